@@ -0,0 +1,278 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "LinkWrapper.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modules/system/network-stack/NetworkStack.h"
+#include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/time/Time.h"
+#include "pedigree/kernel/utilities/pocketknife.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+static uint64_t monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * Time::Multiplier::Second) + ts.tv_nsec;
+}
+
+LinkWrapper::LinkWrapper(int fd, const LinkParameters &params)
+    : m_Fd(fd), m_Params(params), m_Queue(), m_Lock(false), m_Cond(),
+      m_LinkFree(0), m_Seed(), m_nSent(0), m_nLost(0), m_bRunning(false),
+      m_pReceiver(0), m_pTransmitter(0)
+{
+    m_SpecificType = "Pedigree Emulated Link";
+
+    // Seed per-process so both directions don't lose the same frames.
+    uint64_t seed = monotonicTime() ^ getpid();
+    m_Seed[0] = seed & 0xFFFF;
+    m_Seed[1] = (seed >> 16) & 0xFFFF;
+    m_Seed[2] = (seed >> 32) & 0xFFFF;
+}
+
+LinkWrapper::~LinkWrapper()
+{
+    stop();
+}
+
+Device::Type LinkWrapper::getType()
+{
+    return Device::Network;
+}
+
+void LinkWrapper::getName(String &str)
+{
+    str = "Pedigree Emulated Link";
+}
+
+void LinkWrapper::dump(String &str)
+{
+    str = "Pedigree Emulated Link";
+}
+
+bool LinkWrapper::send(size_t nBytes, uintptr_t buffer)
+{
+    if (m_Fd < 0 || nBytes > sizeof(frame::buffer))
+    {
+        return false;
+    }
+
+    LockGuard<Mutex> guard(m_Lock);
+
+    ++m_nSent;
+
+    // Lost frames still "succeed" - the sender has no way to know.
+    if (m_Params.loss > 0 && erand48(m_Seed) < m_Params.loss)
+    {
+        ++m_nLost;
+        return true;
+    }
+
+    // An ideal link needs no queueing at all.
+    if (!m_Params.latency && !m_Params.bandwidth)
+    {
+        return transmit(nBytes, reinterpret_cast<const void *>(buffer));
+    }
+
+    if (m_Queue.count() >= m_Params.queueLength)
+    {
+        ++m_nLost;
+        return true;
+    }
+
+    // The frame can't start serialising until the link is free, and arrives
+    // one propagation delay after the last bit has left.
+    uint64_t now = monotonicTime();
+    uint64_t start = m_LinkFree > now ? m_LinkFree : now;
+    uint64_t serialise = 0;
+    if (m_Params.bandwidth)
+    {
+        serialise =
+            (nBytes * 8 * Time::Multiplier::Second) / m_Params.bandwidth;
+    }
+    m_LinkFree = start + serialise;
+
+    frame *f = new frame;
+    f->due = m_LinkFree + m_Params.latency;
+    f->bytes = nBytes;
+    MemoryCopy(f->buffer, reinterpret_cast<void *>(buffer), nBytes);
+
+    bool wasEmpty = m_Queue.count() == 0;
+    m_Queue.pushBack(f);
+    if (wasEmpty)
+    {
+        m_Cond.signal();
+    }
+
+    return true;
+}
+
+bool LinkWrapper::setStationInfo(const StationInfo &info)
+{
+    m_StationInfo.ipv4 = info.ipv4;
+    m_StationInfo.subnetMask = info.subnetMask;
+    m_StationInfo.broadcast = info.broadcast;
+    m_StationInfo.gateway = info.gateway;
+    m_StationInfo.mac = info.mac;
+
+    return true;
+}
+
+const StationInfo &LinkWrapper::getStationInfo()
+{
+    return m_StationInfo;
+}
+
+uint32_t LinkWrapper::getChecksumOffload()
+{
+    return m_Params.checksumOffload;
+}
+
+void LinkWrapper::start()
+{
+    m_bRunning = true;
+    m_pReceiver = pocketknife::runConcurrentlyAttached(receiveThread, this);
+    m_pTransmitter = pocketknife::runConcurrentlyAttached(transmitThread, this);
+}
+
+void LinkWrapper::stop()
+{
+    if (!m_bRunning)
+    {
+        return;
+    }
+
+    m_Lock.acquire();
+    m_bRunning = false;
+    m_Cond.signal();
+    m_Lock.release();
+
+    pocketknife::attachTo(m_pTransmitter);
+    pocketknife::attachTo(m_pReceiver);
+
+    while (m_Queue.count())
+    {
+        delete m_Queue.popFront();
+    }
+}
+
+int LinkWrapper::receiveThread(void *param)
+{
+    LinkWrapper *wrapper = reinterpret_cast<LinkWrapper *>(param);
+    wrapper->receiveLoop();
+    return 0;
+}
+
+void LinkWrapper::receiveLoop()
+{
+    char buffer[sizeof(frame::buffer)];
+
+    struct pollfd pfd;
+    pfd.fd = m_Fd;
+    pfd.events = POLLIN;
+
+    while (m_bRunning)
+    {
+        // Time out regularly so stop() doesn't have to wait for traffic.
+        int ready = poll(&pfd, 1, 100);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            perror("Failed to poll link");
+            return;
+        }
+        else if (!ready)
+        {
+            continue;
+        }
+
+        ssize_t bytes = read(m_Fd, buffer, sizeof buffer);
+        if (bytes <= 0)
+        {
+            // Other end of the link has gone away.
+            return;
+        }
+
+        // receive() copies the frame into a pbuf before returning.
+        NetworkStack::instance().receive(
+            bytes, reinterpret_cast<uintptr_t>(buffer), this, 0);
+    }
+}
+
+int LinkWrapper::transmitThread(void *param)
+{
+    LinkWrapper *wrapper = reinterpret_cast<LinkWrapper *>(param);
+    wrapper->transmitLoop();
+    return 0;
+}
+
+void LinkWrapper::transmitLoop()
+{
+    m_Lock.acquire();
+    while (m_bRunning)
+    {
+        if (!m_Queue.count())
+        {
+            m_Cond.wait(m_Lock);
+            continue;
+        }
+
+        frame *f = *m_Queue.begin();
+        uint64_t now = monotonicTime();
+        if (f->due > now)
+        {
+            Time::Timestamp timeout = f->due - now;
+            ConditionVariable::WaitResult result =
+                m_Cond.wait(m_Lock, timeout);
+            if (result.hasError())
+            {
+                // Timed out waits return without the lock held.
+                m_Lock.acquire();
+            }
+            continue;
+        }
+
+        m_Queue.popFront();
+
+        m_Lock.release();
+        transmit(f->bytes, f->buffer);
+        delete f;
+        m_Lock.acquire();
+    }
+    m_Lock.release();
+}
+
+bool LinkWrapper::transmit(size_t nBytes, const void *buffer)
+{
+    // SOCK_SEQPACKET preserves frame boundaries, so each write is one frame.
+    ssize_t written = write(m_Fd, buffer, nBytes);
+    return written == static_cast<ssize_t>(nBytes);
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LINKWRAPPER_H
+#define LINKWRAPPER_H
+
+#include "pedigree/kernel/machine/Network.h"
+#include "pedigree/kernel/process/ConditionVariable.h"
+#include "pedigree/kernel/process/Mutex.h"
+#include "pedigree/kernel/utilities/List.h"
+
+/** Characteristics of an emulated link. */
+struct LinkParameters
+{
+    LinkParameters()
+        : latency(0), loss(0), bandwidth(0), queueLength(1000),
+          checksumOffload(0)
+    {
+    }
+
+    /// One-way propagation delay, in nanoseconds.
+    uint64_t latency;
+    /// Probability (0 - 1) that any given frame is lost in transit.
+    double loss;
+    /// Link rate in bits per second, or zero for an unlimited link.
+    uint64_t bandwidth;
+    /// Number of frames that may wait for the link before tail drops start.
+    size_t queueLength;
+    /// Checksums the link claims to handle (Network::ChecksumOffload). The
+    /// link never corrupts frames, so this just skips the work in the stack.
+    uint32_t checksumOffload;
+};
+
+/**
+ * A Network device that carries Ethernet frames over one end of a host
+ * socketpair, so two network stacks can be wired back to back without a
+ * TUN/TAP device. Frames are shaped on transmit according to the given
+ * LinkParameters.
+ */
+class LinkWrapper : public Network
+{
+  public:
+    LinkWrapper(int fd, const LinkParameters &params);
+    virtual ~LinkWrapper();
+
+    virtual Type getType();
+    virtual void getName(String &str);
+    virtual void dump(String &str);
+
+    /** Sends a given packet through the device.
+     * \param nBytes The number of bytes to send.
+     * \param buffer A buffer with the packet to send */
+    virtual bool send(size_t nBytes, uintptr_t buffer);
+
+    /** Sets station information (such as IP addresses)
+     * \param info The information to set as the station info */
+    virtual bool setStationInfo(const StationInfo &info);
+
+    /** Gets station information (such as IP addresses) */
+    virtual const StationInfo &getStationInfo();
+
+    /** Which checksums the link handles itself. */
+    virtual uint32_t getChecksumOffload();
+
+    /** Starts the receive and transmit threads for the link. */
+    void start();
+
+    /** Stops the link, discarding any frames still in flight. */
+    void stop();
+
+    /** Number of frames handed to the link for transmission. */
+    size_t framesSent() const
+    {
+        return m_nSent;
+    }
+
+    /** Number of frames lost to emulated loss or a full queue. */
+    size_t framesLost() const
+    {
+        return m_nLost;
+    }
+
+  private:
+    static int receiveThread(void *param);
+    void receiveLoop();
+
+    static int transmitThread(void *param);
+    void transmitLoop();
+
+    /** Writes a frame to the other end of the link. */
+    bool transmit(size_t nBytes, const void *buffer);
+
+    struct frame
+    {
+        /// Time at which the frame arrives at the other end of the link.
+        uint64_t due;
+        size_t bytes;
+        char buffer[1600];
+    };
+
+    int m_Fd;
+    LinkParameters m_Params;
+
+    /// Frames waiting for their delivery time, in delivery order.
+    List<frame *> m_Queue;
+    Mutex m_Lock;
+    ConditionVariable m_Cond;
+
+    /// Time at which the link finishes serialising the last queued frame.
+    uint64_t m_LinkFree;
+
+    /// State for the loss generator.
+    unsigned short m_Seed[3];
+
+    size_t m_nSent;
+    size_t m_nLost;
+
+    volatile bool m_bRunning;
+    void *m_pReceiver;
+    void *m_pTransmitter;
+};
+
+#endif  // LINKWRAPPER_H
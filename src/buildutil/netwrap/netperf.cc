@@ -0,0 +1,1100 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "LinkWrapper.h"
+
+#include "modules/system/network-stack/NetworkStack.h"
+#include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/process/Mutex.h"
+#include "pedigree/kernel/utilities/pocketknife.h"
+
+#include "modules/system/lwip/include/lwip/api.h"
+#include "modules/system/lwip/include/lwip/ip_addr.h"
+#include "modules/system/lwip/include/lwip/netif.h"
+#include "modules/system/lwip/include/lwip/tcp.h"
+#include "modules/system/lwip/include/lwip/tcpip.h"
+
+/**
+ * netperf: measures the Pedigree network stack against itself.
+ *
+ * lwIP keeps all of its state in globals, so two stacks cannot share an
+ * address space. Instead, we fork: each process brings up its own
+ * NetworkStack and lwIP instance on a LinkWrapper, and the two LinkWrappers
+ * are joined by a SOCK_SEQPACKET socketpair. The parent runs the client side
+ * of each workload, the child runs the servers. A second socketpair carries
+ * control messages and the server's counters so the parent can report on
+ * both ends of the link.
+ */
+
+enum Ports
+{
+    BulkPort = 5001,
+    RequestResponsePort = 5002,
+    AcceptPort = 5003,
+    DatagramPort = 5004,
+};
+
+static const uint8_t ClientHost = 1;
+static const uint8_t ServerHost = 2;
+
+struct Options
+{
+    Options()
+        : link(), workload("all"), bulkBytes(64 << 20), bulkChunk(16384),
+          transactions(10000), requestSize(64), responseSize(64),
+          connections(1000), datagrams(100000), datagramSize(64),
+          verbose(false)
+    {
+    }
+
+    LinkParameters link;
+    const char *workload;
+
+    uint64_t bulkBytes;
+    size_t bulkChunk;
+
+    size_t transactions;
+    size_t requestSize;
+    size_t responseSize;
+
+    size_t connections;
+
+    size_t datagrams;
+    size_t datagramSize;
+
+    bool verbose;
+};
+
+enum ControlOp
+{
+    ControlReset,
+    ControlReport,
+    ControlQuit,
+};
+
+/** Sent from the client to the server over the control channel. */
+struct ControlMessage
+{
+    uint32_t op;
+    /// For ControlReport: connections the server should see before replying.
+    uint64_t connections;
+    /// For ControlReport: bytes the server should see before replying.
+    uint64_t bytes;
+};
+
+/** Server-side counters, returned in response to every ControlMessage. */
+struct ServerReport
+{
+    uint64_t bytes;
+    uint64_t packets;
+    uint64_t connections;
+    /// Times of the first and last received payload.
+    uint64_t first;
+    uint64_t last;
+    /// CPU time the server process used since the last ControlReset.
+    uint64_t cpu;
+};
+
+class StreamingStderrLogger : public Log::LogCallback
+{
+  public:
+    void callback(const LogCord &cord)
+    {
+        for (size_t i = 0; i < cord.length(); ++i)
+        {
+            fprintf(stderr, "%c", cord[i]);
+        }
+    }
+};
+
+static Options g_Options;
+
+static std::atomic<uint64_t> g_Bytes;
+static std::atomic<uint64_t> g_Packets;
+static std::atomic<uint64_t> g_Connections;
+static std::atomic<uint64_t> g_First;
+static std::atomic<uint64_t> g_Last;
+static std::atomic<uint64_t> g_ActiveStreams;
+
+/// Connections accepted on AcceptPort, held open until the next report.
+static std::vector<struct netconn *> g_HeldConnections;
+static Mutex g_HeldLock(false);
+
+static uint64_t monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * Time::Multiplier::Second) + ts.tv_nsec;
+}
+
+static uint64_t cpuTime()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    uint64_t result = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+                      Time::Multiplier::Second;
+    result += (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) *
+              Time::Multiplier::Microsecond;
+    return result;
+}
+
+static void sleepFor(uint64_t nanoseconds)
+{
+    struct timespec ts;
+    ts.tv_sec = nanoseconds / Time::Multiplier::Second;
+    ts.tv_nsec = nanoseconds % Time::Multiplier::Second;
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+static bool readFully(int fd, void *buffer, size_t length)
+{
+    char *p = reinterpret_cast<char *>(buffer);
+    while (length)
+    {
+        ssize_t r = read(fd, p, length);
+        if (r <= 0)
+        {
+            if (r < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        p += r;
+        length -= r;
+    }
+
+    return true;
+}
+
+static bool writeFully(int fd, const void *buffer, size_t length)
+{
+    const char *p = reinterpret_cast<const char *>(buffer);
+    while (length)
+    {
+        ssize_t r = write(fd, p, length);
+        if (r <= 0)
+        {
+            if (r < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        p += r;
+        length -= r;
+    }
+
+    return true;
+}
+
+static Mutex tcpipInitPending(false);
+
+static void tcpipInitComplete(void *)
+{
+    tcpipInitPending.release();
+}
+
+/** Brings up this process' network stack on one end of the link. */
+static LinkWrapper *bringUp(int fd, uint8_t host)
+{
+    tcpipInitPending.acquire();
+
+    // make sure the multi threaded lwIP implementation is ready to go
+    tcpip_init(tcpipInitComplete, nullptr);
+
+    tcpipInitPending.acquire();
+
+    new NetworkStack();
+
+    StationInfo info;
+    info.ipv4.setIp(Network::convertToIpv4(10, 0, 0, host));
+    info.subnetMask.setIp(Network::convertToIpv4(255, 255, 255, 0));
+    info.broadcast.setIp(Network::convertToIpv4(10, 0, 0, 255));
+    uint8_t mac[6] = {0x02, 0, 0, 0, 0, host};
+    for (size_t i = 0; i < 6; ++i)
+    {
+        info.mac.setMac(mac[i], i);
+    }
+
+    LinkWrapper *link = new LinkWrapper(fd, g_Options.link);
+    link->setStationInfo(info);
+    NetworkStack::instance().registerDevice(link);
+
+    struct netif *iface = NetworkStack::instance().getInterface(link);
+
+    ip4_addr_t ipaddr;
+    ip4_addr_t netmask;
+    ip4_addr_t gateway;
+    ByteSet(&gateway, 0, sizeof(gateway));
+
+    ipaddr.addr = info.ipv4.getIp();
+    netmask.addr = info.subnetMask.getIp();
+
+    netif_set_addr(iface, &ipaddr, &netmask, &gateway);
+    netif_set_default(iface);
+    netif_set_link_up(iface);
+    netif_set_up(iface);
+
+    link->start();
+
+    return link;
+}
+
+static void noteArrival()
+{
+    uint64_t now = monotonicTime();
+    uint64_t zero = 0;
+    g_First.compare_exchange_strong(zero, now);
+    g_Last = now;
+}
+
+static struct netconn *listenOn(enum netconn_type type, uint16_t port)
+{
+    struct netconn *server = netconn_new(type);
+    if (!server)
+    {
+        return nullptr;
+    }
+
+    ip_addr_t ipaddr;
+    ByteSet(&ipaddr, 0, sizeof(ipaddr));
+
+    if (netconn_bind(server, &ipaddr, port) != ERR_OK)
+    {
+        fprintf(stderr, "netperf: cannot bind to port %u\n", port);
+        netconn_delete(server);
+        return nullptr;
+    }
+
+    if (type == NETCONN_TCP)
+    {
+        netconn_listen(server);
+    }
+
+    return server;
+}
+
+/** Request/response needs every segment sent as soon as it's written. */
+static void disableNagle(struct netconn *conn)
+{
+    // Not strictly safe outside the tcpip thread, but the flag is only ever
+    // read by it and nothing else touches this pcb yet.
+    tcp_nagle_disable(conn->pcb.tcp);
+}
+
+static int bulkSink(void *param)
+{
+    struct netconn *conn = reinterpret_cast<struct netconn *>(param);
+
+    struct netbuf *buf = nullptr;
+    while (netconn_recv(conn, &buf) == ERR_OK)
+    {
+        g_Bytes += netbuf_len(buf);
+        noteArrival();
+        netbuf_delete(buf);
+    }
+
+    netconn_close(conn);
+    netconn_delete(conn);
+
+    --g_ActiveStreams;
+    return 0;
+}
+
+static int bulkServer(void *param)
+{
+    struct netconn *server = reinterpret_cast<struct netconn *>(param);
+
+    struct netconn *conn = nullptr;
+    while (netconn_accept(server, &conn) == ERR_OK)
+    {
+        ++g_ActiveStreams;
+        pocketknife::runConcurrently(bulkSink, conn);
+    }
+
+    return 0;
+}
+
+static int requestResponseConnection(void *param)
+{
+    struct netconn *conn = reinterpret_cast<struct netconn *>(param);
+    disableNagle(conn);
+
+    char *response = new char[g_Options.responseSize];
+    ByteSet(response, 0x5A, g_Options.responseSize);
+
+    size_t pending = 0;
+    struct netbuf *buf = nullptr;
+    while (netconn_recv(conn, &buf) == ERR_OK)
+    {
+        size_t len = netbuf_len(buf);
+        g_Bytes += len;
+        noteArrival();
+        netbuf_delete(buf);
+
+        // Requests may be coalesced or split by the stack; answer each one
+        // as soon as all of it has arrived.
+        pending += len;
+        while (pending >= g_Options.requestSize)
+        {
+            pending -= g_Options.requestSize;
+            ++g_Packets;
+            netconn_write(
+                conn, response, g_Options.responseSize, NETCONN_COPY);
+        }
+    }
+
+    delete[] response;
+
+    netconn_close(conn);
+    netconn_delete(conn);
+
+    --g_ActiveStreams;
+    return 0;
+}
+
+static int requestResponseServer(void *param)
+{
+    struct netconn *server = reinterpret_cast<struct netconn *>(param);
+
+    struct netconn *conn = nullptr;
+    while (netconn_accept(server, &conn) == ERR_OK)
+    {
+        ++g_ActiveStreams;
+        pocketknife::runConcurrently(requestResponseConnection, conn);
+    }
+
+    return 0;
+}
+
+static int acceptServer(void *param)
+{
+    struct netconn *server = reinterpret_cast<struct netconn *>(param);
+
+    struct netconn *conn = nullptr;
+    while (netconn_accept(server, &conn) == ERR_OK)
+    {
+        g_HeldLock.acquire();
+        g_HeldConnections.push_back(conn);
+        g_HeldLock.release();
+
+        ++g_Connections;
+        noteArrival();
+    }
+
+    return 0;
+}
+
+static int datagramServer(void *param)
+{
+    struct netconn *server = reinterpret_cast<struct netconn *>(param);
+
+    struct netbuf *buf = nullptr;
+    while (netconn_recv(server, &buf) == ERR_OK)
+    {
+        g_Bytes += netbuf_len(buf);
+        ++g_Packets;
+        noteArrival();
+        netbuf_delete(buf);
+    }
+
+    return 0;
+}
+
+static void resetCounters()
+{
+    g_Bytes = 0;
+    g_Packets = 0;
+    g_Connections = 0;
+    g_First = 0;
+    g_Last = 0;
+}
+
+static void releaseHeldConnections()
+{
+    g_HeldLock.acquire();
+    for (auto conn : g_HeldConnections)
+    {
+        netconn_close(conn);
+        netconn_delete(conn);
+    }
+    g_HeldConnections.clear();
+    g_HeldLock.release();
+}
+
+static int runServer(int linkFd, int controlFd)
+{
+    LinkWrapper *link = bringUp(linkFd, ServerHost);
+
+    // Listen on everything before the client can be told we're up, or its
+    // first connection can race the listener and get reset.
+    struct netconn *bulk = listenOn(NETCONN_TCP, BulkPort);
+    struct netconn *rr = listenOn(NETCONN_TCP, RequestResponsePort);
+    struct netconn *accepts = listenOn(NETCONN_TCP, AcceptPort);
+    struct netconn *datagram = listenOn(NETCONN_UDP, DatagramPort);
+    if (!bulk || !rr || !accepts || !datagram)
+    {
+        return 1;
+    }
+
+    pocketknife::runConcurrently(bulkServer, bulk);
+    pocketknife::runConcurrently(requestResponseServer, rr);
+    pocketknife::runConcurrently(acceptServer, accepts);
+    pocketknife::runConcurrently(datagramServer, datagram);
+
+    uint64_t cpuStart = cpuTime();
+
+    ControlMessage msg;
+    while (readFully(controlFd, &msg, sizeof(msg)))
+    {
+        if (msg.op == ControlReset)
+        {
+            resetCounters();
+            cpuStart = cpuTime();
+        }
+        else if (msg.op == ControlReport)
+        {
+            // Give the stack a chance to deliver everything the client
+            // has sent; with emulated loss that can take retransmissions.
+            uint64_t deadline = monotonicTime() + (30 * Time::Multiplier::Second);
+            while (monotonicTime() < deadline)
+            {
+                if (g_Connections >= msg.connections &&
+                    g_Bytes >= msg.bytes && !g_ActiveStreams)
+                {
+                    break;
+                }
+
+                sleepFor(Time::Multiplier::Millisecond);
+            }
+
+            releaseHeldConnections();
+        }
+
+        ServerReport report;
+        report.bytes = g_Bytes;
+        report.packets = g_Packets;
+        report.connections = g_Connections;
+        report.first = g_First;
+        report.last = g_Last;
+        report.cpu = cpuTime() - cpuStart;
+
+        if (!writeFully(controlFd, &report, sizeof(report)))
+        {
+            break;
+        }
+
+        if (msg.op == ControlQuit)
+        {
+            break;
+        }
+    }
+
+    link->stop();
+    return 0;
+}
+
+static bool control(
+    int fd, ControlOp op, ServerReport &report, uint64_t connections = 0,
+    uint64_t bytes = 0)
+{
+    ControlMessage msg;
+    ByteSet(&msg, 0, sizeof(msg));
+    msg.op = op;
+    msg.connections = connections;
+    msg.bytes = bytes;
+
+    if (!writeFully(fd, &msg, sizeof(msg)) ||
+        !readFully(fd, &report, sizeof(report)))
+    {
+        fprintf(stderr, "netperf: lost contact with the server process\n");
+        return false;
+    }
+
+    return true;
+}
+
+static struct netconn *connectTo(uint16_t port)
+{
+    struct netconn *conn = netconn_new(NETCONN_TCP);
+    if (!conn)
+    {
+        return nullptr;
+    }
+
+    ip_addr_t addr;
+    IP_ADDR4(&addr, 10, 0, 0, ServerHost);
+
+    err_t e = netconn_connect(conn, &addr, port);
+    if (e != ERR_OK)
+    {
+        fprintf(
+            stderr, "netperf: connect to port %u failed: %s\n", port,
+            lwip_strerr(e));
+        netconn_delete(conn);
+        return nullptr;
+    }
+
+    return conn;
+}
+
+static double seconds(uint64_t nanoseconds)
+{
+    return nanoseconds / static_cast<double>(Time::Multiplier::Second);
+}
+
+/** Prints latency percentiles (in microseconds) of the given samples. */
+static void printLatencies(const char *what, std::vector<uint64_t> &samples)
+{
+    if (samples.empty())
+    {
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    const double percentiles[] = {0.5, 0.9, 0.99, 0.999};
+    printf("  %s latency (us):", what);
+    for (auto p : percentiles)
+    {
+        size_t index = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+        printf(
+            " p%g %.1f", p * 100,
+            samples[index] /
+                static_cast<double>(Time::Multiplier::Microsecond));
+    }
+    printf(
+        " max %.1f\n",
+        samples.back() / static_cast<double>(Time::Multiplier::Microsecond));
+}
+
+static bool runBulk(int controlFd)
+{
+    ServerReport report;
+    if (!control(controlFd, ControlReset, report))
+    {
+        return false;
+    }
+
+    char *chunk = new char[g_Options.bulkChunk];
+    ByteSet(chunk, 0xAB, g_Options.bulkChunk);
+
+    uint64_t cpu = cpuTime();
+    uint64_t start = monotonicTime();
+
+    struct netconn *conn = connectTo(BulkPort);
+    if (!conn)
+    {
+        delete[] chunk;
+        return false;
+    }
+
+    uint64_t remaining = g_Options.bulkBytes;
+    while (remaining)
+    {
+        size_t n = g_Options.bulkChunk;
+        if (n > remaining)
+        {
+            n = remaining;
+        }
+
+        err_t e = netconn_write(conn, chunk, n, NETCONN_COPY);
+        if (e != ERR_OK)
+        {
+            fprintf(stderr, "netperf: bulk write failed: %s\n", lwip_strerr(e));
+            break;
+        }
+
+        remaining -= n;
+    }
+
+    netconn_close(conn);
+    netconn_delete(conn);
+    delete[] chunk;
+
+    // The server only replies once it has seen the whole stream.
+    if (!control(
+            controlFd, ControlReport, report, 0,
+            g_Options.bulkBytes - remaining))
+    {
+        return false;
+    }
+
+    uint64_t elapsed = monotonicTime() - start;
+    cpu = (cpuTime() - cpu) + report.cpu;
+
+    printf(
+        "tcp-bulk: %" PRIu64 " bytes in %.3f s: %.2f Mbit/s, %.2f ns CPU/byte\n",
+        report.bytes, seconds(elapsed),
+        (report.bytes * 8) / seconds(elapsed) / 1e6,
+        report.bytes ? cpu / static_cast<double>(report.bytes) : 0.0);
+
+    return report.bytes == g_Options.bulkBytes;
+}
+
+static bool runRequestResponse(int controlFd)
+{
+    ServerReport report;
+    if (!control(controlFd, ControlReset, report))
+    {
+        return false;
+    }
+
+    char *request = new char[g_Options.requestSize];
+    ByteSet(request, 0xA5, g_Options.requestSize);
+
+    struct netconn *conn = connectTo(RequestResponsePort);
+    if (!conn)
+    {
+        delete[] request;
+        return false;
+    }
+    disableNagle(conn);
+
+    std::vector<uint64_t> latencies;
+    latencies.reserve(g_Options.transactions);
+
+    uint64_t cpu = cpuTime();
+    uint64_t start = monotonicTime();
+
+    bool ok = true;
+    for (size_t i = 0; ok && i < g_Options.transactions; ++i)
+    {
+        uint64_t sent = monotonicTime();
+
+        if (netconn_write(conn, request, g_Options.requestSize, NETCONN_COPY) !=
+            ERR_OK)
+        {
+            ok = false;
+            break;
+        }
+
+        size_t received = 0;
+        while (received < g_Options.responseSize)
+        {
+            struct netbuf *buf = nullptr;
+            if (netconn_recv(conn, &buf) != ERR_OK)
+            {
+                ok = false;
+                break;
+            }
+
+            received += netbuf_len(buf);
+            netbuf_delete(buf);
+        }
+
+        latencies.push_back(monotonicTime() - sent);
+    }
+
+    uint64_t elapsed = monotonicTime() - start;
+
+    netconn_close(conn);
+    netconn_delete(conn);
+    delete[] request;
+
+    if (!control(controlFd, ControlReport, report))
+    {
+        return false;
+    }
+
+    cpu = (cpuTime() - cpu) + report.cpu;
+
+    size_t completed = latencies.size();
+    uint64_t bytes =
+        completed * (g_Options.requestSize + g_Options.responseSize);
+    printf(
+        "tcp-rr: %zu transactions (%zu/%zu bytes) in %.3f s: %.0f "
+        "transactions/s, %.2f ns CPU/byte\n",
+        completed, g_Options.requestSize, g_Options.responseSize,
+        seconds(elapsed), completed / seconds(elapsed),
+        bytes ? cpu / static_cast<double>(bytes) : 0.0);
+    printLatencies("round trip", latencies);
+
+    return ok;
+}
+
+static bool runAccept(int controlFd)
+{
+    ServerReport report;
+    if (!control(controlFd, ControlReset, report))
+    {
+        return false;
+    }
+
+    std::vector<struct netconn *> connections;
+    connections.reserve(g_Options.connections);
+
+    std::vector<uint64_t> latencies;
+    latencies.reserve(g_Options.connections);
+
+    uint64_t cpu = cpuTime();
+    uint64_t start = monotonicTime();
+
+    // Hold every connection open so both stacks carry the full set of PCBs
+    // by the time the last one is accepted.
+    for (size_t i = 0; i < g_Options.connections; ++i)
+    {
+        uint64_t begin = monotonicTime();
+        struct netconn *conn = connectTo(AcceptPort);
+        if (!conn)
+        {
+            break;
+        }
+
+        latencies.push_back(monotonicTime() - begin);
+        connections.push_back(conn);
+    }
+
+    uint64_t elapsed = monotonicTime() - start;
+
+    if (!control(controlFd, ControlReport, report, connections.size()))
+    {
+        return false;
+    }
+
+    for (auto conn : connections)
+    {
+        netconn_close(conn);
+        netconn_delete(conn);
+    }
+
+    cpu = (cpuTime() - cpu) + report.cpu;
+
+    printf(
+        "tcp-accept: %" PRIu64 " connections accepted in %.3f s: %.0f "
+        "connections/s, %.2f us CPU/connection\n",
+        report.connections, seconds(elapsed),
+        report.connections / seconds(elapsed),
+        report.connections ? (cpu / static_cast<double>(report.connections)) /
+                                 Time::Multiplier::Microsecond
+                           : 0.0);
+    printLatencies("connect", latencies);
+
+    return connections.size() == g_Options.connections;
+}
+
+static bool runDatagrams(int controlFd)
+{
+    struct netconn *conn = netconn_new(NETCONN_UDP);
+    if (!conn)
+    {
+        return false;
+    }
+
+    ip_addr_t addr;
+    IP_ADDR4(&addr, 10, 0, 0, ServerHost);
+    netconn_connect(conn, &addr, DatagramPort);
+
+    char *payload = new char[g_Options.datagramSize];
+    ByteSet(payload, 0x3C, g_Options.datagramSize);
+
+    struct netbuf *buf = netbuf_new();
+    netbuf_ref(buf, payload, g_Options.datagramSize);
+
+    // UDP has no handshake to resolve ARP for us, and lwIP only queues one
+    // frame behind an ARP request; prime the cache before measuring.
+    netconn_send(conn, buf);
+    sleepFor(
+        (100 * Time::Multiplier::Millisecond) + (2 * g_Options.link.latency));
+
+    ServerReport report;
+    if (!control(controlFd, ControlReset, report))
+    {
+        return false;
+    }
+
+    uint64_t cpu = cpuTime();
+    uint64_t start = monotonicTime();
+
+    size_t failed = 0;
+    for (size_t i = 0; i < g_Options.datagrams; ++i)
+    {
+        if (netconn_send(conn, buf) != ERR_OK)
+        {
+            ++failed;
+        }
+    }
+
+    uint64_t elapsed = monotonicTime() - start;
+
+    // Let anything still queued on the link drain before asking for counts.
+    sleepFor(
+        (100 * Time::Multiplier::Millisecond) + (2 * g_Options.link.latency));
+
+    if (!control(controlFd, ControlReport, report))
+    {
+        return false;
+    }
+
+    cpu = (cpuTime() - cpu) + report.cpu;
+
+    netbuf_delete(buf);
+    netconn_delete(conn);
+    delete[] payload;
+
+    uint64_t span = report.last - report.first;
+    size_t sent = g_Options.datagrams - failed;
+    printf(
+        "udp-pps: %zu x %zu bytes sent in %.3f s (%.0f pps), %" PRIu64
+        " received (%.0f pps), %.2f%% lost, %.2f ns CPU/byte\n",
+        sent, g_Options.datagramSize, seconds(elapsed),
+        sent / seconds(elapsed), report.packets,
+        span ? report.packets / seconds(span) : 0.0,
+        sent ? 100.0 * (sent - std::min<uint64_t>(sent, report.packets)) / sent : 0.0,
+        report.bytes ? cpu / static_cast<double>(report.bytes) : 0.0);
+
+    return true;
+}
+
+static int runClient(int linkFd, int controlFd)
+{
+    LinkWrapper *link = bringUp(linkFd, ClientHost);
+
+    struct
+    {
+        const char *name;
+        bool (*run)(int);
+    } workloads[] = {
+        {"bulk", runBulk},
+        {"rr", runRequestResponse},
+        {"accept", runAccept},
+        {"udp", runDatagrams},
+    };
+
+    bool all = !strcmp(g_Options.workload, "all");
+    bool found = false;
+    int result = 0;
+    for (auto &workload : workloads)
+    {
+        if (!all && strcmp(g_Options.workload, workload.name))
+        {
+            continue;
+        }
+
+        found = true;
+        if (!workload.run(controlFd))
+        {
+            fprintf(stderr, "netperf: %s workload failed\n", workload.name);
+            result = 1;
+        }
+    }
+
+    if (!found)
+    {
+        fprintf(stderr, "netperf: unknown workload '%s'\n", g_Options.workload);
+        result = 1;
+    }
+
+    printf(
+        "link: %zu frames sent by the client, %zu lost\n", link->framesSent(),
+        link->framesLost());
+
+    ServerReport report;
+    control(controlFd, ControlQuit, report);
+
+    link->stop();
+    return result;
+}
+
+static void usage()
+{
+    fprintf(
+        stderr,
+        "Usage: netperf [options]\n"
+        "Run two instances of the Pedigree network stack back to back over "
+        "an emulated\nlink and measure them.\n\n"
+        "Link options:\n"
+        "  --latency US      One-way link latency in microseconds (default 0).\n"
+        "  --loss PERCENT    Frame loss rate in percent (default 0).\n"
+        "  --bandwidth MBIT  Link rate in Mbit/s (default unlimited).\n"
+        "  --queue FRAMES    Frames queued before tail drop (default 1000).\n"
+        "  --offload         Have the link claim all checksum offloads.\n\n"
+        "Workload options:\n"
+        "  --workload NAME   bulk, rr, accept, udp or all (default all).\n"
+        "  --bytes N         Bytes to send in the bulk workload.\n"
+        "  --transactions N  Request/response transactions to run.\n"
+        "  --request N       Request size for the rr workload.\n"
+        "  --response N      Response size for the rr workload.\n"
+        "  --connections N   Connections to open in the accept workload.\n"
+        "  --datagrams N     Datagrams to send in the udp workload.\n"
+        "  --size N          Datagram payload size for the udp workload.\n\n"
+        "  --verbose, -v     Show network stack log output.\n"
+        "  --help, -h        Print this help and exit successfully.\n");
+}
+
+int main(int argc, char **argv)
+{
+    const struct option long_options[] = {
+        {"latency", required_argument, 0, 'l'},
+        {"loss", required_argument, 0, 'L'},
+        {"bandwidth", required_argument, 0, 'b'},
+        {"queue", required_argument, 0, 'q'},
+        {"offload", no_argument, 0, 'o'},
+        {"workload", required_argument, 0, 'w'},
+        {"bytes", required_argument, 0, 'B'},
+        {"transactions", required_argument, 0, 't'},
+        {"request", required_argument, 0, 'r'},
+        {"response", required_argument, 0, 'R'},
+        {"connections", required_argument, 0, 'c'},
+        {"datagrams", required_argument, 0, 'd'},
+        {"size", required_argument, 0, 's'},
+        {"verbose", no_argument, 0, 'v'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0},
+    };
+
+    while (1)
+    {
+        int c = getopt_long(argc, argv, "vh", long_options, nullptr);
+        if (c == -1)
+        {
+            break;
+        }
+
+        switch (c)
+        {
+            case 'l':
+                g_Options.link.latency =
+                    strtoull(optarg, 0, 10) * Time::Multiplier::Microsecond;
+                break;
+            case 'L':
+                g_Options.link.loss = strtod(optarg, 0) / 100.0;
+                break;
+            case 'b':
+                g_Options.link.bandwidth = strtod(optarg, 0) * 1e6;
+                break;
+            case 'q':
+                g_Options.link.queueLength = strtoul(optarg, 0, 10);
+                break;
+            case 'o':
+                g_Options.link.checksumOffload =
+                    Network::GenerateIpv4Checksum |
+                    Network::GenerateUdpChecksum |
+                    Network::GenerateTcpChecksum | Network::CheckIpv4Checksum |
+                    Network::CheckUdpChecksum | Network::CheckTcpChecksum;
+                break;
+            case 'w':
+                g_Options.workload = optarg;
+                break;
+            case 'B':
+                g_Options.bulkBytes = strtoull(optarg, 0, 10);
+                break;
+            case 't':
+                g_Options.transactions = strtoul(optarg, 0, 10);
+                break;
+            case 'r':
+                g_Options.requestSize = std::max(strtoul(optarg, 0, 10), 1UL);
+                break;
+            case 'R':
+                g_Options.responseSize = std::max(strtoul(optarg, 0, 10), 1UL);
+                break;
+            case 'c':
+                g_Options.connections = strtoul(optarg, 0, 10);
+                break;
+            case 'd':
+                g_Options.datagrams = strtoul(optarg, 0, 10);
+                break;
+            case 's':
+                g_Options.datagramSize = std::max(strtoul(optarg, 0, 10), 1UL);
+                break;
+            case 'v':
+                g_Options.verbose = true;
+                break;
+            case 'h':
+                usage();
+                return 0;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
+    StreamingStderrLogger logger;
+    if (g_Options.verbose)
+    {
+        Log::instance().installCallback(&logger, true);
+    }
+
+    // A dead peer shouldn't kill us mid-report.
+    signal(SIGPIPE, SIG_IGN);
+
+    int link[2];
+    int controlPair[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, link) < 0 ||
+        socketpair(AF_UNIX, SOCK_STREAM, 0, controlPair) < 0)
+    {
+        perror("netperf: socketpair");
+        return 1;
+    }
+
+    // Fork before anything starts a thread.
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("netperf: fork");
+        return 1;
+    }
+    else if (pid == 0)
+    {
+        close(link[0]);
+        close(controlPair[0]);
+
+        int result = runServer(link[1], controlPair[1]);
+        fflush(stdout);
+        _exit(result);
+    }
+
+    close(link[1]);
+    close(controlPair[1]);
+
+    int result = runClient(link[0], controlPair[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    // lwIP's threads are still running and have no way to be shut down, so
+    // skip global destructors rather than pull state out from under them.
+    fflush(stdout);
+    _exit(result);
+}
@@ -20,10 +20,15 @@
 #define PEDIGREE_EXTERNAL_SOURCE 1
 
 #include <errno.h>
+#include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <thread>
+#include <vector>
 
 #include "modules/system/vfs/VFS.h"
 
@@ -39,6 +44,177 @@
 
 UnixFilesystem *g_pUnixFilesystem = 0;
 
+struct Options
+{
+    Options() : bytes(64 << 20), rounds(10000), size(64), quick(false)
+    {
+    }
+
+    /// Bytes to move in each throughput run.
+    size_t bytes;
+    /// Round trips in the latency run.
+    size_t rounds;
+    /// Message size for the latency run.
+    size_t size;
+    /// Skip the benchmarks entirely.
+    bool quick;
+};
+
+static Options g_Options;
+
+static uint64_t monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/** Read exactly \p len bytes from a stream socket. */
+static bool recvFully(int fd, char *buf, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = posix_recv(fd, buf, len, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        buf += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/** Write exactly \p len bytes to a stream socket. */
+static bool sendFully(int fd, const char *buf, size_t len)
+{
+    while (len)
+    {
+        ssize_t n = posix_send(fd, buf, len, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+
+        buf += n;
+        len -= n;
+    }
+
+    return true;
+}
+
+/** Streams g_Options.bytes from \p tx to \p rx in \p chunk sized writes. */
+static void streamThroughput(int tx, int rx, size_t chunk)
+{
+    size_t total = g_Options.bytes;
+    size_t received = 0;
+
+    std::thread reader([rx, chunk, total, &received] {
+        std::vector<char> buf(chunk);
+        while (received < total)
+        {
+            ssize_t n = posix_recv(rx, buf.data(), chunk, 0);
+            if (n <= 0)
+            {
+                break;
+            }
+            received += n;
+        }
+    });
+
+    std::vector<char> buf(chunk, 'x');
+
+    uint64_t start = monotonicTime();
+    for (size_t sent = 0; sent < total;)
+    {
+        size_t len = std::min(chunk, total - sent);
+        if (!sendFully(tx, buf.data(), len))
+        {
+            break;
+        }
+        sent += len;
+    }
+    reader.join();
+    uint64_t elapsed = monotonicTime() - start;
+
+    double seconds = elapsed / 1e9;
+    printf(
+        "  --> %zu byte writes: %zu bytes in %.3f s: %.1f MiB/s\n", chunk,
+        received, seconds, (received / seconds) / (1024.0 * 1024.0));
+}
+
+/** Bounces a message between \p a and \p b, timing each round trip. */
+static void roundTripLatency(int a, int b)
+{
+    size_t size = g_Options.size;
+    size_t rounds = g_Options.rounds;
+
+    std::thread echo([b, size, rounds] {
+        std::vector<char> buf(size);
+        for (size_t i = 0; i < rounds; ++i)
+        {
+            if (!recvFully(b, buf.data(), size) ||
+                !sendFully(b, buf.data(), size))
+            {
+                break;
+            }
+        }
+    });
+
+    std::vector<char> buf(size, 'x');
+    std::vector<uint64_t> samples;
+    samples.reserve(rounds);
+
+    uint64_t start = monotonicTime();
+    for (size_t i = 0; i < rounds; ++i)
+    {
+        uint64_t before = monotonicTime();
+        if (!sendFully(a, buf.data(), size) || !recvFully(a, buf.data(), size))
+        {
+            break;
+        }
+        samples.push_back(monotonicTime() - before);
+    }
+    uint64_t elapsed = monotonicTime() - start;
+    echo.join();
+
+    if (samples.empty())
+    {
+        fprintf(stderr, "FAIL: no round trips completed\n");
+        return;
+    }
+
+    std::sort(samples.begin(), samples.end());
+    auto percentile = [&samples](double p) {
+        size_t idx = static_cast<size_t>(p * (samples.size() - 1));
+        return samples[idx] / 1000.0;
+    };
+
+    printf(
+        "  --> %zu byte messages: %zu round trips in %.3f s: %.0f/s\n", size,
+        samples.size(), elapsed / 1e9, samples.size() / (elapsed / 1e9));
+    printf(
+        "      round trip (us): p50 %.1f p90 %.1f p99 %.1f max %.1f\n",
+        percentile(0.5), percentile(0.9), percentile(0.99),
+        samples.back() / 1000.0);
+}
+
+static void usage()
+{
+    fprintf(
+        stderr,
+        "Usage: unixsockets [options]\n"
+        "Check UNIX socket behaviour, then measure stream throughput and "
+        "latency.\n\n"
+        "  --bytes N    Bytes to stream in each throughput run.\n"
+        "  --rounds N   Round trips for the latency run.\n"
+        "  --size N     Message size for the latency run.\n"
+        "  --quick, -q  Only run the behaviour checks.\n"
+        "  --help, -h   Print this help and exit successfully.\n");
+}
+
 class StreamingStderrLogger : public Log::LogCallback
 {
   public:
@@ -53,6 +229,46 @@ class StreamingStderrLogger : public Log::LogCallback
 
 int main(int argc, char **argv)
 {
+    const struct option long_options[] = {
+        {"bytes", required_argument, 0, 'b'},
+        {"rounds", required_argument, 0, 'r'},
+        {"size", required_argument, 0, 's'},
+        {"quick", no_argument, 0, 'q'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0},
+    };
+
+    while (1)
+    {
+        int c = getopt_long(argc, argv, "qh", long_options, nullptr);
+        if (c == -1)
+        {
+            break;
+        }
+
+        switch (c)
+        {
+            case 'b':
+                g_Options.bytes = strtoull(optarg, 0, 10);
+                break;
+            case 'r':
+                g_Options.rounds = strtoul(optarg, 0, 10);
+                break;
+            case 's':
+                g_Options.size = std::max(strtoul(optarg, 0, 10), 1UL);
+                break;
+            case 'q':
+                g_Options.quick = true;
+                break;
+            case 'h':
+                usage();
+                return 0;
+            default:
+                usage();
+                return 1;
+        }
+    }
+
     StreamingStderrLogger logger;
     Log::instance().installCallback(&logger, true);
 
@@ -299,10 +515,19 @@ int main(int argc, char **argv)
     assert(!memcmp(buf, "hello", 6));
     memset(buf, 0, 128);
 
-    // final test is to have two threads connect to each other
-
     fprintf(stderr, "All OK\n");
 
+    if (!g_Options.quick)
+    {
+        printf("=> Streaming throughput...\n");
+        streamThroughput(s2, fd2, 64);
+        streamThroughput(s2, fd2, 4096);
+        streamThroughput(s2, fd2, 65536);
+
+        printf("=> Streaming latency...\n");
+        roundTripLatency(s2, fd2);
+    }
+
     Log::instance().removeCallback(&logger);
     return 0;
 }
@@ -168,11 +168,18 @@ Spinlock::Spinlock(bool bLocked, bool bAvoidTracking)
 {
 }
 
+Spinlock::~Spinlock() = default;
+
 bool Spinlock::acquire(bool recurse, bool safe)
 {
-    while (!m_Atom.compareAndSwap(true, false))
-        ;
+    // Same queueing as the kernel, without the interrupt handling. Host
+    // threads can be preempted while they wait (kernel spinners can't), so
+    // yield rather than spin while another waiter is at the head of the queue.
+    uint32_t ticket = (m_NextTicket += 1) - 1;
+    while ((m_NowServing != ticket) || !m_Atom.compareAndSwap(true, false))
+        sched_yield();
 
+    m_NowServing = ticket + 1;
     return true;
 }
 
@@ -186,6 +193,16 @@ void Spinlock::exit()
     m_Atom.compareAndSwap(false, true);
 }
 
+bool Spinlock::acquired()
+{
+    return !m_Atom;
+}
+
+bool Spinlock::getStatistics(size_t n, Statistics &stats)
+{
+    return false;
+}
+
 /** ConditionVariable implementation. */
 
 ConditionVariable::ConditionVariable()
@@ -233,6 +250,11 @@ ConditionVariable::wait(Mutex &mutex, Time::Timestamp &timeout)
         clock_gettime(CLOCK_REALTIME, &ts);
         ts.tv_sec += timeout / Time::Multiplier::Second;
         ts.tv_nsec += timeout % Time::Multiplier::Second;
+        if (ts.tv_nsec >= static_cast<long>(Time::Multiplier::Second))
+        {
+            ++ts.tv_sec;
+            ts.tv_nsec -= Time::Multiplier::Second;
+        }
 
         r = pthread_cond_timedwait(cond, m, &ts);
 
@@ -241,17 +263,22 @@ ConditionVariable::wait(Mutex &mutex, Time::Timestamp &timeout)
             // no more time remaining
             timeout = 0;
             err = TimedOut;
+
+            // Match the kernel: a timed out wait returns without the mutex.
+            mutex.release();
         }
         else
         {
             struct timespec ts2;
             clock_gettime(CLOCK_REALTIME, &ts2);
 
-            // Need to calculate the time remaining.
-            uint64_t sec = ts.tv_sec - ts2.tv_sec;
-            uint64_t nsec = ts.tv_nsec - ts2.tv_nsec;
+            // Need to calculate the time remaining (if any - we may have
+            // been woken right at the deadline).
+            int64_t sec = ts.tv_sec - ts2.tv_sec;
+            int64_t nsec = ts.tv_nsec - ts2.tv_nsec;
+            int64_t remaining = (sec * Time::Multiplier::Second) + nsec;
 
-            timeout = (sec * Time::Multiplier::Second) + nsec;
+            timeout = remaining > 0 ? remaining : 0;
         }
     }
 
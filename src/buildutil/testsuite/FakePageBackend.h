@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef BUILDUTIL_TESTSUITE_FAKEPAGEBACKEND_H
+#define BUILDUTIL_TESTSUITE_FAKEPAGEBACKEND_H
+
+#include "pedigree/kernel/processor/types.h"
+
+/// Hands out sequential fake page addresses and counts what comes back.
+/// Backend is the page allocator interface being faked, e.g.
+/// FreePageCache::Backend.
+template <class Backend>
+class FakePageBackend : public Backend
+{
+  public:
+    FakePageBackend(size_t available = ~0UL)
+        : next(0x1000), available(available), takes(0), returns(0),
+          returned(0)
+    {
+    }
+
+    virtual size_t takePages(physical_uintptr_t *pages, size_t count)
+    {
+        ++takes;
+        size_t i = 0;
+        for (; i < count && available; ++i, --available)
+        {
+            pages[i] = next;
+            next += 0x1000;
+        }
+        return i;
+    }
+
+    virtual void returnPages(const physical_uintptr_t *pages, size_t count)
+    {
+        ++returns;
+        returned += count;
+    }
+
+    physical_uintptr_t next;
+    size_t available;
+    size_t takes;
+    size_t returns;
+    size_t returned;
+};
+
+#endif
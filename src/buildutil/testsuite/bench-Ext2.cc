@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+
+#include "buildutil/ext2img/DiskImage.h"
+#include "modules/system/ext2/Ext2File.h"
+#include "modules/system/ext2/Ext2Filesystem.h"
+#include "modules/system/vfs/VFS.h"
+
+/// Set to use an existing image (e.g. one built with ext2img) instead of a
+/// scratch one. It needs a /large.bin and a /sparse.bin to read.
+#define EXT2_IMAGE_ENVIRONMENT "PEDIGREE_EXT2_BENCH_IMAGE"
+
+#define LARGE_FILE_SIZE (24 << 20)
+#define SPARSE_FILE_SIZE (256 << 20)
+#define READ_CHUNK 65536
+#define APPEND_FILE_SIZE (512 << 10)
+#define APPEND_CHUNK 16384
+
+static String g_LargePath("ext2bench»/large.bin");
+static String g_SparsePath("ext2bench»/sparse.bin");
+static String g_Alias("ext2bench");
+
+static File *g_pLargeFile = 0;
+static File *g_pSparseFile = 0;
+
+// Ext2Filesystem wants this from its host in standalone builds.
+uint32_t getUnixTimestamp()
+{
+    return time(0);
+}
+
+static bool writeScratchFiles(const char *dir)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s/large.bin", dir);
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+    {
+        return false;
+    }
+
+    char *buffer = new char[READ_CHUNK];
+    for (size_t i = 0; i < READ_CHUNK; ++i)
+    {
+        buffer[i] = rand();
+    }
+    for (size_t off = 0; off < LARGE_FILE_SIZE; off += READ_CHUNK)
+    {
+        fwrite(buffer, READ_CHUNK, 1, fp);
+    }
+    fclose(fp);
+
+    // Mostly holes, with data scattered out past the triply-indirect block
+    // (with 1K blocks).
+    snprintf(path, sizeof(path), "%s/sparse.bin", dir);
+    fp = fopen(path, "wb");
+    if (!fp)
+    {
+        delete[] buffer;
+        return false;
+    }
+
+    const long offsets[] = {0, 5 << 20, 70 << 20, 200 << 20,
+                            SPARSE_FILE_SIZE - READ_CHUNK};
+    for (size_t i = 0; i < sizeof(offsets) / sizeof(offsets[0]); ++i)
+    {
+        fseek(fp, offsets[i], SEEK_SET);
+        fwrite(buffer, READ_CHUNK, 1, fp);
+    }
+    fclose(fp);
+
+    delete[] buffer;
+    return true;
+}
+
+static char g_ScratchDir[] = "/tmp/ext2bench.XXXXXX";
+
+static void removeScratchFiles(const char *dir)
+{
+    char path[256];
+
+    snprintf(path, sizeof(path), "%s/large.bin", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/sparse.bin", dir);
+    unlink(path);
+    rmdir(dir);
+}
+
+/// Builds a scratch image with 1K blocks, so the block maps are deep.
+static const char *buildScratchImage()
+{
+    char *dir = g_ScratchDir;
+    static char image[sizeof(g_ScratchDir) + 16];
+
+    if (!mkdtemp(dir))
+    {
+        return 0;
+    }
+
+    char files[sizeof(g_ScratchDir) + 16];
+    snprintf(files, sizeof(files), "%s/files", dir);
+    snprintf(image, sizeof(image), "%s/image", dir);
+    if (mkdir(files, 0700) < 0 || !writeScratchFiles(files))
+    {
+        removeScratchFiles(files);
+        rmdir(dir);
+        return 0;
+    }
+
+    // mke2fs keeps the holes in the sparse file.
+    char command[256];
+    snprintf(
+        command, sizeof(command),
+        "mke2fs -q -F -t ext2 -b 1024 -d %s %s 64M >/dev/null 2>&1", files,
+        image);
+    int result = system(command);
+    removeScratchFiles(files);
+    if (result != 0)
+    {
+        unlink(image);
+        rmdir(dir);
+        return 0;
+    }
+
+    return image;
+}
+
+static bool prepareExt2(benchmark::State &state)
+{
+    static bool bPrepared = false;
+    static bool bReady = false;
+    if (!bPrepared)
+    {
+        bPrepared = true;
+
+        const char *image = getenv(EXT2_IMAGE_ENVIRONMENT);
+        bool bScratch = !image;
+        if (bScratch)
+        {
+            image = buildScratchImage();
+        }
+
+        static DiskImage *pDisk = 0;
+        static Ext2Filesystem *pFs = 0;
+        if (image)
+        {
+            pDisk = new DiskImage(image);
+            pFs = new Ext2Filesystem();
+            if (pDisk->initialise() && pFs->initialise(pDisk))
+            {
+                VFS::instance().addAlias(pFs, g_Alias);
+                g_pLargeFile = VFS::instance().find(g_LargePath);
+                g_pSparseFile = VFS::instance().find(g_SparsePath);
+            }
+
+            // The image stays mapped, so the scratch copy can go right away.
+            if (bScratch)
+            {
+                unlink(image);
+                rmdir(g_ScratchDir);
+            }
+        }
+
+        bReady = g_pLargeFile && g_pSparseFile;
+        if (bReady)
+        {
+            // Skip the File's own block cache, so every read maps its block.
+            g_pLargeFile->enableDirect();
+            g_pSparseFile->enableDirect();
+        }
+    }
+
+    if (!bReady)
+    {
+        state.SkipWithError("couldn't build or mount an ext2 image");
+    }
+
+    return bReady;
+}
+
+static void readSequentially(benchmark::State &state, File *pFile)
+{
+    char *buffer = new char[READ_CHUNK];
+    size_t size = pFile->getSize();
+
+    while (state.KeepRunning())
+    {
+        for (size_t off = 0; off < size; off += READ_CHUNK)
+        {
+            benchmark::DoNotOptimize(pFile->read(
+                off, READ_CHUNK, reinterpret_cast<uintptr_t>(buffer)));
+        }
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(size));
+    delete[] buffer;
+}
+
+static void BM_Ext2SequentialRead(benchmark::State &state)
+{
+    if (!prepareExt2(state))
+    {
+        return;
+    }
+
+    readSequentially(state, g_pLargeFile);
+}
+
+static void BM_Ext2SparseSequentialRead(benchmark::State &state)
+{
+    if (!prepareExt2(state))
+    {
+        return;
+    }
+
+    readSequentially(state, g_pSparseFile);
+}
+
+static void BM_Ext2RandomRead(benchmark::State &state)
+{
+    if (!prepareExt2(state))
+    {
+        return;
+    }
+
+    size_t blockSize = g_pLargeFile->getBlockSize();
+    size_t nBlocks = g_pLargeFile->getSize() / blockSize;
+    char *buffer = new char[blockSize];
+
+    srand(0);
+    while (state.KeepRunning())
+    {
+        uint64_t off = (rand() % nBlocks) * blockSize;
+        benchmark::DoNotOptimize(g_pLargeFile->read(
+            off, blockSize, reinterpret_cast<uintptr_t>(buffer)));
+    }
+
+    state.SetBytesProcessed(int64_t(state.iterations()) * int64_t(blockSize));
+    delete[] buffer;
+}
+
+/// Maps every block of the file from an empty block map cache, which is what
+/// happens after the cache has been trimmed under memory pressure.
+static void BM_Ext2ColdBlockMap(benchmark::State &state)
+{
+    if (!prepareExt2(state))
+    {
+        return;
+    }
+
+    Ext2File *pFile =
+        static_cast<Ext2File *>(state.range(0) ? g_pSparseFile : g_pLargeFile);
+    size_t size = pFile->getSize();
+
+    while (state.KeepRunning())
+    {
+        state.PauseTiming();
+        pFile->trimExtents();
+        state.ResumeTiming();
+
+        for (uint64_t off = 0; off < size;)
+        {
+            uint64_t diskOffset = 0;
+            size_t length = 0;
+            if (!pFile->Ext2Node::mapExtent(off, diskOffset, length))
+            {
+                break;
+            }
+            benchmark::DoNotOptimize(diskOffset);
+            off += length;
+        }
+    }
+
+    state.SetItemsProcessed(
+        int64_t(state.iterations()) * int64_t(size / pFile->getBlockSize()));
+}
+
+static String appendPath(size_t n)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "ext2bench»/append-%zd", n);
+    return String(name);
+}
+
+static size_t countExtents(Ext2File *pFile)
+{
+    size_t nExtents = 0;
+    for (uint64_t off = 0; off < pFile->getSize(); ++nExtents)
+    {
+        uint64_t diskOffset = 0;
+        size_t length = 0;
+        if (!pFile->Ext2Node::mapExtent(off, diskOffset, length))
+        {
+            break;
+        }
+        off += length;
+    }
+
+    return nExtents;
+}
+
+/// Appends to several files in turn, as concurrent writers would, and reports
+/// how many extents each file ends up in. The second argument says whether
+/// the files are opened for writing (which lets them reserve blocks).
+static void BM_Ext2InterleavedAppend(benchmark::State &state)
+{
+    if (!prepareExt2(state))
+    {
+        return;
+    }
+
+    const size_t nWriters = state.range(0);
+    const bool bOpen = state.range(1);
+
+    char *buffer = new char[APPEND_CHUNK];
+    memset(buffer, 0xAB, APPEND_CHUNK);
+
+    File **files = new File *[nWriters];
+    size_t nExtents = 0;
+    bool bFailed = false;
+
+    while (state.KeepRunning())
+    {
+        state.PauseTiming();
+        for (size_t i = 0; i < nWriters; ++i)
+        {
+            VFS::instance().createFile(appendPath(i), 0644);
+            files[i] = VFS::instance().find(appendPath(i));
+            if (!files[i])
+            {
+                bFailed = true;
+                break;
+            }
+
+            if (bOpen)
+            {
+                files[i]->increaseRefCount(true);
+            }
+        }
+        if (bFailed)
+        {
+            break;
+        }
+        state.ResumeTiming();
+
+        for (size_t off = 0; off < APPEND_FILE_SIZE; off += APPEND_CHUNK)
+        {
+            for (size_t i = 0; i < nWriters; ++i)
+            {
+                files[i]->write(
+                    off, APPEND_CHUNK, reinterpret_cast<uintptr_t>(buffer));
+            }
+        }
+
+        state.PauseTiming();
+        for (size_t i = 0; i < nWriters; ++i)
+        {
+            nExtents += countExtents(static_cast<Ext2File *>(files[i]));
+            if (bOpen)
+            {
+                files[i]->decreaseRefCount(true);
+            }
+
+            VFS::instance().remove(appendPath(i));
+        }
+        state.ResumeTiming();
+    }
+
+    if (bFailed)
+    {
+        state.SkipWithError("couldn't create files to append to");
+    }
+
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * int64_t(nWriters * APPEND_FILE_SIZE));
+    state.counters["extents_per_file"] = benchmark::Counter(
+        double(nExtents) / (state.iterations() * nWriters));
+
+    delete[] files;
+    delete[] buffer;
+}
+
+BENCHMARK(BM_Ext2SequentialRead);
+BENCHMARK(BM_Ext2SparseSequentialRead);
+BENCHMARK(BM_Ext2RandomRead);
+BENCHMARK(BM_Ext2ColdBlockMap)->Arg(0)->Arg(1);
+BENCHMARK(BM_Ext2InterleavedAppend)
+    ->Args({1, 1})
+    ->Args({16, 0})
+    ->Args({16, 1});
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <benchmark/benchmark.h>
+
+#include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/Spinlock.h"
+#include "pedigree/kernel/utilities/FreePageCache.h"
+
+#define STORM_PAGES 0x40000
+#define STORM_CPUS 64
+
+/// Stands in for the physical page stack and its single lock.
+class GlobalPageStack : public FreePageCache::Backend
+{
+  public:
+    GlobalPageStack() : m_Lock(false), m_Count(0)
+    {
+        for (size_t i = 0; i < STORM_PAGES; ++i)
+        {
+            m_Pages[m_Count++] = 0x1000 * (i + 1);
+        }
+    }
+
+    virtual size_t takePages(physical_uintptr_t *pages, size_t count)
+    {
+        LockGuard<Spinlock> guard(m_Lock);
+        size_t i = 0;
+        for (; i < count && m_Count; ++i)
+        {
+            pages[i] = m_Pages[--m_Count];
+        }
+        return i;
+    }
+
+    virtual void returnPages(const physical_uintptr_t *pages, size_t count)
+    {
+        LockGuard<Spinlock> guard(m_Lock);
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_Pages[m_Count++] = pages[i];
+        }
+    }
+
+  private:
+    Spinlock m_Lock;
+    size_t m_Count;
+    physical_uintptr_t m_Pages[STORM_PAGES];
+};
+
+static GlobalPageStack g_StormStack;
+static FreePageCache g_StormCaches[STORM_CPUS];
+
+/// Every allocation and free takes the global lock.
+static void BM_PageStormGlobal(benchmark::State &state)
+{
+    physical_uintptr_t pages[16];
+
+    while (state.KeepRunning())
+    {
+        for (size_t i = 0; i < 16; ++i)
+        {
+            g_StormStack.takePages(&pages[i], 1);
+        }
+        for (size_t i = 0; i < 16; ++i)
+        {
+            g_StormStack.returnPages(&pages[i], 1);
+        }
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()) * 16);
+}
+
+/// Allocations and frees go through a per-thread (per-CPU) cache.
+static void BM_PageStormCached(benchmark::State &state)
+{
+    FreePageCache &cache = g_StormCaches[state.thread_index() % STORM_CPUS];
+    cache.setBackend(&g_StormStack);
+
+    physical_uintptr_t pages[16];
+
+    while (state.KeepRunning())
+    {
+        for (size_t i = 0; i < 16; ++i)
+        {
+            pages[i] = cache.allocate();
+        }
+        for (size_t i = 0; i < 16; ++i)
+        {
+            cache.free(pages[i]);
+        }
+    }
+
+    cache.drain();
+
+    state.SetItemsProcessed(int64_t(state.iterations()) * 16);
+}
+
+/// Batch allocation through the cache, as fork() would do.
+static void BM_PageStormCachedBatch(benchmark::State &state)
+{
+    FreePageCache &cache = g_StormCaches[state.thread_index() % STORM_CPUS];
+    cache.setBackend(&g_StormStack);
+
+    physical_uintptr_t pages[16];
+
+    while (state.KeepRunning())
+    {
+        size_t n = cache.allocate(pages, 16);
+        for (size_t i = 0; i < n; ++i)
+        {
+            cache.free(pages[i]);
+        }
+    }
+
+    cache.drain();
+
+    state.SetItemsProcessed(int64_t(state.iterations()) * 16);
+}
+
+BENCHMARK(BM_PageStormGlobal)->ThreadRange(1, 8);
+BENCHMARK(BM_PageStormCached)->ThreadRange(1, 8);
+BENCHMARK(BM_PageStormCachedBatch)->ThreadRange(1, 8);
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <benchmark/benchmark.h>
+#include <sched.h>
+
+#include "pedigree/kernel/Atomic.h"
+#include "pedigree/kernel/Spinlock.h"
+
+#define LOCK_BENCH_SHARED_WORDS 8
+
+/// The lock Spinlock used to be: every waiter spins on a compare-and-swap.
+/// Waiters yield just as the hosted Spinlock does, so that the comparison is
+/// between the locking schemes rather than how they wait.
+class TestAndSetLock
+{
+  public:
+    TestAndSetLock(bool bLocked) : m_Atom(!bLocked)
+    {
+    }
+
+    void acquire()
+    {
+        while (!m_Atom.compareAndSwap(true, false))
+            sched_yield();
+    }
+
+    void release()
+    {
+        m_Atom.compareAndSwap(false, true);
+    }
+
+  private:
+    Atomic<bool> m_Atom;
+};
+
+static inline uint64_t cycles()
+{
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (static_cast<uint64_t>(hi) << 32ULL) | lo;
+}
+
+/// State protected by the lock under test.
+struct SharedState
+{
+    volatile size_t words[LOCK_BENCH_SHARED_WORDS];
+    volatile int lastOwner;
+};
+
+/// Each thread takes the lock, touches some shared state, and releases it.
+/// Throughput is items/s; fairness shows up as the worst-case wait and the
+/// fraction of acquisitions where a thread took the lock straight back from
+/// itself while others were waiting.
+template <class T>
+static void BM_LockContended(benchmark::State &state)
+{
+    static T lock(false);
+    static SharedState shared;
+
+    int self = state.thread_index();
+    uint64_t maxWait = 0;
+    uint64_t totalWait = 0;
+    size_t reacquired = 0;
+
+    while (state.KeepRunning())
+    {
+        uint64_t start = cycles();
+        lock.acquire();
+        uint64_t waited = cycles() - start;
+
+        if (shared.lastOwner == self)
+            ++reacquired;
+        shared.lastOwner = self;
+        for (size_t i = 0; i < LOCK_BENCH_SHARED_WORDS; ++i)
+            shared.words[i] = shared.words[i] + 1;
+
+        lock.release();
+
+        totalWait += waited;
+        if (waited > maxWait)
+            maxWait = waited;
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()));
+    state.counters["wait_cycles"] = benchmark::Counter(
+        double(totalWait) / state.iterations(),
+        benchmark::Counter::kAvgThreads);
+    state.counters["max_wait_cycles"] =
+        benchmark::Counter(double(maxWait), benchmark::Counter::kAvgThreads);
+    state.counters["reacquired"] = benchmark::Counter(
+        double(reacquired) / state.iterations(),
+        benchmark::Counter::kAvgThreads);
+}
+
+BENCHMARK_TEMPLATE(BM_LockContended, TestAndSetLock)->ThreadRange(1, 8);
+BENCHMARK_TEMPLATE(BM_LockContended, Spinlock)->ThreadRange(1, 8);
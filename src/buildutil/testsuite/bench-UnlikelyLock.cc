@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <benchmark/benchmark.h>
+
+#include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/process/ConditionVariable.h"
+#include "pedigree/kernel/process/Mutex.h"
+#include "pedigree/kernel/utilities/UnlikelyLock.h"
+
+#define READ_BENCH_WORDS 8
+
+/// UnlikelyLock as it used to be: every reader takes the Mutex.
+class MutexReaderLock
+{
+  public:
+    MutexReaderLock()
+        : m_Lock(false), m_Condition(), m_nReaders(0), m_bActiveWriter(false)
+    {
+    }
+
+    bool enter()
+    {
+        LockGuard<Mutex> guard(m_Lock);
+        while (m_bActiveWriter)
+        {
+            m_Condition.wait(m_Lock);
+        }
+
+        ++m_nReaders;
+        return true;
+    }
+
+    void leave()
+    {
+        LockGuard<Mutex> guard(m_Lock);
+        if (!--m_nReaders)
+        {
+            m_Condition.signal();
+        }
+    }
+
+    bool acquire()
+    {
+        LockGuard<Mutex> guard(m_Lock);
+        while (m_bActiveWriter || m_nReaders)
+        {
+            m_Condition.wait(m_Lock);
+        }
+
+        m_bActiveWriter = true;
+        return true;
+    }
+
+    void release()
+    {
+        LockGuard<Mutex> guard(m_Lock);
+        m_bActiveWriter = false;
+        m_Condition.broadcast();
+    }
+
+  private:
+    Mutex m_Lock;
+    ConditionVariable m_Condition;
+
+    uint64_t m_nReaders;
+    bool m_bActiveWriter;
+};
+
+/// Each thread reads some shared state under the lock. If the argument is
+/// non-zero, the first thread writes instead on every Nth iteration.
+template <class T>
+static void BM_ReadMostly(benchmark::State &state)
+{
+    static T lock;
+    static volatile size_t shared[READ_BENCH_WORDS];
+
+    const size_t writeEvery = state.range(0);
+    const bool bWriter = writeEvery && !state.thread_index();
+    size_t n = 0;
+    size_t sum = 0;
+
+    while (state.KeepRunning())
+    {
+        if (bWriter && !(++n % writeEvery))
+        {
+            lock.acquire();
+            for (size_t i = 0; i < READ_BENCH_WORDS; ++i)
+                shared[i] = shared[i] + 1;
+            lock.release();
+            continue;
+        }
+
+        lock.enter();
+        for (size_t i = 0; i < READ_BENCH_WORDS; ++i)
+            sum += shared[i];
+        lock.leave();
+    }
+
+    benchmark::DoNotOptimize(sum);
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+BENCHMARK_TEMPLATE(BM_ReadMostly, MutexReaderLock)
+    ->Arg(0)
+    ->Arg(1024)
+    ->Arg(64)
+    ->ThreadRange(1, 8);
+BENCHMARK_TEMPLATE(BM_ReadMostly, UnlikelyLock)
+    ->Arg(0)
+    ->Arg(1024)
+    ->Arg(64)
+    ->ThreadRange(1, 8);
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <stdint.h>
+#include <string.h>
+
+#include <benchmark/benchmark.h>
+
+#include "pedigree/kernel/utilities/utility.h"
+
+// The checksum loop Network::calculateChecksum used to run.
+static uint16_t naiveChecksum(const void *buffer, size_t length)
+{
+    const uint16_t *data = reinterpret_cast<const uint16_t *>(buffer);
+    uint32_t sum = 0;
+    for (size_t i = 0; i < length / 2; ++i)
+    {
+        sum += data[i];
+    }
+    if (length & 1)
+    {
+        sum += reinterpret_cast<const uint8_t *>(buffer)[length - 1];
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return sum;
+}
+
+static void BM_Checksum_Naive(benchmark::State &state)
+{
+    uint8_t *buf = new uint8_t[state.range(0)];
+    memset(buf, 0xA5, state.range(0));
+
+    while (state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(naiveChecksum(buf, state.range(0)));
+    }
+
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * int64_t(state.range(0)));
+
+    delete[] buf;
+}
+
+static void BM_Checksum_OnesComplementSum(benchmark::State &state)
+{
+    uint8_t *buf = new uint8_t[state.range(0)];
+    memset(buf, 0xA5, state.range(0));
+
+    while (state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(OnesComplementSum(buf, state.range(0)));
+    }
+
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * int64_t(state.range(0)));
+
+    delete[] buf;
+}
+
+static void BM_Checksum_CopyThenSum(benchmark::State &state)
+{
+    uint8_t *src = new uint8_t[state.range(0)];
+    uint8_t *dest = new uint8_t[state.range(0)];
+    memset(src, 0xA5, state.range(0));
+
+    while (state.KeepRunning())
+    {
+        MemoryCopy(dest, src, state.range(0));
+        benchmark::DoNotOptimize(OnesComplementSum(dest, state.range(0)));
+    }
+
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * int64_t(state.range(0)));
+
+    delete[] dest;
+    delete[] src;
+}
+
+static void BM_Checksum_OnesComplementSumCopy(benchmark::State &state)
+{
+    uint8_t *src = new uint8_t[state.range(0)];
+    uint8_t *dest = new uint8_t[state.range(0)];
+    memset(src, 0xA5, state.range(0));
+
+    while (state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(
+            OnesComplementSumCopy(dest, src, state.range(0)));
+    }
+
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * int64_t(state.range(0)));
+
+    delete[] dest;
+    delete[] src;
+}
+
+// 64 bytes (a minimal frame) up to 64 KiB (a full TSO-sized segment).
+BENCHMARK(BM_Checksum_Naive)->Range(64, 64 << 10);
+BENCHMARK(BM_Checksum_OnesComplementSum)->Range(64, 64 << 10);
+BENCHMARK(BM_Checksum_CopyThenSum)->Range(64, 64 << 10);
+BENCHMARK(BM_Checksum_OnesComplementSumCopy)->Range(64, 64 << 10);
@@ -77,6 +77,33 @@ static void BM_Memory_ForwardMemoryCopy(benchmark::State &state)
     delete[] src;
 }
 
+// range(0) is the size, range(1) the misalignment of the destination (and,
+// by one byte less, the source) from a 16-byte boundary.
+static void BM_Memory_MisalignedMemoryCopy(benchmark::State &state)
+{
+    char *src = new char[state.range(0) + 32];
+    char *dest = new char[state.range(0) + 32];
+    memset(src, 'a', state.range(0) + 32);
+
+    char *alignedSrc = reinterpret_cast<char *>(
+        (reinterpret_cast<uintptr_t>(src) + 15) & ~15ULL);
+    char *alignedDest = reinterpret_cast<char *>(
+        (reinterpret_cast<uintptr_t>(dest) + 15) & ~15ULL);
+    const char *s = alignedSrc + (state.range(1) ? state.range(1) - 1 : 0);
+    char *d = alignedDest + state.range(1);
+
+    while (state.KeepRunning())
+    {
+        ForwardMemoryCopy(d, s, state.range(0));
+    }
+
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * int64_t(state.range(0)));
+
+    delete[] dest;
+    delete[] src;
+}
+
 static void BM_Memory_ByteSet(benchmark::State &state)
 {
     char *buf = new char[state.range(0)];
@@ -236,11 +263,40 @@ static void BM_Memory_MemoryCompare(benchmark::State &state)
     delete[] buf2;
 }
 
+static void BM_Memory_MemoryFind(benchmark::State &state)
+{
+    // The byte being searched for isn't present, so every byte is visited.
+    char *buf = new char[state.range(0)];
+    memset(buf, 'a', state.range(0));
+
+    while (state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(MemoryFind(buf, 'b', state.range(0)));
+    }
+
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * int64_t(state.range(0)));
+
+    delete[] buf;
+}
+
+static void MisalignedSizes(benchmark::internal::Benchmark *b)
+{
+    for (int size = 64; size <= (64 << 10); size *= 4)
+    {
+        for (int misalign : {0, 1, 8, 15})
+        {
+            b->Args({size, misalign});
+        }
+    }
+}
+
 // Test very large copies and sets for the base interfaces.
 BENCHMARK(BM_Memory_MemoryCopy)->Range(8, 8 << 24);
 BENCHMARK(BM_Memory_OverlappedMemoryCopy)->Range(8, 8 << 24);
 BENCHMARK(BM_Memory_ForwardMemoryCopy)->Range(8, 8 << 24);
 BENCHMARK(BM_Memory_ByteSet)->Range(8, 8 << 24);
+BENCHMARK(BM_Memory_MisalignedMemoryCopy)->Apply(MisalignedSizes);
 
 // Smaller ranges for somewhat lesser benchmarks.
 BENCHMARK(BM_Memory_ByteSetZero)->Range(8, 8 << 16);
@@ -251,3 +307,4 @@ BENCHMARK(BM_Memory_DoubleWordSetZero)->Range(8, 8 << 16);
 BENCHMARK(BM_Memory_QuadWordSet)->Range(8, 8 << 16);
 BENCHMARK(BM_Memory_QuadWordSetZero)->Range(8, 8 << 16);
 BENCHMARK(BM_Memory_MemoryCompare)->Range(8, 8 << 16);
+BENCHMARK(BM_Memory_MemoryFind)->Range(8, 8 << 16);
@@ -46,6 +46,25 @@ static void BM_StringLength(benchmark::State &state)
     delete[] buf;
 }
 
+static void BM_StringLengthMisaligned(benchmark::State &state)
+{
+    char *buf = new char[state.range(0) + 1];
+    memset(buf, 'a', state.range(0) + 1);
+    buf[state.range(0)] = '\0';
+
+    while (state.KeepRunning())
+    {
+        benchmark::DoNotOptimize(StringLength(buf + 1));
+    }
+
+    state.SetBytesProcessed(
+        int64_t(state.iterations()) * int64_t(state.range(0)));
+    state.SetItemsProcessed(int64_t(state.iterations()));
+    state.SetComplexityN(state.range(0));
+
+    delete[] buf;
+}
+
 static void BM_StringLengthConstant(benchmark::State &state)
 {
     while (state.KeepRunning())
@@ -361,6 +380,7 @@ static void BM_StringNextCharacter4byte(benchmark::State &state)
 }
 
 BENCHMARK(BM_StringLength)->Range(8, 8 << 16)->Complexity();
+BENCHMARK(BM_StringLengthMisaligned)->Range(8, 8 << 16)->Complexity();
 BENCHMARK(BM_StringLengthConstant);
 BENCHMARK(BM_StringCopy)->Range(8, 8 << 16)->Complexity();
 BENCHMARK(BM_StringCopyN)->Range(8, 8 << 16)->Complexity();
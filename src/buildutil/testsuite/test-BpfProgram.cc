@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "modules/system/network-stack/BpfProgram.h"
+
+// tcpdump -dd "tcp dst port 80"
+static const BpfInstruction g_TcpPort80[] = {
+    {0x28, 0, 0, 0x0000000c}, {0x15, 0, 4, 0x000086dd},
+    {0x30, 0, 0, 0x00000014}, {0x15, 0, 11, 0x00000006},
+    {0x28, 0, 0, 0x00000038}, {0x15, 8, 9, 0x00000050},
+    {0x15, 0, 8, 0x00000800}, {0x30, 0, 0, 0x00000017},
+    {0x15, 0, 6, 0x00000006}, {0x28, 0, 0, 0x00000014},
+    {0x45, 4, 0, 0x00001fff}, {0xb1, 0, 0, 0x0000000e},
+    {0x48, 0, 0, 0x00000010}, {0x15, 0, 1, 0x00000050},
+    {0x06, 0, 0, 0x00040000}, {0x06, 0, 0, 0x00000000},
+};
+
+/// Builds an Ethernet + IPv4 + TCP frame with the given destination port.
+static void buildTcpPacket(uint8_t *packet, size_t length, uint16_t port)
+{
+    memset(packet, 0, length);
+    packet[12] = 0x08;  // ethertype IPv4
+    packet[13] = 0x00;
+    packet[14] = 0x45;  // IPv4, 20 byte header
+    packet[23] = 6;     // TCP
+    packet[36] = port >> 8;
+    packet[37] = port & 0xFF;
+}
+
+TEST(PedigreeBpfProgram, UnloadedAcceptsEverything)
+{
+    BpfProgram program;
+    uint8_t packet[64] = {0};
+
+    EXPECT_FALSE(program.isLoaded());
+    EXPECT_EQ(program.run(packet, sizeof(packet), sizeof(packet)), ~0U);
+}
+
+TEST(PedigreeBpfProgram, RejectsEmpty)
+{
+    EXPECT_FALSE(BpfProgram::validate(g_TcpPort80, 0));
+    EXPECT_FALSE(BpfProgram::validate(0, 1));
+}
+
+TEST(PedigreeBpfProgram, RejectsMissingReturn)
+{
+    BpfInstruction insns[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_IMM, 1),
+    };
+    EXPECT_FALSE(BpfProgram::validate(insns, 1));
+}
+
+TEST(PedigreeBpfProgram, RejectsOutOfRangeJumps)
+{
+    BpfInstruction conditional[] = {
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    EXPECT_FALSE(BpfProgram::validate(conditional, 2));
+
+    BpfInstruction unconditional[] = {
+        BPF_STMT(BPF_JMP | BPF_JA, 1),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    EXPECT_FALSE(BpfProgram::validate(unconditional, 2));
+
+    // Would wrap around if the validator didn't account for overflow.
+    BpfInstruction wrapping[] = {
+        BPF_STMT(BPF_JMP | BPF_JA, 0xFFFFFFFFU),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    EXPECT_FALSE(BpfProgram::validate(wrapping, 2));
+}
+
+TEST(PedigreeBpfProgram, RejectsBadScratchMemory)
+{
+    BpfInstruction insns[] = {
+        BPF_STMT(BPF_ST, BPF_MEMWORDS),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    EXPECT_FALSE(BpfProgram::validate(insns, 2));
+}
+
+TEST(PedigreeBpfProgram, RejectsConstantDivideByZero)
+{
+    BpfInstruction insns[] = {
+        BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, 0),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    EXPECT_FALSE(BpfProgram::validate(insns, 2));
+}
+
+TEST(PedigreeBpfProgram, RejectsUnknownOpcode)
+{
+    BpfInstruction insns[] = {
+        {0xFF, 0, 0, 0},
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    EXPECT_FALSE(BpfProgram::validate(insns, 2));
+}
+
+TEST(PedigreeBpfProgram, FailedLoadKeepsProgram)
+{
+    BpfProgram program;
+    ASSERT_TRUE(program.load(g_TcpPort80, 16));
+
+    BpfInstruction bad[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_IMM, 1),
+    };
+    EXPECT_FALSE(program.load(bad, 1));
+    EXPECT_EQ(program.count(), 16);
+}
+
+TEST(PedigreeBpfProgram, TcpPortFilter)
+{
+    BpfProgram program;
+    ASSERT_TRUE(program.load(g_TcpPort80, 16));
+
+    uint8_t packet[64];
+    buildTcpPacket(packet, sizeof(packet), 80);
+    EXPECT_EQ(program.run(packet, sizeof(packet), sizeof(packet)), 0x40000);
+    EXPECT_EQ(
+        program.interpret(packet, sizeof(packet), sizeof(packet)), 0x40000);
+
+    buildTcpPacket(packet, sizeof(packet), 81);
+    EXPECT_EQ(program.run(packet, sizeof(packet), sizeof(packet)), 0);
+    EXPECT_EQ(program.interpret(packet, sizeof(packet), sizeof(packet)), 0);
+}
+
+TEST(PedigreeBpfProgram, ShortPacketRejected)
+{
+    BpfProgram program;
+    ASSERT_TRUE(program.load(g_TcpPort80, 16));
+
+    uint8_t packet[64];
+    buildTcpPacket(packet, sizeof(packet), 80);
+
+    // Port is at offset 36, so a 37 byte capture can't reach it.
+    EXPECT_EQ(program.run(packet, sizeof(packet), 37), 0);
+    EXPECT_EQ(program.interpret(packet, sizeof(packet), 37), 0);
+}
+
+TEST(PedigreeBpfProgram, Arithmetic)
+{
+    BpfInstruction insns[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_IMM, 7),
+        BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 6),  // A = 42
+        BPF_STMT(BPF_ST, 3),
+        BPF_STMT(BPF_LDX | BPF_W | BPF_IMM, 5),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_X, 0),  // A = 2
+        BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 4),  // A = 32
+        BPF_STMT(BPF_LDX | BPF_W | BPF_MEM, 3),  // X = 42
+        BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),  // A = 74
+        BPF_STMT(BPF_LDX | BPF_W | BPF_LEN, 0),  // X = 100
+        BPF_JUMP(BPF_JMP | BPF_JGT | BPF_X, 0, 0, 1),
+        BPF_STMT(BPF_RET | BPF_K, 1),
+        BPF_STMT(BPF_ALU | BPF_NEG, 0),
+        BPF_STMT(BPF_ALU | BPF_XOR | BPF_K, 0xFFFFFFFFU),  // A = 73
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    const size_t n = sizeof(insns) / sizeof(insns[0]);
+
+    BpfProgram program;
+    ASSERT_TRUE(program.load(insns, n));
+
+    uint8_t packet[1] = {0};
+    EXPECT_EQ(program.run(packet, 100, 1), 73);
+    EXPECT_EQ(program.interpret(packet, 100, 1), 73);
+}
+
+TEST(PedigreeBpfProgram, DivideByZeroRegister)
+{
+    BpfInstruction insns[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_IMM, 7),
+        BPF_STMT(BPF_LDX | BPF_W | BPF_IMM, 0),
+        BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+        BPF_STMT(BPF_RET | BPF_K, 1),
+    };
+
+    BpfProgram program;
+    ASSERT_TRUE(program.load(insns, 4));
+
+    uint8_t packet[1] = {0};
+    EXPECT_EQ(program.run(packet, 1, 1), 0);
+    EXPECT_EQ(program.interpret(packet, 1, 1), 0);
+}
+
+TEST(PedigreeBpfProgram, RandomProgramsMatchInterpreter)
+{
+    // Only opcodes that are valid in isolation; the validator decides the
+    // rest (jump ranges, divisors, memory indices).
+    static const uint16_t opcodes[] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x14, 0x15,
+        0x16, 0x1c, 0x1d, 0x20, 0x24, 0x25, 0x28, 0x2c, 0x2d, 0x30,
+        0x34, 0x35, 0x3c, 0x3d, 0x40, 0x44, 0x45, 0x48, 0x4c, 0x4d,
+        0x50, 0x54, 0x5c, 0x60, 0x61, 0x64, 0x6c, 0x74, 0x7c, 0x80,
+        0x81, 0x84, 0x87, 0x94, 0x9c, 0xa4, 0xac, 0xb1, 0x16, 0x0e,
+    };
+    const size_t nOpcodes = sizeof(opcodes) / sizeof(opcodes[0]);
+
+    srand(0x42);
+
+    uint8_t packet[128];
+    size_t nValid = 0;
+    for (size_t iteration = 0; iteration < 20000; ++iteration)
+    {
+        BpfInstruction insns[16];
+        size_t n = 1 + (rand() % 16);
+        for (size_t i = 0; i < n; ++i)
+        {
+            insns[i].code = opcodes[rand() % nOpcodes];
+            insns[i].jt = rand() % 4;
+            insns[i].jf = rand() % 4;
+            insns[i].k = (rand() % 2) ? (rand() % 64) : rand();
+        }
+        insns[n - 1].code = BPF_RET | ((rand() % 2) ? BPF_A : BPF_K);
+
+        BpfProgram program;
+        if (!program.load(insns, n))
+        {
+            continue;
+        }
+        ++nValid;
+
+        for (size_t i = 0; i < sizeof(packet); ++i)
+        {
+            packet[i] = rand();
+        }
+
+        size_t length = rand() % sizeof(packet);
+        EXPECT_EQ(
+            program.run(packet, sizeof(packet), length),
+            program.interpret(packet, sizeof(packet), length));
+    }
+
+    // Make sure we actually tested something.
+    EXPECT_GT(nValid, 1000);
+}
@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include "pedigree/kernel/processor/PageFrame.h"
+#include "pedigree/kernel/processor/PhysicalMemoryManager.h"
+#include "pedigree/kernel/utilities/BuddyAllocator.h"
+
+#define PAGE(n) (static_cast<physical_uintptr_t>(n) * 4096)
+
+/// Flat frame array covering the first TEST_PAGES pages.
+#define TEST_PAGES 4096
+
+/// Page zero is never handed out, as 0 means allocation failure.
+class TestFrameMap : public BuddyAllocator::FrameMap
+{
+  public:
+    TestFrameMap() : frames()
+    {
+    }
+
+    virtual PageFrame *frame(physical_uintptr_t page)
+    {
+        if (page >= PAGE(TEST_PAGES))
+        {
+            return 0;
+        }
+        return &frames[page / 4096];
+    }
+
+    virtual physical_uintptr_t address(PageFrame *pFrame)
+    {
+        return PAGE(pFrame - frames);
+    }
+
+    PageFrame frames[TEST_PAGES];
+};
+
+class PedigreeBuddyAllocator : public ::testing::Test
+{
+  protected:
+    virtual void SetUp()
+    {
+        zone.setup(&map, PAGE(0), PAGE(TEST_PAGES));
+    }
+
+    TestFrameMap map;
+    BuddyAllocator zone;
+};
+
+TEST_F(PedigreeBuddyAllocator, StartsEmpty)
+{
+    EXPECT_EQ(zone.freePages(), 0U);
+    EXPECT_EQ(zone.allocate(0), 0U);
+}
+
+TEST_F(PedigreeBuddyAllocator, CoalescesOnFree)
+{
+    zone.freeRange(PAGE(1024), 1024);
+    EXPECT_EQ(zone.freePages(), 1024U);
+    EXPECT_EQ(zone.freeBlocks(BuddyAllocator::MaxOrder), 1U);
+
+    physical_uintptr_t pages[1024];
+    EXPECT_EQ(zone.allocate(pages, 1024), 1024U);
+    EXPECT_EQ(zone.freePages(), 0U);
+
+    zone.free(pages, 1024);
+    EXPECT_EQ(zone.freePages(), 1024U);
+    EXPECT_EQ(zone.freeBlocks(BuddyAllocator::MaxOrder), 1U);
+    for (size_t i = 0; i < BuddyAllocator::MaxOrder; ++i)
+    {
+        EXPECT_EQ(zone.freeBlocks(i), 0U);
+    }
+}
+
+TEST_F(PedigreeBuddyAllocator, SplitsLargerBlocks)
+{
+    zone.freeRange(PAGE(1024), 1024);
+
+    physical_uintptr_t block = zone.allocate(3);
+    EXPECT_EQ(block, PAGE(1024));
+
+    // One free block of each order from 3 up to MaxOrder - 1.
+    for (size_t i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(zone.freeBlocks(i), 0U);
+    }
+    for (size_t i = 3; i < BuddyAllocator::MaxOrder; ++i)
+    {
+        EXPECT_EQ(zone.freeBlocks(i), 1U);
+    }
+
+    zone.free(block, 3);
+    EXPECT_EQ(zone.freeBlocks(BuddyAllocator::MaxOrder), 1U);
+}
+
+TEST_F(PedigreeBuddyAllocator, UnalignedRange)
+{
+    // 3 pages at page 5: blocks of 1 (page 5) and 2 (pages 6-7).
+    zone.freeRange(PAGE(5), 3);
+    EXPECT_EQ(zone.freePages(), 3U);
+    EXPECT_EQ(zone.freeBlocks(0), 1U);
+    EXPECT_EQ(zone.freeBlocks(1), 1U);
+
+    // Page 4 is not free, so page 5 must not merge with it.
+    EXPECT_EQ(zone.allocate(2), 0U);
+}
+
+TEST_F(PedigreeBuddyAllocator, AllocateRangeReturnsTail)
+{
+    zone.freeRange(PAGE(16), 16);
+
+    physical_uintptr_t range = zone.allocateRange(5);
+    EXPECT_EQ(range, PAGE(16));
+    EXPECT_EQ(zone.freePages(), 11U);
+
+    zone.freeRange(range, 5);
+    EXPECT_EQ(zone.freePages(), 16U);
+    EXPECT_EQ(zone.freeBlocks(4), 1U);
+}
+
+TEST_F(PedigreeBuddyAllocator, AllocateRangeTooLarge)
+{
+    zone.freeRange(PAGE(2048), 2048);
+    EXPECT_EQ(zone.allocateRange(2049), 0U);
+    EXPECT_EQ(zone.freePages(), 2048U);
+}
+
+TEST_F(PedigreeBuddyAllocator, AllocateRangeAcrossBlocks)
+{
+    // Three largest blocks, with a hole after the first.
+    zone.freeRange(PAGE(1024), 1024);
+    zone.freeRange(PAGE(3072), 1024);
+    zone.freeRange(PAGE(2048), 1024);
+    zone.allocateSpecific(PAGE(2048), 1);
+
+    // More than one largest block, so it needs a run of them.
+    physical_uintptr_t range =
+        zone.allocateRange((1 << BuddyAllocator::MaxOrder) + 5);
+    EXPECT_EQ(range, 0U);
+
+    zone.freeRange(PAGE(2048), 1);
+    range = zone.allocateRange((1 << BuddyAllocator::MaxOrder) + 5);
+    EXPECT_NE(range, 0U);
+    EXPECT_EQ(zone.freePages(), 3072U - 1029U);
+
+    // The pages of the range are taken, the rest of the last block is not.
+    EXPECT_FALSE(zone.allocateSpecific(range + PAGE(1028), 1));
+    EXPECT_TRUE(zone.allocateSpecific(range + PAGE(1029), 1));
+    zone.freeRange(range + PAGE(1029), 1);
+
+    zone.freeRange(range, 1029);
+    EXPECT_EQ(zone.freePages(), 3072U);
+    EXPECT_EQ(zone.freeBlocks(BuddyAllocator::MaxOrder), 3U);
+}
+
+TEST_F(PedigreeBuddyAllocator, AllocateSpecific)
+{
+    zone.freeRange(PAGE(64), 64);
+
+    EXPECT_TRUE(zone.allocateSpecific(PAGE(77), 7));
+    EXPECT_EQ(zone.freePages(), 57U);
+
+    // Already taken.
+    EXPECT_FALSE(zone.allocateSpecific(PAGE(83), 2));
+    EXPECT_EQ(zone.freePages(), 57U);
+
+    zone.freeRange(PAGE(77), 7);
+    EXPECT_EQ(zone.freePages(), 64U);
+    EXPECT_EQ(zone.freeBlocks(6), 1U);
+}
+
+TEST_F(PedigreeBuddyAllocator, StaysInZone)
+{
+    BuddyAllocator upper;
+    upper.setup(&map, PAGE(8), PAGE(16));
+
+    zone.setup(&map, PAGE(0), PAGE(8));
+    zone.freeRange(PAGE(0), 8);
+    upper.freeRange(PAGE(8), 8);
+
+    // Both halves are free but belong to different zones.
+    EXPECT_EQ(zone.freeBlocks(3), 1U);
+    EXPECT_EQ(upper.freeBlocks(3), 1U);
+    EXPECT_EQ(zone.freeBlocks(4), 0U);
+
+    EXPECT_FALSE(zone.allocateSpecific(PAGE(8), 1));
+}
@@ -21,8 +21,10 @@
 
 #include <gtest/gtest.h>
 
+#include <chrono>
 #include <cstdint>
 #include <memory>
+#include <thread>
 
 #include "pedigree/kernel/utilities/Buffer.h"
 
@@ -197,3 +199,52 @@ TEST(PedigreeBuffer, Chase)
             break;
     }
 }
+
+TEST(PedigreeBuffer, BlockedReaderTakesWriteDirectly)
+{
+    Buffer<char> buffer(8);
+
+    char in[12], out[16];
+    memset(in, 0xAB, 12);
+    memset(out, 0, 16);
+
+    size_t r = 0;
+    std::thread reader([&] { r = buffer.read(out, 16); });
+
+    // Let the reader block on the empty buffer.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // More than the buffer can hold, but it all goes straight to the reader.
+    EXPECT_EQ(buffer.write(in, 12, false), 12);
+    reader.join();
+
+    EXPECT_EQ(r, 12);
+    EXPECT_EQ(buffer.getDataSize(), 0);
+    EXPECT_TRUE(memcmp(in, out, 12) == 0);
+}
+
+TEST(PedigreeBuffer, BlockedReaderLeavesRemainder)
+{
+    Buffer<char> buffer(32);
+
+    char in[10], out[16];
+    for (size_t i = 0; i < 10; ++i)
+    {
+        in[i] = i;
+    }
+    memset(out, 0, 16);
+
+    size_t r = 0;
+    std::thread reader([&] { r = buffer.read(out, 4); });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    EXPECT_EQ(buffer.write(in, 10, false), 10);
+    reader.join();
+
+    // The reader only wanted four; the rest is buffered, in order.
+    EXPECT_EQ(r, 4);
+    EXPECT_EQ(buffer.getDataSize(), 6);
+    EXPECT_EQ(buffer.read(out + 4, 16, false), 6);
+    EXPECT_TRUE(memcmp(in, out, 10) == 0);
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <vector>
+
+#include "pedigree/kernel/utilities/CompressedPageStore.h"
+#include "pedigree/kernel/utilities/lz4.h"
+
+static const size_t PageSize = CompressedPageStore::PageSize;
+
+/// A page that looks like a typical idle heap page: some structure, some
+/// pointers, mostly zeroes.
+static void fillHeapLike(uint8_t *page, unsigned seed)
+{
+    memset(page, 0, PageSize);
+    for (size_t i = 0; i < PageSize; i += 64)
+    {
+        uintptr_t ptr = 0x7f0000100000ULL + (seed * 0x1000) + i;
+        memcpy(page + i, &ptr, sizeof(ptr));
+        page[i + 8] = static_cast<uint8_t>(seed + i);
+        memcpy(page + i + 16, "object", 6);
+    }
+}
+
+/// Data that won't compress at all.
+static void fillRandom(uint8_t *page, unsigned seed)
+{
+    uint32_t x = seed * 2654435761U + 1;
+    for (size_t i = 0; i < PageSize; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        page[i] = x & 0xFF;
+    }
+}
+
+TEST(PedigreeLz4, RoundTrip)
+{
+    uint8_t page[PageSize], out[PageSize], compressed[PageSize + 64];
+    uint16_t table[lz4::HashTableSize];
+
+    fillHeapLike(page, 3);
+    size_t len = lz4::compress(page, PageSize, compressed, sizeof(compressed), table);
+    ASSERT_GT(len, 0U);
+    EXPECT_LT(len, PageSize / 3);
+
+    EXPECT_EQ(lz4::decompress(compressed, len, out, sizeof(out)), PageSize);
+    EXPECT_EQ(memcmp(page, out, PageSize), 0);
+}
+
+TEST(PedigreeLz4, ShortAndRandomInputs)
+{
+    uint8_t page[PageSize], out[PageSize], compressed[PageSize + 64];
+    uint16_t table[lz4::HashTableSize];
+
+    // Too short for any match.
+    size_t len = lz4::compress("hello", 5, compressed, sizeof(compressed), table);
+    ASSERT_GT(len, 0U);
+    EXPECT_EQ(lz4::decompress(compressed, len, out, sizeof(out)), 5U);
+    EXPECT_EQ(memcmp(out, "hello", 5), 0);
+
+    fillRandom(page, 7);
+    len = lz4::compress(page, PageSize, compressed, sizeof(compressed), table);
+    ASSERT_GT(len, 0U);
+    EXPECT_EQ(lz4::decompress(compressed, len, out, sizeof(out)), PageSize);
+    EXPECT_EQ(memcmp(page, out, PageSize), 0);
+
+    // Doesn't fit in a smaller buffer.
+    EXPECT_EQ(lz4::compress(page, PageSize, compressed, PageSize / 2, table), 0U);
+}
+
+TEST(PedigreeLz4, RejectsCorruptInput)
+{
+    uint8_t page[PageSize], out[PageSize], compressed[PageSize + 64];
+    uint16_t table[lz4::HashTableSize];
+
+    fillHeapLike(page, 1);
+    size_t len = lz4::compress(page, PageSize, compressed, sizeof(compressed), table);
+    ASSERT_GT(len, 2U);
+
+    // Truncated.
+    EXPECT_NE(lz4::decompress(compressed, len - 2, out, sizeof(out)), PageSize);
+
+    // Output too small.
+    EXPECT_EQ(lz4::decompress(compressed, len, out, PageSize / 2), 0U);
+}
+
+TEST(PedigreeCompressedPageStore, StoreLoadRelease)
+{
+    CompressedPageStore store;
+    uint8_t page[PageSize], out[PageSize];
+
+    fillHeapLike(page, 42);
+    CompressedPageStore::Handle h = store.store(page);
+    ASSERT_NE(h, 0U);
+    EXPECT_LT(h, 1ULL << CompressedPageStore::HandleBits);
+    EXPECT_EQ(store.storedPages(), 1U);
+    EXPECT_GT(store.backingPages(), 0U);
+
+    memset(out, 0xAA, sizeof(out));
+    EXPECT_TRUE(store.load(h, out));
+    EXPECT_EQ(memcmp(page, out, PageSize), 0);
+
+    store.release(h);
+    EXPECT_EQ(store.storedPages(), 0U);
+    EXPECT_EQ(store.compressedBytes(), 0U);
+    EXPECT_EQ(store.backingPages(), 0U);
+    EXPECT_FALSE(store.load(h, out));
+}
+
+TEST(PedigreeCompressedPageStore, SharedPagesNeedEveryRelease)
+{
+    CompressedPageStore store;
+    uint8_t page[PageSize], out[PageSize];
+
+    fillHeapLike(page, 5);
+    CompressedPageStore::Handle h = store.store(page);
+    ASSERT_NE(h, 0U);
+
+    store.share(h);
+    store.release(h);
+    EXPECT_TRUE(store.load(h, out));
+    EXPECT_EQ(memcmp(page, out, PageSize), 0);
+
+    store.release(h);
+    EXPECT_EQ(store.storedPages(), 0U);
+}
+
+TEST(PedigreeCompressedPageStore, RefusesIncompressiblePages)
+{
+    CompressedPageStore store;
+    uint8_t page[PageSize];
+
+    fillRandom(page, 9);
+    EXPECT_EQ(store.store(page), 0U);
+    EXPECT_EQ(store.incompressiblePages(), 1U);
+    EXPECT_EQ(store.backingPages(), 0U);
+}
+
+TEST(PedigreeCompressedPageStore, PacksPagesUnderLowLimit)
+{
+    // A very small memory limit, to find out what happens once it's hit.
+    const size_t limit = 8;
+    CompressedPageStore store(limit);
+    uint8_t page[PageSize], out[PageSize];
+
+    std::vector<CompressedPageStore::Handle> handles;
+    for (unsigned i = 0; i < 1000; ++i)
+    {
+        fillHeapLike(page, i);
+        CompressedPageStore::Handle h = store.store(page);
+        if (!h)
+            break;
+        handles.push_back(h);
+    }
+
+    EXPECT_LE(store.backingPages(), limit);
+    EXPECT_EQ(store.rejectedPages(), 1U);
+    EXPECT_EQ(store.storedPages(), handles.size());
+
+    // Idle heap pages should pack at least three to a page.
+    EXPECT_GE(handles.size(), limit * 3);
+    EXPECT_GE(
+        store.storedPages() * PageSize, store.compressedBytes() * 3);
+
+    for (unsigned i = 0; i < handles.size(); ++i)
+    {
+        fillHeapLike(page, i);
+        ASSERT_TRUE(store.load(handles[i], out));
+        EXPECT_EQ(memcmp(page, out, PageSize), 0);
+    }
+
+    // Freeing pages makes room again.
+    for (unsigned i = 0; i < handles.size(); ++i)
+    {
+        store.release(handles[i]);
+    }
+    EXPECT_EQ(store.backingPages(), 0U);
+
+    fillHeapLike(page, 0);
+    CompressedPageStore::Handle h = store.store(page);
+    EXPECT_NE(h, 0U);
+    store.release(h);
+}
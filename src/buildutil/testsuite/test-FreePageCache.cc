@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include "pedigree/kernel/utilities/FreePageCache.h"
+
+#include "FakePageBackend.h"
+
+typedef FakePageBackend<FreePageCache::Backend> FakeCacheBackend;
+
+TEST(PedigreeFreePageCache, RefillsInBatches)
+{
+    FakeCacheBackend backend;
+    FreePageCache cache;
+    cache.setBackend(&backend);
+
+    for (size_t i = 0; i < FreePageCache::Batch; ++i)
+    {
+        EXPECT_NE(cache.allocate(), 0U);
+    }
+    EXPECT_EQ(backend.takes, 1U);
+    EXPECT_EQ(cache.count(), 0U);
+
+    EXPECT_NE(cache.allocate(), 0U);
+    EXPECT_EQ(backend.takes, 2U);
+    EXPECT_EQ(cache.count(), FreePageCache::Batch - 1);
+}
+
+TEST(PedigreeFreePageCache, ReusesFreedPage)
+{
+    FakeCacheBackend backend;
+    FreePageCache cache;
+    cache.setBackend(&backend);
+
+    physical_uintptr_t page = cache.allocate();
+    cache.free(page);
+    EXPECT_EQ(cache.allocate(), page);
+    EXPECT_EQ(backend.takes, 1U);
+}
+
+TEST(PedigreeFreePageCache, DrainsAtHighWatermark)
+{
+    FakeCacheBackend backend;
+    FreePageCache cache;
+    cache.setBackend(&backend);
+
+    for (size_t i = 0; i < FreePageCache::HighWatermark; ++i)
+    {
+        cache.free(0x1000 * (i + 1));
+    }
+    EXPECT_EQ(backend.returns, 0U);
+    EXPECT_EQ(cache.count(), FreePageCache::HighWatermark);
+
+    cache.free(0x100000000ULL);
+    EXPECT_EQ(backend.returns, 1U);
+    EXPECT_EQ(backend.returned, FreePageCache::Batch);
+    EXPECT_EQ(
+        cache.count(),
+        FreePageCache::HighWatermark - FreePageCache::Batch + 1);
+
+    // Most recently freed page comes back first.
+    EXPECT_EQ(cache.allocate(), 0x100000000ULL);
+}
+
+TEST(PedigreeFreePageCache, BatchAllocate)
+{
+    FakeCacheBackend backend;
+    FreePageCache cache;
+    cache.setBackend(&backend);
+
+    cache.free(0x1000);
+    cache.free(0x2000);
+
+    physical_uintptr_t pages[100];
+    EXPECT_EQ(cache.allocate(pages, 100), 100U);
+    EXPECT_EQ(backend.takes, 1U);
+    EXPECT_EQ(cache.count(), 0U);
+
+    // Cached pages are used before going to the backend.
+    EXPECT_TRUE(pages[0] == 0x1000 || pages[0] == 0x2000);
+    EXPECT_TRUE(pages[1] == 0x1000 || pages[1] == 0x2000);
+}
+
+TEST(PedigreeFreePageCache, BackendExhausted)
+{
+    FakeCacheBackend backend(3);
+    FreePageCache cache;
+    cache.setBackend(&backend);
+
+    physical_uintptr_t pages[8];
+    EXPECT_EQ(cache.allocate(pages, 8), 3U);
+    EXPECT_EQ(cache.allocate(), 0U);
+}
+
+TEST(PedigreeFreePageCache, Drain)
+{
+    FakeCacheBackend backend;
+    FreePageCache cache;
+    cache.setBackend(&backend);
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        cache.free(0x1000 * (i + 1));
+    }
+
+    cache.drain();
+    EXPECT_EQ(cache.count(), 0U);
+    EXPECT_EQ(backend.returned, 10U);
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include "modules/system/vfs/File.h"
+#include "modules/system/vfs/PageCache.h"
+
+TEST(PedigreePageCache, UnregisterEvictsPages)
+{
+    PageCache &cache = PageCache::instance();
+    File file;
+
+    size_t id = cache.registerFile(&file);
+    EXPECT_NE(cache.getPage(&file, id, 0, false), 0);
+    EXPECT_NE(cache.getPage(&file, id, 0x3000, false), 0);
+    cache.putPage(id, 0);
+    cache.putPage(id, 0x3000);
+
+    cache.unregisterFile(id);
+
+    EXPECT_EQ(cache.lookup(id, 0), 0);
+    EXPECT_EQ(cache.lookup(id, 0x3000), 0);
+}
+
+TEST(PedigreePageCache, RecyclesIds)
+{
+    PageCache &cache = PageCache::instance();
+    File file;
+
+    size_t id = cache.registerFile(&file);
+    EXPECT_NE(cache.getPage(&file, id, 0, false), 0);
+    cache.putPage(id, 0);
+    cache.unregisterFile(id);
+
+    // The new File gets the same ID, but none of the old File's pages.
+    File other;
+    EXPECT_EQ(cache.registerFile(&other), id);
+    EXPECT_EQ(cache.lookup(id, 0), 0);
+    cache.unregisterFile(id);
+}
+
+TEST(PedigreePageCache, PinnedPagesKeepId)
+{
+    PageCache &cache = PageCache::instance();
+    File file;
+
+    size_t id = cache.registerFile(&file);
+    EXPECT_NE(cache.getPage(&file, id, 0, false), 0);
+    cache.unregisterFile(id);
+
+    // The page is still pinned, so its ID mustn't be handed out again.
+    File other;
+    size_t otherId = cache.registerFile(&other);
+    EXPECT_NE(otherId, id);
+    cache.putPage(id, 0);
+    cache.unregisterFile(otherId);
+}
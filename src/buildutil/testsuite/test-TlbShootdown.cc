@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include "pedigree/kernel/processor/PhysicalMemoryManager.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/processor/TlbShootdown.h"
+#include "pedigree/kernel/processor/VirtualAddressSpace.h"
+
+#include <stdlib.h>
+
+/// Address space that maps nothing, for keeping track of stale processors.
+class FakeAddressSpace : public VirtualAddressSpace
+{
+  public:
+    FakeAddressSpace() : VirtualAddressSpace(0)
+    {
+    }
+
+    virtual bool isAddressValid(void *virtualAddress)
+    {
+        return true;
+    }
+    virtual bool isMapped(void *virtualAddress)
+    {
+        return false;
+    }
+    virtual bool
+    map(physical_uintptr_t physicalAddress, void *virtualAddress, size_t flags)
+    {
+        return false;
+    }
+    virtual void getMapping(
+        void *virtualAddress, physical_uintptr_t &physicalAddress,
+        size_t &flags)
+    {
+    }
+    virtual void setFlags(void *virtualAddress, size_t newFlags)
+    {
+    }
+    virtual void unmap(void *virtualAddress)
+    {
+    }
+    virtual Stack *allocateStack()
+    {
+        return 0;
+    }
+    virtual void freeStack(Stack *pStack)
+    {
+    }
+    virtual VirtualAddressSpace *clone(bool copyOnWrite = true)
+    {
+        return 0;
+    }
+    virtual void revertToKernelAddressSpace()
+    {
+    }
+    virtual bool memIsInKernelHeap(void *pMem)
+    {
+        return false;
+    }
+    virtual bool memIsInHeap(void *pMem)
+    {
+        return false;
+    }
+    virtual void *getEndOfHeap()
+    {
+        return 0;
+    }
+    virtual uintptr_t getKernelStart() const
+    {
+        return 0x80000000;
+    }
+    virtual uintptr_t getUserStart() const
+    {
+        return 0x1000;
+    }
+    virtual uintptr_t getUserReservedStart() const
+    {
+        return 0x70000000;
+    }
+    virtual uintptr_t getDynamicLinkerAddress() const
+    {
+        return 0x60000000;
+    }
+    virtual uintptr_t getKernelHeapStart() const
+    {
+        return 0x90000000;
+    }
+    virtual uintptr_t getKernelHeapEnd() const
+    {
+        return 0xA0000000;
+    }
+    virtual uintptr_t getKernelCacheStart() const
+    {
+        return 0xA0000000;
+    }
+    virtual uintptr_t getKernelCacheEnd() const
+    {
+        return 0xB0000000;
+    }
+    virtual uintptr_t getKernelEventBlockStart() const
+    {
+        return 0xB0000000;
+    }
+    virtual uintptr_t getKernelModulesStart() const
+    {
+        return 0xC0000000;
+    }
+    virtual uintptr_t getKernelModulesEnd() const
+    {
+        return 0xD0000000;
+    }
+};
+
+// The single processor the shootdowns run on.
+
+static FakeAddressSpace g_KernelSpace;
+static VirtualAddressSpace *g_pCurrent = &g_KernelSpace;
+
+size_t Processor::m_Initialised = 2;
+ProcessorInformation Processor::m_ProcessorInformation(0);
+
+ProcessorInformation &Processor::information()
+{
+    return m_ProcessorInformation;
+}
+
+void Processor::invalidate(void *pAddress)
+{
+}
+
+void Processor::invalidateAll(bool bGlobal)
+{
+}
+
+EnsureInterrupts::EnsureInterrupts(bool desired) : m_bPrevious(false)
+{
+}
+
+EnsureInterrupts::~EnsureInterrupts()
+{
+}
+
+HostedProcessorInformation::HostedProcessorInformation(
+    ProcessorId processorId, uint8_t apicId)
+    : m_ProcessorId(processorId), m_VirtualAddressSpace(0),
+#ifdef THREADS
+      m_pCurrentThread(0), m_Scheduler(0),
+#endif
+      m_KernelStack(0)
+{
+}
+
+HostedProcessorInformation::~HostedProcessorInformation()
+{
+}
+
+VirtualAddressSpace &HostedProcessorInformation::getVirtualAddressSpace() const
+{
+    return *g_pCurrent;
+}
+
+VirtualAddressSpace &VirtualAddressSpace::getKernelAddressSpace()
+{
+    return g_KernelSpace;
+}
+
+PhysicalMemoryManager &PhysicalMemoryManager::instance()
+{
+    // Nothing here frees pages.
+    abort();
+}
+
+TEST(PedigreeTlbShootdown, OtherAddressSpaceMarkedStale)
+{
+    FakeAddressSpace current, other;
+    g_pCurrent = &current;
+    other.clearStale(0);
+
+    {
+        TlbShootdown shootdown(other);
+        shootdown.add(reinterpret_cast<void *>(0x1000));
+    }
+
+    // Nothing flushed this processor's entries for the other address space,
+    // so switching to it has to.
+    EXPECT_TRUE(other.clearStale(0));
+    g_pCurrent = &g_KernelSpace;
+}
+
+TEST(PedigreeTlbShootdown, CurrentAddressSpaceFlushedLocally)
+{
+    FakeAddressSpace current;
+    g_pCurrent = &current;
+    current.clearStale(0);
+
+    {
+        TlbShootdown shootdown(current);
+        shootdown.add(reinterpret_cast<void *>(0x1000));
+    }
+
+    EXPECT_FALSE(current.clearStale(0));
+    g_pCurrent = &g_KernelSpace;
+}
+
+TEST(PedigreeTlbShootdown, EmptyBatchLeavesStaleAlone)
+{
+    FakeAddressSpace current, other;
+    g_pCurrent = &current;
+    other.clearStale(0);
+
+    {
+        TlbShootdown shootdown(other);
+    }
+
+    EXPECT_FALSE(other.clearStale(0));
+    g_pCurrent = &g_KernelSpace;
+}
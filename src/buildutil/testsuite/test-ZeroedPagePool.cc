@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <gtest/gtest.h>
+
+#include <map>
+
+#include "pedigree/kernel/utilities/ZeroedPagePool.h"
+
+#include "FakePageBackend.h"
+
+/// Records how often each page is zeroed, and can act on the pool from
+/// inside zeroPage() as another processor would.
+class FakeZeroBackend : public FakePageBackend<ZeroedPagePool::Backend>
+{
+  public:
+    FakeZeroBackend(size_t available = ~0UL)
+        : FakePageBackend<ZeroedPagePool::Backend>(available), zeroed(),
+          pPool(0), bRefillWhileZeroing(false), bAllocateWhileZeroing(false),
+          allocatedWhileZeroing(0)
+    {
+    }
+
+    virtual void zeroPage(physical_uintptr_t page)
+    {
+        ++zeroed[page];
+
+        if (bAllocateWhileZeroing)
+        {
+            bAllocateWhileZeroing = false;
+            allocatedWhileZeroing = pPool->allocate();
+        }
+
+        if (bRefillWhileZeroing)
+        {
+            bRefillWhileZeroing = false;
+            pPool->refill();
+        }
+    }
+
+    size_t timesZeroed(physical_uintptr_t page)
+    {
+        return zeroed.count(page) ? zeroed[page] : 0;
+    }
+
+    std::map<physical_uintptr_t, size_t> zeroed;
+
+    ZeroedPagePool *pPool;
+    bool bRefillWhileZeroing;
+    bool bAllocateWhileZeroing;
+    physical_uintptr_t allocatedWhileZeroing;
+};
+
+TEST(PedigreeZeroedPagePool, EmptyPoolMisses)
+{
+    FakeZeroBackend backend;
+    ZeroedPagePool pool;
+    pool.setBackend(&backend);
+
+    EXPECT_TRUE(pool.needsRefill());
+    EXPECT_EQ(pool.allocate(), 0U);
+    EXPECT_EQ(pool.misses(), 1U);
+    EXPECT_EQ(pool.hits(), 0U);
+
+    // allocate() never goes to the backend itself; zeroing on a miss is the
+    // caller's job.
+    EXPECT_EQ(backend.takes, 0U);
+    EXPECT_TRUE(backend.zeroed.empty());
+}
+
+TEST(PedigreeZeroedPagePool, RefillZeroesEachPageOnce)
+{
+    FakeZeroBackend backend;
+    ZeroedPagePool pool;
+    pool.setBackend(&backend);
+
+    EXPECT_EQ(pool.refill(), ZeroedPagePool::Capacity);
+    EXPECT_EQ(backend.zeroed.size(), ZeroedPagePool::Capacity);
+
+    // A full pool takes and zeroes nothing more.
+    EXPECT_EQ(pool.refill(), 0U);
+    EXPECT_EQ(backend.zeroed.size(), ZeroedPagePool::Capacity);
+
+    for (size_t i = 0; i < ZeroedPagePool::Capacity; ++i)
+    {
+        physical_uintptr_t page = pool.allocate();
+        EXPECT_NE(page, 0U);
+        EXPECT_EQ(backend.timesZeroed(page), 1U);
+    }
+
+    EXPECT_EQ(pool.hits(), ZeroedPagePool::Capacity);
+    EXPECT_EQ(pool.misses(), 0U);
+    EXPECT_EQ(pool.allocate(), 0U);
+}
+
+TEST(PedigreeZeroedPagePool, ZeroesWithoutHoldingLock)
+{
+    FakeZeroBackend backend;
+    ZeroedPagePool pool;
+    pool.setBackend(&backend);
+    backend.pPool = &pool;
+
+    pool.refill();
+    pool.allocate();
+
+    // Allocating while a page is being zeroed must not wait on the refill.
+    backend.bAllocateWhileZeroing = true;
+    pool.refill();
+    EXPECT_NE(backend.allocatedWhileZeroing, 0U);
+    EXPECT_EQ(backend.timesZeroed(backend.allocatedWhileZeroing), 1U);
+}
+
+TEST(PedigreeZeroedPagePool, FilledWhileZeroing)
+{
+    FakeZeroBackend backend;
+    ZeroedPagePool pool;
+    pool.setBackend(&backend);
+    backend.pPool = &pool;
+
+    // Someone else fills the pool while the first batch is being zeroed; the
+    // batch no longer fits and goes back to the backend.
+    backend.bRefillWhileZeroing = true;
+    EXPECT_EQ(pool.refill(), 0U);
+    EXPECT_EQ(pool.count(), ZeroedPagePool::Capacity);
+    EXPECT_EQ(backend.returned, ZeroedPagePool::Batch);
+
+    // Every page left in the pool was zeroed before it went in.
+    while (physical_uintptr_t page = pool.allocate())
+    {
+        EXPECT_EQ(backend.timesZeroed(page), 1U);
+    }
+}
+
+TEST(PedigreeZeroedPagePool, LowWatermark)
+{
+    FakeZeroBackend backend;
+    ZeroedPagePool pool;
+    pool.setBackend(&backend);
+
+    pool.refill();
+    while (pool.count() > ZeroedPagePool::LowWatermark)
+    {
+        EXPECT_FALSE(pool.needsRefill());
+        pool.allocate();
+    }
+    EXPECT_FALSE(pool.needsRefill());
+
+    pool.allocate();
+    EXPECT_TRUE(pool.needsRefill());
+
+    // Topping up only zeroes the pages that were used.
+    size_t used = ZeroedPagePool::Capacity - pool.count();
+    size_t zeroed = backend.zeroed.size();
+    EXPECT_EQ(pool.refill(), used);
+    EXPECT_EQ(backend.zeroed.size(), zeroed + used);
+}
+
+TEST(PedigreeZeroedPagePool, BackendExhausted)
+{
+    FakeZeroBackend backend(5);
+    ZeroedPagePool pool;
+    pool.setBackend(&backend);
+
+    EXPECT_EQ(pool.refill(), 5U);
+    EXPECT_EQ(pool.count(), 5U);
+    EXPECT_EQ(backend.zeroed.size(), 5U);
+    EXPECT_EQ(pool.refill(), 0U);
+}
+
+TEST(PedigreeZeroedPagePool, DrainDoesNotZero)
+{
+    FakeZeroBackend backend;
+    ZeroedPagePool pool;
+    pool.setBackend(&backend);
+
+    pool.refill();
+    pool.drain();
+    EXPECT_EQ(pool.count(), 0U);
+    EXPECT_EQ(backend.returned, ZeroedPagePool::Capacity);
+    EXPECT_EQ(backend.zeroed.size(), ZeroedPagePool::Capacity);
+}
@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#define PEDIGREE_EXTERNAL_SOURCE 1
+
+#include <stdint.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "pedigree/kernel/utilities/utility.h"
+
+// Straightforward RFC 1071 sum, 16 bits at a time, to check against.
+static uint16_t referenceSum(const uint8_t *buf, size_t len)
+{
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < len; i += 2)
+    {
+        uint16_t word;
+        memcpy(&word, buf + i, 2);
+        sum += word;
+    }
+    if (len & 1)
+    {
+        uint16_t word = 0;
+        memcpy(&word, buf + len - 1, 1);
+        sum += word;
+    }
+    while (sum >> 16)
+    {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return sum;
+}
+
+static void fill(uint8_t *buf, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+TEST(PedigreeChecksum, Empty)
+{
+    uint8_t buf[1] = {0xFF};
+    EXPECT_EQ(OnesComplementSum(buf, 0), 0);
+}
+
+TEST(PedigreeChecksum, KnownHeader)
+{
+    // A well-known example IPv4 header, checksum field included.
+    const uint8_t header[] = {0x45, 0x00, 0x00, 0x73, 0x00, 0x00, 0x40,
+                              0x00, 0x40, 0x11, 0xb8, 0x61, 0xc0, 0xa8,
+                              0x00, 0x01, 0xc0, 0xa8, 0x00, 0xc7};
+    EXPECT_EQ(OnesComplementSum(header, sizeof(header)), 0xFFFF);
+}
+
+TEST(PedigreeChecksum, MatchesReference)
+{
+    uint8_t buf[2048 + 8];
+    fill(buf, sizeof(buf), 1);
+
+    for (size_t align = 0; align < 8; ++align)
+    {
+        for (size_t len = 0; len <= 2048; len += (len < 80 ? 1 : 61))
+        {
+            EXPECT_EQ(
+                OnesComplementSum(buf + align, len),
+                referenceSum(buf + align, len))
+                << "align " << align << " length " << len;
+        }
+    }
+}
+
+TEST(PedigreeChecksum, AllOnes)
+{
+    // Lots of carries out of every accumulator.
+    uint8_t buf[4096];
+    memset(buf, 0xFF, sizeof(buf));
+    EXPECT_EQ(OnesComplementSum(buf, sizeof(buf)), 0xFFFF);
+    EXPECT_EQ(OnesComplementSum(buf, 33), referenceSum(buf, 33));
+}
+
+TEST(PedigreeChecksum, SumCopy)
+{
+    uint8_t src[1500 + 8];
+    uint8_t dest[1500 + 8];
+    fill(src, sizeof(src), 2);
+
+    for (size_t align = 0; align < 8; ++align)
+    {
+        for (size_t len = 0; len <= 1500; len += (len < 80 ? 1 : 37))
+        {
+            memset(dest, 0, sizeof(dest));
+            EXPECT_EQ(
+                OnesComplementSumCopy(dest + align, src + align, len),
+                referenceSum(src + align, len))
+                << "align " << align << " length " << len;
+            EXPECT_EQ(memcmp(dest + align, src + align, len), 0);
+            EXPECT_EQ(dest[align + len], 0);
+        }
+    }
+}
+
+TEST(PedigreeChecksum, Add)
+{
+    EXPECT_EQ(OnesComplementAdd(0x1234, 0x4321), 0x5555);
+    EXPECT_EQ(OnesComplementAdd(0xFFFF, 0x0001), 0x0001);
+    EXPECT_EQ(OnesComplementAdd(0x8000, 0x8000), 0x0001);
+}
+
+TEST(PedigreeChecksum, SplitSums)
+{
+    // Sums of pieces combine to the sum of the whole, as long as pieces
+    // starting at an odd offset are byte swapped first.
+    uint8_t buf[1000];
+    fill(buf, sizeof(buf), 3);
+
+    uint16_t whole = OnesComplementSum(buf, sizeof(buf));
+    for (size_t split = 0; split <= sizeof(buf); split += 7)
+    {
+        uint16_t a = OnesComplementSum(buf, split);
+        uint16_t b = OnesComplementSum(buf + split, sizeof(buf) - split);
+        if (split & 1)
+        {
+            b = (b << 8) | (b >> 8);
+        }
+        EXPECT_EQ(OnesComplementAdd(a, b), whole) << "split " << split;
+    }
+}
@@ -99,3 +99,84 @@ TEST(PedigreeMemoryLibrary, MemoryCompareHalfDiffers)
 
     EXPECT_NE(MemoryCompare(buf1, buf2, 32), 0);
 }
+
+TEST(PedigreeMemoryLibrary, MemoryCompareUnsigned)
+{
+    // Bytes compare as unsigned char, so 0x80 sorts above 0x7F.
+    unsigned char buf1[256];
+    unsigned char buf2[256];
+
+    memset(buf1, 0x7F, 256);
+    memset(buf2, 0x7F, 256);
+    buf2[200] = 0x80;
+
+    EXPECT_LT(MemoryCompare(buf1, buf2, 256), 0);
+    EXPECT_GT(MemoryCompare(buf2, buf1, 256), 0);
+    EXPECT_EQ(MemoryCompare(buf1, buf2, 200), 0);
+}
+
+TEST(PedigreeMemoryLibrary, LargeMemoryCopyAlignments)
+{
+    // Cover the vector loops and their tails at every source/dest alignment.
+    char src[4200];
+    char dest[4200];
+    for (size_t i = 0; i < sizeof(src); ++i)
+    {
+        src[i] = i * 7;
+    }
+
+    for (size_t len = 60; len < 4096; len = (len * 3) / 2 + 1)
+    {
+        for (size_t align = 0; align < 17; ++align)
+        {
+            memset(dest, 0, sizeof(dest));
+            ForwardMemoryCopy(dest + align, src + (16 - align), len);
+            EXPECT_EQ(memcmp(dest + align, src + (16 - align), len), 0);
+            EXPECT_EQ(dest[align + len], 0);
+        }
+    }
+}
+
+TEST(PedigreeMemoryLibrary, LargeReversedMemoryCopy)
+{
+    char buf[4200];
+    char expected[4200];
+    for (size_t i = 0; i < sizeof(buf); ++i)
+    {
+        buf[i] = i * 13;
+    }
+
+    for (size_t distance = 1; distance < 70; distance += 7)
+    {
+        memcpy(expected, buf, sizeof(buf));
+        memmove(expected + distance, expected, 4000);
+        MemoryCopy(buf + distance, buf, 4000);
+        EXPECT_EQ(memcmp(buf, expected, sizeof(buf)), 0);
+    }
+}
+
+TEST(PedigreeMemoryLibrary, LargeByteSet)
+{
+    char buf[4200];
+    memset(buf, 0, sizeof(buf));
+
+    ByteSet(buf + 3, 0xAB, 4100);
+
+    EXPECT_EQ(buf[2], 0);
+    EXPECT_EQ(buf[3], (char) 0xAB);
+    EXPECT_EQ(buf[4102], (char) 0xAB);
+    EXPECT_EQ(buf[4103], 0);
+}
+
+TEST(PedigreeMemoryLibrary, MemoryFind)
+{
+    char buf[512];
+    memset(buf, 'a', sizeof(buf));
+    buf[300] = 'b';
+    buf[400] = 'b';
+
+    EXPECT_EQ(MemoryFind(buf, 'b', sizeof(buf)), buf + 300);
+    EXPECT_EQ(MemoryFind(buf + 301, 'b', 211), buf + 400);
+    EXPECT_EQ(MemoryFind(buf, 'b', 300), nullptr);
+    EXPECT_EQ(MemoryFind(buf, 'c', sizeof(buf)), nullptr);
+}
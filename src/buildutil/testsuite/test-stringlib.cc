@@ -19,6 +19,8 @@
 
 #define PEDIGREE_EXTERNAL_SOURCE 1
 
+#include <string.h>
+
 #include <gtest/gtest.h>
 
 #include "pedigree/kernel/utilities/utility.h"
@@ -29,6 +31,21 @@ TEST(PedigreeStringLibrary, StringLength)
     EXPECT_EQ(StringLength(""), 0);
 }
 
+TEST(PedigreeStringLibrary, LongStringLength)
+{
+    // Long enough to leave the scalar prefix, at every alignment.
+    char buf[600];
+    for (size_t start = 0; start < 16; ++start)
+    {
+        for (size_t len = 60; len < 560; len += 37)
+        {
+            memset(buf, 'a', sizeof(buf));
+            buf[start + len] = 0;
+            EXPECT_EQ(StringLength(buf + start), len);
+        }
+    }
+}
+
 TEST(PedigreeStringLibrary, BasicStrcpy)
 {
     char buf[32] = {0};
@@ -259,6 +276,21 @@ TEST(PedigreeStringLibrary, StringFind)
     EXPECT_EQ(StringFind("abc", 'd'), nullptr);
 }
 
+TEST(PedigreeStringLibrary, LongStringFind)
+{
+    char buf[600];
+    memset(buf, 'a', sizeof(buf));
+    buf[sizeof(buf) - 1] = 0;
+    buf[500] = '\xe2';
+
+    EXPECT_EQ(StringFind(buf + 3, '\xe2'), buf + 500);
+    EXPECT_EQ(StringFind(buf + 3, 0xe2), buf + 500);
+    EXPECT_EQ(StringFind(buf + 3, 'b'), nullptr);
+
+    buf[200] = 0;
+    EXPECT_EQ(StringFind(buf + 3, '\xe2'), nullptr);
+}
+
 TEST(PedigreeStringLibrary, StringReverseFind)
 {
     EXPECT_STREQ(StringReverseFind("abc", 'a'), "abc");
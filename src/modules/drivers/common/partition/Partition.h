@@ -95,6 +95,26 @@ class Partition : public Disk
         pParent->write(location + m_Start);
     }
 
+    virtual void prefetch(uint64_t location, uint64_t size)
+    {
+        if (location >= m_Length)
+            return;
+        else if ((location + size) > m_Length)
+            size = m_Length - location;
+
+        Disk *pParent = static_cast<Disk *>(getParent());
+
+        if (!m_bAligned)
+        {
+            m_bAligned = true;
+            // Ensure that we get blocks aligned on our start position (which is
+            // quite likely to not be on a 4096-byte boundary).
+            pParent->align(m_Start);
+        }
+
+        pParent->prefetch(location + m_Start, size);
+    }
+
     virtual size_t getSize() const
     {
         return getLength();
@@ -323,6 +323,13 @@ uintptr_t ScsiDisk::read(uint64_t location)
         0, SCSI_REQUEST_READ, reinterpret_cast<uint64_t>(this), loc);
     if (numRead < getBlockSize())
     {
+        // A prefetch may have read the block in while our request waited in
+        // the queue, in which case doRead() does nothing.
+        if ((buffer = m_Cache.lookup(location + offs)))
+        {
+            return buffer - offs;
+        }
+
         // Failed to read for some reason, expose the failure to our caller.
         WARNING("ScsiDisk::read - short read!");
         return 0;
@@ -389,6 +396,51 @@ void ScsiDisk::write(uint64_t location)
 #endif
 }
 
+void ScsiDisk::prefetch(uint64_t location, uint64_t size)
+{
+    if (!(getBlockSize() && getNativeBlockSize()))
+    {
+        return;
+    }
+
+    uint64_t end = location + size;
+    if (end > getSize())
+    {
+        end = getSize();
+    }
+
+    // Look through the align points
+    uint64_t alignPoint = 0;
+    for (size_t i = 0; i < m_nAlignPoints; i++)
+        if (m_AlignPoints[i] <= location && m_AlignPoints[i] > alignPoint)
+            alignPoint = m_AlignPoints[i];
+
+    // Calculate the offset to get location on a page boundary.
+    ssize_t offs = -((location - alignPoint) % 4096);
+
+    // Queue a read of each block not already cached. The controller works
+    // through its queue in order, so the disk sees one long sequential read.
+    ScsiController *pParent = static_cast<ScsiController *>(m_pParent);
+    for (uint64_t block = location + offs; block < end;
+         block += getBlockSize())
+    {
+        if ((block + getNativeBlockSize()) > getSize())
+        {
+            break;
+        }
+
+        if (m_Cache.lookup(block))
+        {
+            m_Cache.release(block);
+            continue;
+        }
+
+        pParent->addAsyncRequest(
+            0, SCSI_REQUEST_READ, reinterpret_cast<uint64_t>(this),
+            block & ~(getBlockSize() - 1));
+    }
+}
+
 void ScsiDisk::flush(uint64_t location)
 {
 #ifndef CRIPPLE_HDD
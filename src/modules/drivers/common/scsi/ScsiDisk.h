@@ -93,6 +93,7 @@ class EXPORTED_PUBLIC ScsiDisk : public Disk
 
     virtual uintptr_t read(uint64_t location);
     virtual void write(uint64_t location);
+    virtual void prefetch(uint64_t location, uint64_t size);
     virtual void flush(uint64_t location);
     virtual void align(uint64_t location);
 
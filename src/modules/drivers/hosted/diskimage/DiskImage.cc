@@ -67,6 +67,25 @@ uintptr_t DiskImage::read(uint64_t location)
     return buffer + offset;
 }
 
+void DiskImage::prefetch(uint64_t location, uint64_t size)
+{
+    uint64_t end = location + size;
+    if (end > m_nSize)
+    {
+        end = m_nSize;
+    }
+
+    // Bring every block in the range into the cache; nothing stays pinned.
+    location &= ~(getBlockSize() - 1);
+    for (; location < end; location += getBlockSize())
+    {
+        if (read(location) != static_cast<uintptr_t>(~0))
+        {
+            unpin(location);
+        }
+    }
+}
+
 size_t DiskImage::getSize() const
 {
     return m_nSize;
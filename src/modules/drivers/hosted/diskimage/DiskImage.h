@@ -49,6 +49,8 @@ class DiskImage : public Disk
 
     virtual uintptr_t read(uint64_t location);
 
+    virtual void prefetch(uint64_t location, uint64_t size);
+
     virtual size_t getSize() const;
 
     virtual size_t getBlockSize() const
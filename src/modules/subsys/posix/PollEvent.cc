@@ -20,6 +20,7 @@
 #include "modules/subsys/posix/PollEvent.h"
 #include "modules/system/vfs/File.h"
 #include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/process/Semaphore.h"
 
 static void pollEventHandler(uint8_t *pBuffer);
 
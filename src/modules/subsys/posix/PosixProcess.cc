@@ -61,6 +61,21 @@ PosixProcess::PosixProcess(Process *pParent, bool bCopyOnWrite)
       m_RealIntervalTimer(this, IntervalTimer::Hardware),
       m_VirtualIntervalTimer(this, IntervalTimer::Virtual),
       m_ProfileIntervalTimer(this, IntervalTimer::Profile)
+{
+    inheritFrom(pParent);
+}
+
+PosixProcess::PosixProcess(Process *pParent, BorrowAddressSpaceTag tag)
+    : Process(pParent, tag), m_pSession(0), m_pProcessGroup(0),
+      m_GroupMembership(NoGroup), m_Mask(0),
+      m_RealIntervalTimer(this, IntervalTimer::Hardware),
+      m_VirtualIntervalTimer(this, IntervalTimer::Virtual),
+      m_ProfileIntervalTimer(this, IntervalTimer::Profile)
+{
+    inheritFrom(pParent);
+}
+
+void PosixProcess::inheritFrom(Process *pParent)
 {
     if (pParent->getType() == Posix)
     {
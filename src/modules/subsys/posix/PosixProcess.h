@@ -154,6 +154,8 @@ class EXPORTED_PUBLIC PosixProcess : public Process
 
     /** Copy constructor. */
     PosixProcess(Process *pParent, bool bCopyOnWrite = true);
+    /** vfork() constructor, see Process. */
+    PosixProcess(Process *pParent, BorrowAddressSpaceTag tag);
     virtual ~PosixProcess();
 
     void setProcessGroup(ProcessGroup *newGroup, bool bRemoveFromGroup = true);
@@ -195,6 +197,9 @@ class EXPORTED_PUBLIC PosixProcess : public Process
     void setSavedGroupId(int64_t id);
 
   private:
+    /** Copies POSIX credentials, session and group from a parent. */
+    void inheritFrom(Process *pParent);
+
     // Register with other systems e.g. procfs
     void registerProcess();
     void unregisterProcess();
@@ -45,6 +45,7 @@
 #include "modules/system/vfs/File.h"
 #include "modules/system/vfs/LockedFile.h"
 #include "modules/system/vfs/MemoryMappedFile.h"
+#include "modules/system/vfs/Prefetcher.h"
 #include "modules/system/vfs/Symlink.h"
 #include "modules/system/vfs/VFS.h"
 #include "pedigree/kernel/linker/Elf.h"
@@ -447,7 +448,11 @@ void PosixSubsystem::exit(int code)
 
     delete pProcess->getLinker();
 
-    MemoryMapManager::instance().unmapAll();
+    // A vfork() child must leave its parent's mappings alone.
+    if (!pProcess->hasBorrowedAddressSpace())
+    {
+        MemoryMapManager::instance().unmapAll();
+    }
 
     // If it's a POSIX process, remove group membership
     if (pProcess->getType() == Process::Posix)
@@ -1460,6 +1465,9 @@ bool PosixSubsystem::invoke(
         return -1;
     }
 
+    // Start reading in what this program needed last time it started up.
+    Prefetcher::instance().startExec(originalFile);
+
     File *interpreterFile = 0;
 
     // Inhibit all signals from coming in while we trash the address space...
@@ -1496,6 +1504,15 @@ bool PosixSubsystem::invoke(
     pLinker = 0;
     pProcess->setLinker(pLinker);
 
+    // A vfork() child takes a fresh address space here rather than wiping
+    // out its parent's, which also lets the parent run again.
+    if (!pProcess->detachAddressSpace())
+    {
+        PS_NOTICE("PosixSubsystem::invoke: failed to detach address space");
+        SYSCALL_ERROR(OutOfMemory);
+        return false;
+    }
+
     // Wipe out old address space.
     MemoryMapManager::instance().unmapAll();
 
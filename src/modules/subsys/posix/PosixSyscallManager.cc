@@ -48,6 +48,9 @@
 
 PosixSyscallManager::PosixSyscallManager()
 {
+    // Translate every Linux syscall once, rather than on each call.
+    for (size_t i = 0; i < POSIX_LINUX_SYSCALLS; ++i)
+        m_LinuxTranslation[i] = posix_translate_syscall(i);
 }
 
 PosixSyscallManager::~PosixSyscallManager()
@@ -94,7 +97,11 @@ uintptr_t PosixSyscallManager::syscall(SyscallState &state)
         base = 6;  // use Linux syscall ABI
 
         // Translate the syscall.
-        long which = posix_translate_syscall(syscallNumber);
+        long which;
+        if (LIKELY(syscallNumber < POSIX_LINUX_SYSCALLS))
+            which = m_LinuxTranslation[syscallNumber];
+        else
+            which = posix_translate_syscall(syscallNumber);
         if (which < 0)
         {
             size_t key = (pProcess->getId() << 32ULL) | syscallNumber;
@@ -152,11 +159,16 @@ uintptr_t PosixSyscallManager::syscall(SyscallState &state)
             return posix_sbrk(p1);
         case POSIX_FORK:
             return posix_fork(state);
+        case POSIX_VFORK:
+            return posix_vfork(state);
         case POSIX_EXECVE:
             return posix_execve(
                 reinterpret_cast<const char *>(p1),
                 reinterpret_cast<const char **>(p2),
                 reinterpret_cast<const char **>(p3), state);
+        case POSIX_PEDIGREE_SPAWN:
+            return pedigree_spawn(
+                reinterpret_cast<const pedigree_spawn_request *>(p1));
         case POSIX_WAITPID:
             return posix_waitpid(p1, reinterpret_cast<int *>(p2), p3);
         case POSIX_EXIT:
@@ -441,6 +453,9 @@ uintptr_t PosixSyscallManager::syscall(SyscallState &state)
         case POSIX_MPROTECT:
             return posix_mprotect(
                 reinterpret_cast<void *>(p1), p2, static_cast<int>(p3));
+        case POSIX_MADVISE:
+            return posix_memadvise(
+                reinterpret_cast<void *>(p1), p2, static_cast<int>(p3));
 
         case POSIX_REALPATH:
             return posix_realpath(
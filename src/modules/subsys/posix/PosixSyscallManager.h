@@ -24,6 +24,9 @@
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/utilities/Tree.h"
 
+/** Linux syscall numbers translated ahead of time. */
+#define POSIX_LINUX_SYSCALLS 512
+
 class PosixSyscallManager : public SyscallHandler
 {
   public:
@@ -51,6 +54,8 @@ class PosixSyscallManager : public SyscallHandler
     PosixSyscallManager &operator=(const PosixSyscallManager &);
     /** Records seen unknown syscalls so we don't spam logs. */
     Tree<size_t, bool> m_SeenUnknownSyscalls;
+    /** Pedigree syscall for each Linux syscall, or -1 if not translated. */
+    int16_t m_LinuxTranslation[POSIX_LINUX_SYSCALLS];
 };
 
 #endif
@@ -21,12 +21,20 @@
 
 #include "modules/system/users/Group.h"
 #include "modules/system/users/User.h"
+#include "modules/system/vfs/MemoryMappedFile.h"
 #include "pedigree/kernel/BootstrapInfo.h"
 #include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/Version.h"
+#include "pedigree/kernel/core/SlamAllocator.h"
+#include "pedigree/kernel/linker/KernelElf.h"
 #include "pedigree/kernel/machine/Device.h"
+#include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/SyscallManager.h"
+#include "pedigree/kernel/processor/TlbShootdown.h"
 #include "pedigree/kernel/time/Time.h"
+#include "pedigree/kernel/utilities/Cache.h"
 
 #include "file-syscalls.h"
 
@@ -75,9 +83,37 @@ void MeminfoFile::updateThread()
         m_Lock.acquire();
         uint64_t freeKb = (g_FreePages * 4096) / 1024;      // each page is 4K
         uint64_t allocKb = (g_AllocedPages * 4096) / 1024;  // each page is 4K
+        CompressedPageStore &swap = AnonymousMemoryMap::getSwapStore();
+        size_t swapIns = AnonymousMemoryMap::swapIns();
         m_Contents.Format(
-            "MemTotal: %ld kB\nMemFree: %ld kB\nMemAvailable: %ld kB\n",
-            freeKb + allocKb, freeKb, freeKb);
+            "MemTotal: %ld kB\nMemFree: %ld kB\nMemAvailable: %ld kB\n"
+            "HugePageFaults: %ld\nHugePageFallbacks: %ld\n"
+            "HeapHugeSlabs: %ld\nHeapHugeSlabFallbacks: %ld\n"
+            "TlbShootdownIpis: %ld\nTlbFullFlushes: %ld\n"
+            "ZeroedPageHits: %ld\nZeroedPageMisses: %ld\n"
+            "Active(file): %ld kB\nInactive(file): %ld kB\n"
+            "ReclaimWakeups: %ld\nReclaimedPages: %ld\n"
+            "ReclaimWritebacks: %ld\nDirectReclaimStalls: %ld\n"
+            "SwapStored: %ld kB\nSwapCompressed: %ld kB\n"
+            "SwapStoreMemory: %ld kB\nSwapIncompressible: %ld\n"
+            "SwapOuts: %ld\nSwapIns: %ld\nSwapInLatency: %ld ns\n",
+            freeKb + allocKb, freeKb, freeKb,
+            AnonymousMemoryMap::hugePageFaults(),
+            AnonymousMemoryMap::hugePageFallbacks(),
+            SlamAllocator::instance().hugeSlabHits(),
+            SlamAllocator::instance().hugeSlabFallbacks(),
+            TlbShootdown::interruptsSent(), TlbShootdown::fullFlushes(),
+            PhysicalMemoryManager::instance().zeroedPageHits(),
+            PhysicalMemoryManager::instance().zeroedPageMisses(),
+            (Cache::activePages() * 4096) / 1024,
+            (Cache::inactivePages() * 4096) / 1024,
+            CacheManager::instance().reclaimWakeups(),
+            Cache::reclaimedPages(), Cache::reclaimWritebacks(),
+            CacheManager::instance().directReclaimStalls(),
+            (swap.storedPages() * 4096) / 1024, swap.compressedBytes() / 1024,
+            (swap.backingPages() * 4096) / 1024, swap.incompressiblePages(),
+            AnonymousMemoryMap::swapOuts(), swapIns,
+            swapIns ? AnonymousMemoryMap::swapInTime() / swapIns : 0);
         m_Lock.release();
 
         Time::delay(1 * Time::Multiplier::Second);
@@ -319,6 +355,223 @@ String UptimeFile::generateString()
     return f;
 }
 
+BuddyinfoFile::BuddyinfoFile(
+    size_t inode, Filesystem *pParentFS, File *pParent)
+    : File(String("buddyinfo"), 0, 0, 0, inode, pParentFS, 0, pParent)
+{
+    setPermissionsOnly(FILE_UR | FILE_GR | FILE_OR);
+    setUidOnly(0);
+    setGidOnly(0);
+}
+
+BuddyinfoFile::~BuddyinfoFile() = default;
+
+uint64_t BuddyinfoFile::readBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    String f = generateString();
+
+    if (location >= f.length())
+    {
+        // "EOF"
+        return 0;
+    }
+
+    if ((location + size) >= f.length())
+    {
+        size = f.length() - location;
+    }
+
+    char *destination = reinterpret_cast<char *>(buffer);
+    StringCopyN(destination, static_cast<const char *>(f) + location, size);
+
+    return size;
+}
+
+uint64_t BuddyinfoFile::writeBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    return 0;
+}
+
+size_t BuddyinfoFile::getSize()
+{
+    String f = generateString();
+    return f.length();
+}
+
+String BuddyinfoFile::generateString()
+{
+    String f;
+    PhysicalMemoryManager::instance().fragmentationReport(f);
+    return f;
+}
+
+LockstatFile::LockstatFile(size_t inode, Filesystem *pParentFS, File *pParent)
+    : File(String("lock_stat"), 0, 0, 0, inode, pParentFS, 0, pParent)
+{
+    setPermissionsOnly(FILE_UR | FILE_GR | FILE_OR);
+    setUidOnly(0);
+    setGidOnly(0);
+}
+
+LockstatFile::~LockstatFile() = default;
+
+uint64_t LockstatFile::readBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    String f = generateString();
+
+    if (location >= f.length())
+    {
+        // "EOF"
+        return 0;
+    }
+
+    if ((location + size) >= f.length())
+    {
+        size = f.length() - location;
+    }
+
+    char *destination = reinterpret_cast<char *>(buffer);
+    StringCopyN(destination, static_cast<const char *>(f) + location, size);
+
+    return size;
+}
+
+uint64_t LockstatFile::writeBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    return 0;
+}
+
+size_t LockstatFile::getSize()
+{
+    String f = generateString();
+    return f.length();
+}
+
+String LockstatFile::generateString()
+{
+    String f;
+    f.Format(
+        "%-18s %10s %10s %14s %12s %14s %12s  %s\n", "lock", "acquires",
+        "contended", "spin-total", "spin-max", "hold-total", "hold-max",
+        "acquired-at");
+
+    Spinlock::Statistics stats;
+    for (size_t i = 0; i < SPINLOCK_STATISTICS_SLOTS; ++i)
+    {
+        if (!Spinlock::getStatistics(i, stats))
+        {
+            continue;
+        }
+
+        uintptr_t symStart = 0;
+        const char *pSym =
+            KernelElf::instance().globalLookupSymbol(stats.ra, &symStart);
+
+        String line;
+        line.Format(
+            "%018lx %10lu %10lu %14lu %12lu %14lu %12lu  %s+%lx\n",
+            static_cast<uintptr_t>(stats.pLock), stats.nAcquires,
+            stats.nContended, stats.spinTime, stats.maxSpinTime,
+            stats.holdTime, stats.maxHoldTime, pSym ? pSym : "?",
+            stats.ra - symStart);
+        f += line;
+    }
+
+    return f;
+}
+
+SyscallStatFile::SyscallStatFile(
+    size_t inode, Filesystem *pParentFS, File *pParent)
+    : File(String("syscall_stat"), 0, 0, 0, inode, pParentFS, 0, pParent)
+{
+    setPermissionsOnly(FILE_UR | FILE_GR | FILE_OR);
+    setUidOnly(0);
+    setGidOnly(0);
+}
+
+SyscallStatFile::~SyscallStatFile() = default;
+
+uint64_t SyscallStatFile::readBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    String f = generateString();
+
+    if (location >= f.length())
+    {
+        // "EOF"
+        return 0;
+    }
+
+    if ((location + size) >= f.length())
+    {
+        size = f.length() - location;
+    }
+
+    char *destination = reinterpret_cast<char *>(buffer);
+    StringCopyN(destination, static_cast<const char *>(f) + location, size);
+
+    return size;
+}
+
+uint64_t SyscallStatFile::writeBytewise(
+    uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
+{
+    return 0;
+}
+
+size_t SyscallStatFile::getSize()
+{
+    String f = generateString();
+    return f.length();
+}
+
+String SyscallStatFile::generateString()
+{
+    // Histogram buckets are listed as log2(cycles):count, for those in use.
+    String f;
+    f.Format(
+        "%-10s %6s %10s %14s %12s  %s\n", "service", "number", "calls",
+        "total", "max", "histogram");
+
+    SyscallManager::Statistics stats;
+    for (size_t service = 0; service < serviceEnd; ++service)
+    {
+        for (size_t n = 0; n < SYSCALL_STATISTICS_NUMBERS; ++n)
+        {
+            Service_t s = static_cast<Service_t>(service);
+            if (!SyscallManager::getStatistics(s, n, stats))
+            {
+                continue;
+            }
+
+            String line;
+            line.Format(
+                "%-10s %6lu %10lu %14lu %12lu ",
+                SyscallManager::getServiceName(s), n, stats.nCalls,
+                stats.totalTime, stats.maxTime);
+            f += line;
+
+            for (size_t i = 0; i < SYSCALL_STATISTICS_BUCKETS; ++i)
+            {
+                if (!stats.histogram[i])
+                {
+                    continue;
+                }
+
+                line.Format(" %lu:%lu", i, stats.histogram[i]);
+                f += line;
+            }
+            f += "\n";
+        }
+    }
+
+    return f;
+}
+
 ConstantFile::ConstantFile(
     String name, const char *value, size_t size, size_t inode,
     Filesystem *pParentFS, File *pParent)
@@ -411,6 +664,17 @@ bool ProcFs::initialise(Disk *pDisk)
     UptimeFile *uptime = new UptimeFile(getNextInode(), this, m_pRoot);
     m_pRoot->addEntry(uptime->getName(), uptime);
 
+    BuddyinfoFile *buddyinfo =
+        new BuddyinfoFile(getNextInode(), this, m_pRoot);
+    m_pRoot->addEntry(buddyinfo->getName(), buddyinfo);
+
+    LockstatFile *lockstat = new LockstatFile(getNextInode(), this, m_pRoot);
+    m_pRoot->addEntry(lockstat->getName(), lockstat);
+
+    SyscallStatFile *syscallstat =
+        new SyscallStatFile(getNextInode(), this, m_pRoot);
+    m_pRoot->addEntry(syscallstat->getName(), syscallstat);
+
     String fs("\text2\nnodev\tproc\nnodev\ttmpfs\n");
     ConstantFile *pFilesystems = new ConstantFile(
         String("filesystems"), fs, fs.length(), getNextInode(), this, m_pRoot);
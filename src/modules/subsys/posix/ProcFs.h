@@ -138,6 +138,79 @@ class UptimeFile : public File
     }
 };
 
+class BuddyinfoFile : public File
+{
+  public:
+    BuddyinfoFile(size_t inode, Filesystem *pParentFS, File *pParent);
+    ~BuddyinfoFile();
+
+    virtual uint64_t readBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+    virtual uint64_t writeBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+
+    virtual size_t getSize();
+
+  private:
+    String generateString();
+
+    virtual bool isBytewise() const
+    {
+        return true;
+    }
+};
+
+/** Per-lock contention statistics for the most contended spinlocks. */
+class LockstatFile : public File
+{
+  public:
+    LockstatFile(size_t inode, Filesystem *pParentFS, File *pParent);
+    ~LockstatFile();
+
+    virtual uint64_t readBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+    virtual uint64_t writeBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+
+    virtual size_t getSize();
+
+  private:
+    String generateString();
+
+    virtual bool isBytewise() const
+    {
+        return true;
+    }
+};
+
+class SyscallStatFile : public File
+{
+  public:
+    SyscallStatFile(size_t inode, Filesystem *pParentFS, File *pParent);
+    ~SyscallStatFile();
+
+    virtual uint64_t readBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+    virtual uint64_t writeBytewise(
+        uint64_t location, uint64_t size, uintptr_t buffer,
+        bool bCanBlock = true);
+
+    virtual size_t getSize();
+
+  private:
+    String generateString();
+
+    virtual bool isBytewise() const
+    {
+        return true;
+    }
+};
+
 class ConstantFile : public File
 {
   public:
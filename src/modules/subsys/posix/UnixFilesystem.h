@@ -24,6 +24,7 @@
 #include "modules/system/vfs/File.h"
 #include "modules/system/vfs/Filesystem.h"
 
+#include "pedigree/kernel/process/Semaphore.h"
 #include "pedigree/kernel/utilities/Buffer.h"
 #include "pedigree/kernel/utilities/RingBuffer.h"
 
@@ -240,7 +241,8 @@ class UnixSocket : public File
     // Other side of the connection (for stream sockets).
     UnixSocket *m_pOther;
 
-    // Data stream.
+    // Data stream. A reader blocked on an empty stream is handed data by
+    // the writer directly, without it being buffered here first.
     UnixSocketStream m_Stream;
 
     // List of sockets pending accept() on this socket.
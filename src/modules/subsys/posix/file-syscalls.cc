@@ -2039,6 +2039,13 @@ void *posix_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off)
             return MAP_FAILED;
         }
 
+        // Huge pages are still only used where they fit and are available,
+        // rather than being reserved up front.
+        if (flags & MAP_HUGETLB)
+        {
+            pObject->setHugePages(MemoryMappedObject::AlwaysHugePages);
+        }
+
         F_NOTICE("  -> " << sanityAddress);
 
         finalAddress = reinterpret_cast<void *>(sanityAddress);
@@ -2183,6 +2190,70 @@ int posix_mprotect(void *p, size_t len, int prot)
     return 0;
 }
 
+int posix_memadvise(void *p, size_t len, int advice)
+{
+    F_NOTICE("madvise");
+    F_NOTICE(
+        "  -> addr=" << p << ", len=" << len << ", advice=" << Dec << advice
+                     << Hex);
+
+    uintptr_t addr = reinterpret_cast<uintptr_t>(p);
+    size_t pageSz = PhysicalMemoryManager::getPageSize();
+
+    // Verify the passed address
+    if (addr & (pageSz - 1))
+    {
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    switch (advice)
+    {
+        case MADV_HUGEPAGE:
+        case MADV_NOHUGEPAGE:
+        case MADV_DONTNEED:
+            break;
+
+        case MADV_NORMAL:
+        case MADV_RANDOM:
+        case MADV_SEQUENTIAL:
+        case MADV_WILLNEED:
+            // Only advice, which we're free to ignore.
+            return 0;
+
+        default:
+            SYSCALL_ERROR(InvalidArgument);
+            return -1;
+    }
+
+    // Linux accepts an empty range and does nothing.
+    if (!len)
+    {
+        return 0;
+    }
+
+    // Make sure there's at least one object we'll touch.
+    if (!MemoryMapManager::instance().contains(addr, len))
+    {
+        SYSCALL_ERROR(OutOfMemory);
+        return -1;
+    }
+
+    if (advice == MADV_DONTNEED)
+    {
+        // Not just advice - the pages must read afresh on the next access.
+        MemoryMapManager::instance().discard(addr, len);
+        return 0;
+    }
+
+    MemoryMapManager::instance().setHugePages(
+        addr, len,
+        advice == MADV_HUGEPAGE ? MemoryMappedObject::AlwaysHugePages :
+                                  MemoryMappedObject::NoHugePages);
+
+    return 0;
+}
+
 int posix_munmap(void *addr, size_t len)
 {
     F_NOTICE(
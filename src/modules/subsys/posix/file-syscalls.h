@@ -86,6 +86,7 @@ posix_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t off);
 int posix_msync(void *p, size_t len, int flags);
 int posix_munmap(void *addr, size_t len);
 int posix_mprotect(void *addr, size_t len, int prot);
+int posix_memadvise(void *addr, size_t len, int advice);
 
 int posix_access(const char *name, int amode);
 
@@ -23,7 +23,56 @@
 
 #ifdef X86_COMMON
 
-void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include "glue-memory.h"
+
+/* Enhanced rep movsb/stosb; cpuid.h has no name for it. */
+#define CPUID_7_EBX_ERMS (1 << 9)
+
+/* Detected once, on the first call to any of the dispatched functions. */
+static int memory_features = -1;
+
+static int detect_memory_features(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    int features = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return 0;
+
+    if (edx & bit_SSE2)
+        features |= GLUE_MEMORY_SSE2;
+
+    /* AVX also needs the kernel to have enabled the YMM state. */
+    int avx = 0;
+    if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX))
+    {
+        unsigned int xcr0_lo, xcr0_hi;
+        asm volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+        avx = (xcr0_lo & 0x6) == 0x6;
+    }
+
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+    {
+        if (ebx & CPUID_7_EBX_ERMS)
+            features |= GLUE_MEMORY_ERMS;
+        if (avx && (ebx & bit_AVX2))
+            features |= GLUE_MEMORY_AVX2;
+    }
+
+    return features;
+}
+
+int _glue_memory_features(void)
+{
+    if (memory_features < 0)
+        memory_features = detect_memory_features();
+    return memory_features;
+}
+
+static inline void *rep_movsb(void *s1, const void *s2, size_t n)
 {
     int a, b, c;
     asm volatile("rep movsb"
@@ -33,6 +82,77 @@ void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
     return s1;
 }
 
+__attribute__((target("sse2"))) static void *
+memcpy_sse2(void *restrict s1, const void *restrict s2, size_t n)
+{
+    unsigned char *d = (unsigned char *) s1;
+    const unsigned char *s = (const unsigned char *) s2;
+
+    for (; n >= 64; n -= 64, d += 64, s += 64)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *) (s + 0));
+        __m128i b = _mm_loadu_si128((const __m128i *) (s + 16));
+        __m128i c = _mm_loadu_si128((const __m128i *) (s + 32));
+        __m128i e = _mm_loadu_si128((const __m128i *) (s + 48));
+        _mm_storeu_si128((__m128i *) (d + 0), a);
+        _mm_storeu_si128((__m128i *) (d + 16), b);
+        _mm_storeu_si128((__m128i *) (d + 32), c);
+        _mm_storeu_si128((__m128i *) (d + 48), e);
+    }
+    for (; n >= 16; n -= 16, d += 16, s += 16)
+        _mm_storeu_si128(
+            (__m128i *) d, _mm_loadu_si128((const __m128i *) s));
+
+    rep_movsb(d, s, n);
+    return s1;
+}
+
+__attribute__((target("avx2"))) static void *
+memcpy_avx2(void *restrict s1, const void *restrict s2, size_t n)
+{
+    unsigned char *d = (unsigned char *) s1;
+    const unsigned char *s = (const unsigned char *) s2;
+
+    for (; n >= 128; n -= 128, d += 128, s += 128)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *) (s + 0));
+        __m256i b = _mm256_loadu_si256((const __m256i *) (s + 32));
+        __m256i c = _mm256_loadu_si256((const __m256i *) (s + 64));
+        __m256i e = _mm256_loadu_si256((const __m256i *) (s + 96));
+        _mm256_storeu_si256((__m256i *) (d + 0), a);
+        _mm256_storeu_si256((__m256i *) (d + 32), b);
+        _mm256_storeu_si256((__m256i *) (d + 64), c);
+        _mm256_storeu_si256((__m256i *) (d + 96), e);
+    }
+    for (; n >= 32; n -= 32, d += 32, s += 32)
+        _mm256_storeu_si256(
+            (__m256i *) d, _mm256_loadu_si256((const __m256i *) s));
+
+    rep_movsb(d, s, n);
+    return s1;
+}
+
+void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
+{
+    if (n < GLUE_VECTOR_THRESHOLD)
+        return rep_movsb(s1, s2, n);
+
+    int features = _glue_memory_features();
+    int erms = features & GLUE_MEMORY_ERMS;
+    if (features & GLUE_MEMORY_AVX2)
+    {
+        if (!(erms && n >= GLUE_AVX_REP_THRESHOLD))
+            return memcpy_avx2(s1, s2, n);
+    }
+    else if (features & GLUE_MEMORY_SSE2)
+    {
+        if (!(erms && n >= GLUE_SSE_REP_THRESHOLD))
+            return memcpy_sse2(s1, s2, n);
+    }
+
+    return rep_movsb(s1, s2, n);
+}
+
 #else
 
 /* No custom memcpy on ARM. */
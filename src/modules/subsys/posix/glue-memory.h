@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GLUE_MEMORY_H
+#define _GLUE_MEMORY_H
+
+/* Shared by glue-memcpy.c and glue-memset.c to pick a vectorised path. */
+
+#define GLUE_MEMORY_SSE2 (1 << 0)
+#define GLUE_MEMORY_AVX2 (1 << 1)
+#define GLUE_MEMORY_ERMS (1 << 2)
+
+/* Below this, rep movsb/stosb is as quick as anything else. */
+#define GLUE_VECTOR_THRESHOLD 64
+
+/* Above these, rep movsb/stosb beats the vector loops on ERMS processors. */
+#define GLUE_SSE_REP_THRESHOLD 1024
+#define GLUE_AVX_REP_THRESHOLD 4096
+
+/* Returns the GLUE_MEMORY_* flags for this processor (from CPUID, once). */
+int _glue_memory_features(void);
+
+#endif
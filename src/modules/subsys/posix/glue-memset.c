@@ -23,7 +23,11 @@
 
 #ifdef X86_COMMON
 
-void *memset(void *s, int c, size_t n)
+#include <immintrin.h>
+
+#include "glue-memory.h"
+
+static inline void *rep_stosb(void *s, int c, size_t n)
 {
     int a, b;
     asm volatile("rep stosb"
@@ -33,4 +37,65 @@ void *memset(void *s, int c, size_t n)
     return s;
 }
 
+__attribute__((target("sse2"))) static void *
+memset_sse2(void *s, int c, size_t n)
+{
+    unsigned char *d = (unsigned char *) s;
+    __m128i v = _mm_set1_epi8((char) c);
+
+    for (; n >= 64; n -= 64, d += 64)
+    {
+        _mm_storeu_si128((__m128i *) (d + 0), v);
+        _mm_storeu_si128((__m128i *) (d + 16), v);
+        _mm_storeu_si128((__m128i *) (d + 32), v);
+        _mm_storeu_si128((__m128i *) (d + 48), v);
+    }
+    for (; n >= 16; n -= 16, d += 16)
+        _mm_storeu_si128((__m128i *) d, v);
+
+    rep_stosb(d, c, n);
+    return s;
+}
+
+__attribute__((target("avx2"))) static void *
+memset_avx2(void *s, int c, size_t n)
+{
+    unsigned char *d = (unsigned char *) s;
+    __m256i v = _mm256_set1_epi8((char) c);
+
+    for (; n >= 128; n -= 128, d += 128)
+    {
+        _mm256_storeu_si256((__m256i *) (d + 0), v);
+        _mm256_storeu_si256((__m256i *) (d + 32), v);
+        _mm256_storeu_si256((__m256i *) (d + 64), v);
+        _mm256_storeu_si256((__m256i *) (d + 96), v);
+    }
+    for (; n >= 32; n -= 32, d += 32)
+        _mm256_storeu_si256((__m256i *) d, v);
+
+    rep_stosb(d, c, n);
+    return s;
+}
+
+void *memset(void *s, int c, size_t n)
+{
+    if (n < GLUE_VECTOR_THRESHOLD)
+        return rep_stosb(s, c, n);
+
+    int features = _glue_memory_features();
+    int erms = features & GLUE_MEMORY_ERMS;
+    if (features & GLUE_MEMORY_AVX2)
+    {
+        if (!(erms && n >= GLUE_AVX_REP_THRESHOLD))
+            return memset_avx2(s, c, n);
+    }
+    else if (features & GLUE_MEMORY_SSE2)
+    {
+        if (!(erms && n >= GLUE_SSE_REP_THRESHOLD))
+            return memset_sse2(s, c, n);
+    }
+
+    return rep_stosb(s, c, n);
+}
+
 #endif
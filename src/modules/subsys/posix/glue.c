@@ -1778,6 +1778,11 @@ int mprotect(void *addr, size_t len, int prot)
     return syscall3(POSIX_MPROTECT, (long) addr, len, prot);
 }
 
+int madvise(void *addr, size_t len, int advice)
+{
+    return syscall3(POSIX_MADVISE, (long) addr, len, advice);
+}
+
 int nanosleep(const struct timespec *rqtp, struct timespec *rmtp)
 {
     if (!rqtp)
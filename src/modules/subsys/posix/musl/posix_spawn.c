@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+// Replaces musl's posix_spawn.c and posix_spawnp.c. Rather than cloning the
+// caller and running the file actions and exec in the child, the whole
+// request goes to the kernel, which builds the child from the executable.
+
+#include <errno.h>
+#include <limits.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "fdop.h"
+
+// From the Pedigree source tree (syscall stubs). References musl errno.
+#include <posix-spawn.h>
+#include <posix-syscall.h>
+#include <posixSyscallNumbers.h>
+
+static int spawn_request(pid_t *restrict res, const char *path,
+                         const posix_spawn_file_actions_t *fa,
+                         const posix_spawnattr_t *restrict attr,
+                         char *const argv[], char *const envp[])
+{
+    struct pedigree_spawn_request request;
+    struct pedigree_spawn_action *actions = 0;
+    struct fdop *op;
+    size_t n = 0;
+    long err = 0;
+    long r;
+
+    // Actions are kept newest first, so count them and find the oldest.
+    op = fa ? fa->__actions : 0;
+    if (op)
+    {
+        for (n = 1; op->next; op = op->next, ++n);
+
+        actions = malloc(n * sizeof(*actions));
+        if (!actions)
+            return ENOMEM;
+
+        for (size_t i = 0; i < n; ++i, op = op->prev)
+        {
+            actions[i].cmd = op->cmd;
+            actions[i].fd = op->fd;
+            actions[i].srcfd = op->srcfd;
+            actions[i].oflag = op->oflag;
+            actions[i].mode = op->mode;
+            actions[i].path = op->cmd == FDOP_OPEN ? op->path : 0;
+        }
+    }
+
+    request.path = path;
+    request.argv = argv;
+    request.envp = envp;
+    request.actions = actions;
+    request.action_count = n;
+    request.flags = 0;
+    request.pgroup = 0;
+
+    /// \todo POSIX_SPAWN_SETSIGMASK and POSIX_SPAWN_SETSIGDEF are ignored.
+    if (attr)
+    {
+        request.flags = attr->__flags &
+                        (PEDIGREE_SPAWN_RESETIDS | PEDIGREE_SPAWN_SETPGROUP);
+        request.pgroup = attr->__pgrp;
+    }
+
+    r = syscall6_err(POSIX_PEDIGREE_SPAWN, (long) &request, 0, 0, 0, 0, 0,
+                     &err);
+    free(actions);
+
+    if (err)
+        return err;
+
+    if (res)
+        *res = r;
+    return 0;
+}
+
+int posix_spawn(pid_t *restrict res, const char *restrict path,
+                const posix_spawn_file_actions_t *fa,
+                const posix_spawnattr_t *restrict attr,
+                char *const argv[restrict], char *const envp[restrict])
+{
+    return spawn_request(res, path, fa, attr, argv, envp);
+}
+
+int posix_spawnp(pid_t *restrict res, const char *restrict file,
+                 const posix_spawn_file_actions_t *fa,
+                 const posix_spawnattr_t *restrict attr,
+                 char *const argv[restrict], char *const envp[restrict])
+{
+    const char *p, *z, *path = getenv("PATH");
+    size_t l, k;
+    int seen_eacces = 0;
+    int ret;
+
+    if (!*file)
+        return ENOENT;
+    if (strchr(file, '/'))
+        return spawn_request(res, file, fa, attr, argv, envp);
+
+    // Same search as execvp().
+    if (!path)
+        path = "/usr/local/bin:/bin:/usr/bin";
+    k = strnlen(file, NAME_MAX + 1);
+    if (k > NAME_MAX)
+        return ENAMETOOLONG;
+    l = strnlen(path, PATH_MAX - 1) + 1;
+
+    for (p = path;; p = z)
+    {
+        char b[l + k + 1];
+        z = strchr(p, ':');
+        if (!z)
+            z = p + strlen(p);
+        if ((size_t)(z - p) >= l)
+        {
+            if (!*z++)
+                break;
+            continue;
+        }
+        memcpy(b, p, z - p);
+        b[z - p] = '/';
+        memcpy(b + (z - p) + (z > p), file, k + 1);
+
+        ret = spawn_request(res, b, fa, attr, argv, envp);
+        switch (ret)
+        {
+            case EACCES:
+                seen_eacces = 1;
+                // fall through
+            case ENOENT:
+            case ENOTDIR:
+                break;
+            default:
+                return ret;
+        }
+        if (!*z++)
+            break;
+    }
+    return seen_eacces ? EACCES : ENOENT;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _POSIX_SPAWN_H
+#define _POSIX_SPAWN_H
+
+// Kernel interface for POSIX_PEDIGREE_SPAWN, shared by the kernel and libc.
+
+#include <stddef.h>
+
+// File action commands (the same values as musl's FDOP_*).
+#define PEDIGREE_SPAWN_CLOSE 1
+#define PEDIGREE_SPAWN_DUP2 2
+#define PEDIGREE_SPAWN_OPEN 3
+
+// Most file actions a single request may carry.
+#define PEDIGREE_SPAWN_MAX_ACTIONS 1024
+
+// Request flags (the same values as POSIX_SPAWN_*).
+#define PEDIGREE_SPAWN_RESETIDS 1
+#define PEDIGREE_SPAWN_SETPGROUP 2
+
+/** A file action, applied in the child in order before the exec. */
+struct pedigree_spawn_action
+{
+    int cmd;
+    int fd;
+    int srcfd;
+    int oflag;
+    int mode;
+    const char *path;
+};
+
+/** Everything needed to create a process running the given executable. */
+struct pedigree_spawn_request
+{
+    const char *path;
+    char *const *argv;
+    char *const *envp;
+    const struct pedigree_spawn_action *actions;
+    size_t action_count;
+    int flags;
+    int pgroup;
+};
+
+#endif
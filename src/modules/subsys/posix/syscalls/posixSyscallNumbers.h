@@ -279,5 +279,9 @@
 #define POSIX_CAPGET 267
 #define POSIX_CAPSET 268
 #define POSIX_PRCTL 269
+#define POSIX_MADVISE 270
+
+#define POSIX_VFORK 271
+#define POSIX_PEDIGREE_SPAWN 272
 
 #endif
@@ -105,6 +105,9 @@ inline long posix_translate_syscall(long which)
         case SYS_msync:
             pedigree_translation = POSIX_MSYNC;
             break;
+        case SYS_madvise:
+            pedigree_translation = POSIX_MADVISE;
+            break;
         // ...
         case SYS_dup:
             pedigree_translation = POSIX_DUP;
@@ -183,6 +186,9 @@ inline long posix_translate_syscall(long which)
         case SYS_fork:
             pedigree_translation = POSIX_FORK;
             break;
+        case SYS_vfork:
+            pedigree_translation = POSIX_VFORK;
+            break;
         // ...
         case SYS_execve:
             pedigree_translation = POSIX_EXECVE;
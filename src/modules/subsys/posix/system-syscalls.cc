@@ -43,6 +43,7 @@
 #include "pedigree/kernel/utilities/String.h"
 #include "pedigree/kernel/utilities/Vector.h"
 #include "pipe-syscalls.h"
+#include "posix-spawn.h"
 #include "posixSyscallNumbers.h"
 #include "pthread-syscalls.h"
 #include "signal-syscalls.h"
@@ -215,6 +216,34 @@ uintptr_t posix_brk(uintptr_t theBreak)
     return reinterpret_cast<uintptr_t>(currentBreak);
 }
 
+/** Copies POSIX Process Group information from a parent if needed. */
+static void copyProcessGroup(Process *pParentProcess, PosixProcess *pProcess)
+{
+    if (pParentProcess->getType() != Process::Posix)
+    {
+        return;
+    }
+
+    PosixProcess *p = static_cast<PosixProcess *>(pParentProcess);
+    pProcess->setProcessGroup(p->getProcessGroup());
+
+    // default to being a member of the group
+    pProcess->setGroupMembership(PosixProcess::Member);
+
+    // Do not adopt leadership status.
+    if (p->getGroupMembership() == PosixProcess::Leader)
+    {
+        SC_NOTICE("fork parent was a group leader.");
+    }
+    else
+    {
+        SC_NOTICE(
+            "fork parent had status "
+            << static_cast<int>(p->getGroupMembership()) << "...");
+        pProcess->setGroupMembership(p->getGroupMembership());
+    }
+}
+
 long posix_clone(
     SyscallState &state, unsigned long flags, void *child_stack, int *ptid,
     int *ctid, unsigned long newtls)
@@ -237,12 +266,11 @@ long posix_clone(
     {
         SC_NOTICE(" -> CLONE_PARENT is not yet supported!");
     }
-    if (flags & CLONE_VFORK)
-    {
-        // Halts parent until child ruins execve() or exit(), just like vfork.
-        // We should support this properly.
-        SC_NOTICE(" -> CLONE_VFORK is not yet supported!");
-    }
+
+    // CLONE_VFORK halts the parent until the child runs execve() or exit(),
+    // just like vfork. The child runs in the parent's address space rather
+    // than a copy of it, even without CLONE_VM.
+    bool bVfork = (flags & CLONE_VFORK) == CLONE_VFORK;
 
 #if 0
     if (flags & CLONE_VM) SC_NOTICE("\t\t-> CLONE_VM");
@@ -269,7 +297,7 @@ long posix_clone(
     if (flags & CLONE_IO) SC_NOTICE("\t\t-> CLONE_IO");
 #endif
 
-    if ((flags & CLONE_VM) == CLONE_VM)
+    if ((flags & CLONE_VM) == CLONE_VM && !bVfork)
     {
         // clone vm doesn't actually copy the address space, it shares it
 
@@ -328,7 +356,16 @@ long posix_clone(
     // Create a new process.
     Process *pParentProcess =
         Processor::information().getCurrentThread()->getParent();
-    PosixProcess *pProcess = new PosixProcess(pParentProcess);
+    PosixProcess *pProcess = 0;
+    if (bVfork)
+    {
+        pProcess =
+            new PosixProcess(pParentProcess, Process::BorrowAddressSpace);
+    }
+    else
+    {
+        pProcess = new PosixProcess(pParentProcess);
+    }
     if (!pProcess)
     {
         SYSCALL_ERROR(OutOfMemory);
@@ -361,28 +398,7 @@ long posix_clone(
     pProcess->setSubsystem(pSubsystem);
     pSubsystem->setProcess(pProcess);
 
-    // Copy POSIX Process Group information if needed
-    if (pParentProcess->getType() == Process::Posix)
-    {
-        PosixProcess *p = static_cast<PosixProcess *>(pParentProcess);
-        pProcess->setProcessGroup(p->getProcessGroup());
-
-        // default to being a member of the group
-        pProcess->setGroupMembership(PosixProcess::Member);
-
-        // Do not adopt leadership status.
-        if (p->getGroupMembership() == PosixProcess::Leader)
-        {
-            SC_NOTICE("fork parent was a group leader.");
-        }
-        else
-        {
-            SC_NOTICE(
-                "fork parent had status "
-                << static_cast<int>(p->getGroupMembership()) << "...");
-            pProcess->setGroupMembership(p->getGroupMembership());
-        }
-    }
+    copyProcessGroup(pParentProcess, pProcess);
 
     // Register with the dynamic linker.
     DynamicLinker *oldLinker = pProcess->getLinker();
@@ -392,7 +408,11 @@ long posix_clone(
         pProcess->setLinker(newLinker);
     }
 
-    MemoryMapManager::instance().clone(pProcess);
+    // A vfork child shares our mappings as well as the address space.
+    if (!bVfork)
+    {
+        MemoryMapManager::instance().clone(pProcess);
+    }
 
     // Copy the file descriptors from the parent
     pSubsystem->copyDescriptors(pParentSubsystem);
@@ -400,9 +420,14 @@ long posix_clone(
     // Child returns 0.
     clonedState.setSyscallReturnValue(0);
 
-    // Allow signals to the parent again
-    for (int sig = 0; sig < 32; sig++)
-        Processor::information().getCurrentThread()->inhibitEvent(sig, false);
+    // Allow signals to the parent again, unless we are about to wait for a
+    // vfork child that is using our address space.
+    if (!bVfork)
+    {
+        for (int sig = 0; sig < 32; sig++)
+            Processor::information().getCurrentThread()->inhibitEvent(
+                sig, false);
+    }
 
     // Set ctid in the new address space if we are required to.
     if (flags & CLONE_CHILD_SETTID)
@@ -415,6 +440,13 @@ long posix_clone(
         Processor::switchAddressSpace(curr);
     }
 
+    // Released by the child once it is finished with our address space.
+    Semaphore vforkWaiter(0, false);
+    if (bVfork)
+    {
+        pProcess->setBorrowWaiter(&vforkWaiter);
+    }
+
     // Create a new thread for the new process.
     Thread *pThread = new Thread(pProcess, clonedState);
     pThread->detach();
@@ -427,9 +459,21 @@ long posix_clone(
         Processor::information().getCurrentThread(), pParentSubsystem, pThread,
         pSubsystem);
 
+    // The child may have exited by the time we wake up.
+    size_t childId = pProcess->getId();
+
+    if (bVfork)
+    {
+        vforkWaiter.acquire();
+
+        for (int sig = 0; sig < 32; sig++)
+            Processor::information().getCurrentThread()->inhibitEvent(
+                sig, false);
+    }
+
     // Parent returns child ID.
-    SC_NOTICE(" -> " << pProcess->getId() << " [new process]");
-    return pProcess->getId();
+    SC_NOTICE(" -> " << childId << " [new process]");
+    return childId;
 }
 
 int posix_fork(SyscallState &state)
@@ -439,6 +483,13 @@ int posix_fork(SyscallState &state)
     return posix_clone(state, 0, 0, 0, 0, 0);
 }
 
+int posix_vfork(SyscallState &state)
+{
+    SC_NOTICE("vfork");
+
+    return posix_clone(state, CLONE_VM | CLONE_VFORK, 0, 0, 0, 0);
+}
+
 int posix_execve(
     const char *name, const char **argv, const char **env, SyscallState &state)
 {
@@ -496,6 +547,305 @@ int posix_execve(
     return 0;
 }
 
+/** Shared between pedigree_spawn and the thread that sets up the child. */
+struct SpawnContext
+{
+    const pedigree_spawn_request *request;
+    /// Checked copies of the file actions, and of each open action's path.
+    Vector<pedigree_spawn_action> actions;
+    Vector<String> actionPaths;
+    /// Normalised path of the executable.
+    String path;
+    /// Checked copies of the argument and environment strings.
+    Vector<String> argv;
+    Vector<String> env;
+    /// errno for the parent if the child could not be started.
+    int error;
+};
+
+/** Checks that a user string is readable up to and including its NUL. */
+static bool checkUserString(const char *str)
+{
+    const size_t pageSize = PhysicalMemoryManager::getPageSize();
+    uintptr_t addr = reinterpret_cast<uintptr_t>(str);
+    while (true)
+    {
+        size_t extent = pageSize - (addr & (pageSize - 1));
+        if (!PosixSubsystem::checkAddress(
+                addr, extent, PosixSubsystem::SafeRead))
+        {
+            return false;
+        }
+
+        const char *p = reinterpret_cast<const char *>(addr);
+        for (size_t i = 0; i < extent; ++i)
+        {
+            if (!p[i])
+            {
+                return true;
+            }
+        }
+
+        addr += extent;
+    }
+}
+
+/** Copies a null-terminated array of user strings, checking each address. */
+static bool copyUserStrings(char *const *array, Vector<String> &list)
+{
+    for (char *const *entry = array;; ++entry)
+    {
+        if (!PosixSubsystem::checkAddress(
+                reinterpret_cast<uintptr_t>(entry), sizeof(*entry),
+                PosixSubsystem::SafeRead))
+        {
+            return false;
+        }
+
+        const char *str = *entry;
+        if (!str)
+        {
+            return true;
+        }
+        if (!checkUserString(str))
+        {
+            return false;
+        }
+
+        list.pushBack(String(str));
+    }
+}
+
+/** Applies one spawn file action in the current process. */
+static bool
+applySpawnAction(const pedigree_spawn_action &action, const String &path)
+{
+    switch (action.cmd)
+    {
+        case PEDIGREE_SPAWN_CLOSE:
+            // Closing a descriptor that is not open is not an error here.
+            posix_close(action.fd);
+            return true;
+        case PEDIGREE_SPAWN_DUP2:
+            return posix_dup2(action.srcfd, action.fd) >= 0;
+        case PEDIGREE_SPAWN_OPEN:
+        {
+            int fd = posix_open(path, action.oflag, action.mode);
+            if (fd < 0)
+            {
+                return false;
+            }
+            if (fd != action.fd)
+            {
+                int result = posix_dup2(fd, action.fd);
+                posix_close(fd);
+                if (result < 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        default:
+            SYSCALL_ERROR(InvalidArgument);
+            return false;
+    }
+}
+
+/**
+ * Sets up and execs a spawned child. This runs as a kernel thread in the
+ * child, which is still borrowing the parent's address space, and works only
+ * from the copies pedigree_spawn made of the request. The exec gives the
+ * child its own address space and starts its first user thread; this thread
+ * then ends.
+ */
+static int spawnChild(void *param)
+{
+    SpawnContext *ctx = reinterpret_cast<SpawnContext *>(param);
+    const pedigree_spawn_request *request = ctx->request;
+
+    Thread *pThread = Processor::information().getCurrentThread();
+    PosixProcess *pProcess = static_cast<PosixProcess *>(pThread->getParent());
+    PosixSubsystem *pSubsystem =
+        reinterpret_cast<PosixSubsystem *>(pProcess->getSubsystem());
+
+    bool bSuccess = true;
+    if ((request->flags & PEDIGREE_SPAWN_SETPGROUP) &&
+        (posix_setpgid(0, request->pgroup) < 0))
+    {
+        bSuccess = false;
+    }
+
+    if (bSuccess && (request->flags & PEDIGREE_SPAWN_RESETIDS))
+    {
+        pProcess->setEffectiveUserId(pProcess->getUserId());
+        pProcess->setEffectiveGroupId(pProcess->getGroupId());
+    }
+
+    for (size_t i = 0; bSuccess && i < ctx->actions.count(); ++i)
+    {
+        bSuccess = applySpawnAction(ctx->actions[i], ctx->actionPaths[i]);
+    }
+
+    if (bSuccess)
+    {
+        bSuccess = pSubsystem->invoke(ctx->path, ctx->argv, ctx->env);
+    }
+
+    if (!bSuccess)
+    {
+        // Let the parent know why before it wakes up to collect us. If the
+        // exec failed after we left the parent's address space, the parent
+        // has already returned and will see the exit status instead.
+        if (pProcess->hasBorrowedAddressSpace())
+        {
+            ctx->error = pThread->getErrno();
+            if (!ctx->error)
+            {
+                ctx->error = Error::ExecFormatError;
+            }
+        }
+        pSubsystem->exit(127);
+    }
+
+    return 0;
+}
+
+int pedigree_spawn(const pedigree_spawn_request *userRequest)
+{
+    if (!PosixSubsystem::checkAddress(
+            reinterpret_cast<uintptr_t>(userRequest), sizeof(*userRequest),
+            PosixSubsystem::SafeRead))
+    {
+        SC_NOTICE("spawn -> invalid address");
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    // Take a copy so that what is checked here is what the child uses.
+    pedigree_spawn_request copiedRequest = *userRequest;
+    const pedigree_spawn_request *request = &copiedRequest;
+
+    // Bound the action count so the size checked below cannot overflow.
+    if (request->action_count > PEDIGREE_SPAWN_MAX_ACTIONS)
+    {
+        SC_NOTICE("spawn -> too many file actions");
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    if (!PosixSubsystem::checkAddress(
+            reinterpret_cast<uintptr_t>(request->path), PATH_MAX,
+            PosixSubsystem::SafeRead) ||
+        !PosixSubsystem::checkAddress(
+            reinterpret_cast<uintptr_t>(request->actions),
+            request->action_count * sizeof(pedigree_spawn_action),
+            PosixSubsystem::SafeRead))
+    {
+        SC_NOTICE("spawn -> invalid address");
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    SC_NOTICE("spawn(\"" << request->path << "\")");
+
+    // Bad arguments?
+    if (request->argv == 0 || request->envp == 0)
+    {
+        SYSCALL_ERROR(ExecFormatError);
+        return -1;
+    }
+
+    // Copy everything the child needs from user memory now, checking it as
+    // we go, so the child never follows a user pointer itself.
+    SpawnContext ctx;
+    ctx.request = request;
+    ctx.error = 0;
+    normalisePath(ctx.path, request->path);
+    for (size_t i = 0; i < request->action_count; ++i)
+    {
+        pedigree_spawn_action action = request->actions[i];
+        String path;
+        if (action.cmd == PEDIGREE_SPAWN_OPEN)
+        {
+            if (!checkUserString(action.path))
+            {
+                SC_NOTICE("spawn -> invalid file action path");
+                SYSCALL_ERROR(InvalidArgument);
+                return -1;
+            }
+            path = String(action.path);
+        }
+        action.path = 0;
+
+        ctx.actions.pushBack(action);
+        ctx.actionPaths.pushBack(path);
+    }
+
+    if (!copyUserStrings(request->argv, ctx.argv) ||
+        !copyUserStrings(request->envp, ctx.env))
+    {
+        SC_NOTICE("spawn -> invalid argument or environment");
+        SYSCALL_ERROR(InvalidArgument);
+        return -1;
+    }
+
+    Process *pParentProcess =
+        Processor::information().getCurrentThread()->getParent();
+    PosixSubsystem *pParentSubsystem =
+        reinterpret_cast<PosixSubsystem *>(pParentProcess->getSubsystem());
+    if (!pParentSubsystem)
+    {
+        ERROR("No subsystem for this process!");
+        return -1;
+    }
+
+    // The child borrows our address space until its exec, so nothing here is
+    // copied that the exec would immediately throw away.
+    PosixProcess *pProcess =
+        new PosixProcess(pParentProcess, Process::BorrowAddressSpace);
+    PosixSubsystem *pSubsystem = new PosixSubsystem(*pParentSubsystem);
+    pProcess->setSubsystem(pSubsystem);
+    pSubsystem->setProcess(pProcess);
+    copyProcessGroup(pParentProcess, pProcess);
+
+    // The exec installs a new linker; the parent's must not be shared.
+    pProcess->setLinker(0);
+
+    pSubsystem->copyDescriptors(pParentSubsystem);
+
+    // Our stack holds the context and the child reads our memory, so we
+    // must stay here until the child is done with both.
+    for (int sig = 0; sig < 32; sig++)
+        Processor::information().getCurrentThread()->inhibitEvent(sig, true);
+
+    Semaphore spawnWaiter(0, false);
+    pProcess->setBorrowWaiter(&spawnWaiter);
+
+    size_t childId = pProcess->getId();
+
+    Thread *pThread = new Thread(pProcess, spawnChild, &ctx);
+    pThread->detach();
+
+    spawnWaiter.acquire();
+
+    for (int sig = 0; sig < 32; sig++)
+        Processor::information().getCurrentThread()->inhibitEvent(sig, false);
+
+    if (ctx.error)
+    {
+        // The child has exited; collect it so the caller only sees the error.
+        posix_waitpid(childId, 0, 0);
+
+        SC_NOTICE(" -> failed (" << ctx.error << ")");
+        syscallError(ctx.error);
+        return -1;
+    }
+
+    SC_NOTICE(" -> " << childId);
+    return childId;
+}
+
 /**
  * Class intended to be used for RAII to clean up waitpid state on exit.
  */
@@ -31,6 +31,7 @@
 // Forward-declare types.
 struct group;
 struct passwd;
+struct pedigree_spawn_request;
 struct timespec;
 
 uintptr_t posix_brk(uintptr_t theBreak);
@@ -39,8 +40,10 @@ long posix_clone(
     SyscallState &state, unsigned long flags, void *child_stack, int *ptid,
     int *ctid, unsigned long newtls);
 int posix_fork(SyscallState &state);
+int posix_vfork(SyscallState &state);
 int posix_execve(
     const char *name, const char **argv, const char **env, SyscallState &state);
+int pedigree_spawn(const pedigree_spawn_request *request);
 int posix_waitpid(const int pid, int *status, int options);
 int posix_exit(int code, bool allthreads = true) NORETURN;
 int posix_getpid();
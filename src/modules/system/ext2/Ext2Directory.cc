@@ -74,10 +74,9 @@ bool Ext2Directory::addEntry(String filename, File *pFile, size_t type)
     Dir *pDir = 0;
     Dir *pLastDir = 0;
     Dir *pBlockEnd = 0;
-    for (i = 0; i < m_Blocks.count(); i++)
+    for (i = 0; i < m_nBlocks; i++)
     {
-        ensureBlockLoaded(i);
-        uintptr_t buffer = m_pExt2Fs->readBlock(m_Blocks[i]);
+        uintptr_t buffer = m_pExt2Fs->readBlock(getBlock(i));
         pLastDir = pDir;
         pDir = reinterpret_cast<Dir *>(buffer);
         pBlockEnd = adjust_pointer(pDir, m_pExt2Fs->m_BlockSize);
@@ -146,17 +145,16 @@ bool Ext2Directory::addEntry(String filename, File *pFile, size_t type)
         }
         if (!addBlock(block))
             return false;
-        i = m_Blocks.count() - 1;
+        i = m_nBlocks - 1;
 
-        m_Size = m_Blocks.count() * m_pExt2Fs->m_BlockSize;
+        m_Size = m_nBlocks * m_pExt2Fs->m_BlockSize;
         fileAttributeChanged();
 
         /// \todo Previous directory entry might need its reclen updated to
         ///       point to this new entry (as directory entries cannot cross
         ///       block boundaries).
 
-        ensureBlockLoaded(i);
-        uintptr_t buffer = m_pExt2Fs->readBlock(m_Blocks[i]);
+        uintptr_t buffer = m_pExt2Fs->readBlock(getBlock(i));
 
         ByteSet(reinterpret_cast<void *>(buffer), 0, m_pExt2Fs->m_BlockSize);
         pDir = reinterpret_cast<Dir *>(buffer);
@@ -203,7 +201,7 @@ bool Ext2Directory::addEntry(String filename, File *pFile, size_t type)
     addDirectoryEntry(filename, pFile);
 
     // Trigger write back to disk.
-    m_pExt2Fs->writeBlock(m_Blocks[i]);
+    m_pExt2Fs->writeBlock(getBlock(i));
 
     m_Size = m_nSize;
 
@@ -219,10 +217,9 @@ bool Ext2Directory::removeEntry(const String &filename, Ext2Node *pFile)
 
     uint32_t i;
     Dir *pDir, *pLastDir = 0;
-    for (i = 0; i < m_Blocks.count(); i++)
+    for (i = 0; i < m_nBlocks; i++)
     {
-        ensureBlockLoaded(i);
-        uintptr_t buffer = m_pExt2Fs->readBlock(m_Blocks[i]);
+        uintptr_t buffer = m_pExt2Fs->readBlock(getBlock(i));
         pDir = reinterpret_cast<Dir *>(buffer);
         pLastDir = 0;
         while (reinterpret_cast<uintptr_t>(pDir) <
@@ -248,7 +245,7 @@ bool Ext2Directory::removeEntry(const String &filename, Ext2Node *pFile)
 
                         pDir->d_reclen = HOST_TO_LITTLE16(old_reclen);
 
-                        m_pExt2Fs->writeBlock(m_Blocks[i]);
+                        m_pExt2Fs->writeBlock(getBlock(i));
                         bFound = true;
                         break;
                     }
@@ -296,12 +293,10 @@ void Ext2Directory::cacheDirectoryContents()
 
     uint32_t i;
     Dir *pDir;
-    for (i = 0; i < m_Blocks.count(); i++)
+    for (i = 0; i < m_nBlocks; i++)
     {
-        ensureBlockLoaded(i);
-
         // Grab the block and pin it while we parse it.
-        uintptr_t buffer = m_pExt2Fs->readBlock(m_Blocks[i]);
+        uintptr_t buffer = m_pExt2Fs->readBlock(getBlock(i));
         assert(buffer);  /// \todo need to handle short/failed reads better
         pDir = reinterpret_cast<Dir *>(buffer);
 
@@ -393,7 +388,7 @@ void Ext2Directory::cacheDirectoryContents()
         }
 
         // Done with this block now; nothing remains that points to it.
-        m_pExt2Fs->unpinBlock(m_Blocks[i]);
+        m_pExt2Fs->unpinBlock(getBlock(i));
     }
 
     markCachePopulated();
@@ -68,6 +68,30 @@ void Ext2File::truncate()
     // Wipe all our blocks. (Ext2Node).
     Ext2Node::wipe();
     m_Size = m_nSize;
+
+    // Cached pages now refer to blocks we no longer own.
+    invalidatePages();
+}
+
+void Ext2File::increaseRefCount(bool bIsWriter)
+{
+    File::increaseRefCount(bIsWriter);
+
+    // Open writers usually append, so give them room to grow into.
+    if (bIsWriter && m_nWriters == 1)
+    {
+        setReserving(true);
+    }
+}
+
+void Ext2File::decreaseRefCount(bool bIsWriter)
+{
+    File::decreaseRefCount(bIsWriter);
+
+    if (bIsWriter && !m_nWriters)
+    {
+        setReserving(false);
+    }
 }
 
 void Ext2File::fileAttributeChanged()
@@ -98,12 +122,23 @@ void Ext2File::unpinBlock(uint64_t location)
     Ext2Node::unpinBlock(location);
 }
 
-void Ext2File::sync(size_t offset, bool async)
+size_t Ext2File::getBlockSize() const
 {
-    Ext2Node::sync(offset, async);
+    return m_pExt2Fs->m_BlockSize;
 }
 
-size_t Ext2File::getBlockSize() const
+bool Ext2File::hasBlockMap() const
 {
-    return m_pExt2Fs->m_BlockSize;
+    return true;
+}
+
+bool Ext2File::mapBlock(uint64_t location, uint64_t &diskOffset)
+{
+    return Ext2Node::mapBlock(location, diskOffset);
+}
+
+bool Ext2File::mapExtent(
+    uint64_t location, uint64_t &diskOffset, size_t &length)
+{
+    return Ext2Node::mapExtent(location, diskOffset, length);
 }
@@ -59,10 +59,17 @@ class Ext2File : public File, public Ext2Node
     virtual void pinBlock(uint64_t location);
     virtual void unpinBlock(uint64_t location);
 
-    using File::sync;
-    virtual void sync(size_t offset, bool async);
-
     virtual size_t getBlockSize() const;
+
+    virtual void increaseRefCount(bool bIsWriter);
+    virtual void decreaseRefCount(bool bIsWriter);
+
+  protected:
+    /** File data lives in the page cache, mapped straight onto disk. */
+    virtual bool hasBlockMap() const;
+    virtual bool mapBlock(uint64_t location, uint64_t &diskOffset);
+    virtual bool
+    mapExtent(uint64_t location, uint64_t &diskOffset, size_t &length);
 };
 
 #endif
@@ -27,6 +27,7 @@
 #include "modules/system/users/User.h"
 #include "modules/system/vfs/File.h"
 #include "modules/system/vfs/VFS.h"
+#include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/machine/Disk.h"
@@ -34,6 +35,7 @@
 #include "pedigree/kernel/machine/Timer.h"
 #include "pedigree/kernel/process/Process.h"
 #include "pedigree/kernel/process/Thread.h"
+#include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/Processor.h"
 #include "pedigree/kernel/processor/ProcessorInformation.h"
 #include "pedigree/kernel/syscallError.h"
@@ -52,6 +54,39 @@
 /// \todo Work out what to do when it traps.
 static uint8_t g_pSparseBlock[4096] ALIGN(4096) SECTION(".bss");
 
+/** Allocation state of a block group. */
+struct Ext2GroupState
+{
+    Ext2GroupState()
+        :
+#ifdef THREADS
+          lock(false),
+#endif
+          nFirstFreeBlock(0), nFirstFreeInode(0), reserved()
+    {
+    }
+
+    ~Ext2GroupState()
+    {
+        for (auto it : reserved)
+        {
+            delete[] reinterpret_cast<uint8_t *>(it);
+        }
+    }
+
+#ifdef THREADS
+    /** Guards the group's bitmaps, its descriptor and the fields below. */
+    Mutex lock;
+#endif
+    /** Free-extent hints: nothing before these (relative to the start of the
+     *  group) is free on disk. */
+    size_t nFirstFreeBlock;
+    size_t nFirstFreeInode;
+    /** Blocks reserved for appending writers, laid out like the block bitmap.
+     *  Empty until the group's first reservation. */
+    Vector<size_t> reserved;
+};
+
 #ifdef EXT2_STANDALONE
 extern uint32_t getUnixTimestamp();
 #else
@@ -64,22 +99,37 @@ static uint32_t getUnixTimestamp()
 
 Ext2Filesystem::Ext2Filesystem()
     : m_pSuperblock(0), m_pGroupDescriptors(0), m_pInodeTables(0),
-      m_pInodeBitmaps(0), m_pBlockBitmaps(0), m_BlockSize(0), m_InodeSize(0),
+      m_pInodeBitmaps(0), m_pBlockBitmaps(0), m_pGroupStates(0),
+      m_BlockSize(0), m_InodeSize(0),
       m_nGroupDescriptors(0),
 #ifdef THREADS
       m_WriteLock(false),
+#endif
+      m_ExtentNodes(),
+#ifdef THREADS
+      m_ExtentNodesLock(false),
 #endif
       m_pRoot(0)
 {
+#ifndef EXT2_STANDALONE
+    MemoryPressureManager::instance().registerHandler(
+        MemoryPressureManager::MediumPriority, this);
+#endif
 }
 
 Ext2Filesystem::~Ext2Filesystem()
 {
+#ifndef EXT2_STANDALONE
+    MemoryPressureManager::instance().removeHandler(this);
+#endif
+
+    // Nodes hand back their reservations as they go, so they go first.
+    delete m_pRoot;
+    delete[] m_pGroupStates;
     delete[] m_pBlockBitmaps;
     delete[] m_pInodeBitmaps;
     delete[] m_pInodeTables;
     delete[] m_pGroupDescriptors;
-    delete m_pRoot;
 }
 
 bool Ext2Filesystem::initialise(Disk *pDisk)
@@ -204,6 +254,7 @@ bool Ext2Filesystem::initialise(Disk *pDisk)
     m_pInodeTables = new Vector<size_t>[m_nGroupDescriptors];
     m_pInodeBitmaps = new Vector<size_t>[m_nGroupDescriptors];
     m_pBlockBitmaps = new Vector<size_t>[m_nGroupDescriptors];
+    m_pGroupStates = new Ext2GroupState[m_nGroupDescriptors];
 
     /// \todo Set g_pSparseBlock as read-only.
 
@@ -590,10 +641,10 @@ void Ext2Filesystem::sync(size_t offset, bool async)
         m_pDisk->flush(static_cast<uint64_t>(m_BlockSize) * offset);
 }
 
-uint32_t Ext2Filesystem::findFreeBlock(uint32_t inode)
+uint32_t Ext2Filesystem::findFreeBlock(uint32_t inode, uint32_t goal)
 {
     Vector<uint32_t> blocks;
-    if (findFreeBlocks(inode, 1, blocks))
+    if (findFreeBlocks(inode, 1, blocks, goal))
     {
         return blocks[0];
     }
@@ -602,20 +653,33 @@ uint32_t Ext2Filesystem::findFreeBlock(uint32_t inode)
 }
 
 bool Ext2Filesystem::findFreeBlocks(
-    uint32_t inode, size_t count, Vector<uint32_t> &blocks)
+    uint32_t inode, size_t count, Vector<uint32_t> &blocks, uint32_t goal)
 {
     // Inode zero is invalid, so make sure we are getting local blocks.
     --inode;
 
-    // Try to allocate near the inode's group (but we can fall back to a
-    // different group if needed).
+    const uint32_t blocksPerGroup =
+        LITTLE_TO_HOST32(m_pSuperblock->s_blocks_per_group);
+    const uint32_t firstDataBlock =
+        LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block);
+
+    // Try to allocate at the goal, or else near the inode's group (but we can
+    // fall back to a different group if needed).
     uint32_t group =
         inode / LITTLE_TO_HOST32(m_pSuperblock->s_inodes_per_group);
+    size_t start = 0;
+    if (goal > firstDataBlock &&
+        ((goal - firstDataBlock) / blocksPerGroup) < m_nGroupDescriptors)
+    {
+        group = (goal - firstDataBlock) / blocksPerGroup;
+        start = (goal - firstDataBlock) % blocksPerGroup;
+    }
     uint32_t startGroup = group;
 
     for (; count && group < m_nGroupDescriptors; ++group)
     {
-        count -= findFreeBlocksInGroup(group, count, blocks);
+        count -= findFreeBlocksInGroup(group, start, count, blocks);
+        start = 0;
     }
 
     // Try again from the start of the disk if we couldn't find a group (if
@@ -625,7 +689,7 @@ bool Ext2Filesystem::findFreeBlocks(
         ERROR("FALLING BACK TO STARTING FROM ZERO");
     for (group = 0; count && group < startGroup; ++group)
     {
-        count -= findFreeBlocksInGroup(group, count, blocks);
+        count -= findFreeBlocksInGroup(group, 0, count, blocks);
     }
 
     /// \todo should release blocks if we failed to allocate enough blocks.
@@ -633,138 +697,87 @@ bool Ext2Filesystem::findFreeBlocks(
 }
 
 size_t Ext2Filesystem::findFreeBlocksInGroup(
-    uint32_t group, size_t maxCount, Vector<uint32_t> &blocks)
+    uint32_t group, size_t start, size_t maxCount, Vector<uint32_t> &blocks)
 {
     if (!maxCount)
     {
         return 0;
     }
 
-    const uint32_t blocksPerGroup =
-        LITTLE_TO_HOST32(m_pSuperblock->s_blocks_per_group);
-    const size_t bitmapBlockBytes = m_BlockSize;
-    size_t currentCount = 0;
-
     // Any free blocks here?
     GroupDesc *pDesc = m_pGroupDescriptors[group];
     if (!pDesc->bg_free_blocks_count)
     {
         // No blocks free in this group.
-        return currentCount;
+        return 0;
     }
 
+    Ext2GroupState &state = m_pGroupStates[group];
+#ifdef THREADS
+    LockGuard<Mutex> guard(state.lock);
+#endif
+
     ensureFreeBlockBitmapLoaded(group);
 
-    // 8 blocks per byte - i == bitmap offset in bytes.
     Vector<size_t> &list = m_pBlockBitmaps[group];
-    const uint32_t bytesToSearch = blocksPerGroup >> 3;
-    size_t idx = 0;
-
-    // Block bitmap pointer.
-    typedef uint64_t searchType;
-    size_t base = list[idx];
-    searchType *ptr = reinterpret_cast<searchType *>(base);
-    searchType *ptr_end = adjust_pointer(ptr, bitmapBlockBytes);
-
-    // Find a free block in this group.
-    bool changedBitmap = false;
-    while (true)
-    {
-        // Grab the specific block for the bitmap.
-        /// \todo Endianness - to ensure correct operation, must ptr be
-        /// little endian?
-        searchType tmp = *ptr;
-
-        // Bitmap full of bits? Skip it.
-        if (tmp != static_cast<searchType>(-1))
+    Vector<size_t> *pReserved = state.reserved.count() ? &state.reserved : 0;
+    const uint32_t bitmapBlock = LITTLE_TO_HOST32(pDesc->bg_block_bitmap);
+    const size_t nBits = getBlocksInGroup(group);
+    const size_t nFree = LITTLE_TO_HOST16(pDesc->bg_free_blocks_count);
+
+    // First block of this group.
+    const uint32_t base =
+        (group * LITTLE_TO_HOST32(m_pSuperblock->s_blocks_per_group)) +
+        LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block);
+
+    // Nothing before the hint is free, so there's no use starting before it.
+    size_t bit = start;
+    if (bit < state.nFirstFreeBlock)
+    {
+        bit = state.nFirstFreeBlock;
+    }
+    bool bWrapped = bit == state.nFirstFreeBlock;
+
+    size_t currentCount = 0;
+    while (currentCount < maxCount && currentCount < nFree)
+    {
+        bit = findClearBit(list, pReserved, bit, nBits);
+        if (bit >= nBits)
         {
-            // Check each bit in this field.
-            for (size_t j = 0; j < (sizeof(searchType) * 8);
-                 j++, tmp >>= static_cast<searchType>(1))
+            if (bWrapped)
             {
-                // Free?
-                if ((tmp & 1) == 0)
-                {
-                    // This block is free! Mark used.
-                    *ptr |= (static_cast<searchType>(1) << j);
-                    pDesc->bg_free_blocks_count--;
-
-                    // Yes, we changed the bitmap.
-                    changedBitmap = true;
-
-                    // Update superblock.
-                    m_pSuperblock->s_free_blocks_count--;
-
-                    // First block of this group...
-                    uint32_t result =
-                        group *
-                        LITTLE_TO_HOST32(m_pSuperblock->s_blocks_per_group);
-                    // Add the data block offset for this filesystem.
-                    result +=
-                        LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block);
-                    // Blocks skipped so far (i == offset in bytes)...
-                    result += ((idx * bitmapBlockBytes) +
-                               (reinterpret_cast<uintptr_t>(ptr) - base))
-                              << 3;
-                    // Blocks skipped so far (j == bits ie blocks)...
-                    result += j;
-                    // Return block.
-                    blocks.pushBack(result);
-
-                    // Check if we're done - we have nothing left to do if
-                    // there's no more blocks free in this bitmap.
-                    if ((++currentCount >= maxCount) ||
-                        (!pDesc->bg_free_blocks_count))
-                    {
-                        break;
-                    }
-                }
+                break;
             }
-        }
-
-        // Did we make changes to the bitmap? Write back now if so - we don't
-        // want to keep writing over and over if e.g. we're setting more than
-        // one block above.
-        if (changedBitmap)
-        {
-            // Update bitmap on disk.
-            uint32_t desc_block =
-                LITTLE_TO_HOST32(m_pGroupDescriptors[group]->bg_block_bitmap) +
-                idx;
-            writeBlock(desc_block);
 
-            changedBitmap = false;
+            // Nothing free past the goal, so look before it too.
+            bWrapped = true;
+            bit = state.nFirstFreeBlock;
+            continue;
         }
 
-        // Are we finished with this loop?
-        if (currentCount >= maxCount)
+        // Take the whole run in one go.
+        size_t nRun = getClearRunLength(
+            list, pReserved, bit, nBits, maxCount - currentCount);
+        updateBitmap(list, bit, nRun, true);
+        writeBitmap(bitmapBlock, bit, nRun);
+
+        for (size_t i = 0; i < nRun; ++i)
         {
-            break;
+            blocks.pushBack(base + bit + i);
         }
 
-        // Haven't found anything yet - need to take care here.
-        if (++ptr >= ptr_end)
+        if (bit == state.nFirstFreeBlock)
         {
-            if ((++idx * bitmapBlockBytes) >= bytesToSearch)
-                break;
-
-            base = list[idx];
-            ptr = reinterpret_cast<searchType *>(base);
-            ptr_end = adjust_pointer(ptr, bitmapBlockBytes);
+            state.nFirstFreeBlock = bit + nRun;
         }
+
+        currentCount += nRun;
+        bit += nRun;
     }
 
-    if (currentCount >= maxCount)
+    if (currentCount)
     {
-        // Write back the superblock/group descriptor updates now.
-        m_pDisk->write(1024ULL);
-
-        // Update group descriptor on disk.
-        /// \todo save group descriptor block number elsewhere
-        uint32_t gdBlock =
-            LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block) + 1;
-        uint32_t groupBlock = (group * sizeof(GroupDesc)) / m_BlockSize;
-        writeBlock(gdBlock + groupBlock);
+        updateFreeCounts(group, -static_cast<ssize_t>(currentCount), 0);
     }
 
     return currentCount;
@@ -772,6 +785,9 @@ size_t Ext2Filesystem::findFreeBlocksInGroup(
 
 uint32_t Ext2Filesystem::findFreeInode()
 {
+    const uint32_t inodesPerGroup =
+        LITTLE_TO_HOST32(m_pSuperblock->s_inodes_per_group);
+
     for (uint32_t group = 0; group < m_nGroupDescriptors; group++)
     {
         // Any free inodes here?
@@ -782,82 +798,155 @@ uint32_t Ext2Filesystem::findFreeInode()
             continue;
         }
 
+        Ext2GroupState &state = m_pGroupStates[group];
+#ifdef THREADS
+        LockGuard<Mutex> guard(state.lock);
+#endif
+
         // Make sure this block group's inode bitmap has been loaded.
         ensureFreeInodeBitmapLoaded(group);
 
-        // 8 inodes per byte - i == bitmap offset in bytes.
         Vector<size_t> &list = m_pInodeBitmaps[group];
-        for (size_t i = 0;
-             i < LITTLE_TO_HOST32(m_pSuperblock->s_inodes_per_group) / 8;
-             i += sizeof(uint32_t))
+        size_t bit =
+            findClearBit(list, 0, state.nFirstFreeInode, inodesPerGroup);
+        if (bit >= inodesPerGroup)
         {
-            // Calculate block index into the bitmap.
-            size_t idx = i / (m_BlockSize * 8);
-            size_t off = i % (m_BlockSize * 8);
-
-            // Grab the specific block for the bitmap.
-            /// \todo Endianness - to ensure correct operation, must ptr be
-            /// little endian?
-            uintptr_t block = list[idx];
-            uint32_t *ptr = reinterpret_cast<uint32_t *>(block + off);
-            uint32_t tmp = *ptr;
-
-            // If all bits set, avoid searching the bitmap.
-            if (tmp == ~0U)
-                continue;
-
-            // Check each bit for free inode.
-            for (size_t j = 0; j < 32; j++, tmp >>= 1)
-            {
-                // Free?
-                if ((tmp & 1) == 0)
-                {
-                    // This inode is free! Mark used.
-                    *ptr |= (1 << j);
-                    pDesc->bg_free_inodes_count--;
-
-                    // Update superblock.
-                    m_pSuperblock->s_free_inodes_count--;
-                    m_pDisk->write(1024ULL);
-
-                    // Update bitmap on disk.
-                    uint32_t desc_block =
-                        LITTLE_TO_HOST32(
-                            m_pGroupDescriptors[group]->bg_inode_bitmap) +
-                        idx;
-                    writeBlock(desc_block);
-
-                    // Update group descriptor count on disk.
-                    /// \todo save group descriptor block number elsewhere
-                    uint32_t gdBlock =
-                        LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block) + 1;
-                    uint32_t result = (group * sizeof(GroupDesc)) / m_BlockSize;
-                    writeBlock(gdBlock + result);
-
-                    // First inode of this group...
-                    uint32_t inode =
-                        group *
-                        LITTLE_TO_HOST32(m_pSuperblock->s_inodes_per_group);
-                    // Inodes skipped so far (i == offset in bytes)...
-                    inode += i * 8;
-                    // Inodes skipped so far (j == bits ie inodes)...
-                    // Note: inodes start counting at one, not zero.
-                    inode += j + 1;
-                    // Return inode.
-                    return inode;
-                }
-            }
-
-            // Shouldn't get here - if there were no available blocks here it
-            // should have hit the "continue" above!
-            assert(false);
+            // Another thread took the last one while we weren't looking.
+            continue;
         }
+
+        // This inode is free! Mark used.
+        updateBitmap(list, bit, 1, true);
+        writeBitmap(LITTLE_TO_HOST32(pDesc->bg_inode_bitmap), bit, 1);
+        state.nFirstFreeInode = bit + 1;
+
+        updateFreeCounts(group, 0, -1);
+
+        // Note: inodes start counting at one, not zero.
+        return (group * inodesPerGroup) + bit + 1;
     }
 
     return 0;
 }
 
+size_t Ext2Filesystem::reserveBlocks(
+    uint32_t goal, size_t count, uint32_t &start)
+{
+    const uint32_t blocksPerGroup =
+        LITTLE_TO_HOST32(m_pSuperblock->s_blocks_per_group);
+    const uint32_t firstDataBlock =
+        LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block);
+
+    if (!count || goal <= firstDataBlock)
+    {
+        return 0;
+    }
+
+    uint32_t group = (goal - firstDataBlock) / blocksPerGroup;
+    size_t bit = (goal - firstDataBlock) % blocksPerGroup;
+    if (group >= m_nGroupDescriptors ||
+        !m_pGroupDescriptors[group]->bg_free_blocks_count)
+    {
+        return 0;
+    }
+
+    Ext2GroupState &state = m_pGroupStates[group];
+#ifdef THREADS
+    LockGuard<Mutex> guard(state.lock);
+#endif
+
+    ensureFreeBlockBitmapLoaded(group);
+
+    Vector<size_t> &list = m_pBlockBitmaps[group];
+    if (!state.reserved.count())
+    {
+        // Same layout as the block bitmap, so the same helpers work on it.
+        for (size_t i = 0; i < list.count(); ++i)
+        {
+            uint8_t *pBuffer = new uint8_t[m_BlockSize];
+            ByteSet(pBuffer, 0, m_BlockSize);
+            state.reserved.pushBack(reinterpret_cast<size_t>(pBuffer));
+        }
+    }
+
+    const size_t nBits = getBlocksInGroup(group);
+    bit = findClearBit(list, &state.reserved, bit, nBits);
+    if (bit >= nBits)
+    {
+        return 0;
+    }
+
+    size_t nRun =
+        getClearRunLength(list, &state.reserved, bit, nBits, count);
+    updateBitmap(state.reserved, bit, nRun, true);
+
+    start = (group * blocksPerGroup) + firstDataBlock + bit;
+    return nRun;
+}
+
+bool Ext2Filesystem::claimReservedBlocks(uint32_t start, size_t count)
+{
+    const uint32_t blocksPerGroup =
+        LITTLE_TO_HOST32(m_pSuperblock->s_blocks_per_group);
+    uint32_t block =
+        start - LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block);
+    uint32_t group = block / blocksPerGroup;
+    size_t bit = block % blocksPerGroup;
+
+    Ext2GroupState &state = m_pGroupStates[group];
+#ifdef THREADS
+    LockGuard<Mutex> guard(state.lock);
+#endif
+
+    // Reservations never span groups and the bitmap is already loaded.
+    Vector<size_t> &list = m_pBlockBitmaps[group];
+    updateBitmap(state.reserved, bit, count, false);
+    if (getClearRunLength(list, 0, bit, bit + count, count) != count)
+    {
+        // Something allocated past the reservation; handing these out again
+        // would give one block to two files.
+        WARNING(
+            "Ext2: reserved blocks at " << Dec << start << Hex
+                                        << " were allocated elsewhere");
+        return false;
+    }
+
+    updateBitmap(list, bit, count, true);
+    writeBitmap(
+        LITTLE_TO_HOST32(m_pGroupDescriptors[group]->bg_block_bitmap), bit,
+        count);
+
+    if (bit == state.nFirstFreeBlock)
+    {
+        state.nFirstFreeBlock = bit + count;
+    }
+
+    updateFreeCounts(group, -static_cast<ssize_t>(count), 0);
+    return true;
+}
+
+void Ext2Filesystem::releaseReservedBlocks(uint32_t start, size_t count)
+{
+    const uint32_t blocksPerGroup =
+        LITTLE_TO_HOST32(m_pSuperblock->s_blocks_per_group);
+    uint32_t block =
+        start - LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block);
+    uint32_t group = block / blocksPerGroup;
+
+    Ext2GroupState &state = m_pGroupStates[group];
+#ifdef THREADS
+    LockGuard<Mutex> guard(state.lock);
+#endif
+
+    updateBitmap(state.reserved, block % blocksPerGroup, count, false);
+}
+
 void Ext2Filesystem::releaseBlock(uint32_t block)
+{
+    releaseBlocks(block, 1);
+}
+
+void Ext2Filesystem::releaseBlocks(uint32_t block, size_t count)
 {
     // In some ext2 filesystems, this is zero so we don't need to do this. But
     // for those that do, not doing this messes up the bit offsets below.
@@ -865,8 +954,6 @@ void Ext2Filesystem::releaseBlock(uint32_t block)
 
     uint32_t blocksPerGroup =
         LITTLE_TO_HOST32(m_pSuperblock->s_blocks_per_group);
-    uint32_t group = block / blocksPerGroup;
-    uint32_t index = block % blocksPerGroup;
 
     if (!block)
     {
@@ -875,41 +962,47 @@ void Ext2Filesystem::releaseBlock(uint32_t block)
         FATAL("Releasing block zero!");
     }
 
-    ensureFreeBlockBitmapLoaded(group);
+    while (count)
+    {
+        uint32_t group = block / blocksPerGroup;
+        size_t index = block % blocksPerGroup;
+        size_t nRun = blocksPerGroup - index;
+        if (nRun > count)
+        {
+            nRun = count;
+        }
 
-    // Free block.
-    GroupDesc *pDesc = m_pGroupDescriptors[group];
+        Ext2GroupState &state = m_pGroupStates[group];
+        {
+#ifdef THREADS
+            LockGuard<Mutex> guard(state.lock);
+#endif
 
-    // Index = block offset from the start of this block.
-    size_t bitmapField = (index / 8) / m_BlockSize;
-    size_t bitmapOffset = (index / 8) % m_BlockSize;
+            ensureFreeBlockBitmapLoaded(group);
 
-    Vector<size_t> &list = m_pBlockBitmaps[group];
-    uintptr_t diskBlock = list[bitmapField];
-    uint8_t *ptr = reinterpret_cast<uint8_t *>(diskBlock + bitmapOffset);
-    uint8_t bit = (index % 8);
-    if ((*ptr & (1 << bit)) == 0)
-        ERROR("bit already freed for block " << Dec << block << Hex);
-    *ptr &= ~(1 << bit);
-
-    // Update hints.
-    pDesc->bg_free_blocks_count++;
-    m_pSuperblock->s_free_blocks_count++;
-
-    // Update superblock.
-    m_pDisk->write(1024ULL);
-
-    // Update bitmap on disk.
-    uint32_t desc_block =
-        LITTLE_TO_HOST32(m_pGroupDescriptors[group]->bg_block_bitmap) +
-        bitmapField;
-    writeBlock(desc_block);
+            // Free blocks.
+            size_t nFreed =
+                updateBitmap(m_pBlockBitmaps[group], index, nRun, false);
+            if (nFreed != nRun)
+                ERROR(
+                    "bit already freed for blocks " << Dec << block << "-"
+                                                    << (block + nRun - 1)
+                                                    << Hex);
+            writeBitmap(
+                LITTLE_TO_HOST32(m_pGroupDescriptors[group]->bg_block_bitmap),
+                index, nRun);
+
+            // Update hints.
+            if (index < state.nFirstFreeBlock)
+            {
+                state.nFirstFreeBlock = index;
+            }
+            updateFreeCounts(group, nFreed, 0);
+        }
 
-    // Update group descriptor on disk.
-    /// \todo save group descriptor block number elsewhere
-    uint32_t gdBlock = LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block) + 1;
-    uint32_t groupBlock = (group * sizeof(GroupDesc)) / m_BlockSize;
-    writeBlock(gdBlock + groupBlock);
+        block += nRun;
+        count -= nRun;
+    }
 }
 
 bool Ext2Filesystem::releaseInode(uint32_t inode)
@@ -930,37 +1023,24 @@ bool Ext2Filesystem::releaseInode(uint32_t inode)
         // Set dtime on inode.
         pInode->i_dtime = HOST_TO_LITTLE32(getUnixTimestamp());
 
+        Ext2GroupState &state = m_pGroupStates[group];
+#ifdef THREADS
+        LockGuard<Mutex> guard(state.lock);
+#endif
+
         ensureFreeInodeBitmapLoaded(group);
 
         // Free inode.
-        GroupDesc *pDesc = m_pGroupDescriptors[group];
-        pDesc->bg_free_inodes_count++;
-        m_pSuperblock->s_free_inodes_count++;
-
-        // Index = inode offset from the start of this block.
-        size_t bitmapField = (index / 8) / m_BlockSize;
-        size_t bitmapOffset = (index / 8) % m_BlockSize;
-
-        Vector<size_t> &list = m_pInodeBitmaps[group];
-        uintptr_t block = list[bitmapField];
-        uint8_t *ptr = reinterpret_cast<uint8_t *>(block + bitmapOffset);
-        *ptr &= ~(1 << (index % 8));
-
-        // Update superblock.
-        m_pDisk->write(1024ULL);
-
-        // Update on disk.
-        uint32_t desc_block =
-            LITTLE_TO_HOST32(m_pGroupDescriptors[group]->bg_inode_bitmap) +
-            bitmapField;
-        writeBlock(desc_block);
+        updateBitmap(m_pInodeBitmaps[group], index, 1, false);
+        writeBitmap(
+            LITTLE_TO_HOST32(m_pGroupDescriptors[group]->bg_inode_bitmap),
+            index, 1);
 
-        // Update group descriptor on disk.
-        /// \todo save group descriptor block number elsewhere
-        uint32_t gdBlock =
-            LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block) + 1;
-        uint32_t groupBlock = (group * sizeof(GroupDesc)) / m_BlockSize;
-        writeBlock(gdBlock + groupBlock);
+        if (index < state.nFirstFreeInode)
+        {
+            state.nFirstFreeInode = index;
+        }
+        updateFreeCounts(group, 0, 1);
     }
 
     writeInode(inode);
@@ -1112,6 +1192,163 @@ void Ext2Filesystem::ensureInodeTableLoaded(size_t group)
     }
 }
 
+size_t Ext2Filesystem::getBlocksInGroup(uint32_t group)
+{
+    const uint32_t blocksPerGroup =
+        LITTLE_TO_HOST32(m_pSuperblock->s_blocks_per_group);
+    const uint32_t firstBlock =
+        (group * blocksPerGroup) +
+        LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block);
+    const uint32_t blockCount = LITTLE_TO_HOST32(m_pSuperblock->s_blocks_count);
+
+    if (firstBlock >= blockCount)
+    {
+        return 0;
+    }
+    else if ((blockCount - firstBlock) < blocksPerGroup)
+    {
+        return blockCount - firstBlock;
+    }
+
+    return blocksPerGroup;
+}
+
+uint64_t *Ext2Filesystem::getBitmapWord(Vector<size_t> &list, size_t word)
+{
+    /// \todo Endianness - bitmaps are little endian on disk.
+    const size_t wordsPerBlock = m_BlockSize / sizeof(uint64_t);
+    uint64_t *pBlock = reinterpret_cast<uint64_t *>(list[word / wordsPerBlock]);
+    return &pBlock[word % wordsPerBlock];
+}
+
+size_t Ext2Filesystem::findClearBit(
+    Vector<size_t> &list, Vector<size_t> *pReserved, size_t start,
+    size_t nBits)
+{
+    while (start < nBits)
+    {
+        size_t word = start / 64;
+        uint64_t used = *getBitmapWord(list, word);
+        if (pReserved)
+        {
+            used |= *getBitmapWord(*pReserved, word);
+        }
+
+        // Ignore the bits before the start.
+        used |= (1ULL << (start % 64)) - 1;
+        if (used != ~0ULL)
+        {
+            start = (word * 64) + __builtin_ctzll(~used);
+            break;
+        }
+
+        start = (word + 1) * 64;
+    }
+
+    return start < nBits ? start : nBits;
+}
+
+size_t Ext2Filesystem::getClearRunLength(
+    Vector<size_t> &list, Vector<size_t> *pReserved, size_t start,
+    size_t nBits, size_t maxLength)
+{
+    size_t end = start + maxLength;
+    if (end > nBits)
+    {
+        end = nBits;
+    }
+
+    size_t bit = start;
+    while (bit < end)
+    {
+        size_t word = bit / 64;
+        size_t shift = bit % 64;
+        uint64_t used = *getBitmapWord(list, word);
+        if (pReserved)
+        {
+            used |= *getBitmapWord(*pReserved, word);
+        }
+
+        used >>= shift;
+        if (used)
+        {
+            bit += __builtin_ctzll(used);
+            break;
+        }
+
+        bit += 64 - shift;
+    }
+
+    return (bit < end ? bit : end) - start;
+}
+
+size_t Ext2Filesystem::updateBitmap(
+    Vector<size_t> &list, size_t first, size_t count, bool bSet)
+{
+    size_t nChanged = 0;
+    while (count)
+    {
+        size_t shift = first % 64;
+        size_t n = 64 - shift;
+        if (n > count)
+        {
+            n = count;
+        }
+
+        uint64_t mask = ~0ULL;
+        if (n < 64)
+        {
+            mask = ((1ULL << n) - 1) << shift;
+        }
+
+        uint64_t *pWord = getBitmapWord(list, first / 64);
+        uint64_t changed = mask & (bSet ? ~*pWord : *pWord);
+        *pWord ^= changed;
+        nChanged += __builtin_popcountll(changed);
+
+        first += n;
+        count -= n;
+    }
+
+    return nChanged;
+}
+
+void Ext2Filesystem::writeBitmap(
+    uint32_t bitmapBlock, size_t first, size_t count)
+{
+    const size_t bitsPerBlock = m_BlockSize * 8;
+    size_t last = (first + count - 1) / bitsPerBlock;
+    for (size_t i = first / bitsPerBlock; i <= last; ++i)
+    {
+        writeBlock(bitmapBlock + i);
+    }
+}
+
+void Ext2Filesystem::updateFreeCounts(
+    uint32_t group, ssize_t nBlocks, ssize_t nInodes)
+{
+    GroupDesc *pDesc = m_pGroupDescriptors[group];
+    pDesc->bg_free_blocks_count += nBlocks;
+    pDesc->bg_free_inodes_count += nInodes;
+
+    {
+#ifdef THREADS
+        LockGuard<Mutex> guard(m_WriteLock);
+#endif
+        m_pSuperblock->s_free_blocks_count += nBlocks;
+        m_pSuperblock->s_free_inodes_count += nInodes;
+
+        // Update superblock.
+        m_pDisk->write(1024ULL);
+    }
+
+    // Update group descriptor on disk.
+    /// \todo save group descriptor block number elsewhere
+    uint32_t gdBlock = LITTLE_TO_HOST32(m_pSuperblock->s_first_data_block) + 1;
+    uint32_t groupBlock = (group * sizeof(GroupDesc)) / m_BlockSize;
+    writeBlock(gdBlock + groupBlock);
+}
+
 void Ext2Filesystem::increaseInodeRefcount(uint32_t inode)
 {
     Inode *pInode = getInode(inode);
@@ -1139,7 +1376,57 @@ bool Ext2Filesystem::decreaseInodeRefcount(uint32_t inode)
     return bRemove;
 }
 
+void Ext2Filesystem::trackExtentCache(Ext2Node *pNode)
+{
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_ExtentNodesLock);
+#endif
+
+    m_ExtentNodes.pushBack(pNode);
+}
+
+void Ext2Filesystem::untrackExtentCache(Ext2Node *pNode)
+{
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_ExtentNodesLock);
+#endif
+
+    for (List<Ext2Node *>::Iterator it = m_ExtentNodes.begin();
+         it != m_ExtentNodes.end(); ++it)
+    {
+        if (*it == pNode)
+        {
+            m_ExtentNodes.erase(it);
+            break;
+        }
+    }
+}
+
 #ifndef EXT2_STANDALONE
+bool Ext2Filesystem::compact()
+{
+#ifdef THREADS
+    // Don't wait on a thread that is allocating while adding to the list.
+    if (!m_ExtentNodesLock.tryAcquire())
+    {
+        return false;
+    }
+#endif
+
+    size_t nFreed = 0;
+    for (List<Ext2Node *>::Iterator it = m_ExtentNodes.begin();
+         it != m_ExtentNodes.end(); ++it)
+    {
+        nFreed += (*it)->trimExtents();
+    }
+
+#ifdef THREADS
+    m_ExtentNodesLock.release();
+#endif
+
+    return nFreed >= PhysicalMemoryManager::getPageSize();
+}
+
 static bool initExt2()
 {
     VFS::instance().addProbeCallback(&Ext2Filesystem::probe);
@@ -23,10 +23,17 @@
 #include "modules/system/vfs/Filesystem.h"
 #include "pedigree/kernel/process/Mutex.h"
 #include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/utilities/List.h"
 #include "pedigree/kernel/utilities/String.h"
 
+#ifndef EXT2_STANDALONE
+#include "pedigree/kernel/process/MemoryPressureManager.h"
+#endif
+
 class Disk;
+class Ext2Node;
 class File;
+struct Ext2GroupState;
 struct GroupDesc;
 struct Inode;
 struct Superblock;
@@ -35,6 +42,9 @@ class Vector;
 
 /** This class provides an implementation of the second extended filesystem. */
 class Ext2Filesystem : public Filesystem
+#ifndef EXT2_STANDALONE
+    , public MemoryPressureHandler
+#endif
 {
     friend class Ext2File;
     friend class Ext2Node;
@@ -54,6 +64,16 @@ class Ext2Filesystem : public Filesystem
     virtual File *getRoot() const;
     virtual String getVolumeLabel() const;
 
+#ifndef EXT2_STANDALONE
+    virtual const String getMemoryPressureDescription()
+    {
+        return String("Trimming ext2 block map caches");
+    }
+
+    /** Drops the block map caches of all our nodes. */
+    virtual bool compact();
+#endif
+
   protected:
     virtual bool
     createFile(File *parent, const String &filename, uint32_t mask);
@@ -83,13 +103,34 @@ class Ext2Filesystem : public Filesystem
 
     void sync(size_t offset, bool async);
 
-    uint32_t findFreeBlock(uint32_t inode);
-    bool findFreeBlocks(uint32_t inode, size_t count, Vector<uint32_t> &blocks);
+    /** Allocates blocks, starting from goal if it is given and otherwise in
+     *  the inode's group. Runs of free blocks are taken whole. */
+    uint32_t findFreeBlock(uint32_t inode, uint32_t goal = 0);
+    bool findFreeBlocks(
+        uint32_t inode, size_t count, Vector<uint32_t> &blocks,
+        uint32_t goal = 0);
     size_t findFreeBlocksInGroup(
-        uint32_t group, size_t maxCount, Vector<uint32_t> &blocks);
+        uint32_t group, size_t start, size_t maxCount,
+        Vector<uint32_t> &blocks);
     uint32_t findFreeInode();
 
+    /**
+     * Sets aside free blocks for one node to allocate later. Reserved blocks
+     * stay free on disk, but no other allocation will take them.
+     * \param goal the first block wanted; only its group is searched.
+     * \param start set to the first block reserved.
+     * \return the number of contiguous blocks reserved (at most count).
+     */
+    size_t reserveBlocks(uint32_t goal, size_t count, uint32_t &start);
+    /** Allocates blocks previously set aside by reserveBlocks().
+     * \return false, with the blocks left unreserved and unallocated, if
+     *         any of them turned out to be allocated already. */
+    bool claimReservedBlocks(uint32_t start, size_t count);
+    /** Returns reserved blocks to the pool without allocating them. */
+    void releaseReservedBlocks(uint32_t start, size_t count);
+
     void releaseBlock(uint32_t block);
+    void releaseBlocks(uint32_t block, size_t count);
     /** Releases the given inode, returns true if the inode had no more links.
      */
     bool releaseInode(uint32_t inode);
@@ -101,6 +142,30 @@ class Ext2Filesystem : public Filesystem
     void ensureFreeInodeBitmapLoaded(size_t group);
     void ensureInodeTableLoaded(size_t group);
 
+    /** Gets the number of blocks that group holds (the last may be short). */
+    size_t getBlocksInGroup(uint32_t group);
+    /** Gets a 64-bit word of a bitmap loaded by ensureFree*BitmapLoaded(). */
+    uint64_t *getBitmapWord(Vector<size_t> &list, size_t word);
+    /** Finds the first bit from start on that is clear in both bitmaps.
+     *  \return the bit, or nBits if there is none. */
+    size_t findClearBit(
+        Vector<size_t> &list, Vector<size_t> *pReserved, size_t start,
+        size_t nBits);
+    /** Gets the number of bits from start on (at most maxLength) that are
+     *  clear in both bitmaps. */
+    size_t getClearRunLength(
+        Vector<size_t> &list, Vector<size_t> *pReserved, size_t start,
+        size_t nBits, size_t maxLength);
+    /** Sets or clears count bits from first on.
+     *  \return the number of bits that changed. */
+    size_t updateBitmap(
+        Vector<size_t> &list, size_t first, size_t count, bool bSet);
+    /** Writes back the blocks of an on-disk bitmap covering the given bits. */
+    void writeBitmap(uint32_t bitmapBlock, size_t first, size_t count);
+    /** Adjusts the free block and inode counts of a group and of the
+     *  filesystem, and writes them back. The group must be locked. */
+    void updateFreeCounts(uint32_t group, ssize_t nBlocks, ssize_t nInodes);
+
     bool checkOptionalFeature(size_t feature);
     bool checkRequiredFeature(size_t feature);
     bool checkReadOnlyFeature(size_t feature);
@@ -108,6 +173,10 @@ class Ext2Filesystem : public Filesystem
     void increaseInodeRefcount(uint32_t inode);
     bool decreaseInodeRefcount(uint32_t inode);
 
+    /** Lets compact() trim the given node's block map cache. */
+    void trackExtentCache(Ext2Node *pNode);
+    void untrackExtentCache(Ext2Node *pNode);
+
     /** Our superblock. */
     Superblock *m_pSuperblock;
 
@@ -121,6 +190,8 @@ class Ext2Filesystem : public Filesystem
     Vector<size_t> *m_pInodeBitmaps;
     /** Free block bitmaps, indexed by group descriptor. */
     Vector<size_t> *m_pBlockBitmaps;
+    /** Allocation state (locks, hints and reservations) of each group. */
+    Ext2GroupState *m_pGroupStates;
 
     /** Size of a block. */
     uint32_t m_BlockSize;
@@ -132,11 +203,17 @@ class Ext2Filesystem : public Filesystem
     size_t m_nGroupDescriptors;
 
 #ifdef THREADS
-    /** Write lock - we're finding some inodes and updating the superblock and
-     * block group structures. */
+    /** Write lock - we're updating the superblock's counts. Each group has
+     * its own lock for its bitmaps and descriptor, taken before this one. */
     Mutex m_WriteLock;
 #endif
 
+    /** Nodes whose block map caches can be trimmed. */
+    List<Ext2Node *> m_ExtentNodes;
+#ifdef THREADS
+    Mutex m_ExtentNodesLock;
+#endif
+
     /** The root filesystem node. */
     File *m_pRoot;
 
@@ -21,6 +21,7 @@
 #include "Ext2Filesystem.h"
 #include "ext2.h"
 #include "modules/system/vfs/File.h"
+#include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/syscallError.h"
@@ -28,8 +29,14 @@
 #include "pedigree/kernel/utilities/utility.h"
 
 Ext2Node::Ext2Node(uintptr_t inode_num, Inode *pInode, Ext2Filesystem *pFs)
-    : m_pInode(pInode), m_InodeNumber(inode_num), m_pExt2Fs(pFs), m_Blocks(),
-      m_nMetadataBlocks(0), m_nSize(LITTLE_TO_HOST32(pInode->i_size))
+    : m_pInode(pInode), m_InodeNumber(inode_num), m_pExt2Fs(pFs),
+      m_nBlocks(0), m_Extents(), m_nLastExtent(0), m_bExtentsTracked(false),
+#ifdef THREADS
+      m_ExtentLock(false),
+#endif
+      m_nMetadataBlocks(0), m_bReserving(false), m_nReservedStart(0),
+      m_nReservedCount(0), m_nReserveWindow(0),
+      m_nSize(LITTLE_TO_HOST32(pInode->i_size))
 {
     // i_blocks == # of 512-byte blocks. Convert to FS block count.
     uint32_t blockCount = LITTLE_TO_HOST32(pInode->i_blocks);
@@ -41,32 +48,31 @@ Ext2Node::Ext2Node(uintptr_t inode_num, Inode *pInode, Ext2Filesystem *pFs)
         ++dataBlockCount;
     }
 
-    m_Blocks.reserve(dataBlockCount, false);
+    m_nBlocks = dataBlockCount;
     m_nMetadataBlocks = totalBlocks - dataBlockCount;
 
-    for (size_t i = 0; i < 12 && i < dataBlockCount; i++)
-        m_Blocks.pushBack(LITTLE_TO_HOST32(m_pInode->i_block[i]));
-
-    // We'll read these later.
-    for (size_t i = 12; i < dataBlockCount; ++i)
-    {
-        m_Blocks.pushBack(~0);
-    }
+    // The block map is read in as it is needed.
 }
 
 Ext2Node::~Ext2Node()
 {
+    discardReservation();
+
+    if (m_bExtentsTracked)
+    {
+        m_pExt2Fs->untrackExtentCache(this);
+    }
 }
 
 uintptr_t Ext2Node::readBlock(uint64_t location)
 {
     // Sanity check.
     uint32_t nBlock = location / m_pExt2Fs->m_BlockSize;
-    if (nBlock > m_Blocks.count())
+    if (nBlock > m_nBlocks)
     {
         ERROR(
-            "Ext2Node::readBlock beyond blocks [" << nBlock << ", "
-                                                  << m_Blocks.count() << "]");
+            "Ext2Node::readBlock beyond blocks [" << nBlock << ", " << m_nBlocks
+                                                  << "]");
         return 0;
     }
     if (location > m_nSize)
@@ -77,8 +83,7 @@ uintptr_t Ext2Node::readBlock(uint64_t location)
         return 0;
     }
 
-    ensureBlockLoaded(nBlock);
-    uintptr_t result = m_pExt2Fs->readBlock(m_Blocks[nBlock]);
+    uintptr_t result = m_pExt2Fs->readBlock(getBlock(nBlock));
 
     // Add any remaining offset we chopped off.
     result += location % m_pExt2Fs->m_BlockSize;
@@ -89,23 +94,31 @@ void Ext2Node::writeBlock(uint64_t location)
 {
     // Sanity check.
     uint32_t nBlock = location / m_pExt2Fs->m_BlockSize;
-    if (nBlock > m_Blocks.count())
+    if (nBlock > m_nBlocks)
         return;
     if (location > m_nSize)
         return;
 
     // Update on disk.
-    ensureBlockLoaded(nBlock);
-    m_pExt2Fs->writeBlock(m_Blocks[nBlock]);
+    m_pExt2Fs->writeBlock(getBlock(nBlock));
 }
 
 void Ext2Node::trackBlock(uint32_t block)
 {
-    m_Blocks.pushBack(block);
+    Ext2Extent extent = {static_cast<uint32_t>(m_nBlocks), block, 1};
+    ++m_nBlocks;
+
+    // The new block usually just extends the last run.
+    {
+#ifdef THREADS
+        LockGuard<Mutex> guard(m_ExtentLock);
+#endif
+        insertExtent(extent);
+    }
 
     // Inode i_blocks field is actually the count of 512-byte blocks.
     uint32_t i_blocks =
-        ((m_Blocks.count() + m_nMetadataBlocks) * m_pExt2Fs->m_BlockSize) / 512;
+        ((m_nBlocks + m_nMetadataBlocks) * m_pExt2Fs->m_BlockSize) / 512;
     m_pInode->i_blocks = HOST_TO_LITTLE32(i_blocks);
 
     // Write updated inode.
@@ -114,12 +127,39 @@ void Ext2Node::trackBlock(uint32_t block)
 
 void Ext2Node::wipe()
 {
-    for (size_t i = 0; i < m_Blocks.count(); ++i)
+    for (size_t i = 0; i < m_nBlocks;)
+    {
+        uint32_t physical = 0;
+        size_t nRun = getExtent(i, physical);
+        if (!nRun)
+        {
+            break;
+        }
+
+        if (physical)
+        {
+            m_pExt2Fs->releaseBlocks(physical, nRun);
+        }
+
+        i += nRun;
+    }
+
+    // Then the indirect tables that mapped them.
+    for (size_t i = 0; i < 3; ++i)
     {
-        ensureBlockLoaded(i);
-        m_pExt2Fs->releaseBlock(m_Blocks[i]);
+        uint32_t table = LITTLE_TO_HOST32(m_pInode->i_block[12 + i]);
+        if (table)
+        {
+            releaseTable(table, i + 1);
+        }
     }
-    m_Blocks.clear();
+
+    m_nBlocks = 0;
+    m_nMetadataBlocks = 0;
+    trimExtents();
+
+    discardReservation();
+    m_nReserveWindow = 0;
 
     m_nSize = 0;
 
@@ -131,6 +171,52 @@ void Ext2Node::wipe()
     m_pExt2Fs->writeInode(getInodeNumber());
 }
 
+void Ext2Node::setReserving(bool bReserving)
+{
+    m_bReserving = bReserving;
+    if (!bReserving)
+    {
+        discardReservation();
+        m_nReserveWindow = 0;
+    }
+}
+
+void Ext2Node::discardReservation()
+{
+    if (m_nReservedCount)
+    {
+        m_pExt2Fs->releaseReservedBlocks(m_nReservedStart, m_nReservedCount);
+        m_nReservedCount = 0;
+    }
+}
+
+void Ext2Node::releaseTable(uint32_t table, size_t nLevels)
+{
+    if (nLevels > 1)
+    {
+        // Copy the entries out, as reading the tables below may reuse the
+        // buffer.
+        size_t nPerBlock = m_pExt2Fs->m_BlockSize / 4;
+        uint32_t *pEntries = new uint32_t[nPerBlock];
+        MemoryCopy(
+            pEntries, reinterpret_cast<void *>(m_pExt2Fs->readBlock(table)),
+            m_pExt2Fs->m_BlockSize);
+
+        for (size_t i = 0; i < nPerBlock; ++i)
+        {
+            uint32_t entry = LITTLE_TO_HOST32(pEntries[i]);
+            if (entry)
+            {
+                releaseTable(entry, nLevels - 1);
+            }
+        }
+
+        delete[] pEntries;
+    }
+
+    m_pExt2Fs->releaseBlock(table);
+}
+
 void Ext2Node::extend(size_t newSize)
 {
     ensureLargeEnough(newSize, 0, 0);
@@ -147,7 +233,7 @@ bool Ext2Node::ensureLargeEnough(size_t size, uint64_t location, uint64_t opsize
     // So, we check for that early. Then, we can move on to actually allocating
     // blocks if that is necessary.
     size_t blockSize = m_pExt2Fs->m_BlockSize;
-    size_t currentMaxSize = m_Blocks.count() * blockSize;
+    size_t currentMaxSize = m_nBlocks * blockSize;
     if (LIKELY(size <= currentMaxSize))
     {
         if (size > m_nSize && !onlyBlocks)
@@ -180,7 +266,7 @@ bool Ext2Node::ensureLargeEnough(size_t size, uint64_t location, uint64_t opsize
     // Allocate the needed blocks.
     Vector<uint32_t> newBlocks;
 #if 1
-    if (!m_pExt2Fs->findFreeBlocks(m_InodeNumber, deltaBlocks, newBlocks))
+    if (!allocateBlocks(deltaBlocks, newBlocks))
     {
         SYSCALL_ERROR(NoSpaceLeftOnDevice);
         return false;
@@ -239,96 +325,382 @@ bool Ext2Node::ensureLargeEnough(size_t size, uint64_t location, uint64_t opsize
     return true;
 }
 
-bool Ext2Node::ensureBlockLoaded(size_t nBlock)
+bool Ext2Node::allocateBlocks(size_t count, Vector<uint32_t> &blocks)
 {
-    if (nBlock > m_Blocks.count())
+    // Blocks reserved by the last extension follow straight on from it.
+    if (m_nReservedCount)
     {
-        FATAL(
-            "EXT2: ensureBlockLoaded: Algorithmic error [block "
-            << nBlock << " > " << m_Blocks.count() << "].");
+        size_t nClaim = min(count, m_nReservedCount);
+        if (m_pExt2Fs->claimReservedBlocks(m_nReservedStart, nClaim))
+        {
+            for (size_t i = 0; i < nClaim; ++i)
+            {
+                blocks.pushBack(m_nReservedStart + i);
+            }
+
+            m_nReservedStart += nClaim;
+            m_nReservedCount -= nClaim;
+            count -= nClaim;
+        }
+        else
+        {
+            // The reservation can't be trusted any more: drop what's left of
+            // it and allocate from the bitmap as usual.
+            if (m_nReservedCount > nClaim)
+            {
+                m_pExt2Fs->releaseReservedBlocks(
+                    m_nReservedStart + nClaim, m_nReservedCount - nClaim);
+            }
+            m_nReservedCount = 0;
+        }
+    }
+
+    // Allocate the rest as close to the end of the node as we can.
+    uint32_t goal = 0;
+    if (blocks.count())
+    {
+        goal = blocks[blocks.count() - 1] + 1;
+    }
+    else if (m_nBlocks)
+    {
+        uint32_t last = getBlock(m_nBlocks - 1);
+        if (last)
+        {
+            goal = last + 1;
+        }
+    }
+
+    if (count &&
+        !m_pExt2Fs->findFreeBlocks(m_InodeNumber, count, blocks, goal))
+    {
+        return false;
+    }
+
+    // Keep the following blocks aside for the writer's next extension. The
+    // window grows for as long as the writer keeps using it all.
+    if (m_bReserving && !m_nReservedCount && blocks.count())
+    {
+        if (!m_nReserveWindow)
+        {
+            m_nReserveWindow = EXT2_RESERVE_MIN_BLOCKS;
+        }
+        else if (m_nReserveWindow < EXT2_RESERVE_MAX_BLOCKS)
+        {
+            m_nReserveWindow *= 2;
+        }
+
+        m_nReservedCount = m_pExt2Fs->reserveBlocks(
+            blocks[blocks.count() - 1] + 1, m_nReserveWindow,
+            m_nReservedStart);
     }
-    if (m_Blocks[nBlock] == ~0U)
-        getBlockNumber(nBlock);
 
     return true;
 }
 
-bool Ext2Node::getBlockNumber(size_t nBlock)
+uint32_t Ext2Node::getBlock(size_t nBlock)
+{
+    uint32_t physical = 0;
+    getExtent(nBlock, physical);
+    return physical;
+}
+
+size_t Ext2Node::getExtent(size_t nBlock, uint32_t &physical)
+{
+    physical = 0;
+    if (nBlock >= m_nBlocks)
+    {
+        return 0;
+    }
+
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_ExtentLock);
+#endif
+
+    size_t index = 0;
+    if (!findExtent(nBlock, index))
+    {
+        if (!loadExtents(nBlock) || !findExtent(nBlock, index))
+        {
+            ERROR(
+                "EXT2: couldn't map block " << nBlock << " of inode "
+                                            << m_InodeNumber);
+            return 0;
+        }
+    }
+
+    const Ext2Extent &extent = m_Extents[index];
+    size_t offset = nBlock - extent.logical;
+    if (extent.physical)
+    {
+        physical = extent.physical + offset;
+    }
+
+    return extent.length - offset;
+}
+
+bool Ext2Node::findExtent(size_t nBlock, size_t &index)
+{
+    size_t nCount = m_Extents.count();
+    if (!nCount)
+    {
+        return false;
+    }
+
+    // Sequential access mostly stays within the extent found last time.
+    if (m_nLastExtent < nCount)
+    {
+        const Ext2Extent &last = m_Extents[m_nLastExtent];
+        if (nBlock >= last.logical &&
+            nBlock < (static_cast<size_t>(last.logical) + last.length))
+        {
+            index = m_nLastExtent;
+            return true;
+        }
+    }
+
+    // Find the last extent starting at or before nBlock. The search has no
+    // unpredictable branches, as lookups tend to be all over the place.
+    const Ext2Extent *pBase = m_Extents.begin();
+    const Ext2Extent *pFirst = pBase;
+    while (nCount > 1)
+    {
+        size_t nHalf = nCount / 2;
+        pBase = (pBase[nHalf].logical <= nBlock) ? pBase + nHalf : pBase;
+        nCount -= nHalf;
+    }
+
+    if (nBlock < pBase->logical ||
+        nBlock >= (static_cast<size_t>(pBase->logical) + pBase->length))
+    {
+        return false;
+    }
+
+    index = m_nLastExtent = pBase - pFirst;
+    return true;
+}
+
+bool Ext2Node::loadExtents(size_t nBlock)
 {
     size_t nPerBlock = m_pExt2Fs->m_BlockSize / 4;
 
-    assert(nBlock >= 12);
+    if (m_Extents.count() >= EXT2_MAX_CACHED_EXTENTS)
+    {
+        // Badly fragmented (or sparse) and randomly accessed. Start over
+        // rather than letting the cache grow without bound.
+        m_Extents.clear();
+    }
 
-    if (nBlock < nPerBlock + 12)
+    if (nBlock < 12)
     {
-        getBlockNumberIndirect(
-            LITTLE_TO_HOST32(m_pInode->i_block[12]), 12, nBlock);
+        uint32_t entries[12];
+        for (size_t i = 0; i < 12; ++i)
+        {
+            entries[i] = LITTLE_TO_HOST32(m_pInode->i_block[i]);
+        }
+
+        cacheRuns(0, entries, min(m_nBlocks, static_cast<size_t>(12)));
         return true;
     }
 
-    if (nBlock < (nPerBlock * nPerBlock) + nPerBlock + 12)
+    if (!m_bExtentsTracked)
     {
-        getBlockNumberBiindirect(
-            LITTLE_TO_HOST32(m_pInode->i_block[13]), nPerBlock + 12, nBlock);
-        return true;
+        // Only nodes with indirect blocks build up a cache worth trimming.
+        m_pExt2Fs->trackExtentCache(this);
+        m_bExtentsTracked = true;
     }
 
-    getBlockNumberTriindirect(
-        LITTLE_TO_HOST32(m_pInode->i_block[14]),
-        (nPerBlock * nPerBlock) + nPerBlock + 12, nBlock);
+    // Walk down the indirect tables to the leaf table that maps nBlock. A
+    // missing table at any level is one large hole.
+    size_t nFirst = 12;
+    size_t nSpan = nPerBlock;
+    size_t nLevels = 1;
+    uint32_t table = LITTLE_TO_HOST32(m_pInode->i_block[12]);
+    if (nBlock >= nFirst + nSpan)
+    {
+        nFirst += nSpan;
+        nSpan *= nPerBlock;
+        nLevels = 2;
+        table = LITTLE_TO_HOST32(m_pInode->i_block[13]);
 
-    return true;
+        if (nBlock >= nFirst + nSpan)
+        {
+            nFirst += nSpan;
+            nSpan *= nPerBlock;
+            nLevels = 3;
+            table = LITTLE_TO_HOST32(m_pInode->i_block[14]);
+        }
+    }
+
+    while (true)
+    {
+        if (!table)
+        {
+            cacheHole(nFirst, nSpan);
+            return true;
+        }
+
+        uint32_t *buffer =
+            reinterpret_cast<uint32_t *>(m_pExt2Fs->readBlock(table));
+        if (!buffer)
+        {
+            return false;
+        }
+
+        if (nLevels == 1)
+        {
+            // Decode the whole leaf in one go. Nothing else can read a block
+            // until we're done, so the buffer stays valid.
+            cacheRuns(nFirst, buffer, min(m_nBlocks - nFirst, nPerBlock));
+            return true;
+        }
+
+        nSpan /= nPerBlock;
+        size_t index = (nBlock - nFirst) / nSpan;
+        nFirst += index * nSpan;
+        table = LITTLE_TO_HOST32(buffer[index]);
+        --nLevels;
+    }
 }
 
-bool Ext2Node::getBlockNumberIndirect(
-    uint32_t inode_block, size_t nBlocks, size_t nBlock)
+void Ext2Node::cacheRuns(
+    size_t nFirst, const uint32_t *pEntries, size_t nEntries)
 {
-    uint32_t *buffer =
-        reinterpret_cast<uint32_t *>(m_pExt2Fs->readBlock(inode_block));
+    if (!nEntries)
+    {
+        return;
+    }
 
-    for (size_t i = 0;
-         i < m_pExt2Fs->m_BlockSize / 4 && nBlocks < m_Blocks.count(); i++)
+    Ext2Extent run = {static_cast<uint32_t>(nFirst),
+                      LITTLE_TO_HOST32(pEntries[0]), 1};
+    for (size_t i = 1; i < nEntries; ++i)
     {
-        m_Blocks[nBlocks++] = LITTLE_TO_HOST32(buffer[i]);
+        uint32_t block = LITTLE_TO_HOST32(pEntries[i]);
+        bool bContiguous = run.physical ? (block == run.physical + run.length)
+                                        : (block == 0);
+        if (bContiguous)
+        {
+            ++run.length;
+            continue;
+        }
+
+        insertExtent(run);
+        run.logical = nFirst + i;
+        run.physical = block;
+        run.length = 1;
     }
 
-    return true;
+    insertExtent(run);
 }
 
-bool Ext2Node::getBlockNumberBiindirect(
-    uint32_t inode_block, size_t nBlocks, size_t nBlock)
+void Ext2Node::cacheHole(size_t nFirst, size_t nLength)
 {
-    size_t nPerBlock = m_pExt2Fs->m_BlockSize / 4;
+    if (nFirst >= m_nBlocks)
+    {
+        return;
+    }
 
-    uint32_t *buffer =
-        reinterpret_cast<uint32_t *>(m_pExt2Fs->readBlock(inode_block));
+    if (nLength > (m_nBlocks - nFirst))
+    {
+        nLength = m_nBlocks - nFirst;
+    }
 
-    // What indirect block does nBlock exist on?
-    size_t nIndirectBlock = (nBlock - nBlocks) / nPerBlock;
+    Ext2Extent hole = {static_cast<uint32_t>(nFirst), 0,
+                       static_cast<uint32_t>(nLength)};
+    insertExtent(hole);
+}
 
-    getBlockNumberIndirect(
-        LITTLE_TO_HOST32(buffer[nIndirectBlock]),
-        nBlocks + nIndirectBlock * nPerBlock, nBlock);
+/** Whether b carries straight on from a, both on disk and in the node. */
+static bool extentsAdjacent(const Ext2Extent &a, const Ext2Extent &b)
+{
+    if ((a.logical + a.length) != b.logical)
+    {
+        return false;
+    }
 
-    return true;
+    if (!a.physical || !b.physical)
+    {
+        return !a.physical && !b.physical;
+    }
+
+    return (a.physical + a.length) == b.physical;
 }
 
-bool Ext2Node::getBlockNumberTriindirect(
-    uint32_t inode_block, size_t nBlocks, size_t nBlock)
+void Ext2Node::insertExtent(const Ext2Extent &extent)
 {
-    size_t nPerBlock = m_pExt2Fs->m_BlockSize / 4;
+    uint32_t end = extent.logical + extent.length;
+
+    // Find the first extent starting at or after this one.
+    size_t lo = 0, hi = m_Extents.count();
+    while (lo < hi)
+    {
+        size_t mid = lo + ((hi - lo) / 2);
+        if (m_Extents[mid].logical < extent.logical)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+    size_t index = lo;
+
+    if (index)
+    {
+        Ext2Extent &previous = m_Extents[index - 1];
+        uint32_t previousEnd = previous.logical + previous.length;
+        if (previousEnd > extent.logical)
+        {
+            // Keep the parts of the previous extent either side of this one.
+            previous.length = extent.logical - previous.logical;
+            if (previousEnd > end)
+            {
+                Ext2Extent tail = previous;
+                tail.logical = end;
+                tail.length = previousEnd - end;
+                if (tail.physical)
+                {
+                    tail.physical += end - previous.logical;
+                }
+                m_Extents.insert(index, tail);
+            }
+        }
+    }
 
-    uint32_t *buffer =
-        reinterpret_cast<uint32_t *>(m_pExt2Fs->readBlock(inode_block));
+    // Anything else this extent covers is out of date.
+    while (index < m_Extents.count() && m_Extents[index].logical < end)
+    {
+        Ext2Extent &existing = m_Extents[index];
+        uint32_t existingEnd = existing.logical + existing.length;
+        if (existingEnd <= end)
+        {
+            m_Extents.erase(index);
+            continue;
+        }
 
-    // What biindirect block does nBlock exist on?
-    size_t nBiBlock = (nBlock - nBlocks) / (nPerBlock * nPerBlock);
+        if (existing.physical)
+        {
+            existing.physical += end - existing.logical;
+        }
+        existing.length = existingEnd - end;
+        existing.logical = end;
+        break;
+    }
 
-    getBlockNumberBiindirect(
-        LITTLE_TO_HOST32(buffer[nBiBlock]),
-        nBlocks + nBiBlock * nPerBlock * nPerBlock, nBlock);
+    m_Extents.insert(index, extent);
 
-    return true;
+    // Merge with the neighbours if the run carries on into them.
+    if ((index + 1) < m_Extents.count() &&
+        extentsAdjacent(m_Extents[index], m_Extents[index + 1]))
+    {
+        m_Extents[index].length += m_Extents[index + 1].length;
+        m_Extents.erase(index + 1);
+    }
+    if (index && extentsAdjacent(m_Extents[index - 1], m_Extents[index]))
+    {
+        m_Extents[index - 1].length += m_Extents[index].length;
+        m_Extents.erase(index);
+    }
 }
 
 bool Ext2Node::addBlock(uint32_t blockValue)
@@ -336,19 +708,19 @@ bool Ext2Node::addBlock(uint32_t blockValue)
     size_t nEntriesPerBlock = m_pExt2Fs->m_BlockSize / 4;
 
     // Calculate whether direct, indirect or tri-indirect addressing is needed.
-    if (m_Blocks.count() < 12)
+    if (m_nBlocks < 12)
     {
         // Direct addressing is possible.
-        m_pInode->i_block[m_Blocks.count()] = HOST_TO_LITTLE32(blockValue);
+        m_pInode->i_block[m_nBlocks] = HOST_TO_LITTLE32(blockValue);
     }
-    else if (m_Blocks.count() < 12 + nEntriesPerBlock)
+    else if (m_nBlocks < 12 + nEntriesPerBlock)
     {
         // Indirect addressing needed.
-        size_t indirectIdx = m_Blocks.count() - 12;
+        size_t indirectIdx = m_nBlocks - 12;
 
         // If this is the first indirect block, we need to reserve a new table
         // block.
-        if (m_Blocks.count() == 12)
+        if (m_nBlocks == 12)
         {
             uint32_t newBlock = m_pExt2Fs->findFreeBlock(m_InodeNumber);
             m_pInode->i_block[12] = HOST_TO_LITTLE32(newBlock);
@@ -366,8 +738,8 @@ bool Ext2Node::addBlock(uint32_t blockValue)
             // Write back the zeroed block to prepare the indirect block.
             m_pExt2Fs->writeBlock(newBlock);
 
-            // Taken on a new block - update block count (but don't track in
-            // m_Blocks, as this is a metadata block).
+            // Taken on a new block - update block count (but don't track it
+            // as a data block, as this is a metadata block).
             m_nMetadataBlocks++;
         }
 
@@ -380,14 +752,14 @@ bool Ext2Node::addBlock(uint32_t blockValue)
         m_pExt2Fs->writeBlock(bufferBlock);
     }
     else if (
-        m_Blocks.count() <
+        m_nBlocks <
         12 + nEntriesPerBlock + nEntriesPerBlock * nEntriesPerBlock)
     {
         // Bi-indirect addressing required.
 
         // Index from the start of the bi-indirect block (i.e. ignore the 12
         // direct entries and one indirect block).
-        size_t biIdx = m_Blocks.count() - 12 - nEntriesPerBlock;
+        size_t biIdx = m_nBlocks - 12 - nEntriesPerBlock;
         // Block number inside the bi-indirect table of where to find the
         // indirect block table.
         size_t indirectBlock = biIdx / nEntriesPerBlock;
@@ -411,8 +783,8 @@ bool Ext2Node::addBlock(uint32_t blockValue)
                 reinterpret_cast<void *>(m_pExt2Fs->readBlock(newBlock));
             ByteSet(buffer, 0, m_pExt2Fs->m_BlockSize);
 
-            // Taken on a new block - update block count (but don't track in
-            // m_Blocks, as this is a metadata block).
+            // Taken on a new block - update block count (but don't track it
+            // as a data block, as this is a metadata block).
             m_nMetadataBlocks++;
         }
 
@@ -439,8 +811,8 @@ bool Ext2Node::addBlock(uint32_t blockValue)
                 reinterpret_cast<void *>(m_pExt2Fs->readBlock(newBlock));
             ByteSet(buffer, 0, m_pExt2Fs->m_BlockSize);
 
-            // Taken on a new block - update block count (but don't track in
-            // m_Blocks, as this is a metadata block).
+            // Taken on a new block - update block count (but don't track it
+            // as a data block, as this is a metadata block).
             m_nMetadataBlocks++;
         }
 
@@ -480,7 +852,7 @@ void Ext2Node::fileAttributeChanged(
 {
     // Reconstruct the inode from the cached fields.
     uint32_t i_blocks =
-        ((m_Blocks.count() + m_nMetadataBlocks) * m_pExt2Fs->m_BlockSize) / 512;
+        ((m_nBlocks + m_nMetadataBlocks) * m_pExt2Fs->m_BlockSize) / 512;
     m_pInode->i_blocks = HOST_TO_LITTLE32(i_blocks);
     m_pInode->i_size = HOST_TO_LITTLE32(size);  /// \todo 4GB files.
     m_pInode->i_atime = HOST_TO_LITTLE32(atime);
@@ -512,38 +884,91 @@ void Ext2Node::updateMetadata(uint16_t uid, uint16_t gid, uint32_t perms)
 void Ext2Node::sync(size_t offset, bool async)
 {
     uint32_t nBlock = offset / m_pExt2Fs->m_BlockSize;
-    if (nBlock > m_Blocks.count())
+    if (nBlock > m_nBlocks)
         return;
     if (offset > m_nSize)
         return;
 
     // Sync the block.
-    ensureBlockLoaded(nBlock);
-    m_pExt2Fs->sync(m_Blocks[nBlock] * m_pExt2Fs->m_BlockSize, async);
+    m_pExt2Fs->sync(getBlock(nBlock) * m_pExt2Fs->m_BlockSize, async);
 }
 
 void Ext2Node::pinBlock(uint64_t location)
 {
     uint32_t nBlock = location / m_pExt2Fs->m_BlockSize;
-    if (nBlock > m_Blocks.count())
+    if (nBlock > m_nBlocks)
         return;
     if (location > m_nSize)
         return;
 
-    ensureBlockLoaded(nBlock);
-    m_pExt2Fs->pinBlock(m_Blocks[nBlock]);
+    m_pExt2Fs->pinBlock(getBlock(nBlock));
 }
 
 void Ext2Node::unpinBlock(uint64_t location)
 {
     uint32_t nBlock = location / m_pExt2Fs->m_BlockSize;
-    if (nBlock > m_Blocks.count())
+    if (nBlock > m_nBlocks)
         return;
     if (location > m_nSize)
         return;
 
-    ensureBlockLoaded(nBlock);
-    m_pExt2Fs->unpinBlock(m_Blocks[nBlock]);
+    m_pExt2Fs->unpinBlock(getBlock(nBlock));
+}
+
+bool Ext2Node::mapBlock(uint64_t location, uint64_t &diskOffset)
+{
+    size_t length = 0;
+    return mapExtent(location, diskOffset, length);
+}
+
+bool Ext2Node::mapExtent(
+    uint64_t location, uint64_t &diskOffset, size_t &length)
+{
+    size_t blockSize = m_pExt2Fs->m_BlockSize;
+    uint32_t nBlock = location / blockSize;
+    if (nBlock >= m_nBlocks)
+        return false;
+    if (location > m_nSize)
+        return false;
+
+    uint32_t block = 0;
+    size_t nRun = getExtent(nBlock, block);
+    if (!nRun)
+        return false;
+
+    size_t offset = location % blockSize;
+    length = (nRun * blockSize) - offset;
+
+    if (block == 0)
+    {
+        // Sparse block(s).
+        diskOffset = 0;
+        return true;
+    }
+
+    diskOffset = static_cast<uint64_t>(block) * blockSize + offset;
+    return true;
+}
+
+size_t Ext2Node::trimExtents()
+{
+#ifdef THREADS
+    // Called under memory pressure, which may well have been caused by an
+    // allocation made while this lock is held.
+    if (!m_ExtentLock.tryAcquire())
+    {
+        return 0;
+    }
+#endif
+
+    size_t nFreed = m_Extents.size() * sizeof(Ext2Extent);
+    m_Extents.clear(true);
+
+#ifdef THREADS
+    m_ExtentLock.release();
+#endif
+
+    return nFreed;
 }
 
 uint32_t Ext2Node::modeToPermissions(uint32_t mode) const
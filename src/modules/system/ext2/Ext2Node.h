@@ -20,11 +20,33 @@
 #ifndef EXT2_NODE_H
 #define EXT2_NODE_H
 
+#include "pedigree/kernel/process/Mutex.h"
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/utilities/Vector.h"
 
 struct Inode;
 
+/** Soft limit on the number of extents cached for a single node. Once it is
+ *  reached the cache is dropped and refilled on demand. */
+#define EXT2_MAX_CACHED_EXTENTS 512
+
+/** Blocks reserved past the end of a node the first time an open writer
+ *  extends it. The window doubles each time it is used up. */
+#define EXT2_RESERVE_MIN_BLOCKS 8
+/** Upper bound on a node's reservation window. */
+#define EXT2_RESERVE_MAX_BLOCKS 1024
+
+/** A run of a node's data blocks that are contiguous on disk. */
+struct Ext2Extent
+{
+    /** First data block of the node covered by this run. */
+    uint32_t logical;
+    /** Disk block holding the first data block, or zero for a hole. */
+    uint32_t physical;
+    /** Number of blocks in the run. */
+    uint32_t length;
+};
+
 /** A node in an ext2 filesystem. */
 class Ext2Node
 {
@@ -61,6 +83,13 @@ class Ext2Node
     /** Wipes the node of data - frees all blocks. */
     void wipe();
 
+    /**
+     * Turns on or off reserving blocks past the end of the node as it is
+     * extended, so that appends stay contiguous even with other writers
+     * about. Turning it off hands back any blocks still reserved.
+     */
+    void setReserving(bool bReserving);
+
     void extend(size_t newSize);
     void extend(size_t newSize, uint64_t location, uint64_t size);
 
@@ -74,6 +103,24 @@ class Ext2Node
 
     void sync(size_t offset, bool async);
 
+    /**
+     * Translates a byte offset into this node's data into a byte offset on
+     * the disk. Sparse blocks give a disk offset of zero.
+     */
+    bool mapBlock(uint64_t location, uint64_t &diskOffset);
+
+    /**
+     * As mapBlock(), but also gives the number of bytes from location onwards
+     * that are contiguous on disk (or that are all sparse).
+     */
+    bool mapExtent(uint64_t location, uint64_t &diskOffset, size_t &length);
+
+    /**
+     * Drops the cached block map; it is rebuilt from the inode as needed.
+     * \return the number of bytes of memory released.
+     */
+    size_t trimExtents();
+
   protected:
     /**
      * Ensures the inode is at least 'size' big.
@@ -84,14 +131,33 @@ class Ext2Node
 
     bool addBlock(uint32_t blockValue);
 
-    bool ensureBlockLoaded(size_t nBlock);
-    bool getBlockNumber(size_t nBlock);
-    bool
-    getBlockNumberIndirect(uint32_t inode_block, size_t nBlocks, size_t nBlock);
-    bool getBlockNumberBiindirect(
-        uint32_t inode_block, size_t nBlocks, size_t nBlock);
-    bool getBlockNumberTriindirect(
-        uint32_t inode_block, size_t nBlocks, size_t nBlock);
+    /** Allocates blocks to append to the node, from its reservation first. */
+    bool allocateBlocks(size_t count, Vector<uint32_t> &blocks);
+    /** Hands back the node's reserved blocks. */
+    void discardReservation();
+    /** Releases an indirect table and the tables below it. */
+    void releaseTable(uint32_t table, size_t nLevels);
+
+    /** Gets the disk block holding the given data block (zero if sparse). */
+    uint32_t getBlock(size_t nBlock);
+
+    /**
+     * Gets the disk block holding the given data block, and the number of
+     * blocks from there on that are contiguous on disk.
+     * \return the length of the run, or zero if nBlock could not be mapped.
+     */
+    size_t getExtent(size_t nBlock, uint32_t &physical);
+
+    /** Finds the cached extent covering nBlock. */
+    bool findExtent(size_t nBlock, size_t &index);
+    /** Decodes the direct or indirect block containing nBlock's mapping. */
+    bool loadExtents(size_t nBlock);
+    /** Caches the given block pointers as runs of contiguous blocks. */
+    void cacheRuns(size_t nFirst, const uint32_t *pEntries, size_t nEntries);
+    /** Caches a hole of the given length. */
+    void cacheHole(size_t nFirst, size_t nLength);
+    /** Inserts an extent, replacing any cached mapping it overlaps. */
+    void insertExtent(const Ext2Extent &extent);
 
     bool setBlockNumber(size_t blockNum, uint32_t blockValue);
 
@@ -102,9 +168,28 @@ class Ext2Node
     uint32_t m_InodeNumber;
     class Ext2Filesystem *m_pExt2Fs;
 
-    Vector<uint32_t> m_Blocks;
+    /** Number of data blocks in the node. */
+    size_t m_nBlocks;
+    /** Block map cache, as sorted and non-overlapping runs of blocks. */
+    Vector<Ext2Extent> m_Extents;
+    /** Index of the extent most recently looked up. */
+    size_t m_nLastExtent;
+    /** Whether the filesystem can trim our cache under memory pressure. */
+    bool m_bExtentsTracked;
+#ifdef THREADS
+    Mutex m_ExtentLock;
+#endif
     uint32_t m_nMetadataBlocks;
 
+    /** Whether an open writer is extending the node. */
+    bool m_bReserving;
+    /** Blocks reserved to extend the node with, contiguous from
+     *  m_nReservedStart. */
+    uint32_t m_nReservedStart;
+    size_t m_nReservedCount;
+    /** Number of blocks to reserve next. */
+    size_t m_nReserveWindow;
+
     size_t m_nSize;
 };
 
@@ -26,6 +26,15 @@
 #define MEMCPY(dst, src, len) MemoryCopy(dst, src, len)
 #define SMEMCPY(dst, src, len) MemoryCopy(dst, src, len)
 
+// Use the kernel's checksum routines, and have TCP checksum application data
+// while it copies it into segments rather than in a second pass.
+#define LWIP_CHKSUM(dataptr, len) OnesComplementSum(dataptr, len)
+#define LWIP_CHECKSUM_ON_COPY 1
+#define LWIP_CHKSUM_COPY(dst, src, len) OnesComplementSumCopy(dst, src, len)
+
+// Drivers can take over checksum work per interface (Network::ChecksumOffload)
+#define LWIP_CHECKSUM_CTRL_PER_NETIF 1
+
 #define MEM_LIBC_MALLOC 1
 #define MEMP_MEM_MALLOC 1
 
@@ -156,6 +156,9 @@ typedef enum {
 #define PBUF_FLAG_LLMCAST   0x10U
 /** indicates this pbuf includes a TCP FIN flag */
 #define PBUF_FLAG_TCP_FIN   0x20U
+/** indicates the IP header and TCP/UDP checksums of this received pbuf have
+    already been verified (by the driver, or while copying it in) */
+#define PBUF_FLAG_CHKSUM_OK 0x40U
 
 /** Main packet buffer struct */
 struct pbuf {
@@ -0,0 +1,719 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "BpfProgram.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+/// Opcodes for the threaded form. The order must match the dispatch table in
+/// BpfProgram::run.
+enum BpfThreadedOp
+{
+    OpLoadWordAbs = 0,
+    OpLoadHalfAbs,
+    OpLoadByteAbs,
+    OpLoadWordInd,
+    OpLoadHalfInd,
+    OpLoadByteInd,
+    OpLoadImm,
+    OpLoadLen,
+    OpLoadMem,
+    OpLoadXImm,
+    OpLoadXLen,
+    OpLoadXMem,
+    OpLoadXMsh,
+    OpStore,
+    OpStoreX,
+    OpAddK,
+    OpSubK,
+    OpMulK,
+    OpDivK,
+    OpModK,
+    OpOrK,
+    OpAndK,
+    OpXorK,
+    OpLshK,
+    OpRshK,
+    OpAddX,
+    OpSubX,
+    OpMulX,
+    OpDivX,
+    OpModX,
+    OpOrX,
+    OpAndX,
+    OpXorX,
+    OpLshX,
+    OpRshX,
+    OpNeg,
+    OpJump,
+    OpJeqK,
+    OpJgtK,
+    OpJgeK,
+    OpJsetK,
+    OpJeqX,
+    OpJgtX,
+    OpJgeX,
+    OpJsetX,
+    OpRetK,
+    OpRetA,
+    OpTax,
+    OpTxa,
+    OpCount,
+    OpInvalid = 0xFFFFFFFFU,
+};
+
+static inline uint32_t loadWord(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 24) |
+           (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static inline uint32_t loadHalf(const uint8_t *p)
+{
+    return (static_cast<uint32_t>(p[0]) << 8) | p[1];
+}
+
+/// Checks that [offset, offset + size) is within the captured buffer.
+static inline bool inBounds(uint64_t offset, size_t size, size_t length)
+{
+    return (offset + size) <= length;
+}
+
+BpfProgram::BpfProgram()
+    : m_pInstructions(0), m_pCompiled(0), m_nInstructions(0)
+{
+}
+
+BpfProgram::~BpfProgram()
+{
+    delete[] m_pInstructions;
+    delete[] m_pCompiled;
+}
+
+uint32_t BpfProgram::translate(uint16_t code)
+{
+    switch (code)
+    {
+        case BPF_LD | BPF_W | BPF_ABS:
+            return OpLoadWordAbs;
+        case BPF_LD | BPF_H | BPF_ABS:
+            return OpLoadHalfAbs;
+        case BPF_LD | BPF_B | BPF_ABS:
+            return OpLoadByteAbs;
+        case BPF_LD | BPF_W | BPF_IND:
+            return OpLoadWordInd;
+        case BPF_LD | BPF_H | BPF_IND:
+            return OpLoadHalfInd;
+        case BPF_LD | BPF_B | BPF_IND:
+            return OpLoadByteInd;
+        case BPF_LD | BPF_W | BPF_IMM:
+            return OpLoadImm;
+        case BPF_LD | BPF_W | BPF_LEN:
+            return OpLoadLen;
+        case BPF_LD | BPF_W | BPF_MEM:
+            return OpLoadMem;
+        case BPF_LDX | BPF_W | BPF_IMM:
+            return OpLoadXImm;
+        case BPF_LDX | BPF_W | BPF_LEN:
+            return OpLoadXLen;
+        case BPF_LDX | BPF_W | BPF_MEM:
+            return OpLoadXMem;
+        case BPF_LDX | BPF_B | BPF_MSH:
+            return OpLoadXMsh;
+        case BPF_ST:
+            return OpStore;
+        case BPF_STX:
+            return OpStoreX;
+        case BPF_ALU | BPF_ADD | BPF_K:
+            return OpAddK;
+        case BPF_ALU | BPF_SUB | BPF_K:
+            return OpSubK;
+        case BPF_ALU | BPF_MUL | BPF_K:
+            return OpMulK;
+        case BPF_ALU | BPF_DIV | BPF_K:
+            return OpDivK;
+        case BPF_ALU | BPF_MOD | BPF_K:
+            return OpModK;
+        case BPF_ALU | BPF_OR | BPF_K:
+            return OpOrK;
+        case BPF_ALU | BPF_AND | BPF_K:
+            return OpAndK;
+        case BPF_ALU | BPF_XOR | BPF_K:
+            return OpXorK;
+        case BPF_ALU | BPF_LSH | BPF_K:
+            return OpLshK;
+        case BPF_ALU | BPF_RSH | BPF_K:
+            return OpRshK;
+        case BPF_ALU | BPF_ADD | BPF_X:
+            return OpAddX;
+        case BPF_ALU | BPF_SUB | BPF_X:
+            return OpSubX;
+        case BPF_ALU | BPF_MUL | BPF_X:
+            return OpMulX;
+        case BPF_ALU | BPF_DIV | BPF_X:
+            return OpDivX;
+        case BPF_ALU | BPF_MOD | BPF_X:
+            return OpModX;
+        case BPF_ALU | BPF_OR | BPF_X:
+            return OpOrX;
+        case BPF_ALU | BPF_AND | BPF_X:
+            return OpAndX;
+        case BPF_ALU | BPF_XOR | BPF_X:
+            return OpXorX;
+        case BPF_ALU | BPF_LSH | BPF_X:
+            return OpLshX;
+        case BPF_ALU | BPF_RSH | BPF_X:
+            return OpRshX;
+        case BPF_ALU | BPF_NEG:
+            return OpNeg;
+        case BPF_JMP | BPF_JA:
+            return OpJump;
+        case BPF_JMP | BPF_JEQ | BPF_K:
+            return OpJeqK;
+        case BPF_JMP | BPF_JGT | BPF_K:
+            return OpJgtK;
+        case BPF_JMP | BPF_JGE | BPF_K:
+            return OpJgeK;
+        case BPF_JMP | BPF_JSET | BPF_K:
+            return OpJsetK;
+        case BPF_JMP | BPF_JEQ | BPF_X:
+            return OpJeqX;
+        case BPF_JMP | BPF_JGT | BPF_X:
+            return OpJgtX;
+        case BPF_JMP | BPF_JGE | BPF_X:
+            return OpJgeX;
+        case BPF_JMP | BPF_JSET | BPF_X:
+            return OpJsetX;
+        case BPF_RET | BPF_K:
+            return OpRetK;
+        case BPF_RET | BPF_A:
+            return OpRetA;
+        case BPF_MISC | BPF_TAX:
+            return OpTax;
+        case BPF_MISC | BPF_TXA:
+            return OpTxa;
+        default:
+            return OpInvalid;
+    }
+}
+
+bool BpfProgram::validate(
+    const BpfInstruction *pInstructions, size_t nInstructions)
+{
+    if (!pInstructions || !nInstructions || nInstructions > BPF_MAXINSNS)
+    {
+        return false;
+    }
+
+    for (size_t pc = 0; pc < nInstructions; ++pc)
+    {
+        const BpfInstruction &insn = pInstructions[pc];
+        uint32_t op = translate(insn.code);
+        if (op == OpInvalid)
+        {
+            return false;
+        }
+
+        // Remaining instructions after this one; jumps are relative to the
+        // next instruction so must land strictly within this range.
+        size_t remaining = nInstructions - pc - 1;
+
+        switch (op)
+        {
+            case OpLoadMem:
+            case OpLoadXMem:
+            case OpStore:
+            case OpStoreX:
+                if (insn.k >= BPF_MEMWORDS)
+                {
+                    return false;
+                }
+                break;
+
+            case OpDivK:
+            case OpModK:
+                if (insn.k == 0)
+                {
+                    return false;
+                }
+                break;
+
+            case OpLshK:
+            case OpRshK:
+                if (insn.k >= 32)
+                {
+                    return false;
+                }
+                break;
+
+            case OpJump:
+                if (insn.k >= remaining)
+                {
+                    return false;
+                }
+                break;
+
+            case OpJeqK:
+            case OpJgtK:
+            case OpJgeK:
+            case OpJsetK:
+            case OpJeqX:
+            case OpJgtX:
+            case OpJgeX:
+            case OpJsetX:
+                if (insn.jt >= remaining || insn.jf >= remaining)
+                {
+                    return false;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    // Every path must end in a return. As all jumps are forward and in
+    // bounds, this holds if the final instruction is a return.
+    return BPF_CLASS(pInstructions[nInstructions - 1].code) == BPF_RET;
+}
+
+bool BpfProgram::load(const BpfInstruction *pInstructions, size_t nInstructions)
+{
+    if (!validate(pInstructions, nInstructions))
+    {
+        return false;
+    }
+
+    BpfInstruction *pCopy = new BpfInstruction[nInstructions];
+    CompiledInstruction *pCompiled = new CompiledInstruction[nInstructions];
+    MemoryCopy(pCopy, pInstructions, sizeof(BpfInstruction) * nInstructions);
+
+    for (size_t pc = 0; pc < nInstructions; ++pc)
+    {
+        const BpfInstruction &insn = pInstructions[pc];
+        CompiledInstruction &out = pCompiled[pc];
+
+        out.op = translate(insn.code);
+        out.k = insn.k;
+
+        // Resolve relative jumps to absolute targets once, here, rather than
+        // on every packet.
+        if (out.op == OpJump)
+        {
+            out.jt = out.jf = pc + 1 + insn.k;
+        }
+        else
+        {
+            out.jt = pc + 1 + insn.jt;
+            out.jf = pc + 1 + insn.jf;
+        }
+    }
+
+    delete[] m_pInstructions;
+    delete[] m_pCompiled;
+
+    m_pInstructions = pCopy;
+    m_pCompiled = pCompiled;
+    m_nInstructions = nInstructions;
+
+    return true;
+}
+
+uint32_t BpfProgram::run(
+    const uint8_t *packet, size_t wireLength, size_t bufferLength) const
+{
+    if (!m_pCompiled)
+    {
+        return ~0U;
+    }
+
+    // Threaded dispatch: each handler jumps directly to the next handler,
+    // avoiding the bounds check and shared indirect branch of a switch.
+    static const void *const dispatch[] = {
+        &&load_word_abs, &&load_half_abs, &&load_byte_abs, &&load_word_ind,
+        &&load_half_ind, &&load_byte_ind, &&load_imm,      &&load_len,
+        &&load_mem,      &&loadx_imm,     &&loadx_len,     &&loadx_mem,
+        &&loadx_msh,     &&store,         &&storex,        &&add_k,
+        &&sub_k,         &&mul_k,         &&div_k,         &&mod_k,
+        &&or_k,          &&and_k,         &&xor_k,         &&lsh_k,
+        &&rsh_k,         &&add_x,         &&sub_x,         &&mul_x,
+        &&div_x,         &&mod_x,         &&or_x,          &&and_x,
+        &&xor_x,         &&lsh_x,         &&rsh_x,         &&neg,
+        &&jump,          &&jeq_k,         &&jgt_k,         &&jge_k,
+        &&jset_k,        &&jeq_x,         &&jgt_x,         &&jge_x,
+        &&jset_x,        &&ret_k,         &&ret_a,         &&tax,
+        &&txa,
+    };
+    static_assert(
+        sizeof(dispatch) / sizeof(dispatch[0]) == OpCount,
+        "BPF dispatch table does not match threaded opcodes");
+
+    const CompiledInstruction *base = m_pCompiled;
+    const CompiledInstruction *pc = base;
+    uint32_t A = 0, X = 0;
+    uint32_t mem[BPF_MEMWORDS];
+    ByteSet(mem, 0, sizeof(mem));
+    uint64_t offset;
+
+#define DISPATCH() goto *dispatch[pc->op]
+#define NEXT()  \
+    do          \
+    {           \
+        ++pc;   \
+        DISPATCH(); \
+    } while (0)
+#define BRANCH(cond)                                 \
+    do                                               \
+    {                                                \
+        pc = base + ((cond) ? pc->jt : pc->jf);      \
+        DISPATCH();                                  \
+    } while (0)
+
+    DISPATCH();
+
+load_word_abs:
+    if (!inBounds(pc->k, 4, bufferLength))
+        return 0;
+    A = loadWord(packet + pc->k);
+    NEXT();
+load_half_abs:
+    if (!inBounds(pc->k, 2, bufferLength))
+        return 0;
+    A = loadHalf(packet + pc->k);
+    NEXT();
+load_byte_abs:
+    if (!inBounds(pc->k, 1, bufferLength))
+        return 0;
+    A = packet[pc->k];
+    NEXT();
+load_word_ind:
+    offset = static_cast<uint64_t>(X) + pc->k;
+    if (!inBounds(offset, 4, bufferLength))
+        return 0;
+    A = loadWord(packet + offset);
+    NEXT();
+load_half_ind:
+    offset = static_cast<uint64_t>(X) + pc->k;
+    if (!inBounds(offset, 2, bufferLength))
+        return 0;
+    A = loadHalf(packet + offset);
+    NEXT();
+load_byte_ind:
+    offset = static_cast<uint64_t>(X) + pc->k;
+    if (!inBounds(offset, 1, bufferLength))
+        return 0;
+    A = packet[offset];
+    NEXT();
+load_imm:
+    A = pc->k;
+    NEXT();
+load_len:
+    A = wireLength;
+    NEXT();
+load_mem:
+    A = mem[pc->k];
+    NEXT();
+loadx_imm:
+    X = pc->k;
+    NEXT();
+loadx_len:
+    X = wireLength;
+    NEXT();
+loadx_mem:
+    X = mem[pc->k];
+    NEXT();
+loadx_msh:
+    if (!inBounds(pc->k, 1, bufferLength))
+        return 0;
+    X = (packet[pc->k] & 0xF) << 2;
+    NEXT();
+store:
+    mem[pc->k] = A;
+    NEXT();
+storex:
+    mem[pc->k] = X;
+    NEXT();
+add_k:
+    A += pc->k;
+    NEXT();
+sub_k:
+    A -= pc->k;
+    NEXT();
+mul_k:
+    A *= pc->k;
+    NEXT();
+div_k:
+    A /= pc->k;
+    NEXT();
+mod_k:
+    A %= pc->k;
+    NEXT();
+or_k:
+    A |= pc->k;
+    NEXT();
+and_k:
+    A &= pc->k;
+    NEXT();
+xor_k:
+    A ^= pc->k;
+    NEXT();
+lsh_k:
+    A <<= pc->k;
+    NEXT();
+rsh_k:
+    A >>= pc->k;
+    NEXT();
+add_x:
+    A += X;
+    NEXT();
+sub_x:
+    A -= X;
+    NEXT();
+mul_x:
+    A *= X;
+    NEXT();
+div_x:
+    if (!X)
+        return 0;
+    A /= X;
+    NEXT();
+mod_x:
+    if (!X)
+        return 0;
+    A %= X;
+    NEXT();
+or_x:
+    A |= X;
+    NEXT();
+and_x:
+    A &= X;
+    NEXT();
+xor_x:
+    A ^= X;
+    NEXT();
+lsh_x:
+    A = (X < 32) ? (A << X) : 0;
+    NEXT();
+rsh_x:
+    A = (X < 32) ? (A >> X) : 0;
+    NEXT();
+neg:
+    A = -A;
+    NEXT();
+jump:
+    pc = base + pc->jt;
+    DISPATCH();
+jeq_k:
+    BRANCH(A == pc->k);
+jgt_k:
+    BRANCH(A > pc->k);
+jge_k:
+    BRANCH(A >= pc->k);
+jset_k:
+    BRANCH(A & pc->k);
+jeq_x:
+    BRANCH(A == X);
+jgt_x:
+    BRANCH(A > X);
+jge_x:
+    BRANCH(A >= X);
+jset_x:
+    BRANCH(A & X);
+ret_k:
+    return pc->k;
+ret_a:
+    return A;
+tax:
+    X = A;
+    NEXT();
+txa:
+    A = X;
+    NEXT();
+
+#undef BRANCH
+#undef NEXT
+#undef DISPATCH
+}
+
+uint32_t BpfProgram::interpret(
+    const uint8_t *packet, size_t wireLength, size_t bufferLength) const
+{
+    if (!m_pInstructions)
+    {
+        return ~0U;
+    }
+
+    uint32_t A = 0, X = 0;
+    uint32_t mem[BPF_MEMWORDS];
+    ByteSet(mem, 0, sizeof(mem));
+
+    for (size_t pc = 0; pc < m_nInstructions; ++pc)
+    {
+        const BpfInstruction &insn = m_pInstructions[pc];
+        uint64_t offset = insn.k;
+        size_t size = 0;
+
+        switch (BPF_CLASS(insn.code))
+        {
+            case BPF_LD:
+            case BPF_LDX:
+            {
+                uint32_t value = 0;
+                switch (BPF_MODE(insn.code))
+                {
+                    case BPF_IMM:
+                        value = insn.k;
+                        break;
+                    case BPF_LEN:
+                        value = wireLength;
+                        break;
+                    case BPF_MEM:
+                        value = mem[insn.k];
+                        break;
+                    case BPF_IND:
+                        offset += X;
+                        // fall through
+                    case BPF_ABS:
+                    case BPF_MSH:
+                        size = BPF_SIZE(insn.code) == BPF_W ?
+                                   4 :
+                                   (BPF_SIZE(insn.code) == BPF_H ? 2 : 1);
+                        if (!inBounds(offset, size, bufferLength))
+                        {
+                            return 0;
+                        }
+                        if (size == 4)
+                            value = loadWord(packet + offset);
+                        else if (size == 2)
+                            value = loadHalf(packet + offset);
+                        else
+                            value = packet[offset];
+                        if (BPF_MODE(insn.code) == BPF_MSH)
+                        {
+                            value = (value & 0xF) << 2;
+                        }
+                        break;
+                }
+
+                if (BPF_CLASS(insn.code) == BPF_LD)
+                    A = value;
+                else
+                    X = value;
+                break;
+            }
+
+            case BPF_ST:
+                mem[insn.k] = A;
+                break;
+
+            case BPF_STX:
+                mem[insn.k] = X;
+                break;
+
+            case BPF_ALU:
+            {
+                uint32_t operand = BPF_SRC(insn.code) == BPF_X ? X : insn.k;
+                switch (BPF_OP(insn.code))
+                {
+                    case BPF_ADD:
+                        A += operand;
+                        break;
+                    case BPF_SUB:
+                        A -= operand;
+                        break;
+                    case BPF_MUL:
+                        A *= operand;
+                        break;
+                    case BPF_DIV:
+                        if (!operand)
+                            return 0;
+                        A /= operand;
+                        break;
+                    case BPF_MOD:
+                        if (!operand)
+                            return 0;
+                        A %= operand;
+                        break;
+                    case BPF_OR:
+                        A |= operand;
+                        break;
+                    case BPF_AND:
+                        A &= operand;
+                        break;
+                    case BPF_XOR:
+                        A ^= operand;
+                        break;
+                    case BPF_LSH:
+                        A = operand < 32 ? (A << operand) : 0;
+                        break;
+                    case BPF_RSH:
+                        A = operand < 32 ? (A >> operand) : 0;
+                        break;
+                    case BPF_NEG:
+                        A = -A;
+                        break;
+                }
+                break;
+            }
+
+            case BPF_JMP:
+            {
+                if (BPF_OP(insn.code) == BPF_JA)
+                {
+                    pc += insn.k;
+                    break;
+                }
+
+                uint32_t operand = BPF_SRC(insn.code) == BPF_X ? X : insn.k;
+                bool taken = false;
+                switch (BPF_OP(insn.code))
+                {
+                    case BPF_JEQ:
+                        taken = A == operand;
+                        break;
+                    case BPF_JGT:
+                        taken = A > operand;
+                        break;
+                    case BPF_JGE:
+                        taken = A >= operand;
+                        break;
+                    case BPF_JSET:
+                        taken = (A & operand) != 0;
+                        break;
+                }
+
+                pc += taken ? insn.jt : insn.jf;
+                break;
+            }
+
+            case BPF_RET:
+                return BPF_RVAL(insn.code) == BPF_A ? A : insn.k;
+
+            case BPF_MISC:
+                if (BPF_MISCOP(insn.code) == BPF_TAX)
+                    X = A;
+                else
+                    A = X;
+                break;
+        }
+    }
+
+    // Unreachable for a validated program.
+    return 0;
+}
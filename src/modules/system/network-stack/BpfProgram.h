@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef NETWORK_STACK_BPFPROGRAM_H
+#define NETWORK_STACK_BPFPROGRAM_H
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+/** \file BpfProgram.h
+ * A classic BPF (Berkeley Packet Filter) compatible virtual machine.
+ *
+ * Programs use the same instruction encoding as classic BPF, so the output of
+ * `tcpdump -dd` can be loaded directly. Programs are validated on load and
+ * then translated into a threaded form which is what runs per-packet. */
+
+// Instruction classes.
+#define BPF_CLASS(code) ((code)&0x07)
+#define BPF_LD 0x00
+#define BPF_LDX 0x01
+#define BPF_ST 0x02
+#define BPF_STX 0x03
+#define BPF_ALU 0x04
+#define BPF_JMP 0x05
+#define BPF_RET 0x06
+#define BPF_MISC 0x07
+
+// Load/store sizes.
+#define BPF_SIZE(code) ((code)&0x18)
+#define BPF_W 0x00
+#define BPF_H 0x08
+#define BPF_B 0x10
+
+// Load/store addressing modes.
+#define BPF_MODE(code) ((code)&0xe0)
+#define BPF_IMM 0x00
+#define BPF_ABS 0x20
+#define BPF_IND 0x40
+#define BPF_MEM 0x60
+#define BPF_LEN 0x80
+#define BPF_MSH 0xa0
+
+// ALU and jump operations.
+#define BPF_OP(code) ((code)&0xf0)
+#define BPF_ADD 0x00
+#define BPF_SUB 0x10
+#define BPF_MUL 0x20
+#define BPF_DIV 0x30
+#define BPF_OR 0x40
+#define BPF_AND 0x50
+#define BPF_LSH 0x60
+#define BPF_RSH 0x70
+#define BPF_NEG 0x80
+#define BPF_MOD 0x90
+#define BPF_XOR 0xa0
+
+#define BPF_JA 0x00
+#define BPF_JEQ 0x10
+#define BPF_JGT 0x20
+#define BPF_JGE 0x30
+#define BPF_JSET 0x40
+
+// Operand source.
+#define BPF_SRC(code) ((code)&0x08)
+#define BPF_K 0x00
+#define BPF_X 0x08
+
+// Return value source.
+#define BPF_RVAL(code) ((code)&0x18)
+#define BPF_A 0x10
+
+// Miscellaneous operations.
+#define BPF_MISCOP(code) ((code)&0xf8)
+#define BPF_TAX 0x00
+#define BPF_TXA 0x80
+
+/// Number of 32-bit words of scratch memory available to programs.
+#define BPF_MEMWORDS 16
+
+/// Maximum number of instructions in a single program.
+#define BPF_MAXINSNS 4096
+
+/// Helpers for writing programs inline, as in the BSD headers.
+#define BPF_STMT(code, k) {static_cast<uint16_t>(code), 0, 0, k}
+#define BPF_JUMP(code, k, jt, jf) {static_cast<uint16_t>(code), jt, jf, k}
+
+/** A single classic BPF instruction. */
+struct BpfInstruction
+{
+    uint16_t code;
+    uint8_t jt;
+    uint8_t jf;
+    uint32_t k;
+};
+
+/**
+ * A validated, compiled BPF program.
+ *
+ * The return value of a program is the number of bytes of the packet to
+ * accept; zero means the packet should be rejected (or not captured).
+ */
+class EXPORTED_PUBLIC BpfProgram
+{
+  public:
+    BpfProgram();
+    ~BpfProgram();
+
+    /**
+     * Validates and compiles the given program.
+     * \return false if the program is not valid, in which case any
+     *         previously loaded program is retained.
+     */
+    bool load(const BpfInstruction *pInstructions, size_t nInstructions);
+
+    /** Whether a program has been loaded. */
+    bool isLoaded() const
+    {
+        return m_pCompiled != 0;
+    }
+
+    /** Number of instructions in the loaded program. */
+    size_t count() const
+    {
+        return m_nInstructions;
+    }
+
+    /**
+     * Runs the compiled program over a packet.
+     * \param packet The packet data.
+     * \param wireLength The full length of the packet on the wire.
+     * \param bufferLength The number of bytes of the packet in 'packet'.
+     * \return the number of bytes to accept; zero to reject. If no program
+     *         is loaded, every packet is accepted in full.
+     */
+    uint32_t
+    run(const uint8_t *packet, size_t wireLength, size_t bufferLength) const;
+
+    /**
+     * Runs the loaded program with the reference interpreter.
+     * This is slower than run() and exists to cross-check the compiled form.
+     */
+    uint32_t interpret(
+        const uint8_t *packet, size_t wireLength, size_t bufferLength) const;
+
+    /**
+     * Checks that a program is safe to execute: all instructions are known,
+     * jumps are forward and in bounds, scratch memory accesses are in range,
+     * constant divisors are non-zero and the program ends in a return.
+     */
+    static bool
+    validate(const BpfInstruction *pInstructions, size_t nInstructions);
+
+  private:
+    NOT_COPYABLE_OR_ASSIGNABLE(BpfProgram);
+
+    /** An instruction in the threaded form that run() executes. */
+    struct CompiledInstruction
+    {
+        /// Index into the dispatch table in run().
+        uint32_t op;
+        uint32_t k;
+        /// Absolute instruction indices for conditional jumps.
+        uint32_t jt;
+        uint32_t jf;
+    };
+
+    /** Translates a validated instruction into its threaded opcode. */
+    static uint32_t translate(uint16_t code);
+
+    BpfInstruction *m_pInstructions;
+    CompiledInstruction *m_pCompiled;
+    size_t m_nInstructions;
+};
+
+#endif  // NETWORK_STACK_BPFPROGRAM_H
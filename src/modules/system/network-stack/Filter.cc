@@ -24,86 +24,156 @@
 
 NetworkFilter NetworkFilter::m_Instance;
 
-NetworkFilter::NetworkFilter() : m_Callbacks()
+NetworkFilter::NetworkFilter()
+    : m_Callbacks(), m_Programs(), m_nPrograms(0), m_Lock()
 {
 }
 
 NetworkFilter::~NetworkFilter()
 {
+    for (Tree<Network *, BpfProgram *>::Iterator it = m_Programs.begin();
+         it != m_Programs.end(); ++it)
+    {
+        delete it.value();
+    }
 }
 
-bool NetworkFilter::filter(size_t level, uintptr_t packet, size_t sz)
+bool NetworkFilter::filter(
+    size_t level, uintptr_t packet, size_t sz, Network *pCard)
 {
     // Check for a valid level
-    if (level <= 4 && level > 0)
+    if (level > NETWORK_FILTER_LEVELS || level == 0)
+    {
+        // Default response: allow packet
+        return true;
+    }
+
+    Vector<void *> &callbacks = m_Callbacks[level - 1];
+
+    // Fast path: nothing to run for this packet.
+    if (!callbacks.count() && (level != 1 || !m_nPrograms || !pCard))
+    {
+        return true;
+    }
+
+    m_Lock.enter();
+
+    // Run the interface's program first, if it has one.
+    if (level == 1 && pCard && m_nPrograms)
     {
-        // Grab the callback list
-        typedef List<void *>::Iterator callbackIterator;
-        List<void *> *list = m_Callbacks.lookup(level);
-        if (list)
+        BpfProgram *pProgram = m_Programs.lookup(pCard);
+        if (pProgram &&
+            !pProgram->run(reinterpret_cast<const uint8_t *>(packet), sz, sz))
         {
-            // Iterate, call each callback until one returns false
-            for (callbackIterator it = list->begin(); it != list->end(); ++it)
-            {
-                bool (*callback)(uintptr_t, size_t) =
-                    reinterpret_cast<bool (*)(uintptr_t, size_t)>(*it);
-                bool result = callback(packet, sz);
-                if (!result)
-                    return result;  // Short-circuit. This way we avoid
-                                    // executing extra filters if one says to
-                                    // drop.
-            }
+            m_Lock.leave();
+            return false;
         }
     }
 
-    // Default response: allow packet
-    return true;
+    // Call each callback until one returns false
+    bool result = true;
+    for (auto it = callbacks.begin(); it != callbacks.end(); ++it)
+    {
+        if (!*it)
+        {
+            continue;  // removed callback
+        }
+
+        bool (*callback)(uintptr_t, size_t) =
+            reinterpret_cast<bool (*)(uintptr_t, size_t)>(*it);
+        result = callback(packet, sz);
+        if (!result)
+            break;  // Short-circuit. This way we avoid executing extra
+                    // filters if one says to drop.
+    }
+
+    m_Lock.leave();
+
+    return result;
 }
 
 size_t NetworkFilter::installCallback(
     size_t level, bool (*callback)(uintptr_t, size_t))
 {
-    /// \todo UnlikelyLock here
-
     // Check for a valid level
-    if (level <= 4 && level > 0)
+    if (level > NETWORK_FILTER_LEVELS || level == 0)
     {
-        // Grab the callback list
-        List<void *> *list = m_Callbacks.lookup(level);
-
-        // If it already exists, add the callback
-        if (list)
-        {
-            // We return the index into the list of this callback
-            size_t index = list->count();
-            list->pushBack(reinterpret_cast<void *>(callback));
-            return index;
-        }
-        // Otherwise, allocate
-        else
-        {
-            list = new List<void *>;
-            if (!list)
-            {
-                ERROR(
-                    "Ran out of memory creating list for level "
-                    << Dec << level << Hex << " callbacks!");
-                return static_cast<size_t>(-1);
-            }
-
-            list->pushBack(reinterpret_cast<void *>(callback));
-            m_Callbacks.insert(level, list);
-
-            // First item
-            return 0;
-        }
+        // Invalid input
+        return static_cast<size_t>(-1);
     }
 
-    // Invalid input
-    return static_cast<size_t>(-1);
+    m_Lock.acquire();
+
+    // We return the index into the list of this callback
+    Vector<void *> &callbacks = m_Callbacks[level - 1];
+    size_t index = callbacks.count();
+    callbacks.pushBack(reinterpret_cast<void *>(callback));
+
+    m_Lock.release();
+
+    return index;
 }
 
 void NetworkFilter::removeCallback(size_t level, size_t id)
 {
-    /// \todo Implement me!
+    if (level > NETWORK_FILTER_LEVELS || level == 0)
+    {
+        return;
+    }
+
+    m_Lock.acquire();
+
+    Vector<void *> &callbacks = m_Callbacks[level - 1];
+    if (id < callbacks.count())
+    {
+        callbacks.setAt(id, 0);
+    }
+
+    m_Lock.release();
+}
+
+bool NetworkFilter::attachProgram(
+    Network *pCard, const BpfInstruction *pInstructions, size_t nInstructions)
+{
+    BpfProgram *pProgram = new BpfProgram();
+    if (!pProgram->load(pInstructions, nInstructions))
+    {
+        ERROR("NetworkFilter: rejecting invalid BPF program");
+        delete pProgram;
+        return false;
+    }
+
+    m_Lock.acquire();
+
+    BpfProgram *pOld = m_Programs.lookup(pCard);
+    if (pOld)
+    {
+        m_Programs.remove(pCard);
+        --m_nPrograms;
+    }
+
+    m_Programs.insert(pCard, pProgram);
+    ++m_nPrograms;
+
+    m_Lock.release();
+
+    delete pOld;
+
+    return true;
+}
+
+void NetworkFilter::detachProgram(Network *pCard)
+{
+    m_Lock.acquire();
+
+    BpfProgram *pProgram = m_Programs.lookup(pCard);
+    if (pProgram)
+    {
+        m_Programs.remove(pCard);
+        --m_nPrograms;
+    }
+
+    m_Lock.release();
+
+    delete pProgram;
 }
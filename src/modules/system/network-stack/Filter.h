@@ -20,10 +20,17 @@
 #ifndef NETWORK_STACK_FILTER_H
 #define NETWORK_STACK_FILTER_H
 
+#include "BpfProgram.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/processor/types.h"
-#include "pedigree/kernel/utilities/List.h"
 #include "pedigree/kernel/utilities/Tree.h"
+#include "pedigree/kernel/utilities/UnlikelyLock.h"
+#include "pedigree/kernel/utilities/Vector.h"
+
+class Network;
+
+/// Number of filter levels (see NetworkFilter::filter).
+#define NETWORK_FILTER_LEVELS 4
 
 /** Provides an interface for filtering network packets as they come in to
  * the system. */
@@ -55,9 +62,12 @@ class EXPORTED_PUBLIC NetworkFilter
      * \param level Level of callback to call
      * \param packet Packet buffer, can be modified by callbacks
      * \param size Size of the packet. Can NOT be modified by callbacks
+     * \param pCard The interface the packet arrived on or is leaving by. If
+     *        a BPF program is attached to the interface, it runs on Level 1
+     *        packets before any callbacks.
      * \return False if the packet has been rejected, true otherwise.
      */
-    bool filter(size_t level, uintptr_t packet, size_t sz);
+    bool filter(size_t level, uintptr_t packet, size_t sz, Network *pCard = 0);
 
     /** Installs a callback for a specific level.
      * \return An identifier which can be passed to removeCallback to
@@ -68,11 +78,34 @@ class EXPORTED_PUBLIC NetworkFilter
     /** Removes a callback for a specific level. */
     void removeCallback(size_t level, size_t id);
 
+    /** Attaches a BPF program to an interface, replacing any existing one.
+     * Level 1 packets on the interface for which the program returns zero
+     * are dropped.
+     * \return False if the program failed validation.
+     */
+    bool attachProgram(
+        Network *pCard, const BpfInstruction *pInstructions,
+        size_t nInstructions);
+
+    /** Detaches the BPF program from an interface, if any. */
+    void detachProgram(Network *pCard);
+
   private:
     static NetworkFilter m_Instance;
 
-    /// Level -> Callback list mapping
-    Tree<size_t, List<void *> *> m_Callbacks;
+    /// Callbacks for each level, indexed by level - 1. Removed callbacks
+    /// leave a null entry behind so identifiers remain stable.
+    Vector<void *> m_Callbacks[NETWORK_FILTER_LEVELS];
+
+    /// Interface -> attached BPF program mapping
+    Tree<Network *, BpfProgram *> m_Programs;
+
+    /// Number of attached programs, to skip the lookup when there are none.
+    size_t m_nPrograms;
+
+    /// Guards the callback lists and program table. Packets only ever take
+    /// the read side.
+    UnlikelyLock m_Lock;
 };
 
 #endif  // NETWORK_STACK_FILTER_H
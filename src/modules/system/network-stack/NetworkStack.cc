@@ -27,6 +27,7 @@
 #include "modules/system/lwip/include/lwip/etharp.h"
 #include "modules/system/lwip/include/lwip/ethip6.h"
 #include "modules/system/lwip/include/lwip/netif.h"
+#include "modules/system/lwip/include/lwip/prot/ip.h"
 #include "modules/system/lwip/include/lwip/tcpip.h"
 #include "modules/system/lwip/include/netif/ethernet.h"
 
@@ -50,9 +51,10 @@ static err_t linkOutput(struct netif *netif, struct pbuf *p)
 
     // Check for filtering
     if (!NetworkFilter::instance().filter(
-            1, reinterpret_cast<uintptr_t>(output), totalLength))
+            1, reinterpret_cast<uintptr_t>(output), totalLength, pDevice))
     {
         pDevice->droppedPacket();
+        delete[] output;
         return ERR_IF;  // Drop the packet.
     }
 
@@ -106,12 +108,146 @@ static err_t netifInit(struct netif *netif)
     netif->output = etharp_output;
     netif->output_ip6 = ethip6_output;
 
+    // Network::ChecksumOffload uses the same bit layout as lwIP's flags.
+    uint32_t offload = pDevice->getChecksumOffload();
+    NETIF_SET_CHECKSUM_CTRL(netif, NETIF_CHECKSUM_ENABLE_ALL & ~offload);
+
     netif_set_status_callback(netif, netifStatusUpdate);
     netif_set_link_callback(netif, netifLinkUpdate);
 
     return ERR_OK;
 }
 
+/**
+ * Works out which checksums of an incoming Ethernet frame receive() can
+ * verify while copying it into lwIP's buffers. Only unfragmented IPv4 and
+ * IPv6 (without extension headers) carrying TCP or UDP are handled - anything
+ * else is left to lwIP to check as normal.
+ * \param l4Start/l4End the range covered by the TCP/UDP checksum, empty if
+ *        it doesn't need verifying
+ * \param seed the sum of the pseudo header to add to that range
+ * \return false if the frame cannot be verified here, or its IPv4 header
+ *         checksum is already known to be bad (\p headerOk)
+ */
+static bool findChecksumRange(
+    const uint8_t *frame, size_t nBytes, uint32_t offload, size_t &l4Start,
+    size_t &l4End, uint16_t &seed, bool &headerOk)
+{
+    const size_t ethHeaderLength = 14;
+    headerOk = true;
+    l4Start = l4End = 0;
+
+    if (nBytes < ethHeaderLength)
+    {
+        return false;
+    }
+
+    const uint8_t *ip = frame + ethHeaderLength;
+    size_t ipBytes = nBytes - ethHeaderLength;
+    uint16_t etherType = (frame[12] << 8) | frame[13];
+
+    // Pseudo header, laid out in network byte order so it can be summed
+    // exactly like the packet data.
+    uint8_t pseudo[40];
+    size_t pseudoLength = 0;
+    uint8_t protocol = 0;
+    size_t l4Length = 0;
+
+    if (etherType == 0x0800)
+    {
+        if (ipBytes < 20 || (ip[0] >> 4) != 4)
+        {
+            return false;
+        }
+
+        size_t headerLength = (ip[0] & 0xF) * 4;
+        size_t totalLength = (ip[2] << 8) | ip[3];
+        uint16_t fragment = ((ip[6] << 8) | ip[7]) & 0x3FFF;
+        if (headerLength < 20 || totalLength < headerLength ||
+            totalLength > ipBytes || fragment)
+        {
+            return false;
+        }
+
+        protocol = ip[9];
+        if (protocol != IP_PROTO_TCP && protocol != IP_PROTO_UDP)
+        {
+            return false;
+        }
+
+        if ((offload & Network::CheckIpv4Checksum) == 0)
+        {
+            headerOk = OnesComplementSum(ip, headerLength) == 0xFFFF;
+            if (!headerOk)
+            {
+                return false;
+            }
+        }
+
+        l4Start = ethHeaderLength + headerLength;
+        l4Length = totalLength - headerLength;
+
+        MemoryCopy(pseudo, ip + 12, 8);
+        pseudoLength = 8;
+
+        // A zero UDP checksum over IPv4 means the sender didn't compute one.
+        if (protocol == IP_PROTO_UDP && l4Length >= 8 &&
+            !(ip[headerLength + 6] | ip[headerLength + 7]))
+        {
+            l4Start = l4End = 0;
+            return true;
+        }
+    }
+    else if (etherType == 0x86DD)
+    {
+        if (ipBytes < 40 || (ip[0] >> 4) != 6)
+        {
+            return false;
+        }
+
+        l4Length = (ip[4] << 8) | ip[5];
+        protocol = ip[6];
+        if ((protocol != IP_PROTO_TCP && protocol != IP_PROTO_UDP) ||
+            l4Length + 40 > ipBytes)
+        {
+            return false;
+        }
+
+        l4Start = ethHeaderLength + 40;
+
+        MemoryCopy(pseudo, ip + 8, 32);
+        pseudoLength = 32;
+    }
+    else
+    {
+        return false;
+    }
+
+    if (l4Length < (protocol == IP_PROTO_TCP ? 20U : 8U))
+    {
+        return false;
+    }
+
+    uint32_t needed = protocol == IP_PROTO_TCP ? Network::CheckTcpChecksum :
+                                                 Network::CheckUdpChecksum;
+    if (offload & needed)
+    {
+        // The device has already done this one.
+        l4Start = l4End = 0;
+        return true;
+    }
+
+    l4End = l4Start + l4Length;
+
+    pseudo[pseudoLength++] = 0;
+    pseudo[pseudoLength++] = protocol;
+    pseudo[pseudoLength++] = (l4Length >> 8) & 0xFF;
+    pseudo[pseudoLength++] = l4Length & 0xFF;
+    seed = OnesComplementSum(pseudo, pseudoLength);
+
+    return true;
+}
+
 NetworkStack::NetworkStack()
     : RequestQueue("Network Stack"), m_pLoopback(0), m_Children(),
       m_MemPool("network-pool")
@@ -181,7 +317,7 @@ void NetworkStack::receive(
     packet += offset;
 
     // Check for filtering before doing anything else
-    if (!NetworkFilter::instance().filter(1, packet, nBytes))
+    if (!NetworkFilter::instance().filter(1, packet, nBytes, pCard))
     {
         pCard->droppedPacket();
         return;  // Drop the packet.
@@ -195,20 +331,59 @@ void NetworkStack::receive(
         return;
     }
 
+    // Find out what we can verify while the packet is copied, so lwIP does
+    // not need to walk all of it again later.
+    const uint8_t *frame = reinterpret_cast<const uint8_t *>(packet);
+    size_t l4Start = 0, l4End = 0;
+    uint16_t sum = 0;
+    bool headerOk = true;
+    bool verify = findChecksumRange(
+        frame, nBytes, pCard->getChecksumOffload(), l4Start, l4End, sum,
+        headerOk);
+    if (!headerOk)
+    {
+        pCard->badPacket();
+        return;
+    }
+
     struct pbuf *p = pbuf_alloc(PBUF_RAW, nBytes, PBUF_POOL);
     if (p != 0)
     {
-        struct pbuf *buf = p;
-        while (buf != nullptr)
+        size_t pos = 0;
+        for (struct pbuf *buf = p; buf != nullptr; buf = buf->next)
         {
-            size_t copyLength = buf->len;
-            MemoryCopy(
-                buf->payload, reinterpret_cast<void *>(packet), buf->len);
-
-            packet += buf->len;
-            nBytes -= buf->len;
-
-            buf = buf->next;
+            uint8_t *dest = reinterpret_cast<uint8_t *>(buf->payload);
+            size_t end = pos + buf->len;
+
+            // Only the part of this pbuf inside the checksummed range gets
+            // the fused copy; the rest is a plain copy.
+            size_t sumStart = l4Start > pos ? l4Start : pos;
+            size_t sumEnd = l4End < end ? l4End : end;
+            if (sumStart < sumEnd)
+            {
+                MemoryCopy(dest, frame + pos, sumStart - pos);
+
+                uint16_t partial = OnesComplementSumCopy(
+                    dest + (sumStart - pos), frame + sumStart,
+                    sumEnd - sumStart);
+
+                // A run starting at an odd offset into the range has its
+                // bytes summed in the opposite lanes.
+                if ((sumStart - l4Start) & 1)
+                {
+                    partial = (partial << 8) | (partial >> 8);
+                }
+                sum = OnesComplementAdd(sum, partial);
+
+                MemoryCopy(
+                    dest + (sumEnd - pos), frame + sumEnd, end - sumEnd);
+            }
+            else
+            {
+                MemoryCopy(dest, frame + pos, buf->len);
+            }
+
+            pos = end;
         }
     }
     else
@@ -219,6 +394,18 @@ void NetworkStack::receive(
         return;
     }
 
+    if (verify)
+    {
+        if (l4Start != l4End && sum != 0xFFFF)
+        {
+            pbuf_free(p);
+            pCard->badPacket();
+            return;
+        }
+
+        p->flags |= PBUF_FLAG_CHKSUM_OK;
+    }
+
     uint64_t result = addRequest(
         0, reinterpret_cast<uint64_t>(p), reinterpret_cast<uintptr_t>(iface));
 }
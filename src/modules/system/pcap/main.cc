@@ -18,15 +18,24 @@
  */
 
 #include "modules/Module.h"
+#include "modules/system/network-stack/BpfProgram.h"
 #include "modules/system/network-stack/Filter.h"
-#include "pedigree/kernel/LockGuard.h"
+#include "modules/system/vfs/File.h"
+#include "modules/system/vfs/VFS.h"
 #include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/machine/Machine.h"
 #include "pedigree/kernel/machine/Serial.h"
-#include "pedigree/kernel/process/Mutex.h"
+#include "pedigree/kernel/process/Semaphore.h"
+#include "pedigree/kernel/process/Thread.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/time/Time.h"
+#include "pedigree/kernel/utilities/String.h"
+#include "pedigree/kernel/utilities/UnlikelyLock.h"
+#include "pedigree/kernel/utilities/utility.h"
 
 struct PcapHeader
 {
@@ -54,9 +63,56 @@ struct PcapRecord
 
 #define PCAP_NETWORK 1
 
+/// Maximum number of bytes captured from each packet.
+#define PCAP_SNAPLEN 0xFFFF
+
+/// Size of each per-CPU capture ring. Must be a power of two.
+#define PCAP_RING_SIZE 0x40000
+
+/// How often the drain thread flushes the rings even if not woken.
+#define PCAP_FLUSH_INTERVAL_USECS 100000
+
+/// Where captures are written; falls back to the third serial port.
+#define PCAP_FILE "scratch»/capture.pcap"
+
+/**
+ * A per-CPU capture ring. Packets are copied in on the network path and
+ * drained to the capture file asynchronously, so a slow sink never stalls
+ * packet processing - if the ring is full the packet is simply not captured.
+ */
+struct PcapRing
+{
+    PcapRing() : lock(false), buffer(0), head(0), tail(0), nDropped(0)
+    {
+    }
+
+    Spinlock lock;
+    uint8_t *buffer;
+    /// Write and read positions; these only ever increase.
+    size_t head;
+    size_t tail;
+    /// Packets that did not fit in the ring.
+    size_t nDropped;
+};
+
 static size_t g_FilterEntry = 0;
 
-static Mutex g_PcapMutex(false);
+/// One ring per processor, sized at load time from Processor::getCount().
+static PcapRing **g_Rings = 0;
+static size_t g_nRings = 0;
+
+/// Capture filter, run on each packet to determine how much to capture.
+static BpfProgram g_CaptureFilter;
+static UnlikelyLock g_CaptureFilterLock;
+
+static Semaphore g_DrainWakeup(0);
+static Thread *g_pDrainThread = 0;
+static volatile bool g_bCapturing = false;
+
+/// Output sink, chosen by the drain thread once something is available.
+static File *g_pFile = 0;
+static uint64_t g_FileOffset = 0;
+static Serial *g_pSerial = 0;
 
 static Serial *getSerial() PURE;
 static Serial *getSerial()
@@ -76,95 +132,291 @@ static Serial *getSerial()
     return Machine::instance().getSerial(2);
 }
 
-bool pcapLogPacket(uintptr_t packet, size_t size)
+static void pcapWrite(const uint8_t *data, size_t length)
 {
-    LockGuard<Mutex> guard(g_PcapMutex);
+    if (g_pFile)
+    {
+        g_FileOffset += g_pFile->write(
+            g_FileOffset, length, reinterpret_cast<uintptr_t>(data), true);
+    }
+    else if (g_pSerial)
+    {
+        for (size_t i = 0; i < length; ++i)
+        {
+            g_pSerial->write(data[i]);
+        }
+    }
+}
 
-    Serial *pSerial = getSerial();
-    if (!pSerial)
+/// Picks an output for the capture, writing the pcap file header to it.
+static bool pcapOpenSink()
+{
+    if (g_pFile || g_pSerial)
     {
         return true;
     }
 
-    // 256K is the max packet we ever want to capture.
-    if (size >= 262144)
+    String path(PCAP_FILE);
+    File *pFile = VFS::instance().find(path);
+    if (!pFile && VFS::instance().createFile(path, 0644))
+    {
+        pFile = VFS::instance().find(path);
+    }
+
+    if (pFile)
+    {
+        pFile->truncate();
+        g_pFile = pFile;
+        g_FileOffset = 0;
+        NOTICE("pcap: capturing to " << path);
+    }
+    else
+    {
+        g_pSerial = getSerial();
+        if (!g_pSerial)
+        {
+            return false;
+        }
+
+        NOTICE("pcap: capturing to serial port");
+    }
+
+    PcapHeader header;
+    header.magic = PCAP_MAGIC;
+    header.major = PCAP_MAJOR;
+    header.minor = PCAP_MINOR;
+    header.tz = 0;
+    header.sigfig = 0;
+    header.caplen = PCAP_SNAPLEN;
+    header.network = PCAP_NETWORK;
+
+    pcapWrite(reinterpret_cast<const uint8_t *>(&header), sizeof(header));
+
+    return true;
+}
+
+/// Copies into the ring at the given position, handling wraparound.
+static void ringCopyIn(PcapRing *pRing, size_t pos, const void *data, size_t n)
+{
+    size_t offset = pos & (PCAP_RING_SIZE - 1);
+    size_t first = min(n, PCAP_RING_SIZE - offset);
+
+    MemoryCopy(pRing->buffer + offset, data, first);
+    if (first < n)
+    {
+        MemoryCopy(
+            pRing->buffer, reinterpret_cast<const uint8_t *>(data) + first,
+            n - first);
+    }
+}
+
+/// Copies out of the ring from the given position, handling wraparound.
+static void ringCopyOut(PcapRing *pRing, size_t pos, uint8_t *out, size_t n)
+{
+    size_t offset = pos & (PCAP_RING_SIZE - 1);
+    size_t first = min(n, PCAP_RING_SIZE - offset);
+
+    MemoryCopy(out, pRing->buffer + offset, first);
+    if (first < n)
     {
-        ERROR("pcap: packet is way too big - size is " << size);
-        return true;  // don't write to the serial port at all.
+        MemoryCopy(out + first, pRing->buffer, n - first);
     }
+}
+
+bool pcapLogPacket(uintptr_t packet, size_t size)
+{
+    if (!g_bCapturing)
+    {
+        return true;
+    }
+
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(packet);
+
+    g_CaptureFilterLock.enter();
+    size_t capLength = g_CaptureFilter.run(data, size, size);
+    g_CaptureFilterLock.leave();
 
-    static uint64_t time = 0;
+    // Filter rejected the packet - don't capture it.
+    if (!capLength)
+    {
+        return true;
+    }
 
-    // Time::Timestamp time = Time::getTimeNanoseconds();
+    if (capLength > size)
+    {
+        capLength = size;
+    }
+    if (capLength > PCAP_SNAPLEN)
+    {
+        capLength = PCAP_SNAPLEN;
+    }
 
-    // Don't care about timing in Wireshark but do care about ordering, and
-    // so we want timestamps to always increase.
-    time += Time::Multiplier::Millisecond;
+    Time::Timestamp now = Time::getTimeNanoseconds();
 
     PcapRecord header;
-    header.ts_sec = time / Time::Multiplier::Second;
+    header.ts_sec = now / Time::Multiplier::Second;
     header.ts_usec =
-        (time % Time::Multiplier::Second) / Time::Multiplier::Microsecond;
-    header.stored_length = size;
+        (now % Time::Multiplier::Second) / Time::Multiplier::Microsecond;
+    header.stored_length = capLength;
     header.orig_length = size;
 
-    // Write the pcap record header.
-    const uint8_t *headerData = reinterpret_cast<const uint8_t *>(&header);
-    for (size_t i = 0; i < sizeof(header); ++i)
+    size_t cpu = Processor::id();
+    if (cpu >= g_nRings)
     {
-        pSerial->write(headerData[i]);
+        cpu = 0;
     }
+    PcapRing *pRing = g_Rings[cpu];
 
-    // Write the packet data now.
-    const uint8_t *data = reinterpret_cast<const uint8_t *>(packet);
-    for (size_t i = 0; i < size; ++i)
+    size_t needed = sizeof(header) + capLength;
+
+    pRing->lock.acquire();
+
+    size_t used = pRing->head - pRing->tail;
+    if ((PCAP_RING_SIZE - used) < needed)
+    {
+        ++pRing->nDropped;
+        pRing->lock.release();
+        return true;
+    }
+
+    ringCopyIn(pRing, pRing->head, &header, sizeof(header));
+    ringCopyIn(pRing, pRing->head + sizeof(header), data, capLength);
+    pRing->head += needed;
+
+    pRing->lock.release();
+
+    // Only wake the drain thread when the ring goes from empty to non-empty;
+    // otherwise it will pick the data up on its current pass.
+    if (!used)
     {
-        pSerial->write(data[i]);
+        g_DrainWakeup.release();
     }
 
     // Always let the packet through.
     return true;
 }
 
+/// Drains every ring to the output, returning the number of bytes written.
+static size_t pcapDrain(uint8_t *staging)
+{
+    size_t total = 0;
+    for (size_t i = 0; i < g_nRings; ++i)
+    {
+        PcapRing *pRing = g_Rings[i];
+
+        pRing->lock.acquire();
+        size_t n = pRing->head - pRing->tail;
+        ringCopyOut(pRing, pRing->tail, staging, n);
+        pRing->tail += n;
+        size_t nDropped = pRing->nDropped;
+        pRing->nDropped = 0;
+        pRing->lock.release();
+
+        if (nDropped)
+        {
+            WARNING(
+                "pcap: CPU" << Dec << i << " ring overflowed, " << nDropped
+                            << " packets were not captured");
+        }
+
+        pcapWrite(staging, n);
+        total += n;
+    }
+
+    return total;
+}
+
+static int pcapDrainThread(void *)
+{
+    uint8_t *staging = new uint8_t[PCAP_RING_SIZE];
+
+    while (g_bCapturing)
+    {
+        g_DrainWakeup.acquire(1, 0, PCAP_FLUSH_INTERVAL_USECS);
+
+        // Hold packets in the rings until there's somewhere to put them.
+        if (!pcapOpenSink())
+        {
+            continue;
+        }
+
+        pcapDrain(staging);
+    }
+
+    // Flush anything captured before we were asked to stop.
+    if (pcapOpenSink())
+    {
+        pcapDrain(staging);
+    }
+
+    delete[] staging;
+
+    return 0;
+}
+
+/** Replaces the capture filter. Returns false if the program is invalid. */
+EXPORTED_PUBLIC bool
+pcapSetFilter(const BpfInstruction *pInstructions, size_t nInstructions)
+{
+    g_CaptureFilterLock.acquire();
+    bool result = g_CaptureFilter.load(pInstructions, nInstructions);
+    g_CaptureFilterLock.release();
+
+    return result;
+}
+
 static bool entry()
 {
-    LockGuard<Mutex> guard(g_PcapMutex);
+    // Default capture filter: everything, up to the snap length.
+    static const BpfInstruction captureAll[] = {
+        BPF_STMT(BPF_RET | BPF_K, PCAP_SNAPLEN),
+    };
+    g_CaptureFilter.load(captureAll, 1);
 
-    Serial *pSerial = getSerial();
-    if (!pSerial)
+    g_nRings = Processor::getCount();
+    g_Rings = new PcapRing *[g_nRings];
+    for (size_t i = 0; i < g_nRings; ++i)
     {
-        NOTICE("pcap: could not find a useful serial port");
-        return false;
+        g_Rings[i] = new PcapRing;
+        g_Rings[i]->buffer = new uint8_t[PCAP_RING_SIZE];
     }
 
+    g_bCapturing = true;
+
+    Process *pParent = Processor::information().getCurrentThread()->getParent();
+    g_pDrainThread = new Thread(pParent, pcapDrainThread, 0);
+
     g_FilterEntry = NetworkFilter::instance().installCallback(1, pcapLogPacket);
     if (g_FilterEntry == static_cast<size_t>(-1))
     {
         NOTICE("pcap: could not install callback");
+        g_bCapturing = false;
+        g_DrainWakeup.release();
+        g_pDrainThread->join();
         return false;
     }
 
-    PcapHeader header;
-    header.magic = PCAP_MAGIC;
-    header.major = PCAP_MAJOR;
-    header.minor = PCAP_MINOR;
-    header.tz = 0;
-    header.sigfig = 0;
-    header.caplen = 0xFFFF;
-    header.network = PCAP_NETWORK;
-
-    const uint8_t *data = reinterpret_cast<const uint8_t *>(&header);
-    for (size_t i = 0; i < sizeof(header); ++i)
-    {
-        pSerial->write(data[i]);
-    }
-
     return true;
 }
 
 static void exit()
 {
     NetworkFilter::instance().removeCallback(1, g_FilterEntry);
+
+    g_bCapturing = false;
+    g_DrainWakeup.release();
+    g_pDrainThread->join();
+    g_pDrainThread = 0;
+
+    for (size_t i = 0; i < g_nRings; ++i)
+    {
+        delete[] g_Rings[i]->buffer;
+        delete g_Rings[i];
+    }
+    delete[] g_Rings;
+    g_Rings = 0;
+    g_nRings = 0;
 }
 
-MODULE_INFO("pcap", &entry, &exit, "network-stack");
+MODULE_INFO("pcap", &entry, &exit, "network-stack", "vfs");
+MODULE_OPTIONAL_DEPENDS("mountroot");
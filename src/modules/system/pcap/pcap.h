@@ -21,3 +21,10 @@
 extern bool pcapLogPacket(uintptr_t packet, size_t size) WEAK;
 extern bool pcapLogPacketFakeHeader(
     uintptr_t packet, size_t size, void *from, void *to) WEAK;
+
+struct BpfInstruction;
+
+// Replaces the capture filter (a BPF program returning the number of bytes of
+// each packet to capture). Returns false if the program is not valid.
+extern bool pcapSetFilter(
+    const BpfInstruction *pInstructions, size_t nInstructions) WEAK;
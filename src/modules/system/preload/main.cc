@@ -18,71 +18,16 @@
  */
 
 #include "modules/Module.h"
-#include "modules/system/vfs/File.h"
-#include "modules/system/vfs/VFS.h"
-#include "pedigree/kernel/Log.h"
-#include "pedigree/kernel/process/Semaphore.h"
-#include "pedigree/kernel/processor/types.h"
-#include "pedigree/kernel/utilities/String.h"
-
-static const char *g_FilesToPreload[] = {
-    "root»/applications/init",        "root»/applications/ttyterm",
-    "root»/applications/winman",      "root»/applications/tui",
-    "root»/applications/TUI",         "root»/applications/login",
-    "root»/libraries/libload.so",     "root»/libraries/libc.so",
-    "root»/libraries/libm.so",        "root»/libraries/libstdc++.so",
-    "root»/libraries/libpedigree.so", "root»/libraries/libpedigree-c.so",
-    "root»/libraries/libpthread.so",  0};
-
-static Semaphore g_Preloads(0);
-
-static int preloadThread(void *p)
-{
-    const char *s = reinterpret_cast<const char *>(p);
-
-    NOTICE("PRELOAD: " << s);
-
-    File *pFile = VFS::instance().find(String(s));
-    if (pFile)
-    {
-        NOTICE("PRELOAD: preloading " << s << "...");
-        size_t sz = 0;
-        while (sz < pFile->getSize())
-        {
-            pFile->read(sz, 0x1000, 0);
-            sz += 0x1000;
-        }
-    }
-
-    NOTICE("PRELOAD: preload " << s << " has completed.");
-    g_Preloads.release();
-
-    return 0;
-}
+#include "modules/system/vfs/Prefetcher.h"
 
 static bool init()
 {
-    /// \todo figure out why this causes numerous problems with ext2
-    return false;
-    /*
-        size_t n = 0;
-        const char *s = g_FilesToPreload[n++];
-        do
-        {
-            NOTICE("PRELOAD: Queue " << s);
-            Thread *pThread = new Thread(
-                Processor::information().getCurrentThread()->getParent(),
-                preloadThread, const_cast<char *>(s));
-            pThread->detach();
-            s = g_FilesToPreload[n++];
-        } while (s);
-
-        g_Preloads.acquire(n - 1);
-        NOTICE("PRELOAD: preloaded " << n << " files.");
+    // Replays the previous boot's trace and records this boot's. Programs
+    // starting up are traced by the POSIX subsystem from exec.
+    Prefetcher::instance().initialise();
+    Prefetcher::instance().startBoot();
 
-        // Trick: return false, which unloads this module (its purpose is
-       complete.) return false;
-    */
+    return true;
 }
 
 static void destroy()
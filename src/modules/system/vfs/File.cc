@@ -19,8 +19,10 @@
 
 #include "File.h"
 #include "Filesystem.h"
+#include "PageCache.h"
 #include "pedigree/kernel/LockGuard.h"
 #include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/machine/Disk.h"
 #include "pedigree/kernel/process/Scheduler.h"
 #include "pedigree/kernel/process/Thread.h"
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
@@ -34,6 +36,10 @@
 #include "pedigree/kernel/utilities/assert.h"
 #include "pedigree/kernel/utilities/utility.h"
 
+#ifndef VFS_STANDALONE
+#include "Prefetcher.h"
+#endif
+
 void File::writeCallback(
     CacheConstants::CallbackCause cause, uintptr_t loc, uintptr_t page,
     void *meta)
@@ -69,11 +75,7 @@ File::File()
     : m_Name(), m_AccessedTime(0), m_ModifiedTime(0), m_CreationTime(0),
       m_Inode(0), m_pFilesystem(0), m_Size(0), m_pParent(0), m_nWriters(0),
       m_nReaders(0), m_Uid(0), m_Gid(0), m_Permissions(0),
-      m_DataCache(FILE_BAD_BLOCK), m_bDirect(false)
-#ifndef VFS_NOMMU
-      ,
-      m_FillCache()
-#endif
+      m_DataCache(FILE_BAD_BLOCK), m_bDirect(false), m_PageCacheId(0)
 #ifdef THREADS
       ,
       m_Lock(), m_MonitorTargets()
@@ -88,11 +90,8 @@ File::File(
     : m_Name(name), m_AccessedTime(accessedTime), m_ModifiedTime(modifiedTime),
       m_CreationTime(creationTime), m_Inode(inode), m_pFilesystem(pFs),
       m_Size(size), m_pParent(pParent), m_nWriters(0), m_nReaders(0), m_Uid(0),
-      m_Gid(0), m_Permissions(0), m_DataCache(FILE_BAD_BLOCK), m_bDirect(false)
-#ifndef VFS_NOMMU
-      ,
-      m_FillCache()
-#endif
+      m_Gid(0), m_Permissions(0), m_DataCache(FILE_BAD_BLOCK), m_bDirect(false),
+      m_PageCacheId(0)
 #ifdef THREADS
       ,
       m_Lock(), m_MonitorTargets()
@@ -110,6 +109,10 @@ File::File(
 
 File::~File()
 {
+    if (m_PageCacheId)
+    {
+        PageCache::instance().unregisterFile(m_PageCacheId);
+    }
 }
 
 uint64_t
@@ -139,8 +142,16 @@ File::read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
         }
     }
 
+    const bool bPageCache = usePageCache();
     const size_t blockSize =
-        useFillCache() ? PhysicalMemoryManager::getPageSize() : getBlockSize();
+        bPageCache ? PhysicalMemoryManager::getPageSize() : getBlockSize();
+
+    // Reads of more than a page get their disk I/O started up front, in as
+    // few requests as the layout on disk allows.
+    if (bPageCache && hasBlockMap() && size > blockSize)
+    {
+        prefetchRuns(location, size);
+    }
 
     size_t n = 0;
     while (size)
@@ -156,7 +167,8 @@ File::read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
         if (sz > (m_Size - location))
             sz = m_Size - location;
 
-        uintptr_t buff = readIntoCache(block);
+        uintptr_t buff = bPageCache ? readIntoPageCache(block * blockSize)
+                                    : readIntoCache(block);
         if (buff == FILE_BAD_BLOCK)
         {
             ERROR(
@@ -172,6 +184,11 @@ File::read(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
             buffer += sz;
         }
 
+        if (bPageCache)
+        {
+            PageCache::instance().putPage(getPageCacheId(), block * blockSize);
+        }
+
         location += sz;
         size -= sz;
         n += sz;
@@ -189,16 +206,9 @@ File::write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
         return writeBytewise(location, size, buffer, bCanBlock);
     }
 
-    const size_t blockSize = getBlockSize();
-
-    bool isEntireBlock = false;
-    if ((location % blockSize) == 0)
-    {
-        if ((size % blockSize) == 0)
-        {
-            isEntireBlock = true;
-        }
-    }
+    const bool bPageCache = usePageCache();
+    const size_t blockSize =
+        bPageCache ? PhysicalMemoryManager::getPageSize() : getBlockSize();
 
     // Extend the file before writing it if needed.
     extend(location + size, location, size);
@@ -210,7 +220,12 @@ File::write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
         uintptr_t offs = location % blockSize;
         uintptr_t sz = (size + offs > blockSize) ? blockSize - offs : size;
 
-        uintptr_t buff = readIntoCache(block);
+        // No need to read in a page that is about to be entirely overwritten.
+        bool isEntireBlock = (offs == 0) && (sz == blockSize);
+
+        uintptr_t buff = bPageCache
+                             ? readIntoPageCache(block * blockSize, !isEntireBlock)
+                             : readIntoCache(block);
         if (buff == FILE_BAD_BLOCK)
         {
             ERROR(
@@ -223,7 +238,17 @@ File::write(uint64_t location, uint64_t size, uintptr_t buffer, bool bCanBlock)
             reinterpret_cast<void *>(buffer), sz);
 
         // Trigger an immediate write-back - write-through cache.
-        writeBlock(block * blockSize, buff);
+        if (bPageCache)
+        {
+            size_t id = getPageCacheId();
+            flushPage(block * blockSize, buff, offs, sz, true);
+            PageCache::instance().pageWritten(id, block * blockSize);
+            PageCache::instance().putPage(id, block * blockSize);
+        }
+        else
+        {
+            writeBlock(block * blockSize, buff);
+        }
 
         location += sz;
         buffer += sz;
@@ -250,10 +275,9 @@ physical_uintptr_t File::getPhysicalPage(size_t offset)
 #ifndef VFS_NOMMU
     // Sanitise input.
     size_t blockSize = getBlockSize();
-    size_t nativeBlockSize = PhysicalMemoryManager::getPageSize();
-    if (useFillCache())
+    if (usePageCache())
     {
-        blockSize = nativeBlockSize;
+        blockSize = PhysicalMemoryManager::getPageSize();
     }
     offset &= ~(blockSize - 1);
 
@@ -263,28 +287,28 @@ physical_uintptr_t File::getPhysicalPage(size_t offset)
         return ~0UL;
     }
 
-    // Check if we have this page in the cache.
+    // Check if we have this page in the cache. Page cache lookups pin the
+    // page for us.
     uintptr_t vaddr = FILE_BAD_BLOCK;
-    if (LIKELY(!useFillCache()))
-    {
-        // Not using fill cache, this is the easy and common case.
-        vaddr = getCachedPage(offset / blockSize);
-    }
-    else
+    if (usePageCache())
     {
-        // Using the fill cache, because the filesystem has a block size
-        // smaller than our native page size.
-        vaddr = m_FillCache.lookup(offset);
+        vaddr = PageCache::instance().lookup(getPageCacheId(), offset);
         if (!vaddr)
         {
             // Wasn't there. No physical page.
-            vaddr = FILE_BAD_BLOCK;
+            return ~0UL;
         }
     }
-
-    if ((!vaddr) || (vaddr == FILE_BAD_BLOCK))
+    else
     {
-        return ~0UL;
+        vaddr = getCachedPage(offset / blockSize);
+        if ((!vaddr) || (vaddr == FILE_BAD_BLOCK))
+        {
+            return ~0UL;
+        }
+
+        // Pin this key in the cache down, so we don't lose it.
+        pinBlock(offset);
     }
 
     // Look up the page now that we've confirmed it is in the cache.
@@ -294,19 +318,10 @@ physical_uintptr_t File::getPhysicalPage(size_t offset)
         physical_uintptr_t phys = 0;
         size_t flags = 0;
         va.getMapping(reinterpret_cast<void *>(vaddr), phys, flags);
-
-        // Pin this key in the cache down, so we don't lose it.
-        if (UNLIKELY(useFillCache()))
-        {
-            m_FillCache.pin(offset);
-        }
-        else
-        {
-            pinBlock(offset);
-        }
-
         return phys;
     }
+
+    returnPhysicalPage(offset);
 #endif  // VFS_NOMMU
 
     return ~0UL;
@@ -322,10 +337,9 @@ void File::returnPhysicalPage(size_t offset)
 #ifndef VFS_NOMMU
     // Sanitise input.
     size_t blockSize = getBlockSize();
-    size_t nativeBlockSize = PhysicalMemoryManager::getPageSize();
-    if (useFillCache())
+    if (usePageCache())
     {
-        blockSize = nativeBlockSize;
+        blockSize = PhysicalMemoryManager::getPageSize();
     }
     offset &= ~(blockSize - 1);
 
@@ -337,9 +351,9 @@ void File::returnPhysicalPage(size_t offset)
 
     // Release the page. Beware - this could cause a cache evict, which will
     // make the next read/write at this offset do real (slow) I/O.
-    if (UNLIKELY(useFillCache()))
+    if (usePageCache())
     {
-        m_FillCache.release(offset);
+        PageCache::instance().putPage(getPageCacheId(), offset);
     }
     else
     {
@@ -350,6 +364,17 @@ void File::returnPhysicalPage(size_t offset)
 
 void File::sync()
 {
+    if (usePageCache())
+    {
+        const size_t pageSize = PhysicalMemoryManager::getPageSize();
+        for (size_t offset = 0; offset < m_Size; offset += pageSize)
+        {
+            sync(offset, false);
+        }
+
+        return;
+    }
+
 #ifdef THREADS
     LockGuard<Mutex> guard(m_Lock);
 #endif
@@ -373,6 +398,23 @@ void File::sync()
 
 void File::sync(size_t offset, bool async)
 {
+    if (!(usePageCache() && m_PageCacheId))
+    {
+        return;
+    }
+
+    const size_t pageSize = PhysicalMemoryManager::getPageSize();
+    offset &= ~(pageSize - 1);
+
+    uintptr_t page = PageCache::instance().lookup(m_PageCacheId, offset);
+    if (!page)
+    {
+        return;
+    }
+
+    flushPage(offset, page, 0, pageSize, async);
+    PageCache::instance().pageWritten(m_PageCacheId, offset);
+    PageCache::instance().putPage(m_PageCacheId, offset);
 }
 
 Time::Timestamp File::getCreationTime()
@@ -599,6 +641,42 @@ uint64_t File::writeBytewise(
     return 0;
 }
 
+bool File::hasBlockMap() const
+{
+    return false;
+}
+
+bool File::mapBlock(uint64_t location, uint64_t &diskOffset)
+{
+    return false;
+}
+
+bool File::mapExtent(uint64_t location, uint64_t &diskOffset, size_t &length)
+{
+    if (!mapBlock(location, diskOffset))
+    {
+        return false;
+    }
+
+    length = getBlockSize() - (location % getBlockSize());
+    return true;
+}
+
+void File::invalidatePages()
+{
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_Lock);
+#endif
+
+    // Drop the pages cached under the old ID; a new one is allocated the
+    // next time a page is needed.
+    if (m_PageCacheId)
+    {
+        PageCache::instance().unregisterFile(m_PageCacheId);
+        m_PageCacheId = 0;
+    }
+}
+
 uintptr_t File::readBlock(uint64_t location)
 {
     ERROR("File: base class readBlock() called for " << getFullPath());
@@ -801,66 +879,89 @@ void File::setCachedPage(size_t block, uintptr_t value, bool locked)
     }
 }
 
-bool File::useFillCache() const
+bool File::usePageCache() const
 {
 #ifdef VFS_NOMMU
-    // No fill cache in NOMMU builds.
+    // No page cache in NOMMU builds.
     return false;
 #else
-    size_t blockSize = getBlockSize();
-    size_t nativeBlockSize = PhysicalMemoryManager::getPageSize();
-    return blockSize < nativeBlockSize;
+    if (m_bDirect)
+    {
+        return false;
+    }
+
+    if (hasBlockMap())
+    {
+        return true;
+    }
+
+    // Blocks smaller than a page have to be gathered into whole pages to be
+    // mapped into memory.
+    return getBlockSize() < PhysicalMemoryManager::getPageSize();
 #endif
 }
 
-uintptr_t File::readIntoCache(uintptr_t block)
+size_t File::getPageCacheId()
 {
-    size_t blockSize = getBlockSize();
-    size_t nativeBlockSize = PhysicalMemoryManager::getPageSize();
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_Lock);
+#endif
 
-    size_t offset = block * blockSize;
-    size_t mask = blockSize - 1;
-    if (useFillCache())
+    if (!m_PageCacheId)
     {
-        mask = nativeBlockSize - 1;
+        m_PageCacheId = PageCache::instance().registerFile(this);
     }
 
-    size_t blockOffset = offset & mask;
-    offset &= ~mask;
+    return m_PageCacheId;
+}
 
-#ifndef VFS_NOMMU
-    if (useFillCache())
+bool File::prefetchLocation(uint64_t offset, uint64_t &diskOffset)
+{
+    diskOffset = 0;
+    if (!usePageCache() || offset >= m_Size)
     {
-        // Using Cache::insert() here is atomic compared to if we did a
-        // lookup() followed by an insert() - means we don't need to lock the
-        // File object to do this.
-        bool didExist = false;
-        uintptr_t vaddr =
-            m_FillCache.insert(offset, nativeBlockSize, &didExist);
+        return false;
+    }
 
-        // If in direct mode we are required to read() again
-        if (didExist && !m_bDirect)
-        {
-            // Already in cache - don't re-read the file.
-            return vaddr;
-        }
+    size_t id = getPageCacheId();
 
-        // Read the blocks
-        for (size_t i = 0; i < nativeBlockSize; i += blockSize)
-        {
-            uintptr_t blockAddr = readBlock(offset + i);
-            /// \todo handle readBlock failing here
-            ForwardMemoryCopy(
-                reinterpret_cast<void *>(vaddr),
-                reinterpret_cast<void *>(blockAddr), blockSize);
-        }
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_Lock);
+#endif
 
-        m_FillCache.markNoLongerEditing(offset, nativeBlockSize);
+    if (PageCache::instance().lookup(id, offset))
+    {
+        PageCache::instance().putPage(id, offset);
+        return false;
+    }
 
-        NOTICE("readIntoCache: fillcache blockOffset=" << blockOffset);
-        return vaddr + blockOffset;
+    if (hasBlockMap() && !mapBlock(offset, diskOffset))
+    {
+        diskOffset = 0;
     }
-#endif
+
+    return true;
+}
+
+bool File::prefetchPage(uint64_t offset)
+{
+    if (!usePageCache() || offset >= m_Size)
+    {
+        return false;
+    }
+
+    if (readIntoPageCache(offset) == FILE_BAD_BLOCK)
+    {
+        return false;
+    }
+
+    PageCache::instance().putPage(getPageCacheId(), offset);
+    return true;
+}
+
+uintptr_t File::readIntoCache(uintptr_t block)
+{
+    size_t blockSize = getBlockSize();
 
     uintptr_t buff = FILE_BAD_BLOCK;
     if (!m_bDirect)
@@ -885,5 +986,210 @@ uintptr_t File::readIntoCache(uintptr_t block)
         }
     }
 
-    return buff + blockOffset;
+    return buff;
+}
+
+uintptr_t File::readIntoPageCache(uint64_t offset, bool bFill)
+{
+    size_t id = getPageCacheId();
+
+#ifndef VFS_STANDALONE
+    if (bFill)
+    {
+        Prefetcher::instance().recordAccess(this, offset);
+    }
+#endif
+
+    // Only one thread may fill this File's pages at a time, so that nobody
+    // sees a page before it has been filled.
+#ifdef THREADS
+    LockGuard<Mutex> guard(m_Lock);
+#endif
+
+    uintptr_t page = PageCache::instance().getPage(this, id, offset, bFill);
+    if (!page)
+    {
+        return FILE_BAD_BLOCK;
+    }
+
+    return page;
+}
+
+void File::prefetchRuns(uint64_t location, uint64_t size)
+{
+    const size_t pageSize = PhysicalMemoryManager::getPageSize();
+    Disk *pDisk = m_pFilesystem ? m_pFilesystem->getDisk() : 0;
+    if (!pDisk)
+    {
+        return;
+    }
+
+    size_t id = getPageCacheId();
+    uint64_t offset = location & ~static_cast<uint64_t>(pageSize - 1);
+    uint64_t end = min(location + size, static_cast<uint64_t>(m_Size));
+    while (offset < end)
+    {
+        if (PageCache::instance().lookup(id, offset))
+        {
+            PageCache::instance().putPage(id, offset);
+            offset += pageSize;
+            continue;
+        }
+
+        // Find the end of this stretch of uncached pages.
+        uint64_t runEnd = offset + pageSize;
+        while (runEnd < end)
+        {
+            if (PageCache::instance().lookup(id, runEnd))
+            {
+                PageCache::instance().putPage(id, runEnd);
+                break;
+            }
+            runEnd += pageSize;
+        }
+        runEnd = min(runEnd, end);
+
+        while (offset < runEnd)
+        {
+            uint64_t diskOffset = 0;
+            size_t length = 0;
+            bool bMapped = false;
+            {
+#ifdef THREADS
+                LockGuard<Mutex> guard(m_Lock);
+#endif
+                bMapped = mapExtent(offset, diskOffset, length);
+            }
+
+            if (!bMapped || !length)
+            {
+                return;
+            }
+
+            length = min(static_cast<uint64_t>(length), runEnd - offset);
+            if (diskOffset)
+            {
+                pDisk->prefetch(diskOffset, length);
+            }
+
+            offset += length;
+        }
+
+        // Start the next stretch on a page boundary.
+        offset = (offset + pageSize - 1) & ~static_cast<uint64_t>(pageSize - 1);
+    }
+}
+
+void File::fillPage(uint64_t offset, uintptr_t page)
+{
+    const size_t pageSize = PhysicalMemoryManager::getPageSize();
+    const size_t unit = min(getBlockSize(), pageSize);
+    Disk *pDisk = m_pFilesystem ? m_pFilesystem->getDisk() : 0;
+
+    for (size_t pos = 0; pos < pageSize; pos += unit)
+    {
+        uint64_t location = offset + pos;
+        void *dest = reinterpret_cast<void *>(page + pos);
+
+        // Anything past the end of the file reads as zeroes.
+        if (location >= m_Size)
+        {
+            ByteSet(dest, 0, pageSize - pos);
+            break;
+        }
+
+        uintptr_t buffer = 0;
+        uint64_t diskOffset = 0;
+        if (hasBlockMap())
+        {
+            if (!mapBlock(location, diskOffset))
+            {
+                ERROR(
+                    "File::fillPage - couldn't map " << location << " in "
+                                                     << getFullPath());
+            }
+            else if (diskOffset && pDisk)
+            {
+                buffer = pDisk->read(diskOffset);
+            }
+        }
+        else
+        {
+            buffer = readBlock(location);
+        }
+
+        if (!buffer)
+        {
+            // A hole, or a failed read.
+            ByteSet(dest, 0, unit);
+            continue;
+        }
+
+        ForwardMemoryCopy(dest, reinterpret_cast<void *>(buffer), unit);
+
+        // The page cache has the data now, so the disk's cache doesn't need
+        // to hold on to it.
+        if (diskOffset)
+        {
+            pDisk->unpin(diskOffset);
+        }
+    }
+}
+
+void File::flushPage(
+    uint64_t offset, uintptr_t page, size_t start, size_t length, bool async)
+{
+    const size_t unit = min(getBlockSize(), PhysicalMemoryManager::getPageSize());
+    Disk *pDisk = m_pFilesystem ? m_pFilesystem->getDisk() : 0;
+
+    size_t end = start + length;
+    for (size_t pos = start & ~(unit - 1); pos < end; pos += unit)
+    {
+        uint64_t location = offset + pos;
+        if (location >= m_Size)
+        {
+            break;
+        }
+
+        void *src = reinterpret_cast<void *>(page + pos);
+
+        if (!hasBlockMap())
+        {
+            uintptr_t buffer = readBlock(location);
+            if (buffer)
+            {
+                ForwardMemoryCopy(reinterpret_cast<void *>(buffer), src, unit);
+                writeBlock(location, buffer);
+            }
+            continue;
+        }
+
+        uint64_t diskOffset = 0;
+        if (!mapBlock(location, diskOffset) || !diskOffset || !pDisk)
+        {
+            WARNING(
+                "File::flushPage - no block to write " << location << " of "
+                                                       << getFullPath()
+                                                       << " back to");
+            continue;
+        }
+
+        uintptr_t buffer = pDisk->read(diskOffset);
+        if (!buffer)
+        {
+            ERROR("File::flushPage - disk read failed at " << diskOffset);
+            continue;
+        }
+
+        ForwardMemoryCopy(reinterpret_cast<void *>(buffer), src, unit);
+        if (async)
+        {
+            pDisk->write(diskOffset);
+        }
+        else
+        {
+            pDisk->flush(diskOffset);
+        }
+        pDisk->unpin(diskOffset);
+    }
 }
@@ -66,6 +66,7 @@ class Thread;
 class EXPORTED_PUBLIC File
 {
     friend class Filesystem;
+    friend class PageCache;
 
   public:
     /** Constructor, creates an invalid file. */
@@ -123,6 +124,10 @@ class EXPORTED_PUBLIC File
 
     /**
      * Trigger a sync of an inner cache back to disk.
+     *
+     * The default implementation writes back the page cache page at offset,
+     * if there is one. Overrides should call it before syncing their own
+     * caches.
      */
     virtual void sync(size_t offset, bool async);
 
@@ -176,6 +181,20 @@ class EXPORTED_PUBLIC File
     Filesystem *getFilesystem() const;
     void setFilesystem(Filesystem *pFs);
 
+    /**
+     * For prefetching: check whether the page at offset still needs reading
+     * into the page cache, and if so, find where it starts on the disk.
+     *
+     * \param diskOffset set to the page's first byte on the filesystem's
+     *        disk, or to zero if that isn't known.
+     * \return false if there's nothing to read: the page is already cached,
+     *         or this File doesn't keep its data in the page cache.
+     */
+    bool prefetchLocation(uint64_t offset, uint64_t &diskOffset);
+
+    /** Read the page at offset into the page cache, for prefetching. */
+    bool prefetchPage(uint64_t offset);
+
     virtual void fileAttributeChanged();
 
     virtual void increaseRefCount(bool bIsWriter);
@@ -260,6 +279,37 @@ class EXPORTED_PUBLIC File
      */
     virtual void writeBlock(uint64_t location, uintptr_t addr);
 
+    /**
+     * Whether this File's data is stored in blocks on its filesystem's disk,
+     * which mapBlock() can locate. Such files keep their data in the page
+     * cache rather than in the disk's cache.
+     */
+    virtual bool hasBlockMap() const;
+
+    /**
+     * Block-mapping callback for the page cache: find where on the
+     * filesystem's disk the byte at location is stored.
+     *
+     * \param diskOffset set to the byte offset on the disk, or to zero for a
+     *        hole in the file, which reads as zeroes.
+     * \return false if location couldn't be mapped.
+     */
+    virtual bool mapBlock(uint64_t location, uint64_t &diskOffset);
+
+    /**
+     * As mapBlock(), but also finds how many bytes from location onwards are
+     * contiguous on the disk (or are all a hole), so that they can be read in
+     * one go. The default implementation maps a single block.
+     */
+    virtual bool
+    mapExtent(uint64_t location, uint64_t &diskOffset, size_t &length);
+
+    /**
+     * Drop this File's pages from the page cache, for example once its
+     * blocks have been released by a truncate.
+     */
+    void invalidatePages();
+
     /** Internal function to extend a file to be at least the given size. */
     virtual void extend(size_t newSize);
 
@@ -367,17 +417,11 @@ class EXPORTED_PUBLIC File
 
     bool m_bDirect;
 
-#ifndef VFS_NOMMU
     /**
-     * This cache is necessary to handle filesystems with block sizes that are
-     * smaller than the native page size. For these filesystems, to perform
-     * memory maps we read native page size blocks into this cache, and then
-     * return pages from it directly. This is expected to somewhat increase
-     * memory usage and reduce performance on non-natively-sized block sizes,
-     * but that's an acceptable compromise.
+     * ID of this File's pages in the page cache, or zero if it has none yet.
+     * Allocated on first use, as most Files never use the page cache.
      */
-    Cache m_FillCache;
-#endif
+    size_t m_PageCacheId;
 
 #ifdef THREADS
     Mutex m_Lock;
@@ -401,12 +445,42 @@ class EXPORTED_PUBLIC File
     /** Set a page in our cache. */
     void setCachedPage(size_t block, uintptr_t value, bool locked = true);
 
-    /** Indicate whether the 'fill cache' is needed to handle sub-page block
-     * sizes. */
-    bool useFillCache() const;
+    /**
+     * Indicate whether data goes through the page cache: for files with a
+     * block map, and to give files with sub-page block sizes whole pages.
+     */
+    bool usePageCache() const;
+
+    /** Get (allocating if needed) this File's page cache ID. */
+    size_t getPageCacheId();
 
     /** Read the given block into the relevant cache. */
     uintptr_t readIntoCache(uintptr_t block);
+
+    /**
+     * Get the page cache page at offset, pinned, filling it unless bFill is
+     * false. Returns FILE_BAD_BLOCK on failure.
+     */
+    uintptr_t readIntoPageCache(uint64_t offset, bool bFill = true);
+
+    /**
+     * Ask the disk to start reading the parts of [location, location + size)
+     * that aren't in the page cache, with one request per contiguous run of
+     * blocks rather than one per block.
+     */
+    void prefetchRuns(uint64_t location, uint64_t size);
+
+    /** Page cache callback: read the page at offset into page. */
+    void fillPage(uint64_t offset, uintptr_t page);
+
+    /**
+     * Write length bytes from start in the page cache page at offset back to
+     * the filesystem. Disk writebacks are scheduled if async is set, and
+     * carried out straight away otherwise.
+     */
+    void flushPage(
+        uint64_t offset, uintptr_t page, size_t start, size_t length,
+        bool async);
 };
 
 #endif
@@ -26,21 +26,52 @@
 #include "pedigree/kernel/process/Process.h"
 #include "pedigree/kernel/process/Thread.h"
 #include "pedigree/kernel/process/Uninterruptible.h"
+#include "pedigree/kernel/processor/MemoryRegion.h"
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/Processor.h"
 #include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/processor/TlbShootdown.h"
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
+#include "pedigree/kernel/time/Time.h"
 #include "pedigree/kernel/utilities/Iterator.h"
 #include "pedigree/kernel/utilities/MemoryAllocator.h"
 #include "pedigree/kernel/utilities/assert.h"
 #include "pedigree/kernel/utilities/utility.h"
 
+/** Most memory the anonymous swap store may use, in pages. */
+#define ANON_SWAP_MAX_PAGES 16384
+
+/** Most pages swapped out by one MemoryMapManager::swapOut(). */
+#define ANON_SWAP_BATCH 32
+
 MemoryMapManager MemoryMapManager::m_Instance;
 
 physical_uintptr_t AnonymousMemoryMap::m_Zero = 0;
+Atomic<size_t> AnonymousMemoryMap::m_HugePageFaults(0);
+Atomic<size_t> AnonymousMemoryMap::m_HugePageFallbacks(0);
+
+CompressedPageStore AnonymousMemoryMap::m_SwapStore(ANON_SWAP_MAX_PAGES);
+Atomic<size_t> AnonymousMemoryMap::m_SwapOuts(0);
+Atomic<size_t> AnonymousMemoryMap::m_SwapIns(0);
+Atomic<size_t> AnonymousMemoryMap::m_SwapInTime(0);
 
 // #define DEBUG_MMOBJECTS
 
+/**
+ * Map nPages of physical memory from phys into the kernel alone, so that they
+ * can be filled in before anything else can see them. Mapping them as non-RAM
+ * keeps freeing the region from freeing the pages.
+ */
+static bool
+mapForKernel(MemoryRegion &region, physical_uintptr_t phys, size_t nPages)
+{
+    return PhysicalMemoryManager::instance().allocateRegion(
+        region, nPages,
+        PhysicalMemoryManager::continuous | PhysicalMemoryManager::nonRamMemory |
+            PhysicalMemoryManager::force | PhysicalMemoryManager::anonymous,
+        VirtualAddressSpace::KernelMode | VirtualAddressSpace::Write, phys);
+}
+
 MemoryMappedObject::~MemoryMappedObject()
 {
 }
@@ -48,24 +79,14 @@ MemoryMappedObject::~MemoryMappedObject()
 AnonymousMemoryMap::AnonymousMemoryMap(
     uintptr_t address, size_t length, MemoryMappedObject::Permissions perms)
     : MemoryMappedObject(address, true, length, perms), m_Mappings(),
-      m_Lock(false)
+      m_HugeMappings(), m_HugePages(TransparentHugePages), m_Lock(false)
 {
     LockGuard<Spinlock> guard(m_Lock);
 
     if (m_Zero == 0)
     {
-        m_Zero = PhysicalMemoryManager::instance().allocatePage();
+        m_Zero = PhysicalMemoryManager::instance().allocateZeroedPage();
         PhysicalMemoryManager::instance().pin(m_Zero);
-
-        VirtualAddressSpace &va =
-            Processor::information().getVirtualAddressSpace();
-        va.map(
-            m_Zero, reinterpret_cast<void *>(address),
-            VirtualAddressSpace::Write);
-        ByteSet(
-            reinterpret_cast<void *>(address), 0,
-            PhysicalMemoryManager::getPageSize());
-        va.unmap(reinterpret_cast<void *>(address));
     }
 }
 
@@ -76,6 +97,24 @@ MemoryMappedObject *AnonymousMemoryMap::clone()
     AnonymousMemoryMap *pResult =
         new AnonymousMemoryMap(m_Address, m_Length, m_Permissions);
     pResult->m_Mappings = m_Mappings;
+    pResult->m_HugeMappings = m_HugeMappings;
+    pResult->m_HugePages = m_HugePages;
+
+    // The address space clone copies swap entries, so both copies of a
+    // swapped out page refer to it in the swap store.
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    for (List<void *>::Iterator it = m_Mappings.begin(); it != m_Mappings.end();
+         ++it)
+    {
+        if (va.isSwapped(*it))
+        {
+            size_t flags;
+            physical_uintptr_t entry;
+            va.getMapping(*it, entry, flags);
+            m_SwapStore.share(entry / PhysicalMemoryManager::getPageSize());
+        }
+    }
+
     return pResult;
 }
 
@@ -105,6 +144,28 @@ MemoryMappedObject *AnonymousMemoryMap::split(uintptr_t at)
     // New object.
     AnonymousMemoryMap *pResult =
         new AnonymousMemoryMap(at, oldLength - m_Length, m_Permissions);
+    pResult->m_HugePages = m_HugePages;
+
+    // Huge pages move across whole, unless the split goes through one.
+    size_t hugePageSz =
+        Processor::information().getVirtualAddressSpace().getHugePageSize();
+    for (List<void *>::Iterator it = m_HugeMappings.begin();
+         it != m_HugeMappings.end();)
+    {
+        uintptr_t v = reinterpret_cast<uintptr_t>(*it);
+        if (v >= at)
+        {
+            pResult->m_HugeMappings.pushBack(*it);
+            it = m_HugeMappings.erase(it);
+        }
+        else if ((v + hugePageSz) > at)
+        {
+            demoteHugePage(*it, at, pResult);
+            it = m_HugeMappings.erase(it);
+        }
+        else
+            ++it;
+    }
 
     // Fix up mapping metadata.
     for (List<void *>::Iterator it = m_Mappings.begin();
@@ -145,13 +206,38 @@ bool AnonymousMemoryMap::remove(size_t length)
     m_Address += length;
     m_Length -= length;
 
+    // Remove huge pages in this range, splitting one that crosses the new
+    // base so the rest of it stays mapped.
+    size_t hugePageSz = va.getHugePageSize();
+    for (List<void *>::Iterator it = m_HugeMappings.begin();
+         it != m_HugeMappings.end();)
+    {
+        uintptr_t v = reinterpret_cast<uintptr_t>(*it);
+        if ((v + hugePageSz) <= m_Address)
+        {
+            releaseHugePage(*it);
+            it = m_HugeMappings.erase(it);
+        }
+        else if (v < m_Address)
+        {
+            demoteHugePage(*it, m_Address, this);
+            it = m_HugeMappings.erase(it);
+        }
+        else
+            ++it;
+    }
+
     // Remove any existing mappings in this range.
+    TlbShootdown shootdown(va);
     for (List<void *>::Iterator it = m_Mappings.begin();
          it != m_Mappings.end();)
     {
         uintptr_t virt = reinterpret_cast<uintptr_t>(*it);
         if (virt >= m_Address)
-            break;
+        {
+            ++it;
+            continue;
+        }
 
         void *v = *it;
         if (va.isMapped(v))
@@ -161,8 +247,12 @@ bool AnonymousMemoryMap::remove(size_t length)
 
             va.getMapping(v, phys, flags);
 
-            va.unmap(v);
-            PhysicalMemoryManager::instance().freePage(phys);
+            va.unmapBatched(v, shootdown);
+            shootdown.free(phys);
+        }
+        else
+        {
+            dropSwapEntry(v);
         }
 
         it = m_Mappings.erase(it);
@@ -186,36 +276,26 @@ void AnonymousMemoryMap::setPermissions(MemoryMappedObject::Permissions perms)
         // Adjust any existing mappings in this object.
         for (List<void *>::Iterator it = m_Mappings.begin();
              it != m_Mappings.end(); ++it)
+        {
+            setPagePermissions(*it, perms);
+        }
+
+        // Huge pages take the new flags in one go, unless they have been split.
+        size_t pageSz = PhysicalMemoryManager::getPageSize();
+        size_t hugePageSz = va.getHugePageSize();
+        for (List<void *>::Iterator it = m_HugeMappings.begin();
+             it != m_HugeMappings.end(); ++it)
         {
             void *v = *it;
-            if (va.isMapped(v))
+            if (va.isHugePage(v))
             {
-                physical_uintptr_t p;
-                size_t f;
-                va.getMapping(v, p, f);
-
-                // Shared pages will have write/exec added to them when written
-                // to.
-                if (!(f & VirtualAddressSpace::Shared))
-                {
-                    // Make sure we remove permissions as well as add them.
-                    if (perms & MemoryMappedObject::Write)
-                        f |= VirtualAddressSpace::Write;
-                    else
-                        f &= ~VirtualAddressSpace::Write;
-
-                    if (perms & MemoryMappedObject::Exec)
-                        f |= VirtualAddressSpace::Execute;
-                    else
-                        f &= ~VirtualAddressSpace::Execute;
+                setPagePermissions(v, perms);
+                continue;
+            }
 
-                    va.setFlags(v, f);
-                }
-                else if (perms & MemoryMappedObject::Exec)
-                {
-                    // We can however still make these pages executable.
-                    va.setFlags(v, f | VirtualAddressSpace::Execute);
-                }
+            for (size_t off = 0; off < hugePageSz; off += pageSz)
+            {
+                setPagePermissions(adjust_pointer(v, off), perms);
             }
         }
     }
@@ -223,6 +303,45 @@ void AnonymousMemoryMap::setPermissions(MemoryMappedObject::Permissions perms)
     m_Permissions = perms;
 }
 
+void AnonymousMemoryMap::setPagePermissions(
+    void *v, MemoryMappedObject::Permissions perms)
+{
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+
+    // Swap entries take the new permissions too, for when they're swapped in.
+    if (!va.isMapped(v) && !va.isSwapped(v))
+    {
+        return;
+    }
+
+    physical_uintptr_t p;
+    size_t f;
+    va.getMapping(v, p, f);
+
+    // Shared pages will have write/exec added to them when written
+    // to.
+    if (!(f & VirtualAddressSpace::Shared))
+    {
+        // Make sure we remove permissions as well as add them.
+        if (perms & MemoryMappedObject::Write)
+            f |= VirtualAddressSpace::Write;
+        else
+            f &= ~VirtualAddressSpace::Write;
+
+        if (perms & MemoryMappedObject::Exec)
+            f |= VirtualAddressSpace::Execute;
+        else
+            f &= ~VirtualAddressSpace::Execute;
+
+        va.setFlags(v, f);
+    }
+    else if (perms & MemoryMappedObject::Exec)
+    {
+        // We can however still make these pages executable.
+        va.setFlags(v, f | VirtualAddressSpace::Execute);
+    }
+}
+
 void AnonymousMemoryMap::unmap()
 {
     LockGuard<Spinlock> guard(m_Lock);
@@ -265,6 +384,16 @@ bool AnonymousMemoryMap::trap(uintptr_t address, bool bWrite)
     if (m_Permissions & Exec)
         extraFlags |= VirtualAddressSpace::Execute;
 
+    if (va.isSwapped(reinterpret_cast<void *>(address)))
+    {
+        return swapIn(reinterpret_cast<void *>(address));
+    }
+
+    if (trapHuge(address, bWrite, extraFlags))
+    {
+        return true;
+    }
+
     if (!bWrite)
     {
         if (va.isMapped(reinterpret_cast<void *>(address)))
@@ -300,19 +429,368 @@ bool AnonymousMemoryMap::trap(uintptr_t address, bool bWrite)
 
         // "Copy" on write... but not really :)
         physical_uintptr_t newPage =
-            PhysicalMemoryManager::instance().allocatePage();
+            PhysicalMemoryManager::instance().allocateZeroedPage();
         if (!va.map(
                 newPage, reinterpret_cast<void *>(address),
                 VirtualAddressSpace::Write | extraFlags))
             ERROR("map() failed in AnonymousMemoryMap::trap() - write");
-        ByteSet(
-            reinterpret_cast<void *>(address), 0,
-            PhysicalMemoryManager::getPageSize());
     }
 
     return true;
 }
 
+bool AnonymousMemoryMap::trapHuge(
+    uintptr_t address, bool bWrite, size_t extraFlags)
+{
+    if (m_HugePages == NoHugePages)
+        return false;
+    else if (!bWrite && m_HugePages != AlwaysHugePages)
+        return false;
+
+    // Huge pages are always mapped writeable.
+    if (!(m_Permissions & Write))
+        return false;
+
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    size_t pageSz = PhysicalMemoryManager::getPageSize();
+    size_t hugePageSz = va.getHugePageSize();
+    if (!hugePageSz)
+        return false;
+
+    // Must fit entirely within this object.
+    uintptr_t base = address & ~(hugePageSz - 1);
+    if (base < m_Address || (base + hugePageSz) > (m_Address + m_Length))
+        return false;
+
+    // Already using normal pages here.
+    void *v = reinterpret_cast<void *>(base);
+    if (!va.canMapHugePage(v))
+        return false;
+
+    size_t order = __builtin_ctzl(hugePageSz / pageSz);
+    physical_uintptr_t phys =
+        PhysicalMemoryManager::instance().allocateBlock(order);
+    if (!phys)
+    {
+        m_HugePageFallbacks += 1;
+        return false;
+    }
+
+    // Zero the block before it's mapped, or other threads of the process
+    // could see what it held before.
+    {
+        MemoryRegion region("huge-page-zero");
+        if (!mapForKernel(region, phys, hugePageSz / pageSz))
+        {
+            PhysicalMemoryManager::instance().freeBlock(phys, order);
+            m_HugePageFallbacks += 1;
+            return false;
+        }
+
+        ByteSet(region.virtualAddress(), 0, hugePageSz);
+        region.free();
+    }
+
+    if (!va.mapHugePage(phys, v, VirtualAddressSpace::Write | extraFlags))
+    {
+        PhysicalMemoryManager::instance().freeBlock(phys, order);
+        m_HugePageFallbacks += 1;
+        return false;
+    }
+
+    m_HugeMappings.pushBack(v);
+    m_HugePageFaults += 1;
+
+#ifdef DEBUG_MMOBJECTS
+    NOTICE("  -> huge page at " << Hex << base);
+#endif
+
+    return true;
+}
+
+void AnonymousMemoryMap::releaseHugePage(void *v)
+{
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    size_t pageSz = PhysicalMemoryManager::getPageSize();
+    size_t hugePageSz = va.getHugePageSize();
+
+    if (va.isHugePage(v))
+    {
+        size_t flags;
+        physical_uintptr_t phys;
+        va.getMapping(v, phys, flags);
+        va.unmapHugePage(v);
+
+        // Free page by page, as parts of it may have been pinned.
+        for (size_t off = 0; off < hugePageSz; off += pageSz)
+        {
+            PhysicalMemoryManager::instance().freePage(phys + off);
+        }
+
+        return;
+    }
+
+    // Split since (e.g. by a fork), so unmap whatever is left of it.
+    TlbShootdown shootdown(va);
+    for (size_t off = 0; off < hugePageSz; off += pageSz)
+    {
+        void *page = adjust_pointer(v, off);
+        if (va.isMapped(page))
+        {
+            size_t flags;
+            physical_uintptr_t phys;
+
+            va.getMapping(page, phys, flags);
+
+            va.unmapBatched(page, shootdown);
+            shootdown.free(phys);
+        }
+    }
+}
+
+void AnonymousMemoryMap::demoteHugePage(
+    void *v, uintptr_t at, AnonymousMemoryMap *pOther)
+{
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    size_t pageSz = PhysicalMemoryManager::getPageSize();
+    size_t hugePageSz = va.getHugePageSize();
+
+    if (!va.splitHugePage(v))
+    {
+        ERROR(
+            "AnonymousMemoryMap: couldn't split huge page at "
+            << v << ", pages may leak");
+    }
+
+    for (size_t off = 0; off < hugePageSz; off += pageSz)
+    {
+        void *page = adjust_pointer(v, off);
+        if (reinterpret_cast<uintptr_t>(page) < at)
+            m_Mappings.pushBack(page);
+        else
+            pOther->m_Mappings.pushBack(page);
+    }
+}
+
+void AnonymousMemoryMap::setHugePages(MemoryMappedObject::HugePages policy)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    m_HugePages = policy;
+}
+
+size_t AnonymousMemoryMap::swapOut(size_t count)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    size_t n = 0;
+    for (List<void *>::Iterator it = m_Mappings.begin();
+         it != m_Mappings.end() && n < count; ++it)
+    {
+        if (swapOutPage(*it))
+        {
+            ++n;
+        }
+    }
+
+    return n;
+}
+
+bool AnonymousMemoryMap::swapOutPage(void *v)
+{
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    size_t pageSz = PhysicalMemoryManager::getPageSize();
+
+    if (!va.isMapped(v) || va.isHugePage(v))
+    {
+        return false;
+    }
+
+    size_t flags;
+    physical_uintptr_t phys;
+    va.getMapping(v, phys, flags);
+
+    // Nothing is gained by swapping out the zero page, or a page still
+    // shared with another process until one of them writes to it.
+    if (flags & (VirtualAddressSpace::Shared | VirtualAddressSpace::CopyOnWrite))
+    {
+        return false;
+    }
+
+    // Recently accessed pages get a second chance.
+    if (va.clearAccessed(v))
+    {
+        return false;
+    }
+
+    // Writes now fault, and wait on our lock until the page is swapped out.
+    if (flags & VirtualAddressSpace::Write)
+    {
+        va.setFlags(v, flags & ~VirtualAddressSpace::Write);
+    }
+
+    // Compress through a kernel mapping - v itself may be kept inaccessible
+    // for aging, and faulting on it would count as an access.
+    CompressedPageStore::Handle handle = 0;
+    {
+        MemoryRegion region("swap-out");
+        if (mapForKernel(region, phys, 1))
+        {
+            handle = m_SwapStore.store(region.virtualAddress());
+            region.free();
+        }
+    }
+    if (!handle)
+    {
+        if (flags & VirtualAddressSpace::Write)
+        {
+            va.setFlags(v, flags);
+        }
+        return false;
+    }
+
+    va.unmap(v);
+    va.map(handle * pageSz, v, flags | VirtualAddressSpace::Swapped);
+    if (!va.isSwapped(v))
+    {
+        // The address space can't hold swap entries - put the page back.
+        if (va.isMapped(v))
+        {
+            va.unmap(v);
+        }
+        va.map(phys, v, flags);
+        m_SwapStore.release(handle);
+        return false;
+    }
+
+    PhysicalMemoryManager::instance().freePage(phys);
+    m_SwapOuts += 1;
+
+    return true;
+}
+
+bool AnonymousMemoryMap::swapIn(void *v)
+{
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    size_t pageSz = PhysicalMemoryManager::getPageSize();
+
+    Time::Timestamp start = Time::getTimeNanoseconds();
+
+    size_t flags;
+    physical_uintptr_t entry;
+    va.getMapping(v, entry, flags);
+    flags &= ~VirtualAddressSpace::Swapped;
+
+    CompressedPageStore::Handle handle = entry / pageSz;
+
+    physical_uintptr_t page = PhysicalMemoryManager::instance().allocatePage();
+    if (!page)
+    {
+        ERROR("AnonymousMemoryMap: no memory to swap in " << v);
+        return false;
+    }
+
+    // Decompress before the page is mapped, so that no other thread of the
+    // process can see it half-filled.
+    {
+        MemoryRegion region("swap-in");
+        if (!mapForKernel(region, page, 1))
+        {
+            ERROR("AnonymousMemoryMap: couldn't map a page to swap in " << v);
+            PhysicalMemoryManager::instance().freePage(page);
+            return false;
+        }
+
+        if (!m_SwapStore.load(handle, region.virtualAddress()))
+        {
+            FATAL(
+                "AnonymousMemoryMap: swapped out page at " << v << " is lost");
+        }
+        region.free();
+    }
+
+    va.unmap(v);
+    if (!va.map(page, v, flags))
+    {
+        ERROR("map() failed in AnonymousMemoryMap::swapIn()");
+        PhysicalMemoryManager::instance().freePage(page);
+        return false;
+    }
+
+    m_SwapStore.release(handle);
+
+    m_SwapIns += 1;
+    m_SwapInTime += Time::getTimeNanoseconds() - start;
+
+    return true;
+}
+
+void AnonymousMemoryMap::dropSwapEntry(void *v)
+{
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+
+    if (!va.isSwapped(v))
+    {
+        return;
+    }
+
+    size_t flags;
+    physical_uintptr_t entry;
+    va.getMapping(v, entry, flags);
+    va.unmap(v);
+
+    m_SwapStore.release(entry / PhysicalMemoryManager::getPageSize());
+}
+
+void AnonymousMemoryMap::discard(uintptr_t at)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+    size_t hugePageSz = va.getHugePageSize();
+    void *v = reinterpret_cast<void *>(at);
+
+    // A huge page has to be broken up to drop just one page of it.
+    for (List<void *>::Iterator it = m_HugeMappings.begin();
+         it != m_HugeMappings.end(); ++it)
+    {
+        uintptr_t base = reinterpret_cast<uintptr_t>(*it);
+        if (at >= base && at < (base + hugePageSz))
+        {
+            demoteHugePage(*it, base + hugePageSz, this);
+            m_HugeMappings.erase(it);
+            break;
+        }
+    }
+
+    for (List<void *>::Iterator it = m_Mappings.begin();
+         it != m_Mappings.end(); ++it)
+    {
+        if (*it != v)
+        {
+            continue;
+        }
+
+        // The next access faults in a zeroed page, as for a new mapping.
+        if (va.isMapped(v))
+        {
+            size_t flags;
+            physical_uintptr_t phys;
+
+            va.getMapping(v, phys, flags);
+            va.unmap(v);
+            PhysicalMemoryManager::instance().freePage(phys);
+        }
+        else
+        {
+            dropSwapEntry(v);
+        }
+
+        m_Mappings.erase(it);
+        break;
+    }
+}
+
 void AnonymousMemoryMap::unmapUnlocked()
 {
 #ifdef DEBUG_MMOBJECTS
@@ -321,6 +799,7 @@ void AnonymousMemoryMap::unmapUnlocked()
 
     VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
 
+    TlbShootdown shootdown(va);
     for (List<void *>::Iterator it = m_Mappings.begin(); it != m_Mappings.end();
          ++it)
     {
@@ -334,12 +813,25 @@ void AnonymousMemoryMap::unmapUnlocked()
 
             // Clean up. Shared read-only zero page will only have its refcount
             // decreased by this - it will not hit zero.
-            va.unmap(v);
-            PhysicalMemoryManager::instance().freePage(phys);
+            va.unmapBatched(v, shootdown);
+            shootdown.free(phys);
+        }
+        else
+        {
+            dropSwapEntry(v);
         }
     }
 
+    shootdown.flush();
     m_Mappings.clear();
+
+    for (List<void *>::Iterator it = m_HugeMappings.begin();
+         it != m_HugeMappings.end(); ++it)
+    {
+        releaseHugePage(*it);
+    }
+
+    m_HugeMappings.clear();
 }
 
 MemoryMappedFile::MemoryMappedFile(
@@ -447,6 +939,7 @@ bool MemoryMappedFile::remove(size_t length)
     m_Length -= length;
 
     // Remove any existing mappings in this range.
+    TlbShootdown shootdown(va);
     for (uintptr_t virt = oldStart; virt < m_Address; virt += pageSz)
     {
         void *v = reinterpret_cast<void *>(virt);
@@ -456,7 +949,7 @@ bool MemoryMappedFile::remove(size_t length)
             physical_uintptr_t phys;
 
             va.getMapping(v, phys, flags);
-            va.unmap(v);
+            va.unmapBatched(v, shootdown);
 
             physical_uintptr_t p = getMapping(virt);
             if (p == ~0UL)
@@ -471,7 +964,7 @@ bool MemoryMappedFile::remove(size_t length)
                     m_pBacking->sync(fileOffset, true);
             }
             else
-                PhysicalMemoryManager::instance().freePage(phys);
+                shootdown.free(phys);
         }
 
         untrackMapping(virt);
@@ -696,7 +1189,13 @@ bool MemoryMappedFile::trap(uintptr_t address, bool bWrite)
     size_t mappingOffset = (address - m_Address);
     size_t fileOffset = m_Offset + mappingOffset;
 
-    bool bWillEof = (mappingOffset + pageSz) > m_Length;
+    // A mapping that ends part way through a page must read as zeroes past
+    // its end. The backing page has zeroes there already if the file ends
+    // there too, so it only needs a copy if the file carries on.
+    uint64_t fileSize = m_pBacking->getSize();
+    bool bWillEof = ((mappingOffset + pageSz) > m_Length) &&
+                    ((fileOffset >= fileSize) ||
+                     ((m_Offset + m_Length) < fileSize));
     bool bShouldCopy = m_bCopyOnWrite && (bWillEof || bWrite);
 
     // Skip out on a few things if we can.
@@ -794,8 +1293,7 @@ bool MemoryMappedFile::trap(uintptr_t address, bool bWrite)
         {
             // Couldn't quite read in a page - zero out what's left.
             ByteSet(
-                reinterpret_cast<void *>(address + nRead), 0,
-                pageSz - nRead - 1);
+                reinterpret_cast<void *>(address + nRead), 0, pageSz - nRead);
         }
 
         trackMapping(address, newPhys);
@@ -836,6 +1334,10 @@ bool MemoryMappedFile::compact()
             if (!(flags & VirtualAddressSpace::Write))
                 continue;
 
+            // Recently accessed pages get a second chance.
+            if (va.clearAccessed(reinterpret_cast<void *>(addr)))
+                continue;
+
             size_t mappingOffset = (addr - m_Address);
             size_t fileOffset = m_Offset + mappingOffset;
 
@@ -870,6 +1372,9 @@ bool MemoryMappedFile::compact()
             if ((flags & VirtualAddressSpace::Write))
                 continue;
 
+            if (va.clearAccessed(reinterpret_cast<void *>(addr)))
+                continue;
+
             size_t mappingOffset = (addr - m_Address);
             size_t fileOffset = m_Offset + mappingOffset;
 
@@ -898,6 +1403,7 @@ void MemoryMappedFile::unmapUnlocked()
     if (!getMappingCount())
         return;
 
+    TlbShootdown shootdown(va);
     for (auto it = m_Mappings.begin(); it != m_Mappings.end(); ++it)
     {
         void *v = reinterpret_cast<void *>(it.key());
@@ -907,7 +1413,7 @@ void MemoryMappedFile::unmapUnlocked()
         size_t flags = 0;
         physical_uintptr_t phys = 0;
         va.getMapping(v, phys, flags);
-        va.unmap(v);
+        va.unmapBatched(v, shootdown);
 
         physical_uintptr_t p = it.value();
         if (p == ~0UL)
@@ -922,9 +1428,10 @@ void MemoryMappedFile::unmapUnlocked()
                 m_pBacking->sync(fileOffset, true);
         }
         else
-            PhysicalMemoryManager::instance().freePage(phys);
+            shootdown.free(phys);
     }
 
+    shootdown.flush();
     clearMappings();
 }
 
@@ -953,15 +1460,19 @@ void MemoryMappedFile::clearMappings()
     m_Mappings.clear();
 }
 
-MemoryMapManager::MemoryMapManager() : m_MmObjectLists(), m_Lock()
+MemoryMapManager::MemoryMapManager()
+    : m_MmObjectLists(), m_Lock(), m_SwapHandler(), m_bSwapping(false)
 {
     PageFaultHandler::instance().registerHandler(this);
     MemoryPressureManager::instance().registerHandler(
         MemoryPressureManager::HighPriority, this);
+    MemoryPressureManager::instance().registerHandler(
+        MemoryPressureManager::LowPriority, &m_SwapHandler);
 }
 
 MemoryMapManager::~MemoryMapManager()
 {
+    MemoryPressureManager::instance().removeHandler(&m_SwapHandler);
     MemoryPressureManager::instance().removeHandler(this);
 }
 
@@ -1393,6 +1904,37 @@ size_t MemoryMapManager::setPermissions(
     return nAffected;
 }
 
+size_t MemoryMapManager::setHugePages(
+    uintptr_t base, size_t length, MemoryMappedObject::HugePages policy)
+{
+    VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+
+    LockGuard<Spinlock> guard(m_Lock);
+
+    MmObjectList *pMmObjectList = m_MmObjectLists.lookup(&va);
+    if (!pMmObjectList)
+    {
+        return 0;
+    }
+
+    size_t nAffected = 0;
+    for (List<MemoryMappedObject *>::Iterator it = pMmObjectList->begin();
+         it != pMmObjectList->end(); it++)
+    {
+        MemoryMappedObject *pObject = *it;
+        if (pObject->address() >= (base + length) ||
+            (pObject->address() + pObject->length()) <= base)
+        {
+            continue;
+        }
+
+        pObject->setHugePages(policy);
+        ++nAffected;
+    }
+
+    return nAffected;
+}
+
 bool MemoryMapManager::contains(uintptr_t base, size_t length)
 {
     VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
@@ -1453,6 +1995,9 @@ void MemoryMapManager::op(
                     case Invalidate:
                         pObject->invalidate(address);
                         break;
+                    case Discard:
+                        pObject->discard(address);
+                        break;
                     default:
                         WARNING("Bad 'what' in MemoryMapManager::op()");
                 }
@@ -1473,6 +2018,11 @@ void MemoryMapManager::invalidate(uintptr_t base, size_t length)
     op(Invalidate, base, length, false);
 }
 
+void MemoryMapManager::discard(uintptr_t base, size_t length)
+{
+    op(Discard, base, length, false);
+}
+
 void MemoryMapManager::unmap(MemoryMappedObject *pObj)
 {
     LockGuard<Spinlock> guard(m_Lock);
@@ -1640,6 +2190,54 @@ bool MemoryMapManager::compact()
     return false;
 }
 
+bool MemoryMapManager::swapOut()
+{
+    // The swap store allocates memory, which can bring us straight back here.
+    if (!m_bSwapping.compareAndSwap(false, true))
+    {
+        return false;
+    }
+
+    // Memory can run out while this processor already holds our lock (for
+    // example, while cloning), and it doesn't recurse - try again later.
+    if (m_Lock.acquired())
+    {
+        m_bSwapping = false;
+        return false;
+    }
+
+    // Hold the lock for the whole walk, so that no object we're swapping out
+    // of can be unmapped and freed under us.
+    m_Lock.acquire();
+
+    VirtualAddressSpace &currva =
+        Processor::information().getVirtualAddressSpace();
+
+    size_t nSwapped = 0;
+    for (Tree<VirtualAddressSpace *, MmObjectList *>::Iterator it =
+             m_MmObjectLists.begin();
+         it != m_MmObjectLists.end() && nSwapped < ANON_SWAP_BATCH; ++it)
+    {
+        Processor::switchAddressSpace(*it.key());
+
+        for (MmObjectList::Iterator it2 = it.value()->begin();
+             it2 != it.value()->end() && nSwapped < ANON_SWAP_BATCH; ++it2)
+        {
+            nSwapped += (*it2)->swapOut(ANON_SWAP_BATCH - nSwapped);
+        }
+    }
+
+    Processor::switchAddressSpace(currva);
+
+    m_Lock.release();
+
+    m_bSwapping = false;
+
+    if (nSwapped)
+        NOTICE("    -> swapped out " << nSwapped << " pages");
+    return nSwapped != 0;
+}
+
 void MemoryMapManager::unmapAllUnlocked()
 {
     if (!m_Lock.acquired())
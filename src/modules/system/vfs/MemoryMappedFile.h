@@ -20,12 +20,14 @@
 #ifndef MEMORY_MAPPED_FILE_H
 #define MEMORY_MAPPED_FILE_H
 
+#include "pedigree/kernel/Atomic.h"
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/process/MemoryPressureManager.h"
 #include "pedigree/kernel/processor/PageFaultHandler.h"
 #include "pedigree/kernel/processor/state_forward.h"
 #include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/utilities/CompressedPageStore.h"
 #include "pedigree/kernel/utilities/List.h"
 #include "pedigree/kernel/utilities/String.h"
 #include "pedigree/kernel/utilities/Tree.h"
@@ -122,6 +124,17 @@ class MemoryMappedObject
     static const int Write = 0x2;
     static const int Exec = 0x4;
 
+    /** How an object's memory may be backed by huge pages. */
+    enum HugePages
+    {
+        /** Only ever use normal pages. */
+        NoHugePages,
+        /** Use a huge page for a write fault, if one is free. */
+        TransparentHugePages,
+        /** Use a huge page for any fault, if one is free. */
+        AlwaysHugePages
+    };
+
     /** Constructor - bring up common metadata. */
     MemoryMappedObject(
         uintptr_t address, bool bCopyOnWrite, size_t length, Permissions perms)
@@ -184,6 +197,17 @@ class MemoryMappedObject
     {
     }
 
+    /**
+     * Throw away this process' own copy of the given page, so that the
+     * next access sees it afresh (for madvise's MADV_DONTNEED).
+     *
+     * Default implementation restores the page as invalidate() does.
+     */
+    virtual void discard(uintptr_t at)
+    {
+        invalidate(at);
+    }
+
     /**
      * Unmaps existing mappings in this object from the address space.
      *
@@ -201,6 +225,15 @@ class MemoryMappedObject
      */
     virtual bool trap(uintptr_t address, bool bWrite) = 0;
 
+    /**
+     * Advise how this object should use huge pages for new mappings.
+     *
+     * Default implementation ignores the advice.
+     */
+    virtual void setHugePages(HugePages policy)
+    {
+    }
+
     /**
      * Release memory that can be released.
      *
@@ -211,6 +244,17 @@ class MemoryMappedObject
         return false;
     }
 
+    /**
+     * Move up to count pages that haven't been used recently out to swap.
+     *
+     * Default implementation has nothing to swap.
+     * \return the number of pages swapped out.
+     */
+    virtual size_t swapOut(size_t count)
+    {
+        return 0;
+    }
+
     /**
      * Determines if the given address is within this object's mapping.
      */
@@ -280,6 +324,11 @@ class MemoryMappedObject
  * onto a common page full of zeroes with forced copy-on-write. This
  * is perfect for mapping in large .bss sections in binaries or for
  * getting huge amounts of zeroed memory.
+ *
+ * Under memory pressure, pages that haven't been used recently are
+ * compressed into an in-memory swap store. Their page table entries are
+ * replaced by swap entries, which are decompressed into a fresh page when
+ * next touched.
  */
 class AnonymousMemoryMap : public MemoryMappedObject
 {
@@ -296,18 +345,100 @@ class AnonymousMemoryMap : public MemoryMappedObject
 
     virtual void setPermissions(MemoryMappedObject::Permissions perms);
 
+    virtual void discard(uintptr_t at);
+
     virtual void unmap();
 
     virtual bool trap(uintptr_t address, bool bWrite);
 
+    virtual void setHugePages(MemoryMappedObject::HugePages policy);
+
+    virtual size_t swapOut(size_t count);
+
+    /** Number of faults that mapped a huge page. */
+    static size_t hugePageFaults()
+    {
+        return m_HugePageFaults;
+    }
+
+    /** Number of faults that could have used a huge page, but fell back to a
+     *  normal page as no huge page could be allocated. */
+    static size_t hugePageFallbacks()
+    {
+        return m_HugePageFallbacks;
+    }
+
+    /** The store swapped out pages are compressed into. */
+    static CompressedPageStore &getSwapStore()
+    {
+        return m_SwapStore;
+    }
+
+    /** Number of pages swapped out. */
+    static size_t swapOuts()
+    {
+        return m_SwapOuts;
+    }
+
+    /** Number of faults that swapped a page back in. */
+    static size_t swapIns()
+    {
+        return m_SwapIns;
+    }
+
+    /** Total time spent swapping pages back in, in nanoseconds. */
+    static size_t swapInTime()
+    {
+        return m_SwapInTime;
+    }
+
   private:
     static physical_uintptr_t m_Zero;
 
+    static Atomic<size_t> m_HugePageFaults;
+    static Atomic<size_t> m_HugePageFallbacks;
+
+    static CompressedPageStore m_SwapStore;
+    static Atomic<size_t> m_SwapOuts;
+    static Atomic<size_t> m_SwapIns;
+    static Atomic<size_t> m_SwapInTime;
+
     void unmapUnlocked();
 
+    /** Map a zeroed huge page covering address, if the policy allows. */
+    bool trapHuge(uintptr_t address, bool bWrite, size_t extraFlags);
+
+    /** Unmap and free a huge page we mapped, whether or not it has been
+     *  split into normal pages since. */
+    void releaseHugePage(void *v);
+
+    /** Split a huge page into normal pages, tracking those below at in
+     *  this object and the rest in pOther. */
+    void demoteHugePage(void *v, uintptr_t at, AnonymousMemoryMap *pOther);
+
+    /** Apply perms to an existing mapping. */
+    void setPagePermissions(void *v, MemoryMappedObject::Permissions perms);
+
+    /** Compress the page at v into the swap store, if it's worth it. */
+    bool swapOutPage(void *v);
+
+    /** Decompress the swapped out page at v into a new page. Returns false
+     *  if there is no swap entry at v. */
+    bool swapIn(void *v);
+
+    /** Remove the swap entry at v, if there is one, and release its page in
+     *  the swap store. */
+    void dropSwapEntry(void *v);
+
     /** List of existing virtual addresses we've mapped in. */
     List<void *> m_Mappings;
 
+    /** Base addresses of the huge pages we've mapped in. */
+    List<void *> m_HugeMappings;
+
+    /** When to use huge pages for faults. */
+    MemoryMappedObject::HugePages m_HugePages;
+
     /** Lock for anything to do with the memory mapping. */
     Spinlock m_Lock;
 };
@@ -466,6 +597,24 @@ class EXPORTED_PUBLIC MemoryMapManager : public MemoryTrapHandler,
      */
     void invalidate(uintptr_t base, size_t length);
 
+    /**
+     * Throws away the pages within the given range that are private to
+     * this process. Anonymous memory reads back as zeroes afterwards, and
+     * private file mappings as the file's content.
+     */
+    void discard(uintptr_t base, size_t length);
+
+    /**
+     * Sets the huge page policy of objects within the given range (for
+     * madvise). Objects are not split; partially covered objects take the
+     * new policy as a whole.
+     *
+     * \return number of objects affected by this call.
+     */
+    size_t setHugePages(
+        uintptr_t base, size_t length,
+        MemoryMappedObject::HugePages policy);
+
     /**
      * Removes the mappings for the given object from the address space.
      */
@@ -493,6 +642,16 @@ class EXPORTED_PUBLIC MemoryMapManager : public MemoryTrapHandler,
         return String("Unmap safe pages from memory mapped files.");
     }
 
+    /**
+     * Swap out anonymous memory that hasn't been used recently, in all
+     * address spaces.
+     *
+     * This may switch in and out of several address spaces, and gives up
+     * straight away if the lock is already held.
+     * \return true if pages were released.
+     */
+    bool swapOut();
+
   protected:
     /**
      * Removes all mappings from the address space, unlocked.
@@ -528,10 +687,30 @@ class EXPORTED_PUBLIC MemoryMapManager : public MemoryTrapHandler,
     {
         Sync,
         Invalidate,
+        Discard,
     };
 
     void op(Ops what, uintptr_t base, size_t length, bool async);
 
+    /**
+     * Swapping anonymous memory is a last resort, after caches have given up
+     * what they can, so it is a separate, lower priority memory pressure
+     * handler.
+     */
+    class AnonymousSwapHandler : public MemoryPressureHandler
+    {
+      public:
+        virtual const String getMemoryPressureDescription()
+        {
+            return String("Compress idle anonymous memory into swap.");
+        }
+
+        virtual bool compact()
+        {
+            return MemoryMapManager::instance().swapOut();
+        }
+    };
+
     /** Singleton instance. */
     static MemoryMapManager m_Instance;
 
@@ -542,6 +721,11 @@ class EXPORTED_PUBLIC MemoryMapManager : public MemoryTrapHandler,
 
     /** Lock for the cache. */
     Spinlock m_Lock;
+
+    AnonymousSwapHandler m_SwapHandler;
+
+    /** Set while swapping out, as swapping out can allocate memory. */
+    Atomic<bool> m_bSwapping;
 };
 
 /** @} */
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#include "PageCache.h"
+#include "File.h"
+#include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/processor/PhysicalMemoryManager.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+PageCache PageCache::m_Instance;
+
+PageCache::PageCache()
+    : m_Cache(), m_Files(), m_Ends(), m_FreeIds(), m_NextId(1), m_Lock(false)
+{
+    m_Cache.setCallback(writeback, this);
+}
+
+PageCache::~PageCache()
+{
+}
+
+size_t PageCache::registerFile(File *pFile)
+{
+    LockGuard<Mutex> guard(m_Lock);
+
+    size_t id = 0;
+    if (m_FreeIds.count())
+    {
+        id = m_FreeIds.popBack();
+    }
+    else if (
+        m_NextId < (1ULL << ((sizeof(uintptr_t) * 8) - PAGECACHE_OFFSET_BITS)))
+    {
+        id = m_NextId++;
+    }
+    else
+    {
+        FATAL("PageCache: out of file IDs");
+    }
+
+    m_Files.insert(id, pFile);
+    m_Ends.insert(id, 0);
+    return id;
+}
+
+void PageCache::unregisterFile(size_t id)
+{
+    uint64_t end = 0;
+    {
+        LockGuard<Mutex> guard(m_Lock);
+        end = m_Ends.lookup(id);
+        m_Files.remove(id);
+        m_Ends.remove(id);
+    }
+
+    // Without its File, writeback() drops any dirty pages rather than
+    // writing them. It takes our lock, so that can't be held here.
+    size_t nLeft = m_Cache.evictRange(key(id, 0), end);
+    if (nLeft)
+    {
+        // Someone still has a page pinned, so the ID can never be reused.
+        WARNING(
+            "PageCache: " << nLeft << " pages still pinned for file ID " << id);
+        return;
+    }
+
+    LockGuard<Mutex> guard(m_Lock);
+    m_FreeIds.pushBack(id);
+}
+
+uintptr_t PageCache::getPage(File *pFile, size_t id, uint64_t offset, bool bFill)
+{
+    uintptr_t k = key(id, offset);
+
+    uintptr_t page = m_Cache.lookup(k);
+    if (page)
+    {
+        return page;
+    }
+
+    bool bExisted = false;
+    page = m_Cache.insert(k, &bExisted);
+    if (!page)
+    {
+        return 0;
+    }
+
+    if (!bExisted)
+    {
+        {
+            LockGuard<Mutex> guard(m_Lock);
+            uint64_t end = offset + PhysicalMemoryManager::getPageSize();
+            if (m_Files.lookup(id) && m_Ends.lookup(id) < end)
+            {
+                m_Ends.remove(id);
+                m_Ends.insert(id, end);
+            }
+        }
+
+        // The new page stays marked as being edited, and so won't be written
+        // back, until it has been filled.
+        if (bFill)
+        {
+            pFile->fillPage(offset, page);
+        }
+        else
+        {
+            ByteSet(
+                reinterpret_cast<void *>(page), 0,
+                PhysicalMemoryManager::getPageSize());
+        }
+        m_Cache.markNoLongerEditing(k);
+    }
+
+    // Pin for the caller on top of the reference insert() leaves behind.
+    m_Cache.pin(k);
+
+    return page;
+}
+
+uintptr_t PageCache::lookup(size_t id, uint64_t offset)
+{
+    return m_Cache.lookup(key(id, offset));
+}
+
+void PageCache::putPage(size_t id, uint64_t offset)
+{
+    m_Cache.release(key(id, offset));
+}
+
+void PageCache::pageWritten(size_t id, uint64_t offset)
+{
+    m_Cache.triggerChecksum(key(id, offset));
+}
+
+void PageCache::writeback(
+    CacheConstants::CallbackCause cause, uintptr_t key, uintptr_t page,
+    void *meta)
+{
+    PageCache *pCache = reinterpret_cast<PageCache *>(meta);
+
+    if (cause != CacheConstants::WriteBack)
+    {
+        // Nothing refers to evicted pages, so nothing to clean up.
+        return;
+    }
+
+    size_t id = key >> PAGECACHE_OFFSET_BITS;
+    uint64_t offset = key & ((1ULL << PAGECACHE_OFFSET_BITS) - 1);
+
+    LockGuard<Mutex> guard(pCache->m_Lock);
+
+    File *pFile = pCache->m_Files.lookup(id);
+    if (!pFile)
+    {
+        // File went away (or was truncated), so its data doesn't matter.
+        return;
+    }
+
+    pFile->flushPage(
+        offset, page, 0, PhysicalMemoryManager::getPageSize(), true);
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/process/Mutex.h"
+#include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/utilities/Cache.h"
+#include "pedigree/kernel/utilities/CacheConstants.h"
+#include "pedigree/kernel/utilities/Tree.h"
+#include "pedigree/kernel/utilities/Vector.h"
+
+class File;
+
+/// Bits of a page cache key that hold the offset into the file. The rest
+/// hold the File's ID.
+/// \todo 32-bit hosts need a wider key than uintptr_t.
+#define PAGECACHE_OFFSET_BITS 40
+
+/**
+ * The page cache holds file data for every File, one page per (file, page
+ * offset), in a single Cache.
+ *
+ * File::read(), File::write() and memory maps of a File all share these
+ * pages. Files fill and write back pages through their filesystem's block
+ * mapping (File::mapBlock()), going straight to the disk so that only
+ * metadata needs to stay in the disk's own cache. Files with no block map,
+ * but with blocks smaller than a page, fill pages from readBlock() instead.
+ */
+class EXPORTED_PUBLIC PageCache
+{
+  public:
+    PageCache();
+    ~PageCache();
+
+    static PageCache &instance()
+    {
+        return m_Instance;
+    }
+
+    /** Allocate an ID to key the given File's pages with. */
+    size_t registerFile(File *pFile);
+
+    /**
+     * Forget the given ID and evict its pages, without writing them back.
+     * The ID is given out again once none of its pages are left.
+     */
+    void unregisterFile(size_t id);
+
+    /**
+     * Get the page at the given (page-aligned) offset into a file, pinned.
+     * Pages not yet cached are filled by the File, unless bFill is false, in
+     * which case the caller is about to overwrite the whole page.
+     *
+     * Callers must not call this for the same File from two threads at
+     * once, or one could see a page the other is still filling.
+     *
+     * \return the page's address, or 0 on failure.
+     */
+    uintptr_t getPage(File *pFile, size_t id, uint64_t offset, bool bFill = true);
+
+    /** Get the page at the given offset, pinned, only if already cached. */
+    uintptr_t lookup(size_t id, uint64_t offset);
+
+    /** Unpin a page from getPage() or lookup(). */
+    void putPage(size_t id, uint64_t offset);
+
+    /**
+     * Note that the page at the given offset was written back by its File, so
+     * that the writeback timer doesn't write it back again.
+     */
+    void pageWritten(size_t id, uint64_t offset);
+
+  private:
+    PageCache(const PageCache &);
+    PageCache &operator=(const PageCache &);
+
+    static uintptr_t key(size_t id, uint64_t offset)
+    {
+        return (static_cast<uintptr_t>(id) << PAGECACHE_OFFSET_BITS) | offset;
+    }
+
+    /** Cache callback: writes dirty pages back through their File. */
+    static void writeback(
+        CacheConstants::CallbackCause cause, uintptr_t key, uintptr_t page,
+        void *meta);
+
+    static PageCache m_Instance;
+
+    Cache m_Cache;
+
+    /** File for each registered ID. */
+    Tree<size_t, File *> m_Files;
+
+    /** One past the highest offset cached for each registered ID. */
+    Tree<size_t, uint64_t> m_Ends;
+
+    /** IDs that have been unregistered and can be given out again. */
+    Vector<size_t> m_FreeIds;
+
+    size_t m_NextId;
+
+    Mutex m_Lock;
+};
+
+#endif
@@ -0,0 +1,767 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "Prefetcher.h"
+#include "File.h"
+#include "Filesystem.h"
+#include "VFS.h"
+#include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/machine/Disk.h"
+#include "pedigree/kernel/process/MemoryPressureManager.h"
+#include "pedigree/kernel/process/Process.h"
+#include "pedigree/kernel/process/Semaphore.h"
+#include "pedigree/kernel/process/Thread.h"
+#include "pedigree/kernel/processor/PhysicalMemoryManager.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/utilities/Iterator.h"
+#include "pedigree/kernel/utilities/Vector.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+/// Trace files start with this header, followed by one entry per file.
+struct PrefetchTraceHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nFiles;
+    uint32_t nPages;
+} PACKED;
+
+/// Each entry is followed by the path (not terminated) and then the ranges.
+struct PrefetchTraceEntry
+{
+    uint32_t pathLength;
+    uint32_t nRanges;
+} PACKED;
+
+/// A run of consecutive pages in a file.
+struct PrefetchTraceRange
+{
+    uint32_t firstPage;
+    uint32_t nPages;
+} PACKED;
+
+#define PREFETCH_TRACE_MAGIC 0x52545046  // "PFTR"
+#define PREFETCH_TRACE_VERSION 1
+
+/// Largest trace file that will be loaded.
+#define PREFETCH_MAX_TRACE_FILE 0x100000
+
+/// How far ahead of the pages being filled disk reads are issued.
+#define PREFETCH_READ_AHEAD (PREFETCH_MAX_RUN * 4)
+
+Prefetcher Prefetcher::m_Instance;
+
+Prefetcher::Trace::~Trace()
+{
+    for (Tree<uintptr_t, TraceFile *>::Iterator it = files.begin();
+         it != files.end(); ++it)
+    {
+        delete it.value();
+    }
+}
+
+bool Prefetcher::Trace::add(File *pFile, const String &path, size_t page)
+{
+    uintptr_t key = reinterpret_cast<uintptr_t>(pFile);
+    TraceFile *pTraceFile = files.lookup(key);
+    if (!pTraceFile)
+    {
+        pTraceFile = new TraceFile;
+        pTraceFile->path = path;
+        files.insert(key, pTraceFile);
+    }
+    else if (pTraceFile->pages.test(page))
+    {
+        return false;
+    }
+
+    pTraceFile->pages.set(page);
+    if (page > pTraceFile->nMaxPage)
+    {
+        pTraceFile->nMaxPage = page;
+    }
+    ++nPages;
+    return true;
+}
+
+Prefetcher::Prefetcher()
+    : m_pBootTrace(0), m_ExecTraces(), m_TraceSizes(), m_nRecording(0),
+      m_Jobs(), m_pWorker(0), m_pWake(0), m_Stats(), m_Lock(false)
+{
+    ByteSet(&m_Stats, 0, sizeof(m_Stats));
+}
+
+Prefetcher::~Prefetcher()
+{
+}
+
+void Prefetcher::initialise()
+{
+    LockGuard<Mutex> guard(m_Lock);
+    if (m_pWorker)
+    {
+        return;
+    }
+
+    Process *pParent = Processor::information().getCurrentThread()->getParent();
+    m_pWake = new Semaphore(0);
+    m_pWorker = new Thread(pParent, workerTrampoline, 0);
+    m_pWorker->detach();
+}
+
+void Prefetcher::startBoot()
+{
+    {
+        LockGuard<Mutex> guard(m_Lock);
+        if (!m_pWorker || m_pBootTrace)
+        {
+            return;
+        }
+
+        m_pBootTrace = new Trace;
+        m_pBootTrace->name = "boot.pf";
+        m_pBootTrace->deadline =
+            Time::getTimeNanoseconds() +
+            (PREFETCH_BOOT_WINDOW * Time::Multiplier::Second);
+        m_nRecording += 1;
+    }
+
+    queueJob(Job::Replay, String("boot.pf"), 0);
+}
+
+void Prefetcher::startExec(File *pFile)
+{
+    if (!m_pWorker)
+    {
+        return;
+    }
+
+    String name = traceName(pFile);
+    size_t pid =
+        Processor::information().getCurrentThread()->getParent()->getId();
+
+    Trace *pTrace = new Trace;
+    pTrace->name = name;
+    pTrace->deadline = Time::getTimeNanoseconds() +
+                       (PREFETCH_EXEC_WINDOW * Time::Multiplier::Second);
+
+    {
+        LockGuard<Mutex> guard(m_Lock);
+
+        // An exec replaces whatever the process was starting up as before.
+        Trace *pPrevious = m_ExecTraces.lookup(pid);
+        if (pPrevious)
+        {
+            m_ExecTraces.remove(pid);
+            m_nRecording -= 1;
+            delete pPrevious;
+        }
+
+        m_ExecTraces.insert(pid, pTrace);
+        m_nRecording += 1;
+    }
+
+    queueJob(Job::Replay, name, 0);
+}
+
+void Prefetcher::recordAccess(File *pFile, uint64_t offset)
+{
+    if (!m_nRecording)
+    {
+        return;
+    }
+
+    Thread *pThread = Processor::information().getCurrentThread();
+    if (pThread == m_pWorker)
+    {
+        // Replays and saves don't belong in any trace.
+        return;
+    }
+
+    size_t page = offset / PhysicalMemoryManager::getPageSize();
+    size_t pid = pThread->getParent()->getId();
+
+    LockGuard<Mutex> guard(m_Lock);
+
+    Trace *pExecTrace = m_ExecTraces.lookup(pid);
+    Trace *traces[2] = {m_pBootTrace, pExecTrace};
+
+    String path;
+    for (size_t i = 0; i < 2; ++i)
+    {
+        Trace *pTrace = traces[i];
+        if (!pTrace || pTrace->nPages >= PREFETCH_MAX_TRACE_PAGES)
+        {
+            continue;
+        }
+
+        if (!path.length() &&
+            !pTrace->files.contains(reinterpret_cast<uintptr_t>(pFile)))
+        {
+            path = pFile->getFullPath();
+        }
+
+        pTrace->add(pFile, path, page);
+    }
+}
+
+Prefetcher::Statistics Prefetcher::getStatistics()
+{
+    LockGuard<Mutex> guard(m_Lock);
+    return m_Stats;
+}
+
+int Prefetcher::workerTrampoline(void *p)
+{
+    Prefetcher::instance().worker();
+    return 0;
+}
+
+void Prefetcher::worker()
+{
+    while (true)
+    {
+        // Wake up now and again while recording, to stop recording traces
+        // once their time is up.
+        if (m_nRecording)
+        {
+            m_pWake->acquire(1, 1);
+        }
+        else
+        {
+            m_pWake->acquire(1);
+        }
+
+        expireTraces();
+
+        while (true)
+        {
+            Job *pJob = 0;
+            {
+                LockGuard<Mutex> guard(m_Lock);
+                if (m_Jobs.count())
+                {
+                    pJob = m_Jobs.popFront();
+                }
+            }
+
+            if (!pJob)
+            {
+                break;
+            }
+
+            if (pJob->type == Job::Replay)
+            {
+                Trace *pTrace = load(pJob->name);
+                if (pTrace)
+                {
+                    replay(pTrace);
+                    delete pTrace;
+                }
+            }
+            else
+            {
+                save(pJob->pTrace);
+                delete pJob->pTrace;
+            }
+
+            delete pJob;
+        }
+    }
+}
+
+void Prefetcher::queueJob(Job::Type type, const String &name, Trace *pTrace)
+{
+    Job *pJob = new Job;
+    pJob->type = type;
+    pJob->name = name;
+    pJob->pTrace = pTrace;
+
+    {
+        LockGuard<Mutex> guard(m_Lock);
+        m_Jobs.pushBack(pJob);
+    }
+
+    m_pWake->release();
+}
+
+void Prefetcher::expireTraces()
+{
+    Time::Timestamp now = Time::getTimeNanoseconds();
+    List<Trace *> finished;
+
+    {
+        LockGuard<Mutex> guard(m_Lock);
+
+        if (m_pBootTrace && (m_pBootTrace->deadline <= now))
+        {
+            finished.pushBack(m_pBootTrace);
+            m_pBootTrace = 0;
+            m_nRecording -= 1;
+        }
+
+        List<size_t> expired;
+        for (Tree<size_t, Trace *>::Iterator it = m_ExecTraces.begin();
+             it != m_ExecTraces.end(); ++it)
+        {
+            if (it.value()->deadline <= now)
+            {
+                expired.pushBack(it.key());
+            }
+        }
+
+        for (List<size_t>::Iterator it = expired.begin(); it != expired.end();
+             ++it)
+        {
+            finished.pushBack(m_ExecTraces.lookup(*it));
+            m_ExecTraces.remove(*it);
+            m_nRecording -= 1;
+        }
+
+        for (List<Trace *>::Iterator it = finished.begin();
+             it != finished.end(); ++it)
+        {
+            Job *pJob = new Job;
+            pJob->type = Job::Save;
+            pJob->pTrace = *it;
+            m_Jobs.pushBack(pJob);
+        }
+    }
+}
+
+Prefetcher::Trace *Prefetcher::load(const String &name)
+{
+    String path(PREFETCH_TRACE_DIRECTORY "/");
+    path += name;
+
+    File *pFile = VFS::instance().find(path);
+    if (!pFile || pFile->isDirectory())
+    {
+        return 0;
+    }
+
+    size_t size = pFile->getSize();
+    if (size < sizeof(PrefetchTraceHeader) || size > PREFETCH_MAX_TRACE_FILE)
+    {
+        return 0;
+    }
+
+    uint8_t *buffer = new uint8_t[size];
+    if (pFile->read(0, size, reinterpret_cast<uintptr_t>(buffer)) != size)
+    {
+        delete[] buffer;
+        return 0;
+    }
+
+    PrefetchTraceHeader *pHeader =
+        reinterpret_cast<PrefetchTraceHeader *>(buffer);
+    if (pHeader->magic != PREFETCH_TRACE_MAGIC ||
+        pHeader->version != PREFETCH_TRACE_VERSION)
+    {
+        WARNING("Prefetcher: ignoring bad trace " << path);
+        delete[] buffer;
+        return 0;
+    }
+
+    Trace *pTrace = new Trace;
+    pTrace->name = name;
+
+    const size_t pageSize = PhysicalMemoryManager::getPageSize();
+
+    size_t pos = sizeof(PrefetchTraceHeader);
+    for (size_t i = 0; i < pHeader->nFiles; ++i)
+    {
+        if ((pos + sizeof(PrefetchTraceEntry)) > size)
+        {
+            break;
+        }
+
+        PrefetchTraceEntry *pEntry =
+            reinterpret_cast<PrefetchTraceEntry *>(buffer + pos);
+        pos += sizeof(PrefetchTraceEntry);
+
+        size_t rangesSize = pEntry->nRanges * sizeof(PrefetchTraceRange);
+        if ((pos + pEntry->pathLength + rangesSize) > size)
+        {
+            break;
+        }
+
+        TraceFile *pTraceFile = new TraceFile;
+        pTraceFile->path.assign(
+            reinterpret_cast<const char *>(buffer + pos), pEntry->pathLength,
+            true);
+        pos += pEntry->pathLength;
+
+        PrefetchTraceRange *pRanges =
+            reinterpret_cast<PrefetchTraceRange *>(buffer + pos);
+        pos += rangesSize;
+
+        // Only pages the file still has are worth anything. Anything else is
+        // a stale or corrupt trace, and mustn't grow the page bitmap.
+        File *pTraced = VFS::instance().find(pTraceFile->path);
+        if (!pTraced || pTraced->isDirectory())
+        {
+            delete pTraceFile;
+            continue;
+        }
+        size_t nFilePages = (pTraced->getSize() + pageSize - 1) / pageSize;
+
+        for (size_t j = 0; j < pEntry->nRanges; ++j)
+        {
+            size_t firstPage = pRanges[j].firstPage;
+            if (firstPage >= nFilePages)
+            {
+                continue;
+            }
+
+            size_t count = pRanges[j].nPages;
+            if (count > (nFilePages - firstPage))
+            {
+                count = nFilePages - firstPage;
+            }
+            for (size_t k = 0; k < count; ++k)
+            {
+                if (pTrace->nPages >= PREFETCH_MAX_TRACE_PAGES)
+                {
+                    break;
+                }
+
+                size_t page = firstPage + k;
+                pTraceFile->pages.set(page);
+                if (page > pTraceFile->nMaxPage)
+                {
+                    pTraceFile->nMaxPage = page;
+                }
+                ++pTrace->nPages;
+            }
+        }
+
+        pTrace->files.insert(i, pTraceFile);
+    }
+
+    delete[] buffer;
+
+    LockGuard<Mutex> guard(m_Lock);
+    m_TraceSizes.insert(name.hash(), pTrace->nPages);
+
+    return pTrace;
+}
+
+void Prefetcher::save(Trace *pTrace)
+{
+    if (!pTrace->nPages)
+    {
+        return;
+    }
+
+    {
+        LockGuard<Mutex> guard(m_Lock);
+        uint32_t key = pTrace->name.hash();
+        if (m_TraceSizes.lookup(key) == pTrace->nPages)
+        {
+            // Most likely the same trace as last time.
+            return;
+        }
+
+        m_TraceSizes.remove(key);
+        m_TraceSizes.insert(key, pTrace->nPages);
+    }
+
+    // Lay the trace out in memory first.
+    size_t size = sizeof(PrefetchTraceHeader);
+    for (Tree<uintptr_t, TraceFile *>::Iterator it = pTrace->files.begin();
+         it != pTrace->files.end(); ++it)
+    {
+        TraceFile *pTraceFile = it.value();
+        size += sizeof(PrefetchTraceEntry) + pTraceFile->path.length();
+
+        // Worst case, every other page.
+        size += ((pTraceFile->nMaxPage / 2) + 1) * sizeof(PrefetchTraceRange);
+    }
+
+    uint8_t *buffer = new uint8_t[size];
+    PrefetchTraceHeader *pHeader =
+        reinterpret_cast<PrefetchTraceHeader *>(buffer);
+    pHeader->magic = PREFETCH_TRACE_MAGIC;
+    pHeader->version = PREFETCH_TRACE_VERSION;
+    pHeader->nFiles = pTrace->files.count();
+    pHeader->nPages = pTrace->nPages;
+
+    size_t pos = sizeof(PrefetchTraceHeader);
+    for (Tree<uintptr_t, TraceFile *>::Iterator it = pTrace->files.begin();
+         it != pTrace->files.end(); ++it)
+    {
+        TraceFile *pTraceFile = it.value();
+
+        PrefetchTraceEntry *pEntry =
+            reinterpret_cast<PrefetchTraceEntry *>(buffer + pos);
+        pEntry->pathLength = pTraceFile->path.length();
+        pEntry->nRanges = 0;
+        pos += sizeof(PrefetchTraceEntry);
+
+        MemoryCopy(
+            buffer + pos, static_cast<const char *>(pTraceFile->path),
+            pEntry->pathLength);
+        pos += pEntry->pathLength;
+
+        PrefetchTraceRange *pRange = 0;
+        for (size_t page = 0; page <= pTraceFile->nMaxPage; ++page)
+        {
+            if (!pTraceFile->pages.test(page))
+            {
+                pRange = 0;
+                continue;
+            }
+
+            if (!pRange)
+            {
+                pRange = reinterpret_cast<PrefetchTraceRange *>(buffer + pos);
+                pRange->firstPage = page;
+                pRange->nPages = 0;
+                pos += sizeof(PrefetchTraceRange);
+                ++pEntry->nRanges;
+            }
+
+            ++pRange->nPages;
+        }
+    }
+
+    // Then write it out.
+    VFS &vfs = VFS::instance();
+    String directory(PREFETCH_TRACE_DIRECTORY);
+    if (!vfs.find(directory))
+    {
+        vfs.createDirectory(directory, 0755);
+    }
+
+    String path(directory);
+    path += "/";
+    path += pTrace->name;
+
+    File *pFile = vfs.find(path);
+    if (!pFile)
+    {
+        vfs.createFile(path, 0644);
+        pFile = vfs.find(path);
+    }
+
+    if (!pFile || pFile->isDirectory())
+    {
+        // Not a problem, the trace just won't survive a reboot.
+        NOTICE("Prefetcher: couldn't save trace " << path);
+    }
+    else
+    {
+        pFile->truncate();
+        pFile->write(0, pos, reinterpret_cast<uintptr_t>(buffer));
+    }
+
+    delete[] buffer;
+}
+
+void Prefetcher::replay(Trace *pTrace)
+{
+    /** A page to read, and where it is. */
+    struct PendingPage
+    {
+        File *pFile;
+        uint64_t offset;
+    };
+
+    /** A disk read covering some pages. */
+    struct Run
+    {
+        uint64_t location;
+        uint64_t length;
+    };
+
+    Time::Timestamp start = Time::getTimeNanoseconds();
+    const size_t pageSize = PhysicalMemoryManager::getPageSize();
+
+    size_t nTraced = 0, nCached = 0, nRead = 0, nRuns = 0;
+
+    // Find where each page lives, sorted by disk location. Pages with no
+    // known location get read in trace order afterwards.
+    Tree<Disk *, Tree<uint64_t, PendingPage *> *> disks;
+    List<PendingPage *> unplaced;
+    for (Tree<uintptr_t, TraceFile *>::Iterator it = pTrace->files.begin();
+         it != pTrace->files.end(); ++it)
+    {
+        TraceFile *pTraceFile = it.value();
+        File *pFile = VFS::instance().find(pTraceFile->path);
+        if (!pFile || pFile->isDirectory())
+        {
+            continue;
+        }
+
+        Filesystem *pFs = pFile->getFilesystem();
+        Disk *pDisk = pFs ? pFs->getDisk() : 0;
+
+        for (size_t page = 0; page <= pTraceFile->nMaxPage; ++page)
+        {
+            uint64_t offset = static_cast<uint64_t>(page) * pageSize;
+            if (!pTraceFile->pages.test(page) || offset >= pFile->getSize())
+            {
+                continue;
+            }
+
+            ++nTraced;
+
+            uint64_t diskOffset = 0;
+            if (!pFile->prefetchLocation(offset, diskOffset))
+            {
+                ++nCached;
+                continue;
+            }
+
+            PendingPage *pPage = new PendingPage;
+            pPage->pFile = pFile;
+            pPage->offset = offset;
+
+            Tree<uint64_t, PendingPage *> *pPages = 0;
+            if (pDisk && diskOffset)
+            {
+                pPages = disks.lookup(pDisk);
+                if (!pPages)
+                {
+                    pPages = new Tree<uint64_t, PendingPage *>;
+                    disks.insert(pDisk, pPages);
+                }
+            }
+
+            if (pPages && !pPages->contains(diskOffset))
+            {
+                pPages->insert(diskOffset, pPage);
+            }
+            else
+            {
+                unplaced.pushBack(pPage);
+            }
+        }
+    }
+
+    bool bAborted = false;
+    for (Tree<Disk *, Tree<uint64_t, PendingPage *> *>::Iterator it =
+             disks.begin();
+         it != disks.end(); ++it)
+    {
+        Disk *pDisk = it.key();
+        Tree<uint64_t, PendingPage *> *pPages = it.value();
+
+        // Coalesce the pages into runs, reading through small gaps.
+        Vector<Run> runs;
+        for (Tree<uint64_t, PendingPage *>::Iterator pit = pPages->begin();
+             pit != pPages->end(); ++pit)
+        {
+            uint64_t location = pit.key();
+            if (runs.count())
+            {
+                Run &last = runs[runs.count() - 1];
+                uint64_t end = last.location + last.length;
+                if ((location <= (end + PREFETCH_RUN_GAP)) &&
+                    ((location + pageSize - last.location) <= PREFETCH_MAX_RUN))
+                {
+                    last.length = location + pageSize - last.location;
+                    continue;
+                }
+            }
+
+            Run run;
+            run.location = location;
+            run.length = pageSize;
+            runs.pushBack(run);
+        }
+        nRuns += runs.count();
+
+        // Fill pages in disk order, keeping the disk busy reading ahead of
+        // the fills.
+        size_t nextRun = 0;
+        for (Tree<uint64_t, PendingPage *>::Iterator pit = pPages->begin();
+             pit != pPages->end(); ++pit)
+        {
+            PendingPage *pPage = pit.value();
+
+            while (!bAborted && nextRun < runs.count() &&
+                   runs[nextRun].location < (pit.key() + PREFETCH_READ_AHEAD))
+            {
+                pDisk->prefetch(runs[nextRun].location, runs[nextRun].length);
+                ++nextRun;
+            }
+
+            // Don't push anything else out of memory for the sake of a
+            // prefetch.
+            if (!bAborted && PhysicalMemoryManager::instance().freePageCount() <
+                                 MemoryPressureManager::getLowWatermark())
+            {
+                NOTICE("Prefetcher: memory is low, cutting replay short");
+                bAborted = true;
+            }
+
+            if (!bAborted && pPage->pFile->prefetchPage(pPage->offset))
+            {
+                ++nRead;
+            }
+
+            delete pPage;
+        }
+
+        delete pPages;
+    }
+
+    for (List<PendingPage *>::Iterator it = unplaced.begin();
+         it != unplaced.end(); ++it)
+    {
+        PendingPage *pPage = *it;
+        if (!bAborted && pPage->pFile->prefetchPage(pPage->offset))
+        {
+            ++nRead;
+        }
+
+        delete pPage;
+    }
+
+    Time::Timestamp elapsed = Time::getTimeNanoseconds() - start;
+
+    NOTICE(
+        "Prefetcher: replayed " << pTrace->name << ": " << Dec << nTraced
+                                << " pages, " << nCached << " cached, "
+                                << nRead << " read in " << nRuns
+                                << " disk reads, "
+                                << (elapsed / Time::Multiplier::Millisecond)
+                                << " ms");
+
+    LockGuard<Mutex> guard(m_Lock);
+    ++m_Stats.replays;
+    m_Stats.pagesTraced += nTraced;
+    m_Stats.pagesCached += nCached;
+    m_Stats.pagesRead += nRead;
+    m_Stats.runs += nRuns;
+    m_Stats.replayTime += elapsed;
+}
+
+String Prefetcher::traceName(File *pFile)
+{
+    String path = pFile->getFullPath();
+
+    String name;
+    name.Format("exec-%08x.pf", path.hash());
+    return name;
+}
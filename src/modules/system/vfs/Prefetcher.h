@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+#ifndef PREFETCHER_H
+#define PREFETCHER_H
+
+#include "pedigree/kernel/Atomic.h"
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/process/Mutex.h"
+#include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/time/Time.h"
+#include "pedigree/kernel/utilities/ExtensibleBitmap.h"
+#include "pedigree/kernel/utilities/List.h"
+#include "pedigree/kernel/utilities/String.h"
+#include "pedigree/kernel/utilities/Tree.h"
+
+class File;
+class Semaphore;
+class Thread;
+
+/// Directory the traces are kept in.
+#define PREFETCH_TRACE_DIRECTORY "root»/system/prefetch"
+
+/// How long after boot (or an exec) accesses are recorded, in seconds.
+#define PREFETCH_BOOT_WINDOW 60
+#define PREFETCH_EXEC_WINDOW 5
+
+/// Most pages one trace records.
+#define PREFETCH_MAX_TRACE_PAGES 16384
+
+/// Largest single disk read a replay asks for, and the biggest gap between
+/// two pages' blocks that still gets read through to keep a run going.
+#define PREFETCH_MAX_RUN 0x80000
+#define PREFETCH_RUN_GAP 0x8000
+
+/**
+ * The Prefetcher records which pages of which files are needed while the
+ * system boots and while each program starts up, and replays those traces
+ * the next time around by reading the pages into the page cache ahead of
+ * time.
+ *
+ * Accesses are noted by File as reads take pages from the page cache. Faults
+ * on memory maps aren't noted directly, as they hold a spinlock, but pages
+ * they have to read in are. A replay maps every traced page to its place on disk, asks each Disk for the
+ * covered ranges as a few large reads in disk order (Disk::prefetch()), and
+ * then fills the pages in that same order from a single worker thread, so
+ * that filesystems only ever see ordinary page cache fills.
+ *
+ * Traces are saved under PREFETCH_TRACE_DIRECTORY: boot.pf for boot, and one
+ * file per program, named after a hash of its path, for exec.
+ */
+class EXPORTED_PUBLIC Prefetcher
+{
+  public:
+    /** Counters, for measuring how well replays work. */
+    struct Statistics
+    {
+        /// Traces replayed.
+        size_t replays;
+        /// Pages named by replayed traces.
+        size_t pagesTraced;
+        /// Pages that were already in the page cache.
+        size_t pagesCached;
+        /// Pages read in by replays.
+        size_t pagesRead;
+        /// Disk reads issued for those pages.
+        size_t runs;
+        /// Time spent replaying, in nanoseconds.
+        Time::Timestamp replayTime;
+    };
+
+    Prefetcher();
+    ~Prefetcher();
+
+    static Prefetcher &instance()
+    {
+        return m_Instance;
+    }
+
+    /** Start the worker thread. Nothing is recorded or replayed before. */
+    void initialise();
+
+    /**
+     * Replay the trace of the previous boot, and start recording this one
+     * for the next PREFETCH_BOOT_WINDOW seconds.
+     */
+    void startBoot();
+
+    /**
+     * Called as the current process execs pFile: replay the trace of its
+     * previous startup, and record this one for PREFETCH_EXEC_WINDOW seconds.
+     */
+    void startExec(File *pFile);
+
+    /**
+     * Note that the current thread needed the page at offset into pFile.
+     * Cheap when nothing is being recorded.
+     */
+    void recordAccess(File *pFile, uint64_t offset);
+
+    Statistics getStatistics();
+
+  private:
+    Prefetcher(const Prefetcher &);
+    Prefetcher &operator=(const Prefetcher &);
+
+    /** The pages of one file named by a trace. */
+    struct TraceFile
+    {
+        TraceFile() : path(), pages(), nMaxPage(0)
+        {
+        }
+
+        String path;
+        ExtensibleBitmap pages;
+        size_t nMaxPage;
+    };
+
+    /** A trace being recorded, or loaded for replay. */
+    struct Trace
+    {
+        Trace() : files(), nPages(0), name(), deadline(0)
+        {
+        }
+        ~Trace();
+
+        /** Add a page, returning false if it was already there. */
+        bool add(File *pFile, const String &path, size_t page);
+
+        /// Files, keyed by File while recording and by position when loaded.
+        Tree<uintptr_t, TraceFile *> files;
+        size_t nPages;
+        /// Trace file name, under PREFETCH_TRACE_DIRECTORY.
+        String name;
+        /// When recording stops.
+        Time::Timestamp deadline;
+    };
+
+    /** Work for the worker thread. */
+    struct Job
+    {
+        enum Type
+        {
+            Replay,
+            Save
+        } type;
+
+        /// Trace name to replay, or the finished trace to save.
+        String name;
+        Trace *pTrace;
+    };
+
+    static int workerTrampoline(void *p);
+    void worker();
+
+    void queueJob(Job::Type type, const String &name, Trace *pTrace);
+
+    /** Stop recording any traces past their deadline, and queue saving them. */
+    void expireTraces();
+
+    /** Load the named trace, or return null if there isn't one. */
+    Trace *load(const String &name);
+    void save(Trace *pTrace);
+
+    /** Read a loaded trace's pages into the page cache. */
+    void replay(Trace *pTrace);
+
+    static String traceName(File *pFile);
+
+    static Prefetcher m_Instance;
+
+    /// Trace for this boot, while it's being recorded.
+    Trace *m_pBootTrace;
+
+    /// Traces for processes starting up, keyed by process ID.
+    Tree<size_t, Trace *> m_ExecTraces;
+
+    /// Page counts of the traces saved or loaded so far, by name hash, so
+    /// that a trace that hasn't changed isn't written out again.
+    Tree<uint32_t, size_t> m_TraceSizes;
+
+    /// Number of traces being recorded.
+    Atomic<size_t> m_nRecording;
+
+    List<Job *> m_Jobs;
+
+    Thread *m_pWorker;
+    Semaphore *m_pWake;
+
+    Statistics m_Stats;
+
+    /// Protects all of the above.
+    Mutex m_Lock;
+};
+
+#endif
@@ -139,6 +139,19 @@ class EXPORTED_PUBLIC Atomic<T, true>
             return true;
         }
         return false;
+#endif
+    }
+    /** Exchange, as a full memory barrier
+     *\param[in] newVal the new value
+     *\return the value of the Atomic before the exchange */
+    inline T exchange(T newVal)
+    {
+#if !defined(TARGET_HAS_NO_ATOMICS)
+        return __atomic_exchange_n(&m_Atom, newVal, __ATOMIC_SEQ_CST);
+#else
+        T oldVal = m_Atom;
+        m_Atom = newVal;
+        return oldVal;
 #endif
     }
     /** Get the value
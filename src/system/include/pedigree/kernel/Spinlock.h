@@ -24,14 +24,43 @@
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/processor/types.h"
 
+/** Number of locks whose contention statistics can be tracked at once. */
+#define SPINLOCK_STATISTICS_SLOTS 128
+
+/**
+ * A queued spinlock.
+ *
+ * Waiters take a ticket and spin (reading only) until their ticket comes up;
+ * only the waiter at the head of the queue touches the lock word. This keeps
+ * acquisition FIFO and stops every waiter hammering the same cache line.
+ *
+ * The lock word itself remains a plain flag, because context switches release
+ * the outgoing thread's lock with a single store once they've left its stack.
+ */
 class EXPORTED_PUBLIC Spinlock
 {
     friend class PerProcessorScheduler;
     friend class LocksCommand;
 
   public:
+    /** Contention statistics for one lock. Times are in cycles. */
+    struct Statistics
+    {
+        /** The lock, or zero if this slot is not in use. */
+        Atomic<uintptr_t> pLock;
+        /** Return address of the first contended acquire, to identify it. */
+        uintptr_t ra;
+        uint64_t nAcquires;
+        uint64_t nContended;
+        uint64_t spinTime;
+        uint64_t maxSpinTime;
+        uint64_t holdTime;
+        uint64_t maxHoldTime;
+    };
+
     Spinlock();
     Spinlock(bool bLocked, bool bAvoidTracking = false);
+    ~Spinlock();
 
     /**
      * Enter the critical section.
@@ -54,6 +83,13 @@ class EXPORTED_PUBLIC Spinlock
 
     static const bool allow_recursion = true;
 
+    /**
+     * Retrieve the statistics in the given slot. Locks are given a slot the
+     * first time they are contended.
+     * \return false if the slot is not in use.
+     */
+    static bool getStatistics(size_t n, Statistics &stats);
+
   private:
     /** Unwind the spinlock because a thread is releasing it. */
     void unwind();
@@ -61,8 +97,16 @@ class EXPORTED_PUBLIC Spinlock
     /** Track the release of this lock. */
     void trackRelease() const;
 
+    /** Find a statistics slot for this lock. */
+    bool allocateStatistics();
+
     volatile bool m_bInterrupts = false;
     Atomic<bool> m_Atom = true;  // unlocked by default
+
+    /** Next ticket to hand to a waiter. */
+    Atomic<uint32_t> m_NextTicket = 0;
+    /** Ticket of the waiter allowed to take the lock word next. */
+    volatile uint32_t m_NowServing = 0;
     /// \todo handle more than 64 CPUs.
     Atomic<uint64_t> m_CpuState = 0;
 
@@ -79,6 +123,11 @@ class EXPORTED_PUBLIC Spinlock
 
     bool m_bAvoidTracking = false;
     bool m_bOwned = false;
+
+    /** Contention statistics, once this lock has been contended. */
+    Statistics *m_pStatistics = nullptr;
+    /** When the lock was taken, if it has statistics. */
+    uint64_t m_AcquiredAt = 0;
 };
 
 #endif
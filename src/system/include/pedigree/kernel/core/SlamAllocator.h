@@ -50,6 +50,13 @@ class SlamCache;
 /// Minimum slab size in bytes
 #define SLAB_MINIMUM_SIZE (4096 * SLAB_SIZE)
 
+/// Objects at least this big share large slabs, which can be backed by huge
+/// pages, rather than getting a slab each.
+#define SLAB_LARGE_OBJECT_SIZE (512 * 1024)
+
+/// Size of large slabs in bytes (one 2MB huge page).
+#define SLAB_LARGE_SIZE (2 * 1024 * 1024)
+
 /// Define if using the magic number method of slab recovery.
 /// This turns recovery into an O(n) instead of O(n^2) algorithm,
 /// but relies on a magic number which introduces false positives
@@ -276,6 +283,18 @@ class SlamAllocator
         return m_HeapPageCount;
     }
 
+    /** Number of huge pages mapped for large slabs. */
+    size_t hugeSlabHits() const
+    {
+        return m_HugeSlabHits;
+    }
+
+    /** Number of times a large slab had to be mapped with normal pages. */
+    size_t hugeSlabFallbacks() const
+    {
+        return m_HugeSlabFallbacks;
+    }
+
     uintptr_t getSlab(size_t fullSize);
     void freeSlab(uintptr_t address, size_t length);
 
@@ -354,6 +373,9 @@ class SlamAllocator
 
     size_t m_HeapPageCount;
 
+    size_t m_HugeSlabHits;
+    size_t m_HugeSlabFallbacks;
+
     uint64_t *m_SlabRegionBitmap;
     size_t m_SlabRegionBitmapEntries;
 
@@ -48,6 +48,9 @@ class Spinlock;
 
 #define LOCKS_COMMAND_DO_BACKTRACES 0
 
+/** Number of locks listed by "locks stats". */
+#define LOCKS_COMMAND_STATS_LINES 8
+
 /**
  * Traces lock allocations.
  */
@@ -72,7 +75,8 @@ class LocksCommand : public DebuggerCommand, public Scrollable
     void autocomplete(const HugeStaticString &input, HugeStaticString &output);
 
     /**
-     * Execute the command with the given screen.
+     * Execute the command with the given screen. "locks stats" lists the
+     * most contended spinlocks instead of the lock tracker.
      */
     bool execute(
         const HugeStaticString &input, HugeStaticString &output,
@@ -127,6 +131,9 @@ class LocksCommand : public DebuggerCommand, public Scrollable
     void clearFatal();
 
   private:
+    /** Formats the most contended spinlocks' statistics into output. */
+    void statistics(HugeStaticString &output);
+
     enum State
     {
         /// This entry is no longer active.
@@ -20,6 +20,7 @@
 #include "pedigree/kernel/debugger/DebuggerCommand.h"
 #include "pedigree/kernel/debugger/DebuggerIO.h"
 #include "pedigree/kernel/debugger/Scrollable.h"
+#include "pedigree/kernel/processor/SyscallManager.h"
 #include "pedigree/kernel/processor/state_forward.h"
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/utilities/StaticString.h"
@@ -44,6 +45,9 @@ class SyscallTracerCommand : public DebuggerCommand, public Scrollable
      * screen while executing, but must return it to CLI mode (via enableCLI)
      * before returning. \return True if the debugger should continue accepting
      * commands, false if it should return control to the kernel.
+     *
+     * Lists every syscall that has completed, with its call count, average
+     * and worst time and latency histogram (see SYSCALL_STATISTICS).
      */
     bool execute(
         const HugeStaticString &input, HugeStaticString &output,
@@ -66,4 +70,10 @@ class SyscallTracerCommand : public DebuggerCommand, public Scrollable
         size_t index, size_t &colOffset, DebuggerIO::Colour &colour,
         DebuggerIO::Colour &bgColour);
     virtual size_t getLineCount();
+
+  private:
+    /** Syscalls with statistics, as service * SYSCALL_STATISTICS_NUMBERS +
+     *  number, gathered when the command is executed. */
+    uint16_t m_Syscalls[serviceEnd * SYSCALL_STATISTICS_NUMBERS];
+    size_t m_nSyscalls;
 };
@@ -75,6 +75,20 @@ class EXPORTED_PUBLIC Disk : public Device
      */
     virtual void write(uint64_t location);
 
+    /**
+     * \brief Hints that the given range of the disk will be read soon.
+     *
+     * Implementations may start reading the range into their cache in the
+     * background, so that a later \c read() finds it there. Nothing is
+     * pinned. Callers should ask for large ranges, and in increasing order of
+     * location where they can, as that's how disks like to be read.
+     *
+     * The default implementation does nothing.
+     * \param location The offset from the start of the device, in bytes.
+     * \param size The number of bytes that will be read.
+     */
+    virtual void prefetch(uint64_t location, uint64_t size);
+
     /**
      * \brief Sets the page boundary alignment after a specific location on the
      * disk.
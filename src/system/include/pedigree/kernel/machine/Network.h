@@ -66,6 +66,23 @@ class EXPORTED_PUBLIC StationInfo
 class EXPORTED_PUBLIC Network : public Device
 {
   public:
+    /** Checksums a device computes (Generate*) or verifies (Check*) itself,
+     *  which the network stack can then skip in software. */
+    enum ChecksumOffload
+    {
+        GenerateIpv4Checksum = 1 << 0,
+        GenerateUdpChecksum = 1 << 1,
+        GenerateTcpChecksum = 1 << 2,
+        GenerateIcmpChecksum = 1 << 3,
+        GenerateIcmpv6Checksum = 1 << 4,
+
+        CheckIpv4Checksum = 1 << 8,
+        CheckUdpChecksum = 1 << 9,
+        CheckTcpChecksum = 1 << 10,
+        CheckIcmpChecksum = 1 << 11,
+        CheckIcmpv6Checksum = 1 << 12,
+    };
+
     Network();
     Network(Network *pDev);
     virtual ~Network();
@@ -91,6 +108,9 @@ class EXPORTED_PUBLIC Network : public Device
     /** Is this device actually connected to a network? */
     virtual bool isConnected();
 
+    /** Which checksums does this device handle itself? (ChecksumOffload) */
+    virtual uint32_t getChecksumOffload();
+
     /** Converts an IPv4 address into an integer */
     EXPORTED_PUBLIC static uint32_t
     convertToIpv4(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
@@ -89,11 +89,22 @@ class EXPORTED_PUBLIC MemoryPressureManager
         return 32;
     }
 
+    static size_t getReclaimWatermark()
+    {
+        // Background reclaim, once started at the low water mark, carries on
+        // until this many pages are free so that it isn't needed again by the
+        // very next allocation.
+        return 64;
+    }
+
     /**
      * Attempt to alleviate memory pressure by requesting registered
      * handlers release pages that can be safely released.
+     *
+     * Handlers registered at a lower priority than lowestPriority are not
+     * run, which lets background reclaim avoid the more drastic handlers.
      */
-    bool compact();
+    bool compact(size_t lowestPriority = LowestPriority);
 
     /**
      * Register a new handler.
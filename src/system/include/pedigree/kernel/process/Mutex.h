@@ -49,19 +49,123 @@ class Mutex
 
 #ifdef THREADS
 
+#include "pedigree/kernel/Atomic.h"
+#include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/compiler.h"
-#include "pedigree/kernel/process/Semaphore.h"
+#include "pedigree/kernel/process/Event.h"
+#include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/utilities/List.h"
+#include "pedigree/kernel/utilities/Result.h"
 
-/**
- * A mutex, or binary semaphore
- */
-class EXPORTED_PUBLIC Mutex : public Semaphore
+class Thread;
+
+/** Number of times a contended acquire polls the mutex while its owner is
+ *  running on another processor, before queueing and going to sleep. */
+#define MUTEX_SPIN_LIMIT 1000
+
+/** A sleeping lock with a single owner.
+ *
+ *  Uncontended acquire and release are a single compare-and-swap each. A
+ *  contended acquire polls while the owner is running on another processor,
+ *  and only then queues and sleeps. release() hands the mutex directly to the
+ *  first sleeping waiter, so a thread that never queued can't take it from
+ *  under the waiter.
+ *
+ *  The interface matches a binary Semaphore. The owner is tracked for
+ *  debugging, but is not enforced: drivers release a locked Mutex from an IRQ
+ *  handler to wake the thread waiting on it. */
+class EXPORTED_PUBLIC Mutex
 {
   public:
+    enum MutexError
+    {
+        TimedOut,
+        Interrupted,
+    };
+    typedef Result<bool, MutexError> MutexResult;
+
     /** Constructor */
     Mutex(bool bLocked = false);
     /** Destructor */
-    ~Mutex();
+    virtual ~Mutex();
+
+    /** Acquires the mutex, blocking until it is available.
+     * \param n Must be 1; present for compatibility with Semaphore. Any
+     *          other value fails without acquiring.
+     * \param timeoutSecs Timeout value in seconds - if zero, no timeout.
+     * \return a Result with a bool value indicating success if no timeout
+     * took place, a Result with a MutexError error otherwise. */
+    MutexResult acquireWithResult(
+        size_t n = 1, size_t timeoutSecs = 0, size_t timeoutUsecs = 0);
+
+    /** Convenience wrapper for acquireWithResult(). */
+    bool acquire(size_t n = 1, size_t timeoutSecs = 0, size_t timeoutUsecs = 0)
+    {
+        MutexResult result = acquireWithResult(n, timeoutSecs, timeoutUsecs);
+        if (result.hasValue())
+        {
+            return result.value();
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    /** Attempts to acquire the mutex without blocking. n must be 1.
+     * \return True if acquire succeeded, false otherwise. */
+    bool tryAcquire(size_t n = 1);
+
+    /** Releases the mutex, handing it to a waiting thread if there is one.
+     *  n must be 1; any other value is rejected and the mutex stays held. */
+    void release(size_t n = 1);
+
+    /** Gets the current value of the mutex: 1 if unlocked, 0 if locked. */
+    ssize_t getValue();
+
+    /** Gets the thread that last acquired the mutex, if it is still held. */
+    Thread *getOwner() const
+    {
+        return m_pOwner;
+    }
+
+  private:
+    /** Private copy constructor
+        \note NOT implemented. */
+    Mutex(const Mutex &);
+    /** Private operator=
+        \note NOT implemented. */
+    void operator=(const Mutex &);
+
+    /** Whether the owner is currently running on another processor, and so
+     *  is worth waiting for without sleeping. */
+    bool ownerRunning();
+
+    /** Removes the given thread from the wait queue. m_Lock must be held. */
+    void removeThread(Thread *pThread);
+
+    /** Internal event class - interrupts the calling thread on timeout. */
+    class MutexEvent : public Event
+    {
+      public:
+        MutexEvent();
+        virtual ~MutexEvent();
+        virtual size_t serialize(uint8_t *pBuffer);
+        static bool unserialize(uint8_t *pBuffer, MutexEvent &event);
+        virtual size_t getNumber();
+    };
+
+    /** 1 if the mutex is available, 0 if it is held. */
+    Atomic<size_t> m_Value;
+    /** Thread holding the mutex (or that it was handed to). */
+    Thread *volatile m_pOwner;
+    /** Processor the owner acquired the mutex on. */
+    volatile size_t m_OwnerProcessor;
+    /** Number of threads queued (or about to queue) on the mutex. */
+    Atomic<size_t> m_nWaiters;
+    /** Protects the wait queue. */
+    Spinlock m_Lock;
+    List<Thread *> m_Queue;
 };
 
 #endif  // THREADS
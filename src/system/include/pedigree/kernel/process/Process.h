@@ -78,6 +78,12 @@ class EXPORTED_PUBLIC Process
         Reaped,  /// Reaped means the process has had a status retrieved.
     };
 
+    /** Tag type selecting the vfork()-style constructor. */
+    enum BorrowAddressSpaceTag
+    {
+        BorrowAddressSpace
+    };
+
     /** Default constructor. */
     Process();
 
@@ -90,6 +96,14 @@ class EXPORTED_PUBLIC Process
      */
     Process(Process *pParent, bool bCopyOnWrite = true);
 
+    /** Constructor for creating a new Process as a UNIX vfork() would. The
+     * new Process runs in its parent's address space, without copying it,
+     * until it calls detachAddressSpace() or terminates. The parent must not
+     * run in userspace until then. This constructor does not create any
+     * threads.
+     * \param pParent The parent process. */
+    Process(Process *pParent, BorrowAddressSpaceTag);
+
     /** Destructor. */
     virtual ~Process();
 
@@ -407,6 +421,29 @@ class EXPORTED_PUBLIC Process
         return m_bSharedAddressSpace;
     }
 
+    /** Whether this process is still running in its parent's address space
+     * (i.e. it was created by the vfork() constructor and has not yet called
+     * detachAddressSpace()). */
+    bool hasBorrowedAddressSpace() const
+    {
+        return m_bBorrowedAddressSpace;
+    }
+
+    /** Sets a Semaphore to release once this process stops borrowing its
+     * parent's address space, whether by detachAddressSpace() or by
+     * terminating. */
+    void setBorrowWaiter(Semaphore *pWaiter)
+    {
+        m_pBorrowWaiter = pWaiter;
+    }
+
+    /** Gives this process a new address space with an empty user region
+     * in place of the one borrowed from its parent, switches to it, and
+     * releases the borrow waiter. Must be called from a thread in this
+     * process. Does nothing if the address space is not borrowed.
+     * \return false if the new address space could not be created. */
+    bool detachAddressSpace();
+
     /**
      * Get the init process (first userspace process, parent of all
      * userspace processes).
@@ -514,6 +551,9 @@ class EXPORTED_PUBLIC Process
     /** Releases all locks in m_Waiters once. */
     void notifyWaiters();
 
+    /** Releases m_pBorrowWaiter, if set, and clears it. */
+    void releaseBorrowWaiter();
+
     /** Stores metadata about this process. */
     struct ProcessMetadata
     {
@@ -554,6 +594,12 @@ class EXPORTED_PUBLIC Process
     /** Is our address space shared with the parent? */
     bool m_bSharedAddressSpace;
 
+    /** Are we running in our parent's address space until exec or exit? */
+    bool m_bBorrowedAddressSpace;
+
+    /** Released once we stop borrowing our parent's address space. */
+    Semaphore *m_pBorrowWaiter;
+
     /** Init process (terminated processes' children will reparent to this). */
     static Process *m_pInitProcess;
 
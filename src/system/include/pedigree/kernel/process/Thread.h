@@ -74,6 +74,7 @@ class EXPORTED_PUBLIC Thread
     {
         None,
         SemWait,
+        MutexWait,
         CondWait,
         Joining
     };
@@ -0,0 +1,103 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_PROCESSOR_PAGEFRAME_H
+#define KERNEL_PROCESSOR_PAGEFRAME_H
+
+#include "pedigree/kernel/Atomic.h"
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+/** @addtogroup kernelprocessor
+ * @{ */
+
+/** Metadata for one physical page. The PhysicalMemoryManager keeps one of
+ * these per page frame in a flat array indexed by page frame number, so
+ * finding the metadata for a page is a single index.
+ *
+ * A page that has never been pinned has a refcount of zero and a single
+ * implicit owner. Every pin() adds a reference, and the page is only freed
+ * once unpin() (via PhysicalMemoryManager::freePage) drops it back to zero.
+ * Reference counting is lock-free. */
+struct PageFrame
+{
+    /** Bits for the flags field. */
+    enum Flags
+    {
+        /** The page has been accessed since it was last aged. */
+        Referenced = 1 << 0,
+        /** The page holds data not yet written back to its owner. */
+        Dirty = 1 << 1,
+        /** The page heads a free block in a BuddyAllocator. */
+        Free = 1 << 2
+    };
+
+    /** Add a reference to the page. */
+    void pin()
+    {
+        refcount += 1;
+    }
+
+    /** Drop a reference to the page.
+     * \return true if no references remain and the page can be freed. */
+    bool unpin()
+    {
+        while (true)
+        {
+            uint32_t current = refcount;
+            if (!current)
+            {
+                // Never pinned (or no pins left), so the caller was the only
+                // owner.
+                return true;
+            }
+
+            if (refcount.compareAndSwap(current, current - 1))
+            {
+                return current == 1;
+            }
+        }
+    }
+
+    /** References to the page, beyond the implicit owner. */
+    Atomic<uint32_t> refcount;
+
+    /** Number of page table entries mapping the page, for reverse mapping. */
+    Atomic<uint32_t> mapcount;
+
+    /** Flags from PageFrame::Flags. */
+    Atomic<uint32_t> flags;
+
+    /** Order of the free block this page heads, if flags has Free. */
+    uint32_t order;
+
+    /** The cache (or other object) holding this page, if any. */
+    void *owner;
+
+    /** Offset of this page within its owner. */
+    uint64_t offset;
+
+    /** Links for the owner's (or reclaim's) LRU list. */
+    PageFrame *prev;
+    PageFrame *next;
+};
+
+/** @} */
+
+#endif
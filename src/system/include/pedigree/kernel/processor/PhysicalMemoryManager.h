@@ -28,6 +28,8 @@
  * @{ */
 
 class MemoryRegion;
+class String;
+struct PageFrame;
 
 /** The PhysicalMemoryManager manages the physical address space. That means it
  * provides functions to allocate and free pages. */
@@ -82,9 +84,32 @@ class EXPORTED_PUBLIC PhysicalMemoryManager
     /** Allocate a single page with optional constraints.
      * \return physical address of the page or 0 if no page available. */
     virtual physical_uintptr_t allocatePage(size_t pageConstraints = 0) = 0;
+    /** Allocate a single page that is filled with zeroes, preferably from a
+     *  pool of pages zeroed ahead of time. Freed with freePage().
+     * \return physical address of the page or 0 if no page available. */
+    virtual physical_uintptr_t allocateZeroedPage(size_t pageConstraints = 0);
+
     /** Free a page allocated with the allocatePage() function
      *\param[in] page physical address of the page */
     virtual void freePage(physical_uintptr_t page) = 0;
+    /** Allocate several pages at once, for callers that need many (fork,
+     *  readahead). Each page is freed individually with freePage().
+     *\param[in] count number of pages wanted
+     *\param[out] pages receives the physical address of each page
+     *\param[in] pageConstraints as for allocatePage()
+     *\return number of pages allocated, less than count if memory ran out */
+    virtual size_t allocatePages(
+        size_t count, physical_uintptr_t *pages, size_t pageConstraints = 0);
+    /** Allocate 2^order physically contiguous pages, aligned to their size.
+     *\param[in] order log2 of the number of pages wanted
+     *\param[in] pageConstraints as for allocatePage()
+     *\return physical address of the block, or 0 if none is available */
+    virtual physical_uintptr_t
+    allocateBlock(size_t order, size_t pageConstraints = 0);
+    /** Free a block allocated with allocateBlock().
+     *\param[in] block physical address of the block
+     *\param[in] order the order it was allocated with */
+    virtual void freeBlock(physical_uintptr_t block, size_t order);
 
     /**
      * "Pin" a page, increasing its refcount.
@@ -97,6 +122,12 @@ class EXPORTED_PUBLIC PhysicalMemoryManager
      */
     virtual void pin(physical_uintptr_t page) = 0;
 
+    /** Get the metadata for a physical page.
+     *\param[in] page physical address of the page
+     *\return the page's PageFrame, or null if the page isn't tracked (e.g.
+     *        it isn't RAM) */
+    virtual PageFrame *pageFrame(physical_uintptr_t page);
+
     /** Allocate a memory-region with specific constraints the pages need to
      *fullfill. \param[in] Region reference to the MemoryRegion object
      *\param[in] cPages the number of pages to allocate for the MemoryRegion
@@ -148,6 +179,16 @@ class EXPORTED_PUBLIC PhysicalMemoryManager
     /** Specifies the number of pages that remain free on the system. */
     virtual size_t freePageCount() const;
 
+    /** Number of allocateZeroedPage() calls served by pre-zeroed pages. */
+    virtual size_t zeroedPageHits() const;
+
+    /** Number of allocateZeroedPage() calls that had to zero a page. */
+    virtual size_t zeroedPageMisses() const;
+
+    /** Append a report of free blocks of each order in each zone, in the
+     *  format of Linux's /proc/buddyinfo. */
+    virtual void fragmentationReport(String &report);
+
   protected:
     /** The constructor */
     PhysicalMemoryManager();
@@ -82,8 +82,10 @@ class EXPORTED_PUBLIC Processor
     friend class Multiprocessor;
     friend class X86GdtManager;
     friend class X64GdtManager;
+    friend class TlbShootdown;
 #ifdef THREADS
     friend class Scheduler;
+    friend class Mutex;
 #endif
   public:
     /** Initialises the processor specific interface. After this function call
@@ -293,6 +295,10 @@ class EXPORTED_PUBLIC Processor
         static void
         invalidate(void *pAddress);
 
+    /** Invalidate the whole TLB
+     *\param[in] bGlobal whether to also invalidate global pages */
+    static void invalidateAll(bool bGlobal = false);
+
 #if defined(X86_COMMON)
     static physical_uintptr_t readCr3();
 #endif
@@ -377,7 +383,15 @@ class EXPORTED_PUBLIC Processor
     static void _reset() NORETURN;
     static void _haltUntilInterrupt();
 
-    static bool m_bInterrupts;
+    /** Each virtual processor is a host thread, so the interrupt flag (which
+     *  mirrors that thread's signal mask) is thread-local. */
+    static __thread bool m_bInterrupts;
+
+#if defined(MULTIPROCESSOR)
+    /** The ProcessorInformation of the virtual processor running on the
+     *  current host thread, stands in for the local APIC ID lookup. */
+    static __thread ProcessorInformation *m_pLocalInformation;
+#endif
 #endif
 
 /** If we have only one processor, we define the ProcessorInformation class here
@@ -26,6 +26,11 @@
 
 class SyscallHandler;
 
+/** Syscall numbers (per service) that statistics are kept for. */
+#define SYSCALL_STATISTICS_NUMBERS 512
+/** Buckets in each syscall's log2 latency histogram. */
+#define SYSCALL_STATISTICS_BUCKETS 40
+
 /** @addtogroup kernelprocessor
  * @{ */
 
@@ -49,6 +54,48 @@ class SyscallManager
         uintptr_t p2 = 0, uintptr_t p3 = 0, uintptr_t p4 = 0,
         uintptr_t p5 = 0) = 0;
 
+    /** Per-syscall statistics, kept when the kernel is built with
+     *  SYSCALL_STATISTICS. Times are in TSC cycles. */
+    struct Statistics
+    {
+        /** Number of completed calls. */
+        uint64_t nCalls;
+        /** Total and longest time spent in the handler. */
+        uint64_t totalTime;
+        uint64_t maxTime;
+        /** histogram[n] counts calls taking [2^n, 2^(n+1)) cycles; the last
+         *  bucket also holds everything slower. */
+        uint64_t histogram[SYSCALL_STATISTICS_BUCKETS];
+    };
+
+    /** Cheap timestamp for syscall statistics. */
+    inline static uint64_t statisticsTimestamp()
+    {
+#if defined(X86_COMMON) || defined(HOSTED)
+        uint32_t lo, hi;
+        asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+        return (static_cast<uint64_t>(hi) << 32ULL) | lo;
+#else
+        return 0;
+#endif
+    }
+
+    /** Records a completed syscall against the current processor.
+     *\param[in] service the service the syscall was made to
+     *\param[in] number the syscall number within the service
+     *\param[in] time cycles spent handling the syscall */
+    static void
+    recordStatistics(Service_t service, size_t number, uint64_t time);
+
+    /** Gets the statistics of a syscall, summed over all processors.
+     * \return false if the syscall has never completed (or statistics are
+     *        not being kept), true otherwise */
+    EXPORTED_PUBLIC static bool
+    getStatistics(Service_t service, size_t number, Statistics &stats);
+
+    /** Gets a short name for a service, for reporting statistics. */
+    EXPORTED_PUBLIC static const char *getServiceName(Service_t service);
+
   protected:
     /** The constructor */
     SyscallManager();
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_PROCESSOR_TLBSHOOTDOWN_H
+#define KERNEL_PROCESSOR_TLBSHOOTDOWN_H
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+class VirtualAddressSpace;
+
+/** @addtogroup kernelprocessor
+ * @{ */
+
+/**
+ * \brief Gathers the TLB invalidations of one operation on an address space.
+ *
+ * Pages are added as their mappings change and invalidated together by
+ * flush() (or the destructor): locally, and on every other processor that has
+ * the address space active with a single shootdown IPI for the whole batch.
+ * A batch of more than MaxPages pages flushes the whole TLB instead.
+ *
+ * Physical pages that were mapped at the invalidated addresses can be handed
+ * to free(), which only frees them once no processor can still reach them
+ * through a stale TLB entry. Paging structures go to freeTable() instead: with
+ * PCIDs, invlpg only drops the paging-structure caches of the current PCID,
+ * so freeing a kernel table flushes every PCID on every processor.
+ *
+ * Processors are tracked with one bit each in a 64-bit mask, so processors
+ * with an ID of MaxProcessors or more are never started.
+ */
+class EXPORTED_PUBLIC TlbShootdown
+{
+  public:
+    /** Most pages invalidated one at a time before flushing everything. */
+    static const size_t MaxPages = 32;
+
+    /** Most pages held by free() before the batch is flushed early. */
+    static const size_t MaxFreePages = 64;
+
+    /** Processor IDs that shootdowns can be sent to are below this. */
+    static const size_t MaxProcessors = 64;
+
+    TlbShootdown(VirtualAddressSpace &addressSpace);
+    ~TlbShootdown();
+
+    /** Invalidate the TLB entry for virtualAddress on flush(). */
+    void add(void *virtualAddress);
+
+    /** Invalidate every (non-global) TLB entry for the address space. */
+    void addAll();
+
+    /** Free the given physical page after the next flush(). */
+    void free(physical_uintptr_t page);
+
+    /** Free the given paging structure after the next flush(). */
+    void freeTable(physical_uintptr_t page);
+
+    /** Carry out the invalidations gathered so far and free any pages. */
+    void flush();
+
+    /** Handle the shootdown pending for this processor, if any. Called from
+     *  the shootdown IPI, and by processors spinning with interrupts
+     *  disabled, which would otherwise never see the IPI. */
+    static void poll();
+
+    /** Called by each processor once it can take shootdown IPIs. */
+    static void processorOnline();
+
+    /** Number of shootdown IPIs sent so far. */
+    static size_t interruptsSent();
+
+    /** Number of batches that flushed the whole TLB. */
+    static size_t fullFlushes();
+
+  private:
+    TlbShootdown(const TlbShootdown &);
+    TlbShootdown &operator=(const TlbShootdown &);
+
+    VirtualAddressSpace &m_AddressSpace;
+
+    uintptr_t m_Pages[MaxPages];
+    size_t m_nPages;
+
+    physical_uintptr_t m_FreePages[MaxFreePages];
+    size_t m_nFreePages;
+
+    /** Whether the whole TLB is to be flushed. */
+    bool m_bFlushAll;
+
+    /** Whether any page is in the kernel's part of the address space, which
+     *  every processor shares. */
+    bool m_bKernel;
+
+    /** Whether any of the pages to free held paging structures. */
+    bool m_bTablesFreed;
+};
+
+/** @} */
+
+#endif
@@ -20,9 +20,12 @@
 #ifndef KERNEL_PROCESSOR_VIRTUALADDRESSSPACE_H
 #define KERNEL_PROCESSOR_VIRTUALADDRESSSPACE_H
 
+#include "pedigree/kernel/Atomic.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/processor/types.h"
 
+class TlbShootdown;
+
 /** @addtogroup kernelprocessor
  * @{ */
 
@@ -118,6 +121,46 @@ class VirtualAddressSpace
     virtual bool mapHuge(
         physical_uintptr_t physAddress, void *virtualAddress, size_t count,
         size_t flags);
+    /** Size of the pages mapped by mapHugePage(), or zero if the address
+     *  space doesn't support them. */
+    virtual size_t getHugePageSize() const
+    {
+        return 0;
+    }
+    /** Map a single huge page. Both addresses must be aligned to
+     *  getHugePageSize().
+     *\note Fails if anything is already mapped in the range, so the caller
+     *      can fall back to mapping normal pages.
+     *\return true if successful, false otherwise */
+    virtual bool mapHugePage(
+        physical_uintptr_t physAddress, void *virtualAddress, size_t flags)
+    {
+        return false;
+    }
+    /** Whether mapHugePage() could map a huge page at virtualAddress, i.e.
+     *  nothing is mapped anywhere in its range yet. */
+    virtual bool canMapHugePage(void *virtualAddress)
+    {
+        return false;
+    }
+    /** Whether the given address is mapped by a huge page. */
+    virtual bool isHugePage(void *virtualAddress)
+    {
+        return false;
+    }
+    /** Remove a huge page mapped with mapHugePage(). The physical memory is
+     *  not freed. */
+    virtual void unmapHugePage(void *virtualAddress)
+    {
+    }
+    /** Replace the huge page covering virtualAddress, if any, with normal
+     *  pages mapping the same memory with the same flags. Parts of it can
+     *  then be unmapped or remapped individually. unmap() does this itself.
+     *\return false if the page tables couldn't be allocated */
+    virtual bool splitHugePage(void *virtualAddress)
+    {
+        return true;
+    }
     /** Get the physical address and the flags associated with the specific
      *virtual address. \note This function is only valid on memory that was
      *mapped with VirtualAddressSpace::map() and that is still mapped or marked
@@ -137,6 +180,54 @@ class VirtualAddressSpace
      *VirtualAddressSpace::map() and that is still mapped or marked as swapped
      *out. \param[in] virtualAddress the virtual address */
     virtual void unmap(void *virtualAddress) = 0;
+    /** As setFlags(), but the TLB invalidation is added to \p shootdown
+     *instead of being carried out straight away. */
+    virtual void setFlagsBatched(
+        void *virtualAddress, size_t newFlags, TlbShootdown &shootdown)
+    {
+        setFlags(virtualAddress, newFlags);
+    }
+    /** As unmap(), but the TLB invalidation is added to \p shootdown
+     *instead of being carried out straight away. */
+    virtual void unmapBatched(void *virtualAddress, TlbShootdown &shootdown)
+    {
+        unmap(virtualAddress);
+    }
+    /** Clear the accessed bit of the page at a specific virtual address.
+     *The TLB is not flushed, so an access through an entry still cached there
+     *can go unnoticed - this is only a hint for page aging. \note
+     *Architectures that don't track accesses always return false. \param[in]
+     *virtualAddress the virtual address \return whether the page was accessed
+     *since the accessed bit was last cleared */
+    virtual bool clearAccessed(void *virtualAddress)
+    {
+        return false;
+    }
+    /** Whether the page at a specific virtual address is marked as swapped
+     *out, by map() with the Swapped flag, rather than mapped or not mapped
+     *at all. The physical address getMapping() gives for such a page is the
+     *swap entry it was mapped with. \note Architectures that can't keep swap
+     *entries in their page tables always return false. \param[in]
+     *virtualAddress the virtual address */
+    virtual bool isSwapped(void *virtualAddress)
+    {
+        return false;
+    }
+    /** Copy into memory in this address space, which need not be the active
+     *one. The source must be in the active address space. \note Copying
+     *stops at the first destination page that is not mapped writable.
+     *\return the number of bytes copied */
+    virtual size_t
+    copyInto(void *destination, const void *source, size_t size);
+    /** Lend the page at \p page (in this, the active, address space) to
+     *\p target, where it replaces the page at \p targetPage. Both mappings
+     *become copy-on-write, so neither side sees the other's later writes.
+     *\return true if the page was lent, false if nothing has changed */
+    virtual bool
+    lendPage(void *page, VirtualAddressSpace &target, void *targetPage)
+    {
+        return false;
+    }
 
     /** Allocates a single stack for a thread. Will use the default kernel
      * thread size. */
@@ -179,6 +270,40 @@ class VirtualAddressSpace
         m_HeapEnd = heapEnd;
     }
 
+    /** Note that a processor has switched to (or away from) this address
+     * space. */
+    void setActive(size_t processor, bool bActive)
+    {
+        if (bActive)
+            m_ActiveProcessors |= (1ULL << processor);
+        else
+            m_ActiveProcessors &= ~(1ULL << processor);
+    }
+
+    /** Processors that have this address space active, one bit each. */
+    uint64_t getActiveProcessors() const
+    {
+        return m_ActiveProcessors;
+    }
+
+    /** Note that the given processors may have TLB entries for this address
+     * space left that switching to it would not flush (e.g. with PCIDs). */
+    void markStale(uint64_t processors)
+    {
+        m_StaleProcessors |= processors;
+    }
+
+    /** Whether processor must flush this address space's TLB entries as it
+     * switches to it. Clears the processor's mark. */
+    bool clearStale(size_t processor)
+    {
+        uint64_t bit = 1ULL << processor;
+        if ((m_StaleProcessors & bit) == 0)
+            return false;
+        m_StaleProcessors &= ~bit;
+        return true;
+    }
+
     /** Determines whether a given address is within the kernel's heap region.
      */
     virtual bool memIsInKernelHeap(void *pMem) = 0;
@@ -283,7 +408,9 @@ class VirtualAddressSpace
 
   protected:
     /** The constructor does nothing */
-    inline VirtualAddressSpace(void *Heap) : m_Heap(Heap), m_HeapEnd(Heap)
+    inline VirtualAddressSpace(void *Heap)
+        : m_Heap(Heap), m_HeapEnd(Heap), m_ActiveProcessors(0),
+          m_StaleProcessors(~0ULL)
     {
     }
 
@@ -301,6 +428,11 @@ class VirtualAddressSpace
      *\param[in] virtualAddress current heap address
      *\param[in] pageCount number of mapped pages to unmap and free */
     void rollbackHeapExpansion(void *virtualAddress, size_t pageCount);
+
+    /** Processors that have this address space active. */
+    Atomic<uint64_t> m_ActiveProcessors;
+    /** Processors that may have stale TLB entries for this address space. */
+    Atomic<uint64_t> m_StaleProcessors;
 };
 
 /** @} */
@@ -38,6 +38,7 @@ class EXPORTED_PUBLIC X86CommonProcessorInformation
 {
     friend class Processor;
     friend class Multiprocessor;
+    friend class TlbShootdown;
 
   public:
 #if defined(X86)
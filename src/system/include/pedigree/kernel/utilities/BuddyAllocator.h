@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_BUDDYALLOCATOR_H
+#define KERNEL_UTILITIES_BUDDYALLOCATOR_H
+
+/** @addtogroup kernelutilities
+ * @{ */
+
+#include "pedigree/kernel/Spinlock.h"
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+struct PageFrame;
+
+/**
+ * \brief Binary buddy allocator for one zone of physical memory.
+ *
+ * Free memory is kept as blocks of 2^order pages, each aligned to its own
+ * size. Allocating splits a larger block when no block of the wanted order is
+ * free, and freeing merges a block with its buddy for as long as the buddy is
+ * free too, so contiguous memory is recovered as pages come back.
+ *
+ * Free lists are threaded through the PageFrame of the first page of each
+ * block, so the allocator needs no memory of its own.
+ */
+class EXPORTED_PUBLIC BuddyAllocator
+{
+  public:
+    /** Largest block is 2^MaxOrder pages (4 MiB with 4 KiB pages). */
+    static const size_t MaxOrder = 10;
+
+    /** Maps between physical pages and their PageFrames. */
+    class FrameMap
+    {
+      public:
+        virtual ~FrameMap()
+        {
+        }
+
+        /** The PageFrame for a physical page, or null if it has none. */
+        virtual PageFrame *frame(physical_uintptr_t page) = 0;
+
+        /** The physical page a PageFrame describes. */
+        virtual physical_uintptr_t address(PageFrame *pFrame) = 0;
+    };
+
+    BuddyAllocator();
+
+    /** Manage pages in [base, limit). The zone starts out empty. Page zero
+     * must never be freed into a zone, as 0 means an allocation failed. */
+    void setup(
+        FrameMap *pFrames, physical_uintptr_t base, physical_uintptr_t limit);
+
+    /** Whether the given page falls within this zone. */
+    bool contains(physical_uintptr_t page) const
+    {
+        return page >= m_Base && page < m_Limit;
+    }
+
+    /** Allocate a block of 2^order pages. 0 if none is available. */
+    physical_uintptr_t allocate(size_t order);
+
+    /** Allocate up to count single pages, returning how many were. */
+    size_t allocate(physical_uintptr_t *pages, size_t count);
+
+    /**
+     * Allocate count physically contiguous pages. The result is aligned to
+     * the smallest power of two pages that holds count, or to a block of
+     * 2^MaxOrder pages if count is larger than that. 0 if there is no block
+     * (or run of adjacent largest blocks) large enough.
+     */
+    physical_uintptr_t allocateRange(size_t count);
+
+    /** Allocate count pages starting at a specific address. */
+    bool allocateSpecific(physical_uintptr_t address, size_t count);
+
+    /** Free a block of 2^order pages. */
+    void free(physical_uintptr_t address, size_t order);
+
+    /** Free count single pages. */
+    void free(const physical_uintptr_t *pages, size_t count);
+
+    /** Free count contiguous pages, of any alignment. */
+    void freeRange(physical_uintptr_t address, size_t count);
+
+    /** Number of free pages in the zone. */
+    size_t freePages() const
+    {
+        return m_FreePages;
+    }
+
+    /** Number of free blocks of the given order, for fragmentation reports. */
+    size_t freeBlocks(size_t order) const
+    {
+        return order <= MaxOrder ? m_FreeBlocks[order] : 0;
+    }
+
+  private:
+    BuddyAllocator(const BuddyAllocator &);
+    BuddyAllocator &operator=(const BuddyAllocator &);
+
+    /** Size in bytes of a block of the given order. */
+    static size_t blockSize(size_t order);
+
+    /** Largest order block that starts at address and fits in count pages. */
+    static size_t largestOrder(physical_uintptr_t address, size_t count);
+
+    /** Take a run of adjacent free blocks of MaxOrder holding count pages,
+     * for ranges too large for any one block. Unlocked. */
+    physical_uintptr_t takeRun(size_t count);
+
+    /** Take a block of the given order, splitting larger ones. Unlocked. */
+    physical_uintptr_t takeBlock(size_t order);
+
+    /** Take the specific block at address out of whichever free block holds
+     * it. Unlocked. */
+    bool carveBlock(physical_uintptr_t address, size_t order);
+
+    /** Free a block, merging it with its buddies. Unlocked. */
+    void releaseBlock(physical_uintptr_t address, size_t order);
+
+    /** freeRange, without the lock. */
+    void releaseRange(physical_uintptr_t address, size_t count);
+
+    /** Free list manipulation. */
+    void push(physical_uintptr_t address, size_t order);
+    void unlink(PageFrame *pFrame, size_t order);
+
+    Spinlock m_Lock;
+    FrameMap *m_pFrames;
+    physical_uintptr_t m_Base;
+    physical_uintptr_t m_Limit;
+    PageFrame *m_FreeLists[MaxOrder + 1];
+    size_t m_FreeBlocks[MaxOrder + 1];
+    size_t m_FreePages;
+};
+
+/** @} */
+
+#endif
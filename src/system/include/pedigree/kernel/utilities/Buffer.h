@@ -28,8 +28,10 @@
 #include "pedigree/kernel/utilities/new"
 
 class Event;
+class Process;
 class Semaphore;
 class Thread;
+class VirtualAddressSpace;
 
 /**
  * Provides a buffer of a specific size and utility functions for integration
@@ -44,6 +46,12 @@ class Thread;
  * always return the number of bytes read so far (or zero if none yet). The
  * same is true for an attempt to write when reading is disabled if that would
  * block.
+ *
+ * A reader that blocks on an empty buffer leaves its destination with the
+ * buffer, and the next writer copies straight into it rather than into a
+ * segment, so data that's being waited for is only copied once. Large,
+ * page-aligned transfers between single-threaded processes are lent as
+ * copy-on-write pages instead of being copied at all.
  */
 template <class T, bool allowShortOperation = false>
 class EXPORTED_PUBLIC Buffer
@@ -160,6 +168,15 @@ class EXPORTED_PUBLIC Buffer
      */
     void addSegment(const T *buffer, size_t count);
 
+    /**
+     * Give data from a writer straight to the blocked reader, which is
+     * released either way. Must be called with the lock held and the buffer
+     * empty.
+     * \return the number of values handed over; zero means the data has to
+     *         go through a segment after all.
+     */
+    size_t handOff(const T *buffer, size_t count);
+
     /**
      * Controls the size of each segment.
      */
@@ -185,6 +202,39 @@ class EXPORTED_PUBLIC Buffer
         size_t size;
     };
 
+    /**
+     * Transfers at least this big (in bytes) may be lent as pages rather than
+     * copied. Below this, the copy-on-write faults that follow cost more than
+     * the copy would have.
+     */
+    static const size_t m_MinimumLendSize = 16384;
+
+    /**
+     * A reader waiting on an empty buffer, for writers to hand data to.
+     */
+    struct DirectReader
+    {
+        DirectReader()
+            : buffer(0), count(0), done(0), pAddressSpace(0), pProcess(0)
+        {
+        }
+
+        /** Where the reader wants its data. */
+        T *buffer;
+
+        /** How much it wants. */
+        size_t count;
+
+        /** How much a writer gave it. */
+        size_t done;
+
+        /** The address space \p buffer is in. */
+        VirtualAddressSpace *pAddressSpace;
+
+        /** The reader's process. */
+        Process *pProcess;
+    };
+
     /**
      * Contains information about a particular target to send events to.
      */
@@ -219,6 +269,8 @@ class EXPORTED_PUBLIC Buffer
     List<Segment *> m_Segments;
     List<MonitorTarget *> m_MonitorTargets;
 
+    DirectReader *m_pDirectReader;
+
     bool m_bCanRead;
     bool m_bCanWrite;
 };
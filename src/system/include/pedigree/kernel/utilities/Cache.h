@@ -24,6 +24,8 @@
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/machine/TimerHandler.h"
+#include "pedigree/kernel/process/MemoryPressureManager.h"
+#include "pedigree/kernel/process/Mutex.h"
 #include "pedigree/kernel/processor/state_forward.h"
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/utilities/BloomFilter.h"
@@ -48,13 +50,31 @@ class UnlikelyLock;
 /// How regularly (in milliseconds) the writeback timer handler should fire.
 #define CACHE_WRITEBACK_PERIOD 500
 
+/// How regularly (in milliseconds) the reclaim thread ages cache pages when
+/// nothing has woken it.
+#define CACHE_AGING_PERIOD 1000
+
+/// Number of pages the reclaim thread takes off the inactive list at a time.
+#define CACHE_RECLAIM_BATCH 32
+
 // Forward declaration of Cache so CacheManager can be defined first
 class Cache;
 
-/** Provides a clean abstraction to a set of data caches. */
+/**
+ * Provides a clean abstraction to a set of data caches.
+ *
+ * The CacheManager also runs page reclaim for every cache, against three free
+ * page watermarks:
+ *  - min (MemoryPressureManager::getHighWatermark): an allocation below this
+ *    reclaims pages itself before carrying on, which is counted as a stall.
+ *  - low (MemoryPressureManager::getLowWatermark): wakes the reclaim thread.
+ *  - high (MemoryPressureManager::getReclaimWatermark): the reclaim thread
+ *    stops once this many pages are free.
+ */
 class CacheManager :
 #ifndef STANDALONE_CACHE
     public TimerHandler,
+    public MemoryPressureHandler,
 #endif
     public RequestQueue
 {
@@ -72,15 +92,43 @@ class CacheManager :
     void registerCache(Cache *pCache);
     void unregisterCache(Cache *pCache);
 
+    /** Wake the reclaim thread, if it isn't already awake. */
+    void wakeReclaim();
+
     /**
-     * Trim each cache we know about until 'count' pages have been evicted.
+     * Called before a cache grows by nPages pages. Wakes the reclaim thread
+     * below the low watermark, and below the min watermark reclaims enough
+     * pages for the caller synchronously.
+     */
+    void directReclaim(size_t nPages = 1);
+
+    /** Number of times an allocation had to wait on reclaim itself. */
+    size_t directReclaimStalls() const
+    {
+        return m_DirectReclaimStalls;
+    }
+
+    /** Number of times the reclaim thread was woken below the low watermark.
      */
-    bool trimAll(size_t count = 1);
+    size_t reclaimWakeups() const
+    {
+        return m_ReclaimWakeups;
+    }
 
     virtual void timer(uint64_t delta, InterruptState &state);
 
+#ifndef STANDALONE_CACHE
+    virtual const String getMemoryPressureDescription()
+    {
+        return String("Evicting inactive cache pages");
+    }
+
+    /** Emergency reclaim, from the physical memory manager. */
+    virtual bool compact();
+#endif
+
 #ifdef THREADS
-    void trimThread();
+    void reclaimThread();
 #endif
 
   private:
@@ -108,9 +156,18 @@ class CacheManager :
     List<Cache *> m_Caches;
 
 #ifdef THREADS
-    Thread *m_pTrimThread;
+    Thread *m_pReclaimThread;
+
+    /** Released to wake the reclaim thread. */
+    Semaphore *m_pReclaimWake;
 #endif
 
+    /** Whether a wakeup is already pending on m_pReclaimWake. */
+    Atomic<bool> m_bReclaimPending;
+
+    Atomic<size_t> m_DirectReclaimStalls;
+    Atomic<size_t> m_ReclaimWakeups;
+
     bool m_bActive;
 };
 
@@ -152,10 +209,19 @@ class EXPORTED_PUBLIC Cache
             ChecksumStable
         } status;
 
+        /// The cache this page belongs to.
+        Cache *pCache;
+
         /// Linked list components for LRU.
         CachePage *pNext;
         CachePage *pPrev;
 
+        /// Which of the two LRU lists the page is on.
+        bool bActive;
+
+        /// Whether the page was used since it was last aged.
+        bool bReferenced;
+
         /// Check the checksum against another.
         bool checkChecksum(uint64_t other[2]) const;
 
@@ -221,6 +287,15 @@ class EXPORTED_PUBLIC Cache
      */
     bool evict(uintptr_t key);
 
+    /**
+     * Evicts every page with a key in [key, key + length).
+     *
+     * Pinned pages are left in the cache, as with evict().
+     *
+     * \return the number of pages in the range that are still cached.
+     */
+    size_t evictRange(uintptr_t key, size_t length);
+
     /**
      * Empties the cache.
      *
@@ -246,17 +321,48 @@ class EXPORTED_PUBLIC Cache
     bool pin(uintptr_t key);
 
     /**
-     * Attempts to trim the cache.
+     * Reclaims up to count of the least recently used pages across every
+     * cache.
      *
-     * A trim is slightly different to a compact in that it is designed to be
-     * called in a non-emergency situation. This could be called, for example,
-     * after a process terminates, to clean up some old cached data while the
-     * system is already doing busywork. Or, it could be called when the system
-     * is idle to clean up a bit.
+     * Inactive pages that were used since they were last looked at are
+     * activated instead of evicted, and dirty pages have a writeback queued
+     * and are left for a later pass. If bTry is set, no lock that may already
+     * be held by the caller is waited on.
      *
-     * This will take the lock, also, unlike compact().
+     * \return number of pages evicted
      */
-    size_t trim(size_t count = 1);
+    static size_t reclaim(size_t count, bool bTry = false);
+
+    /**
+     * Deactivates active pages that haven't been used since they were last
+     * looked at, until the inactive list is at least as long as the active
+     * list (or count pages have been looked at).
+     */
+    static void age(size_t count = CACHE_RECLAIM_BATCH);
+
+    /** Number of cache pages on the active LRU list. */
+    static size_t activePages()
+    {
+        return m_nActivePages;
+    }
+
+    /** Number of cache pages on the inactive LRU list. */
+    static size_t inactivePages()
+    {
+        return m_nInactivePages;
+    }
+
+    /** Number of pages reclaim has evicted. */
+    static size_t reclaimedPages()
+    {
+        return m_nReclaimed;
+    }
+
+    /** Number of writebacks reclaim has queued for dirty pages. */
+    static size_t reclaimWritebacks()
+    {
+        return m_nReclaimWritebacks;
+    }
 
     /**
      * Synchronises the given cache key back to a backing store, if a
@@ -319,29 +425,37 @@ class EXPORTED_PUBLIC Cache
     bool evict(uintptr_t key, bool bLock, bool bPhysicalLock, bool bRemove);
 
     /**
-     * LRU evict do-er.
-     *
-     * \param force force an eviction to be attempted
-     * \return number of cache pages evicted
+     * Reclaim do-er: evicts the given key if it is unpinned and clean. A
+     * dirty page has a writeback queued instead.
      */
-    size_t lruEvict(bool force = false);
+    bool reclaimPage(uintptr_t key, bool bTry);
 
     /**
-     * Link the given CachePage to the LRU list.
+     * Link the given CachePage to the head of the inactive LRU list.
      */
-    void linkPage(CachePage *pPage);
+    static void linkPage(CachePage *pPage);
 
     /**
-     * Promote the given CachePage within the LRU list.
+     * Mark the given CachePage as used.
      *
-     * This marks the page as the most-recently-used page.
+     * An inactive page that was already marked is moved to the active list.
+     */
+    static void promotePage(CachePage *pPage);
+
+    /**
+     * Unlink the given CachePage from whichever LRU list it is on.
      */
-    void promotePage(CachePage *pPage);
+    static void unlinkPage(CachePage *pPage);
+
+    /** LRU list doers; m_LruLock must be held. */
+    static void pushPage(CachePage *pPage, bool bActive);
+    static void removePage(CachePage *pPage);
 
     /**
-     * Unlink the given CachePage from the LRU list.
+     * Whether the given CachePage was used since this was last called, from
+     * both its referenced flag and the accessed bit of its mapping.
      */
-    void unlinkPage(CachePage *pPage);
+    static bool testAndClearReferenced(CachePage *pPage);
 
     /**
      * Calculate a checksum for the given CachePage.
@@ -393,10 +507,27 @@ class EXPORTED_PUBLIC Cache
     BloomFilter<uintptr_t> m_PageFilter;
 
     /**
-     * List of known CachePages, kept up-to-date with m_Pages but in LRU order.
+     * Every cache's CachePages, in LRU order. Pages start out inactive, and
+     * are activated if used again while inactive.
      */
-    CachePage *m_pLruHead;
-    CachePage *m_pLruTail;
+    static CachePage *m_pActiveHead;
+    static CachePage *m_pActiveTail;
+    static CachePage *m_pInactiveHead;
+    static CachePage *m_pInactiveTail;
+    static size_t m_nActivePages;
+    static size_t m_nInactivePages;
+
+    /** Lock for the LRU lists. Nests inside each cache's m_Lock. */
+    static Spinlock m_LruLock;
+
+    /**
+     * Held while reclaiming, and by a cache being destroyed, so reclaim never
+     * evicts from a cache that has gone away.
+     */
+    static Mutex m_ReclaimLock;
+
+    static size_t m_nReclaimed;
+    static size_t m_nReclaimWritebacks;
 
     /** Static MemoryAllocator to allocate virtual address space for all caches.
      */
@@ -405,6 +536,9 @@ class EXPORTED_PUBLIC Cache
     /** Lock for using the allocator. */
     static Spinlock m_AllocatorLock;
 
+    /** Allocate address space from m_Allocator, setting it up if needed. */
+    static bool allocateAddress(size_t size, uintptr_t &location);
+
     /** Lock for this cache. */
     Spinlock m_Lock;
 
@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_COMPRESSEDPAGESTORE_H
+#define KERNEL_UTILITIES_COMPRESSEDPAGESTORE_H
+
+/** @addtogroup kernelutilities
+ * @{ */
+
+#include "pedigree/kernel/Spinlock.h"
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/utilities/Vector.h"
+#include "pedigree/kernel/utilities/lz4.h"
+
+/**
+ * \brief Compressed storage for whole pages of memory.
+ *
+ * Pages are compressed and packed tightly into "zspages": runs of one to four
+ * pages, each carved into equal slots of one size class, so that objects of
+ * similar size share backing memory without per-object headers beyond their
+ * length and reference count. Pages that don't compress well enough to be
+ * worth keeping are refused.
+ *
+ * The store never holds more than its page limit of backing memory.
+ */
+class EXPORTED_PUBLIC CompressedPageStore
+{
+  public:
+    /** Refers to a stored page. Zero is never a valid handle. */
+    typedef uintptr_t Handle;
+
+    /** Size of the pages stored. */
+    static const size_t PageSize = 4096;
+
+    /** Size classes are this far apart. */
+    static const size_t ClassSize = 32;
+
+    /** Pages that don't compress to at most this size are refused. */
+    static const size_t MaxObjectSize = (PageSize * 3) / 4;
+
+    /** Most pages in one zspage. */
+    static const size_t MaxZspagePages = 4;
+
+    /** Handles fit in this many bits, so they can live in page tables. */
+    static const size_t HandleBits = 40;
+
+    explicit CompressedPageStore(size_t pageLimit = ~0UL);
+    ~CompressedPageStore();
+
+    /** Set the most backing pages the store may use. Pages already stored
+     *  are not affected. */
+    void setPageLimit(size_t pageLimit);
+
+    /** Compress and store the PageSize bytes at page. Returns 0 if the page
+     *  doesn't compress well or the store is full. */
+    Handle store(const void *page);
+
+    /** Decompress the stored page into page. */
+    bool load(Handle handle, void *page);
+
+    /** Take another reference on a stored page. */
+    void share(Handle handle);
+
+    /** Drop a reference on a stored page, freeing it with the last one. */
+    void release(Handle handle);
+
+    /** Number of pages currently stored. */
+    size_t storedPages() const
+    {
+        return m_StoredPages;
+    }
+
+    /** Total compressed size of the pages currently stored. */
+    size_t compressedBytes() const
+    {
+        return m_CompressedBytes;
+    }
+
+    /** Number of pages of memory the store is using. */
+    size_t backingPages() const
+    {
+        return m_BackingPages;
+    }
+
+    /** Number of pages refused because they didn't compress well. */
+    size_t incompressiblePages() const
+    {
+        return m_Incompressible;
+    }
+
+    /** Number of pages refused because the store was full. */
+    size_t rejectedPages() const
+    {
+        return m_Rejected;
+    }
+
+  private:
+    CompressedPageStore(const CompressedPageStore &);
+    CompressedPageStore &operator=(const CompressedPageStore &);
+
+    /** Largest slot, for a page compressed to MaxObjectSize. */
+    static const size_t MaxSlotSize =
+        (MaxObjectSize + 4 + ClassSize - 1) & ~(ClassSize - 1);
+
+    static const size_t NumClasses = MaxSlotSize / ClassSize;
+
+    /** Bits of a handle that select the slot within a zspage. */
+    static const size_t SlotBits = 9;
+
+    struct Zspage
+    {
+        uint8_t *data;
+        size_t sizeClass;
+        size_t nPages;
+        size_t nSlots;
+        size_t inUse;
+        size_t freeHead;
+        size_t index;
+        Zspage *prev;
+        Zspage *next;
+    };
+
+    /** Start of each slot; the compressed page follows. */
+    struct SlotHeader
+    {
+        /** Compressed length, or zero if the slot is free. */
+        uint16_t length;
+        /** References, or for a free slot, the next free slot. */
+        uint16_t refs;
+    };
+
+    static size_t slotSize(size_t sizeClass)
+    {
+        return (sizeClass + 1) * ClassSize;
+    }
+
+    /** Number of pages per zspage that wastes the least space. */
+    static size_t zspagePages(size_t sizeClass);
+
+    Zspage *newZspage(size_t sizeClass);
+    void freeZspage(Zspage *pZspage);
+
+    void linkPartial(Zspage *pZspage);
+    void unlinkPartial(Zspage *pZspage);
+
+    /** Find the slot a handle refers to. Returns null for a bad handle. */
+    SlotHeader *lookup(Handle handle, Zspage **ppZspage = 0);
+
+    Spinlock m_Lock;
+    size_t m_PageLimit;
+
+    /** Zspages by index, with holes where they have been freed. */
+    Vector<void *> m_Zspages;
+    Vector<uint32_t> m_FreeIndices;
+
+    /** Zspages with free slots, for each size class. */
+    Zspage *m_Partial[NumClasses];
+
+    size_t m_StoredPages;
+    size_t m_CompressedBytes;
+    size_t m_BackingPages;
+    size_t m_Incompressible;
+    size_t m_Rejected;
+
+    /** Compression happens here, under the lock, before the size class is
+     *  known. */
+    uint8_t m_Scratch[MaxObjectSize];
+    uint16_t m_HashTable[lz4::HashTableSize];
+};
+
+/** @} */
+
+#endif
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_FREEPAGECACHE_H
+#define KERNEL_UTILITIES_FREEPAGECACHE_H
+
+/** @addtogroup kernelutilities
+ * @{ */
+
+#include "pedigree/kernel/Spinlock.h"
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+/**
+ * \brief A small cache of free physical pages, meant to be kept per processor.
+ *
+ * Pages are taken from and given back to a backing allocator (normally the
+ * physical memory manager's zones) in batches, so the backing
+ * allocator's lock is acquired once per Batch pages instead of once per page.
+ * An empty cache is refilled with Batch pages; a cache holding HighWatermark
+ * pages drains Batch of them before accepting another.
+ *
+ * The cache has its own lock, which is only ever contended when another
+ * processor drains the cache under memory pressure.
+ */
+class EXPORTED_PUBLIC FreePageCache
+{
+  public:
+    /** Where pages come from and go back to. */
+    class Backend
+    {
+      public:
+        virtual ~Backend()
+        {
+        }
+
+        /** Allocate up to count pages at once, returning how many were. */
+        virtual size_t takePages(physical_uintptr_t *pages, size_t count) = 0;
+
+        /** Free count pages at once. */
+        virtual void returnPages(const physical_uintptr_t *pages, size_t count) = 0;
+    };
+
+    /** Number of pages moved to or from the backend at a time. */
+    static const size_t Batch = 32;
+
+    /** Most pages the cache will hold. */
+    static const size_t HighWatermark = 64;
+
+    FreePageCache();
+    ~FreePageCache();
+
+    /** Set the backing allocator. Must be done before the cache is used. */
+    void setBackend(Backend *pBackend);
+
+    /** Allocate a page, refilling from the backend if needed. 0 if none. */
+    physical_uintptr_t allocate();
+
+    /**
+     * Allocate count pages into pages. Whatever the cache can't supply comes
+     * from the backend in one go. Returns the number of pages allocated.
+     */
+    size_t allocate(physical_uintptr_t *pages, size_t count);
+
+    /** Free a page into the cache, draining a batch if it is full. */
+    void free(physical_uintptr_t page);
+
+    /** Return every cached page to the backend. */
+    void drain();
+
+    /** Number of pages currently held by the cache. */
+    size_t count() const
+    {
+        return m_Count;
+    }
+
+  private:
+    FreePageCache(const FreePageCache &);
+    FreePageCache &operator=(const FreePageCache &);
+
+    Spinlock m_Lock;
+    Backend *m_pBackend;
+    size_t m_Count;
+    physical_uintptr_t m_Pages[HighWatermark];
+};
+
+/** @} */
+
+#endif
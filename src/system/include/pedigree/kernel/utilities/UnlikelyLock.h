@@ -20,6 +20,7 @@
 #ifndef UNLIKELY_LOCK_H
 #define UNLIKELY_LOCK_H
 
+#include "pedigree/kernel/Atomic.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/process/ConditionVariable.h"
 #include "pedigree/kernel/process/Mutex.h"
@@ -34,14 +35,15 @@
 /** An "Unlikely lock" is a lock which normally any number of threads can access
     concurrently, but when locked, all threads must exit and never reenter.
 
-    This is implemented as a simple counting semaphore that starts at zero. Any
-    thread can acquire by adding one to the semaphore. If a thread discovers
-   that the semaphore was over a threshold (100000), it decrements again and
-   returns false.
+    The state is a single atomic word: the number of readers inside, plus a
+    writer bit. Readers enter and leave with one atomic operation each as long
+    as the writer bit is clear, and never touch the Mutex.
 
-    Thus, the lock can be acquired by adding 100000 to the atomic member, and
-   waiting until the atomic member's value drops to exactly 100000, at which
-   point all threads will have exited.
+    A writer sets the writer bit, which stops any new readers entering, and
+    then sleeps until the readers already inside have left. Readers that
+    arrive while a writer holds or is waiting for the lock sleep until it is
+    released, so writers can't be starved by a stream of readers. As a result
+    a thread must not enter() a lock it is already inside.
 */
 class EXPORTED_PUBLIC UnlikelyLock
 {
@@ -64,11 +66,15 @@ class EXPORTED_PUBLIC UnlikelyLock
     void release();
 
   private:
+    /** Set in m_State while a writer holds or is waiting for the lock. */
+    static const size_t WriterBit = ~(~static_cast<size_t>(0) >> 1);
+
+    /** Reader count, plus WriterBit. */
+    Atomic<size_t> m_State;
+
+    /** Only used by threads that have to wait. */
     Mutex m_Lock;
     ConditionVariable m_Condition;
-
-    uint64_t m_nReaders;
-    bool m_bActiveWriter;
 };
 
 #endif
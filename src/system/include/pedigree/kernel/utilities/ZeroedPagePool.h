@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_ZEROEDPAGEPOOL_H
+#define KERNEL_UTILITIES_ZEROEDPAGEPOOL_H
+
+/** @addtogroup kernelutilities
+ * @{ */
+
+#include "pedigree/kernel/Spinlock.h"
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+/**
+ * \brief A pool of physical pages that have already been zeroed.
+ *
+ * A background thread calls refill() to take pages from a backing allocator
+ * and zero them ahead of time, so that allocate() can hand out a zeroed page
+ * without a memset in the faulting path. The pool's lock is never held while
+ * a page is being zeroed.
+ */
+class EXPORTED_PUBLIC ZeroedPagePool
+{
+  public:
+    /** Where pages come from, and how they are zeroed. */
+    class Backend
+    {
+      public:
+        virtual ~Backend()
+        {
+        }
+
+        /** Allocate up to count pages at once, returning how many were. */
+        virtual size_t takePages(physical_uintptr_t *pages, size_t count) = 0;
+
+        /** Free count pages at once. */
+        virtual void returnPages(const physical_uintptr_t *pages, size_t count) = 0;
+
+        /** Fill the given page with zeroes. */
+        virtual void zeroPage(physical_uintptr_t page) = 0;
+    };
+
+    /** Most pages the pool will hold. */
+    static const size_t Capacity = 64;
+
+    /** Below this many pages, the pool should be refilled. */
+    static const size_t LowWatermark = 16;
+
+    /** Number of pages taken from the backend at a time by refill(). */
+    static const size_t Batch = 16;
+
+    ZeroedPagePool();
+    ~ZeroedPagePool();
+
+    /** Set the backing allocator. Must be done before the pool is used. */
+    void setBackend(Backend *pBackend);
+
+    /** Take a zeroed page from the pool. 0 if the pool is empty. */
+    physical_uintptr_t allocate();
+
+    /** Zero pages until the pool is full (or the backend runs dry).
+     *  Returns the number of pages added. */
+    size_t refill();
+
+    /** Return every pooled page to the backend. */
+    void drain();
+
+    /** Whether the pool has dropped below its low watermark. */
+    bool needsRefill() const
+    {
+        return m_Count < LowWatermark;
+    }
+
+    /** Number of zeroed pages currently in the pool. */
+    size_t count() const
+    {
+        return m_Count;
+    }
+
+    /** Number of allocations served from the pool. */
+    size_t hits() const
+    {
+        return m_Hits;
+    }
+
+    /** Number of allocations that found the pool empty. */
+    size_t misses() const
+    {
+        return m_Misses;
+    }
+
+  private:
+    ZeroedPagePool(const ZeroedPagePool &);
+    ZeroedPagePool &operator=(const ZeroedPagePool &);
+
+    Spinlock m_Lock;
+    Backend *m_pBackend;
+    size_t m_Count;
+    physical_uintptr_t m_Pages[Capacity];
+    size_t m_Hits;
+    size_t m_Misses;
+};
+
+/** @} */
+
+#endif
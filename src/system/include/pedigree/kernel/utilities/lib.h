@@ -105,6 +105,19 @@ EXPORTED_PUBLIC void *ForwardMemoryCopy(void *s1, const void *s2, size_t n);
 EXPORTED_PUBLIC void *MemoryCopy(void *s1, const void *s2, size_t n);
 EXPORTED_PUBLIC int
 MemoryCompare(const void *p1, const void *p2, size_t len) PURE;
+EXPORTED_PUBLIC void *MemoryFind(const void *buf, int c, size_t len) PURE;
+
+// Selects the memory and string function implementations for this processor.
+// Until this is called the generic paths are used; call it once the processor
+// has set up its FPU and SSE state.
+EXPORTED_PUBLIC void InitialiseMemoryFunctions(void);
+
+// Internet checksum helpers. These return the folded (but not inverted) 16-bit
+// ones' complement sum of the buffer, in the same byte order as the data.
+EXPORTED_PUBLIC uint16_t OnesComplementSum(const void *buf, size_t len) PURE;
+EXPORTED_PUBLIC uint16_t
+OnesComplementSumCopy(void *dest, const void *src, size_t len);
+EXPORTED_PUBLIC uint16_t OnesComplementAdd(uint16_t a, uint16_t b) PURE;
 
 // Misc utilities for paths etc
 EXPORTED_PUBLIC const char *
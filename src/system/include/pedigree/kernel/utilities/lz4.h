@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_UTILITIES_LZ4_H
+#define KERNEL_UTILITIES_LZ4_H
+
+/** @addtogroup kernelutilities
+ * @{ */
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+
+/**
+ * A small, fast LZ77 compressor producing LZ4 block format data.
+ *
+ * Built for compressing single pages: inputs are limited to 64 KiB, and the
+ * caller provides the hash table so that nothing large is put on the stack.
+ */
+namespace lz4
+{
+/** Number of entries in the hash table passed to compress(). */
+const size_t HashTableSize = 4096;
+
+/** Largest input compress() accepts. */
+const size_t MaxInputSize = 0xFFFF;
+
+/**
+ * Compress srcLen bytes at src into at most dstLen bytes at dst.
+ * \param table scratch space of HashTableSize entries.
+ * \return the compressed size, or zero if it wouldn't fit in dstLen.
+ */
+EXPORTED_PUBLIC size_t compress(
+    const void *src, size_t srcLen, void *dst, size_t dstLen,
+    uint16_t *table);
+
+/**
+ * Decompress srcLen bytes at src into at most dstLen bytes at dst.
+ * \return the decompressed size, or zero if the input is corrupt or doesn't
+ *         fit in dstLen.
+ */
+EXPORTED_PUBLIC size_t
+decompress(const void *src, size_t srcLen, void *dst, size_t dstLen);
+}  // namespace lz4
+
+/** @} */
+
+#endif
@@ -21,6 +21,10 @@
 #include "pedigree/kernel/processor/Processor.h"
 #include "pedigree/kernel/processor/ProcessorInformation.h"
 
+#if defined(MULTIPROCESSOR) && defined(X86_COMMON)
+#include "pedigree/kernel/processor/TlbShootdown.h"
+#endif
+
 #ifdef TRACK_LOCKS
 #include "pedigree/kernel/debugger/commands/LocksCommand.h"
 #endif
@@ -32,6 +36,21 @@ class Thread;
 
 static Atomic<size_t> x(0);
 
+/** Statistics for contended locks. */
+static Spinlock::Statistics g_LockStatistics[SPINLOCK_STATISTICS_SLOTS];
+
+/** Cheap timestamp for lock statistics. */
+static inline uint64_t lockTimestamp()
+{
+#if defined(X86_COMMON) || defined(HOSTED)
+    uint32_t lo, hi;
+    asm volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return (static_cast<uint64_t>(hi) << 32ULL) | lo;
+#else
+    return 0;
+#endif
+}
+
 Spinlock::Spinlock() = default;
 
 Spinlock::Spinlock(bool bLocked, bool bAvoidTracking) : Spinlock()
@@ -40,6 +59,13 @@ Spinlock::Spinlock(bool bLocked, bool bAvoidTracking) : Spinlock()
     m_bAvoidTracking = bAvoidTracking;
 }
 
+Spinlock::~Spinlock()
+{
+    // Give the statistics slot back.
+    if (m_pStatistics)
+        m_pStatistics->pLock = 0;
+}
+
 bool Spinlock::acquire(bool recurse, bool safe)
 {
     Thread *pThread = Processor::information().getCurrentThread();
@@ -88,77 +114,99 @@ bool Spinlock::acquire(bool recurse, bool safe)
     }
 #endif
 
-    while (m_Atom.compareAndSwap(true, false) == false)
+    uint64_t spinStart = 0;
+
+    // Can we re-enter the critical section? This must be checked before
+    // queueing, as we would otherwise be waiting behind ourselves.
+    if (m_bOwned && (m_pOwner == pThread) && recurse)
+    {
+        // Yes.
+        ++m_Level;
+    }
+    else
     {
-        // Couldn't take the lock - can we re-enter the critical section?
-        if (m_bOwned && (m_pOwner == pThread) && recurse)
+        // Join the queue. The head of the queue is the only waiter that
+        // attempts to take the lock word, and it hands the head of the queue
+        // on once it has done so.
+        uint32_t ticket = (m_NextTicket += 1) - 1;
+        while ((m_NowServing != ticket) ||
+               (m_Atom.compareAndSwap(true, false) == false))
         {
-            // Yes.
-            ++m_Level;
-            break;
-        }
+            if (!spinStart)
+                spinStart = lockTimestamp() | 1;
 
-        Processor::pause();
+            Processor::pause();
 
 #ifdef TRACK_LOCKS
-        if (!m_bAvoidTracking)
-        {
-            g_LocksCommand.clearFatal();
-            if (!g_LocksCommand.checkState(this))
+            if (!m_bAvoidTracking)
             {
-                uintptr_t myra =
-                    reinterpret_cast<uintptr_t>(__builtin_return_address(0));
-                FATAL_NOLOCK(
-                    "Spinlock: LocksCommand failed a state check [return="
-                    << Hex << myra << "].");
+                g_LocksCommand.clearFatal();
+                if (!g_LocksCommand.checkState(this))
+                {
+                    uintptr_t myra = reinterpret_cast<uintptr_t>(
+                        __builtin_return_address(0));
+                    FATAL_NOLOCK(
+                        "Spinlock: LocksCommand failed a state check [return="
+                        << Hex << myra << "].");
+                }
+                g_LocksCommand.setFatal();
             }
-            g_LocksCommand.setFatal();
-        }
 #endif
 
 #ifdef MULTIPROCESSOR
-        if (Processor::getCount() > 1)
-        {
-            if (safe)
+            if (Processor::getCount() > 1)
             {
-                // If the other locker is in fact this CPU, we're trying to
-                // re-enter and that won't work at all.
-                if (Processor::id() != m_OwnedProcessor)
+#ifdef X86_COMMON
+                // Interrupts are off while we spin, so a shootdown IPI can't
+                // get through - and the lock holder may be waiting on it.
+                TlbShootdown::poll();
+#endif
+
+                if (safe)
                 {
-                    // OK, the other CPU could still release the lock.
+                    // If the other locker is in fact this CPU, we're trying to
+                    // re-enter and that won't work at all.
+                    if (Processor::id() != m_OwnedProcessor)
+                    {
+                        // OK, the other CPU could still release the lock.
+                        continue;
+                    }
+                }
+                else
+                {
+                    // Unsafe mode, so we don't detect obvious re-entry.
                     continue;
                 }
             }
-            else
-            {
-                // Unsafe mode, so we don't detect obvious re-entry.
-                continue;
-            }
-        }
 #endif
 
-        /// \note When we hit this breakpoint, we're not able to backtrace as
-        /// backtracing
-        ///       depends on the log spinlock, which may have deadlocked. So we
-        ///       actually force the spinlock to release here, then hit the
-        ///       breakpoint.
-        size_t atom = m_Atom;
-        m_Atom = true;
+            /// \note When we hit this breakpoint, we're not able to backtrace
+            /// as backtracing depends on the log spinlock, which may have
+            /// deadlocked. So we actually force the spinlock to release here
+            /// (and skip the queue ahead of us), then hit the breakpoint.
+            size_t atom = m_Atom;
+            m_NowServing = ticket;
+            m_Atom = true;
 
-        uintptr_t myra =
-            reinterpret_cast<uintptr_t>(__builtin_return_address(0));
-        ERROR_NOLOCK("Spinlock has deadlocked in acquire");
-        ERROR_NOLOCK(" -> level is " << m_Level);
-        ERROR_NOLOCK(" -> my return address is " << Hex << myra);
-        ERROR_NOLOCK(" -> return address of other locker is " << Hex << m_Ra);
-        FATAL_NOLOCK(
-            "Spinlock has deadlocked, spinlock is "
-            << Hex << reinterpret_cast<uintptr_t>(this) << ", atom is " << atom
-            << ".");
+            uintptr_t myra =
+                reinterpret_cast<uintptr_t>(__builtin_return_address(0));
+            ERROR_NOLOCK("Spinlock has deadlocked in acquire");
+            ERROR_NOLOCK(" -> level is " << m_Level);
+            ERROR_NOLOCK(" -> my return address is " << Hex << myra);
+            ERROR_NOLOCK(
+                " -> return address of other locker is " << Hex << m_Ra);
+            FATAL_NOLOCK(
+                "Spinlock has deadlocked, spinlock is "
+                << Hex << reinterpret_cast<uintptr_t>(this) << ", atom is "
+                << atom << ".");
 
-        // Panic in case there's a return from the debugger (or the debugger
-        // isn't available)
-        panic("Spinlock has deadlocked");
+            // Panic in case there's a return from the debugger (or the
+            // debugger isn't available)
+            panic("Spinlock has deadlocked");
+        }
+
+        // Let the next waiter at the lock word.
+        m_NowServing = ticket + 1;
     }
     m_Ra = reinterpret_cast<uintptr_t>(__builtin_return_address(0));
 
@@ -188,9 +236,61 @@ bool Spinlock::acquire(bool recurse, bool safe)
     m_bInterrupts = bInterrupts;
     m_OwnedProcessor = Processor::id();
 
+    // Statistics are only kept for locks that have seen contention. We hold
+    // the lock, so they can be updated without atomics.
+    if (m_pStatistics || (spinStart && allocateStatistics()))
+    {
+        uint64_t now = lockTimestamp();
+        ++m_pStatistics->nAcquires;
+        if (spinStart)
+        {
+            uint64_t spun = now - spinStart;
+            ++m_pStatistics->nContended;
+            m_pStatistics->spinTime += spun;
+            if (spun > m_pStatistics->maxSpinTime)
+                m_pStatistics->maxSpinTime = spun;
+        }
+
+        // Only the outermost acquire starts the hold time.
+        if (!m_Level || m_Level == 1)
+            m_AcquiredAt = now;
+    }
+
     return true;
 }
 
+bool Spinlock::allocateStatistics()
+{
+    for (size_t i = 0; i < SPINLOCK_STATISTICS_SLOTS; ++i)
+    {
+        Statistics &stats = g_LockStatistics[i];
+        if (stats.pLock.compareAndSwap(0, reinterpret_cast<uintptr_t>(this)))
+        {
+            stats.ra = m_Ra;
+            stats.nAcquires = 0;
+            stats.nContended = 0;
+            stats.spinTime = 0;
+            stats.maxSpinTime = 0;
+            stats.holdTime = 0;
+            stats.maxHoldTime = 0;
+            m_pStatistics = &stats;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Spinlock::getStatistics(size_t n, Statistics &stats)
+{
+    if (n >= SPINLOCK_STATISTICS_SLOTS)
+        return false;
+
+    // Copy first, the slot could be given up while we look at it.
+    stats = g_LockStatistics[n];
+    return static_cast<uintptr_t>(stats.pLock) != 0;
+}
+
 void Spinlock::trackRelease() const
 {
 #ifdef TRACK_LOCKS
@@ -240,6 +340,15 @@ void Spinlock::exit()
     m_bOwned = false;
     m_OwnedProcessor = ~0;
 
+    if (m_pStatistics && m_AcquiredAt)
+    {
+        uint64_t held = lockTimestamp() - m_AcquiredAt;
+        m_pStatistics->holdTime += held;
+        if (held > m_pStatistics->maxHoldTime)
+            m_pStatistics->maxHoldTime = held;
+        m_AcquiredAt = 0;
+    }
+
     // Track the release just before we actually release the lock to avoid an
     // immediate reschedule screwing with the tracking.
     trackRelease();
@@ -138,6 +138,15 @@ inline size_t getPageSize()
 #endif
 }
 
+inline size_t getHugePageSize()
+{
+#ifdef PEDIGREE_BENCHMARK
+    return 0;
+#else
+    return VirtualAddressSpace::getKernelAddressSpace().getHugePageSize();
+#endif
+}
+
 inline void allocateAndMapAt(void *addr, bool cowOk = false)
 {
 #ifdef PEDIGREE_BENCHMARK
@@ -147,7 +156,6 @@ inline void allocateAndMapAt(void *addr, bool cowOk = false)
         VirtualAddressSpace::KernelMode | VirtualAddressSpace::Write;
 
     static physical_uintptr_t physZero = 0;
-    bool needZeroPage = false;
     size_t extraFlags = 0;
 
     physical_uintptr_t phys = 0;
@@ -155,17 +163,9 @@ inline void allocateAndMapAt(void *addr, bool cowOk = false)
     {
         if (!physZero)
         {
-            // allocate the zero page, we'll zero it shortly
-            physZero = PhysicalMemoryManager::instance().allocatePage();
-            needZeroPage = true;
-
-            // allow us to zero out the page
-            extraFlags |= VirtualAddressSpace::Write;
-        }
-        else
-        {
-            extraFlags |= VirtualAddressSpace::CopyOnWrite;
+            physZero = PhysicalMemoryManager::instance().allocateZeroedPage();
         }
+        extraFlags |= VirtualAddressSpace::CopyOnWrite;
 
         // disable writing (for CoW to work properly)
         standardFlags &= ~VirtualAddressSpace::Write;
@@ -182,14 +182,54 @@ inline void allocateAndMapAt(void *addr, bool cowOk = false)
     {
         FATAL("SlamAllocator: failed to allocate and map at " << addr);
     }
+#endif
+}
 
-    if (needZeroPage)
+/** Map a huge page at addr, returning false if none could be allocated. */
+inline bool allocateAndMapHugeAt(void *addr)
+{
+#ifdef PEDIGREE_BENCHMARK
+    return false;
+#else
+    size_t order = __builtin_ctzl(getHugePageSize() / getPageSize());
+    physical_uintptr_t phys =
+        PhysicalMemoryManager::instance().allocateBlock(order);
+    if (!phys)
     {
-        ByteSet(addr, 0, PhysicalMemoryManager::getPageSize());
+        return false;
+    }
 
-        // Page zeroed - mark page copy on write now so the zero page works
-        va.setFlags(addr, standardFlags | VirtualAddressSpace::CopyOnWrite);
+    VirtualAddressSpace &va = VirtualAddressSpace::getKernelAddressSpace();
+    if (!va.mapHugePage(
+            phys, addr,
+            VirtualAddressSpace::KernelMode | VirtualAddressSpace::Write))
+    {
+        PhysicalMemoryManager::instance().freeBlock(phys, order);
+        return false;
     }
+
+    return true;
+#endif
+}
+
+/** Unmap and free the huge page at addr, if there is one there. */
+inline bool unmapHuge(void *addr)
+{
+#ifdef PEDIGREE_BENCHMARK
+    return false;
+#else
+    VirtualAddressSpace &va = VirtualAddressSpace::getKernelAddressSpace();
+    if (!va.isHugePage(addr))
+        return false;
+
+    physical_uintptr_t phys;
+    size_t flags;
+    va.getMapping(addr, phys, flags);
+    va.unmapHugePage(addr);
+
+    PhysicalMemoryManager::instance().freeBlock(
+        phys, __builtin_ctzl(getHugePageSize() / getPageSize()));
+    return true;
 #endif
 }
 
@@ -231,7 +271,10 @@ void SlamCache::initialise(SlamAllocator *parent, size_t objectSize)
         return;
 
     m_ObjectSize = objectSize;
-    if (m_ObjectSize > SLAB_MINIMUM_SIZE)
+    if (m_ObjectSize >= SLAB_LARGE_OBJECT_SIZE &&
+        m_ObjectSize < SLAB_LARGE_SIZE)
+        m_SlabSize = SLAB_LARGE_SIZE;
+    else if (m_ObjectSize > SLAB_MINIMUM_SIZE)
         m_SlabSize = m_ObjectSize;
     else
         m_SlabSize = SLAB_MINIMUM_SIZE;
@@ -796,8 +839,8 @@ SlamAllocator::SlamAllocator()
       m_SlabRegionLock(false)
 #endif
       ,
-      m_HeapPageCount(0), m_SlabRegionBitmap(), m_SlabRegionBitmapEntries(0),
-      m_Base(0)
+      m_HeapPageCount(0), m_HugeSlabHits(0), m_HugeSlabFallbacks(0),
+      m_SlabRegionBitmap(), m_SlabRegionBitmapEntries(0), m_Base(0)
 {
 }
 
@@ -947,6 +990,16 @@ uintptr_t SlamAllocator::getSlab(size_t fullSize)
         panic("Attempted to get a slab smaller than the native page size.");
     }
 
+    // Slabs made of whole huge pages are placed so they can be mapped with
+    // them. Each bitmap entry covers 64 pages.
+    size_t hugePageSize = getHugePageSize();
+    size_t entryAlign = 1;
+    if (hugePageSize && (fullSize % hugePageSize) == 0 &&
+        (m_Base % hugePageSize) == 0)
+    {
+        entryAlign = hugePageSize / (getPageSize() * 64);
+    }
+
 #ifdef THREADS
     m_SlabRegionLock.acquire();
 #endif
@@ -983,6 +1036,10 @@ uintptr_t SlamAllocator::getSlab(size_t fullSize)
             if (m_SlabRegionBitmap[entry])
                 continue;
 
+            // Keep huge page slabs aligned.
+            if (entry % entryAlign)
+                continue;
+
             // This entry has 64 free pages. Now we need to see if we can get
             // contiguously free bitmap entries.
             size_t needed = nPages - 64;
@@ -1091,10 +1148,24 @@ uintptr_t SlamAllocator::getSlab(size_t fullSize)
 
     // Map. This could break as we're allocating physical memory; though we are
     // free of the lock so that helps.
-    for (ssize_t i = 0; i < nPages; ++i)
+    for (ssize_t i = 0; i < nPages;)
     {
         void *p = reinterpret_cast<void *>(slab + (i * getPageSize()));
+
+        if (entryAlign > 1 && ((i * getPageSize()) % hugePageSize) == 0)
+        {
+            if (allocateAndMapHugeAt(p))
+            {
+                __atomic_add_fetch(&m_HugeSlabHits, 1, __ATOMIC_RELAXED);
+                i += hugePageSize / getPageSize();
+                continue;
+            }
+
+            __atomic_add_fetch(&m_HugeSlabFallbacks, 1, __ATOMIC_RELAXED);
+        }
+
         allocateAndMapAt(p);
+        ++i;
     }
 
 #ifdef KERNEL_NEEDS_ADDRESS_SPACE_SWITCH
@@ -1129,11 +1200,17 @@ void SlamAllocator::freeSlab(uintptr_t address, size_t length)
         Processor::switchAddressSpace(va);
 #endif
 
-    for (uintptr_t base = address; base < (address + length);
-         base += getPageSize())
+    for (uintptr_t base = address; base < (address + length);)
     {
         void *p = reinterpret_cast<void *>(base);
+        if (unmapHuge(p))
+        {
+            base += getHugePageSize();
+            continue;
+        }
+
         unmap(p);
+        base += getPageSize();
     }
 
 #ifdef KERNEL_NEEDS_ADDRESS_SPACE_SWITCH
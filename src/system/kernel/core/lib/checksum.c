@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/types.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+/*
+ * Ones' complement sums for the Internet checksum (RFC 1071).
+ *
+ * The sum is independent of byte order, so the data can be added up as
+ * native 64-bit words with end-around carry and folded to 16 bits at the end.
+ * The kernel is built without SSE, so rather than vectorising we run four
+ * independent accumulators to keep the adds in flight; on x86-64 the carry
+ * handling compiles down to add/adc pairs.
+ */
+
+static inline uint64_t load64(const uint8_t *p)
+{
+    uint64_t v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store64(uint8_t *p, uint64_t v)
+{
+    __builtin_memcpy(p, &v, sizeof(v));
+}
+
+static inline uint64_t addCarry(uint64_t sum, uint64_t value)
+{
+    sum += value;
+    return sum + (sum < value);
+}
+
+static inline uint16_t fold64(uint64_t sum)
+{
+    sum = (sum & 0xFFFFFFFFULL) + (sum >> 32);
+    sum = (sum & 0xFFFFFFFFULL) + (sum >> 32);
+    sum = (sum & 0xFFFFULL) + (sum >> 16);
+    sum = (sum & 0xFFFFULL) + (sum >> 16);
+    return (uint16_t) sum;
+}
+
+uint16_t OnesComplementSum(const void *buffer, size_t length)
+{
+    const uint8_t *p = (const uint8_t *) buffer;
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+    while (length >= 32)
+    {
+        s0 = addCarry(s0, load64(p));
+        s1 = addCarry(s1, load64(p + 8));
+        s2 = addCarry(s2, load64(p + 16));
+        s3 = addCarry(s3, load64(p + 24));
+        p += 32;
+        length -= 32;
+    }
+
+    s0 = addCarry(addCarry(s0, s1), addCarry(s2, s3));
+
+    while (length >= 8)
+    {
+        s0 = addCarry(s0, load64(p));
+        p += 8;
+        length -= 8;
+    }
+
+    // Trailing bytes keep their position in the word; an odd final byte is
+    // therefore paired with a zero, as RFC 1071 requires.
+    if (length)
+    {
+        uint64_t tail = 0;
+        __builtin_memcpy(&tail, p, length);
+        s0 = addCarry(s0, tail);
+    }
+
+    return fold64(s0);
+}
+
+uint16_t OnesComplementSumCopy(void *dest, const void *src, size_t length)
+{
+    uint8_t *d = (uint8_t *) dest;
+    const uint8_t *s = (const uint8_t *) src;
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+    while (length >= 32)
+    {
+        uint64_t w0 = load64(s);
+        uint64_t w1 = load64(s + 8);
+        uint64_t w2 = load64(s + 16);
+        uint64_t w3 = load64(s + 24);
+
+        store64(d, w0);
+        store64(d + 8, w1);
+        store64(d + 16, w2);
+        store64(d + 24, w3);
+
+        s0 = addCarry(s0, w0);
+        s1 = addCarry(s1, w1);
+        s2 = addCarry(s2, w2);
+        s3 = addCarry(s3, w3);
+
+        s += 32;
+        d += 32;
+        length -= 32;
+    }
+
+    s0 = addCarry(addCarry(s0, s1), addCarry(s2, s3));
+
+    while (length >= 8)
+    {
+        uint64_t w = load64(s);
+        store64(d, w);
+        s0 = addCarry(s0, w);
+        s += 8;
+        d += 8;
+        length -= 8;
+    }
+
+    if (length)
+    {
+        uint64_t tail = 0;
+        __builtin_memcpy(&tail, s, length);
+        __builtin_memcpy(d, &tail, length);
+        s0 = addCarry(s0, tail);
+    }
+
+    return fold64(s0);
+}
+
+uint16_t OnesComplementAdd(uint16_t a, uint16_t b)
+{
+    uint32_t sum = (uint32_t) a + b;
+    return (uint16_t)((sum & 0xFFFF) + (sum >> 16));
+}
@@ -24,8 +24,6 @@
 
 #undef memcpy
 
-#define WITH_SSE 0
-#define SSE_THRESHOLD 1024
 #define STOSB_THRESHOLD 64
 
 #ifdef HOSTED_X64
@@ -46,7 +44,17 @@
 extern void memzero_xmm_aligned(void *, size_t);
 extern void memzero_xmm(void *, size_t);
 
+#ifdef TARGET_IS_X86
+// Vectorised versions, see processor/x86_common/string.c.
+extern void *memcpy_x86(void *restrict s1, const void *restrict s2, size_t n);
+extern void *memset_x86(void *buf, int c, size_t n);
+extern void *memmove_backward_x86(void *s1, const void *s2, size_t n);
+extern int memcmp_x86(const void *p1, const void *p2, size_t n) PURE;
+extern void *memchr_x86(const void *buf, int c, size_t n) PURE;
+#endif
+
 EXPORT int memcmp(const void *p1, const void *p2, size_t len) PURE;
+EXPORT void *memchr(const void *buf, int c, size_t len) PURE;
 EXPORT void *memset(void *buf, int c, size_t n);
 void *WordSet(void *buf, int c, size_t n);
 void *DoubleWordSet(void *buf, unsigned int c, size_t n);
@@ -61,8 +69,11 @@ EXPORT void *memmove(void *s1, const void *s2, size_t n);
 
 EXPORT int memcmp(const void *p1, const void *p2, size_t len)
 {
-    const char *a = (const char *) p1;
-    const char *b = (const char *) p2;
+#ifdef TARGET_IS_X86
+    return memcmp_x86(p1, p2, len);
+#else
+    const unsigned char *a = (const unsigned char *) p1;
+    const unsigned char *b = (const unsigned char *) p2;
     size_t i = 0;
     int r = 0;
     for (; i < len; i++)
@@ -71,20 +82,35 @@ EXPORT int memcmp(const void *p1, const void *p2, size_t len)
             break;
     }
     return r;
+#endif
 }
 
-EXPORT void *memset(void *buf, int c, size_t n)
+// Intentionally casting away const, don't warn
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+
+EXPORT void *memchr(const void *buf, int c, size_t len)
 {
 #ifdef TARGET_IS_X86
-    if (n >= STOSB_THRESHOLD)
+    return memchr_x86(buf, c, len);
+#else
+    const unsigned char *p = (const unsigned char *) buf;
+    for (; len; --len, ++p)
     {
-        int a, b;
-        __asm__ __volatile__("rep stosb"
-                             : "=&D"(a), "=&c"(b)
-                             : "0"(buf), "a"(c), "1"(n)
-                             : "memory");
-        return buf;
+        if (*p == (unsigned char) c)
+            return (void *) p;
     }
+    return 0;
+#endif
+}
+
+#pragma GCC diagnostic pop
+
+EXPORT void *memset(void *buf, int c, size_t n)
+{
+#ifdef TARGET_IS_X86
+    if (n >= STOSB_THRESHOLD)
+        return memset_x86(buf, c, n);
 #endif
     unsigned char *tmp = (unsigned char *) buf;
     while (n--)
@@ -98,14 +124,7 @@ EXPORT void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
 {
 #ifdef TARGET_IS_X86
     if (n >= STOSB_THRESHOLD)
-    {
-        int a, b, c;
-        __asm__ __volatile__("rep movsb"
-                             : "=&c"(a), "=&D"(b), "=&S"(c)
-                             : "1"(s1), "2"(s2), "0"(n)
-                             : "memory");
-        return s1;
-    }
+        return memcpy_x86(s1, s2, n);
 #endif
     const unsigned char *restrict sp = (const unsigned char *restrict) s2;
     unsigned char *restrict dp = (unsigned char *restrict) s1;
@@ -114,22 +133,6 @@ EXPORT void *memcpy(void *restrict s1, const void *restrict s2, size_t n)
     return s1;
 }
 
-#ifdef TARGET_IS_X86
-static inline void *memmove_x86(void *s1, const void *s2, size_t n)
-{
-    // Perform rep movsb in reverse.
-    const unsigned char *sp = (const unsigned char *) s2 + (n - 1);
-    unsigned char *dp = (unsigned char *) s1 + (n - 1);
-
-    int a, b, c;
-    __asm__ __volatile__("std; rep movsb; cld"
-                         : "=&c"(a), "=&D"(b), "=&S"(c)
-                         : "1"(dp), "2"(sp), "0"(n)
-                         : "memory");
-    return s1;
-}
-#endif
-
 EXPORT void *memmove(void *s1, const void *s2, size_t n)
 {
     if (UNLIKELY(!n))
@@ -143,21 +146,15 @@ EXPORT void *memmove(void *s1, const void *s2, size_t n)
     }
     else
     {
+        // Writing bytes from s2 into s1 cannot be done forwards, copy
+        // backwards instead.
 #ifdef TARGET_IS_X86
-        if (n >= STOSB_THRESHOLD)
-        {
-            memmove_x86(s1, s2, n);
-        }
-        else
-        {
-#endif
-        // Writing bytes from s2 into s1 cannot be done forwards, use memmove.
+        memmove_backward_x86(s1, s2, n);
+#else
         const unsigned char *sp = (const unsigned char *) s2 + (n - 1);
         unsigned char *dp = (unsigned char *) s1 + (n - 1);
         for (; n != 0; n--)
             *dp-- = *sp--;
-#ifdef TARGET_IS_X86
-        }
 #endif
     }
 
@@ -269,3 +266,8 @@ int MemoryCompare(const void *a, const void *b, size_t c)
 {
     return memcmp(a, b, c);
 }
+
+void *MemoryFind(const void *a, int b, size_t c)
+{
+    return memchr(a, b, c);
+}
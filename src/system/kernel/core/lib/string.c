@@ -40,6 +40,16 @@ unsigned long strtoul(const char *nptr, char const **endptr, int base);
 
 #define ULONG_MAX -1
 
+#ifdef TARGET_IS_X86
+// Vectorised scans, see processor/x86_common/string.c. Most strings are short,
+// so these only take over once the first SCALAR_SCAN_LENGTH bytes have been
+// checked the simple way.
+extern size_t strlen_x86(const char *s) PURE;
+extern char *strchr_x86(const char *s, int c) PURE;
+
+#define SCALAR_SCAN_LENGTH 64
+#endif
+
 char toUpper(char c)
 {
     if (c < 'a' || c > 'z')
@@ -92,6 +102,10 @@ WEAK size_t _StringLength(const char *src)
         UNROLL(7);
 #undef UNROLL
         src += 8;
+#ifdef TARGET_IS_X86
+        if ((size_t)(src - orig) >= SCALAR_SCAN_LENGTH)
+            return (src - orig) + strlen_x86(src);
+#endif
     }
 }
 
@@ -406,14 +420,17 @@ char *StringFind(const char *str, int target)
 {
     const char *s;
     char ch;
+#ifdef TARGET_IS_X86
+    const char *orig = str;
+#endif
     while (1)
     {
-#define UNROLL(n)     \
-    s = str + n;      \
-    ch = *s;          \
-    if (!ch)          \
-        return NULL;  \
-    if (ch == target) \
+#define UNROLL(n)            \
+    s = str + n;             \
+    ch = *s;                 \
+    if (!ch)                 \
+        return NULL;         \
+    if (ch == (char) target) \
         return (char *) s;
 
         UNROLL(0);
@@ -426,6 +443,10 @@ char *StringFind(const char *str, int target)
         UNROLL(7);
 #undef UNROLL
         str += 8;
+#ifdef TARGET_IS_X86
+        if ((size_t)(str - orig) >= SCALAR_SCAN_LENGTH)
+            return strchr_x86(str, target);
+#endif
     }
 }
 
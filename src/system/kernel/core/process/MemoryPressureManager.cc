@@ -27,9 +27,10 @@ MemoryPressureManager MemoryPressureManager::m_Instance;
 MemoryPressureHandler::MemoryPressureHandler() = default;
 MemoryPressureHandler::~MemoryPressureHandler() = default;
 
-bool MemoryPressureManager::compact()
+bool MemoryPressureManager::compact(size_t lowestPriority)
 {
-    for (size_t i = 0; i < MAX_MEMPRESSURE_PRIORITY; ++i)
+    for (size_t i = 0; (i < MAX_MEMPRESSURE_PRIORITY) && (i <= lowestPriority);
+         ++i)
     {
         for (List<MemoryPressureHandler *>::Iterator it = m_Handlers[i].begin();
              it != m_Handlers[i].end(); ++it)
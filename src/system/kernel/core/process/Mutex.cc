@@ -21,13 +21,288 @@
 
 #ifdef THREADS
 
-// NOTE, this is in its own file purely so that a vtable can be generated.
-Mutex::Mutex(bool bLocked) : Semaphore(bLocked ? 0 : 1)
+#include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/machine/Machine.h"
+#include "pedigree/kernel/machine/Timer.h"
+#include "pedigree/kernel/process/PerProcessorScheduler.h"
+#include "pedigree/kernel/process/Scheduler.h"
+#include "pedigree/kernel/process/Thread.h"
+#include "pedigree/kernel/process/eventNumbers.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/utilities/Iterator.h"
+
+static void interruptMutex(uint8_t *pBuffer)
+{
+    Processor::information().getCurrentThread()->setInterrupted(true);
+}
+
+Mutex::MutexEvent::MutexEvent()
+    : Event(
+          reinterpret_cast<uintptr_t>(&interruptMutex),
+          false /* Not deletable */)
+{
+}
+
+Mutex::MutexEvent::~MutexEvent() = default;
+
+size_t Mutex::MutexEvent::serialize(uint8_t *pBuffer)
+{
+    return 0;
+}
+
+bool Mutex::MutexEvent::unserialize(uint8_t *pBuffer, Mutex::MutexEvent &event)
+{
+    return true;
+}
+
+size_t Mutex::MutexEvent::getNumber()
+{
+    return EventNumbers::Interrupt;
+}
+
+Mutex::Mutex(bool bLocked)
+    : m_Value(bLocked ? 0 : 1), m_pOwner(0), m_OwnerProcessor(~0),
+      m_nWaiters(0), m_Lock(false), m_Queue()
 {
 }
 
 Mutex::~Mutex()
 {
+    m_Queue.clear();
+}
+
+bool Mutex::tryAcquire(size_t n)
+{
+    if (n != 1)
+    {
+        ERROR("Mutex::tryAcquire: a mutex can only be acquired once");
+        return false;
+    }
+
+    if (!m_Value.compareAndSwap(1, 0))
+        return false;
+
+    m_pOwner = Processor::information().getCurrentThread();
+    m_OwnerProcessor = Processor::id();
+    return true;
+}
+
+Mutex::MutexResult
+Mutex::acquireWithResult(size_t n, size_t timeoutSecs, size_t timeoutUsecs)
+{
+    if (n != 1)
+    {
+        ERROR("Mutex::acquire: a mutex can only be acquired once");
+        return MutexResult::withValue(false);
+    }
+
+    if (tryAcquire())
+        return MutexResult::withValue(true);
+
+    // The owner is likely to release the mutex sooner than we could sleep and
+    // be woken again, so long as it is still running.
+    for (size_t i = 0; (i < MUTEX_SPIN_LIMIT) && ownerRunning(); ++i)
+    {
+        Processor::pause();
+        if (m_Value && tryAcquire())
+            return MutexResult::withValue(true);
+    }
+
+    // If we have a timeout, create the event and register it.
+    Event *pEvent = 0;
+    if (timeoutSecs || timeoutUsecs)
+    {
+        pEvent = new MutexEvent();
+        Machine::instance().getTimer()->addAlarm(
+            pEvent, timeoutSecs, timeoutUsecs);
+    }
+
+    Thread *pThread = Processor::information().getCurrentThread();
+    MutexResult result = MutexResult::withValue(true);
+    while (true)
+    {
+        m_Lock.acquire();
+        bool bWasInterrupts = m_Lock.interrupts();
+
+        // Count ourselves as a waiter before trying again: release() frees
+        // the mutex before it looks for waiters, so either we see the mutex
+        // free here or it sees us and wakes us.
+        m_nWaiters += 1;
+        if (tryAcquire())
+        {
+            m_nWaiters -= 1;
+            m_Lock.release();
+            break;
+        }
+
+        m_Queue.pushBack(pThread);
+
+        Thread::WakeReason wakeReason = Thread::NotWoken;
+
+        pThread->setInterrupted(false);
+        pThread->setUnwindState(Thread::Continue);
+        pThread->setDebugState(
+            Thread::MutexWait,
+            reinterpret_cast<uintptr_t>(__builtin_return_address(0)));
+        pThread->addWakeupWatcher(&wakeReason);
+        Processor::information().getScheduler().sleep(&m_Lock);
+        pThread->setDebugState(Thread::None, 0);
+        pThread->removeWakeupWatcher(&wakeReason);  // sanity removal
+
+        m_Lock.acquire();
+        bool bHandedOff = m_pOwner == pThread;
+        if (!bHandedOff)
+        {
+            // Woken by something other than release() - leave the queue.
+            removeThread(pThread);
+            m_nWaiters -= 1;
+        }
+        m_Lock.release();
+
+        // Why were we woken?
+        bool bState = true;
+        if (!bHandedOff && wakeReason != Thread::NotWoken &&
+            wakeReason != Thread::Unknown)
+        {
+            if (pThread->wasInterrupted())
+            {
+                // Timed out!
+                result = MutexResult::withError(TimedOut);
+            }
+            else
+            {
+                // Interrupted by some other source (e.g. an event).
+                result = MutexResult::withError(Interrupted);
+            }
+
+            bState = false;
+        }
+
+        // Restore interrupt state, which may not have survived unwinding an
+        // event (see Semaphore::acquireWithResult).
+        Processor::setInterrupts(bWasInterrupts);
+
+        if (bHandedOff || !bState)
+        {
+            break;
+        }
+    }
+
+    if (pEvent)
+    {
+        Machine::instance().getTimer()->removeAlarm(pEvent);
+        delete pEvent;
+    }
+
+    return result;
+}
+
+void Mutex::release(size_t n)
+{
+    if (n != 1)
+    {
+        ERROR("Mutex::release: a mutex can only be released once");
+        return;
+    }
+
+    m_pOwner = 0;
+    m_OwnerProcessor = ~0;
+
+    // This must be a full barrier: if the read of m_nWaiters below were
+    // satisfied before the free state was visible, a waiter counting itself
+    // in acquireWithResult() could miss both and sleep forever.
+    m_Value.exchange(1);
+
+    // No waiters (the common case) means nothing more to do.
+    if (!m_nWaiters)
+        return;
+
+    m_Lock.acquire();
+
+    // Take the mutex back to hand it to the first sleeping waiter. If someone
+    // else took it in the meantime, their release() will do this instead.
+    Thread *pWake = 0;
+    if (m_Queue.count() && m_Value.compareAndSwap(1, 0))
+    {
+        for (List<Thread *>::Iterator it = m_Queue.begin();
+             it != m_Queue.end(); ++it)
+        {
+            Thread *pThread = *it;
+            if (!Scheduler::instance().threadInSchedule(pThread))
+            {
+                WARNING("A thread that was to be woken by a Mutex is no "
+                        "longer in the scheduler");
+                continue;
+            }
+            else if (pThread->getStatus() != Thread::Sleeping)
+            {
+                // Already on its way (e.g. timed out), or suspended. It will
+                // try again itself when it runs.
+                continue;
+            }
+
+            m_Queue.erase(it);
+            pWake = pThread;
+            break;
+        }
+
+        if (pWake)
+        {
+            m_pOwner = pWake;
+            m_OwnerProcessor = ~0;
+            m_nWaiters -= 1;
+        }
+        else
+        {
+            m_Value = 1;
+        }
+    }
+
+    m_Lock.release();
+
+    if (pWake)
+    {
+        pWake->getLock().acquire();
+        if (pWake->getStatus() == Thread::Sleeping)
+            pWake->setStatus(Thread::Ready);
+        pWake->getLock().release();
+    }
+}
+
+ssize_t Mutex::getValue()
+{
+    return static_cast<ssize_t>(m_Value);
+}
+
+bool Mutex::ownerRunning()
+{
+#ifdef MULTIPROCESSOR
+    Thread *pOwner = m_pOwner;
+    size_t nProcessor = m_OwnerProcessor;
+    if (!pOwner || (nProcessor == Processor::id()) ||
+        (nProcessor >= Processor::m_ProcessorInformation.count()))
+        return false;
+
+    // Only compare pointers: the owner may have exited since we looked.
+    return Processor::m_ProcessorInformation[nProcessor]->getCurrentThread() ==
+           pOwner;
+#else
+    return false;
+#endif
+}
+
+void Mutex::removeThread(Thread *pThread)
+{
+    for (List<Thread *>::Iterator it = m_Queue.begin(); it != m_Queue.end();
+         ++it)
+    {
+        if ((*it) == pThread)
+        {
+            m_Queue.erase(it);
+            break;
+        }
+    }
 }
 
 #endif
@@ -56,7 +56,8 @@ Process::Process()
       m_bUnreportedResume(false), m_State(Active),
       m_BeforeSuspendState(Thread::Ready), m_Lock(false), m_Metadata(),
       m_LastKernelEntry(0), m_LastUserspaceEntry(0), m_pRootFile(0),
-      m_bSharedAddressSpace(false), m_DeadThreads(0)
+      m_bSharedAddressSpace(false), m_bBorrowedAddressSpace(false),
+      m_pBorrowWaiter(0), m_DeadThreads(0)
 {
     resetCounts();
     m_Metadata.startTime = Time::getTimeNanoseconds();
@@ -88,7 +89,8 @@ Process::Process(Process *pParent, bool bCopyOnWrite)
       m_State(pParent->getState()), m_BeforeSuspendState(Thread::Ready),
       m_Lock(false), m_Metadata(pParent->m_Metadata), m_LastKernelEntry(0),
       m_LastUserspaceEntry(0), m_pRootFile(pParent->m_pRootFile),
-      m_bSharedAddressSpace(!bCopyOnWrite), m_DeadThreads(0)
+      m_bSharedAddressSpace(!bCopyOnWrite), m_bBorrowedAddressSpace(false),
+      m_pBorrowWaiter(0), m_DeadThreads(0)
 {
     m_pAddressSpace = pParent->m_pAddressSpace->clone(bCopyOnWrite);
 
@@ -106,6 +108,30 @@ Process::Process(Process *pParent, bool bCopyOnWrite)
     }
 }
 
+Process::Process(Process *pParent, BorrowAddressSpaceTag)
+    : m_Threads(), m_NextTid(0), m_Id(0), str(), m_pParent(pParent),
+      m_pAddressSpace(pParent->m_pAddressSpace), m_ExitStatus(0),
+      m_Cwd(pParent->m_Cwd), m_Ctty(pParent->m_Ctty),
+      m_SpaceAllocator(pParent->m_SpaceAllocator),
+      m_DynamicSpaceAllocator(pParent->m_DynamicSpaceAllocator),
+      m_pUser(pParent->m_pUser), m_pGroup(pParent->m_pGroup),
+      m_pEffectiveUser(pParent->m_pEffectiveUser),
+      m_pEffectiveGroup(pParent->m_pEffectiveGroup),
+      m_pDynamicLinker(pParent->m_pDynamicLinker), m_pSubsystem(0), m_Waiters(),
+      m_bUnreportedSuspend(false), m_bUnreportedResume(false),
+      m_State(pParent->getState()), m_BeforeSuspendState(Thread::Ready),
+      m_Lock(false), m_Metadata(pParent->m_Metadata), m_LastKernelEntry(0),
+      m_LastUserspaceEntry(0), m_pRootFile(pParent->m_pRootFile),
+      m_bSharedAddressSpace(false), m_bBorrowedAddressSpace(true),
+      m_pBorrowWaiter(0), m_DeadThreads(0)
+{
+    m_Id = Scheduler::instance().addProcess(this);
+
+    // Set a temporary description.
+    str = m_pParent->str;
+    str += "<V>";  // V for vforked (i.e. borrowed address space)
+}
+
 Process::~Process()
 {
     // Make sure we have full mutual exclusion on the Subsystem before we lock
@@ -167,11 +193,19 @@ Process::~Process()
     bool bInterrupts = Processor::getInterrupts();
     Processor::setInterrupts(false);
 
-    Processor::switchAddressSpace(*m_pAddressSpace);
-    m_pAddressSpace->revertToKernelAddressSpace();
-    Processor::switchAddressSpace(VAddressSpace);
+    // A borrowed address space still belongs to our parent.
+    if (m_bBorrowedAddressSpace)
+    {
+        releaseBorrowWaiter();
+    }
+    else
+    {
+        Processor::switchAddressSpace(*m_pAddressSpace);
+        m_pAddressSpace->revertToKernelAddressSpace();
+        Processor::switchAddressSpace(VAddressSpace);
 
-    delete m_pAddressSpace;
+        delete m_pAddressSpace;
+    }
 
     str.append("<Z>");
 
@@ -268,6 +302,10 @@ void Process::kill()
 
     m_State = Terminated;
 
+    // A vfork() parent can run again now. We keep the borrowed address space
+    // until we are destroyed, but never return to userspace with it.
+    releaseBorrowWaiter();
+
     processTerminated();
 
     // Add to the zombie queue if the process is an orphan.
@@ -391,6 +429,44 @@ void Process::notifyWaiters()
     }
 }
 
+void Process::releaseBorrowWaiter()
+{
+    Semaphore *pWaiter = m_pBorrowWaiter;
+    m_pBorrowWaiter = 0;
+    if (pWaiter)
+    {
+        pWaiter->release();
+    }
+}
+
+bool Process::detachAddressSpace()
+{
+    if (!m_bBorrowedAddressSpace)
+    {
+        return true;
+    }
+
+    VirtualAddressSpace *pAddressSpace = VirtualAddressSpace::create();
+    if (!pAddressSpace)
+    {
+        return false;
+    }
+
+    bool bInterrupts = Processor::getInterrupts();
+    Processor::setInterrupts(false);
+
+    // The scheduler picks up the new address space from m_pAddressSpace, so
+    // this must not be interrupted between the two.
+    m_pAddressSpace = pAddressSpace;
+    m_bBorrowedAddressSpace = false;
+    Processor::switchAddressSpace(*m_pAddressSpace);
+
+    Processor::setInterrupts(bInterrupts);
+
+    releaseBorrowWaiter();
+    return true;
+}
+
 Process *Process::getInit()
 {
     return m_pInitProcess;
@@ -22,6 +22,13 @@
 #include "pedigree/kernel/utilities/Iterator.h"
 #include "pedigree/kernel/utilities/utility.h"
 
+#if defined(HOSTED) && defined(MULTIPROCESSOR)
+#include "pedigree/kernel/process/Process.h"
+#include "pedigree/kernel/process/Scheduler.h"
+#include "pedigree/kernel/process/Thread.h"
+#include "pedigree/kernel/processor/VirtualAddressSpace.h"
+#endif
+
 class PerProcessorScheduler;
 class Thread;
 
@@ -62,6 +69,18 @@ bool RoundRobinCoreAllocator::initialise(
 
 PerProcessorScheduler *RoundRobinCoreAllocator::allocateThread(Thread *pThread)
 {
+#if defined(HOSTED) && defined(MULTIPROCESSOR)
+    // Hosted address spaces are all mapped into the one host process, so only
+    // one of them can be live at a time. Keep everything that isn't using the
+    // kernel address space on the BSP.
+    Process *pProcess = pThread->getParent();
+    if (pProcess && pProcess->getAddressSpace() !=
+                        &VirtualAddressSpace::getKernelAddressSpace())
+    {
+        return Scheduler::instance().getBootstrapProcessorScheduler();
+    }
+#endif
+
     PerProcessorScheduler *pReturn = m_ProcMap.lookup(m_pNext);
     m_pNext = pReturn;
     return pReturn;
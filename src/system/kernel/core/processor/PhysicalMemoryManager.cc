@@ -19,7 +19,9 @@
 
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/MemoryRegion.h"
+#include "pedigree/kernel/processor/VirtualAddressSpace.h"
 #include "pedigree/kernel/utilities/new"
+#include "pedigree/kernel/utilities/utility.h"
 
 PhysicalMemoryManager::PhysicalMemoryManager() : m_MemoryRegions()
 {
@@ -34,7 +36,90 @@ size_t PhysicalMemoryManager::freePageCount() const
     return ~0UL;
 }
 
-#ifndef UTILITY_LINUX
+size_t PhysicalMemoryManager::zeroedPageHits() const
+{
+    return 0;
+}
+
+size_t PhysicalMemoryManager::zeroedPageMisses() const
+{
+    return 0;
+}
+
+PageFrame *PhysicalMemoryManager::pageFrame(physical_uintptr_t page)
+{
+    return 0;
+}
+
+physical_uintptr_t
+PhysicalMemoryManager::allocateBlock(size_t order, size_t pageConstraints)
+{
+    // Only single pages without a buddy allocator.
+    return order ? 0 : allocatePage(pageConstraints);
+}
+
+void PhysicalMemoryManager::freeBlock(physical_uintptr_t block, size_t order)
+{
+    if (!order)
+    {
+        freePage(block);
+    }
+}
+
+void PhysicalMemoryManager::fragmentationReport(String &report)
+{
+}
+
+size_t PhysicalMemoryManager::allocatePages(
+    size_t count, physical_uintptr_t *pages, size_t pageConstraints)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        pages[i] = allocatePage(pageConstraints);
+        if (!pages[i])
+        {
+            return i;
+        }
+    }
+
+    return count;
+}
+
+#ifdef UTILITY_LINUX
+physical_uintptr_t
+PhysicalMemoryManager::allocateZeroedPage(size_t pageConstraints)
+{
+    // Host utilities never map physical pages, so there is nothing to zero.
+    return allocatePage(pageConstraints);
+}
+#else
+physical_uintptr_t
+PhysicalMemoryManager::allocateZeroedPage(size_t pageConstraints)
+{
+    physical_uintptr_t page = allocatePage(pageConstraints);
+    if (!page)
+    {
+        return 0;
+    }
+
+    // No way to reach the page other than mapping it somewhere. Mapping it
+    // as non-RAM keeps freeing the region from freeing the page.
+    MemoryRegion region("zeroed-page");
+    if (!allocateRegion(
+            region, 1, continuous | nonRamMemory | force | anonymous,
+            VirtualAddressSpace::KernelMode | VirtualAddressSpace::Write,
+            page))
+    {
+        freePage(page);
+        return 0;
+    }
+
+    ByteSet(region.virtualAddress(), 0, getPageSize());
+    region.free();
+
+    return page;
+}
+
 void PhysicalMemoryManager::allocateMemoryRegionList(
     Vector<MemoryRegionInfo *> &MemoryRegions)
 {
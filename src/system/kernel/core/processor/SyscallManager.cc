@@ -18,6 +18,127 @@
  */
 
 #include "pedigree/kernel/processor/SyscallManager.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+static const char *g_ServiceNames[serviceEnd] = {
+    "linux", "posix", "tui", "native", "pedigree-c", "kernel"};
+
+#ifdef SYSCALL_STATISTICS
+#ifdef MULTIPROCESSOR
+/// \todo handle more than 64 CPUs (as for Spinlock).
+static const size_t StatisticsProcessors = 64;
+#else
+static const size_t StatisticsProcessors = 1;
+#endif
+
+/** Per-processor statistics tables for each service. Tables and entries are
+ *  allocated on the first call that needs them and never freed. */
+static SyscallManager::Statistics **g_pStatistics[StatisticsProcessors]
+                                                 [serviceEnd];
+
+/** Publishes p at *pSlot unless another thread got there first, in which case
+ *  p is discarded and the winner returned. */
+template <class T>
+static T *publish(T **pSlot, T *p)
+{
+    T *expected = 0;
+    if (__atomic_compare_exchange_n(
+            pSlot, &expected, p, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return p;
+
+    delete p;
+    return expected;
+}
+#endif
 
 SyscallManager::SyscallManager() = default;
 SyscallManager::~SyscallManager() = default;
+
+void SyscallManager::recordStatistics(
+    Service_t service, size_t number, uint64_t time)
+{
+#ifdef SYSCALL_STATISTICS
+    if (service >= serviceEnd || number >= SYSCALL_STATISTICS_NUMBERS)
+        return;
+
+    // Threads can move between processors while they do this, so the
+    // per-processor entries are still updated atomically; they only exist to
+    // keep each processor's updates on its own cache lines.
+    size_t cpu = 0;
+    if (Processor::m_Initialised == 2)
+        cpu = Processor::id() % StatisticsProcessors;
+
+    Statistics **&pTable = g_pStatistics[cpu][service];
+    Statistics **pEntries = __atomic_load_n(&pTable, __ATOMIC_ACQUIRE);
+    if (UNLIKELY(!pEntries))
+    {
+        Statistics **pNew = new Statistics *[SYSCALL_STATISTICS_NUMBERS];
+        ByteSet(pNew, 0, sizeof(Statistics *) * SYSCALL_STATISTICS_NUMBERS);
+        pEntries = publish(&pTable, pNew);
+    }
+
+    Statistics *pStats = __atomic_load_n(&pEntries[number], __ATOMIC_ACQUIRE);
+    if (UNLIKELY(!pStats))
+    {
+        Statistics *pNew = new Statistics;
+        ByteSet(pNew, 0, sizeof(Statistics));
+        pStats = publish(&pEntries[number], pNew);
+    }
+
+    size_t bucket = time ? 63 - __builtin_clzll(time) : 0;
+    if (bucket >= SYSCALL_STATISTICS_BUCKETS)
+        bucket = SYSCALL_STATISTICS_BUCKETS - 1;
+
+    __atomic_add_fetch(&pStats->nCalls, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pStats->totalTime, time, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&pStats->histogram[bucket], 1, __ATOMIC_RELAXED);
+
+    uint64_t maxTime = __atomic_load_n(&pStats->maxTime, __ATOMIC_RELAXED);
+    while (time > maxTime && !__atomic_compare_exchange_n(
+                                 &pStats->maxTime, &maxTime, time, true,
+                                 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+#endif
+}
+
+bool SyscallManager::getStatistics(
+    Service_t service, size_t number, Statistics &stats)
+{
+    ByteSet(&stats, 0, sizeof(stats));
+
+#ifdef SYSCALL_STATISTICS
+    if (service >= serviceEnd || number >= SYSCALL_STATISTICS_NUMBERS)
+        return false;
+
+    for (size_t cpu = 0; cpu < StatisticsProcessors; ++cpu)
+    {
+        Statistics **pEntries =
+            __atomic_load_n(&g_pStatistics[cpu][service], __ATOMIC_ACQUIRE);
+        if (!pEntries)
+            continue;
+
+        Statistics *pStats =
+            __atomic_load_n(&pEntries[number], __ATOMIC_ACQUIRE);
+        if (!pStats)
+            continue;
+
+        stats.nCalls += pStats->nCalls;
+        stats.totalTime += pStats->totalTime;
+        if (pStats->maxTime > stats.maxTime)
+            stats.maxTime = pStats->maxTime;
+        for (size_t i = 0; i < SYSCALL_STATISTICS_BUCKETS; ++i)
+            stats.histogram[i] += pStats->histogram[i];
+    }
+#endif
+
+    return stats.nCalls != 0;
+}
+
+const char *SyscallManager::getServiceName(Service_t service)
+{
+    if (service >= serviceEnd)
+        return "?";
+
+    return g_ServiceNames[service];
+}
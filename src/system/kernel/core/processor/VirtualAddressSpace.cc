@@ -20,10 +20,27 @@
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
 #include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
 #include "pedigree/kernel/utilities/utility.h"
 
 physical_uintptr_t VirtualAddressSpace::m_ZeroPage = 0;
 
+size_t
+VirtualAddressSpace::copyInto(void *destination, const void *source, size_t size)
+{
+    // Without help from the architecture we can only reach the active address
+    // space, and the kernel (which is part of all of them).
+    if (this != &Processor::information().getVirtualAddressSpace() &&
+        reinterpret_cast<uintptr_t>(destination) < getKernelStart())
+    {
+        return 0;
+    }
+
+    MemoryCopy(destination, source, size);
+    return size;
+}
+
 void *VirtualAddressSpace::expandHeap(ssize_t incr, size_t flags)
 {
     PhysicalMemoryManager &PMemoryManager = PhysicalMemoryManager::instance();
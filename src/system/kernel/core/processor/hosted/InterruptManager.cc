@@ -30,6 +30,10 @@
 #include "pedigree/kernel/process/Process.h"
 #endif
 
+#if defined(MULTIPROCESSOR)
+#include "Multiprocessor.h"
+#endif
+
 namespace __pedigree_hosted
 {
 };
@@ -202,7 +206,11 @@ void HostedInterruptManager::signalShim(int which, void *siginfo, void *meta)
 {
     if (!Processor::getInterrupts())
     {
-        if (which == SIGUSR1 || which == SIGUSR2)
+        bool bInterrupt = which == SIGUSR1 || which == SIGUSR2;
+#if defined(MULTIPROCESSOR)
+        bInterrupt = bInterrupt || which == HOSTED_IPI_SIGNAL;
+#endif
+        if (bInterrupt)
         {
             FATAL_NOLOCK("interrupts disabled but interrupts are firing");
         }
@@ -219,7 +227,7 @@ void HostedInterruptManager::signalShim(int which, void *siginfo, void *meta)
 
     // Update return signal mask.
     ucontext_t *ctx = reinterpret_cast<ucontext_t *>(meta);
-    sigprocmask(0, 0, &ctx->uc_sigmask);
+    pthread_sigmask(0, 0, &ctx->uc_sigmask);
 }
 
 void HostedInterruptManager::initialiseProcessor()
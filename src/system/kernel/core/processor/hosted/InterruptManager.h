@@ -28,7 +28,8 @@
 /** @addtogroup kernelprocessorhosted
  * @{ */
 
-#define MAX_SIGNAL 32
+/** Covers the realtime signals too, one of which carries IPIs. */
+#define MAX_SIGNAL 65
 
 /** The interrupt manager on hosted systems */
 class HostedInterruptManager : public ::InterruptManager
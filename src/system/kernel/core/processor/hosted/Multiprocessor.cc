@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#if defined(MULTIPROCESSOR)
+
+#include "Multiprocessor.h"
+#include "pedigree/kernel/Log.h"
+#include "pedigree/kernel/Spinlock.h"
+#include "pedigree/kernel/process/initialiseMultitasking.h"
+#include "pedigree/kernel/processor/InterruptHandler.h"
+#include "pedigree/kernel/processor/InterruptManager.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/processor/state.h"
+#include "pedigree/kernel/utilities/Vector.h"
+
+using namespace __pedigree_hosted;
+
+#include <pthread.h>
+#include <signal.h>
+
+namespace __multiprocessor_cc_hosted
+{
+#include <stdlib.h>
+#include <unistd.h>
+}  // namespace __multiprocessor_cc_hosted
+
+using namespace __multiprocessor_cc_hosted;
+
+/** Receives IPIs on every virtual processor. */
+class HostedIpiHandler : public InterruptHandler
+{
+  public:
+    virtual void interrupt(size_t nInterruptNumber, InterruptState &state);
+};
+
+static HostedIpiHandler g_IpiHandler;
+
+// Don't track these locks - they are never going to be "correct" (they are for
+// synchronisation, not for protecting a specific resource).
+Spinlock Multiprocessor::m_ProcessorLock1(false, true);
+Spinlock Multiprocessor::m_ProcessorLock2(true, true);
+
+pthread_t Multiprocessor::m_Threads[HOSTED_MAX_PROCESSORS];
+
+void HostedIpiHandler::interrupt(size_t nInterruptNumber, InterruptState &state)
+{
+    // The vector travels in the signal's value.
+    size_t vector = state.getRegister(0);
+
+    if (vector == IPI_HALT_VECTOR)
+    {
+        NOTICE("Halting processor #" << Dec << Processor::id());
+
+        // Processor::halt() would take the whole host process down with it,
+        // so just stop taking signals on this thread instead.
+        sigset_t set;
+        sigfillset(&set);
+        while (true)
+            sigsuspend(&set);
+    }
+}
+
+size_t Multiprocessor::initialise1()
+{
+    // One virtual processor per host processor, unless told otherwise.
+    long nProcessors = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *env = getenv(HOSTED_PROCESSORS_ENVIRONMENT);
+    if (env)
+        nProcessors = strtol(env, 0, 10);
+    if (nProcessors < 1)
+        nProcessors = 1;
+    else if (nProcessors > HOSTED_MAX_PROCESSORS)
+        nProcessors = HOSTED_MAX_PROCESSORS;
+
+    // The BSP is the host thread we booted on.
+    Processor::m_ProcessorInformation.pushBack(
+        &Processor::m_SafeBspProcessorInformation);
+    Processor::m_pLocalInformation = &Processor::m_SafeBspProcessorInformation;
+    m_Threads[0] = pthread_self();
+
+    if (!InterruptManager::instance().registerInterruptHandler(
+            HOSTED_IPI_SIGNAL, &g_IpiHandler))
+    {
+        ERROR("Multiprocessor: couldn't register the IPI handler");
+        return 1;
+    }
+
+    if (nProcessors == 1)
+    {
+        NOTICE("Multiprocessor: running with a single virtual processor");
+        return 1;
+    }
+
+    NOTICE(
+        "Multiprocessor: starting " << Dec << nProcessors << Hex
+                                    << " virtual processors");
+
+    for (long i = 1; i < nProcessors; ++i)
+    {
+        ::ProcessorInformation *pProcessorInfo = new ::ProcessorInformation(i);
+        Processor::m_ProcessorInformation.pushBack(pProcessorInfo);
+
+        NOTICE(" Booting processor #" << Dec << i << Hex);
+
+        // Acquire the lock
+        m_ProcessorLock1.acquire(false);
+
+        // The new thread inherits our signal mask, so it starts with
+        // interrupts disabled.
+        int r = pthread_create(
+            &m_Threads[i], 0, applicationProcessorStartup, pProcessorInfo);
+        if (r != 0)
+        {
+            ERROR(
+                "Multiprocessor: couldn't create a host thread for processor #"
+                << Dec << i << Hex);
+            m_ProcessorLock1.release();
+            Processor::m_ProcessorInformation.popBack();
+            delete pProcessorInfo;
+            break;
+        }
+
+        // Wait until the processor is started and has unlocked the lock
+        m_ProcessorLock1.acquire(false, false);
+        m_ProcessorLock1.release();
+    }
+
+    return Processor::m_ProcessorInformation.count();
+}
+
+void Multiprocessor::initialise2()
+{
+    m_ProcessorLock2.release();
+}
+
+bool Multiprocessor::interProcessorInterrupt(
+    ProcessorId processorId, size_t vector)
+{
+    if (processorId >= Processor::getCount())
+        return false;
+
+    union sigval value;
+    value.sival_ptr = reinterpret_cast<void *>(vector);
+    return pthread_sigqueue(m_Threads[processorId], HOSTED_IPI_SIGNAL, value) ==
+           0;
+}
+
+void Multiprocessor::interProcessorInterruptAllExcludingThis(size_t vector)
+{
+    ProcessorId self = Processor::id();
+    for (size_t i = 0; i < Processor::getCount(); ++i)
+    {
+        if (i != self)
+            interProcessorInterrupt(i, vector);
+    }
+}
+
+void *Multiprocessor::applicationProcessorStartup(void *param)
+{
+    // Make Processor::information() and Processor::id() work on this thread.
+    Processor::m_pLocalInformation =
+        reinterpret_cast<::ProcessorInformation *>(param);
+    Processor::setInterrupts(false);
+
+    // Signal the Bootstrap processor that this processor is started and the BSP
+    // can continue to boot up other processors
+    m_ProcessorLock1.release();
+
+    // Wait until the BSP has finished initialising multitasking.
+    m_ProcessorLock2.acquire(false, false);
+    m_ProcessorLock2.release();
+
+    // Start up the kernel process and idle thread for this processor. This also
+    // arms the processor's own scheduler timer.
+    initialiseMultitaskingPerProcessor();
+
+    // Call the per-processor code in main.cc
+    apMain();
+
+    // apMain() becomes this processor's idle thread and never returns.
+    return 0;
+}
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef KERNEL_PROCESSOR_HOSTED_MULTIPROCESSOR_H
+#define KERNEL_PROCESSOR_HOSTED_MULTIPROCESSOR_H
+
+#include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/processor/types.h"
+
+namespace __pedigree_hosted
+{
+#include <pthread.h>
+#include <signal.h>
+}  // namespace __pedigree_hosted
+
+class Spinlock;
+
+/** @addtogroup kernelprocessorhosted
+ * @{ */
+
+/** Upper bound on the number of virtual processors. */
+#define HOSTED_MAX_PROCESSORS 32
+
+/** Environment variable giving the number of virtual processors to start. If
+ *  it is not set, one virtual processor is started per host processor. */
+#define HOSTED_PROCESSORS_ENVIRONMENT "PEDIGREE_CPUS"
+
+/** The host signal used to deliver interprocessor interrupts. It is a
+ *  realtime signal so that IPIs queue rather than coalesce; the vector is
+ *  carried in the signal's value. */
+#define HOSTED_IPI_SIGNAL (SIGRTMIN)
+
+/** Stops the target processor (used when entering the debugger). */
+#define IPI_HALT_VECTOR 0xFB
+
+/** Runs virtual processors as host threads. Each has its own
+ *  ProcessorInformation, scheduler timer and IPI delivery. */
+class Multiprocessor
+{
+  public:
+    /** Startup and initialise all processors
+     *\return the number of initialised processors */
+    static size_t initialise1() INITIALISATION_ONLY;
+    /** Let the application processors enter the scheduler */
+    static void initialise2() INITIALISATION_ONLY;
+
+    /** Issue an IPI to one processor
+     *\param[in] processorId the destination processor
+     *\param[in] vector the IPI vector
+     *\return true if the IPI was queued for the processor */
+    static bool interProcessorInterrupt(ProcessorId processorId, size_t vector);
+    /** Issue an IPI to all processors except this one
+     *\param[in] vector the IPI vector */
+    static void interProcessorInterruptAllExcludingThis(size_t vector);
+
+  private:
+    /** Host thread entry point for each application processor. */
+    static void *applicationProcessorStartup(void *param);
+
+    static Spinlock m_ProcessorLock1 INITIALISATION_ONLY_DATA;
+    static Spinlock m_ProcessorLock2 INITIALISATION_ONLY_DATA;
+
+    /** Host threads running each processor, indexed by ProcessorId. */
+    static __pedigree_hosted::pthread_t m_Threads[HOSTED_MAX_PROCESSORS];
+};
+
+/** @} */
+
+#endif
@@ -55,6 +55,14 @@ void PageFaultHandler::interrupt(size_t interruptNumber, InterruptState &state)
     uintptr_t code = info->si_code;
 
     VirtualAddressSpace &va = Processor::information().getVirtualAddressSpace();
+
+    // Pages aged for swapping are kept inaccessible until their next access.
+    if (static_cast<HostedVirtualAddressSpace &>(va).noteAccess(
+            reinterpret_cast<void *>(page)))
+    {
+        return;
+    }
+
     if (va.isMapped(reinterpret_cast<void *>(page)))
     {
         physical_uintptr_t phys;
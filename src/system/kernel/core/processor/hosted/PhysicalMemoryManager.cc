@@ -142,19 +142,11 @@ void HostedPhysicalMemoryManager::freePageUnlocked(physical_uintptr_t page)
               "acquired lock");
 
     // Check for pinned page.
-    size_t index = page >> 12;
-    if (m_PageMetadata && m_PageMetadata[index].active)
+    PageFrame *pFrame = pageFrame(page);
+    if (pFrame && !pFrame->unpin())
     {
-        if (--m_PageMetadata[index].refcount)
-        {
-            // Still references.
-            return;
-        }
-        else
-        {
-            // No more references.
-            m_PageMetadata[index].active = false;
-        }
+        // Still references.
+        return;
     }
 
 #ifdef USE_BITMAP
@@ -175,24 +167,22 @@ void HostedPhysicalMemoryManager::freePageUnlocked(physical_uintptr_t page)
 
 void HostedPhysicalMemoryManager::pin(physical_uintptr_t page)
 {
-    RecursingLockGuard<Spinlock> guard(m_Lock);
-
-    if (!m_PageMetadata)
+    PageFrame *pFrame = pageFrame(page);
+    if (pFrame)
     {
-        // No page metadata to speak of.
-        return;
+        pFrame->pin();
     }
+}
 
-    size_t index = page >> 12;
-    if (m_PageMetadata[index].active)
-    {
-        ++m_PageMetadata[index].refcount;
-    }
-    else
+PageFrame *HostedPhysicalMemoryManager::pageFrame(physical_uintptr_t page)
+{
+    if (!m_PageFrames || page >= HOSTED_PHYSICAL_MEMORY_SIZE)
     {
-        m_PageMetadata[index].refcount = 1;
-        m_PageMetadata[index].active = true;
+        // No page metadata to speak of.
+        return 0;
     }
+
+    return &m_PageFrames[page >> 12];
 }
 
 bool HostedPhysicalMemoryManager::allocateRegion(
@@ -321,7 +311,7 @@ void HostedPhysicalMemoryManager::initialise(const BootstrapStruct_t &Info)
     {
         m_PageStack.free(p);
     }
-    m_PageMetadata = new struct page[HOSTED_PHYSICAL_MEMORY_SIZE >> 12];
+    m_PageFrames = new PageFrame[HOSTED_PHYSICAL_MEMORY_SIZE >> 12]();
 
     // Initialise the free physical ranges
     m_PhysicalRanges.free(0, 0x100000000ULL);
@@ -352,7 +342,7 @@ void HostedPhysicalMemoryManager::initialisationDone()
 
 HostedPhysicalMemoryManager::HostedPhysicalMemoryManager()
     : m_PhysicalRanges(), m_MemoryRegions(), m_Lock(false, true),
-      m_RegionLock(false, true), m_PageMetadata(0), m_BackingFile(-1)
+      m_RegionLock(false, true), m_PageFrames(0), m_BackingFile(-1)
 {
     // Create our backing memory file.
     m_BackingFile = open("physical.bin", O_RDWR | O_CREAT, 0644);
@@ -363,8 +353,8 @@ HostedPhysicalMemoryManager::HostedPhysicalMemoryManager()
 HostedPhysicalMemoryManager::~HostedPhysicalMemoryManager()
 {
     PhysicalMemoryManager::m_MemoryRegions.clear();
-    delete[] m_PageMetadata;
-    m_PageMetadata = 0;
+    delete[] m_PageFrames;
+    m_PageFrames = 0;
 
     close(m_BackingFile);
     m_BackingFile = -1;
@@ -23,14 +23,18 @@
 #include "pedigree/kernel/BootstrapInfo.h"
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/PageFrame.h"
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
-#include "pedigree/kernel/utilities/HashTable.h"
 #include "pedigree/kernel/utilities/RangeList.h"
 
 /** @addtogroup kernelprocessorhosted
  * @{ */
 
+/** Size of the emulated physical memory. Can be overridden at build time,
+ * for example to run with an artificially low memory limit. */
+#ifndef HOSTED_PHYSICAL_MEMORY_SIZE
 #define HOSTED_PHYSICAL_MEMORY_SIZE (1UL << 31)
+#endif
 
 /** The common x86 implementation of the PhysicalMemoryManager
  *\brief Implementation of the PhysicalMemoryManager for common x86 */
@@ -59,6 +63,7 @@ class HostedPhysicalMemoryManager : public PhysicalMemoryManager
         size_t Flags, physical_uintptr_t start = -1);
 
     virtual void pin(physical_uintptr_t page);
+    virtual PageFrame *pageFrame(physical_uintptr_t page);
 
     /** Initialise the page stack
      *\param[in] Info reference to the multiboot information structure */
@@ -161,49 +166,8 @@ class HostedPhysicalMemoryManager : public PhysicalMemoryManager
     /** To guard against multiprocessor reentrancy. */
     Spinlock m_Lock, m_RegionLock;
 
-    /** Utility to wrap a physical address and hash it. */
-    class PageHashable
-    {
-      public:
-        PageHashable()
-        {
-            m_Hash = m_Page = 0;
-        }
-
-        PageHashable(physical_uintptr_t p)
-        {
-            m_Hash = p / getPageSize();
-            m_Page = p;
-        }
-
-        size_t hash() const
-        {
-            return m_Hash;
-        }
-
-        bool operator==(const PageHashable &p) const
-        {
-            return p.m_Page == m_Page;
-        }
-
-      private:
-        size_t m_Hash;
-        physical_uintptr_t m_Page;
-    };
-
-    /** Physical page metadata. */
-    struct page
-    {
-        page() : active(false), refcount(0)
-        {
-        }
-
-        bool active;
-        size_t refcount;
-    };
-
-    /** Page metadata table */
-    struct page *m_PageMetadata;
+    /** Page frame metadata, indexed by page frame number. */
+    PageFrame *m_PageFrames;
 
     /** Hosted: backing file for physical memory. */
     int m_BackingFile;
@@ -22,10 +22,17 @@
 #include "PhysicalMemoryManager.h"
 #include "SyscallManager.h"
 #include "VirtualAddressSpace.h"
+#include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/process/Scheduler.h"
 #include "pedigree/kernel/process/Thread.h"
 #include "pedigree/kernel/process/initialiseMultitasking.h"
 #include "pedigree/kernel/processor/PageFaultHandler.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/processor/state.h"
+
+#if defined(MULTIPROCESSOR)
+#include "Multiprocessor.h"
+#endif
 
 namespace __pedigree_hosted
 {
@@ -35,7 +42,10 @@ using namespace __pedigree_hosted;
 #include <setjmp.h>
 #include <signal.h>
 
-bool Processor::m_bInterrupts;
+__thread bool Processor::m_bInterrupts;
+#if defined(MULTIPROCESSOR)
+__thread ProcessorInformation *Processor::m_pLocalInformation = 0;
+#endif
 
 typedef void (*jump_func_t)(uintptr_t, uintptr_t, uintptr_t, uintptr_t);
 
@@ -56,8 +66,17 @@ void Processor::initialise1(const BootstrapStruct_t &Info)
 
 void Processor::initialise2(const BootstrapStruct_t &Info)
 {
+#if defined(MULTIPROCESSOR)
+    size_t nProcessors = Multiprocessor::initialise1();
+#endif
+
     initialiseMultitasking();
     m_Initialised = 2;
+
+#if defined(MULTIPROCESSOR)
+    if (nProcessors != 1)
+        Multiprocessor::initialise2();
+#endif
 }
 
 void Processor::deinitialise()
@@ -226,13 +245,23 @@ void Processor::setInterrupts(bool bEnable)
     {
         sigemptyset(&set);
 
-        // Only SIGUSR1 and SIGUSR2 are true "interrupts". The rest are all
-        // more like exceptions, which we are okay with triggering even if
-        // bEnable is false.
+        // Only SIGUSR1 and SIGUSR2 (and IPIs) are true "interrupts". The
+        // rest are all more like exceptions, which we are okay with
+        // triggering even if bEnable is false.
         sigaddset(&set, SIGUSR1);
         sigaddset(&set, SIGUSR2);
+#if defined(MULTIPROCESSOR)
+        sigaddset(&set, HOSTED_IPI_SIGNAL);
+#endif
     }
 
+#if defined(MULTIPROCESSOR)
+    // Device IRQs are process-directed signals; like the I/O APIC, route them
+    // all to the BSP by keeping them masked on every other processor.
+    if (Processor::id() != 0)
+        sigaddset(&set, SIGUSR1);
+#endif
+
     // We must mark interrupts enabled before we unmask signals, as any pending
     // signals may trigger immediately (and will cause problems if interrupts
     // are marked as disabled)
@@ -241,7 +270,8 @@ void Processor::setInterrupts(bool bEnable)
         m_bInterrupts = true;
     }
 
-    int r = sigprocmask(SIG_SETMASK, &set, 0);
+    // Each processor is a host thread, so this must only mask this thread.
+    int r = pthread_sigmask(SIG_SETMASK, &set, 0);
     if (r != 0)
     {
         ERROR("Processor::setInterrupts failed to set new mask");
@@ -271,6 +301,33 @@ void Processor::invalidate(void *pAddress)
     // no-op on hosted
 }
 
+#if defined(MULTIPROCESSOR)
+ProcessorId Processor::id()
+{
+    if (!m_pLocalInformation)
+        return 0;
+
+    return m_pLocalInformation->m_ProcessorId;
+}
+
+ProcessorInformation &Processor::information()
+{
+    if (!m_pLocalInformation)
+        return m_SafeBspProcessorInformation;
+
+    return *m_pLocalInformation;
+}
+
+size_t Processor::getCount()
+{
+    // Before Multiprocessor::initialise1(), only the BSP is running.
+    if (!m_ProcessorInformation.count())
+        return 1;
+
+    return m_ProcessorInformation.count();
+}
+#endif
+
 namespace __processor_cc_hosted
 {
 #include <sched.h>
@@ -288,9 +345,9 @@ void Processor::_breakpoint()
     sigemptyset(&set);
     sigemptyset(&oset);
     sigaddset(&set, SIGTRAP);
-    sigprocmask(SIG_UNBLOCK, &set, &oset);
+    pthread_sigmask(SIG_UNBLOCK, &set, &oset);
     raise(SIGTRAP);
-    sigprocmask(SIG_SETMASK, &oset, 0);
+    pthread_sigmask(SIG_SETMASK, &oset, 0);
 }
 
 void Processor::_reset()
@@ -305,6 +362,10 @@ void Processor::_haltUntilInterrupt()
     Processor::setInterrupts(true);
     sigset_t set;
     sigemptyset(&set);
+#if defined(MULTIPROCESSOR)
+    if (Processor::id() != 0)
+        sigaddset(&set, SIGUSR1);
+#endif
     sigsuspend(&set);
     Processor::setInterrupts(bOld);
 }
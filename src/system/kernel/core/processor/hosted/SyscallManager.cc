@@ -42,7 +42,8 @@ bool HostedSyscallManager::registerSyscallHandler(
     if (UNLIKELY(pHandler == 0 && m_pHandler[Service] == 0))
         return false;
 
-    m_pHandler[Service] = pHandler;
+    // Publish the handler; syscall() reads the table without the lock.
+    __atomic_store_n(&m_pHandler[Service], pHandler, __ATOMIC_RELEASE);
     return true;
 }
 
@@ -58,14 +59,21 @@ void HostedSyscallManager::syscall(SyscallState &syscallState)
     }
 
     // Get the syscall handler
-    {
-        LockGuard<Spinlock> lock(m_Instance.m_Lock);
-        pHandler = m_Instance.m_pHandler[serviceNumber];
-    }
+    pHandler = __atomic_load_n(
+        &m_Instance.m_pHandler[serviceNumber], __ATOMIC_ACQUIRE);
 
     if (LIKELY(pHandler != 0))
     {
+#ifdef SYSCALL_STATISTICS
+        uint64_t statisticsStart = statisticsTimestamp();
+#endif
         syscallState.setSyscallReturnValue(pHandler->syscall(syscallState));
+#ifdef SYSCALL_STATISTICS
+        recordStatistics(
+            static_cast<Service_t>(serviceNumber),
+            syscallState.getSyscallNumber(),
+            statisticsTimestamp() - statisticsStart);
+#endif
         syscallState.setSyscallErrno(
             Processor::information().getCurrentThread()->getErrno());
 
@@ -21,6 +21,7 @@
 #define KERNEL_PROCESSOR_HOSTED_SYSCALLMANAGER_H
 
 #include "pedigree/kernel/Spinlock.h"
+#include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/processor/SyscallManager.h"
 #include "pedigree/kernel/processor/types.h"
 
@@ -68,11 +69,12 @@ class HostedSyscallManager : public ::SyscallManager
     /** The destructor */
     virtual ~HostedSyscallManager();
 
-    /** Spinlock protecting the member variables */
+    /** Spinlock serialising handler registration */
     Spinlock m_Lock;
 
-    /** The syscall handlers */
-    SyscallHandler *m_pHandler[serviceEnd];
+    /** The syscall handlers. Written only under m_Lock, but read without it
+     *  on every syscall, so kept off the lock's cache line. */
+    SyscallHandler *m_pHandler[serviceEnd] ALIGN(64);
 
     /** The instance of the syscall manager  */
     static HostedSyscallManager m_Instance;
@@ -116,11 +116,12 @@ bool HostedVirtualAddressSpace::isMapped(void *virtualAddress)
             return r;
     }
 
-    // Find this mapping if we can.
+    // Find this mapping if we can. Swap entries are mapped with no access at
+    // all, but don't count as mapped.
     for (size_t i = 0; i < m_KnownMapsSize; ++i)
     {
         if (m_pKnownMaps[i].active && m_pKnownMaps[i].vaddr == virtualAddress)
-            return true;
+            return (m_pKnownMaps[i].flags & Swapped) == 0;
     }
 
     return false;
@@ -138,7 +139,7 @@ bool HostedVirtualAddressSpace::map(
                 physAddress, virtualAddress, flags);
 
     // mmap() won't fail if the address is already mapped, but we need to.
-    if (isMapped(virtualAddress))
+    if (isMapped(virtualAddress) || isSwapped(virtualAddress))
     {
         return false;
     }
@@ -206,6 +207,7 @@ bool HostedVirtualAddressSpace::map(
         panic("Fatal algorithmic error in HostedVirtualAddressSpace::map");
 
     m_pKnownMaps[idx].active = true;
+    m_pKnownMaps[idx].accessed = true;
     m_pKnownMaps[idx].vaddr = virtualAddress;
     m_pKnownMaps[idx].paddr = physAddress;
     m_pKnownMaps[idx].flags = flags;
@@ -271,17 +273,19 @@ void HostedVirtualAddressSpace::setFlags(void *virtualAddress, size_t newFlags)
                     "mapped in kernel.");
     }
 
+    // Aged pages stay inaccessible until they are next accessed.
+    int prot = toFlags(newFlags, true);
     for (size_t i = 0; i < m_KnownMapsSize; ++i)
     {
         if (m_pKnownMaps[i].active && m_pKnownMaps[i].vaddr == virtualAddress)
         {
             m_pKnownMaps[i].flags = newFlags;
+            prot = protection(m_pKnownMaps[i]);
             break;
         }
     }
 
-    size_t flags = toFlags(newFlags, true);
-    mprotect(virtualAddress, PhysicalMemoryManager::getPageSize(), flags);
+    mprotect(virtualAddress, PhysicalMemoryManager::getPageSize(), prot);
 }
 
 void HostedVirtualAddressSpace::unmap(void *virtualAddress)
@@ -313,7 +317,83 @@ void HostedVirtualAddressSpace::unmap(void *virtualAddress)
     munmap(virtualAddress, PhysicalMemoryManager::getPageSize());
 }
 
-VirtualAddressSpace *HostedVirtualAddressSpace::clone()
+bool HostedVirtualAddressSpace::clearAccessed(void *virtualAddress)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    virtualAddress = page_align(virtualAddress);
+
+    // The host doesn't tell us about accesses, so take away access to the
+    // page instead: the next access faults, and noteAccess() gives it back.
+    for (size_t i = 0; i < m_KnownMapsSize; ++i)
+    {
+        mapping_t &mapping = m_pKnownMaps[i];
+        if (!mapping.active || mapping.vaddr != virtualAddress)
+            continue;
+
+        if ((mapping.flags & Swapped) || !mapping.accessed)
+            return false;
+
+        mapping.accessed = false;
+        if (&Processor::information().getVirtualAddressSpace() == this)
+            mprotect(
+                virtualAddress, PhysicalMemoryManager::getPageSize(),
+                PROT_NONE);
+        return true;
+    }
+
+    return false;
+}
+
+bool HostedVirtualAddressSpace::isSwapped(void *virtualAddress)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    virtualAddress = page_align(virtualAddress);
+
+    for (size_t i = 0; i < m_KnownMapsSize; ++i)
+    {
+        if (m_pKnownMaps[i].active && m_pKnownMaps[i].vaddr == virtualAddress)
+            return (m_pKnownMaps[i].flags & Swapped) != 0;
+    }
+
+    return false;
+}
+
+bool HostedVirtualAddressSpace::noteAccess(void *virtualAddress)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    virtualAddress = page_align(virtualAddress);
+
+    for (size_t i = 0; i < m_KnownMapsSize; ++i)
+    {
+        mapping_t &mapping = m_pKnownMaps[i];
+        if (!mapping.active || mapping.vaddr != virtualAddress)
+            continue;
+
+        if ((mapping.flags & Swapped) || mapping.accessed)
+            return false;
+
+        mapping.accessed = true;
+        mprotect(
+            virtualAddress, PhysicalMemoryManager::getPageSize(),
+            toFlags(mapping.flags, true));
+        return true;
+    }
+
+    return false;
+}
+
+int HostedVirtualAddressSpace::protection(const mapping_t &mapping)
+{
+    if (!mapping.accessed)
+        return PROT_NONE;
+
+    return toFlags(mapping.flags, true);
+}
+
+VirtualAddressSpace *HostedVirtualAddressSpace::clone(bool copyOnWrite)
 {
     HostedVirtualAddressSpace *pNew =
         static_cast<HostedVirtualAddressSpace *>(VirtualAddressSpace::create());
@@ -338,6 +418,11 @@ VirtualAddressSpace *HostedVirtualAddressSpace::clone()
             if (!mapping->active)
                 continue;
 
+            // Swap entries are copied as they are. Whoever swapped the page
+            // out keeps track of who refers to it.
+            if (mapping->flags & Swapped)
+                continue;
+
             PhysicalMemoryManager::instance().pin(mapping->paddr);
 
             if (mapping->flags & Shared)
@@ -348,6 +433,9 @@ VirtualAddressSpace *HostedVirtualAddressSpace::clone()
             if (!(mapping->flags & CopyOnWrite))
                 PhysicalMemoryManager::instance().pin(mapping->paddr);
 
+            if (!copyOnWrite)
+                continue;
+
             if (mapping->flags & Write)
             {
                 mapping->flags |= CopyOnWrite;
@@ -550,12 +638,12 @@ HostedVirtualAddressSpace::HostedVirtualAddressSpace(
 uint64_t HostedVirtualAddressSpace::toFlags(size_t flags, bool bFinal)
 {
     uint64_t Flags = 0;
+    // Swap entries can't be accessed at all until swapped back in.
+    if (flags & Swapped)
+        return PROT_NONE;
     if (flags & Write)
         Flags |= PROT_WRITE;
-    if (flags & Swapped)
-        Flags |= PROT_NONE;
-    else
-        Flags |= PROT_READ;
+    Flags |= PROT_READ;
     if (flags & Execute)
         Flags |= PROT_EXEC;
     return Flags;
@@ -610,7 +698,7 @@ void HostedVirtualAddressSpace::switchAddressSpace(
             mmap(
                 newSpace.m_pKnownMaps[i].vaddr,
                 PhysicalMemoryManager::getPageSize(),
-                newSpace.toFlags(newSpace.m_pKnownMaps[i].flags, true),
+                newSpace.protection(newSpace.m_pKnownMaps[i]),
                 MAP_FIXED | MAP_SHARED,
                 HostedPhysicalMemoryManager::instance().getBackingFile(),
                 newSpace.m_pKnownMaps[i].paddr);
@@ -90,6 +90,8 @@ class HostedVirtualAddressSpace : public VirtualAddressSpace
         void *virtualAddress, physical_uintptr_t &physAddress, size_t &flags);
     virtual void setFlags(void *virtualAddress, size_t newFlags);
     virtual void unmap(void *virtualAddress);
+    virtual bool clearAccessed(void *virtualAddress);
+    virtual bool isSwapped(void *virtualAddress);
     virtual Stack *allocateStack();
     virtual Stack *allocateStack(size_t stackSz);
     virtual void freeStack(Stack *pStack);
@@ -103,6 +105,13 @@ class HostedVirtualAddressSpace : public VirtualAddressSpace
     /** The destructor cleans up the address space */
     virtual ~HostedVirtualAddressSpace();
 
+    /** Give access back to a page that clearAccessed() aged, noting that it
+     *has been accessed since. Called from the page fault handler.
+     *\param[in] virtualAddress the faulting virtual address
+     *\return true if the fault was due to aging and the access can be
+     *retried, false otherwise */
+    bool noteAccess(void *virtualAddress);
+
     /** Gets start address of the kernel in the address space. */
     virtual uintptr_t getKernelStart() const
     {
@@ -225,11 +234,17 @@ class HostedVirtualAddressSpace : public VirtualAddressSpace
     typedef struct
     {
         bool active;
+        /** Whether the page has been accessed since clearAccessed() last
+         *aged it. Aged pages are mapped with no access at all. */
+        bool accessed;
         void *vaddr;
         physical_uintptr_t paddr;
         size_t flags;  // Real flags, not the mmap-specific ones.
     } mapping_t;
 
+    /** Host protection to map a known mapping with. */
+    int protection(const mapping_t &mapping);
+
     /** Current top of the stacks */
     void *m_pStackTop;
     /** List of free stacks */
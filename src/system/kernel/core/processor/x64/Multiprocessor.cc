@@ -22,12 +22,14 @@
 #include "../x86_common/Multiprocessor.h"
 #include "InterruptManager.h"
 #include "SyscallManager.h"
+#include "VirtualAddressSpace.h"
 #include "gdt.h"
 #include "machine/mach_pc/Pc.h"
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/process/initialiseMultitasking.h"
 #include "pedigree/kernel/processor/NMFaultHandler.h"
 #include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/TlbShootdown.h"
 
 void Multiprocessor::applicationProcessorStartup()
 {
@@ -36,6 +38,9 @@ void Multiprocessor::applicationProcessorStartup()
     asm volatile("mov %%cr0, %%rax; or $0x10000, %%rax; mov %%rax, %%cr0" ::
                      : "rax");
 
+    // Match the BSP's global page and PCID configuration.
+    X64VirtualAddressSpace::initialiseProcessor();
+
     // Initialise this processor's interrupt handling
     X64InterruptManager::initialiseProcessor();
 
@@ -63,6 +68,9 @@ void Multiprocessor::applicationProcessorStartup()
     // Initialise the machine-specific interface
     Pc::instance().initialiseProcessor();
 
+    // The local APIC is up, so this processor can take shootdown IPIs now.
+    TlbShootdown::processorOnline();
+
     // We need to synchronize the -init section invalidation
     Processor::invalidate(0);
     Processor::invalidate(reinterpret_cast<void *>(0x200000));
@@ -27,6 +27,7 @@
 #include "pedigree/kernel/processor/IoPortManager.h"
 #include "pedigree/kernel/processor/NMFaultHandler.h"
 #include "pedigree/kernel/processor/PageFaultHandler.h"
+#include "pedigree/kernel/processor/TlbShootdown.h"
 #include "pedigree/kernel/utilities/utility.h"
 
 // Multiprocessor headers
@@ -84,18 +85,38 @@ void Processor::switchAddressSpace(VirtualAddressSpace &AddressSpace)
     const X64VirtualAddressSpace &x64AddressSpace =
         static_cast<const X64VirtualAddressSpace &>(AddressSpace);
 
+    // Shootdowns check which address space is active here, so this processor
+    // must not take one between the switch and recording it.
+    EnsureInterrupts ensure(false);
+
     // Get the current page directory
     uint64_t cr3;
     asm volatile("mov %%cr3, %0" : "=r"(cr3));
 
     // Do we need to set a new page directory?
-    if (cr3 != x64AddressSpace.m_PhysicalPML4)
+    if ((cr3 & ~0xFFFULL) != x64AddressSpace.m_PhysicalPML4)
     {
+        ProcessorInformation &processorInformation = Processor::information();
+        ProcessorId id = Processor::id();
+
+        processorInformation.getVirtualAddressSpace().setActive(id, false);
+        AddressSpace.setActive(id, true);
+
+        // With PCIDs, this address space's TLB entries survived the last
+        // switch away from it, and only need to go if they have gone stale
+        // since.
+        uint64_t newCr3 = x64AddressSpace.m_PhysicalPML4;
+        if (X64VirtualAddressSpace::m_bPcidEnabled && x64AddressSpace.m_Pcid)
+        {
+            newCr3 |= x64AddressSpace.m_Pcid;
+            if (!AddressSpace.clearStale(id))
+                newCr3 |= 1ULL << 63;
+        }
+
         // Set the new page directory
-        asm volatile("mov %0, %%cr3" ::"r"(x64AddressSpace.m_PhysicalPML4));
+        asm volatile("mov %0, %%cr3" ::"r"(newCr3));
 
         // Update the information in the ProcessorInformation structure
-        ProcessorInformation &processorInformation = Processor::information();
         processorInformation.setVirtualAddressSpace(AddressSpace);
     }
 }
@@ -140,6 +161,9 @@ void Processor::initialise1(const BootstrapStruct_t &Info)
     NMFaultHandler::instance().initialise();
     NMFaultHandler::instance().initialiseProcessor();
 
+    // Now SSE is available, pick the vectorised memory/string functions.
+    InitialiseMemoryFunctions();
+
     /// todo move to a better place
     // Write PAT MSR.
     // MSR 0x277
@@ -176,6 +200,9 @@ void Processor::initialise1(const BootstrapStruct_t &Info)
 
     asm volatile("wrmsr" ::"a"(pat_lo), "d"(pat_hi), "c"(0x277));
 
+    // Turn on global pages and PCIDs, if available.
+    X64VirtualAddressSpace::initialiseProcessor();
+
     m_Initialised = 1;
 }
 
@@ -197,6 +224,8 @@ void Processor::initialise2(const BootstrapStruct_t &Info)
 
     m_Initialised = 2;
 
+    TlbShootdown::processorOnline();
+
 #if defined(MULTIPROCESSOR)
     if (nProcessors != 1)
         Multiprocessor::initialise2();
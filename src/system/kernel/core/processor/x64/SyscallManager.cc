@@ -52,7 +52,8 @@ bool X64SyscallManager::registerSyscallHandler(
     if (UNLIKELY(pHandler == 0 && m_pHandler[Service] == 0))
         return false;
 
-    m_pHandler[Service] = pHandler;
+    // Publish the handler; syscall() reads the table without the lock.
+    __atomic_store_n(&m_pHandler[Service], pHandler, __ATOMIC_RELEASE);
     return true;
 }
 
@@ -80,14 +81,21 @@ void X64SyscallManager::syscall(SyscallState &syscallState)
     }
 
     // Get the syscall handler
-    {
-        LockGuard<Spinlock> lock(m_Instance.m_Lock);
-        pHandler = m_Instance.m_pHandler[serviceNumber];
-    }
+    pHandler = __atomic_load_n(
+        &m_Instance.m_pHandler[serviceNumber], __ATOMIC_ACQUIRE);
 
     if (LIKELY(pHandler != 0))
     {
+#ifdef SYSCALL_STATISTICS
+        uint64_t statisticsStart = statisticsTimestamp();
+#endif
         uint64_t result = pHandler->syscall(syscallState);
+#ifdef SYSCALL_STATISTICS
+        recordStatistics(
+            static_cast<Service_t>(serviceNumber),
+            syscallState.getSyscallNumber(),
+            statisticsTimestamp() - statisticsStart);
+#endif
         uint64_t errno =
             Processor::information().getCurrentThread()->getErrno();
         /// \todo this is an extraordinary hack, this should be done in a way
@@ -75,11 +75,12 @@ class X64SyscallManager : public ::SyscallManager
     /** The destructor */
     virtual ~X64SyscallManager();
 
-    /** Spinlock protecting the member variables */
+    /** Spinlock serialising handler registration */
     Spinlock m_Lock;
 
-    /** The syscall handlers */
-    SyscallHandler *m_pHandler[serviceEnd];
+    /** The syscall handlers. Written only under m_Lock, but read without it
+     *  on every syscall, so kept off the lock's cache line. */
+    SyscallHandler *m_pHandler[serviceEnd] ALIGN(64);
 
     /** The instance of the syscall manager  */
     static X64SyscallManager m_Instance;
@@ -27,6 +27,7 @@
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/Processor.h"
 #include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/processor/TlbShootdown.h"
 #include "pedigree/kernel/utilities/utility.h"
 #include "utils.h"
 
@@ -65,6 +66,13 @@
 #define PAGE_SET_FLAGS(x, f) *x = (*x & ~0x8000000000000FFFULL) | f
 #define PAGE_GET_PHYSICAL_ADDRESS(x) (*x & ~0x8000000000000FFFULL)
 
+#define HUGE_PAGE_SIZE 0x200000ULL
+#define PAGES_PER_HUGE_PAGE 512
+
+#define CR4_PGE (1 << 7)
+#define CR4_PCIDE (1 << 17)
+#define PCID_COUNT 4096
+
 // Defined in boot-standalone.s
 extern void *pml4;
 
@@ -74,6 +82,39 @@ X64VirtualAddressSpace X64VirtualAddressSpace::m_KernelSpace(
         reinterpret_cast<uintptr_t>(KERNEL_VIRTUAL_ADDRESS),
     KERNEL_VIRTUAL_STACK);
 
+bool X64VirtualAddressSpace::m_bPcidEnabled = false;
+
+/** PCIDs given out to address spaces. PCID 0 is the kernel's, and is shared
+ *  by any address space that can't get one of its own. */
+static uint64_t g_PcidsInUse[PCID_COUNT / 64] = {1};
+static Spinlock g_PcidLock;
+
+static uint16_t allocatePcid()
+{
+    LockGuard<Spinlock> guard(g_PcidLock);
+
+    for (size_t i = 0; i < (PCID_COUNT / 64); ++i)
+    {
+        if (g_PcidsInUse[i] == ~0ULL)
+            continue;
+
+        size_t bit = __builtin_ctzll(~g_PcidsInUse[i]);
+        g_PcidsInUse[i] |= 1ULL << bit;
+        return (i * 64) + bit;
+    }
+
+    return 0;
+}
+
+static void freePcid(uint16_t pcid)
+{
+    if (!pcid)
+        return;
+
+    LockGuard<Spinlock> guard(g_PcidLock);
+    g_PcidsInUse[pcid / 64] &= ~(1ULL << (pcid % 64));
+}
+
 static void trackPages(ssize_t v, ssize_t p, ssize_t s)
 {
     // Track, if we can.
@@ -233,6 +274,7 @@ bool X64VirtualAddressSpace::mapHuge(
             physAddress, virtualAddress, count, flags);
     }
 
+    TlbShootdown shootdown(*this);
     LockGuard<Spinlock> guard(m_Lock);
 
     size_t smallPageSize = PhysicalMemoryManager::getPageSize();
@@ -240,7 +282,9 @@ bool X64VirtualAddressSpace::mapHuge(
     // Clean up any existing mapping before we go ahead and map the huge pages
     for (size_t i = 0; i < count; ++i)
     {
-        unmapUnlocked(adjust_pointer(virtualAddress, i * smallPageSize), false);
+        unmapUnlocked(
+            adjust_pointer(virtualAddress, i * smallPageSize), shootdown,
+            false);
     }
 
     // Ensure correct page size for this mapping.
@@ -307,6 +351,11 @@ bool X64VirtualAddressSpace::mapUnlocked(
     size_t pml4Index = PML4_INDEX(virtualAddress);
     uint64_t *pml4Entry = TABLE_ENTRY(m_PhysicalPML4, pml4Index);
 
+    // Only kernel space is the same in every address space, so only it can
+    // have global pages.
+    if (virtualAddress < KERNEL_SPACE_START)
+        Flags &= ~PAGE_GLOBAL;
+
     // Check if a page directory pointer table was present *before* the
     // conditional allocation.
     bool pdWasPresent = (*pml4Entry & PAGE_PRESENT) != PAGE_PRESENT;
@@ -334,6 +383,13 @@ bool X64VirtualAddressSpace::mapUnlocked(
         PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryPointerEntry),
         pageDirectoryIndex);
 
+    // Already covered by a 2MB page?
+    if ((*pageDirectoryEntry & (PAGE_PRESENT | PAGE_2MB)) ==
+        (PAGE_PRESENT | PAGE_2MB))
+    {
+        return false;
+    }
+
     // Is a page table present?
     if (conditionalTableEntryAllocation(pageDirectoryEntry, flags) == false)
     {
@@ -365,27 +421,9 @@ bool X64VirtualAddressSpace::mapUnlocked(
     // If there wasn't a PDPT already present, and the address is in the kernel
     // area of memory, we need to propagate this change across all address
     // spaces.
-    if (!pdWasPresent && Processor::m_Initialised == 2 &&
-        virtualAddress >= KERNEL_VIRTUAL_HEAP)
+    if (!pdWasPresent && virtualAddress >= KERNEL_VIRTUAL_HEAP)
     {
-        uint64_t thisPml4Entry = *pml4Entry;
-        /// \todo this can actually break if a process is removed from the
-        ///       scheduler while we iterate!
-        for (size_t i = 0; i < Scheduler::instance().getNumProcesses(); i++)
-        {
-            Process *p = Scheduler::instance().getProcess(i);
-            if (!p)
-            {
-                continue;
-            }
-
-            X64VirtualAddressSpace *x64VAS =
-                reinterpret_cast<X64VirtualAddressSpace *>(
-                    p->getAddressSpace());
-            uint64_t *otherPml4Entry =
-                TABLE_ENTRY(x64VAS->m_PhysicalPML4, pml4Index);
-            *otherPml4Entry = thisPml4Entry;
-        }
+        propagatePml4Entry(pml4Index, *pml4Entry);
     }
 
     // If we were locked before, take the lock to enforce that.
@@ -395,9 +433,236 @@ bool X64VirtualAddressSpace::mapUnlocked(
     return true;
 }
 
+void X64VirtualAddressSpace::propagatePml4Entry(
+    size_t pml4Index, uint64_t entry)
+{
+    if (Processor::m_Initialised != 2)
+    {
+        return;
+    }
+
+    /// \todo this can actually break if a process is removed from the
+    ///       scheduler while we iterate!
+    for (size_t i = 0; i < Scheduler::instance().getNumProcesses(); i++)
+    {
+        Process *p = Scheduler::instance().getProcess(i);
+        if (!p)
+        {
+            continue;
+        }
+
+        X64VirtualAddressSpace *x64VAS =
+            reinterpret_cast<X64VirtualAddressSpace *>(p->getAddressSpace());
+        uint64_t *otherPml4Entry =
+            TABLE_ENTRY(x64VAS->m_PhysicalPML4, pml4Index);
+        *otherPml4Entry = entry;
+    }
+}
+
+size_t X64VirtualAddressSpace::getHugePageSize() const
+{
+    return HUGE_PAGE_SIZE;
+}
+
+bool X64VirtualAddressSpace::mapHugePage(
+    physical_uintptr_t physAddress, void *virtualAddress, size_t flags)
+{
+    if ((physAddress & (HUGE_PAGE_SIZE - 1)) ||
+        (reinterpret_cast<uintptr_t>(virtualAddress) & (HUGE_PAGE_SIZE - 1)))
+    {
+        return false;
+    }
+
+    size_t pml4Index = PML4_INDEX(virtualAddress);
+    uint64_t *pml4Entry = 0;
+    bool pdptCreated = false;
+
+    {
+        LockGuard<Spinlock> guard(m_Lock);
+
+        pml4Entry = TABLE_ENTRY(m_PhysicalPML4, pml4Index);
+        pdptCreated = (*pml4Entry & PAGE_PRESENT) != PAGE_PRESENT;
+
+        // Is a page directory pointer table present?
+        if (conditionalTableEntryAllocation(pml4Entry, flags) == false)
+        {
+            return false;
+        }
+
+        size_t pageDirectoryPointerIndex =
+            PAGE_DIRECTORY_POINTER_INDEX(virtualAddress);
+        uint64_t *pageDirectoryPointerEntry = TABLE_ENTRY(
+            PAGE_GET_PHYSICAL_ADDRESS(pml4Entry), pageDirectoryPointerIndex);
+
+        // Already covered by a 1GB page?
+        if ((*pageDirectoryPointerEntry & (PAGE_PRESENT | PAGE_2MB)) ==
+            (PAGE_PRESENT | PAGE_2MB))
+        {
+            return false;
+        }
+
+        // Is a page directory present?
+        if (conditionalTableEntryAllocation(
+                pageDirectoryPointerEntry, flags) == false)
+        {
+            return false;
+        }
+
+        size_t pageDirectoryIndex = PAGE_DIRECTORY_INDEX(virtualAddress);
+        uint64_t *pageDirectoryEntry = TABLE_ENTRY(
+            PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryPointerEntry),
+            pageDirectoryIndex);
+
+        // A page table here means at least one small page is mapped.
+        if ((*pageDirectoryEntry & PAGE_PRESENT) == PAGE_PRESENT)
+        {
+            return false;
+        }
+
+        // PAT is a different bit in a 2MB page, so write-through is ignored.
+        uint64_t Flags = toFlags(flags, true) & ~PAGE_PAT;
+        if (virtualAddress < KERNEL_SPACE_START)
+            Flags &= ~PAGE_GLOBAL;
+        *pageDirectoryEntry = physAddress | PAGE_2MB | Flags;
+
+        Processor::invalidate(virtualAddress);
+
+        trackPages(PAGES_PER_HUGE_PAGE, 0, 0);
+    }
+
+    if (pdptCreated && virtualAddress >= KERNEL_VIRTUAL_HEAP)
+    {
+        propagatePml4Entry(pml4Index, *pml4Entry);
+    }
+
+    return true;
+}
+
+bool X64VirtualAddressSpace::canMapHugePage(void *virtualAddress)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    size_t pml4Index = PML4_INDEX(virtualAddress);
+    uint64_t *pml4Entry = TABLE_ENTRY(m_PhysicalPML4, pml4Index);
+
+    // Is a page directory pointer table present?
+    if ((*pml4Entry & PAGE_PRESENT) != PAGE_PRESENT)
+        return true;
+
+    size_t pageDirectoryPointerIndex =
+        PAGE_DIRECTORY_POINTER_INDEX(virtualAddress);
+    uint64_t *pageDirectoryPointerEntry = TABLE_ENTRY(
+        PAGE_GET_PHYSICAL_ADDRESS(pml4Entry), pageDirectoryPointerIndex);
+
+    // Is a page directory present?
+    if ((*pageDirectoryPointerEntry & PAGE_PRESENT) != PAGE_PRESENT)
+        return true;
+    if ((*pageDirectoryPointerEntry & PAGE_2MB) == PAGE_2MB)
+        return false;
+
+    size_t pageDirectoryIndex = PAGE_DIRECTORY_INDEX(virtualAddress);
+    uint64_t *pageDirectoryEntry = TABLE_ENTRY(
+        PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryPointerEntry),
+        pageDirectoryIndex);
+
+    // Empty page tables are freed on unmap, so any entry here means something
+    // is mapped.
+    return (*pageDirectoryEntry & PAGE_PRESENT) != PAGE_PRESENT;
+}
+
+bool X64VirtualAddressSpace::isHugePage(void *virtualAddress)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    uint64_t *pageDirectoryEntry = 0;
+    return getHugePageEntry(virtualAddress, pageDirectoryEntry);
+}
+
+void X64VirtualAddressSpace::unmapHugePage(void *virtualAddress)
+{
+    TlbShootdown shootdown(*this);
+    LockGuard<Spinlock> guard(m_Lock);
+
+    uint64_t *pageDirectoryEntry = 0;
+    if (getHugePageEntry(virtualAddress, pageDirectoryEntry) == false)
+    {
+        panic("VirtualAddressSpace::unmapHugePage(): function misused");
+    }
+
+    *pageDirectoryEntry = 0;
+
+    // Invalidate the TLB entry
+    shootdown.add(virtualAddress);
+
+    trackPages(-PAGES_PER_HUGE_PAGE, 0, 0);
+
+    maybeFreeTables(virtualAddress, shootdown);
+}
+
+bool X64VirtualAddressSpace::splitHugePage(void *virtualAddress)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    return splitHugePageUnlocked(virtualAddress);
+}
+
+bool X64VirtualAddressSpace::splitHugePageUnlocked(void *virtualAddress)
+{
+    uint64_t *pageDirectoryEntry = 0;
+    if (getHugePageEntry(virtualAddress, pageDirectoryEntry) == false)
+    {
+        // Nothing to do.
+        return true;
+    }
+
+    physical_uintptr_t table = PhysicalMemoryManager::instance().allocatePage();
+    if (table == 0)
+    {
+        ERROR("OOM in X64VirtualAddressSpace::splitHugePage!");
+        return false;
+    }
+
+    physical_uintptr_t base =
+        PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryEntry) & ~(HUGE_PAGE_SIZE - 1);
+    uint64_t flags = PAGE_GET_FLAGS(pageDirectoryEntry) & ~PAGE_2MB;
+
+    for (size_t i = 0; i < PAGES_PER_HUGE_PAGE; ++i)
+    {
+        uint64_t *pageTableEntry = TABLE_ENTRY(table, i);
+        *pageTableEntry =
+            (base + (i * PhysicalMemoryManager::getPageSize())) | flags;
+    }
+
+    // As in conditionalTableEntryAllocation, leave write and user access to
+    // be controlled by the individual pages.
+    *pageDirectoryEntry = table |
+                          (flags & ~(PAGE_GLOBAL | PAGE_NX | PAGE_SWAPPED |
+                                     PAGE_COPY_ON_WRITE)) |
+                          PAGE_WRITE | PAGE_USER;
+
+    // Drops the 2MB TLB entry.
+    Processor::invalidate(virtualAddress);
+
+    return true;
+}
+
 void X64VirtualAddressSpace::getMapping(
     void *virtualAddress, physical_uintptr_t &physAddress, size_t &flags)
 {
+    // Pages within a 2MB page are reported as if mapped individually.
+    uint64_t *pageDirectoryEntry = 0;
+    if (getHugePageEntry(virtualAddress, pageDirectoryEntry))
+    {
+        uintptr_t offset = reinterpret_cast<uintptr_t>(virtualAddress) &
+                           (HUGE_PAGE_SIZE - 1) &
+                           ~(PhysicalMemoryManager::getPageSize() - 1);
+        physAddress = (PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryEntry) &
+                       ~(HUGE_PAGE_SIZE - 1)) +
+                      offset;
+        flags = fromFlags(PAGE_GET_FLAGS(pageDirectoryEntry) & ~PAGE_2MB, true);
+        return;
+    }
+
     // Get a pointer to the page-table entry (Also checks whether the page is
     // actually present or marked swapped out)
     uint64_t *pageTableEntry = 0;
@@ -413,8 +678,36 @@ void X64VirtualAddressSpace::getMapping(
 
 void X64VirtualAddressSpace::setFlags(void *virtualAddress, size_t newFlags)
 {
+    TlbShootdown shootdown(*this);
     LockGuard<Spinlock> guard(m_Lock);
 
+    setFlagsUnlocked(virtualAddress, newFlags, shootdown);
+}
+
+void X64VirtualAddressSpace::setFlagsBatched(
+    void *virtualAddress, size_t newFlags, TlbShootdown &shootdown)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    setFlagsUnlocked(virtualAddress, newFlags, shootdown);
+}
+
+void X64VirtualAddressSpace::setFlagsUnlocked(
+    void *virtualAddress, size_t newFlags, TlbShootdown &shootdown)
+{
+    uint64_t Flags = toFlags(newFlags, true);
+    if (virtualAddress < KERNEL_SPACE_START)
+        Flags &= ~PAGE_GLOBAL;
+
+    // A 2MB page takes the new flags as a whole.
+    uint64_t *pageDirectoryEntry = 0;
+    if (getHugePageEntry(virtualAddress, pageDirectoryEntry))
+    {
+        PAGE_SET_FLAGS(pageDirectoryEntry, (Flags & ~PAGE_PAT) | PAGE_2MB);
+        shootdown.add(virtualAddress);
+        return;
+    }
+
     // Get a pointer to the page-table entry (Also checks whether the page is
     // actually present or marked swapped out)
     uint64_t *pageTableEntry = 0;
@@ -424,22 +717,74 @@ void X64VirtualAddressSpace::setFlags(void *virtualAddress, size_t newFlags)
     }
 
     // Set the flags
-    PAGE_SET_FLAGS(pageTableEntry, toFlags(newFlags, true));
+    PAGE_SET_FLAGS(pageTableEntry, Flags);
 
     // Flush TLB - modified the mapping for this address.
-    Processor::invalidate(virtualAddress);
+    shootdown.add(virtualAddress);
 }
 
 void X64VirtualAddressSpace::unmap(void *virtualAddress)
+{
+    TlbShootdown shootdown(*this);
+    LockGuard<Spinlock> guard(m_Lock);
+
+    unmapUnlocked(virtualAddress, shootdown);
+}
+
+void X64VirtualAddressSpace::unmapBatched(
+    void *virtualAddress, TlbShootdown &shootdown)
 {
     LockGuard<Spinlock> guard(m_Lock);
 
-    unmapUnlocked(virtualAddress);
+    unmapUnlocked(virtualAddress, shootdown);
+}
+
+bool X64VirtualAddressSpace::clearAccessed(void *virtualAddress)
+{
+    // The processor sets the accessed bit behind our back, so it has to be
+    // cleared atomically rather than under m_Lock.
+    uint64_t *entry = 0;
+    if (!getHugePageEntry(virtualAddress, entry) &&
+        !getPageTableEntry(virtualAddress, entry))
+    {
+        return false;
+    }
+
+    if ((*entry & PAGE_PRESENT) == 0)
+    {
+        return false;
+    }
+
+    uint64_t old = __atomic_fetch_and(
+        entry, ~static_cast<uint64_t>(PAGE_ACCESSED), __ATOMIC_RELAXED);
+    return (old & PAGE_ACCESSED) != 0;
+}
+
+bool X64VirtualAddressSpace::isSwapped(void *virtualAddress)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    uint64_t *pageTableEntry = 0;
+    if (getPageTableEntry(virtualAddress, pageTableEntry) == false)
+    {
+        return false;
+    }
+
+    return (*pageTableEntry & (PAGE_PRESENT | PAGE_SWAPPED)) == PAGE_SWAPPED;
 }
 
 void X64VirtualAddressSpace::unmapUnlocked(
-    void *virtualAddress, bool requireMapped)
+    void *virtualAddress, TlbShootdown &shootdown, bool requireMapped)
 {
+    // Unmapping part of a 2MB page needs it split up first.
+    if (splitHugePageUnlocked(virtualAddress) == false)
+    {
+        ERROR(
+            "VirtualAddressSpace::unmap(): couldn't split the 2MB page at "
+            << virtualAddress);
+        return;
+    }
+
     // Get a pointer to the page-table entry (Also checks whether the page is
     // actually present or marked swapped out)
     uint64_t *pageTableEntry = 0;
@@ -461,14 +806,152 @@ void X64VirtualAddressSpace::unmapUnlocked(
     *pageTableEntry = 0;
 
     // Invalidate the TLB entry
-    Processor::invalidate(virtualAddress);
+    shootdown.add(virtualAddress);
 
     trackPages(-1, 0, 0);
 
     // Possibly wipe out paging structures now that we've unmapped the page.
     // This can clear all the way up to, but not including, the PML4 - can be
     // extremely useful to conserve memory.
-    maybeFreeTables(virtualAddress);
+    maybeFreeTables(virtualAddress, shootdown);
+}
+
+size_t X64VirtualAddressSpace::copyInto(
+    void *destination, const void *source, size_t size)
+{
+    if (this == &Processor::information().getVirtualAddressSpace() ||
+        reinterpret_cast<uintptr_t>(destination) >= getKernelStart())
+    {
+        return VirtualAddressSpace::copyInto(destination, source, size);
+    }
+
+    // Another address space: all of physical memory is mapped, so write the
+    // destination's frames directly.
+    VirtualAddressSpace &current =
+        Processor::information().getVirtualAddressSpace();
+    const size_t pageSize = PhysicalMemoryManager::getPageSize();
+    uintptr_t dest = reinterpret_cast<uintptr_t>(destination);
+    uintptr_t src = reinterpret_cast<uintptr_t>(source);
+
+    size_t done = 0;
+    while (done < size)
+    {
+        size_t offset = (dest + done) & (pageSize - 1);
+        size_t chunk = pageSize - offset;
+        if (chunk > (size - done))
+        {
+            chunk = size - done;
+        }
+
+        // The source must not fault while we hold our lock (which would be
+        // needed to bring it in if it's the same lock, and can't be slept on
+        // anyway).
+        void *srcFirst = page_align(reinterpret_cast<void *>(src + done));
+        void *srcLast =
+            page_align(reinterpret_cast<void *>(src + done + chunk - 1));
+        if (!current.isMapped(srcFirst) || !current.isMapped(srcLast))
+        {
+            break;
+        }
+
+        LockGuard<Spinlock> guard(m_Lock);
+
+        uint64_t *pageTableEntry = 0;
+        void *target = reinterpret_cast<void *>(dest + done);
+        if (!getPageTableEntry(target, pageTableEntry))
+        {
+            break;
+        }
+
+        // Only pages the owner could write to right now; anything else needs
+        // a fault in the owner's context to sort out.
+        uint64_t required = PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
+        if ((*pageTableEntry & required) != required ||
+            (*pageTableEntry & PAGE_COPY_ON_WRITE))
+        {
+            break;
+        }
+
+        uintptr_t frame =
+            physicalAddress(PAGE_GET_PHYSICAL_ADDRESS(pageTableEntry));
+        MemoryCopy(
+            reinterpret_cast<void *>(frame + offset),
+            reinterpret_cast<void *>(src + done), chunk);
+
+        // The write didn't go through this mapping, so the CPU didn't mark it.
+        *pageTableEntry |= PAGE_ACCESSED | PAGE_DIRTY;
+
+        done += chunk;
+    }
+
+    return done;
+}
+
+bool X64VirtualAddressSpace::lendPage(
+    void *page, VirtualAddressSpace &target, void *targetPage)
+{
+    X64VirtualAddressSpace &other = static_cast<X64VirtualAddressSpace &>(target);
+    if (&other == this)
+    {
+        return false;
+    }
+
+    TlbShootdown shootdown(*this);
+    TlbShootdown targetShootdown(other);
+
+    // Always take the two locks in the same order.
+    Spinlock &first = (this < &other) ? m_Lock : other.m_Lock;
+    Spinlock &second = (this < &other) ? other.m_Lock : m_Lock;
+    LockGuard<Spinlock> guard1(first);
+    LockGuard<Spinlock> guard2(second);
+
+    uint64_t *sourceEntry = 0;
+    uint64_t *targetEntry = 0;
+    if (!getPageTableEntry(page, sourceEntry) ||
+        !other.getPageTableEntry(targetPage, targetEntry))
+    {
+        return false;
+    }
+
+    // Both must be present, private user pages. The target must be writable
+    // by its owner, or it's not a valid destination for a read.
+    uint64_t required = PAGE_PRESENT | PAGE_USER;
+    if ((*sourceEntry & required) != required ||
+        (*targetEntry & required) != required ||
+        (*sourceEntry & PAGE_SHARED) || (*targetEntry & PAGE_SHARED) ||
+        !(*targetEntry & (PAGE_WRITE | PAGE_COPY_ON_WRITE)))
+    {
+        return false;
+    }
+
+    physical_uintptr_t lent = PAGE_GET_PHYSICAL_ADDRESS(sourceEntry);
+    physical_uintptr_t replaced = PAGE_GET_PHYSICAL_ADDRESS(targetEntry);
+
+    // Reference counting follows clone(): a page that isn't already
+    // copy-on-write gets a reference for its current owner first.
+    if (!(*sourceEntry & PAGE_COPY_ON_WRITE))
+    {
+        PhysicalMemoryManager::instance().pin(lent);
+
+        uint64_t flags = PAGE_GET_FLAGS(sourceEntry);
+        flags &= ~PAGE_WRITE;
+        flags |= PAGE_COPY_ON_WRITE;
+        PAGE_SET_FLAGS(sourceEntry, flags);
+        shootdown.add(page);
+    }
+    PhysicalMemoryManager::instance().pin(lent);
+
+    uint64_t flags = PAGE_GET_FLAGS(targetEntry);
+    flags &= ~(PAGE_WRITE | PAGE_DIRTY);
+    flags |= PAGE_COPY_ON_WRITE;
+    *targetEntry = lent | flags;
+
+    // Drop the target's reference to the page it used to have, once no
+    // processor running the target can still reach it.
+    targetShootdown.add(targetPage);
+    targetShootdown.free(replaced);
+
+    return true;
 }
 
 VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
@@ -484,6 +967,10 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
         return 0;
     }
 
+    // Pages made copy-on-write here must be flushed from every processor
+    // running this address space.
+    TlbShootdown shootdown(*this);
+
     // Lock both address spaces so we can clone safely.
     LockGuard<Spinlock> cloneGuard(pClone->m_Lock);
     LockGuard<Spinlock> cloneStacksGuard(pClone->m_StacksLock);
@@ -511,15 +998,24 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
                 if ((*pdEntry & PAGE_PRESENT) != PAGE_PRESENT)
                     continue;
 
-                /// \todo Deal with 2MB pages here.
+                // 2MB pages are split so each page can be copied on write
+                // separately.
                 if ((*pdEntry & PAGE_2MB) == PAGE_2MB)
-                    continue;
+                {
+                    void *hugeAddress = reinterpret_cast<void *>(
+                        ((i & 0x100) ? (~0ULL << 48) :
+                                       0ULL) | /* Sign-extension. */
+                        (i << 39) |
+                        (j << 30) | (k << 21));
+                    if (!splitHugePageUnlocked(hugeAddress))
+                        continue;
+                }
 
                 for (uint64_t l = 0; l < 512; l++)
                 {
                     uint64_t *ptEntry =
                         TABLE_ENTRY(PAGE_GET_PHYSICAL_ADDRESS(pdEntry), l);
-                    if ((*ptEntry & PAGE_PRESENT) != PAGE_PRESENT)
+                    if ((*ptEntry & (PAGE_PRESENT | PAGE_SWAPPED)) == 0)
                         continue;
 
                     uint64_t flags = PAGE_GET_FLAGS(ptEntry);
@@ -532,6 +1028,16 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
                         (i << 39) |
                         (j << 30) | (k << 21) | (l << 12));
 
+                    if ((flags & PAGE_PRESENT) != PAGE_PRESENT)
+                    {
+                        // Swap entries are copied as they are. Whoever swapped
+                        // the page out keeps track of who refers to it.
+                        pClone->mapUnlocked(
+                            physicalAddress, virtualAddress,
+                            fromFlags(flags, true));
+                        continue;
+                    }
+
                     if (flags & PAGE_SHARED)
                     {
                         // The physical address is now referenced (shared) in
@@ -571,7 +1077,7 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
                     if (copyOnWrite)
                     {
                         PAGE_SET_FLAGS(ptEntry, flags);
-                        Processor::invalidate(virtualAddress);
+                        shootdown.add(virtualAddress);
                     }
 
                     // Pin the page twice - once for each side of the clone.
@@ -600,6 +1106,7 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
 
     // No longer need this address space's lock - cloning is mostly done.
     m_Lock.release();
+    shootdown.flush();
 
     // Now we pick up the stacks lock, so we can copy safely. However, we don't
     // have the VirtualAddressSpace lock, so we can still safely use the heap
@@ -624,6 +1131,7 @@ VirtualAddressSpace *X64VirtualAddressSpace::clone(bool copyOnWrite)
 
 void X64VirtualAddressSpace::revertToKernelAddressSpace()
 {
+    TlbShootdown shootdown(*this);
     LockGuard<Spinlock> guard(m_Lock);
 
     // The userspace area is only the bottom half of the address space - the top
@@ -658,9 +1166,28 @@ void X64VirtualAddressSpace::revertToKernelAddressSpace()
                 if (regionVirtualAddress > KERNEL_SPACE_START)
                     break;
 
-                /// \todo Deal with 2MB pages here.
                 if ((*pdEntry & PAGE_2MB) == PAGE_2MB)
+                {
+                    // Free each page of the 2MB page, as pages can be freed
+                    // individually after a split anyway.
+                    if ((PAGE_GET_FLAGS(pdEntry) & PAGE_SHARED) == 0)
+                    {
+                        physical_uintptr_t base =
+                            PAGE_GET_PHYSICAL_ADDRESS(pdEntry) &
+                            ~(HUGE_PAGE_SIZE - 1);
+                        for (size_t l = 0; l < PAGES_PER_HUGE_PAGE; l++)
+                        {
+                            shootdown.free(
+                                base +
+                                (l * PhysicalMemoryManager::getPageSize()));
+                        }
+                    }
+
+                    trackPages(-PAGES_PER_HUGE_PAGE, 0, 0);
+                    *pdEntry = 0;
+                    shootdown.add(regionVirtualAddress);
                     continue;
+                }
 
                 for (uint64_t l = 0; l < 512; l++)
                 {
@@ -683,32 +1210,31 @@ void X64VirtualAddressSpace::revertToKernelAddressSpace()
                     /// \todo When swap system comes along, we want to remove
                     /// this page
                     ///       from swap!
-                    if ((flags & (PAGE_SHARED | PAGE_SWAPPED)) == 0)
-                    {
-                        PhysicalMemoryManager::instance().freePage(
-                            physicalAddress);
-                    }
-
                     // Free the page.
                     trackPages(-1, 0, 0);
                     *ptEntry = 0;
-                    Processor::invalidate(virtualAddress);
+                    shootdown.add(virtualAddress);
+
+                    if ((flags & (PAGE_SHARED | PAGE_SWAPPED)) == 0)
+                    {
+                        shootdown.free(physicalAddress);
+                    }
                 }
 
                 // Remove the table.
-                PhysicalMemoryManager::instance().freePage(
-                    PAGE_GET_PHYSICAL_ADDRESS(pdEntry));
+                physical_uintptr_t table = PAGE_GET_PHYSICAL_ADDRESS(pdEntry);
                 *pdEntry = 0;
+                shootdown.freeTable(table);
             }
 
-            PhysicalMemoryManager::instance().freePage(
-                PAGE_GET_PHYSICAL_ADDRESS(pdptEntry));
+            physical_uintptr_t table = PAGE_GET_PHYSICAL_ADDRESS(pdptEntry);
             *pdptEntry = 0;
+            shootdown.freeTable(table);
         }
 
-        PhysicalMemoryManager::instance().freePage(
-            PAGE_GET_PHYSICAL_ADDRESS(pml4Entry));
+        physical_uintptr_t table = PAGE_GET_PHYSICAL_ADDRESS(pml4Entry);
         *pml4Entry = 0;
+        shootdown.freeTable(table);
     }
 
     // Reset heap; it's been wiped out by this reversion.
@@ -944,13 +1470,19 @@ X64VirtualAddressSpace::~X64VirtualAddressSpace()
 
     // Free the PageMapLevel4
     physicalMemoryManager.freePage(m_PhysicalPML4);
+
+    freePcid(m_Pcid);
 }
 
 X64VirtualAddressSpace::X64VirtualAddressSpace()
     : VirtualAddressSpace(USERSPACE_VIRTUAL_HEAP), m_PhysicalPML4(0),
       m_pStackTop(USERSPACE_VIRTUAL_STACK), m_freeStacks(),
-      m_bKernelSpace(false), m_Lock(false, false), m_StacksLock(false)
+      m_bKernelSpace(false), m_Lock(false, false), m_StacksLock(false),
+      m_Pcid(0)
 {
+    if (m_bPcidEnabled)
+        m_Pcid = allocatePcid();
+
     // Allocate a new PageMapLevel4
     PhysicalMemoryManager &physicalMemoryManager =
         PhysicalMemoryManager::instance();
@@ -972,10 +1504,28 @@ X64VirtualAddressSpace::X64VirtualAddressSpace(
     void *Heap, physical_uintptr_t PhysicalPML4, void *VirtualStack)
     : VirtualAddressSpace(Heap), m_PhysicalPML4(PhysicalPML4),
       m_pStackTop(VirtualStack), m_freeStacks(), m_bKernelSpace(true),
-      m_Lock(false, false), m_StacksLock(false)
+      m_Lock(false, false), m_StacksLock(false), m_Pcid(0)
 {
 }
 
+void X64VirtualAddressSpace::initialiseProcessor()
+{
+    uint32_t eax, ebx, ecx, edx;
+    Processor::cpuid(1, 0, eax, ebx, ecx, edx);
+
+    // PCIDs only pay off if kernel mappings survive an address space switch,
+    // so they are only used alongside global pages.
+    if (!(ecx & (1 << 17)) || !(edx & (1 << 13)))
+        return;
+
+    uint64_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+    cr4 |= CR4_PGE | CR4_PCIDE;
+    asm volatile("mov %0, %%cr4" ::"r"(cr4));
+
+    m_bPcidEnabled = true;
+}
+
 bool X64VirtualAddressSpace::getPageTableEntry(
     void *virtualAddress, uint64_t *&pageTableEntry) const
 {
@@ -1018,7 +1568,38 @@ bool X64VirtualAddressSpace::getPageTableEntry(
     return true;
 }
 
-void X64VirtualAddressSpace::maybeFreeTables(void *virtualAddress)
+bool X64VirtualAddressSpace::getHugePageEntry(
+    void *virtualAddress, uint64_t *&pageDirectoryEntry) const
+{
+    size_t pml4Index = PML4_INDEX(virtualAddress);
+    uint64_t *pml4Entry = TABLE_ENTRY(m_PhysicalPML4, pml4Index);
+
+    // Is a page directory pointer table present?
+    if ((*pml4Entry & PAGE_PRESENT) != PAGE_PRESENT)
+        return false;
+
+    size_t pageDirectoryPointerIndex =
+        PAGE_DIRECTORY_POINTER_INDEX(virtualAddress);
+    uint64_t *pageDirectoryPointerEntry = TABLE_ENTRY(
+        PAGE_GET_PHYSICAL_ADDRESS(pml4Entry), pageDirectoryPointerIndex);
+
+    // Is a page directory present? (1GB pages don't count.)
+    if ((*pageDirectoryPointerEntry & (PAGE_PRESENT | PAGE_2MB)) !=
+        PAGE_PRESENT)
+        return false;
+
+    size_t pageDirectoryIndex = PAGE_DIRECTORY_INDEX(virtualAddress);
+    pageDirectoryEntry = TABLE_ENTRY(
+        PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryPointerEntry),
+        pageDirectoryIndex);
+
+    // Is a 2MB page present?
+    return (*pageDirectoryEntry & (PAGE_PRESENT | PAGE_2MB)) ==
+           (PAGE_PRESENT | PAGE_2MB);
+}
+
+void X64VirtualAddressSpace::maybeFreeTables(
+    void *virtualAddress, TlbShootdown &shootdown)
 {
     bool bCanFreePageTable = true;
 
@@ -1066,10 +1647,10 @@ void X64VirtualAddressSpace::maybeFreeTables(void *virtualAddress)
         }
     }
 
-    if (bCanFreePageTable && pageDirectoryEntry)
+    if (bCanFreePageTable && pageDirectoryEntry &&
+        (*pageDirectoryEntry & PAGE_PRESENT) == PAGE_PRESENT)
     {
-        PhysicalMemoryManager::instance().freePage(
-            PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryEntry));
+        shootdown.freeTable(PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryEntry));
         *pageDirectoryEntry = 0;
     }
     else if (!bCanFreePageTable)
@@ -1093,7 +1674,7 @@ void X64VirtualAddressSpace::maybeFreeTables(void *virtualAddress)
 
     if (bCanFreeDirectory)
     {
-        PhysicalMemoryManager::instance().freePage(
+        shootdown.freeTable(
             PAGE_GET_PHYSICAL_ADDRESS(pageDirectoryPointerEntry));
         *pageDirectoryPointerEntry = 0;
     }
@@ -1115,8 +1696,7 @@ void X64VirtualAddressSpace::maybeFreeTables(void *virtualAddress)
 
     if (bCanFreeDirectoryPointerTable)
     {
-        PhysicalMemoryManager::instance().freePage(
-            PAGE_GET_PHYSICAL_ADDRESS(pml4Entry));
+        shootdown.freeTable(PAGE_GET_PHYSICAL_ADDRESS(pml4Entry));
         *pml4Entry = 0;
     }
 }
@@ -1197,10 +1777,10 @@ bool X64VirtualAddressSpace::conditionalTableEntryAllocation(
 
     if ((*tableEntry & PAGE_PRESENT) != PAGE_PRESENT)
     {
-        // Allocate a page
+        // Allocate a zeroed page for the new table
         PhysicalMemoryManager &PMemoryManager =
             PhysicalMemoryManager::instance();
-        uint64_t page = PMemoryManager.allocatePage();
+        uint64_t page = PMemoryManager.allocateZeroedPage();
         if (page == 0)
         {
             ERROR("OOM in "
@@ -1209,17 +1789,13 @@ bool X64VirtualAddressSpace::conditionalTableEntryAllocation(
         }
 
         // Add the WRITE and USER flags so that these can be controlled
-        // on a page-granularity level.
+        // on a page-granularity level. The table is present even if the page
+        // being mapped is a swap entry.
         flags &= ~(PAGE_GLOBAL | PAGE_NX | PAGE_SWAPPED | PAGE_COPY_ON_WRITE);
-        flags |= PAGE_WRITE | PAGE_USER;
+        flags |= PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
 
         // Map the page.
         *tableEntry = page | flags;
-
-        // Zero the page directory pointer table.
-        ByteSet(
-            physicalAddress(reinterpret_cast<void *>(page)), 0,
-            PhysicalMemoryManager::getPageSize());
     }
     else if (((*tableEntry & PAGE_USER) != PAGE_USER) && (flags & PAGE_USER))
     {
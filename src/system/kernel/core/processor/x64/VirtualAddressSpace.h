@@ -20,6 +20,7 @@
 #ifndef KERNEL_PROCESSOR_X64_VIRTUALADDRESSSPACE_H
 #define KERNEL_PROCESSOR_X64_VIRTUALADDRESSSPACE_H
 
+#include "KernelHeap.h"
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
@@ -57,8 +58,10 @@
     reinterpret_cast<void *>(0xFFFF800100000000)
 #define KERNEL_VIRTUAL_PAGESTACK_ABV4GB2 \
     reinterpret_cast<void *>(0xFFFF801000000000)
-#define KERNEL_VIRTUAL_HEAP reinterpret_cast<void *>(0xFFFF900000000000)
-#define KERNEL_VIRTUAL_CACHE reinterpret_cast<void *>(0xFFFFB00000000000)
+#define KERNEL_VIRTUAL_PAGEFRAMES \
+    reinterpret_cast<void *>(0xFFFF880000000000)
+#define KERNEL_VIRTUAL_HEAP reinterpret_cast<void *>(KERNEL_HEAP_START)
+#define KERNEL_VIRTUAL_CACHE reinterpret_cast<void *>(KERNEL_HEAP_END)
 #define KERNEL_VIRTUAL_MEMORYREGION_ADDRESS \
     reinterpret_cast<void *>(0xFFFFF00000000000)
 #define KERNEL_VIRTUAL_PAGESTACK_4GB \
@@ -111,10 +114,26 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
     virtual bool mapHuge(
         physical_uintptr_t physAddress, void *virtualAddress, size_t count,
         size_t flags);
+    virtual size_t getHugePageSize() const;
+    virtual bool mapHugePage(
+        physical_uintptr_t physAddress, void *virtualAddress, size_t flags);
+    virtual bool canMapHugePage(void *virtualAddress);
+    virtual bool isHugePage(void *virtualAddress);
+    virtual void unmapHugePage(void *virtualAddress);
+    virtual bool splitHugePage(void *virtualAddress);
     virtual void getMapping(
         void *virtualAddress, physical_uintptr_t &physAddress, size_t &flags);
     virtual void setFlags(void *virtualAddress, size_t newFlags);
     virtual void unmap(void *virtualAddress);
+    virtual void setFlagsBatched(
+        void *virtualAddress, size_t newFlags, TlbShootdown &shootdown);
+    virtual void unmapBatched(void *virtualAddress, TlbShootdown &shootdown);
+    virtual bool clearAccessed(void *virtualAddress);
+    virtual bool isSwapped(void *virtualAddress);
+    virtual size_t
+    copyInto(void *destination, const void *source, size_t size);
+    virtual bool
+    lendPage(void *page, VirtualAddressSpace &target, void *targetPage);
     virtual Stack *allocateStack();
     virtual Stack *allocateStack(size_t stackSz);
     virtual void freeStack(Stack *pStack);
@@ -147,6 +166,12 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
     /** The destructor cleans up the address space */
     virtual ~X64VirtualAddressSpace();
 
+    /** Turn on PCIDs (and global pages, so kernel mappings survive address
+     *  space switches) for the current processor, if it supports them. Must
+     *  be called on each processor before it first switches address spaces.
+     */
+    static void initialiseProcessor();
+
     /** Gets start address of the kernel in the address space. */
     virtual uintptr_t getKernelStart() const
     {
@@ -260,15 +285,27 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
      *out, false otherwise */
     bool
     getPageTableEntry(void *virtualAddress, uint64_t *&pageTableEntry) const;
+    /** Get the page directory entry of the 2MB page mapping virtualAddress.
+     *\return true if virtualAddress is mapped by a 2MB page, false otherwise */
+    bool getHugePageEntry(
+        void *virtualAddress, uint64_t *&pageDirectoryEntry) const;
+    /** Split a 2MB page into a page table, without taking the lock. */
+    bool splitHugePageUnlocked(void *virtualAddress);
+    /** Set the flags of a page, without taking the lock. */
+    void setFlagsUnlocked(
+        void *virtualAddress, size_t newFlags, TlbShootdown &shootdown);
+    /** Copy a newly created kernel PML4 entry into every process' address
+     *  space. */
+    void propagatePml4Entry(size_t pml4Index, uint64_t entry);
     /**
      * \brief Possibly cleans up tables for the given address.
      *
      * This is used when unmapping pages to opportunistically unmap paging
      * structures that are no longer necessary.
      * \param[in] virtualAddress the virtual address
-     * \param[out] pageTableEntry pointer to the page table entry
+     * \param[in] shootdown frees the tables once no TLB can refer to them
      */
-    void maybeFreeTables(void *virtualAddress);
+    void maybeFreeTables(void *virtualAddress, TlbShootdown &shootdown);
     /** Convert the processor independant flags to the processor's
      *representation of the flags \param[in] flags the processor independant
      *flag representation \param[in] bFinal whether this is for the actual page
@@ -305,7 +342,9 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
     /**
      * Perform an unmap without taking the lock.
      */
-    void unmapUnlocked(void *virtualAddress, bool requireMapped = true);
+    void unmapUnlocked(
+        void *virtualAddress, TlbShootdown &shootdown,
+        bool requireMapped = true);
 
     /** Allocates a stack with a given size. */
     Stack *doAllocateStack(size_t sSize);
@@ -322,6 +361,12 @@ class X64VirtualAddressSpace : public VirtualAddressSpace
     Spinlock m_Lock;
     /** Lock to guard against multiprocessor reentrancy for stack reuse. */
     Spinlock m_StacksLock;
+    /** Process-context identifier tagging this address space's TLB entries,
+     *  or zero if it has none. */
+    uint16_t m_Pcid;
+
+    /** Whether PCIDs are in use. */
+    static bool m_bPcidEnabled;
 
     /** The kernel virtual address space */
     static X64VirtualAddressSpace m_KernelSpace;
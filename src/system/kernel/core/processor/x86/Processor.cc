@@ -26,6 +26,7 @@
 #include "pedigree/kernel/processor/IoPortManager.h"
 #include "pedigree/kernel/processor/NMFaultHandler.h"
 #include "pedigree/kernel/processor/PageFaultHandler.h"
+#include "pedigree/kernel/utilities/utility.h"
 #include <SlabAllocator.h>
 
 // Multiprocessor headers
@@ -107,6 +108,9 @@ void Processor::initialise1(const BootstrapStruct_t &Info)
 
     NMFaultHandler::instance().initialise();
 
+    // Now SSE is available, pick the vectorised memory/string functions.
+    InitialiseMemoryFunctions();
+
     /// todo move to a better place
     // Write PAT MSR.
     // MSR 0x277
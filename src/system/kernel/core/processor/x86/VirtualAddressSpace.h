@@ -20,6 +20,7 @@
 #ifndef KERNEL_PROCESSOR_X86_VIRTUALADDRESSSPACE_H
 #define KERNEL_PROCESSOR_X86_VIRTUALADDRESSSPACE_H
 
+#include "KernelHeap.h"
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
 #include "pedigree/kernel/processor/types.h"
@@ -42,11 +43,12 @@
 #define KERNEL_VIRTUAL_TEMP1 reinterpret_cast<void *>(0xFFBFC000)
 #define KERNEL_VIRTUAL_TEMP2 reinterpret_cast<void *>(0xFFBFD000)
 #define KERNEL_VIRTUAL_TEMP3 reinterpret_cast<void *>(0xFFBFE000)
-#define KERNEL_VIRTUAL_HEAP reinterpret_cast<void *>(0xC0000000)
-#define KERNEL_VIRTUAL_HEAP_SIZE 0x10000000
+#define KERNEL_VIRTUAL_HEAP reinterpret_cast<void *>(KERNEL_HEAP_START)
+#define KERNEL_VIRTUAL_HEAP_SIZE (KERNEL_HEAP_END - KERNEL_HEAP_START)
 #define KERNEL_VIRUTAL_PAGE_DIRECTORY reinterpret_cast<void *>(0xFF7FF000)
 #define KERNEL_VIRTUAL_ADDRESS reinterpret_cast<void *>(0xFF400000 - 0x100000)
 #define KERNEL_VIRTUAL_MEMORYREGION_ADDRESS reinterpret_cast<void *>(0xD0000000)
+#define KERNEL_VIRTUAL_PAGEFRAMES reinterpret_cast<void *>(0xE0000000)
 #define KERNEL_VIRTUAL_PAGESTACK_4GB reinterpret_cast<void *>(0xF0000000)
 #define KERNEL_VIRTUAL_STACK reinterpret_cast<void *>(0xFF3F6000)
 #define KERNEL_VIRTUAL_MEMORYREGION_SIZE 0x10000000
@@ -24,6 +24,7 @@
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/processor/Processor.h"
 #include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/processor/TlbShootdown.h"
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/utilities/Vector.h"
@@ -148,6 +149,16 @@ size_t Multiprocessor::initialise1()
         // Startup the processor
         if (localApic.getId() != (*Processors)[i]->apicId)
         {
+            // TLB shootdowns could never reach this processor.
+            if ((*Processors)[i]->processorId >= TlbShootdown::MaxProcessors)
+            {
+                WARNING(
+                    " Not booting processor #"
+                    << Dec << (*Processors)[i]->processorId << Hex
+                    << ", its ID is too large");
+                continue;
+            }
+
             // AP: set up a proper information structure
             pProcessorInfo = new ::ProcessorInformation(
                 (*Processors)[i]->processorId, (*Processors)[i]->apicId);
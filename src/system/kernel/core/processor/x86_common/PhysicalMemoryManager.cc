@@ -24,11 +24,15 @@
 #include "pedigree/kernel/panic.h"
 #include "pedigree/kernel/process/MemoryPressureManager.h"
 #include "pedigree/kernel/process/Process.h"
+#include "pedigree/kernel/process/SchedulingAlgorithm.h"
+#include "pedigree/kernel/process/Semaphore.h"
 #include "pedigree/kernel/process/Thread.h"
 #include "pedigree/kernel/processor/MemoryRegion.h"
 #include "pedigree/kernel/processor/Processor.h"
 #include "pedigree/kernel/processor/ProcessorInformation.h"
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
+#include "pedigree/kernel/utilities/Cache.h"
+#include "pedigree/kernel/utilities/String.h"
 #include "pedigree/kernel/utilities/Vector.h"
 #include "pedigree/kernel/utilities/utility.h"
 
@@ -36,6 +40,7 @@
 #include "../x86/VirtualAddressSpace.h"
 #elif defined(X64)
 #include "../x64/VirtualAddressSpace.h"
+#include "../x64/utils.h"
 #endif
 
 #if defined(TRACK_PAGE_ALLOCATIONS)
@@ -76,32 +81,105 @@ PhysicalMemoryManager &PhysicalMemoryManager::instance()
 
 size_t X86CommonPhysicalMemoryManager::freePageCount() const
 {
-    return m_PageStack.freePages();
+    size_t result = zoneFreePages();
+    for (size_t i = 0; i < PageCacheCount; ++i)
+    {
+        result += m_PageCaches[i].count() + m_ZeroedPools[i].count();
+    }
+    return result;
 }
 
-physical_uintptr_t
-X86CommonPhysicalMemoryManager::allocatePage(size_t pageConstraints)
+size_t X86CommonPhysicalMemoryManager::zeroedPageHits() const
 {
-    static bool bDidHitWatermark = false;
-    static bool bHandlingPressure = false;
+    size_t result = 0;
+    for (size_t i = 0; i < PageCacheCount; ++i)
+    {
+        result += m_ZeroedPools[i].hits();
+    }
+    return result;
+}
+
+size_t X86CommonPhysicalMemoryManager::zeroedPageMisses() const
+{
+    size_t result = 0;
+    for (size_t i = 0; i < PageCacheCount; ++i)
+    {
+        result += m_ZeroedPools[i].misses();
+    }
+    return result;
+}
+
+/// Keeps g_FreePages and g_AllocedPages in step with the zones.
+static void accountAllocated(size_t numPages)
+{
+    if (g_FreePages >= numPages)
+    {
+        g_FreePages -= numPages;
+    }
+    else
+    {
+        g_FreePages = 0;
+    }
+    g_AllocedPages += numPages;
+}
 
-    // Recursion allowed, to permit e.g. calls from the manager to the heap to
-    // succeed without needing to release/re-acquire the lock.
-    m_Lock.acquire(true);
+static void accountFreed(size_t numPages)
+{
+    g_FreePages += numPages;
+    if (g_AllocedPages >= numPages)
+    {
+        g_AllocedPages -= numPages;
+    }
+    else
+    {
+        g_AllocedPages = 0;
+    }
+}
 
-    physical_uintptr_t ptr;
+/// Common tracking for every page handed out.
+static void noteAllocatedPage(physical_uintptr_t ptr)
+{
+#ifdef MEMORY_TRACING
+    traceAllocation(
+        reinterpret_cast<void *>(ptr), MemoryTracing::PageAlloc, 4096);
+#endif
+
+#if defined(TRACK_PAGE_ALLOCATIONS)
+    if (Processor::m_Initialised == 2)
+    {
+        if (!g_AllocationCommand.isMallocing())
+        {
+            g_AllocationCommand.allocatePage(ptr);
+        }
+    }
+#endif
+}
+
+void X86CommonPhysicalMemoryManager::checkMemoryPressure()
+{
+    static bool bDidHitWatermark = false;
+    static bool bHandlingPressure = false;
 
     // Some methods of handling memory pressure require allocating pages, so
     // we need to not end up recursively trying to release the pressure.
-    if (!bHandlingPressure)
+    if (bHandlingPressure)
     {
-        if (m_PageStack.freePages() < MemoryPressureManager::getHighWatermark())
-        {
-            bHandlingPressure = true;
+        return;
+    }
 
-            // Make sure the compact can trigger frees.
-            m_Lock.release();
+    if (zoneFreePages() < MemoryPressureManager::getHighWatermark())
+    {
+        bHandlingPressure = true;
 
+        // Make sure the compact can trigger frees.
+        m_Lock.release();
+
+        // Pages sitting in other processors' caches are the cheapest thing to
+        // give back.
+        drainPageCaches();
+
+        if (zoneFreePages() < MemoryPressureManager::getHighWatermark())
+        {
             WARNING_NOLOCK(
                 "Memory pressure encountered, performing a compact...");
             if (!MemoryPressureManager::instance().compact())
@@ -109,54 +187,212 @@ X86CommonPhysicalMemoryManager::allocatePage(size_t pageConstraints)
             else
                 NOTICE_NOLOCK("Compact was successful.");
 
-            m_Lock.acquire(true);
-
             bDidHitWatermark = true;
-            bHandlingPressure = false;
         }
-        else if (bDidHitWatermark)
+
+        m_Lock.acquire(true);
+
+        bHandlingPressure = false;
+    }
+    else if (bDidHitWatermark)
+    {
+        ERROR_NOLOCK("<pressure was hit, but is no longer being hit>");
+        bDidHitWatermark = false;
+    }
+}
+
+FreePageCache *X86CommonPhysicalMemoryManager::pageCache()
+{
+#ifdef USE_BITMAP
+    // Keep every page on the stack so the bitmap still catches double frees.
+    return 0;
+#else
+    // Processor::id() means nothing until the processor is set up. It doesn't
+    // matter if we migrate after reading it, as each cache has its own lock.
+    if (Processor::m_Initialised != 2)
+    {
+        return 0;
+    }
+
+    return &m_PageCaches[Processor::id() % PageCacheCount];
+#endif
+}
+
+void X86CommonPhysicalMemoryManager::drainPageCaches()
+{
+    for (size_t i = 0; i < PageCacheCount; ++i)
+    {
+        m_PageCaches[i].drain();
+        m_ZeroedPools[i].drain();
+    }
+}
+
+ZeroedPagePool *X86CommonPhysicalMemoryManager::zeroedPool()
+{
+#if defined(X64)
+    if (Processor::m_Initialised != 2)
+    {
+        return 0;
+    }
+
+    return &m_ZeroedPools[Processor::id() % PageCacheCount];
+#else
+    // Pages can only be zeroed ahead of time through the physical map.
+    return 0;
+#endif
+}
+
+physical_uintptr_t
+X86CommonPhysicalMemoryManager::allocatePage(size_t pageConstraints)
+{
+    physical_uintptr_t ptr = 0;
+
+    // Unconstrained pages come from this processor's cache, which only goes
+    // to the page stack (and takes its lock) once per batch.
+    FreePageCache *pCache = pageConstraints ? 0 : pageCache();
+    if (pCache)
+    {
+        if (UNLIKELY(
+                zoneFreePages() < MemoryPressureManager::getHighWatermark()))
         {
-            ERROR_NOLOCK("<pressure was hit, but is no longer being hit>");
-            bDidHitWatermark = false;
+            RecursingLockGuard<Spinlock> guard(m_Lock);
+            checkMemoryPressure();
         }
+
+        ptr = pCache->allocate();
     }
 
-    ptr = m_PageStack.allocate(pageConstraints);
     if (!ptr)
     {
-        panic("Out of memory.");
-    }
+        // Recursion allowed, to permit e.g. calls from the manager to the heap
+        // to succeed without needing to release/re-acquire the lock.
+        m_Lock.acquire(true);
 
-#ifdef MEMORY_TRACING
-    traceAllocation(
-        reinterpret_cast<void *>(ptr), MemoryTracing::PageAlloc, 4096);
-#endif
+        checkMemoryPressure();
 
-    trackPages(0, 1, 0);
+        ptr = allocateFromZones(0, pageConstraints);
+        if (!ptr)
+        {
+            panic("Out of memory.");
+        }
 
 #ifdef USE_BITMAP
-    physical_uintptr_t ptr_bitmap = ptr / 0x1000;
-    size_t idx = ptr_bitmap / 32;
-    size_t bit = ptr_bitmap % 32;
-    g_PageBitmap[idx] |= (1 << bit);
+        physical_uintptr_t ptr_bitmap = ptr / 0x1000;
+        size_t idx = ptr_bitmap / 32;
+        size_t bit = ptr_bitmap % 32;
+        g_PageBitmap[idx] |= (1 << bit);
 #endif
 
-    m_Lock.release();
+        m_Lock.release();
+    }
 
-#if defined(TRACK_PAGE_ALLOCATIONS)
-    if (Processor::m_Initialised == 2)
+    trackPages(0, 1, 0);
+    noteAllocatedPage(ptr);
+
+    // Get the reclaim thread going before anyone has to reclaim directly.
+    if (UNLIKELY(zoneFreePages() < MemoryPressureManager::getLowWatermark()))
     {
-        if (!g_AllocationCommand.isMallocing())
+        CacheManager::instance().wakeReclaim();
+    }
+
+    return ptr;
+}
+
+size_t X86CommonPhysicalMemoryManager::allocatePages(
+    size_t count, physical_uintptr_t *pages, size_t pageConstraints)
+{
+    FreePageCache *pCache = pageConstraints ? 0 : pageCache();
+    if (!pCache)
+    {
+        return PhysicalMemoryManager::allocatePages(
+            count, pages, pageConstraints);
+    }
+
+    if (UNLIKELY(
+            zoneFreePages() <
+            (MemoryPressureManager::getHighWatermark() + count)))
+    {
+        RecursingLockGuard<Spinlock> guard(m_Lock);
+        checkMemoryPressure();
+    }
+
+    size_t result = pCache->allocate(pages, count);
+
+    trackPages(0, result, 0);
+    for (size_t i = 0; i < result; ++i)
+    {
+        noteAllocatedPage(pages[i]);
+    }
+
+    if (UNLIKELY(zoneFreePages() < MemoryPressureManager::getLowWatermark()))
+    {
+        CacheManager::instance().wakeReclaim();
+    }
+
+    return result;
+}
+
+physical_uintptr_t
+X86CommonPhysicalMemoryManager::allocateZeroedPage(size_t pageConstraints)
+{
+    ZeroedPagePool *pPool = pageConstraints ? 0 : zeroedPool();
+    if (pPool)
+    {
+        physical_uintptr_t ptr = pPool->allocate();
+
+        if (pPool->needsRefill())
         {
-            g_AllocationCommand.allocatePage(ptr);
+            Semaphore *pWake = m_pZeroingWake[pPool - m_ZeroedPools];
+            if (pWake)
+            {
+                pWake->release();
+            }
+        }
+
+        if (ptr)
+        {
+            trackPages(0, 1, 0);
+            noteAllocatedPage(ptr);
+            return ptr;
         }
     }
-#endif
 
+#if defined(X64)
+    physical_uintptr_t ptr = allocatePage(pageConstraints);
+    if (ptr)
+    {
+        // The caller is about to use the page, so zero it through the cache.
+        ByteSet(
+            reinterpret_cast<void *>(physicalAddress(ptr)), 0, getPageSize());
+    }
     return ptr;
+#else
+    return PhysicalMemoryManager::allocateZeroedPage(pageConstraints);
+#endif
 }
+
 void X86CommonPhysicalMemoryManager::freePage(physical_uintptr_t page)
 {
+    if (!unpin(page))
+    {
+        // Still references.
+        return;
+    }
+
+    FreePageCache *pCache = pageCache();
+    if (pCache)
+    {
+        pCache->free(page);
+
+#ifdef MEMORY_TRACING
+        traceAllocation(
+            reinterpret_cast<void *>(page), MemoryTracing::PageFree, 4096);
+#endif
+
+        trackPages(0, -1, 0);
+        return;
+    }
+
     RecursingLockGuard<Spinlock> guard(m_Lock);
 
     freePageUnlocked(page);
@@ -167,29 +403,6 @@ void X86CommonPhysicalMemoryManager::freePageUnlocked(physical_uintptr_t page)
         FATAL("X86CommonPhysicalMemoryManager::freePageUnlocked called without "
               "an acquired lock");
 
-    // Check for pinned page.
-    PageHashable index(page);
-    MetadataTable::LookupResult result = m_PageMetadata.lookup(index);
-    if (result.hasValue())
-    {
-        struct page p = result.value();
-        if (p.active)
-        {
-            if (--p.refcount)
-            {
-                // Still references.
-                m_PageMetadata.update(index, p);
-                return;
-            }
-            else
-            {
-                // No more references, stop tracking page.
-                p.active = false;
-                m_PageMetadata.update(index, p);
-            }
-        }
-    }
-
 #ifdef USE_BITMAP
     physical_uintptr_t ptr_bitmap = page / 0x1000;
     size_t idx = ptr_bitmap / 32;
@@ -203,7 +416,7 @@ void X86CommonPhysicalMemoryManager::freePageUnlocked(physical_uintptr_t page)
     g_PageBitmap[idx] &= ~(1 << bit);
 #endif
 
-    m_PageStack.free(page, getPageSize());
+    freeToZones(page, 0);
 
 #ifdef MEMORY_TRACING
     traceAllocation(
@@ -212,27 +425,382 @@ void X86CommonPhysicalMemoryManager::freePageUnlocked(physical_uintptr_t page)
 
     trackPages(0, -1, 0);
 }
+bool X86CommonPhysicalMemoryManager::unpin(physical_uintptr_t page)
+{
+    PageFrame *pFrame = pageFrame(page);
+    return !pFrame || pFrame->unpin();
+}
 void X86CommonPhysicalMemoryManager::pin(physical_uintptr_t page)
 {
+    PageFrame *pFrame = pageFrame(page);
+    if (pFrame)
+    {
+        pFrame->pin();
+    }
+}
+
+PageFrame *X86CommonPhysicalMemoryManager::pageFrame(physical_uintptr_t page)
+{
+    PageFrame *pFrame = &m_PageFrames[page / getPageSize()];
+
+    // Frames can straddle pages of the array, so check both ends are mapped.
+    uintptr_t offset = pointer_diff(m_PageFrames, pFrame);
+    if (!m_PageFramesMapped.test(offset / getPageSize()) ||
+        !m_PageFramesMapped.test(
+            (offset + sizeof(PageFrame) - 1) / getPageSize()))
+    {
+        return 0;
+    }
+
+    return pFrame;
+}
+
+void X86CommonPhysicalMemoryManager::mapPageFrames(
+    uint64_t base, uint64_t length)
+{
+    size_t pageSize = getPageSize();
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(
+        &m_PageFrames[base / pageSize]);
+    uintptr_t end = reinterpret_cast<uintptr_t>(
+        &m_PageFrames[(base + length + pageSize - 1) / pageSize]);
+    start &= ~(pageSize - 1);
+
+    VirtualAddressSpace &kernelSpace =
+        VirtualAddressSpace::getKernelAddressSpace();
+
+    for (uintptr_t v = start; v < end; v += pageSize)
+    {
+        size_t index =
+            (v - reinterpret_cast<uintptr_t>(m_PageFrames)) / pageSize;
+        if (m_PageFramesMapped.test(index))
+        {
+            continue;
+        }
+
+        physical_uintptr_t phys = allocateFromZones(0, 0);
+        if (!phys)
+        {
+            panic("PhysicalMemoryManager: no memory for the page frame array");
+        }
+
+        void *pVirtual = reinterpret_cast<void *>(v);
+        if (!kernelSpace.map(
+                phys, pVirtual,
+                VirtualAddressSpace::KernelMode | VirtualAddressSpace::Write))
+        {
+            panic("PhysicalMemoryManager: failed to map the page frame array");
+        }
+
+        ByteSet(pVirtual, 0, pageSize);
+        m_PageFramesMapped.set(index);
+    }
+}
+
+size_t X86CommonPhysicalMemoryManager::ZoneBackend::takePages(
+    physical_uintptr_t *pages, size_t count)
+{
+    return m_Pmm.allocatePagesFromZones(pages, count);
+}
+
+void X86CommonPhysicalMemoryManager::ZoneBackend::returnPages(
+    const physical_uintptr_t *pages, size_t count)
+{
+    m_Pmm.freePagesToZones(pages, count);
+}
+
+size_t X86CommonPhysicalMemoryManager::ZeroBackend::takePages(
+    physical_uintptr_t *pages, size_t count)
+{
+    // Don't keep pages zeroed that are better off relieving memory pressure.
+    if (m_Pmm.zoneFreePages() <
+        (MemoryPressureManager::getHighWatermark() + count))
+    {
+        return 0;
+    }
+
+    return m_Pmm.allocatePagesFromZones(pages, count);
+}
+
+void X86CommonPhysicalMemoryManager::ZeroBackend::returnPages(
+    const physical_uintptr_t *pages, size_t count)
+{
+    m_Pmm.freePagesToZones(pages, count);
+}
+
+void X86CommonPhysicalMemoryManager::ZeroBackend::zeroPage(
+    physical_uintptr_t page)
+{
+#if defined(X64)
+    // Non-temporal stores, so zeroing pages nobody has asked for yet doesn't
+    // push anything useful out of the cache.
+    uint64_t *p = reinterpret_cast<uint64_t *>(physicalAddress(page));
+    for (size_t i = 0; i < (getPageSize() / sizeof(uint64_t)); i += 4)
+    {
+        asm volatile("movnti %1, (%0); movnti %1, 8(%0);"
+                     "movnti %1, 16(%0); movnti %1, 24(%0)" ::"r"(&p[i]),
+                     "r"(0ULL)
+                     : "memory");
+    }
+    asm volatile("sfence" ::: "memory");
+#endif
+}
+
+void X86CommonPhysicalMemoryManager::startZeroingThreads()
+{
+#if defined(THREADS) && defined(X64)
+    Process *pParent = Processor::information().getCurrentThread()->getParent();
+
+    size_t nThreads = Processor::getCount();
+    if (nThreads > PageCacheCount)
+    {
+        nThreads = PageCacheCount;
+    }
+
+    for (size_t i = 0; i < nThreads; ++i)
+    {
+        m_pZeroingWake[i] = new Semaphore(0);
+
+        Thread *pThread =
+            new Thread(pParent, zeroingThread, reinterpret_cast<void *>(i));
+        pThread->setPriority(MAX_PRIORITIES - 1);
+        pThread->detach();
+    }
+#endif
+}
+
+int X86CommonPhysicalMemoryManager::zeroingThread(void *p)
+{
+    size_t index = reinterpret_cast<size_t>(p);
+    X86CommonPhysicalMemoryManager &pmm = instance();
+
+    while (true)
+    {
+        pmm.m_ZeroedPools[index].refill();
+
+        // Top up now and then even if nobody asks, in case a wake-up was
+        // missed while refilling.
+        pmm.m_pZeroingWake[index]->acquire(1, 1);
+    }
+
+    return 0;
+}
+
+PageFrame *
+X86CommonPhysicalMemoryManager::PageFrameMap::frame(physical_uintptr_t page)
+{
+    return m_Pmm.pageFrame(page);
+}
+
+physical_uintptr_t
+X86CommonPhysicalMemoryManager::PageFrameMap::address(PageFrame *pFrame)
+{
+    return static_cast<physical_uintptr_t>(pFrame - m_Pmm.m_PageFrames) *
+           getPageSize();
+}
+
+BuddyAllocator *
+X86CommonPhysicalMemoryManager::zoneFor(physical_uintptr_t page)
+{
+    if (!pageFrame(page))
+    {
+        return 0;
+    }
+
+    for (size_t i = 0; i < ZoneCount; ++i)
+    {
+        if (m_Zones[i].contains(page))
+        {
+            return &m_Zones[i];
+        }
+    }
+
+    return 0;
+}
+
+physical_uintptr_t X86CommonPhysicalMemoryManager::allocateFromZones(
+    size_t order, size_t pageConstraints)
+{
+    // Unconstrained allocations leave the DMA zone for those that need it.
+    Zone zones[2] = {HighZone, NormalZone};
+    size_t numZones = 2;
+
+    size_t constraints = pageConstraints & addressConstraints;
+    if (constraints == below1MB || constraints == below16MB)
+    {
+        zones[0] = DmaZone;
+        numZones = 1;
+    }
+    else if (constraints == below4GB || constraints == below64GB)
+    {
+        zones[0] = NormalZone;
+        numZones = 1;
+    }
+
+    physical_uintptr_t result = 0;
+    for (size_t i = 0; i < numZones && !result; ++i)
+    {
+        result = m_Zones[zones[i]].allocate(order);
+    }
+
+    if (result)
+    {
+        accountAllocated(1UL << order);
+    }
+    else if (!order)
+    {
+        // Zones aren't populated yet (or are exhausted).
+        RecursingLockGuard<Spinlock> guard(m_Lock);
+        result = m_PageStack.allocate(pageConstraints);
+    }
+
+    return result;
+}
+
+size_t X86CommonPhysicalMemoryManager::allocatePagesFromZones(
+    physical_uintptr_t *pages, size_t count)
+{
+    size_t result = m_Zones[HighZone].allocate(pages, count);
+    if (result < count)
+    {
+        result +=
+            m_Zones[NormalZone].allocate(pages + result, count - result);
+    }
+
+    accountAllocated(result);
+
+    if (result < count)
+    {
+        RecursingLockGuard<Spinlock> guard(m_Lock);
+        for (; result < count; ++result)
+        {
+            pages[result] = m_PageStack.allocate(0);
+            if (!pages[result])
+            {
+                break;
+            }
+        }
+    }
+
+    return result;
+}
+
+void X86CommonPhysicalMemoryManager::freeToZones(
+    physical_uintptr_t block, size_t order)
+{
+    BuddyAllocator *pZone = zoneFor(block);
+    if (pZone)
+    {
+        pZone->free(block, order);
+        accountFreed(1UL << order);
+        return;
+    }
+
+    // No page frame to track it with (e.g. early in boot).
     RecursingLockGuard<Spinlock> guard(m_Lock);
+    m_PageStack.free(block, getPageSize() << order);
+}
 
-    PageHashable index(page);
-    MetadataTable::LookupResult result = m_PageMetadata.lookup(index);
-    if (result.hasValue())
+void X86CommonPhysicalMemoryManager::freePagesToZones(
+    const physical_uintptr_t *pages, size_t count)
+{
+    size_t i = 0;
+    while (i < count)
     {
-        struct page p = result.value();
-        ++p.refcount;
-        p.active = true;
-        m_PageMetadata.update(index, p);
+        BuddyAllocator *pZone = zoneFor(pages[i]);
+        if (!pZone)
+        {
+            freeToZones(pages[i], 0);
+            ++i;
+            continue;
+        }
+
+        size_t run = 1;
+        while ((i + run) < count && zoneFor(pages[i + run]) == pZone)
+        {
+            ++run;
+        }
+
+        pZone->free(&pages[i], run);
+        accountFreed(run);
+
+        i += run;
     }
-    else
+}
+
+size_t X86CommonPhysicalMemoryManager::zoneFreePages() const
+{
+    return m_PageStack.freePages() + m_Zones[NormalZone].freePages() +
+           m_Zones[HighZone].freePages();
+}
+
+void X86CommonPhysicalMemoryManager::populateZones()
+{
+    // The zones merge the pages back into large blocks as they arrive.
+    physical_uintptr_t page;
+    while ((page = m_PageStack.allocate(0)))
     {
-        struct page p;
-        p.refcount = 1;
-        p.active = true;
-        m_PageMetadata.insert(index, p);
+        BuddyAllocator *pZone = zoneFor(page);
+        if (!pZone)
+        {
+            panic("PhysicalMemoryManager: free page has no page frame");
+        }
+
+        pZone->free(page, 0);
+        accountFreed(1);
     }
 }
+
+physical_uintptr_t X86CommonPhysicalMemoryManager::allocateBlock(
+    size_t order, size_t pageConstraints)
+{
+    if (!order)
+    {
+        return allocatePage(pageConstraints);
+    }
+
+    physical_uintptr_t result = allocateFromZones(order, pageConstraints);
+    if (result)
+    {
+        trackPages(0, 1L << order, 0);
+    }
+
+    return result;
+}
+
+void X86CommonPhysicalMemoryManager::freeBlock(
+    physical_uintptr_t block, size_t order)
+{
+    if (!order)
+    {
+        freePage(block);
+        return;
+    }
+
+    freeToZones(block, order);
+    trackPages(0, -(1L << order), 0);
+}
+
+void X86CommonPhysicalMemoryManager::fragmentationReport(String &report)
+{
+    static const char *zoneNames[ZoneCount] = {"DMA", "Normal", "High"};
+
+    for (size_t i = 0; i < ZoneCount; ++i)
+    {
+        String line;
+        line.Format("Node 0, zone %8s", zoneNames[i]);
+        report += line;
+
+        for (size_t order = 0; order <= BuddyAllocator::MaxOrder; ++order)
+        {
+            line.Format(" %6lu", m_Zones[i].freeBlocks(order));
+            report += line;
+        }
+
+        report += "\n";
+    }
+}
+
 bool X86CommonPhysicalMemoryManager::allocateRegion(
     MemoryRegion &Region, size_t cPages, size_t pageConstraints, size_t Flags,
     physical_uintptr_t start)
@@ -281,17 +849,15 @@ bool X86CommonPhysicalMemoryManager::allocateRegion(
             }
             else if (
                 start < 0x1000000 &&
-                (start + cPages * getPageSize()) < 0x1000000)
+                (start + cPages * getPageSize()) <= 0x1000000)
             {
-                if (m_RangeBelow16MB.allocateSpecific(
-                        start, cPages * getPageSize()) == false)
+                if (m_Zones[DmaZone].allocateSpecific(start, cPages) == false)
                 {
                     ERROR(
                         "PhysicalMemoryManager::allocateRegion() [specific] - "
                         "failed to get "
-                        << cPages
-                        << " pages of memory from <16MB range list at " << Hex
-                        << start);
+                        << cPages << " pages of memory from the DMA zone at "
+                        << Hex << start);
                     return false;
                 }
             }
@@ -353,12 +919,13 @@ bool X86CommonPhysicalMemoryManager::allocateRegion(
     }
     else
     {
-        // If we need continuous memory, switch to below16 if not already
+        // Continuous memory comes from the zones' buddy allocators. Keep it
+        // below 4GB unless told otherwise, as it's usually for DMA.
         if ((pageConstraints & continuous) == continuous)
             if ((pageConstraints & addressConstraints) != below1MB &&
                 (pageConstraints & addressConstraints) != below16MB)
                 pageConstraints =
-                    (pageConstraints & ~addressConstraints) | below16MB;
+                    (pageConstraints & ~addressConstraints) | below4GB;
 
         // Allocate the virtual address space
         uintptr_t vAddress;
@@ -377,7 +944,7 @@ bool X86CommonPhysicalMemoryManager::allocateRegion(
                 Processor::information().getVirtualAddressSpace();
 
             if ((pageConstraints & addressConstraints) == below1MB ||
-                (pageConstraints & addressConstraints) == below16MB)
+                (pageConstraints & continuous) == continuous)
             {
                 // Allocate a range
                 if ((pageConstraints & addressConstraints) == below1MB)
@@ -390,13 +957,28 @@ bool X86CommonPhysicalMemoryManager::allocateRegion(
                         return false;
                     }
                 }
-                else if ((pageConstraints & addressConstraints) == below16MB)
+                else
                 {
-                    if (m_RangeBelow16MB.allocate(
-                            cPages * getPageSize(), allocatedStart) == false)
+                    // Fall back to the DMA zone for any continuous allocation.
+                    if ((pageConstraints & addressConstraints) != below16MB)
+                    {
+                        allocatedStart =
+                            m_Zones[NormalZone].allocateRange(cPages);
+                        if (allocatedStart)
+                        {
+                            // Freed page by page in unmapRegion.
+                            accountAllocated(cPages);
+                        }
+                    }
+                    if (!allocatedStart)
+                    {
+                        allocatedStart = m_Zones[DmaZone].allocateRange(cPages);
+                    }
+                    if (!allocatedStart)
                     {
                         ERROR("PhysicalMemoryManager::allocateRegion() - "
-                              "failed to get space from <16MB range list");
+                              "failed to get " << Dec << cPages << Hex
+                              << " continuous pages");
                         return false;
                     }
                 }
@@ -421,8 +1003,8 @@ bool X86CommonPhysicalMemoryManager::allocateRegion(
                 // Map the physical memory into the allocated space
                 for (size_t i = 0; i < cPages; i++)
                 {
-                    physical_uintptr_t page = m_PageStack.allocate(
-                        pageConstraints & addressConstraints);
+                    physical_uintptr_t page = allocateFromZones(
+                        0, pageConstraints & addressConstraints);
                     if (virtualAddressSpace.map(
                             page,
                             reinterpret_cast<void *>(
@@ -456,14 +1038,13 @@ void X86CommonPhysicalMemoryManager::shutdown()
 {
     NOTICE("Shutting down X86CommonPhysicalMemoryManager");
     PhysicalMemoryManager::m_MemoryRegions.clear();
-    m_PageMetadata.clear();
+    drainPageCaches();
 }
 
 void X86CommonPhysicalMemoryManager::initialise(const BootstrapStruct_t &Info)
 {
     NOTICE("memory-map:");
 
-    physical_uintptr_t top = 0;
     size_t pageSize = getPageSize();
 
     // Fill the page-stack (usable memory above 16MB)
@@ -512,12 +1093,6 @@ void X86CommonPhysicalMemoryManager::initialise(const BootstrapStruct_t &Info)
             addr = 0x1000000;
         }
 
-        if (rangeTop >= top)
-        {
-            // Update the "top of memory" value.
-            top = rangeTop;
-        }
-
         // Prepare the page stack for the additional pages we're giving it.
         m_PageStack.increaseCapacity((length / pageSize) + 1);
 
@@ -527,8 +1102,29 @@ void X86CommonPhysicalMemoryManager::initialise(const BootstrapStruct_t &Info)
     // Stack with <4GB is done.
     m_PageStack.markBelow4GReady();
 
-    /// \todo do this in initialise64 too, copying any existing entries.
-    m_PageMetadata.reserve(top >> 12);  // number of 4k pages in this zone
+    // Page frames for all RAM below 4GB, now that there are pages to back
+    // the array with.
+    MemoryMap = Info.getMemoryMap();
+    while (MemoryMap)
+    {
+        uint64_t addr = Info.getMemoryMapEntryAddress(MemoryMap);
+        uint64_t length = Info.getMemoryMapEntryLength(MemoryMap);
+        uint32_t type = Info.getMemoryMapEntryType(MemoryMap);
+
+        MemoryMap = Info.nextMemoryMapEntry(MemoryMap);
+
+        if (type != 1 || addr >= 0x100000000ULL)
+        {
+            continue;
+        }
+
+        if ((addr + length) > 0x100000000ULL)
+        {
+            length = 0x100000000ULL - addr;
+        }
+
+        mapPageFrames(addr, length);
+    }
 
     // Fill the range-lists (usable memory below 1/16MB & ACPI)
     MemoryMap = Info.getMemoryMap();
@@ -556,7 +1152,8 @@ void X86CommonPhysicalMemoryManager::initialise(const BootstrapStruct_t &Info)
                 if (upperBound >= 0x1000000)
                     upperBound = 0x1000000;
 
-                m_RangeBelow16MB.free(addr, upperBound - addr);
+                m_Zones[DmaZone].freeRange(
+                    addr, (upperBound - addr) / getPageSize());
             }
         }
 #if defined(ACPI)
@@ -572,16 +1169,21 @@ void X86CommonPhysicalMemoryManager::initialise(const BootstrapStruct_t &Info)
     // Remove the pages used by the kernel from the range-list (below 16MB)
     extern void *kernel_start;
     extern void *kernel_end;
-    if (m_RangeBelow16MB.allocateSpecific(
+    if (m_Zones[DmaZone].allocateSpecific(
             reinterpret_cast<uintptr_t>(&kernel_start) -
                 reinterpret_cast<uintptr_t>(KERNEL_VIRTUAL_ADDRESS),
-            reinterpret_cast<uintptr_t>(&kernel_end) -
-                reinterpret_cast<uintptr_t>(&kernel_start)) == false)
+            (reinterpret_cast<uintptr_t>(&kernel_end) -
+             reinterpret_cast<uintptr_t>(&kernel_start) + getPageSize() - 1) /
+                getPageSize()) == false)
     {
         panic("PhysicalMemoryManager: could not remove the kernel image from "
-              "the range-list");
+              "the DMA zone");
     }
 
+    // All RAM now has page frames, so the zones can take over from the page
+    // stack.
+    populateZones();
+
 // Print the ranges
 #if defined(VERBOSE_MEMORY_MANAGER)
     NOTICE("free memory ranges (below 1MB):");
@@ -590,12 +1192,9 @@ void X86CommonPhysicalMemoryManager::initialise(const BootstrapStruct_t &Info)
             " " << Hex << m_RangeBelow1MB.getRange(i).address << " - "
                 << (m_RangeBelow1MB.getRange(i).address +
                     m_RangeBelow1MB.getRange(i).length));
-    NOTICE("free memory ranges (below 16MB):");
-    for (size_t i = 0; i < m_RangeBelow16MB.size(); i++)
-        NOTICE(
-            " " << Hex << m_RangeBelow16MB.getRange(i).address << " - "
-                << (m_RangeBelow16MB.getRange(i).address +
-                    m_RangeBelow16MB.getRange(i).length));
+    NOTICE(
+        "free pages in the DMA zone: " << Dec
+                                       << m_Zones[DmaZone].freePages() << Hex);
 #if defined(ACPI)
     NOTICE("ACPI ranges:");
     for (size_t i = 0; i < m_AcpiRanges.size(); i++)
@@ -680,11 +1279,13 @@ void X86CommonPhysicalMemoryManager::initialise64(const BootstrapStruct_t &Info)
             if (type == 1)
             {
                 size_t numPages = length / getPageSize();
-                m_PageStack.increaseCapacity(numPages);
-                m_PageStack.free(addr, length);
 
                 m_PhysicalRanges.free(addr, length);
 
+                mapPageFrames(addr, length);
+                m_Zones[HighZone].freeRange(addr, numPages);
+                accountFreed(numPages);
+
                 numPagesOver4G += numPages;
             }
         }
@@ -708,7 +1309,8 @@ void X86CommonPhysicalMemoryManager::initialise64(const BootstrapStruct_t &Info)
 
     NOTICE(" --> " << numPagesOver4G << " pages exist above 4G!");
 
-    // Stacks >=4GB are done.
+    // Memory >=4GB lives in the high zone, but the page stack still needs to
+    // know it won't be getting any.
     m_PageStack.markAbove4GReady();
 
 // Fill the range-lists (usable memory below 1/16MB & ACPI)
@@ -804,24 +1406,42 @@ void X86CommonPhysicalMemoryManager::initialisationDone()
     }
 
     // Free the physical pages
-    m_RangeBelow16MB.free(
+    m_Zones[DmaZone].freeRange(
         reinterpret_cast<uintptr_t>(&kernel_init) -
             reinterpret_cast<uintptr_t>(KERNEL_VIRTUAL_ADDRESS),
-        count * getPageSize());
+        count);
 
     NOTICE(
         "PhysicalMemoryManager: cleaned up " << Dec << (count * 4) << Hex
                                              << "KB of init-only code.");
+
+    startZeroingThreads();
 }
 
 X86CommonPhysicalMemoryManager::X86CommonPhysicalMemoryManager()
-    : m_PageStack(), m_RangeBelow1MB(), m_RangeBelow16MB(), m_PhysicalRanges(),
+    : m_PageStack(), m_RangeBelow1MB(), m_PhysicalRanges(),
 #if defined(ACPI)
       m_AcpiRanges(),
 #endif
       m_MemoryRegions(), m_Lock(false, true), m_RegionLock(false, true),
-      m_PageMetadata()
+      m_PageCaches(), m_PageCacheBackend(*this), m_ZeroedPools(),
+      m_ZeroBackend(*this), m_pZeroingWake(),
+      m_PageFrames(reinterpret_cast<PageFrame *>(KERNEL_VIRTUAL_PAGEFRAMES)),
+      m_PageFramesMapped(), m_PageFrameMap(*this), m_Zones()
 {
+    for (size_t i = 0; i < PageCacheCount; ++i)
+    {
+        m_PageCaches[i].setBackend(&m_PageCacheBackend);
+        m_ZeroedPools[i].setBackend(&m_ZeroBackend);
+    }
+
+    m_Zones[DmaZone].setup(&m_PageFrameMap, 0x100000, 0x1000000);
+#if defined(X64)
+    m_Zones[NormalZone].setup(&m_PageFrameMap, 0x1000000, 0x100000000ULL);
+    m_Zones[HighZone].setup(&m_PageFrameMap, 0x100000000ULL, ~0ULL);
+#else
+    m_Zones[NormalZone].setup(&m_PageFrameMap, 0x1000000, ~0UL);
+#endif
 }
 X86CommonPhysicalMemoryManager::~X86CommonPhysicalMemoryManager()
 {
@@ -859,9 +1479,9 @@ void X86CommonPhysicalMemoryManager::unmapRegion(MemoryRegion *pRegion)
                 }
                 else if (
                     phys < 0x1000000 &&
-                    (phys + cPages * getPageSize()) < 0x1000000)
+                    (phys + cPages * getPageSize()) <= 0x1000000)
                 {
-                    m_RangeBelow16MB.free(phys, cPages * getPageSize());
+                    m_Zones[DmaZone].freeRange(phys, cPages);
                 }
                 else if (phys < 0x1000000)
                 {
@@ -885,8 +1505,8 @@ void X86CommonPhysicalMemoryManager::unmapRegion(MemoryRegion *pRegion)
                 size_t flags;
                 virtualAddressSpace.getMapping(vAddr, pAddr, flags);
 
-                if (!pRegion->getNonRamMemory() && pAddr > 0x1000000)
-                    m_PageStack.free(pAddr, getPageSize());
+                if (!pRegion->getNonRamMemory() && pAddr >= 0x1000000)
+                    freeToZones(pAddr, 0);
 
                 virtualAddressSpace.unmap(vAddr);
             }
@@ -23,14 +23,19 @@
 #include "pedigree/kernel/Atomic.h"
 #include "pedigree/kernel/Spinlock.h"
 #include "pedigree/kernel/compiler.h"
+#include "pedigree/kernel/processor/PageFrame.h"
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/types.h"
-#include "pedigree/kernel/utilities/HashTable.h"
+#include "pedigree/kernel/utilities/BuddyAllocator.h"
+#include "pedigree/kernel/utilities/ExtensibleBitmap.h"
+#include "pedigree/kernel/utilities/FreePageCache.h"
 #include "pedigree/kernel/utilities/RangeList.h"
+#include "pedigree/kernel/utilities/ZeroedPagePool.h"
 #include "pedigree/kernel/utilities/utility.h"
 
 class BootstrapStruct_t;
 class MemoryRegion;
+class Semaphore;
 
 /** @addtogroup kernelprocessorx86common
  * @{ */
@@ -57,12 +62,20 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
     // PhysicalMemoryManager Interface
     //
     virtual physical_uintptr_t allocatePage(size_t pageConstraints = 0);
+    virtual physical_uintptr_t
+    allocateZeroedPage(size_t pageConstraints = 0);
     virtual void freePage(physical_uintptr_t page);
+    virtual size_t allocatePages(
+        size_t count, physical_uintptr_t *pages, size_t pageConstraints = 0);
+    virtual physical_uintptr_t
+    allocateBlock(size_t order, size_t pageConstraints = 0);
+    virtual void freeBlock(physical_uintptr_t block, size_t order);
     virtual bool allocateRegion(
         MemoryRegion &Region, size_t cPages, size_t pageConstraints,
         size_t Flags, physical_uintptr_t start = -1);
 
     virtual void pin(physical_uintptr_t page);
+    virtual PageFrame *pageFrame(physical_uintptr_t page);
 
     /** Initialise the page stack
      *\param[in] Info reference to the multiboot information structure */
@@ -91,6 +104,11 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
     /** Specifies the number of pages that remain free on the system. */
     virtual size_t freePageCount() const;
 
+    virtual size_t zeroedPageHits() const;
+    virtual size_t zeroedPageMisses() const;
+
+    virtual void fragmentationReport(String &report);
+
   protected:
     /** The constructor */
     X86CommonPhysicalMemoryManager() INITIALISATION_ONLY;
@@ -108,10 +126,111 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
 
     void unmapRegion(MemoryRegion *pRegion);
 
-    /** Same as freePage, but without the lock. Will panic if the lock is
-     * unlocked. \note Use in the wrong place and you die. */
+    /** Returns a page with no references left to its zone, bypassing the
+     * page caches. Will panic if the lock is unlocked. \note Use in the
+     * wrong place and you die. */
     virtual void freePageUnlocked(physical_uintptr_t page);
 
+    /** Drops a reference to a pinned page. Returns true if the page has no
+     *  references left and should be freed. */
+    bool unpin(physical_uintptr_t page);
+
+    /** Back the part of the page frame array covering the given physical
+     *  range with memory. Must be called with the page stack ready. */
+    void mapPageFrames(uint64_t base, uint64_t length) INITIALISATION_ONLY;
+
+    /** Move everything the page stack was given at boot into the zones. */
+    void populateZones() INITIALISATION_ONLY;
+
+    /** The zone a page belongs to, or null if it has no page frame. */
+    BuddyAllocator *zoneFor(physical_uintptr_t page);
+
+    /** Allocate a block from the zones that satisfy pageConstraints. Single
+     *  pages come from the page stack until the zones are populated. */
+    physical_uintptr_t
+    allocateFromZones(size_t order, size_t pageConstraints);
+
+    /** Allocate up to count unconstrained single pages. */
+    size_t allocatePagesFromZones(physical_uintptr_t *pages, size_t count);
+
+    /** Free a block back to its zone (or a page to the page stack, if it has
+     *  no page frame). */
+    void freeToZones(physical_uintptr_t block, size_t order);
+
+    /** Free count single pages, taking each zone's lock once per run. */
+    void freePagesToZones(const physical_uintptr_t *pages, size_t count);
+
+    /** Free pages in the page stack and general purpose zones. */
+    size_t zoneFreePages() const;
+
+    /** Relieve memory pressure if the free page count is below the high
+     *  watermark. Called with m_Lock held. */
+    void checkMemoryPressure();
+
+    /** The free page cache for the current processor, or null if the caches
+     *  can't be used yet. */
+    FreePageCache *pageCache();
+
+    /** Return every processor's cached and pre-zeroed pages to their
+     *  zones. */
+    void drainPageCaches();
+
+    /** The zeroed page pool for the current processor, or null if the pools
+     *  can't be used yet. */
+    ZeroedPagePool *zeroedPool();
+
+    /** Start a thread to keep each processor's zeroed page pool full. */
+    void startZeroingThreads();
+
+    /** Refills the zeroed page pool with the given index. */
+    static int zeroingThread(void *p);
+
+    /** Feeds the per-processor page caches from the zones. */
+    class ZoneBackend : public FreePageCache::Backend
+    {
+      public:
+        ZoneBackend(X86CommonPhysicalMemoryManager &pmm) : m_Pmm(pmm)
+        {
+        }
+
+        virtual size_t takePages(physical_uintptr_t *pages, size_t count);
+        virtual void returnPages(const physical_uintptr_t *pages, size_t count);
+
+      private:
+        X86CommonPhysicalMemoryManager &m_Pmm;
+    };
+
+    /** Feeds the zeroed page pools from the zones. */
+    class ZeroBackend : public ZeroedPagePool::Backend
+    {
+      public:
+        ZeroBackend(X86CommonPhysicalMemoryManager &pmm) : m_Pmm(pmm)
+        {
+        }
+
+        virtual size_t takePages(physical_uintptr_t *pages, size_t count);
+        virtual void returnPages(const physical_uintptr_t *pages, size_t count);
+        virtual void zeroPage(physical_uintptr_t page);
+
+      private:
+        X86CommonPhysicalMemoryManager &m_Pmm;
+    };
+
+    /** Gives the zones access to m_PageFrames. */
+    class PageFrameMap : public BuddyAllocator::FrameMap
+    {
+      public:
+        PageFrameMap(X86CommonPhysicalMemoryManager &pmm) : m_Pmm(pmm)
+        {
+        }
+
+        virtual PageFrame *frame(physical_uintptr_t page);
+        virtual physical_uintptr_t address(PageFrame *pFrame);
+
+      private:
+        X86CommonPhysicalMemoryManager &m_Pmm;
+    };
+
     /** The actual page stack contains is a Stack of the pages with the
      *constraints below4GB and below64GB and those pages without address size
      *constraints. \brief The Stack of pages (below4GB, below64GB, no
@@ -202,8 +321,6 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
 
     /** RangeList for the usable memory below 1MB */
     RangeList<uint32_t> m_RangeBelow1MB;
-    /** RangeList for the usable memory below 16MB */
-    RangeList<uint32_t> m_RangeBelow16MB;
 
     /** RangeList of free physical memory */
     RangeList<uint64_t> m_PhysicalRanges;
@@ -224,51 +341,51 @@ class X86CommonPhysicalMemoryManager : public PhysicalMemoryManager
     /** To guard against multiprocessor reentrancy. */
     Spinlock m_Lock, m_RegionLock;
 
-    /** Utility to wrap a physical address and hash it. */
-    class PageHashable
-    {
-      public:
-        PageHashable()
-        {
-            m_Hash = m_Page = 0;
-        }
+#ifdef MULTIPROCESSOR
+    /// \todo handle more than 64 CPUs (as for Spinlock).
+    static const size_t PageCacheCount = 64;
+#else
+    static const size_t PageCacheCount = 1;
+#endif
 
-        PageHashable(physical_uintptr_t p)
-        {
-            m_Hash = p / getPageSize();
-            m_Page = p;
-        }
+    /** Free pages cached per processor, in front of the page stack. */
+    FreePageCache m_PageCaches[PageCacheCount];
 
-        size_t hash() const
-        {
-            return m_Hash;
-        }
+    ZoneBackend m_PageCacheBackend;
 
-        bool operator==(const PageHashable &p) const
-        {
-            return p.m_Page == m_Page;
-        }
+    /** Pages zeroed ahead of time per processor, for allocateZeroedPage(). */
+    ZeroedPagePool m_ZeroedPools[PageCacheCount];
 
-      private:
-        size_t m_Hash;
-        physical_uintptr_t m_Page;
-    };
+    ZeroBackend m_ZeroBackend;
 
-    /** Physical page metadata. */
-    struct page
-    {
-        page() : active(false), refcount(0)
-        {
-        }
+    /** Wakes each pool's zeroing thread when the pool runs low. */
+    Semaphore *m_pZeroingWake[PageCacheCount];
 
-        bool active;
-        size_t refcount;
-    };
+    /** Page frame metadata, indexed by page frame number. Only the parts
+     *  covering RAM are mapped. */
+    PageFrame *m_PageFrames;
 
-    typedef HashTable<PageHashable, struct page> MetadataTable;
+    /** Which pages of m_PageFrames are mapped. */
+    ExtensibleBitmap m_PageFramesMapped;
+
+    PageFrameMap m_PageFrameMap;
+
+    /** Physical memory zones. */
+    enum Zone
+    {
+        /** 1 MB to 16 MB, for ISA DMA and continuous allocations. */
+        DmaZone = 0,
+        /** 16 MB to 4 GB. */
+        NormalZone,
+        /** Everything above 4 GB. */
+        HighZone,
+        ZoneCount
+    };
 
-    /** Page metadata table */
-    HashTable<PageHashable, struct page> m_PageMetadata;
+    /** Buddy allocators for each zone. Own all free memory once the page
+     *  frame array is ready; the page stack only serves allocations before
+     *  then. */
+    BuddyAllocator m_Zones[ZoneCount];
 };
 
 /** @} */
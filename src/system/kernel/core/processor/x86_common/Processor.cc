@@ -210,6 +210,25 @@ void Processor::invalidate(void *pAddress)
     asm volatile("invlpg (%0)" ::"a"(pAddress));
 }
 
+void Processor::invalidateAll(bool bGlobal)
+{
+    uintptr_t cr4;
+    asm volatile("mov %%cr4, %0" : "=r"(cr4));
+
+    // Toggling PGE flushes everything, global pages and all PCIDs included.
+    if (bGlobal && (cr4 & (1 << 7)))
+    {
+        asm volatile("mov %0, %%cr4" ::"r"(cr4 & ~(1 << 7)) : "memory");
+        asm volatile("mov %0, %%cr4" ::"r"(cr4) : "memory");
+        return;
+    }
+
+    // Reloading CR3 flushes the non-global entries (of the current PCID).
+    uintptr_t cr3;
+    asm volatile("mov %%cr3, %0" : "=r"(cr3));
+    asm volatile("mov %0, %%cr3" ::"r"(cr3) : "memory");
+}
+
 void Processor::cpuid(
     uint32_t inEax, uint32_t inEcx, uint32_t &eax, uint32_t &ebx, uint32_t &ecx,
     uint32_t &edx)
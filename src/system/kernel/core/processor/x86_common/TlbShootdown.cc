@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/processor/TlbShootdown.h"
+#include "pedigree/kernel/Atomic.h"
+#include "pedigree/kernel/processor/PhysicalMemoryManager.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/processor/VirtualAddressSpace.h"
+#include "pedigree/kernel/utilities/assert.h"
+
+#if defined(MULTIPROCESSOR)
+#include <machine/mach_pc/LocalApic.h>
+#include <machine/mach_pc/Pc.h>
+#endif
+
+static Atomic<size_t> s_InterruptsSent(0);
+static Atomic<size_t> s_FullFlushes(0);
+
+#if defined(MULTIPROCESSOR)
+/// Processors able to take shootdown IPIs.
+static Atomic<uint64_t> s_Online(0);
+
+/// Only one shootdown is in flight at a time; its details are below.
+static Atomic<bool> s_Busy(false);
+/// Processors yet to handle the shootdown in flight.
+static Atomic<uint64_t> s_Pending(0);
+static VirtualAddressSpace *s_pAddressSpace = 0;
+static const uintptr_t *s_pPages = 0;
+static size_t s_nPages = 0;
+static bool s_bFlushAll = false;
+static bool s_bKernel = false;
+#endif
+
+#if defined(MULTIPROCESSOR)
+/// This processor's bit in the processor masks.
+static uint64_t processorBit(ProcessorId id)
+{
+    // Multiprocessor::initialise1() does not start processors beyond this.
+    assert(id < TlbShootdown::MaxProcessors);
+    return 1ULL << id;
+}
+#endif
+
+static void invalidateLocal(
+    const uintptr_t *pages, size_t nPages, bool bFlushAll, bool bKernel)
+{
+    if (bFlushAll)
+    {
+        // Kernel mappings are global, and only go if global pages are flushed
+        // too.
+        Processor::invalidateAll(bKernel);
+        return;
+    }
+
+    for (size_t i = 0; i < nPages; ++i)
+    {
+        Processor::invalidate(reinterpret_cast<void *>(pages[i]));
+    }
+}
+
+TlbShootdown::TlbShootdown(VirtualAddressSpace &addressSpace)
+    : m_AddressSpace(addressSpace), m_Pages(), m_nPages(0), m_FreePages(),
+      m_nFreePages(0), m_bFlushAll(false), m_bKernel(false),
+      m_bTablesFreed(false)
+{
+}
+
+TlbShootdown::~TlbShootdown()
+{
+    flush();
+}
+
+void TlbShootdown::add(void *virtualAddress)
+{
+    if (virtualAddress >=
+        reinterpret_cast<void *>(m_AddressSpace.getKernelStart()))
+        m_bKernel = true;
+
+    if (m_bFlushAll)
+        return;
+
+    if (m_nPages == MaxPages)
+    {
+        m_bFlushAll = true;
+        return;
+    }
+
+    m_Pages[m_nPages++] = reinterpret_cast<uintptr_t>(virtualAddress);
+}
+
+void TlbShootdown::addAll()
+{
+    m_bFlushAll = true;
+}
+
+void TlbShootdown::free(physical_uintptr_t page)
+{
+    if (m_nFreePages == MaxFreePages)
+        flush();
+
+    m_FreePages[m_nFreePages++] = page;
+}
+
+void TlbShootdown::freeTable(physical_uintptr_t page)
+{
+    free(page);
+    m_bTablesFreed = true;
+}
+
+void TlbShootdown::flush()
+{
+    if (!m_nPages && !m_bFlushAll)
+    {
+        // Nothing was invalidated, so nothing can still reach these pages.
+        for (size_t i = 0; i < m_nFreePages; ++i)
+            PhysicalMemoryManager::instance().freePage(m_FreePages[i]);
+        m_nFreePages = 0;
+        return;
+    }
+
+    // Kernel paging structures can be cached under any PCID, and invlpg only
+    // drops those of the current one. Flushing global pages flushes them all.
+    if (m_bKernel && m_bTablesFreed)
+        m_bFlushAll = true;
+
+    if (m_bFlushAll)
+        s_FullFlushes += 1;
+
+    {
+        // Stay on this processor until every TLB is clean.
+        EnsureInterrupts ensure(false);
+
+        VirtualAddressSpace *pCurrent =
+            &Processor::information().getVirtualAddressSpace();
+        bool bLocal = m_bKernel || (pCurrent == &m_AddressSpace);
+        if (bLocal)
+            invalidateLocal(m_Pages, m_nPages, m_bFlushAll, m_bKernel);
+
+        // Processors that switch to the address space later, this one
+        // included if it was not flushed above, must not keep entries they
+        // held on to from before.
+        if (!m_bKernel)
+            m_AddressSpace.markStale(
+                bLocal ? ~(1ULL << Processor::id()) : ~0ULL);
+
+#if defined(MULTIPROCESSOR)
+        if (Processor::m_Initialised == 2 && Processor::getCount() > 1)
+        {
+            uint64_t self = processorBit(Processor::id());
+
+            uint64_t targets;
+            if (m_bKernel)
+            {
+                // Kernel mappings are shared by every address space.
+                targets = s_Online;
+            }
+            else
+            {
+                targets = m_AddressSpace.getActiveProcessors() & s_Online;
+            }
+            targets &= ~self;
+
+            if (targets)
+            {
+                while (!s_Busy.compareAndSwap(false, true))
+                {
+                    // Whoever holds it may be waiting on us.
+                    poll();
+                    Processor::pause();
+                }
+
+                s_pAddressSpace = &m_AddressSpace;
+                s_pPages = m_Pages;
+                s_nPages = m_nPages;
+                s_bFlushAll = m_bFlushAll;
+                s_bKernel = m_bKernel;
+                s_Pending |= targets;
+
+                for (size_t i = 0; i < Processor::m_ProcessorInformation.count();
+                     ++i)
+                {
+                    ProcessorInformation *pInfo =
+                        Processor::m_ProcessorInformation[i];
+                    if (!(targets & processorBit(pInfo->m_ProcessorId)))
+                        continue;
+
+                    Pc::instance().getLocalApic().interProcessorInterrupt(
+                        pInfo->m_LocalApicId, IPI_TLB_SHOOTDOWN_VECTOR,
+                        LocalApic::deliveryModeFixed, true, false);
+                    s_InterruptsSent += 1;
+                }
+
+                while (s_Pending)
+                    Processor::pause();
+
+                s_Busy = false;
+            }
+        }
+#endif
+    }
+
+    m_nPages = 0;
+    m_bFlushAll = false;
+    m_bKernel = false;
+    m_bTablesFreed = false;
+
+    for (size_t i = 0; i < m_nFreePages; ++i)
+        PhysicalMemoryManager::instance().freePage(m_FreePages[i]);
+    m_nFreePages = 0;
+}
+
+void TlbShootdown::poll()
+{
+#if defined(MULTIPROCESSOR)
+    if (!s_Pending || Processor::m_Initialised != 2)
+        return;
+
+    uint64_t self = processorBit(Processor::id());
+    if (!(s_Pending & self))
+        return;
+
+    // Another processor's address space only needs flushing when it is next
+    // switched to, which the sender has already arranged.
+    if (s_bKernel ||
+        (&Processor::information().getVirtualAddressSpace() == s_pAddressSpace))
+        invalidateLocal(s_pPages, s_nPages, s_bFlushAll, s_bKernel);
+
+    s_Pending &= ~self;
+#endif
+}
+
+void TlbShootdown::processorOnline()
+{
+#if defined(MULTIPROCESSOR)
+    s_Online |= processorBit(Processor::id());
+#endif
+}
+
+size_t TlbShootdown::interruptsSent()
+{
+    return s_InterruptsSent;
+}
+
+size_t TlbShootdown::fullFlushes()
+{
+    return s_FullFlushes;
+}
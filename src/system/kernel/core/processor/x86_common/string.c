@@ -16,12 +16,771 @@
  * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
-
 #include "pedigree/kernel/processor/types.h"
 #include "pedigree/kernel/utilities/utility.h"
 
+#if defined(X64)
+#include "../x64/KernelHeap.h"
+#elif defined(X86)
+#include "../x86/KernelHeap.h"
+#endif
+
 #ifdef TARGET_IS_X86
 
-// rep scasb/rep cmpsb are not faster than byte-by-byte ops
+/*
+ * x86 memory and string primitives.
+ *
+ * rep scasb/rep cmpsb are not faster than byte-by-byte ops, but SSE2 compares
+ * are, and SSE2/AVX2 moves beat rep movsb/stosb until copies get into the
+ * kilobytes (where ERMS processors take over again). The paths are picked
+ * from CPUID once, by InitialiseMemoryFunctions().
+ *
+ * The kernel is built with -mno-sse, so GCC neither uses the vector registers
+ * itself nor lets inline assembly clobber them. Every vector block therefore
+ * saves and restores the registers it touches. In the kernel those registers
+ * may also belong to the current thread under the lazy FPU switching done by
+ * NMFaultHandler, so vectors are only used when CR0.TS is clear (the thread
+ * already owns the FPU; we never take #NM just to copy memory), and with
+ * interrupts off so a context switch can't happen mid-block. Code that runs
+ * with interrupts off must not fault, so the kernel only vectorises accesses
+ * to the kernel heap, which is never paged out or demand-mapped (see
+ * VirtualAddressSpace::memIsInKernelHeap). User buffers, mappings and caches
+ * use the string instructions or scalar loops instead. Each block also covers
+ * at most VECTOR_CHUNK bytes, so IPIs such as TLB shootdowns wait for at most
+ * one chunk. The kernel never enables XSAVE, so it stays on SSE2; AVX2 is for
+ * hosted/userspace builds.
+ */
+
+#define CPUID_1_ECX_OSXSAVE (1 << 27)
+#define CPUID_1_ECX_AVX (1 << 28)
+#define CPUID_1_EDX_SSE2 (1 << 26)
+#define CPUID_7_EBX_AVX2 (1 << 5)
+#define CPUID_7_EBX_ERMS (1 << 9)
+
+#define XCR0_SSE_AVX 0x6
+
+#define CR0_EM (1 << 2)
+#define CR0_TS (1 << 3)
+#define CR4_OSFXSR (1 << 9)
+
+#define MEMORY_FEATURE_SSE2 (1 << 0)
+#define MEMORY_FEATURE_AVX2 (1 << 1)
+#define MEMORY_FEATURE_ERMS (1 << 2)
+
+// Sizes above which rep movsb/stosb beats the vector loops on ERMS
+// processors. The AVX2 loops hold out for longer than the SSE2 ones.
+#define SSE_REP_THRESHOLD 1024
+#define AVX_REP_THRESHOLD 4096
+
+#ifdef X86_COMMON
+// Entering a vector block costs a couple of control register reads and an
+// interrupt flag round trip, so small kernel copies stay on rep movsb.
+#define VECTOR_THRESHOLD 256
+#define VECTOR_CHUNK 4096
+#define VECTOR_ENTER "pushf; cli;"
+#define VECTOR_LEAVE "popf;"
+#else
+#define VECTOR_THRESHOLD 64
+#define VECTOR_CHUNK (~(size_t) 0)
+#define VECTOR_ENTER ""
+#define VECTOR_LEAVE ""
+#endif
+
+#define SAVE_XMM0_1                \
+    "movdqu %%xmm0, 0(%[save]);"   \
+    "movdqu %%xmm1, 16(%[save]);"
+#define SAVE_XMM2_3                \
+    "movdqu %%xmm2, 32(%[save]);"  \
+    "movdqu %%xmm3, 48(%[save]);"
+#define RESTORE_XMM0_1             \
+    "movdqu 0(%[save]), %%xmm0;"   \
+    "movdqu 16(%[save]), %%xmm1;"
+#define RESTORE_XMM2_3             \
+    "movdqu 32(%[save]), %%xmm2;"  \
+    "movdqu 48(%[save]), %%xmm3;"
+
+/// MEMORY_FEATURE_* flags for the running processor.
+static int g_MemoryFeatures = 0;
+
+typedef unsigned char xmm_save_t[64];
+
+void *memcpy_x86(void *restrict s1, const void *restrict s2, size_t n);
+void *memset_x86(void *buf, int c, size_t n);
+void *memmove_backward_x86(void *s1, const void *s2, size_t n);
+int memcmp_x86(const void *p1, const void *p2, size_t n);
+void *memchr_x86(const void *buf, int c, size_t n);
+size_t strlen_x86(const char *s);
+char *strchr_x86(const char *s, int c);
+
+static inline void cpuid(
+    uint32_t leaf, uint32_t subleaf, uint32_t *eax, uint32_t *ebx,
+    uint32_t *ecx, uint32_t *edx)
+{
+    __asm__ __volatile__("cpuid"
+                         : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                         : "a"(leaf), "c"(subleaf));
+}
+
+void InitialiseMemoryFunctions(void)
+{
+    uint32_t eax, ebx, ecx, edx;
+    int features = 0;
+
+    cpuid(0, 0, &eax, &ebx, &ecx, &edx);
+    uint32_t maxLeaf = eax;
+
+    cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+    if (edx & CPUID_1_EDX_SSE2)
+    {
+        features |= MEMORY_FEATURE_SSE2;
+    }
+
+#ifndef X86_COMMON
+    int avx = 0;
+    if ((ecx & CPUID_1_ECX_OSXSAVE) && (ecx & CPUID_1_ECX_AVX))
+    {
+        // The OS must also have enabled the AVX state in XCR0.
+        uint32_t xcr0_lo, xcr0_hi;
+        __asm__ __volatile__("xgetbv"
+                             : "=a"(xcr0_lo), "=d"(xcr0_hi)
+                             : "c"(0));
+        avx = (xcr0_lo & XCR0_SSE_AVX) == XCR0_SSE_AVX;
+    }
+#endif
+
+    if (maxLeaf >= 7)
+    {
+        cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+        if (ebx & CPUID_7_EBX_ERMS)
+        {
+            features |= MEMORY_FEATURE_ERMS;
+        }
+#ifndef X86_COMMON
+        if (avx && (ebx & CPUID_7_EBX_AVX2))
+        {
+            features |= MEMORY_FEATURE_AVX2;
+        }
+#endif
+    }
+
+    g_MemoryFeatures = features;
+}
+
+#ifdef UTILITY_LINUX
+static void __attribute__((constructor)) initialiseMemoryFunctionsUtility(void)
+{
+    InitialiseMemoryFunctions();
+}
+#endif
+
+/// Whether the SSE2 paths may be used right now.
+static inline int sseUsable(void)
+{
+    if (!(g_MemoryFeatures & MEMORY_FEATURE_SSE2))
+    {
+        return 0;
+    }
+
+#ifdef X86_COMMON
+    uintptr_t cr0, cr4;
+    __asm__ __volatile__("mov %%cr0, %0" : "=r"(cr0));
+    if (cr0 & (CR0_TS | CR0_EM))
+    {
+        return 0;
+    }
+
+    // Application processors start with TS clear, but can't run SSE until
+    // NMFaultHandler has set them up.
+    __asm__ __volatile__("mov %%cr4, %0" : "=r"(cr4));
+    if (!(cr4 & CR4_OSFXSR))
+    {
+        return 0;
+    }
+#endif
+
+    return 1;
+}
+
+/// Whether [p, p + n) may be accessed from a vector block.
+static inline int vectorMemory(const void *p, size_t n)
+{
+#ifdef X86_COMMON
+    uintptr_t start = (uintptr_t) p;
+    return start >= KERNEL_HEAP_START && start < KERNEL_HEAP_END &&
+           n <= KERNEL_HEAP_END - start;
+#else
+    return 1;
+#endif
+}
+
+static inline int avxUsable(void)
+{
+    return (g_MemoryFeatures & MEMORY_FEATURE_AVX2) != 0;
+}
+
+static inline int fastStrings(void)
+{
+    return (g_MemoryFeatures & MEMORY_FEATURE_ERMS) != 0;
+}
+
+static inline uint64_t load64(const void *p)
+{
+    uint64_t v;
+    __builtin_memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store64(void *p, uint64_t v)
+{
+    __builtin_memcpy(p, &v, sizeof(v));
+}
+
+static inline void *repMovsb(void *s1, const void *s2, size_t n)
+{
+    int a, b, c;
+    __asm__ __volatile__("rep movsb"
+                         : "=&c"(a), "=&D"(b), "=&S"(c)
+                         : "1"(s1), "2"(s2), "0"(n)
+                         : "memory");
+    return s1;
+}
+
+static inline void *repStosb(void *buf, int c, size_t n)
+{
+    int a, b;
+    __asm__ __volatile__("rep stosb"
+                         : "=&D"(a), "=&c"(b)
+                         : "0"(buf), "a"(c), "1"(n)
+                         : "memory");
+    return buf;
+}
+
+/// Copies forwards in 64-byte and then 16-byte blocks. Each block is loaded
+/// before it is stored, so this is also safe for overlapping copies where the
+/// destination is below the source. Returns the number of bytes left over.
+static size_t copyForwardSse(
+    unsigned char **pd, const unsigned char **ps, size_t n)
+{
+    xmm_save_t save;
+    unsigned char *d = *pd;
+    const unsigned char *s = *ps;
+    size_t rest = n;
+
+    while (rest >= 16)
+    {
+        n = rest > VECTOR_CHUNK ? VECTOR_CHUNK : rest;
+        rest -= n;
+        __asm__ __volatile__(VECTOR_ENTER SAVE_XMM0_1 SAVE_XMM2_3
+                             "1:\n"
+                             "cmp $64, %[n];"
+                             "jb 2f;"
+                             "movdqu 0(%[s]), %%xmm0;"
+                             "movdqu 16(%[s]), %%xmm1;"
+                             "movdqu 32(%[s]), %%xmm2;"
+                             "movdqu 48(%[s]), %%xmm3;"
+                             "movdqu %%xmm0, 0(%[d]);"
+                             "movdqu %%xmm1, 16(%[d]);"
+                             "movdqu %%xmm2, 32(%[d]);"
+                             "movdqu %%xmm3, 48(%[d]);"
+                             "add $64, %[s];"
+                             "add $64, %[d];"
+                             "sub $64, %[n];"
+                             "jmp 1b;"
+                             "2:\n"
+                             "cmp $16, %[n];"
+                             "jb 3f;"
+                             "movdqu 0(%[s]), %%xmm0;"
+                             "movdqu %%xmm0, 0(%[d]);"
+                             "add $16, %[s];"
+                             "add $16, %[d];"
+                             "sub $16, %[n];"
+                             "jmp 2b;"
+                             "3:\n" RESTORE_XMM0_1 RESTORE_XMM2_3 VECTOR_LEAVE
+                             : [d] "+r"(d), [s] "+r"(s), [n] "+r"(n)
+                             : [save] "r"(save)
+                             : "memory", "cc");
+        rest += n;
+    }
+
+    *pd = d;
+    *ps = s;
+    return rest;
+}
+
+#ifndef X86_COMMON
+static size_t copyForwardAvx(
+    unsigned char **pd, const unsigned char **ps, size_t n)
+{
+    unsigned char *d = *pd;
+    const unsigned char *s = *ps;
+
+    __asm__ __volatile__("1:\n"
+                         "cmp $128, %[n];"
+                         "jb 2f;"
+                         "vmovdqu 0(%[s]), %%ymm0;"
+                         "vmovdqu 32(%[s]), %%ymm1;"
+                         "vmovdqu 64(%[s]), %%ymm2;"
+                         "vmovdqu 96(%[s]), %%ymm3;"
+                         "vmovdqu %%ymm0, 0(%[d]);"
+                         "vmovdqu %%ymm1, 32(%[d]);"
+                         "vmovdqu %%ymm2, 64(%[d]);"
+                         "vmovdqu %%ymm3, 96(%[d]);"
+                         "add $128, %[s];"
+                         "add $128, %[d];"
+                         "sub $128, %[n];"
+                         "jmp 1b;"
+                         "2:\n"
+                         "cmp $32, %[n];"
+                         "jb 3f;"
+                         "vmovdqu 0(%[s]), %%ymm0;"
+                         "vmovdqu %%ymm0, 0(%[d]);"
+                         "add $32, %[s];"
+                         "add $32, %[d];"
+                         "sub $32, %[n];"
+                         "jmp 2b;"
+                         "3:\n"
+                         "vzeroupper;"
+                         : [d] "+r"(d), [s] "+r"(s), [n] "+r"(n)
+                         :
+                         : "memory", "cc", "xmm0", "xmm1", "xmm2", "xmm3");
+
+    *pd = d;
+    *ps = s;
+    return n;
+}
+#endif
+
+static size_t setForwardSse(unsigned char **pd, uint32_t pattern, size_t n)
+{
+    xmm_save_t save;
+    unsigned char *d = *pd;
+    size_t rest = n;
+
+    while (rest >= 16)
+    {
+        n = rest > VECTOR_CHUNK ? VECTOR_CHUNK : rest;
+        rest -= n;
+        __asm__ __volatile__(VECTOR_ENTER SAVE_XMM0_1
+                             "movd %[pattern], %%xmm0;"
+                             "pshufd $0, %%xmm0, %%xmm0;"
+                             "1:\n"
+                             "cmp $64, %[n];"
+                             "jb 2f;"
+                             "movdqu %%xmm0, 0(%[d]);"
+                             "movdqu %%xmm0, 16(%[d]);"
+                             "movdqu %%xmm0, 32(%[d]);"
+                             "movdqu %%xmm0, 48(%[d]);"
+                             "add $64, %[d];"
+                             "sub $64, %[n];"
+                             "jmp 1b;"
+                             "2:\n"
+                             "cmp $16, %[n];"
+                             "jb 3f;"
+                             "movdqu %%xmm0, 0(%[d]);"
+                             "add $16, %[d];"
+                             "sub $16, %[n];"
+                             "jmp 2b;"
+                             "3:\n" RESTORE_XMM0_1 VECTOR_LEAVE
+                             : [d] "+r"(d), [n] "+r"(n)
+                             : [pattern] "r"(pattern), [save] "r"(save)
+                             : "memory", "cc");
+        rest += n;
+    }
+
+    *pd = d;
+    return rest;
+}
+
+#ifndef X86_COMMON
+static size_t setForwardAvx(unsigned char **pd, uint32_t pattern, size_t n)
+{
+    unsigned char *d = *pd;
+
+    __asm__ __volatile__("vmovd %[pattern], %%xmm0;"
+                         "vpbroadcastd %%xmm0, %%ymm0;"
+                         "1:\n"
+                         "cmp $128, %[n];"
+                         "jb 2f;"
+                         "vmovdqu %%ymm0, 0(%[d]);"
+                         "vmovdqu %%ymm0, 32(%[d]);"
+                         "vmovdqu %%ymm0, 64(%[d]);"
+                         "vmovdqu %%ymm0, 96(%[d]);"
+                         "add $128, %[d];"
+                         "sub $128, %[n];"
+                         "jmp 1b;"
+                         "2:\n"
+                         "cmp $32, %[n];"
+                         "jb 3f;"
+                         "vmovdqu %%ymm0, 0(%[d]);"
+                         "add $32, %[d];"
+                         "sub $32, %[n];"
+                         "jmp 2b;"
+                         "3:\n"
+                         "vzeroupper;"
+                         : [d] "+r"(d), [n] "+r"(n)
+                         : [pattern] "r"(pattern)
+                         : "memory", "cc", "xmm0");
+
+    *pd = d;
+    return n;
+}
+#endif
+
+/// Picks the vector width (in bytes) to copy or set n bytes with, or 0 if the
+/// string instructions should do it.
+static inline int vectorWidth(size_t n)
+{
+    int rep = fastStrings();
+    if (avxUsable())
+    {
+        return (rep && n >= AVX_REP_THRESHOLD) ? 0 : 32;
+    }
+    else if (n < VECTOR_THRESHOLD || (rep && n >= SSE_REP_THRESHOLD))
+    {
+        return 0;
+    }
+
+    return sseUsable() ? 16 : 0;
+}
+
+void *memcpy_x86(void *restrict s1, const void *restrict s2, size_t n)
+{
+    unsigned char *d = (unsigned char *) s1;
+    const unsigned char *s = (const unsigned char *) s2;
+    int width =
+        (vectorMemory(s1, n) && vectorMemory(s2, n)) ? vectorWidth(n) : 0;
+
+    switch (width)
+    {
+#ifndef X86_COMMON
+        case 32:
+            n = copyForwardAvx(&d, &s, n);
+            break;
+#endif
+        case 16:
+            n = copyForwardSse(&d, &s, n);
+            break;
+        default:
+            return repMovsb(s1, s2, n);
+    }
+
+    while (n >= 8)
+    {
+        store64(d, load64(s));
+        d += 8;
+        s += 8;
+        n -= 8;
+    }
+    while (n--)
+    {
+        *d++ = *s++;
+    }
+
+    return s1;
+}
+
+void *memset_x86(void *buf, int c, size_t n)
+{
+    unsigned char *d = (unsigned char *) buf;
+    uint32_t pattern = ((unsigned char) c) * 0x01010101U;
+
+    switch (vectorMemory(buf, n) ? vectorWidth(n) : 0)
+    {
+#ifndef X86_COMMON
+        case 32:
+            n = setForwardAvx(&d, pattern, n);
+            break;
+#endif
+        case 16:
+            n = setForwardSse(&d, pattern, n);
+            break;
+        default:
+            return repStosb(buf, c, n);
+    }
+
+    uint64_t pattern64 = pattern | ((uint64_t) pattern << 32);
+    while (n >= 8)
+    {
+        store64(d, pattern64);
+        d += 8;
+        n -= 8;
+    }
+    while (n--)
+    {
+        *d++ = c;
+    }
+
+    return buf;
+}
+
+void *memmove_backward_x86(void *s1, const void *s2, size_t n)
+{
+    // Work down from the end; each block is loaded before it is stored, so
+    // the part of the source not yet copied is never overwritten. (This used
+    // to be "std; rep movsb", but fast strings only apply going forwards.)
+    unsigned char *d = (unsigned char *) s1 + n;
+    const unsigned char *s = (const unsigned char *) s2 + n;
+
+    if (n >= VECTOR_THRESHOLD && vectorMemory(s1, n) && vectorMemory(s2, n) &&
+        sseUsable())
+    {
+        xmm_save_t save;
+        size_t rest = n;
+        while (rest >= 16)
+        {
+            n = rest > VECTOR_CHUNK ? VECTOR_CHUNK : rest;
+            rest -= n;
+            __asm__ __volatile__(VECTOR_ENTER SAVE_XMM0_1 SAVE_XMM2_3
+                                 "1:\n"
+                                 "cmp $64, %[n];"
+                                 "jb 2f;"
+                                 "sub $64, %[s];"
+                                 "sub $64, %[d];"
+                                 "movdqu 48(%[s]), %%xmm3;"
+                                 "movdqu 32(%[s]), %%xmm2;"
+                                 "movdqu 16(%[s]), %%xmm1;"
+                                 "movdqu 0(%[s]), %%xmm0;"
+                                 "movdqu %%xmm3, 48(%[d]);"
+                                 "movdqu %%xmm2, 32(%[d]);"
+                                 "movdqu %%xmm1, 16(%[d]);"
+                                 "movdqu %%xmm0, 0(%[d]);"
+                                 "sub $64, %[n];"
+                                 "jmp 1b;"
+                                 "2:\n"
+                                 "cmp $16, %[n];"
+                                 "jb 3f;"
+                                 "sub $16, %[s];"
+                                 "sub $16, %[d];"
+                                 "movdqu 0(%[s]), %%xmm0;"
+                                 "movdqu %%xmm0, 0(%[d]);"
+                                 "sub $16, %[n];"
+                                 "jmp 2b;"
+                                 "3:\n" RESTORE_XMM0_1 RESTORE_XMM2_3
+                                     VECTOR_LEAVE
+                                 : [d] "+r"(d), [s] "+r"(s), [n] "+r"(n)
+                                 : [save] "r"(save)
+                                 : "memory", "cc");
+            rest += n;
+        }
+        n = rest;
+    }
+
+    while (n >= 8)
+    {
+        d -= 8;
+        s -= 8;
+        store64(d, load64(s));
+        n -= 8;
+    }
+    while (n--)
+    {
+        *--d = *--s;
+    }
+
+    return s1;
+}
+
+int memcmp_x86(const void *p1, const void *p2, size_t n)
+{
+    const unsigned char *a = (const unsigned char *) p1;
+    const unsigned char *b = (const unsigned char *) p2;
+
+    if (n >= VECTOR_THRESHOLD && vectorMemory(p1, n) && vectorMemory(p2, n) &&
+        sseUsable())
+    {
+        // Skip over the equal prefix 16 bytes at a time; the remainder (and
+        // the first differing block) is finished off below.
+        xmm_save_t save;
+        unsigned int mask;
+        size_t rest = n;
+        while (rest >= 16)
+        {
+            n = rest > VECTOR_CHUNK ? VECTOR_CHUNK : rest;
+            rest -= n;
+            __asm__ __volatile__(VECTOR_ENTER SAVE_XMM0_1
+                                 "1:\n"
+                                 "cmp $16, %[n];"
+                                 "jb 2f;"
+                                 "movdqu 0(%[a]), %%xmm0;"
+                                 "movdqu 0(%[b]), %%xmm1;"
+                                 "pcmpeqb %%xmm1, %%xmm0;"
+                                 "pmovmskb %%xmm0, %[mask];"
+                                 "cmp $0xFFFF, %[mask];"
+                                 "jne 2f;"
+                                 "add $16, %[a];"
+                                 "add $16, %[b];"
+                                 "sub $16, %[n];"
+                                 "jmp 1b;"
+                                 "2:\n" RESTORE_XMM0_1 VECTOR_LEAVE
+                                 : [a] "+r"(a), [b] "+r"(b), [n] "+r"(n),
+                                   [mask] "=&r"(mask)
+                                 : [save] "r"(save)
+                                 : "memory", "cc");
+            rest += n;
+            if (n >= 16)
+            {
+                break;
+            }
+        }
+        n = rest;
+    }
+
+    while (n >= 8 && load64(a) == load64(b))
+    {
+        a += 8;
+        b += 8;
+        n -= 8;
+    }
+
+    for (; n; --n, ++a, ++b)
+    {
+        if (*a != *b)
+        {
+            return *a - *b;
+        }
+    }
+
+    return 0;
+}
+
+// Intentionally casting away const in the search functions, don't warn
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+
+void *memchr_x86(const void *buf, int c, size_t n)
+{
+    const unsigned char *p = (const unsigned char *) buf;
+    unsigned char target = c;
+
+    if (n >= VECTOR_THRESHOLD && vectorMemory(buf, n) && sseUsable())
+    {
+        xmm_save_t save;
+        unsigned int mask = 0;
+        uint32_t pattern = target * 0x01010101U;
+        size_t rest = n;
+        while (rest >= 16 && !mask)
+        {
+            n = rest > VECTOR_CHUNK ? VECTOR_CHUNK : rest;
+            rest -= n;
+            __asm__ __volatile__(VECTOR_ENTER SAVE_XMM0_1
+                                 "movd %[pattern], %%xmm0;"
+                                 "pshufd $0, %%xmm0, %%xmm0;"
+                                 "1:\n"
+                                 "cmp $16, %[n];"
+                                 "jb 2f;"
+                                 "movdqu 0(%[p]), %%xmm1;"
+                                 "pcmpeqb %%xmm0, %%xmm1;"
+                                 "pmovmskb %%xmm1, %[mask];"
+                                 "test %[mask], %[mask];"
+                                 "jnz 2f;"
+                                 "add $16, %[p];"
+                                 "sub $16, %[n];"
+                                 "jmp 1b;"
+                                 "2:\n" RESTORE_XMM0_1 VECTOR_LEAVE
+                                 : [p] "+r"(p), [n] "+r"(n), [mask] "+r"(mask)
+                                 : [pattern] "r"(pattern), [save] "r"(save)
+                                 : "memory", "cc");
+            rest += n;
+        }
+        n = rest;
+
+        if (mask)
+        {
+            return (void *) (p + __builtin_ctz(mask));
+        }
+    }
+
+    for (; n; --n, ++p)
+    {
+        if (*p == target)
+        {
+            return (void *) p;
+        }
+    }
+
+    return 0;
+}
+
+/// Scans aligned 16-byte blocks from the one containing s until a block has a
+/// zero byte (or, if target is non-zero, a byte equal to target). Aligned
+/// loads never cross a page boundary, so reading past the terminator is safe.
+/// Returns the address of the first such byte at or after s.
+static const char *scanSse(const char *s, unsigned char target)
+{
+    xmm_save_t save;
+    uintptr_t offset = ((uintptr_t) s) & 15;
+    const char *p = s - offset;
+    unsigned int keep = ~0U << offset;
+    unsigned int mask = 0;
+    uint32_t pattern = target * 0x01010101U;
+
+    while (!mask)
+    {
+        size_t blocks = VECTOR_CHUNK / 16;
+        __asm__ __volatile__(VECTOR_ENTER SAVE_XMM0_1 SAVE_XMM2_3
+                             "pxor %%xmm0, %%xmm0;"
+                             "movd %[pattern], %%xmm1;"
+                             "pshufd $0, %%xmm1, %%xmm1;"
+                             "1:\n"
+                             "movdqa 0(%[p]), %%xmm2;"
+                             "movdqa %%xmm2, %%xmm3;"
+                             "pcmpeqb %%xmm0, %%xmm2;"
+                             "pcmpeqb %%xmm1, %%xmm3;"
+                             "por %%xmm3, %%xmm2;"
+                             "pmovmskb %%xmm2, %[mask];"
+                             "and %[keep], %[mask];"
+                             "jnz 2f;"
+                             "mov $-1, %[keep];"
+                             "add $16, %[p];"
+                             "sub $1, %[blocks];"
+                             "jnz 1b;"
+                             "2:\n" RESTORE_XMM0_1 RESTORE_XMM2_3 VECTOR_LEAVE
+                             : [p] "+r"(p), [mask] "=&r"(mask),
+                               [keep] "+r"(keep), [blocks] "+r"(blocks)
+                             : [pattern] "r"(pattern), [save] "r"(save)
+                             : "memory", "cc");
+    }
+
+    return p + __builtin_ctz(mask);
+}
+
+size_t strlen_x86(const char *s)
+{
+    if (vectorMemory(s, 1) && sseUsable())
+    {
+        return scanSse(s, 0) - s;
+    }
+
+    const char *orig = s;
+    while (*s)
+    {
+        ++s;
+    }
+    return s - orig;
+}
+
+char *strchr_x86(const char *s, int c)
+{
+    unsigned char target = c;
+
+    if (vectorMemory(s, 1) && sseUsable())
+    {
+        // Matching zero is the same as matching the terminator.
+        s = scanSse(s, target);
+        return *s ? (char *) s : 0;
+    }
+
+    for (; *s; ++s)
+    {
+        if ((unsigned char) *s == target)
+        {
+            return (char *) s;
+        }
+    }
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
 
 #endif
@@ -73,6 +73,13 @@ bool LocksCommand::execute(
     const HugeStaticString &input, HugeStaticString &output,
     InterruptState &state, DebuggerIO *pScreen)
 {
+    // Contention statistics are kept whether or not TRACK_LOCKS is enabled.
+    if (input.contains("stats"))
+    {
+        statistics(output);
+        return true;
+    }
+
 #ifndef TRACK_LOCKS
     output += "Sorry, this kernel was not built with TRACK_LOCKS enabled.";
     return true;
@@ -386,6 +393,82 @@ const char *LocksCommand::getLine2(
     return Line;
 }
 
+void LocksCommand::statistics(HugeStaticString &output)
+{
+    // Find the most contended locks by total time spent spinning.
+    size_t top[LOCKS_COMMAND_STATS_LINES];
+    uint64_t topSpin[LOCKS_COMMAND_STATS_LINES];
+    size_t nTop = 0;
+
+    Spinlock::Statistics stats;
+    for (size_t i = 0; i < SPINLOCK_STATISTICS_SLOTS; ++i)
+    {
+        if (!Spinlock::getStatistics(i, stats) || !stats.nContended)
+            continue;
+
+        size_t j = nTop;
+        if (nTop < LOCKS_COMMAND_STATS_LINES)
+            ++nTop;
+        else if (topSpin[nTop - 1] >= stats.spinTime)
+            continue;
+        else
+            j = nTop - 1;
+
+        for (; j && topSpin[j - 1] < stats.spinTime; --j)
+        {
+            top[j] = top[j - 1];
+            topSpin[j] = topSpin[j - 1];
+        }
+        top[j] = i;
+        topSpin[j] = stats.spinTime;
+    }
+
+    if (!nTop)
+    {
+        output += "No contended spinlocks.\n";
+        return;
+    }
+
+    for (size_t i = 0; i < nTop; ++i)
+    {
+        if (!Spinlock::getStatistics(top[i], stats))
+            continue;
+
+        output.append(static_cast<uintptr_t>(stats.pLock), 16);
+        output += " acq=";
+        output += stats.nAcquires;
+        output += " cont=";
+        output += stats.nContended;
+        output += " spin=";
+        // The slot may have been reset since the scan above.
+        output += stats.nContended ? stats.spinTime / stats.nContended : 0;
+        output += "/";
+        output += stats.maxSpinTime;
+        output += " hold=";
+        output += stats.nAcquires ? stats.holdTime / stats.nAcquires : 0;
+        output += "/";
+        output += stats.maxHoldTime;
+
+#ifndef TESTSUITE
+        uintptr_t symStart = 0;
+        const char *pSym =
+            KernelElf::instance().globalLookupSymbol(stats.ra, &symStart);
+        if (pSym)
+        {
+            LargeStaticString sym(pSym);
+
+            output += " ";
+
+            symbol_t symbol;
+            demangle(sym, &symbol);
+            output += static_cast<const char *>(symbol.name);
+        }
+#endif
+
+        output += "\n";
+    }
+}
+
 size_t LocksCommand::getLineCount()
 {
     size_t numLocks = 0;
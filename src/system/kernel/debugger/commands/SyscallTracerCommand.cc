@@ -19,7 +19,7 @@
 
 #include "pedigree/kernel/debugger/commands/SyscallTracerCommand.h"
 
-SyscallTracerCommand::SyscallTracerCommand()
+SyscallTracerCommand::SyscallTracerCommand() : m_nSyscalls(0)
 {
 }
 
@@ -36,6 +36,26 @@ bool SyscallTracerCommand::execute(
     const HugeStaticString &input, HugeStaticString &output,
     InterruptState &state, DebuggerIO *pScreen)
 {
+#ifndef SYSCALL_STATISTICS
+    output += "Sorry, this kernel was not built with SYSCALL_STATISTICS "
+              "enabled.";
+    return true;
+#endif
+
+    // Find the syscalls that have been called so far.
+    SyscallManager::Statistics stats;
+    m_nSyscalls = 0;
+    for (size_t service = 0; service < serviceEnd; ++service)
+    {
+        for (size_t n = 0; n < SYSCALL_STATISTICS_NUMBERS; ++n)
+        {
+            if (SyscallManager::getStatistics(
+                    static_cast<Service_t>(service), n, stats))
+                m_Syscalls[m_nSyscalls++] =
+                    service * SYSCALL_STATISTICS_NUMBERS + n;
+        }
+    }
+
     // Let's enter 'raw' screen mode.
     pScreen->disableCli();
 
@@ -69,6 +89,9 @@ bool SyscallTracerCommand::execute(
             bStop = true;
     }
 
+    // Let's enter CLI screen mode again.
+    pScreen->enableCli();
+
     //  Return to the debugger
     return (true);
 }
@@ -76,17 +99,70 @@ bool SyscallTracerCommand::execute(
 const char *SyscallTracerCommand::getLine1(
     size_t index, DebuggerIO::Colour &colour, DebuggerIO::Colour &bgColour)
 {
-    return (0);
+    static LargeStaticString Line;
+    Line.clear();
+
+    if (index >= m_nSyscalls)
+        return 0;
+
+    Service_t service =
+        static_cast<Service_t>(m_Syscalls[index] / SYSCALL_STATISTICS_NUMBERS);
+    size_t number = m_Syscalls[index] % SYSCALL_STATISTICS_NUMBERS;
+
+    SyscallManager::Statistics stats;
+    if (!SyscallManager::getStatistics(service, number, stats))
+        return 0;
+
+    colour = DebuggerIO::White;
+    Line.append(SyscallManager::getServiceName(service), 10);
+    Line += " #";
+    Line.append(number, 10, 3, ' ');
+    Line += " calls=";
+    Line += stats.nCalls;
+    Line += " avg=";
+    Line += stats.totalTime / stats.nCalls;
+    Line += " max=";
+    Line += stats.maxTime;
+
+    return Line;
 }
 
 const char *SyscallTracerCommand::getLine2(
     size_t index, size_t &colOffset, DebuggerIO::Colour &colour,
     DebuggerIO::Colour &bgColour)
 {
-    return (0);
+    static HugeStaticString Line;
+    Line.clear();
+
+    if (index >= m_nSyscalls)
+        return 0;
+
+    Service_t service =
+        static_cast<Service_t>(m_Syscalls[index] / SYSCALL_STATISTICS_NUMBERS);
+    size_t number = m_Syscalls[index] % SYSCALL_STATISTICS_NUMBERS;
+
+    SyscallManager::Statistics stats;
+    if (!SyscallManager::getStatistics(service, number, stats))
+        return 0;
+
+    // log2(cycles):count for each histogram bucket in use.
+    colOffset = 64;
+    colour = DebuggerIO::Yellow;
+    for (size_t i = 0; i < SYSCALL_STATISTICS_BUCKETS; ++i)
+    {
+        if (!stats.histogram[i])
+            continue;
+
+        Line.append(i);
+        Line += ":";
+        Line += stats.histogram[i];
+        Line += " ";
+    }
+
+    return Line;
 }
 
 size_t SyscallTracerCommand::getLineCount()
 {
-    return (0);
+    return m_nSyscalls;
 }
@@ -299,6 +299,8 @@ const char *ThreadsCommand::getLine2(
         {
             if (state == Thread::SemWait)
                 Line += "Sem-Wait @ ";
+            else if (state == Thread::MutexWait)
+                Line += "Mutex-Wait @ ";
             else if (state == Thread::Joining)
                 Line += "Joining @";
             else if (state == Thread::CondWait)
@@ -357,6 +359,8 @@ const char *ThreadsCommand::getLine2(
         {
             if (state == Thread::SemWait)
                 Line += "Sem-Wait @ ";
+            else if (state == Thread::MutexWait)
+                Line += "Mutex-Wait @ ";
             else if (state == Thread::Joining)
                 Line += "Joining @";
             else if (state == Thread::CondWait)
@@ -62,6 +62,10 @@ void Disk::write(uint64_t location)
 {
 }
 
+void Disk::prefetch(uint64_t location, uint64_t size)
+{
+}
+
 void Disk::align(uint64_t location)
 {
 }
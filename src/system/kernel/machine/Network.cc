@@ -19,6 +19,7 @@
 
 #include "pedigree/kernel/machine/Network.h"
 #include "pedigree/kernel/utilities/String.h"
+#include "pedigree/kernel/utilities/utility.h"
 
 StationInfo::StationInfo()
     : ipv4(), ipv6(0), nIpv6Addresses(0), subnetMask(), broadcast(0xFFFFFFFF),
@@ -84,6 +85,11 @@ bool Network::isConnected()
     return true;
 }
 
+uint32_t Network::getChecksumOffload()
+{
+    return 0;  // everything is done in software by default
+}
+
 uint32_t Network::convertToIpv4(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
 {
     return a | (b << 8) | (c << 16) | (d << 24);
@@ -101,28 +107,8 @@ IpAddress Network::convertToIpv6(
 
 uint16_t Network::calculateChecksum(uintptr_t buffer, size_t nBytes)
 {
-    uint32_t sum = 0;
-    uint16_t *data = reinterpret_cast<uint16_t *>(buffer);
-
-    while (nBytes > 1)
-    {
-        sum += *data++;
-        nBytes -= sizeof(uint16_t);
-    }
-
-    // odd bytes
-    if (nBytes > 0)
-    {
-        uint8_t *data8 = reinterpret_cast<uint8_t *>(data);
-        sum += *data8;
-    }
-
-    // fold to 16 bits
-    while (sum >> 16)
-        sum = (sum & 0xFFFF) + (sum >> 16);
-
-    uint16_t ret = static_cast<uint16_t>(~sum);
-    return ret;
+    return static_cast<uint16_t>(
+        ~OnesComplementSum(reinterpret_cast<const void *>(buffer), nBytes));
 }
 
 void Network::gotPacket()
@@ -27,6 +27,10 @@
 #include "pedigree/kernel/machine/Device.h"
 #include "pedigree/kernel/machine/Disk.h"
 
+#if defined(MULTIPROCESSOR)
+#include <processor/hosted/Multiprocessor.h>
+#endif
+
 HostedMachine HostedMachine::m_Instance;
 
 Machine &Machine::instance()
@@ -98,7 +102,9 @@ void HostedMachine::setKeyboard(Keyboard *kb)
 
 void HostedMachine::stopAllOtherProcessors()
 {
-    // no-op
+#if defined(MULTIPROCESSOR)
+    Multiprocessor::interProcessorInterruptAllExcludingThis(IPI_HALT_VECTOR);
+#endif
 }
 
 HostedMachine::HostedMachine()
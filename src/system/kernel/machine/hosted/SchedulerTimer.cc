@@ -21,9 +21,19 @@
 #include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/compiler.h"
 #include "pedigree/kernel/machine/Machine.h"
+#include "pedigree/kernel/processor/Processor.h"
 
 using namespace __pedigree_hosted;
 
+#if defined(MULTIPROCESSOR)
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
 /** 10 hertz frequency. */
 #define ONE_SECOND 1000000000
 #define HZ 10
@@ -32,15 +42,65 @@ HostedSchedulerTimer HostedSchedulerTimer::m_Instance;
 
 bool HostedSchedulerTimer::registerHandler(TimerHandler *handler)
 {
+#if defined(MULTIPROCESSOR)
+    // Each PerProcessorScheduler registers from its own processor.
+    ProcessorId id = Processor::id();
+    if (UNLIKELY(id >= HOSTED_MAX_PROCESSORS))
+        return false;
+    if (UNLIKELY(handler == 0 && m_Handlers[id] != 0))
+        return false;
+
+    m_Handlers[id] = handler;
+    if (!m_Timers[id])
+        return startProcessorTimer(id);
+#else
     if (UNLIKELY(handler == 0 && m_Handler != 0))
         return false;
 
     m_Handler = handler;
+#endif
+    return true;
+}
+
+#if defined(MULTIPROCESSOR)
+bool HostedSchedulerTimer::startProcessorTimer(ProcessorId id)
+{
+    // Direct the timer at the calling host thread, so that it interrupts
+    // only this processor.
+    struct sigevent sv;
+    ByteSet(&sv, 0, sizeof(sv));
+    sv.sigev_notify = SIGEV_THREAD_ID;
+    sv.sigev_signo = SIGUSR2;
+    sv.sigev_value.sival_ptr = this;
+    sv.sigev_notify_thread_id = syscall(SYS_gettid);
+    int r = timer_create(CLOCK_REALTIME, &sv, &m_Timers[id]);
+    if (r != 0)
+    {
+        ERROR("HostedSchedulerTimer: couldn't create a timer for processor #"
+              << Dec << id);
+        m_Timers[id] = 0;
+        return false;
+    }
+
+    struct itimerspec interval;
+    ByteSet(&interval, 0, sizeof(interval));
+    interval.it_interval.tv_nsec = ONE_SECOND / HZ;
+    interval.it_value.tv_nsec = ONE_SECOND / HZ;
+    r = timer_settime(m_Timers[id], 0, &interval, 0);
+    if (r != 0)
+    {
+        timer_delete(m_Timers[id]);
+        m_Timers[id] = 0;
+        return false;
+    }
+
     return true;
 }
+#endif
 
 bool HostedSchedulerTimer::initialise()
 {
+#if !defined(MULTIPROCESSOR)
     struct sigevent sv;
     ByteSet(&sv, 0, sizeof(sv));
     sv.sigev_notify = SIGEV_SIGNAL;
@@ -63,12 +123,15 @@ bool HostedSchedulerTimer::initialise()
         timer_delete(m_Timer);
         return false;
     }
+#endif
 
     IrqManager &irqManager = *Machine::instance().getIrqManager();
     m_IrqId = irqManager.registerIsaIrqHandler(1, this);
     if (m_IrqId == 0)
     {
+#if !defined(MULTIPROCESSOR)
         timer_delete(m_Timer);
+#endif
         return false;
     }
 
@@ -76,7 +139,16 @@ bool HostedSchedulerTimer::initialise()
 }
 void HostedSchedulerTimer::uninitialise()
 {
+#if defined(MULTIPROCESSOR)
+    for (size_t i = 0; i < HOSTED_MAX_PROCESSORS; ++i)
+    {
+        if (m_Timers[i])
+            timer_delete(m_Timers[i]);
+        m_Timers[i] = 0;
+    }
+#else
     timer_delete(m_Timer);
+#endif
 
     // Free the IRQ
     if (m_IrqId != 0)
@@ -86,9 +158,17 @@ void HostedSchedulerTimer::uninitialise()
     }
 }
 
+#if defined(MULTIPROCESSOR)
+HostedSchedulerTimer::HostedSchedulerTimer() : m_IrqId(0)
+{
+    ByteSet(m_Timers, 0, sizeof(m_Timers));
+    ByteSet(m_Handlers, 0, sizeof(m_Handlers));
+}
+#else
 HostedSchedulerTimer::HostedSchedulerTimer() : m_IrqId(0), m_Handler(0)
 {
 }
+#endif
 
 bool HostedSchedulerTimer::irq(irq_id_t number, InterruptState &state)
 {
@@ -99,9 +179,16 @@ bool HostedSchedulerTimer::irq(irq_id_t number, InterruptState &state)
         return false;
     }
 
+#if defined(MULTIPROCESSOR)
+    // The signal was directed at this processor's host thread.
+    TimerHandler *pHandler = m_Handlers[Processor::id()];
+#else
+    TimerHandler *pHandler = m_Handler;
+#endif
+
     // TODO: Delta is wrong
-    if (LIKELY(m_Handler != 0))
-        m_Handler->timer(ONE_SECOND / HZ, state);
+    if (LIKELY(pHandler != 0))
+        pHandler->timer(ONE_SECOND / HZ, state);
 
     return true;
 }
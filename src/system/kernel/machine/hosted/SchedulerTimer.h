@@ -25,6 +25,10 @@
 #include "pedigree/kernel/processor/IoPort.h"
 #include "pedigree/kernel/processor/state.h"
 
+#if defined(MULTIPROCESSOR)
+#include <processor/hosted/Multiprocessor.h>
+#endif
+
 namespace __pedigree_hosted
 {
 #include <signal.h>
@@ -75,11 +79,24 @@ class HostedSchedulerTimer : public SchedulerTimer, private IrqHandler
     //
     virtual bool irq(irq_id_t number, InterruptState &state);
 
+#if defined(MULTIPROCESSOR)
+    /** Arms a timer that only interrupts the calling processor. */
+    bool startProcessorTimer(ProcessorId id);
+#endif
+
     irq_id_t m_IrqId;
+
+#if defined(MULTIPROCESSOR)
+    /** Each processor has its own timer, delivered to its host thread. */
+    __pedigree_hosted::timer_t m_Timers[HOSTED_MAX_PROCESSORS];
+    /** The per-processor schedulers */
+    TimerHandler *m_Handlers[HOSTED_MAX_PROCESSORS];
+#else
     __pedigree_hosted::timer_t m_Timer;
 
     /** The scheduler */
     TimerHandler *m_Handler;
+#endif
 
     /** The HostedSchedulerTimer class instance */
     static HostedSchedulerTimer m_Instance;
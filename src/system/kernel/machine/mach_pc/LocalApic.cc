@@ -25,6 +25,7 @@
 #include "pedigree/kernel/processor/InterruptManager.h"
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/TlbShootdown.h"
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
 
 #define LAPIC_REG_ID 0x0020
@@ -102,6 +103,11 @@ bool LocalApic::initialise(uint64_t physicalAddress)
             IPI_HALT_VECTOR, this))
         return false;
 
+    // Register the TLB shootdown vector.
+    if (!InterruptManager::instance().registerInterruptHandler(
+            IPI_TLB_SHOOTDOWN_VECTOR, this))
+        return false;
+
     return initialiseProcessor();
 }
 
@@ -228,6 +234,12 @@ void LocalApic::interrupt(size_t nInterruptNumber, InterruptState &state)
         }
     }
 
+    if (nInterruptNumber == IPI_TLB_SHOOTDOWN_VECTOR)
+    {
+        TlbShootdown::poll();
+        ack();
+    }
+
     // The halt IPI is used in the debugger to stop all other cores.
     if (nInterruptNumber == IPI_HALT_VECTOR)
     {
@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/utilities/BuddyAllocator.h"
+#include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/processor/PageFrame.h"
+#include "pedigree/kernel/processor/PhysicalMemoryManager.h"
+
+const size_t BuddyAllocator::MaxOrder;
+
+BuddyAllocator::BuddyAllocator()
+    : m_Lock(false), m_pFrames(0), m_Base(0), m_Limit(0), m_FreeLists(),
+      m_FreeBlocks(), m_FreePages(0)
+{
+}
+
+void BuddyAllocator::setup(
+    FrameMap *pFrames, physical_uintptr_t base, physical_uintptr_t limit)
+{
+    m_pFrames = pFrames;
+    m_Base = base;
+    m_Limit = limit;
+}
+
+physical_uintptr_t BuddyAllocator::allocate(size_t order)
+{
+    if (order > MaxOrder)
+    {
+        return 0;
+    }
+
+    LockGuard<Spinlock> guard(m_Lock);
+    return takeBlock(order);
+}
+
+size_t BuddyAllocator::allocate(physical_uintptr_t *pages, size_t count)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    size_t i = 0;
+    for (; i < count; ++i)
+    {
+        pages[i] = takeBlock(0);
+        if (!pages[i])
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+physical_uintptr_t BuddyAllocator::allocateRange(size_t count)
+{
+    size_t order = 0;
+    while ((1UL << order) < count)
+    {
+        ++order;
+    }
+
+    if (!count)
+    {
+        return 0;
+    }
+
+    LockGuard<Spinlock> guard(m_Lock);
+
+    if (order > MaxOrder)
+    {
+        return takeRun(count);
+    }
+
+    physical_uintptr_t result = takeBlock(order);
+    if (result)
+    {
+        // Give back the part of the block we don't need.
+        releaseRange(
+            result + (count * PhysicalMemoryManager::getPageSize()),
+            (1UL << order) - count);
+    }
+
+    return result;
+}
+
+bool BuddyAllocator::allocateSpecific(physical_uintptr_t address, size_t count)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    physical_uintptr_t current = address;
+    size_t remaining = count;
+    while (remaining)
+    {
+        size_t order = largestOrder(current, remaining);
+        if (!carveBlock(current, order))
+        {
+            // Undo whatever we managed to take.
+            releaseRange(address, count - remaining);
+            return false;
+        }
+
+        current += blockSize(order);
+        remaining -= 1UL << order;
+    }
+
+    return true;
+}
+
+void BuddyAllocator::free(physical_uintptr_t address, size_t order)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+    releaseBlock(address, order);
+}
+
+void BuddyAllocator::free(const physical_uintptr_t *pages, size_t count)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+    for (size_t i = 0; i < count; ++i)
+    {
+        releaseBlock(pages[i], 0);
+    }
+}
+
+void BuddyAllocator::freeRange(physical_uintptr_t address, size_t count)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+    releaseRange(address, count);
+}
+
+size_t BuddyAllocator::blockSize(size_t order)
+{
+    return PhysicalMemoryManager::getPageSize() << order;
+}
+
+size_t BuddyAllocator::largestOrder(physical_uintptr_t address, size_t count)
+{
+    size_t order = 0;
+    while (order < MaxOrder && (1UL << (order + 1)) <= count &&
+           !(address & (blockSize(order + 1) - 1)))
+    {
+        ++order;
+    }
+
+    return order;
+}
+
+physical_uintptr_t BuddyAllocator::takeRun(size_t count)
+{
+    size_t blockPages = 1UL << MaxOrder;
+    size_t nBlocks = (count + blockPages - 1) / blockPages;
+
+    // Blocks of MaxOrder never merge, so look for one followed by enough free
+    // neighbours of the same order.
+    for (PageFrame *pFrame = m_FreeLists[MaxOrder]; pFrame;
+         pFrame = pFrame->next)
+    {
+        physical_uintptr_t head = m_pFrames->address(pFrame);
+        if ((head + (nBlocks * blockSize(MaxOrder))) > m_Limit)
+        {
+            continue;
+        }
+
+        size_t n = 1;
+        for (; n < nBlocks; ++n)
+        {
+            PageFrame *pNext =
+                m_pFrames->frame(head + (n * blockSize(MaxOrder)));
+            if (!pNext || !(pNext->flags & PageFrame::Free) ||
+                pNext->order != MaxOrder)
+            {
+                break;
+            }
+        }
+
+        if (n < nBlocks)
+        {
+            continue;
+        }
+
+        for (n = 0; n < nBlocks; ++n)
+        {
+            unlink(
+                m_pFrames->frame(head + (n * blockSize(MaxOrder))), MaxOrder);
+        }
+
+        // Give back the part of the last block we don't need.
+        releaseRange(
+            head + (count * PhysicalMemoryManager::getPageSize()),
+            (nBlocks * blockPages) - count);
+
+        return head;
+    }
+
+    return 0;
+}
+
+physical_uintptr_t BuddyAllocator::takeBlock(size_t order)
+{
+    for (size_t current = order; current <= MaxOrder; ++current)
+    {
+        PageFrame *pFrame = m_FreeLists[current];
+        if (!pFrame)
+        {
+            continue;
+        }
+
+        unlink(pFrame, current);
+        physical_uintptr_t address = m_pFrames->address(pFrame);
+
+        // Split down to the requested order, freeing the upper halves.
+        while (current > order)
+        {
+            --current;
+            push(address + blockSize(current), current);
+        }
+
+        return address;
+    }
+
+    return 0;
+}
+
+bool BuddyAllocator::carveBlock(physical_uintptr_t address, size_t order)
+{
+    for (size_t current = order; current <= MaxOrder; ++current)
+    {
+        physical_uintptr_t head = address & ~(blockSize(current) - 1);
+        if (head < m_Base || (head + blockSize(current)) > m_Limit)
+        {
+            break;
+        }
+
+        PageFrame *pFrame = m_pFrames->frame(head);
+        if (!pFrame || !(pFrame->flags & PageFrame::Free) ||
+            pFrame->order != current)
+        {
+            continue;
+        }
+
+        unlink(pFrame, current);
+
+        // Split down, keeping whichever half holds the address.
+        while (current > order)
+        {
+            --current;
+            physical_uintptr_t upper = head + blockSize(current);
+            if (address >= upper)
+            {
+                push(head, current);
+                head = upper;
+            }
+            else
+            {
+                push(upper, current);
+            }
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void BuddyAllocator::releaseBlock(physical_uintptr_t address, size_t order)
+{
+    while (order < MaxOrder)
+    {
+        physical_uintptr_t buddy = address ^ blockSize(order);
+        if (buddy < m_Base || (buddy + blockSize(order)) > m_Limit)
+        {
+            break;
+        }
+
+        PageFrame *pBuddy = m_pFrames->frame(buddy);
+        if (!pBuddy || !(pBuddy->flags & PageFrame::Free) ||
+            pBuddy->order != order)
+        {
+            break;
+        }
+
+        unlink(pBuddy, order);
+        if (buddy < address)
+        {
+            address = buddy;
+        }
+        ++order;
+    }
+
+    push(address, order);
+}
+
+void BuddyAllocator::releaseRange(physical_uintptr_t address, size_t count)
+{
+    while (count)
+    {
+        size_t order = largestOrder(address, count);
+        releaseBlock(address, order);
+
+        address += blockSize(order);
+        count -= 1UL << order;
+    }
+}
+
+void BuddyAllocator::push(physical_uintptr_t address, size_t order)
+{
+    PageFrame *pFrame = m_pFrames->frame(address);
+
+    pFrame->flags |= PageFrame::Free;
+    pFrame->order = order;
+    pFrame->prev = 0;
+    pFrame->next = m_FreeLists[order];
+    if (pFrame->next)
+    {
+        pFrame->next->prev = pFrame;
+    }
+    m_FreeLists[order] = pFrame;
+
+    ++m_FreeBlocks[order];
+    m_FreePages += 1UL << order;
+}
+
+void BuddyAllocator::unlink(PageFrame *pFrame, size_t order)
+{
+    if (pFrame->prev)
+    {
+        pFrame->prev->next = pFrame->next;
+    }
+    else
+    {
+        m_FreeLists[order] = pFrame->next;
+    }
+
+    if (pFrame->next)
+    {
+        pFrame->next->prev = pFrame->prev;
+    }
+
+    pFrame->flags &= ~PageFrame::Free;
+    pFrame->prev = pFrame->next = 0;
+
+    --m_FreeBlocks[order];
+    m_FreePages -= 1UL << order;
+}
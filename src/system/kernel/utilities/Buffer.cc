@@ -22,14 +22,51 @@
 #include "pedigree/kernel/utilities/utility.h"
 
 #ifdef THREADS
+#include "pedigree/kernel/process/Process.h"
 #include "pedigree/kernel/process/Thread.h"
+#include "pedigree/kernel/processor/PhysicalMemoryManager.h"
+#include "pedigree/kernel/processor/Processor.h"
+#include "pedigree/kernel/processor/ProcessorInformation.h"
+#include "pedigree/kernel/processor/VirtualAddressSpace.h"
+
+/**
+ * Moves bytes from the active address space into \p va. Whole pages are
+ * lent where both sides are page aligned (if \p bLend), everything else is
+ * copied. Stops early if the destination can't be reached from here.
+ */
+static size_t transfer(
+    VirtualAddressSpace &va, void *dest, const void *src, size_t size,
+    bool bLend)
+{
+    VirtualAddressSpace &current =
+        Processor::information().getVirtualAddressSpace();
+    const size_t pageSize = PhysicalMemoryManager::getPageSize();
+    uintptr_t d = reinterpret_cast<uintptr_t>(dest);
+    uintptr_t s = reinterpret_cast<uintptr_t>(src);
+
+    size_t done = 0;
+    if (bLend && !((d | s) & (pageSize - 1)))
+    {
+        while ((size - done) >= pageSize &&
+               current.lendPage(
+                   reinterpret_cast<void *>(s + done), va,
+                   reinterpret_cast<void *>(d + done)))
+        {
+            done += pageSize;
+        }
+    }
+
+    return done + va.copyInto(
+                      reinterpret_cast<void *>(d + done),
+                      reinterpret_cast<const void *>(s + done), size - done);
+}
 #endif
 
 template <class T, bool allowShortOperation>
 Buffer<T, allowShortOperation>::Buffer(size_t bufferSize)
     : m_BufferSize(bufferSize), m_DataSize(0), m_Lock(false),
       m_WriteCondition(), m_ReadCondition(), m_Segments(), m_MonitorTargets(),
-      m_bCanRead(true), m_bCanWrite(true)
+      m_pDirectReader(0), m_bCanRead(true), m_bCanWrite(true)
 {
 }
 
@@ -87,6 +124,27 @@ Buffer<T, allowShortOperation>::write(const T *buffer, size_t count, bool block)
             break;
         }
 
+        // Is a reader waiting on an empty buffer? Give it the data directly.
+        if (m_pDirectReader && !m_DataSize && m_bCanRead)
+        {
+            size_t numberCopied = handOff(buffer, count);
+            if (numberCopied)
+            {
+                countSoFar += numberCopied;
+                buffer += numberCopied;
+                count -= numberCopied;
+
+                // Only the reader we handed to needs to wake, but we can't
+                // pick it out from the others.
+                m_ReadCondition.broadcast();
+
+                if (!count)
+                {
+                    break;
+                }
+            }
+        }
+
         // Do we have space?
         size_t bytesAvailable = m_BufferSize - m_DataSize;
         if (!bytesAvailable)
@@ -275,9 +333,57 @@ size_t Buffer<T, allowShortOperation>::read(T *buffer, size_t count, bool block)
                 break;
             }
 
-            // No, we need to wait.
+            // No, we need to wait. If no other reader has, leave our buffer
+            // for the next writer to fill directly.
+            DirectReader direct;
+            bool bDirect = !m_pDirectReader;
+            if (bDirect)
+            {
+                direct.buffer = buffer;
+                direct.count = count;
+#ifdef THREADS
+                direct.pAddressSpace =
+                    &Processor::information().getVirtualAddressSpace();
+                direct.pProcess =
+                    Processor::information().getCurrentThread()->getParent();
+#endif
+                m_pDirectReader = &direct;
+            }
+
             ConditionVariable::WaitResult result = m_ReadCondition.wait(m_Lock);
-            if (result.hasError())
+            if (bDirect)
+            {
+                // A failed wait returns without the lock, but no writer may
+                // be left holding on to our buffer when we return.
+                if (result.hasError())
+                {
+                    m_Lock.acquire();
+                }
+                if (m_pDirectReader == &direct)
+                {
+                    m_pDirectReader = 0;
+                }
+                countSoFar += direct.done;
+                if (result.hasError())
+                {
+                    m_Lock.release();
+                    return countSoFar;
+                }
+
+                if (direct.done)
+                {
+                    buffer += direct.done;
+                    count -= direct.done;
+                    if (!count)
+                    {
+                        break;
+                    }
+
+                    // Pick up anything else that's there, but don't block.
+                    block = false;
+                }
+            }
+            else if (result.hasError())
             {
                 return countSoFar;
             }
@@ -354,6 +460,39 @@ size_t Buffer<T, allowShortOperation>::read(T *buffer, size_t count, bool block)
     return countSoFar;
 }
 
+template <class T, bool allowShortOperation>
+size_t Buffer<T, allowShortOperation>::handOff(const T *buffer, size_t count)
+{
+    DirectReader *pReader = m_pDirectReader;
+    m_pDirectReader = 0;
+
+    if (count > pReader->count)
+    {
+        count = pReader->count;
+    }
+
+#ifdef THREADS
+    // Lending pages to another process is only safe if neither side has
+    // other threads that might still be using the old mappings.
+    Process *pProcess =
+        Processor::information().getCurrentThread()->getParent();
+    size_t bytes = count * sizeof(T);
+    bool bLend = (bytes >= m_MinimumLendSize) &&
+                 (pProcess != pReader->pProcess) &&
+                 (pProcess->getNumThreads() == 1) &&
+                 (pReader->pProcess->getNumThreads() == 1);
+
+    bytes = transfer(
+        *pReader->pAddressSpace, pReader->buffer, buffer, bytes, bLend);
+    count = bytes / sizeof(T);
+#else
+    pedigree_std::copy(pReader->buffer, buffer, count);
+#endif
+
+    pReader->done = count;
+    return count;
+}
+
 template <class T, bool allowShortOperation>
 void Buffer<T, allowShortOperation>::disableWrites()
 {
@@ -22,7 +22,6 @@
 #include "pedigree/kernel/Log.h"
 #include "pedigree/kernel/machine/Machine.h"
 #include "pedigree/kernel/machine/Timer.h"
-#include "pedigree/kernel/process/MemoryPressureManager.h"
 #include "pedigree/kernel/processor/PhysicalMemoryManager.h"
 #include "pedigree/kernel/processor/VirtualAddressSpace.h"
 #include "pedigree/kernel/utilities/Iterator.h"
@@ -30,7 +29,8 @@
 #include "pedigree/kernel/utilities/utility.h"
 
 #ifndef STANDALONE_CACHE
-#include "pedigree/kernel/process/Scheduler.h"
+#include "pedigree/kernel/process/SchedulingAlgorithm.h"
+#include "pedigree/kernel/process/Semaphore.h"
 #include "pedigree/kernel/process/Thread.h"
 #include "pedigree/kernel/processor/Processor.h"
 #include "pedigree/kernel/processor/ProcessorInformation.h"
@@ -48,12 +48,23 @@ MemoryAllocator Cache::m_Allocator(true);
 Spinlock Cache::m_AllocatorLock;
 static bool g_AllocatorInited = false;
 
+Cache::CachePage *Cache::m_pActiveHead = 0;
+Cache::CachePage *Cache::m_pActiveTail = 0;
+Cache::CachePage *Cache::m_pInactiveHead = 0;
+Cache::CachePage *Cache::m_pInactiveTail = 0;
+size_t Cache::m_nActivePages = 0;
+size_t Cache::m_nInactivePages = 0;
+Spinlock Cache::m_LruLock;
+Mutex Cache::m_ReclaimLock(false);
+size_t Cache::m_nReclaimed = 0;
+size_t Cache::m_nReclaimWritebacks = 0;
+
 CacheManager CacheManager::m_Instance;
 
 #ifdef THREADS
-static int trimTrampoline(void *p)
+static int reclaimTrampoline(void *p)
 {
-    CacheManager::instance().trimThread();
+    CacheManager::instance().reclaimThread();
     return 0;
 }
 #endif
@@ -61,8 +72,9 @@ static int trimTrampoline(void *p)
 CacheManager::CacheManager()
     : RequestQueue("CacheManager"), m_Caches(),
 #ifdef THREADS
-      m_pTrimThread(0),
+      m_pReclaimThread(0), m_pReclaimWake(0),
 #endif
+      m_bReclaimPending(false), m_DirectReclaimStalls(0), m_ReclaimWakeups(0),
       m_bActive(false)
 {
 }
@@ -71,7 +83,9 @@ CacheManager::~CacheManager()
 {
     m_bActive = false;
 #ifdef THREADS
-    m_pTrimThread->join();
+    wakeReclaim();
+    m_pReclaimThread->join();
+    delete m_pReclaimWake;
 #endif
 }
 
@@ -88,11 +102,20 @@ void CacheManager::initialise()
     // Call out to the base class initialise() so the RequestQueue goes live.
     RequestQueue::initialise();
 
+#ifndef STANDALONE_CACHE
+    // Below the min watermark, inactive cache pages are the next thing to go
+    // after file mappings have dropped their pins.
+    MemoryPressureManager::instance().registerHandler(
+        MemoryPressureManager::MediumPriority, this);
+#endif
+
 #ifdef THREADS
-    // Create our main trim thread.
+    // Create our reclaim thread.
     Process *pParent = Processor::information().getCurrentThread()->getParent();
+    m_pReclaimWake = new Semaphore(0);
     m_bActive = true;
-    m_pTrimThread = new Thread(pParent, trimTrampoline, 0);
+    m_pReclaimThread = new Thread(pParent, reclaimTrampoline, 0);
+    m_pReclaimThread->setPriority(MAX_PRIORITIES - 1);
 #endif
 }
 
@@ -114,20 +137,48 @@ void CacheManager::unregisterCache(Cache *pCache)
     }
 }
 
-bool CacheManager::trimAll(size_t count)
+void CacheManager::wakeReclaim()
 {
-    size_t totalEvicted = 0;
-    for (List<Cache *>::Iterator it = m_Caches.begin();
-         (it != m_Caches.end()) && count; ++it)
-    {
-        size_t evicted = (*it)->trim(count);
-        totalEvicted += evicted;
-        count -= evicted;
-    }
+#ifdef THREADS
+    if (!m_pReclaimWake)
+        return;
 
-    return totalEvicted != 0;
+    if (m_bReclaimPending.compareAndSwap(false, true))
+        m_pReclaimWake->release();
+#endif
 }
 
+void CacheManager::directReclaim(size_t nPages)
+{
+#ifndef STANDALONE_CACHE
+    size_t minMark = MemoryPressureManager::getHighWatermark();
+    size_t currFree = PhysicalMemoryManager::instance().freePageCount();
+    if (LIKELY(currFree >= (MemoryPressureManager::getLowWatermark() + nPages)))
+        return;
+
+    wakeReclaim();
+
+    if (currFree >= (minMark + nPages))
+        return;
+
+    // The reclaim thread hasn't kept up, so the caller has to reclaim pages
+    // itself. Callers may be inside a cache callback, with that cache's lock
+    // held or even on the reclaim thread, so this mustn't wait on locks.
+    m_DirectReclaimStalls += 1;
+    Cache::reclaim((minMark + nPages) - currFree, true);
+#endif
+}
+
+#ifndef STANDALONE_CACHE
+bool CacheManager::compact()
+{
+    // We may be called with any cache's lock held, by an allocation from
+    // within that cache.
+    m_DirectReclaimStalls += 1;
+    return Cache::reclaim(CACHE_RECLAIM_BATCH, true) != 0;
+}
+#endif
+
 void CacheManager::timer(uint64_t delta, InterruptState &state)
 {
     for (List<Cache *>::Iterator it = m_Caches.begin(); it != m_Caches.end();
@@ -167,51 +218,62 @@ uint64_t CacheManager::executeRequest(
 }
 
 #ifdef THREADS
-void CacheManager::trimThread()
+void CacheManager::reclaimThread()
 {
     while (m_bActive)
     {
-        // Ask caches to trim if we're heading towards memory usage problems.
-        size_t currFree = PhysicalMemoryManager::instance().freePageCount();
-        size_t lowMark = MemoryPressureManager::getLowWatermark();
-        if (UNLIKELY(currFree <= lowMark))
+        // Sleep until an allocation dips below the low watermark, but wake up
+        // now and again anyway to keep page ages current.
+        m_pReclaimWake->acquire(1, 0, CACHE_AGING_PERIOD * 1000);
+        m_bReclaimPending = false;
+
+        PhysicalMemoryManager &pmm = PhysicalMemoryManager::instance();
+        if (pmm.freePageCount() >= MemoryPressureManager::getLowWatermark())
         {
-            // Start trimming. Trim more the closer to the high watermark we
-            // get.
-            NOTICE_NOLOCK("trimThread: free page count nears high watermark, "
-                          "automatically trimming");
-            // Increase as the amount of memory decreases beyond the low
-            // watermark.
-            size_t trimCount = (lowMark - currFree) + 1;
-            trimAll(trimCount);
+            Cache::age();
+            continue;
+        }
+
+        m_ReclaimWakeups += 1;
+
+        // Reclaim up to the high watermark. If caches can't give back enough
+        // on their own, most likely because file mappings have their pages
+        // pinned, ask mappings to unpin pages that weren't recently accessed
+        // and go round again. Handlers down to LowPriority may also swap out
+        // anonymous memory, but the daemon never goes as far as killing
+        // processes.
+        size_t highMark = MemoryPressureManager::getReclaimWatermark();
+        bool bCompacted = false;
+        while (m_bActive)
+        {
+            size_t currFree = pmm.freePageCount();
+            if (currFree >= highMark)
+                break;
+
+            size_t count =
+                min(highMark - currFree,
+                    static_cast<size_t>(CACHE_RECLAIM_BATCH));
+            if (Cache::reclaim(count))
+            {
+                bCompacted = false;
+                continue;
+            }
+
+            if (bCompacted)
+                break;
+
+            // Carry on for as long as handlers free pages themselves.
+            bCompacted = !MemoryPressureManager::instance().compact(
+                MemoryPressureManager::LowPriority);
         }
-        else
-            Scheduler::instance().yield();
     }
 }
 #endif
 
 Cache::Cache(size_t pageConstraints)
-    : m_Pages(), m_PageFilter(0xe80000, 11), m_pLruHead(0), m_pLruTail(0),
-      m_Lock(false), m_Callback(0), m_Nanoseconds(0),
+    : m_Pages(), m_PageFilter(0xe80000, 11), m_Lock(false), m_Callback(0), m_Nanoseconds(0),
       m_PageConstraints(pageConstraints)
 {
-    if (!g_AllocatorInited)
-    {
-#ifdef STANDALONE_CACHE
-        uintptr_t start = 0;
-        uintptr_t end = 0;
-        discover_range(start, end);
-#else
-        uintptr_t start =
-            VirtualAddressSpace::getKernelAddressSpace().getKernelCacheStart();
-        uintptr_t end =
-            VirtualAddressSpace::getKernelAddressSpace().getKernelCacheEnd();
-#endif
-        m_Allocator.free(start, end - start);
-        g_AllocatorInited = true;
-    }
-
     // Allocate any necessary iterators now, so that they're available
     // immediately and we consume their memory early.
     m_Pages.begin();
@@ -222,12 +284,11 @@ Cache::Cache(size_t pageConstraints)
 
 Cache::~Cache()
 {
-    // Clean up existing cache pages
-    for (Tree<uintptr_t, CachePage *>::Iterator it = m_Pages.begin();
-         it != m_Pages.end(); it++)
-    {
-        evict(it.key());
-    }
+    // Clean up existing cache pages, making sure reclaim isn't part way
+    // through evicting one of them.
+    m_ReclaimLock.acquire();
+    empty();
+    m_ReclaimLock.release();
 
     CacheManager::instance().unregisterCache(this);
 }
@@ -257,6 +318,9 @@ uintptr_t Cache::lookup(uintptr_t key)
 
 uintptr_t Cache::insert(uintptr_t key, bool *alreadyExisted)
 {
+    // Do we have memory pressure - do we need to reclaim pages first?
+    CacheManager::instance().directReclaim();
+
     LockGuard<Spinlock> guard(m_Lock);
 
     // We check the bloom filter to avoid hitting the tree, which is useful
@@ -290,10 +354,8 @@ uintptr_t Cache::insert(uintptr_t key, bool *alreadyExisted)
         FATAL("Cache: bloom filter lied!");
     }
 
-    m_AllocatorLock.acquire();
     uintptr_t location = 0;
-    bool succeeded = m_Allocator.allocate(4096, location);
-    m_AllocatorLock.release();
+    bool succeeded = allocateAddress(4096, location);
 
     if (!succeeded)
     {
@@ -303,9 +365,6 @@ uintptr_t Cache::insert(uintptr_t key, bool *alreadyExisted)
         return 0;
     }
 
-    // Do we have memory pressure - do we need to do an LRU eviction?
-    lruEvict();
-
     if (!map(location))
     {
         FATAL("Map failed in Cache::insert())");
@@ -315,6 +374,7 @@ uintptr_t Cache::insert(uintptr_t key, bool *alreadyExisted)
     ByteSet(pPage, 0, sizeof(CachePage));
     pPage->key = key;
     pPage->location = location;
+    pPage->pCache = this;
     pPage->refcnt = 1;
     pPage->checksum[0] = 0;
     pPage->checksum[1] = 0;
@@ -328,8 +388,6 @@ uintptr_t Cache::insert(uintptr_t key, bool *alreadyExisted)
 
 uintptr_t Cache::insert(uintptr_t key, size_t size, bool *alreadyExisted)
 {
-    LockGuard<Spinlock> guard(m_Lock);
-
     if (size % 4096)
     {
         WARNING("Cache::insert called with a size that isn't page-aligned");
@@ -338,6 +396,11 @@ uintptr_t Cache::insert(uintptr_t key, size_t size, bool *alreadyExisted)
 
     size_t nPages = size / 4096;
 
+    // Check for and reclaim pages if we're running low on memory.
+    CacheManager::instance().directReclaim(nPages);
+
+    LockGuard<Spinlock> guard(m_Lock);
+
     // Already allocated buffer?
     /// \todo no - this doesn't check the full size!
     CachePage *pPage = 0;
@@ -360,10 +423,8 @@ uintptr_t Cache::insert(uintptr_t key, size_t size, bool *alreadyExisted)
     }
 
     // Nope, so let's allocate this block
-    m_AllocatorLock.acquire();
     uintptr_t location;
-    bool succeeded = m_Allocator.allocate(size, location);
-    m_AllocatorLock.release();
+    bool succeeded = allocateAddress(size, location);
 
     if (!succeeded)
     {
@@ -382,17 +443,16 @@ uintptr_t Cache::insert(uintptr_t key, size_t size, bool *alreadyExisted)
             continue;  // Don't overwrite existing buffers
         }
 
-        // Check for and evict pages if we're running low on memory.
-        lruEvict();
-
         if (!map(location))
         {
             FATAL("Map failed in Cache::insert())");
         }
 
         pPage = new CachePage;
+        ByteSet(pPage, 0, sizeof(CachePage));
         pPage->key = key + (page * 4096);
         pPage->location = location;
+        pPage->pCache = this;
 
         // Enter into cache unpinned, but only if we can call an eviction
         // callback.
@@ -414,6 +474,31 @@ uintptr_t Cache::insert(uintptr_t key, size_t size, bool *alreadyExisted)
     return returnLocation;
 }
 
+bool Cache::allocateAddress(size_t size, uintptr_t &location)
+{
+    LockGuard<Spinlock> guard(m_AllocatorLock);
+
+    // Set up on first use rather than in a constructor, as static Caches may
+    // well be constructed before m_Allocator is.
+    if (!g_AllocatorInited)
+    {
+#ifdef STANDALONE_CACHE
+        uintptr_t start = 0;
+        uintptr_t end = 0;
+        discover_range(start, end);
+#else
+        uintptr_t start =
+            VirtualAddressSpace::getKernelAddressSpace().getKernelCacheStart();
+        uintptr_t end =
+            VirtualAddressSpace::getKernelAddressSpace().getKernelCacheEnd();
+#endif
+        m_Allocator.free(start, end - start);
+        g_AllocatorInited = true;
+    }
+
+    return m_Allocator.allocate(size, location);
+}
+
 bool Cache::map(uintptr_t virt) const
 {
 #ifdef STANDALONE_CACHE
@@ -457,6 +542,27 @@ bool Cache::evict(uintptr_t key)
     return evict(key, true, true, true);
 }
 
+size_t Cache::evictRange(uintptr_t key, size_t length)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    size_t nLeft = 0;
+    for (size_t i = 0; i < length; i += 4096)
+    {
+        if (!m_PageFilter.contains(key + i) || !m_Pages.lookup(key + i))
+        {
+            continue;
+        }
+
+        if (!evict(key + i, false, true, true))
+        {
+            ++nLeft;
+        }
+    }
+
+    return nLeft;
+}
+
 void Cache::empty()
 {
     LockGuard<Spinlock> guard(m_Lock);
@@ -482,7 +588,7 @@ bool Cache::evict(uintptr_t key, bool bLock, bool bPhysicalLock, bool bRemove)
     }
 
     CachePage *pPage = 0;
-    if (!m_PageFilter.contains(key))
+    if (m_PageFilter.contains(key))
     {
         pPage = m_Pages.lookup(key);
     }
@@ -524,12 +630,13 @@ bool Cache::evict(uintptr_t key, bool bLock, bool bPhysicalLock, bool bRemove)
         va.getMapping(loc, phys, flags);
 #endif
 
-        // Remove from our tracking.
+        // Remove from our tracking. The LRU lists are shared with every
+        // other cache, so the page always has to come off those.
         if (bRemove)
         {
             m_Pages.remove(key);
-            unlinkPage(pPage);
         }
+        unlinkPage(pPage);
 
         // Eviction callback.
         if (m_Callback)
@@ -603,23 +710,131 @@ void Cache::release(uintptr_t key)
     }
 }
 
-size_t Cache::trim(size_t count)
+size_t Cache::reclaim(size_t count, bool bTry)
 {
-    LockGuard<Spinlock> guard(m_Lock);
-
     if (!count)
         return 0;
 
-    size_t nPages = 0;
+    if (bTry)
+    {
+        if (!m_ReclaimLock.tryAcquire())
+            return 0;
+    }
+    else
+    {
+        m_ReclaimLock.acquire();
+    }
+
+    // Look at each page at most twice: once to clear its referenced state, and
+    // once more to evict it if that was all that was keeping it.
+    size_t budget = (m_nActivePages + m_nInactivePages) * 2;
+    size_t nEvicted = 0;
+    while ((nEvicted < count) && budget)
+    {
+        age();
+
+        // Pull a batch of candidates off the inactive list. The keys have to
+        // be copied out as the pages may be evicted by their cache as soon as
+        // m_LruLock is released, but m_ReclaimLock keeps the caches around.
+        Cache *pCaches[CACHE_RECLAIM_BATCH];
+        uintptr_t keys[CACHE_RECLAIM_BATCH];
+        size_t nCandidates = 0;
+
+        m_LruLock.acquire();
+        size_t nScan = min(m_nInactivePages, budget);
+        nScan = min(nScan, static_cast<size_t>(CACHE_RECLAIM_BATCH));
+        for (size_t i = 0; i < nScan; ++i)
+        {
+            CachePage *pPage = m_pInactiveTail;
+            removePage(pPage);
+            --budget;
+
+            if (testAndClearReferenced(pPage))
+            {
+                // Used again since it was deactivated, so it isn't cold.
+                pushPage(pPage, true);
+                continue;
+            }
+
+            // Rotate to the head, so that if the page can't go yet the next
+            // batch looks at different pages.
+            pushPage(pPage, false);
+            pCaches[nCandidates] = pPage->pCache;
+            keys[nCandidates] = pPage->key;
+            ++nCandidates;
+        }
+        m_LruLock.release();
+
+        if (!nScan)
+            break;
+
+        for (size_t i = 0; (i < nCandidates) && (nEvicted < count); ++i)
+        {
+            if (pCaches[i]->reclaimPage(keys[i], bTry))
+                ++nEvicted;
+        }
+    }
+
+    m_nReclaimed += nEvicted;
+
+    m_ReclaimLock.release();
+
+    return nEvicted;
+}
+
+void Cache::age(size_t count)
+{
+    LockGuard<Spinlock> guard(m_LruLock);
+
+    while (count-- && m_pActiveTail && (m_nInactivePages < m_nActivePages))
+    {
+        CachePage *pPage = m_pActiveTail;
+        removePage(pPage);
+        pushPage(pPage, testAndClearReferenced(pPage));
+    }
+}
+
+bool Cache::reclaimPage(uintptr_t key, bool bTry)
+{
+    if (bTry && m_Lock.acquired())
+        return false;
+
+    LockGuard<Spinlock> guard(m_Lock);
+
+    CachePage *pPage = 0;
+    if (m_PageFilter.contains(key))
+    {
+        pPage = m_Pages.lookup(key);
+    }
+    if (!pPage)
+    {
+        return false;
+    }
+
+    // Pinned? (See evict() for why a refcount of one is fine with a callback.)
+    if ((m_Callback && pPage->refcnt > 1) || ((!m_Callback) && pPage->refcnt))
+    {
+        return false;
+    }
+
+    if (pPage->status == CachePage::Editing)
+    {
+        return false;
+    }
 
-    // Attempt an LRU compact.
-    size_t n = 0;
-    while ((nPages < count) && ((n = lruEvict(true)) > 0))
+    // Dirty pages are written back first, asynchronously, so that a whole
+    // batch of them is written back together. They'll be clean by the time
+    // reclaim comes around to them again.
+    if (m_Callback && !verifyChecksum(pPage))
     {
-        nPages += n;
+        CacheManager::instance().addAsyncRequest(
+            1, reinterpret_cast<uint64_t>(this), CacheConstants::WriteBack, key,
+            pPage->location);
+        ++m_nReclaimWritebacks;
+        return false;
     }
 
-    return nPages;
+    return evict(key, false, true, true);
 }
 
 void Cache::sync(uintptr_t key, bool async)
@@ -796,60 +1011,94 @@ uint64_t Cache::executeRequest(
     return 2;
 }
 
-size_t Cache::lruEvict(bool force)
+void Cache::linkPage(CachePage *pPage)
+{
+    LockGuard<Spinlock> guard(m_LruLock);
+
+    pPage->bReferenced = false;
+    pushPage(pPage, false);
+}
+
+void Cache::promotePage(CachePage *pPage)
 {
-#ifdef STANDALONE_CACHE
-    return 0;
-#else
-    if (!(m_pLruHead && m_pLruTail))
-        return 0;
+    LockGuard<Spinlock> guard(m_LruLock);
 
-    // Do we have memory pressure - do we need to do an LRU eviction?
-    if (force || (PhysicalMemoryManager::instance().freePageCount() <
-                  MemoryPressureManager::getLowWatermark()))
+    if (pPage->bActive || !pPage->bReferenced)
     {
-        // Yes, perform the LRU eviction.
-        CachePage *toEvict = m_pLruTail;
-        if (evict(toEvict->key, false, true, true))
-            return 1;
-        else
-        {
-            // Bump the page's priority up as eviction failed for some reason.
-            promotePage(toEvict);
-        }
+        pPage->bReferenced = true;
+        return;
     }
 
-    return 0;
-#endif
+    // Second use while inactive.
+    removePage(pPage);
+    pPage->bReferenced = false;
+    pushPage(pPage, true);
 }
 
-void Cache::linkPage(CachePage *pPage)
+void Cache::unlinkPage(CachePage *pPage)
 {
-    pPage->pPrev = 0;
-    pPage->pNext = m_pLruHead;
-    if (m_pLruHead)
-        m_pLruHead->pPrev = pPage;
-    m_pLruHead = pPage;
-    if (!m_pLruTail)
-        m_pLruTail = m_pLruHead;
+    LockGuard<Spinlock> guard(m_LruLock);
+
+    removePage(pPage);
 }
 
-void Cache::promotePage(CachePage *pPage)
+void Cache::pushPage(CachePage *pPage, bool bActive)
 {
-    unlinkPage(pPage);
-    linkPage(pPage);
+    CachePage *&head = bActive ? m_pActiveHead : m_pInactiveHead;
+    CachePage *&tail = bActive ? m_pActiveTail : m_pInactiveTail;
+
+    pPage->bActive = bActive;
+    pPage->pPrev = 0;
+    pPage->pNext = head;
+    if (head)
+        head->pPrev = pPage;
+    head = pPage;
+    if (!tail)
+        tail = head;
+
+    if (bActive)
+        ++m_nActivePages;
+    else
+        ++m_nInactivePages;
 }
 
-void Cache::unlinkPage(CachePage *pPage)
+void Cache::removePage(CachePage *pPage)
 {
+    CachePage *&head = pPage->bActive ? m_pActiveHead : m_pInactiveHead;
+    CachePage *&tail = pPage->bActive ? m_pActiveTail : m_pInactiveTail;
+
     if (pPage->pPrev)
         pPage->pPrev->pNext = pPage->pNext;
     if (pPage->pNext)
         pPage->pNext->pPrev = pPage->pPrev;
-    if (pPage == m_pLruTail)
-        m_pLruTail = pPage->pPrev;
-    if (pPage == m_pLruHead)
-        m_pLruHead = pPage->pNext;
+    if (pPage == tail)
+        tail = pPage->pPrev;
+    if (pPage == head)
+        head = pPage->pNext;
+    pPage->pNext = pPage->pPrev = 0;
+
+    if (pPage->bActive)
+        --m_nActivePages;
+    else
+        --m_nInactivePages;
+}
+
+bool Cache::testAndClearReferenced(CachePage *pPage)
+{
+    bool bReferenced = pPage->bReferenced;
+    pPage->bReferenced = false;
+
+#ifndef STANDALONE_CACHE
+    // Most cache users copy to and from the page directly rather than going
+    // through lookup(), which only the accessed bit sees.
+    if (VirtualAddressSpace::getKernelAddressSpace().clearAccessed(
+            reinterpret_cast<void *>(pPage->location)))
+    {
+        bReferenced = true;
+    }
+#endif
+
+    return bReferenced;
 }
 
 void Cache::calculateChecksum(CachePage *pPage)
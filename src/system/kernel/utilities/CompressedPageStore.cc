@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/utilities/CompressedPageStore.h"
+#include "pedigree/kernel/LockGuard.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+const size_t CompressedPageStore::PageSize;
+const size_t CompressedPageStore::ClassSize;
+const size_t CompressedPageStore::MaxObjectSize;
+const size_t CompressedPageStore::MaxZspagePages;
+const size_t CompressedPageStore::HandleBits;
+
+CompressedPageStore::CompressedPageStore(size_t pageLimit)
+    : m_Lock(false), m_PageLimit(pageLimit), m_Zspages(), m_FreeIndices(),
+      m_Partial(), m_StoredPages(0), m_CompressedBytes(0), m_BackingPages(0),
+      m_Incompressible(0), m_Rejected(0), m_Scratch(), m_HashTable()
+{
+}
+
+CompressedPageStore::~CompressedPageStore()
+{
+    for (size_t i = 0; i < m_Zspages.count(); ++i)
+    {
+        Zspage *pZspage = reinterpret_cast<Zspage *>(m_Zspages[i]);
+        if (pZspage)
+        {
+            delete[] pZspage->data;
+            delete pZspage;
+        }
+    }
+}
+
+void CompressedPageStore::setPageLimit(size_t pageLimit)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+    m_PageLimit = pageLimit;
+}
+
+CompressedPageStore::Handle CompressedPageStore::store(const void *page)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    size_t length =
+        lz4::compress(page, PageSize, m_Scratch, MaxObjectSize, m_HashTable);
+    if (!length)
+    {
+        ++m_Incompressible;
+        return 0;
+    }
+
+    size_t sizeClass = (length + sizeof(SlotHeader) - 1) / ClassSize;
+
+    Zspage *pZspage = m_Partial[sizeClass];
+    if (!pZspage)
+    {
+        pZspage = newZspage(sizeClass);
+        if (!pZspage)
+        {
+            ++m_Rejected;
+            return 0;
+        }
+    }
+
+    size_t slot = pZspage->freeHead;
+    SlotHeader *pHeader = reinterpret_cast<SlotHeader *>(
+        pZspage->data + (slot * slotSize(sizeClass)));
+    pZspage->freeHead = pHeader->refs;
+    pHeader->length = length;
+    pHeader->refs = 1;
+    MemoryCopy(pHeader + 1, m_Scratch, length);
+
+    if (++pZspage->inUse == pZspage->nSlots)
+    {
+        unlinkPartial(pZspage);
+    }
+
+    ++m_StoredPages;
+    m_CompressedBytes += length;
+
+    return ((pZspage->index + 1) << SlotBits) | slot;
+}
+
+bool CompressedPageStore::load(Handle handle, void *page)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    SlotHeader *pHeader = lookup(handle);
+    if (!pHeader)
+    {
+        return false;
+    }
+
+    return lz4::decompress(pHeader + 1, pHeader->length, page, PageSize) ==
+           PageSize;
+}
+
+void CompressedPageStore::share(Handle handle)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    SlotHeader *pHeader = lookup(handle);
+    if (pHeader)
+    {
+        ++pHeader->refs;
+    }
+}
+
+void CompressedPageStore::release(Handle handle)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    Zspage *pZspage = 0;
+    SlotHeader *pHeader = lookup(handle, &pZspage);
+    if (!pHeader || --pHeader->refs)
+    {
+        return;
+    }
+
+    --m_StoredPages;
+    m_CompressedBytes -= pHeader->length;
+
+    size_t slot = handle & ((1 << SlotBits) - 1);
+    pHeader->length = 0;
+    pHeader->refs = pZspage->freeHead;
+    pZspage->freeHead = slot;
+
+    if (pZspage->inUse-- == pZspage->nSlots)
+    {
+        linkPartial(pZspage);
+    }
+
+    if (!pZspage->inUse)
+    {
+        freeZspage(pZspage);
+    }
+}
+
+size_t CompressedPageStore::zspagePages(size_t sizeClass)
+{
+    size_t size = slotSize(sizeClass);
+
+    size_t best = 1;
+    size_t bestWaste = PageSize;
+    for (size_t n = 1; n <= MaxZspagePages; ++n)
+    {
+        // Compare waste per page.
+        size_t waste = ((n * PageSize) % size) / n;
+        if (waste < bestWaste)
+        {
+            best = n;
+            bestWaste = waste;
+        }
+    }
+
+    return best;
+}
+
+CompressedPageStore::Zspage *CompressedPageStore::newZspage(size_t sizeClass)
+{
+    size_t nPages = zspagePages(sizeClass);
+    if ((m_BackingPages + nPages) > m_PageLimit)
+    {
+        return 0;
+    }
+
+    uint8_t *data = new uint8_t[nPages * PageSize];
+    if (!data)
+    {
+        return 0;
+    }
+
+    Zspage *pZspage = new Zspage;
+    pZspage->data = data;
+    pZspage->sizeClass = sizeClass;
+    pZspage->nPages = nPages;
+    pZspage->nSlots = (nPages * PageSize) / slotSize(sizeClass);
+    pZspage->inUse = 0;
+    pZspage->freeHead = 0;
+    pZspage->prev = pZspage->next = 0;
+
+    // Thread every slot onto the free list.
+    for (size_t i = 0; i < pZspage->nSlots; ++i)
+    {
+        SlotHeader *pHeader =
+            reinterpret_cast<SlotHeader *>(data + (i * slotSize(sizeClass)));
+        pHeader->length = 0;
+        pHeader->refs = i + 1;
+    }
+
+    if (m_FreeIndices.count())
+    {
+        pZspage->index = m_FreeIndices.popBack();
+        m_Zspages.setAt(pZspage->index, pZspage);
+    }
+    else
+    {
+        pZspage->index = m_Zspages.count();
+        m_Zspages.pushBack(pZspage);
+    }
+
+    m_BackingPages += nPages;
+    linkPartial(pZspage);
+
+    return pZspage;
+}
+
+void CompressedPageStore::freeZspage(Zspage *pZspage)
+{
+    unlinkPartial(pZspage);
+
+    m_Zspages.setAt(pZspage->index, 0);
+    m_FreeIndices.pushBack(pZspage->index);
+    m_BackingPages -= pZspage->nPages;
+
+    delete[] pZspage->data;
+    delete pZspage;
+}
+
+void CompressedPageStore::linkPartial(Zspage *pZspage)
+{
+    Zspage *&pHead = m_Partial[pZspage->sizeClass];
+    pZspage->prev = 0;
+    pZspage->next = pHead;
+    if (pHead)
+    {
+        pHead->prev = pZspage;
+    }
+    pHead = pZspage;
+}
+
+void CompressedPageStore::unlinkPartial(Zspage *pZspage)
+{
+    Zspage *&pHead = m_Partial[pZspage->sizeClass];
+    if (pZspage->prev)
+    {
+        pZspage->prev->next = pZspage->next;
+    }
+    else if (pHead == pZspage)
+    {
+        pHead = pZspage->next;
+    }
+    else
+    {
+        // Not on the list (full).
+        return;
+    }
+
+    if (pZspage->next)
+    {
+        pZspage->next->prev = pZspage->prev;
+    }
+    pZspage->prev = pZspage->next = 0;
+}
+
+CompressedPageStore::SlotHeader *
+CompressedPageStore::lookup(Handle handle, Zspage **ppZspage)
+{
+    size_t index = handle >> SlotBits;
+    size_t slot = handle & ((1 << SlotBits) - 1);
+    if (!index || index > m_Zspages.count())
+    {
+        return 0;
+    }
+
+    Zspage *pZspage = reinterpret_cast<Zspage *>(m_Zspages[index - 1]);
+    if (!pZspage || slot >= pZspage->nSlots)
+    {
+        return 0;
+    }
+
+    SlotHeader *pHeader = reinterpret_cast<SlotHeader *>(
+        pZspage->data + (slot * slotSize(pZspage->sizeClass)));
+    if (!pHeader->length)
+    {
+        return 0;
+    }
+
+    if (ppZspage)
+    {
+        *ppZspage = pZspage;
+    }
+    return pHeader;
+}
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/utilities/FreePageCache.h"
+#include "pedigree/kernel/LockGuard.h"
+
+const size_t FreePageCache::Batch;
+const size_t FreePageCache::HighWatermark;
+
+FreePageCache::FreePageCache()
+    : m_Lock(false), m_pBackend(0), m_Count(0), m_Pages()
+{
+}
+
+FreePageCache::~FreePageCache()
+{
+    drain();
+}
+
+void FreePageCache::setBackend(Backend *pBackend)
+{
+    m_pBackend = pBackend;
+}
+
+physical_uintptr_t FreePageCache::allocate()
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    if (!m_Count && m_pBackend)
+    {
+        m_Count = m_pBackend->takePages(m_Pages, Batch);
+    }
+
+    if (!m_Count)
+    {
+        return 0;
+    }
+
+    return m_Pages[--m_Count];
+}
+
+size_t FreePageCache::allocate(physical_uintptr_t *pages, size_t count)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    size_t fromCache = count < m_Count ? count : m_Count;
+    m_Count -= fromCache;
+    for (size_t i = 0; i < fromCache; ++i)
+    {
+        pages[i] = m_Pages[m_Count + i];
+    }
+
+    size_t result = fromCache;
+    if (result < count && m_pBackend)
+    {
+        result += m_pBackend->takePages(pages + result, count - result);
+    }
+
+    return result;
+}
+
+void FreePageCache::free(physical_uintptr_t page)
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    if (m_Count == HighWatermark)
+    {
+        // Drain the oldest pages, leaving the most recently freed (and most
+        // likely to still be in the processor's caches) for reuse.
+        m_pBackend->returnPages(m_Pages, Batch);
+        m_Count -= Batch;
+        for (size_t i = 0; i < m_Count; ++i)
+        {
+            m_Pages[i] = m_Pages[i + Batch];
+        }
+    }
+
+    m_Pages[m_Count++] = page;
+}
+
+void FreePageCache::drain()
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    if (m_Count && m_pBackend)
+    {
+        m_pBackend->returnPages(m_Pages, m_Count);
+        m_Count = 0;
+    }
+}
@@ -20,8 +20,7 @@
 #include "pedigree/kernel/utilities/UnlikelyLock.h"
 #include "pedigree/kernel/LockGuard.h"
 
-UnlikelyLock::UnlikelyLock()
-    : m_Lock(false), m_Condition(), m_nReaders(0), m_bActiveWriter(false)
+UnlikelyLock::UnlikelyLock() : m_State(0), m_Lock(false), m_Condition()
 {
 }
 
@@ -31,40 +30,67 @@ UnlikelyLock::~UnlikelyLock()
 
 bool UnlikelyLock::enter()
 {
-    LockGuard<Mutex> guard(m_Lock);
-    while (m_bActiveWriter)
+    while (true)
     {
-        m_Condition.wait(m_Lock);
-    }
+        size_t state = m_State;
+        if (!(state & WriterBit))
+        {
+            if (m_State.compareAndSwap(state, state + 1))
+                return true;
 
-    ++m_nReaders;
-    return true;
+            continue;
+        }
+
+        // A writer holds the lock or is waiting for it - wait for it to be
+        // released before trying again.
+        LockGuard<Mutex> guard(m_Lock);
+        while (m_State & WriterBit)
+        {
+            m_Condition.wait(m_Lock);
+        }
+    }
 }
 
 void UnlikelyLock::leave()
 {
-    LockGuard<Mutex> guard(m_Lock);
-    if (!--m_nReaders)
+    // The last reader out lets a waiting writer in.
+    if ((m_State -= 1) == WriterBit)
     {
-        m_Condition.signal();
+        LockGuard<Mutex> guard(m_Lock);
+        m_Condition.broadcast();
     }
 }
 
 bool UnlikelyLock::acquire()
 {
     LockGuard<Mutex> guard(m_Lock);
-    while (m_bActiveWriter || m_nReaders)
+
+    // Claim the lock, which stops any more readers entering.
+    while (true)
+    {
+        size_t state = m_State;
+        if (state & WriterBit)
+        {
+            m_Condition.wait(m_Lock);
+        }
+        else if (m_State.compareAndSwap(state, state | WriterBit))
+        {
+            break;
+        }
+    }
+
+    // Wait for the readers that were already inside to leave.
+    while (m_State != WriterBit)
     {
         m_Condition.wait(m_Lock);
     }
 
-    m_bActiveWriter = true;
     return true;
 }
 
 void UnlikelyLock::release()
 {
     LockGuard<Mutex> guard(m_Lock);
-    m_bActiveWriter = false;
+    m_State -= WriterBit;
     m_Condition.broadcast();
 }
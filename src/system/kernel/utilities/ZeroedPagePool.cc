@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/utilities/ZeroedPagePool.h"
+#include "pedigree/kernel/LockGuard.h"
+
+const size_t ZeroedPagePool::Capacity;
+const size_t ZeroedPagePool::LowWatermark;
+const size_t ZeroedPagePool::Batch;
+
+ZeroedPagePool::ZeroedPagePool()
+    : m_Lock(false), m_pBackend(0), m_Count(0), m_Pages(), m_Hits(0),
+      m_Misses(0)
+{
+}
+
+ZeroedPagePool::~ZeroedPagePool()
+{
+    drain();
+}
+
+void ZeroedPagePool::setBackend(Backend *pBackend)
+{
+    m_pBackend = pBackend;
+}
+
+physical_uintptr_t ZeroedPagePool::allocate()
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    if (!m_Count)
+    {
+        ++m_Misses;
+        return 0;
+    }
+
+    ++m_Hits;
+    return m_Pages[--m_Count];
+}
+
+size_t ZeroedPagePool::refill()
+{
+    if (!m_pBackend)
+    {
+        return 0;
+    }
+
+    size_t added = 0;
+    while (true)
+    {
+        size_t wanted = 0;
+        {
+            LockGuard<Spinlock> guard(m_Lock);
+            wanted = Capacity - m_Count;
+        }
+
+        if (!wanted)
+        {
+            break;
+        }
+        else if (wanted > Batch)
+        {
+            wanted = Batch;
+        }
+
+        physical_uintptr_t pages[Batch];
+        size_t count = m_pBackend->takePages(pages, wanted);
+        if (!count)
+        {
+            break;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            m_pBackend->zeroPage(pages[i]);
+        }
+
+        // The pool may have been topped up (or drained) in the meantime.
+        size_t stored = 0;
+        {
+            LockGuard<Spinlock> guard(m_Lock);
+            for (; stored < count && m_Count < Capacity; ++stored)
+            {
+                m_Pages[m_Count++] = pages[stored];
+            }
+        }
+
+        added += stored;
+        if (stored < count)
+        {
+            m_pBackend->returnPages(pages + stored, count - stored);
+            break;
+        }
+        else if (count < wanted)
+        {
+            break;
+        }
+    }
+
+    return added;
+}
+
+void ZeroedPagePool::drain()
+{
+    LockGuard<Spinlock> guard(m_Lock);
+
+    if (m_Count && m_pBackend)
+    {
+        m_pBackend->returnPages(m_Pages, m_Count);
+        m_Count = 0;
+    }
+}
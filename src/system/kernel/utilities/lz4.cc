@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "pedigree/kernel/utilities/lz4.h"
+#include "pedigree/kernel/utilities/utility.h"
+
+/** log2(HashTableSize). */
+#define LZ4_HASH_BITS 12
+/** Shortest match worth encoding. */
+#define LZ4_MIN_MATCH 4
+/** The last bytes of a block are always literals. */
+#define LZ4_LAST_LITERALS 5
+/** No match may start this close to the end of a block. */
+#define LZ4_MATCH_FIND_LIMIT 12
+/** Misses in a row before the search starts skipping ahead. */
+#define LZ4_SKIP_TRIGGER 6
+
+namespace lz4
+{
+static inline uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    MemoryCopy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline size_t hash(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+/** Emit the extra bytes of a length that didn't fit in its token nibble. */
+static inline uint8_t *writeLength(uint8_t *op, size_t length)
+{
+    while (length >= 255)
+    {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = static_cast<uint8_t>(length);
+    return op;
+}
+
+size_t compress(
+    const void *src, size_t srcLen, void *dst, size_t dstLen,
+    uint16_t *table)
+{
+    if (srcLen > MaxInputSize)
+    {
+        return 0;
+    }
+
+    const uint8_t *base = reinterpret_cast<const uint8_t *>(src);
+    const uint8_t *ip = base;
+    const uint8_t *anchor = base;
+    const uint8_t *end = base + srcLen;
+    uint8_t *op = reinterpret_cast<uint8_t *>(dst);
+    uint8_t *oend = op + dstLen;
+
+    if (srcLen > LZ4_MATCH_FIND_LIMIT)
+    {
+        const uint8_t *mflimit = end - LZ4_MATCH_FIND_LIMIT;
+        const uint8_t *matchlimit = end - LZ4_LAST_LITERALS;
+
+        ByteSet(table, 0, HashTableSize * sizeof(uint16_t));
+
+        size_t misses = 0;
+        while (ip < mflimit)
+        {
+            uint32_t sequence = read32(ip);
+            size_t h = hash(sequence);
+            const uint8_t *ref = base + table[h];
+            table[h] = static_cast<uint16_t>(ip - base);
+
+            if (ref >= ip || read32(ref) != sequence)
+            {
+                // Incompressible data is skipped over faster and faster.
+                ip += 1 + (misses++ >> LZ4_SKIP_TRIGGER);
+                continue;
+            }
+            misses = 0;
+
+            const uint8_t *matchEnd = ip + LZ4_MIN_MATCH;
+            const uint8_t *refEnd = ref + LZ4_MIN_MATCH;
+            while (matchEnd < matchlimit && *matchEnd == *refEnd)
+            {
+                ++matchEnd;
+                ++refEnd;
+            }
+
+            size_t literals = ip - anchor;
+            size_t matchLength = matchEnd - ip - LZ4_MIN_MATCH;
+            size_t offset = ip - ref;
+
+            // Token, literals and their length, offset, match length.
+            if (static_cast<size_t>(oend - op) <
+                (1 + (literals / 255) + 1 + literals + 2 + (matchLength / 255) +
+                 1))
+            {
+                return 0;
+            }
+
+            uint8_t *token = op++;
+            if (literals >= 15)
+            {
+                *token = 15 << 4;
+                op = writeLength(op, literals - 15);
+            }
+            else
+            {
+                *token = literals << 4;
+            }
+
+            MemoryCopy(op, anchor, literals);
+            op += literals;
+
+            *op++ = offset & 0xFF;
+            *op++ = (offset >> 8) & 0xFF;
+
+            if (matchLength >= 15)
+            {
+                *token |= 15;
+                op = writeLength(op, matchLength - 15);
+            }
+            else
+            {
+                *token |= matchLength;
+            }
+
+            ip = anchor = matchEnd;
+        }
+    }
+
+    // Whatever is left over goes out as literals.
+    size_t literals = end - anchor;
+    if (static_cast<size_t>(oend - op) <
+        (1 + (literals / 255) + 1 + literals))
+    {
+        return 0;
+    }
+
+    uint8_t *token = op++;
+    if (literals >= 15)
+    {
+        *token = 15 << 4;
+        op = writeLength(op, literals - 15);
+    }
+    else
+    {
+        *token = literals << 4;
+    }
+
+    MemoryCopy(op, anchor, literals);
+    op += literals;
+
+    return op - reinterpret_cast<uint8_t *>(dst);
+}
+
+size_t decompress(const void *src, size_t srcLen, void *dst, size_t dstLen)
+{
+    const uint8_t *ip = reinterpret_cast<const uint8_t *>(src);
+    const uint8_t *iend = ip + srcLen;
+    uint8_t *base = reinterpret_cast<uint8_t *>(dst);
+    uint8_t *op = base;
+    uint8_t *oend = op + dstLen;
+
+    while (ip < iend)
+    {
+        uint8_t token = *ip++;
+
+        size_t literals = token >> 4;
+        if (literals == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (ip >= iend)
+                {
+                    return 0;
+                }
+                b = *ip++;
+                literals += b;
+            } while (b == 255);
+        }
+
+        if (literals > static_cast<size_t>(iend - ip) ||
+            literals > static_cast<size_t>(oend - op))
+        {
+            return 0;
+        }
+
+        MemoryCopy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        // The last sequence has no match.
+        if (ip == iend)
+        {
+            break;
+        }
+
+        if ((iend - ip) < 2)
+        {
+            return 0;
+        }
+
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!offset || offset > static_cast<size_t>(op - base))
+        {
+            return 0;
+        }
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15)
+        {
+            uint8_t b;
+            do
+            {
+                if (ip >= iend)
+                {
+                    return 0;
+                }
+                b = *ip++;
+                matchLength += b;
+            } while (b == 255);
+        }
+        matchLength += LZ4_MIN_MATCH;
+
+        if (matchLength > static_cast<size_t>(oend - op))
+        {
+            return 0;
+        }
+
+        const uint8_t *ref = op - offset;
+        if (offset >= matchLength)
+        {
+            MemoryCopy(op, ref, matchLength);
+            op += matchLength;
+        }
+        else
+        {
+            // Overlapping match, which repeats the last offset bytes.
+            for (size_t i = 0; i < matchLength; ++i)
+            {
+                *op++ = *ref++;
+            }
+        }
+    }
+
+    return op - base;
+}
+}  // namespace lz4
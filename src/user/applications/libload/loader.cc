@@ -868,12 +868,18 @@ bool loadObject(const char *filename, object_meta_t *meta, bool envpath)
                     }
 
                     int map_fd = fd;
+                    size_t map_len = mapsz;
                     if ((meta->phdrs[i].flags & PF_W) == 0)
                     {
-                        // If the program header is read-only, we can quite
-                        // happily share the mapping and reduce memory
-                        // usage across the system.
-                        mapflags &= ~(MAP_PRIVATE);
+                        // Read-only program headers are shared with every
+                        // other process using this object through the page
+                        // cache, as long as nothing writes to them. Private
+                        // mappings keep it that way: a text relocation only
+                        // copies the pages it touches, and never reaches the
+                        // file. Cover the whole of the last page, so that it
+                        // can be shared too rather than copied to zero out
+                        // whatever follows in the file.
+                        map_len = (mapsz + pagesz - 1) & ~(pagesz - 1);
                     }
 
                     // Zero out additional space.
@@ -921,7 +927,7 @@ bool loadObject(const char *filename, object_meta_t *meta, bool envpath)
                     }
 
                     void *p = mmap(
-                        (void *) phdr_base, mapsz, PROT_READ | PROT_WRITE,
+                        (void *) phdr_base, map_len, PROT_READ | PROT_WRITE,
                         mapflags, map_fd, map_fd ? offset : 0);
                     if (p == MAP_FAILED)
                     {
@@ -934,7 +940,7 @@ bool loadObject(const char *filename, object_meta_t *meta, bool envpath)
                     }
 
                     meta->memory_regions.push_back(
-                        std::pair<void *, size_t>(p, mapsz));
+                        std::pair<void *, size_t>(p, map_len));
                 }
             }
         }
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Measures the cost of starting a short-lived child the way a shell or make
+// does: with fork() and execve(), with vfork() and execve(), and with
+// posix_spawn(). The child is this program again, told to exit straight
+// away, with its stdin redirected from /dev/null. The parent can dirty some
+// memory first, as fork() has to copy the mappings of a big parent.
+
+extern char **environ;
+
+static size_t g_nRounds = 1000;
+static size_t g_nResidentMegabytes = 0;
+static const char *g_pTarget = 0;
+
+static char *g_ChildArgv[] = {0, "--child", 0};
+
+static uint64_t monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+static int compareTimes(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+/** Runs in the child after fork() or vfork(); may only exec or _exit. */
+static void execChild()
+{
+    int fd = open("/dev/null", O_RDONLY);
+    if (fd >= 0 && fd != 0)
+    {
+        dup2(fd, 0);
+        close(fd);
+    }
+    execvp(g_pTarget, g_ChildArgv);
+    _exit(127);
+}
+
+static pid_t startFork()
+{
+    pid_t pid = fork();
+    if (pid == 0)
+        execChild();
+    return pid;
+}
+
+static pid_t startVfork()
+{
+    pid_t pid = vfork();
+    if (pid == 0)
+        execChild();
+    return pid;
+}
+
+static pid_t startSpawn()
+{
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+
+    pid_t pid = -1;
+    int err = posix_spawnp(&pid, g_pTarget, &fa, 0, g_ChildArgv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    if (err)
+    {
+        errno = err;
+        return -1;
+    }
+    return pid;
+}
+
+static void run(const char *name, pid_t (*start)())
+{
+    uint64_t *times = malloc(g_nRounds * sizeof(uint64_t));
+    uint64_t total = 0;
+
+    for (size_t i = 0; i < g_nRounds; ++i)
+    {
+        uint64_t begin = monotonicTime();
+        pid_t pid = start();
+        if (pid < 0)
+        {
+            fprintf(stderr, "spawnbench: %s failed: %s\n", name,
+                    strerror(errno));
+            free(times);
+            return;
+        }
+
+        int status = 0;
+        waitpid(pid, &status, 0);
+        times[i] = monotonicTime() - begin;
+        total += times[i];
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status))
+        {
+            fprintf(stderr, "spawnbench: %s child failed (status %x)\n", name,
+                    status);
+            free(times);
+            return;
+        }
+    }
+
+    qsort(times, g_nRounds, sizeof(uint64_t), compareTimes);
+    printf("%-12s %zd children in %llu ms, %.0f/s; p50 %.1f us, p90 %.1f us, "
+           "p99 %.1f us\n",
+           name, g_nRounds, (unsigned long long) (total / 1000000),
+           g_nRounds / (total / 1e9), times[g_nRounds / 2] / 1e3,
+           times[(g_nRounds * 9) / 10] / 1e3,
+           times[(g_nRounds * 99) / 100] / 1e3);
+
+    free(times);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(
+        stderr, "usage: %s [--rounds N] [--resident MB]\n"
+                "  --rounds    children to start with each method\n"
+                "  --resident  megabytes of memory to dirty in the parent\n",
+        argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        {"rounds", required_argument, 0, 'r'},
+        {"resident", required_argument, 0, 'm'},
+        {"child", no_argument, 0, 'c'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}};
+
+    int c;
+    while ((c = getopt_long(argc, argv, "r:m:h", long_options, 0)) != -1)
+    {
+        switch (c)
+        {
+            case 'r':
+                g_nRounds = strtoul(optarg, 0, 0);
+                break;
+            case 'm':
+                g_nResidentMegabytes = strtoul(optarg, 0, 0);
+                break;
+            case 'c':
+                return 0;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (!g_nRounds)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    g_pTarget = g_ChildArgv[0] = argv[0];
+
+    char *resident = 0;
+    if (g_nResidentMegabytes)
+    {
+        size_t size = g_nResidentMegabytes << 20;
+        resident = malloc(size);
+        if (!resident)
+        {
+            fprintf(stderr, "spawnbench: could not allocate %zd MB\n",
+                    g_nResidentMegabytes);
+            return 1;
+        }
+        memset(resident, 0xAB, size);
+    }
+
+    printf("spawnbench: %zd MB resident in the parent\n", g_nResidentMegabytes);
+
+    run("fork+exec", startFork);
+    run("vfork+exec", startVfork);
+    run("posix_spawn", startSpawn);
+
+    free(resident);
+    return 0;
+}
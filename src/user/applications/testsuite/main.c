@@ -19,10 +19,14 @@
 
 #include <setjmp.h>
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 
 extern void test_mprotect();
 extern void test_fs();
+extern void test_sharing(const char *self);
+extern void sharing_child();
+extern void test_swap();
 
 static jmp_buf buf;
 
@@ -35,6 +39,11 @@ void fail()
 
 int main(int argc, char *argv[])
 {
+    if (argc > 1 && !strcmp(argv[1], "--sharing-child"))
+    {
+        sharing_child();
+    }
+
     if (setjmp(buf) == 1)
     {
         printf("FAILED\n");
@@ -46,6 +55,8 @@ int main(int argc, char *argv[])
     // Add calls to test functions here...
     test_mprotect();
     test_fs();
+    test_sharing(argv[0]);
+    test_swap();
 
     printf("Tests complete!\n");
     return 0;
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <elf.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define NUM_COPIES 8
+
+#if __SIZEOF_POINTER__ == 8
+typedef Elf64_Ehdr Ehdr;
+typedef Elf64_Phdr Phdr;
+#else
+typedef Elf32_Ehdr Ehdr;
+typedef Elf32_Phdr Phdr;
+#endif
+
+extern void fail();
+
+static void status(const char *s)
+{
+    fputs(s, stdout);
+    fflush(stdout);
+}
+
+/** Free memory in pages, as seen by /proc/meminfo. */
+static long free_pages()
+{
+    char line[128];
+    long kb = -1;
+
+    // meminfo is refreshed once a second.
+    sleep(2);
+
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (!fp)
+        return -1;
+
+    while (fgets(line, sizeof line, fp))
+    {
+        if (sscanf(line, "MemFree: %ld kB", &kb) == 1)
+            break;
+    }
+
+    fclose(fp);
+    return kb < 0 ? -1 : kb / 4;
+}
+
+/** Pages spanned by the read-only PT_LOAD segments of an ELF file: what a
+ *  process would hold for itself if its text were not shared. */
+static long text_pages(const char *path)
+{
+    Ehdr ehdr;
+    Phdr phdr;
+    long pages = 0;
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return 0;
+
+    if (fread(&ehdr, sizeof ehdr, 1, fp) != 1 ||
+        memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0)
+    {
+        fclose(fp);
+        return 0;
+    }
+
+    for (size_t i = 0; i < ehdr.e_phnum; ++i)
+    {
+        if (fseek(fp, ehdr.e_phoff + i * ehdr.e_phentsize, SEEK_SET) != 0 ||
+            fread(&phdr, sizeof phdr, 1, fp) != 1)
+            break;
+
+        if (phdr.p_type != PT_LOAD || (phdr.p_flags & PF_W) || !phdr.p_filesz)
+            continue;
+
+        unsigned long start = phdr.p_vaddr & ~4095UL;
+        unsigned long end = (phdr.p_vaddr + phdr.p_filesz + 4095) & ~4095UL;
+        pages += (end - start) / 4096;
+    }
+
+    fclose(fp);
+    return pages;
+}
+
+/** Run by each copy: say we're up, then wait to be killed. */
+void sharing_child()
+{
+    char c = 'X';
+    write(1, &c, 1);
+
+    while (1)
+        pause();
+}
+
+void test_sharing(const char *self)
+{
+    pid_t children[NUM_COPIES];
+    int fds[2];
+
+    printf("Testing sharing of program images...\n");
+
+    // We may have been found through PATH.
+    if (!strchr(self, '/'))
+        self = "/applications/testsuite";
+
+    // What each copy would cost on top of its own data if the text of its
+    // program and libraries were not shared.
+    long image_pages = text_pages(self) + text_pages("/libraries/libc.so") +
+                       text_pages("/libraries/libload.so");
+    if (!image_pages)
+        fail();
+
+    status("Measuring free memory... ");
+    long before = free_pages();
+    if (before < 0)
+        fail();
+    printf("%ld pages\n", before);
+
+    if (pipe(fds) != 0)
+        fail();
+
+    status("Starting copies... ");
+    for (size_t i = 0; i < NUM_COPIES; ++i)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+            fail();
+        else if (pid == 0)
+        {
+            close(fds[0]);
+            dup2(fds[1], 1);
+            execl(self, self, "--sharing-child", (char *) 0);
+            _exit(1);
+        }
+
+        children[i] = pid;
+    }
+    close(fds[1]);
+
+    // Wait for every copy to have loaded.
+    for (size_t i = 0; i < NUM_COPIES; ++i)
+    {
+        char c;
+        if (read(fds[0], &c, 1) != 1)
+            fail();
+    }
+    close(fds[0]);
+    status("OK\n");
+
+    status("Measuring free memory... ");
+    long after = free_pages();
+    printf("%ld pages\n", after);
+
+    for (size_t i = 0; i < NUM_COPIES; ++i)
+    {
+        kill(children[i], SIGKILL);
+        waitpid(children[i], 0, 0);
+    }
+
+    long per_copy = (before - after) / NUM_COPIES;
+    printf(
+        "Each copy used %ld pages, its text is %ld pages\n", per_copy,
+        image_pages);
+
+    // Only the pages a copy writes to (data, relocations, its stack and
+    // heap) should be its own. Without sharing, each copy would need all of
+    // its text on top of those, so it would use more than image_pages.
+    status("Checking images are shared... ");
+    if (after < 0 || per_copy >= image_pages)
+        fail();
+    status("OK\n");
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/** Most free memory, in kB, that this test will try to exhaust. */
+#define SWAP_TEST_MAX_FREE_KB (256 * 1024)
+
+/** How far past free memory to go, in pages. */
+#define SWAP_TEST_OVERCOMMIT_PAGES 4096
+
+extern void fail();
+
+static void status(const char *s)
+{
+    fputs(s, stdout);
+    fflush(stdout);
+}
+
+/** A counter from /proc/meminfo, or -1 if it isn't there. */
+static long meminfo(const char *key)
+{
+    char line[128];
+    char name[64];
+    long value;
+
+    // meminfo is refreshed once a second.
+    sleep(2);
+
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (!fp)
+        return -1;
+
+    while (fgets(line, sizeof line, fp))
+    {
+        if (sscanf(line, "%63[^:]: %ld", name, &value) == 2 &&
+            !strcmp(name, key))
+        {
+            fclose(fp);
+            return value;
+        }
+    }
+
+    fclose(fp);
+    return -1;
+}
+
+/** The word filling page i - compressible, and different for every page. */
+static unsigned long pattern(size_t i)
+{
+    return (i * 0x9E3779B9UL) ^ 0xA5A5A5A5UL;
+}
+
+void test_swap()
+{
+    printf("Testing swapping of anonymous memory...\n");
+
+    status("Measuring free memory... ");
+    long free_kb = meminfo("MemFree");
+    long swap_outs = meminfo("SwapOuts");
+    long swap_ins = meminfo("SwapIns");
+    if (free_kb < 0 || swap_outs < 0 || swap_ins < 0)
+        fail();
+    printf("%ld kB\n", free_kb);
+
+    // Filling gigabytes takes too long to be worth it. Hosted builds can be
+    // given less memory with HOSTED_PHYSICAL_MEMORY_SIZE.
+    if (free_kb > SWAP_TEST_MAX_FREE_KB)
+    {
+        printf("Too much free memory to run out of, skipping\n");
+        return;
+    }
+
+    size_t npages = free_kb / 4 + SWAP_TEST_OVERCOMMIT_PAGES;
+    size_t words = 4096 / sizeof(unsigned long);
+
+    status("Filling more than free memory... ");
+    unsigned long *p = mmap(
+        0, npages * 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+        -1, 0);
+    if (p == MAP_FAILED)
+        fail();
+
+    for (size_t i = 0; i < npages; ++i)
+    {
+        for (size_t j = 0; j < words; ++j)
+            p[i * words + j] = pattern(i);
+    }
+    status("OK\n");
+
+    status("Checking contents... ");
+    for (size_t i = 0; i < npages; ++i)
+    {
+        for (size_t j = 0; j < words; ++j)
+        {
+            if (p[i * words + j] != pattern(i))
+            {
+                printf("page %zu differs\n", i);
+                fail();
+            }
+        }
+    }
+    status("OK\n");
+
+    munmap(p, npages * 4096);
+
+    long new_outs = meminfo("SwapOuts");
+    long new_ins = meminfo("SwapIns");
+    printf(
+        "Swapped out %ld pages, swapped in %ld pages\n", new_outs - swap_outs,
+        new_ins - swap_ins);
+
+    // Everything fitted somewhere, so some of it must have been swapped out
+    // and back in again to be checked.
+    status("Checking pages were swapped... ");
+    if (new_outs <= swap_outs || new_ins <= swap_ins)
+        fail();
+    status("OK\n");
+}
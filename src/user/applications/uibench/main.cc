@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <MessageRing.h>
+#include <protocol.h>
+
+// Measures the cost of moving window manager messages between two threads,
+// once over a datagram socket pair (as libui did before message rings) and
+// once through a MessageRing with the socket pair only used as a doorbell.
+// Each side receives the same way libui and winman do: rings first, then
+// select() and recv() on the socket.
+
+using namespace LibUiProtocol;
+
+static size_t g_nMessages = 200000;
+static size_t g_nRounds = 10000;
+
+/// Messages the sender may have outstanding in the message rate run, which
+/// keeps the run within a ring and within the socket's buffer.
+static const size_t g_nWindow = 256;
+
+static uint64_t monotonicTime()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/** One end of a connection between the window manager and a widget. */
+class Endpoint
+{
+  public:
+    Endpoint(int fd, MessageRing *pTx, MessageRing *pRx)
+        : m_Fd(fd), m_pTx(pTx), m_pRx(pRx), m_nDoorbells(0)
+    {
+    }
+
+    bool send(const void *pMessage, size_t length)
+    {
+        bool bDoorbell = false;
+        if (!m_pTx || !m_pTx->push(pMessage, length, bDoorbell))
+        {
+            return ::send(m_Fd, pMessage, length, 0) == ssize_t(length);
+        }
+
+        if (bDoorbell)
+        {
+            WindowManagerMessage doorbell;
+            memset(&doorbell, 0, sizeof(doorbell));
+            doorbell.messageCode = Nothing;
+            ::send(m_Fd, &doorbell, sizeof(doorbell), 0);
+            ++m_nDoorbells;
+        }
+
+        return true;
+    }
+
+    bool recv(void *pBuffer, size_t maxLength)
+    {
+        while (true)
+        {
+            size_t length = 0;
+            if (m_pRx && m_pRx->pop(pBuffer, maxLength, length))
+            {
+                return true;
+            }
+
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(m_Fd, &fds);
+            if (select(m_Fd + 1, &fds, 0, 0, 0) <= 0)
+            {
+                continue;
+            }
+
+            if (::recv(m_Fd, pBuffer, maxLength, 0) <= 0)
+            {
+                return false;
+            }
+
+            WindowManagerMessage *pHeader =
+                reinterpret_cast<WindowManagerMessage *>(pBuffer);
+            if (!m_pRx || pHeader->messageCode != Nothing)
+            {
+                return true;
+            }
+        }
+    }
+
+    size_t getDoorbells() const
+    {
+        return m_nDoorbells;
+    }
+
+  private:
+    int m_Fd;
+    MessageRing *m_pTx;
+    MessageRing *m_pRx;
+    size_t m_nDoorbells;
+};
+
+/** A key event, as winman sends them, with a send timestamp as the key. */
+struct KeyMessage
+{
+    WindowManagerMessage header;
+    KeyEventMessage event;
+};
+
+struct Connection
+{
+    Endpoint *pWindowManager;
+    Endpoint *pWidget;
+    std::vector<uint64_t> latencies;
+};
+
+static void fillKey(KeyMessage &msg, uint64_t key)
+{
+    memset(&msg, 0, sizeof(msg));
+    msg.header.messageCode = KeyEvent;
+    msg.header.widgetHandle = 1;
+    msg.header.messageSize = sizeof(msg.event);
+    msg.event.state = Up;
+    msg.event.key = key;
+}
+
+static void sendAck(Endpoint *pEndpoint, MessageIdentifiers code)
+{
+    WindowManagerMessage ack;
+    memset(&ack, 0, sizeof(ack));
+    ack.messageCode = code;
+    ack.widgetHandle = 1;
+    ack.isResponse = true;
+    pEndpoint->send(&ack, sizeof(ack));
+}
+
+/** Widget side of the message rate run: acknowledge every half window. */
+static void *rateWidget(void *p)
+{
+    Connection *pConn = reinterpret_cast<Connection *>(p);
+    char buffer[4096];
+    for (size_t i = 1; i <= g_nMessages; ++i)
+    {
+        if (!pConn->pWidget->recv(buffer, sizeof(buffer)))
+            break;
+        if ((i % (g_nWindow / 2)) == 0 || i == g_nMessages)
+            sendAck(pConn->pWidget, Sync);
+    }
+    return 0;
+}
+
+/** Widget side of the latency run: note the delivery time and reply. */
+static void *latencyWidget(void *p)
+{
+    Connection *pConn = reinterpret_cast<Connection *>(p);
+    char buffer[4096];
+    for (size_t i = 0; i < g_nRounds; ++i)
+    {
+        if (!pConn->pWidget->recv(buffer, sizeof(buffer)))
+            break;
+        uint64_t now = monotonicTime();
+        KeyMessage *pKey = reinterpret_cast<KeyMessage *>(buffer);
+        pConn->latencies.push_back(now - pKey->event.key);
+        sendAck(pConn->pWidget, RequestRedraw);
+    }
+    return 0;
+}
+
+static void messageRate(const char *name, Connection &conn)
+{
+    pthread_t widget;
+    pthread_create(&widget, 0, rateWidget, &conn);
+
+    char buffer[4096];
+    KeyMessage msg;
+    size_t acked = 0;
+
+    uint64_t start = monotonicTime();
+    for (size_t i = 0; i < g_nMessages; ++i)
+    {
+        while (i - acked >= g_nWindow)
+        {
+            conn.pWindowManager->recv(buffer, sizeof(buffer));
+            acked += g_nWindow / 2;
+        }
+
+        fillKey(msg, i);
+        conn.pWindowManager->send(&msg, sizeof(msg));
+    }
+    while (acked < g_nMessages)
+    {
+        conn.pWindowManager->recv(buffer, sizeof(buffer));
+        acked += g_nWindow / 2;
+    }
+    uint64_t elapsed = monotonicTime() - start;
+
+    pthread_join(widget, 0);
+
+    printf(
+        "%-8s rate: %zd messages in %llu ms, %.0f messages/s\n", name,
+        g_nMessages, (unsigned long long) (elapsed / 1000000),
+        g_nMessages / (elapsed / 1e9));
+}
+
+static void inputLatency(const char *name, Connection &conn)
+{
+    conn.latencies.clear();
+    conn.latencies.reserve(g_nRounds);
+
+    pthread_t widget;
+    pthread_create(&widget, 0, latencyWidget, &conn);
+
+    char buffer[4096];
+    KeyMessage msg;
+    for (size_t i = 0; i < g_nRounds; ++i)
+    {
+        fillKey(msg, monotonicTime());
+        conn.pWindowManager->send(&msg, sizeof(msg));
+        conn.pWindowManager->recv(buffer, sizeof(buffer));
+    }
+
+    pthread_join(widget, 0);
+
+    std::vector<uint64_t> &v = conn.latencies;
+    if (v.empty())
+        return;
+    std::sort(v.begin(), v.end());
+    printf(
+        "%-8s input latency: p50 %.1f us, p90 %.1f us, p99 %.1f us, max "
+        "%.1f us\n",
+        name, v[v.size() / 2] / 1e3, v[(v.size() * 9) / 10] / 1e3,
+        v[(v.size() * 99) / 100] / 1e3, v.back() / 1e3);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(
+        stderr, "usage: %s [--messages N] [--rounds N]\n"
+                "  --messages  key events to send in the message rate run\n"
+                "  --rounds    key events to time in the input latency run\n",
+        argv0);
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        {"messages", required_argument, 0, 'm'},
+        {"rounds", required_argument, 0, 'r'},
+        {"help", no_argument, 0, 'h'},
+        {0, 0, 0, 0}};
+
+    int c;
+    while ((c = getopt_long(argc, argv, "m:r:h", long_options, 0)) != -1)
+    {
+        switch (c)
+        {
+            case 'm':
+                g_nMessages = strtoul(optarg, 0, 0);
+                break;
+            case 'r':
+                g_nRounds = strtoul(optarg, 0, 0);
+                break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) != 0)
+    {
+        fprintf(stderr, "uibench: socketpair failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    // Plain sockets, every message is a send() and a recv().
+    {
+        Endpoint windowManager(fds[0], 0, 0);
+        Endpoint widget(fds[1], 0, 0);
+        Connection conn;
+        conn.pWindowManager = &windowManager;
+        conn.pWidget = &widget;
+
+        messageRate("socket", conn);
+        inputLatency("socket", conn);
+    }
+
+    // Message rings, with the sockets left to carry doorbells.
+    {
+        void *pRegion = calloc(1, MessageRing::RegionSize);
+        MessageRing toWindowManager, toWidget;
+        toWindowManager.attach(pRegion, MessageRing::ToWindowManager);
+        toWidget.attach(pRegion, MessageRing::ToWidget);
+
+        Endpoint windowManager(fds[0], &toWidget, &toWindowManager);
+        Endpoint widget(fds[1], &toWindowManager, &toWidget);
+        Connection conn;
+        conn.pWindowManager = &windowManager;
+        conn.pWidget = &widget;
+
+        messageRate("ring", conn);
+        inputLatency("ring", conn);
+
+        printf(
+            "ring     doorbells: %zd from the window manager, %zd from the "
+            "widget\n",
+            windowManager.getDoorbells(), widget.getDoorbells());
+
+        free(pRegion);
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+
+    return 0;
+}
@@ -84,8 +84,21 @@ Window::Window(
     : m_Handle(handle), m_pParent(pParent), m_Framebuffer(0), m_Dirty(),
       m_bPendingDecoration(false), m_bFocus(false), m_bRefresh(true),
       m_nRegionWidth(0), m_nRegionHeight(0), m_Socket(sock), m_Sa(sa),
-      m_SaLen(sa_len)
+      m_SaLen(sa_len), m_pRingRegion(0), m_InboundRing(), m_OutboundRing()
 {
+    // Set up the message rings before anything is sent to the client. The
+    // client attaches once it has the Create response, and finds whatever
+    // was queued in the meantime waiting for it.
+    m_pRingRegion = new SharedBuffer(LibUiProtocol::MessageRing::RegionSize);
+    void *pRegion = m_pRingRegion->getBuffer();
+    if (pRegion)
+    {
+        memset(pRegion, 0, LibUiProtocol::MessageRing::RegionSize);
+        m_InboundRing.attach(
+            pRegion, LibUiProtocol::MessageRing::ToWindowManager);
+        m_OutboundRing.attach(pRegion, LibUiProtocol::MessageRing::ToWidget);
+    }
+
     refreshContext();
     m_pParent->addChild(this);
 }
@@ -96,6 +109,7 @@ Window::~Window()
 ///       the other side's reference to the same region... Refcount?
 #ifdef TARGET_LINUX
     delete m_Framebuffer;
+    delete m_pRingRegion;
 #endif
     delete m_Sa;
 }
@@ -178,10 +192,34 @@ void *Window::getFramebuffer() const
 }
 
 void Window::sendMessage(const char *msg, size_t len)
+{
+    bool bDoorbell = false;
+    if (!m_OutboundRing.push(msg, len, bDoorbell))
+    {
+        sendSocketMessage(msg, len);
+        return;
+    }
+
+    if (bDoorbell)
+    {
+        LibUiProtocol::WindowManagerMessage doorbell;
+        memset(&doorbell, 0, sizeof(doorbell));
+        doorbell.messageCode = LibUiProtocol::Nothing;
+        doorbell.widgetHandle = m_Handle;
+        sendSocketMessage((const char *) &doorbell, sizeof(doorbell));
+    }
+}
+
+void Window::sendSocketMessage(const char *msg, size_t len)
 {
     sendto(m_Socket, msg, len, 0, m_Sa, m_SaLen);
 }
 
+void *Window::getRingHandle() const
+{
+    return m_InboundRing.isAttached() ? m_pRingRegion->getHandle() : 0;
+}
+
 void Window::setDirty(PedigreeGraphics::Rect &dirty)
 {
     PedigreeGraphics::Rect &me = getDimensions();
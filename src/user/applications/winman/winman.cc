@@ -274,6 +274,13 @@ void handleMessage(char *messageData, struct sockaddr *src, socklen_t slen)
         LibUiProtocol::CreateMessage *pCreate =
             reinterpret_cast<LibUiProtocol::CreateMessage *>(
                 messageData + sizeof(LibUiProtocol::WindowManagerMessage));
+        if (!src)
+        {
+            klog(LOG_INFO, "winman: Create must come in over the socket");
+            return;
+        }
+
+        totalSize += sizeof(LibUiProtocol::CreateMessageResponse);
         char *responseData = new char[totalSize];
         memset(responseData, 0, totalSize);
 
@@ -311,9 +318,16 @@ void handleMessage(char *messageData, struct sockaddr *src, socklen_t slen)
         pHeader->messageSize = sizeof(LibUiProtocol::CreateMessageResponse);
         pHeader->isResponse = true;
 
+        LibUiProtocol::CreateMessageResponse *pResponse =
+            reinterpret_cast<LibUiProtocol::CreateMessageResponse *>(
+                responseData + sizeof(LibUiProtocol::WindowManagerMessage));
+        pResponse->ring_handle = pWindow->getRingHandle();
+        pResponse->ring_size = LibUiProtocol::MessageRing::RegionSize;
+
         g_Windows->insert(std::make_pair(pWinMan->widgetHandle, pWindow));
 
-        pWindow->sendMessage(responseData, totalSize);
+        // The client can't read the ring until it has this response.
+        pWindow->sendSocketMessage(responseData, totalSize);
 
         delete[] responseData;
     }
@@ -411,6 +425,47 @@ void handleMessage(char *messageData, struct sockaddr *src, socklen_t slen)
     }
 }
 
+/// Handles everything clients have left in their message rings. Each ring is
+/// left empty, which arms its doorbell for the next select(). Returns true if
+/// any messages were handled.
+bool drainRings()
+{
+    char msg[4096];
+
+    std::vector<uint64_t> handles;
+    for (std::map<uint64_t, Window *>::iterator it = g_Windows->begin();
+         it != g_Windows->end(); ++it)
+    {
+        handles.push_back(it->first);
+    }
+
+    bool bAny = false;
+    bool bHandled = true;
+    while (bHandled)
+    {
+        bHandled = false;
+        for (size_t i = 0; i < handles.size(); ++i)
+        {
+            // Look the window up again each time, handling a message may
+            // have destroyed it.
+            std::map<uint64_t, Window *>::iterator it =
+                g_Windows->find(handles[i]);
+            if (it == g_Windows->end())
+            {
+                continue;
+            }
+
+            if (it->second->recvMessage(msg, sizeof(msg)))
+            {
+                handleMessage(msg, 0, 0);
+                bHandled = bAny = true;
+            }
+        }
+    }
+
+    return bAny;
+}
+
 void checkForMessages()
 {
 #ifdef TARGET_LINUX
@@ -506,6 +561,8 @@ void checkForMessages()
     SDL_Delay(1);
 #endif
 
+    bool bHandledRings = drainRings();
+
     fd_set fds;
     FD_ZERO(&fds);
 
@@ -521,6 +578,12 @@ void checkForMessages()
     timeout = &tv;
 #endif
 
+    // Don't block if the rings gave us something to render.
+    if (bHandledRings)
+    {
+        timeout = &tv;
+    }
+
     // Do the deed - no timeout.
     int ret = select(nMax + 1, &fds, 0, 0, timeout);
     if (ret > 0)
@@ -537,8 +600,20 @@ void checkForMessages()
                 g_iSocket, msg, 4096, 0, (struct sockaddr *) &saddr, &slen);
             if (sz > 0)
             {
-                // Handle!
-                handleMessage(msg, (struct sockaddr *) &saddr, slen);
+                // Rings come first: a doorbell means one has just become
+                // non-empty, and a client only uses its socket alongside a
+                // ring once that ring has overflowed, so anything still in
+                // the ring is older than this message.
+                drainRings();
+
+                LibUiProtocol::WindowManagerMessage *pHeader =
+                    reinterpret_cast<LibUiProtocol::WindowManagerMessage *>(
+                        msg);
+                if (pHeader->messageCode != LibUiProtocol::Nothing)
+                {
+                    // Handle!
+                    handleMessage(msg, (struct sockaddr *) &saddr, slen);
+                }
             }
         }
 
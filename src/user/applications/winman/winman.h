@@ -31,6 +31,8 @@
 #include "pedigree/native/input/Input.h"
 #include "pedigree/native/ipc/Ipc.h"
 
+#include <MessageRing.h>
+
 #include <cairo/cairo.h>
 
 /** \addtogroup PedigreeGUI
@@ -238,8 +240,22 @@ class Window : public WObject
 
     void *getFramebuffer() const;
 
+    /** Sends a message to the client, via its message ring if possible. */
     virtual void sendMessage(const char *msg, size_t len);
 
+    /** Sends a message over the client's socket, bypassing the ring. */
+    void sendSocketMessage(const char *msg, size_t len);
+
+    /** Dequeues the next message the client left in its message ring. */
+    bool recvMessage(char *msg, size_t maxLen)
+    {
+        size_t len = 0;
+        return m_InboundRing.pop(msg, maxLen, len);
+    }
+
+    /** Handle for the client to map the message rings, or null if none. */
+    void *getRingHandle() const;
+
     uint64_t getHandle() const
     {
         return m_Handle;
@@ -305,6 +321,10 @@ class Window : public WObject
     int m_Socket;
     struct sockaddr *m_Sa;
     size_t m_SaLen;
+
+    SharedBuffer *m_pRingRegion;
+    LibUiProtocol::MessageRing m_InboundRing;
+    LibUiProtocol::MessageRing m_OutboundRing;
 };
 
 /**
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2008-2014, Pedigree Developers
+ *
+ * Please see the CONTRIB file in the root of the source tree for a full
+ * list of contributors.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBUI_MESSAGERING_H
+#define LIBUI_MESSAGERING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/** \addtogroup PedigreeGUI
+ *  @{
+ */
+
+namespace LibUiProtocol
+{
+/**
+ * Single-producer, single-consumer message queue living in memory shared
+ * between the window manager and one widget.
+ *
+ * A shared region holds one ring for each direction. Messages are copied
+ * once into the ring by the producer and once out of it by the consumer,
+ * with no system call on either side while both are busy.
+ *
+ * A consumer that finds its ring empty flags itself as waiting before it
+ * goes to sleep on its socket. The next push clears that flag and tells
+ * the producer to ring the doorbell (a Nothing message on the socket), so
+ * only a transition from empty to non-empty costs a system call.
+ *
+ * If a ring ever fills, the producer marks it overflowed and from then on
+ * sends everything over the socket. Everything still in the ring at that
+ * point predates the socket traffic, so a consumer receiving a real message
+ * on the socket must drain the ring before handling it.
+ */
+class MessageRing
+{
+  public:
+    /** Which ring in a shared region to attach to. */
+    enum Direction
+    {
+        ToWindowManager = 0,
+        ToWidget = 1
+    };
+
+    /** Bytes of message data in each ring (must be a power of two). */
+    static const size_t DataSize = 32768;
+
+    /** Size of the control block at the start of each ring. */
+    static const size_t HeaderSize = 256;
+
+    /** Size of a shared region holding both directions. */
+    static const size_t RegionSize = 2 * (HeaderSize + DataSize);
+
+    MessageRing() : m_pHeader(0), m_pData(0)
+    {
+    }
+
+    /**
+     * Attaches to one of the rings in a shared region. The window manager
+     * zeroes the region before handing it out, which is an empty ring.
+     */
+    void attach(void *pRegion, Direction which)
+    {
+        uint8_t *pBase = reinterpret_cast<uint8_t *>(pRegion) +
+                         (which * (HeaderSize + DataSize));
+        m_pHeader = reinterpret_cast<Header *>(pBase);
+        m_pData = pBase + HeaderSize;
+    }
+
+    void detach()
+    {
+        m_pHeader = 0;
+        m_pData = 0;
+    }
+
+    bool isAttached() const
+    {
+        return m_pHeader != 0;
+    }
+
+    /**
+     * Queues a message. Returns false if the message must go over the socket
+     * instead, either because the ring is not attached or it has overflowed.
+     * bDoorbell is set if the consumer is asleep and must be woken.
+     */
+    bool push(const void *pMessage, size_t length, bool &bDoorbell)
+    {
+        bDoorbell = false;
+        if (!m_pHeader)
+            return false;
+        if (__atomic_load_n(&m_pHeader->overflowed, __ATOMIC_RELAXED))
+            return false;
+
+        uint32_t recordSize = recordLength(length);
+        uint32_t tail = m_pHeader->tail;
+        uint32_t head = __atomic_load_n(&m_pHeader->head, __ATOMIC_ACQUIRE);
+        uint32_t offset = tail & (DataSize - 1);
+
+        // Records never wrap; if this one won't fit before the end of the
+        // ring, the remaining space is skipped.
+        uint32_t skip = 0;
+        if (offset + recordSize > DataSize)
+            skip = DataSize - offset;
+
+        if ((tail - head) + skip + recordSize > DataSize)
+        {
+            __atomic_store_n(&m_pHeader->overflowed, 1, __ATOMIC_RELEASE);
+            return false;
+        }
+
+        if (skip)
+        {
+            uint32_t marker = SkipMarker;
+            memcpy(m_pData + offset, &marker, sizeof(marker));
+            tail += skip;
+            offset = 0;
+        }
+
+        uint32_t length32 = length;
+        memcpy(m_pData + offset, &length32, sizeof(length32));
+        memcpy(m_pData + offset + sizeof(length32), pMessage, length);
+        __atomic_store_n(
+            &m_pHeader->tail, tail + recordSize, __ATOMIC_RELEASE);
+
+        // Pairs with the fence in pop() - either we see the waiting flag, or
+        // the consumer sees our new tail before it sleeps.
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&m_pHeader->waiting, __ATOMIC_RELAXED))
+        {
+            bDoorbell =
+                __atomic_exchange_n(&m_pHeader->waiting, 0, __ATOMIC_ACQ_REL);
+        }
+
+        return true;
+    }
+
+    /**
+     * Dequeues a message into pBuffer, truncating it to maxLength. If the
+     * ring is empty, flags the consumer as waiting so that the next push
+     * rings the doorbell, and returns false.
+     */
+    bool pop(void *pBuffer, size_t maxLength, size_t &length)
+    {
+        if (!m_pHeader)
+            return false;
+
+        uint32_t head = m_pHeader->head;
+        uint32_t tail = __atomic_load_n(&m_pHeader->tail, __ATOMIC_ACQUIRE);
+        if (head == tail)
+        {
+            __atomic_store_n(&m_pHeader->waiting, 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            tail = __atomic_load_n(&m_pHeader->tail, __ATOMIC_ACQUIRE);
+            if (head == tail)
+                return false;
+        }
+
+        uint32_t offset = head & (DataSize - 1);
+        uint32_t length32 = 0;
+        memcpy(&length32, m_pData + offset, sizeof(length32));
+        if (length32 == SkipMarker)
+        {
+            // A skip is always followed by a record at the start of the ring.
+            head += DataSize - offset;
+            offset = 0;
+            memcpy(&length32, m_pData, sizeof(length32));
+        }
+
+        length = length32;
+        memcpy(
+            pBuffer, m_pData + offset + sizeof(length32),
+            length < maxLength ? length : maxLength);
+        __atomic_store_n(
+            &m_pHeader->head, head + recordLength(length32), __ATOMIC_RELEASE);
+
+        return true;
+    }
+
+  private:
+    /** Shared control block. Producer and consumer fields are kept on
+     *  separate cache lines. */
+    struct Header
+    {
+        /// Consumer position, in bytes since the ring was created.
+        uint32_t head;
+        uint32_t waiting;
+        uint8_t pad0[56];
+
+        /// Producer position, in bytes since the ring was created.
+        uint32_t tail;
+        uint32_t overflowed;
+        uint8_t pad1[56];
+    };
+
+    static const uint32_t SkipMarker = ~0U;
+
+    /** Length header plus payload, rounded up to keep records aligned. */
+    static uint32_t recordLength(size_t length)
+    {
+        return (sizeof(uint32_t) + length + 7) & ~7U;
+    }
+
+    Header *m_pHeader;
+    uint8_t *m_pData;
+};
+};  // namespace LibUiProtocol
+
+/** @} */
+
+#endif
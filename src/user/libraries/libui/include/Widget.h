@@ -32,6 +32,8 @@
 
 #include "pedigree/native/graphics/Graphics.h"
 
+#include <MessageRing.h>
+
 #include <map>
 #include <queue>
 #include <string>
@@ -158,11 +160,23 @@ class Widget
 
     /**
      * Handles emptying the pending event queue and dispatch to callbacks
-     * for an application automatically.
+     * for an application automatically. Every event available at the time
+     * is dispatched, as events arriving through the message ring don't each
+     * leave the socket readable.
      */
     static void checkForEvents(bool bAsync = false);
 
   private:
+    /** Sends a message to the window manager, via the ring if possible. */
+    bool sendMessage(const char *pMessage, size_t length);
+
+    /**
+     * Fetches the next message for any widget, from the message rings first
+     * and then the sockets. Returns null if bAsync and nothing is waiting.
+     * The returned buffer must be freed with delete [].
+     */
+    static char *nextMessage(bool bAsync);
+
     /**
      * Waits for a message of the given type, queuing other messages along
      * the way.
@@ -205,12 +219,32 @@ class Widget
     PedigreeIpc::SharedIpcMessage *m_SharedFramebuffer;
 #endif
 
+#ifdef TARGET_LINUX
+    /** Shared memory region holding our message rings. */
+    SharedBuffer *m_pRingRegion;
+#else
+    /** IPC shared message holding our message rings. */
+    PedigreeIpc::SharedIpcMessage *m_pRingRegion;
+#endif
+
+    /** Messages to the window manager. */
+    LibUiProtocol::MessageRing m_OutboundRing;
+
+    /** Messages from the window manager. */
+    LibUiProtocol::MessageRing m_InboundRing;
+
     /** Handle -> Callback mapping. For event handler. */
     static std::map<uint64_t, Widget *> s_KnownWidgets;
 
     /** Queue of messages that have not yet been delivered to a callback. */
     static std::queue<char *> s_PendingMessages;
 
+    /**
+     * Messages received but not yet returned by nextMessage - a ring that
+     * overflowed is drained here ahead of the socket message that followed.
+     */
+    static std::queue<char *> s_ReceivedMessages;
+
     /** # of Widgets currently active. */
     static size_t s_NumWidgets;
 };
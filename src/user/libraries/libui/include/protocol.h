@@ -24,6 +24,7 @@
 
 #include "pedigree/native/graphics/Graphics.h"
 #include "pedigree/native/ipc/Ipc.h"
+#include <MessageRing.h>
 #include <Widget.h>
 
 /** \addtogroup PedigreeGUI
@@ -156,7 +157,8 @@ enum MessageIdentifiers
     NoFocus,
 
     /**
-     * Nothing: nothing at all.
+     * Nothing: nothing at all. Also sent as the doorbell for a MessageRing
+     * that has just become non-empty.
      */
     Nothing
 };
@@ -210,6 +212,12 @@ struct CreateMessage
 /** Create message response data. */
 struct CreateMessageResponse
 {
+    /// Handle for the shared MessageRing region, or null if all messages
+    /// for this widget are to go over its socket.
+    void *ring_handle;
+
+    /// Size of the shared MessageRing region.
+    size_t ring_size;
 };
 
 /** Reposition message data. */
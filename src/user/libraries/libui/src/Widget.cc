@@ -60,11 +60,13 @@ static bool defaultEventHandler(
 
 std::map<uint64_t, Widget *> Widget::s_KnownWidgets;
 std::queue<char *> Widget::s_PendingMessages;
+std::queue<char *> Widget::s_ReceivedMessages;
 size_t Widget::s_NumWidgets;
 
 Widget::Widget()
     : m_bConstructed(false), m_pFramebuffer(0), m_Handle(0),
-      m_EventCallback(defaultEventHandler), m_Socket(-1), m_SharedFramebuffer(0)
+      m_EventCallback(defaultEventHandler), m_Socket(-1), m_SharedFramebuffer(0),
+      m_pRingRegion(0), m_OutboundRing(), m_InboundRing()
 {
     ++s_NumWidgets;
 }
@@ -84,6 +86,13 @@ Widget::~Widget()
             delete[] p;
             Widget::s_PendingMessages.pop();
         }
+
+        while (!Widget::s_ReceivedMessages.empty())
+        {
+            char *p = Widget::s_ReceivedMessages.front();
+            delete[] p;
+            Widget::s_ReceivedMessages.pop();
+        }
     }
 }
 
@@ -214,7 +223,7 @@ bool Widget::setTitle(const std::string &newTitle)
     newTitle.copy(pMessage->newTitle, sizeof pMessage->newTitle);
 
     // Transmit.
-    bool result = send(m_Socket, messageData, totalSize, 0) == totalSize;
+    bool result = sendMessage(messageData, totalSize);
 
     // Clean up.
     delete[] messageData;
@@ -249,7 +258,7 @@ bool Widget::redraw(PedigreeGraphics::Rect &rt)
 
     // Transmit.
     bool bRet = false;
-    bRet = send(m_Socket, messageData, totalSize, 0) == totalSize;
+    bRet = sendMessage(messageData, totalSize);
     delete[] messageData;
 
     // Wait for an ACK message.
@@ -290,7 +299,7 @@ bool Widget::visibility(bool vis)
     pMessage->bVisible = vis;
 
     // Transmit.
-    bool result = send(m_Socket, messageData, totalSize, 0) == totalSize;
+    bool result = sendMessage(messageData, totalSize);
 
     // Clean up.
     delete[] messageData;
@@ -319,7 +328,7 @@ void Widget::destroy()
 
     // Transmit.
     /// \todo do we care if the send fails? We probably do??
-    send(m_Socket, messageData, totalSize, 0);
+    sendMessage(messageData, totalSize);
 
     // Clean up.
     delete[] messageData;
@@ -329,33 +338,65 @@ void Widget::destroy()
     Widget::checkForMessage(LibUiProtocol::Destroy, true);
 
     // Invalidate this widget now.
+    m_OutboundRing.detach();
+    m_InboundRing.detach();
     delete m_pFramebuffer;
     delete m_SharedFramebuffer;
+    delete m_pRingRegion;
     m_pFramebuffer = 0;
     m_SharedFramebuffer = 0;
+    m_pRingRegion = 0;
     m_Handle = 0;
 }
 
-void Widget::checkForEvents(bool bAsync)
+bool Widget::sendMessage(const char *pMessage, size_t length)
 {
-    bool bContinue = true;
+    bool bDoorbell = false;
+    if (!m_OutboundRing.push(pMessage, length, bDoorbell))
+    {
+        return send(m_Socket, pMessage, length, 0) == ssize_t(length);
+    }
+
+    if (bDoorbell)
+    {
+        WindowManagerMessage doorbell;
+        memset(&doorbell, 0, sizeof(doorbell));
+        doorbell.messageCode = Nothing;
+        doorbell.widgetHandle = m_Handle;
+        send(m_Socket, &doorbell, sizeof(doorbell), 0);
+    }
 
-    int max_fd = 0;
-    fd_set fds;
-    FD_ZERO(&fds);
+    return true;
+}
 
-    while (bContinue)
+char *Widget::nextMessage(bool bAsync)
+{
+    while (true)
     {
-        // Check for pending messages that we could handle easily.
-        if (Widget::handlePendingMessages())
-            return;  // Messages were handled, we're done here.
+        if (!s_ReceivedMessages.empty())
+        {
+            char *buffer = s_ReceivedMessages.front();
+            s_ReceivedMessages.pop();
+            return buffer;
+        }
 
         char *buffer = new char[4096];
+        size_t length = 0;
 
+        // Anything in a ring can be had without a system call. An empty ring
+        // arms its doorbell, so the select() below can't miss a message.
+        int max_fd = 0;
+        fd_set fds;
+        FD_ZERO(&fds);
         for (std::map<uint64_t, Widget *>::iterator it = s_KnownWidgets.begin();
              it != s_KnownWidgets.end(); ++it)
         {
             Widget *pWidget = it->second;
+            if (pWidget->m_InboundRing.pop(buffer, 4096, length))
+            {
+                return buffer;
+            }
+
             max_fd = std::max(max_fd, pWidget->getSocket());
             FD_SET(pWidget->getSocket(), &fds);
         }
@@ -365,33 +406,72 @@ void Widget::checkForEvents(bool bAsync)
 
         // Async - check and don't do anything if no message found.
         int nready = select(max_fd + 1, &fds, 0, 0, bAsync ? &tv : 0);
-        if (nready)
+        if (nready <= 0)
+        {
+            delete[] buffer;
+            if (bAsync)
+                return 0;
+            continue;
+        }
+
+        Widget *pSource = 0;
+        for (std::map<uint64_t, Widget *>::iterator it = s_KnownWidgets.begin();
+             it != s_KnownWidgets.end(); ++it)
         {
-            for (int i = 0; i <= max_fd; ++i)
+            Widget *pWidget = it->second;
+            if (FD_ISSET(pWidget->getSocket(), &fds))
             {
-                if (FD_ISSET(i, &fds))
+                if (recv(pWidget->getSocket(), buffer, 4096, 0) > 0)
                 {
-                    recv(i, buffer, 4096, 0);
-                    bContinue = false;
-                    break;
+                    pSource = pWidget;
                 }
+                break;
             }
         }
-        else if (bAsync)
+
+        LibUiProtocol::WindowManagerMessage *pHeader =
+            reinterpret_cast<LibUiProtocol::WindowManagerMessage *>(buffer);
+        if (!pSource || pHeader->messageCode == LibUiProtocol::Nothing)
         {
+            // Doorbell - the message itself is waiting in a ring.
             delete[] buffer;
-            break;
+            continue;
+        }
+
+        // A real message on the socket of a widget with a ring means the
+        // ring overflowed, and everything still in it is older.
+        char *older = new char[4096];
+        while (pSource->m_InboundRing.pop(older, 4096, length))
+        {
+            s_ReceivedMessages.push(older);
+            older = new char[4096];
         }
+        delete[] older;
+
+        s_ReceivedMessages.push(buffer);
+    }
+}
 
+void Widget::checkForEvents(bool bAsync)
+{
+    // Check for pending messages that we could handle easily.
+    if (Widget::handlePendingMessages())
+        return;  // Messages were handled, we're done here.
+
+    char *buffer = Widget::nextMessage(bAsync);
+    while (buffer)
+    {
         Widget::handleMessage(buffer);
         delete[] buffer;
+
+        // Anything else that has already arrived is handled too, as a ring
+        // only rings its doorbell once until it has been emptied.
+        buffer = Widget::nextMessage(true);
     }
 }
 
 void Widget::checkForMessage(size_t which, bool bResponse)
 {
-    bool bContinue = true;
-
     // Check for one that might be hiding in the pending messages queue.
     size_t messagesToCheck = s_PendingMessages.size();
     for (; messagesToCheck > 0; --messagesToCheck)
@@ -411,50 +491,9 @@ void Widget::checkForMessage(size_t which, bool bResponse)
         s_PendingMessages.push(buffer);
     }
 
-    int max_fd = 0;
-    fd_set fds;
-    FD_ZERO(&fds);
-
-    while (bContinue)
+    while (true)
     {
-        char *buffer = new char[4096];
-
-        for (std::map<uint64_t, Widget *>::iterator it = s_KnownWidgets.begin();
-             it != s_KnownWidgets.end(); ++it)
-        {
-            Widget *pWidget = it->second;
-            max_fd = std::max(max_fd, pWidget->getSocket());
-            FD_SET(pWidget->getSocket(), &fds);
-        }
-
-        struct timeval tv;
-        tv.tv_sec = tv.tv_usec = 0;
-
-        int nready = select(max_fd + 1, &fds, 0, 0, 0);
-        if (nready)
-        {
-            bool gotMessage = false;
-            for (int i = 0; i <= max_fd; ++i)
-            {
-                if (FD_ISSET(i, &fds))
-                {
-                    recv(i, buffer, 4096, 0);
-                    gotMessage = true;
-                    break;
-                }
-            }
-
-            if (!gotMessage)
-            {
-                delete[] buffer;
-                continue;
-            }
-        }
-        else
-        {
-            delete[] buffer;
-            continue;
-        }
+        char *buffer = Widget::nextMessage(false);
 
         LibUiProtocol::WindowManagerMessage *pHeader =
             reinterpret_cast<LibUiProtocol::WindowManagerMessage *>(buffer);
@@ -462,8 +501,8 @@ void Widget::checkForMessage(size_t which, bool bResponse)
         if (pHeader->messageCode == which && pHeader->isResponse == bResponse)
         {
             handleMessage(buffer);
-            bContinue = false;
             delete[] buffer;
+            break;
         }
         else
         {
@@ -498,6 +537,39 @@ void Widget::handleMessage(const char *pMessageBuffer)
 
     switch (pMessage->messageCode)
     {
+        case LibUiProtocol::Create:
+        {
+            const LibUiProtocol::CreateMessageResponse *pCreate =
+                reinterpret_cast<const LibUiProtocol::CreateMessageResponse *>(
+                    pMessageBuffer +
+                    sizeof(LibUiProtocol::WindowManagerMessage));
+            if (pMessage->messageSize < sizeof(*pCreate) ||
+                !pCreate->ring_handle ||
+                pCreate->ring_size < LibUiProtocol::MessageRing::RegionSize)
+            {
+                // No ring, everything goes over the socket.
+                break;
+            }
+
+#ifdef TARGET_LINUX
+            pWidget->m_pRingRegion =
+                new SharedBuffer(pCreate->ring_size, pCreate->ring_handle);
+#else
+            pWidget->m_pRingRegion = new PedigreeIpc::SharedIpcMessage(
+                pCreate->ring_size, pCreate->ring_handle);
+            pWidget->m_pRingRegion->initialise();
+#endif
+
+            void *pRegion = pWidget->m_pRingRegion->getBuffer();
+            if (pRegion)
+            {
+                pWidget->m_OutboundRing.attach(
+                    pRegion, LibUiProtocol::MessageRing::ToWindowManager);
+                pWidget->m_InboundRing.attach(
+                    pRegion, LibUiProtocol::MessageRing::ToWidget);
+            }
+            break;
+        }
         case LibUiProtocol::Reposition:
         {
             const LibUiProtocol::RepositionMessage *pReposition =
@@ -554,6 +626,8 @@ void Widget::handleMessage(const char *pMessageBuffer)
         case LibUiProtocol::Destroy:
             cb(::Terminate, 0, 0);
             break;
+        case LibUiProtocol::Nothing:
+            break;
         default:
             syslog(LOG_INFO, "** unknown event %d", pMessage->messageCode);
     }